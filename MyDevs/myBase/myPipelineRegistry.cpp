@@ -0,0 +1,299 @@
+/*
+* Graphics pipeline variant registry
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "myPipelineRegistry.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// 64-bit FNV-1a hash
+static uint64_t hashKey(const std::vector<uint8_t>& key)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (uint8_t byte : key) {
+		hash = (hash ^ byte) * 1099511628211ull;
+	}
+	return hash;
+}
+
+MyPipelineRegistry::PipelineState::PipelineState(const VkGraphicsPipelineCreateInfo& source)
+{
+	assert(source.pNext == nullptr);
+	createInfo = source;
+
+	stages.resize(source.stageCount);
+	for (uint32_t i = 0; i < source.stageCount; i++) {
+		const VkPipelineShaderStageCreateInfo& stageCI = source.pStages[i];
+		stages[i].stage = stageCI.stage;
+		stages[i].module = stageCI.module;
+		stages[i].entryPoint = stageCI.pName;
+		if (stageCI.pSpecializationInfo) {
+			const VkSpecializationInfo& specializationInfo = *stageCI.pSpecializationInfo;
+			const uint8_t* data = static_cast<const uint8_t*>(specializationInfo.pData);
+			stages[i].specialized = true;
+			stages[i].mapEntries.assign(specializationInfo.pMapEntries, specializationInfo.pMapEntries + specializationInfo.mapEntryCount);
+			stages[i].specializationData.assign(data, data + specializationInfo.dataSize);
+		}
+	}
+	// The stage vectors are complete, so pointers into them stay valid from here on
+	for (Stage& stage : stages) {
+		VkPipelineShaderStageCreateInfo stageCI{ VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
+		stageCI.stage = stage.stage;
+		stageCI.module = stage.module;
+		stageCI.pName = stage.entryPoint.c_str();
+		if (stage.specialized) {
+			stage.specializationInfo = vks::initializers::specializationInfo(static_cast<uint32_t>(stage.mapEntries.size()), stage.mapEntries.data(), stage.specializationData.size(), stage.specializationData.data());
+			stageCI.pSpecializationInfo = &stage.specializationInfo;
+		}
+		stageCreateInfos.push_back(stageCI);
+	}
+	createInfo.pStages = stageCreateInfos.data();
+
+	if (source.pVertexInputState) {
+		const VkPipelineVertexInputStateCreateInfo& src = *source.pVertexInputState;
+		vertexBindings.assign(src.pVertexBindingDescriptions, src.pVertexBindingDescriptions + src.vertexBindingDescriptionCount);
+		vertexAttributes.assign(src.pVertexAttributeDescriptions, src.pVertexAttributeDescriptions + src.vertexAttributeDescriptionCount);
+		vertexInputState = src;
+		vertexInputState.pVertexBindingDescriptions = vertexBindings.data();
+		vertexInputState.pVertexAttributeDescriptions = vertexAttributes.data();
+		createInfo.pVertexInputState = &vertexInputState;
+	}
+	if (source.pInputAssemblyState) {
+		inputAssemblyState = *source.pInputAssemblyState;
+		createInfo.pInputAssemblyState = &inputAssemblyState;
+	}
+	if (source.pTessellationState) {
+		tessellationState = *source.pTessellationState;
+		createInfo.pTessellationState = &tessellationState;
+	}
+	if (source.pViewportState) {
+		const VkPipelineViewportStateCreateInfo& src = *source.pViewportState;
+		// Viewports and scissors are usually dynamic, in which case the arrays are ignored
+		if (src.pViewports) {
+			viewports.assign(src.pViewports, src.pViewports + src.viewportCount);
+		}
+		if (src.pScissors) {
+			scissors.assign(src.pScissors, src.pScissors + src.scissorCount);
+		}
+		viewportState = src;
+		viewportState.pViewports = src.pViewports ? viewports.data() : nullptr;
+		viewportState.pScissors = src.pScissors ? scissors.data() : nullptr;
+		createInfo.pViewportState = &viewportState;
+	}
+	if (source.pRasterizationState) {
+		rasterizationState = *source.pRasterizationState;
+		createInfo.pRasterizationState = &rasterizationState;
+	}
+	if (source.pMultisampleState) {
+		const VkPipelineMultisampleStateCreateInfo& src = *source.pMultisampleState;
+		if (src.pSampleMask) {
+			sampleMask.assign(src.pSampleMask, src.pSampleMask + (src.rasterizationSamples + 31) / 32);
+		}
+		multisampleState = src;
+		multisampleState.pSampleMask = src.pSampleMask ? sampleMask.data() : nullptr;
+		createInfo.pMultisampleState = &multisampleState;
+	}
+	if (source.pDepthStencilState) {
+		depthStencilState = *source.pDepthStencilState;
+		createInfo.pDepthStencilState = &depthStencilState;
+	}
+	if (source.pColorBlendState) {
+		const VkPipelineColorBlendStateCreateInfo& src = *source.pColorBlendState;
+		blendAttachments.assign(src.pAttachments, src.pAttachments + src.attachmentCount);
+		colorBlendState = src;
+		colorBlendState.pAttachments = blendAttachments.data();
+		createInfo.pColorBlendState = &colorBlendState;
+	}
+	if (source.pDynamicState) {
+		const VkPipelineDynamicStateCreateInfo& src = *source.pDynamicState;
+		dynamicStates.assign(src.pDynamicStates, src.pDynamicStates + src.dynamicStateCount);
+		dynamicState = src;
+		dynamicState.pDynamicStates = dynamicStates.data();
+		createInfo.pDynamicState = &dynamicState;
+	}
+}
+
+std::vector<uint8_t> MyPipelineRegistry::PipelineState::key() const
+{
+	std::vector<uint8_t> key;
+	auto add = [&key](const void* data, size_t size) {
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		key.insert(key.end(), bytes, bytes + size);
+	};
+	// Only used for values and arrays of structures without padding or pointers
+	auto addValue = [&add](const auto& value) { add(&value, sizeof(value)); };
+	auto addArray = [&add](const auto& values) {
+		const uint64_t count = values.size();
+		add(&count, sizeof(count));
+		add(values.data(), values.size() * sizeof(values[0]));
+	};
+	auto addStencilOp = [&addValue](const VkStencilOpState& op) {
+		addValue(op.failOp); addValue(op.passOp); addValue(op.depthFailOp); addValue(op.compareOp);
+		addValue(op.compareMask); addValue(op.writeMask); addValue(op.reference);
+	};
+
+	addValue(createInfo.flags);
+	addValue(createInfo.layout);
+	addValue(createInfo.renderPass);
+	addValue(createInfo.subpass);
+
+	addValue(static_cast<uint64_t>(stages.size()));
+	for (const Stage& stage : stages) {
+		addValue(stage.stage);
+		addValue(stage.module);
+		add(stage.entryPoint.c_str(), stage.entryPoint.size() + 1);
+		addValue(stage.specialized);
+		for (const VkSpecializationMapEntry& entry : stage.mapEntries) {
+			addValue(entry.constantID); addValue(entry.offset); addValue(static_cast<uint64_t>(entry.size));
+		}
+		addArray(stage.specializationData);
+	}
+
+	// Each optional state block is prefixed with a presence flag
+	auto present = [&addValue](const void* state) { addValue(static_cast<uint8_t>(state != nullptr)); return state != nullptr; };
+	if (present(createInfo.pVertexInputState)) {
+		addValue(vertexInputState.flags);
+		addArray(vertexBindings);
+		addArray(vertexAttributes);
+	}
+	if (present(createInfo.pInputAssemblyState)) {
+		addValue(inputAssemblyState.flags); addValue(inputAssemblyState.topology); addValue(inputAssemblyState.primitiveRestartEnable);
+	}
+	if (present(createInfo.pTessellationState)) {
+		addValue(tessellationState.flags); addValue(tessellationState.patchControlPoints);
+	}
+	if (present(createInfo.pViewportState)) {
+		addValue(viewportState.flags); addValue(viewportState.viewportCount); addValue(viewportState.scissorCount);
+		addArray(viewports);
+		for (const VkRect2D& scissor : scissors) {
+			addValue(scissor.offset.x); addValue(scissor.offset.y); addValue(scissor.extent.width); addValue(scissor.extent.height);
+		}
+	}
+	if (present(createInfo.pRasterizationState)) {
+		const VkPipelineRasterizationStateCreateInfo& state = rasterizationState;
+		addValue(state.flags); addValue(state.depthClampEnable); addValue(state.rasterizerDiscardEnable); addValue(state.polygonMode);
+		addValue(state.cullMode); addValue(state.frontFace); addValue(state.depthBiasEnable); addValue(state.depthBiasConstantFactor);
+		addValue(state.depthBiasClamp); addValue(state.depthBiasSlopeFactor); addValue(state.lineWidth);
+	}
+	if (present(createInfo.pMultisampleState)) {
+		const VkPipelineMultisampleStateCreateInfo& state = multisampleState;
+		addValue(state.flags); addValue(state.rasterizationSamples); addValue(state.sampleShadingEnable); addValue(state.minSampleShading);
+		addArray(sampleMask);
+		addValue(state.alphaToCoverageEnable); addValue(state.alphaToOneEnable);
+	}
+	if (present(createInfo.pDepthStencilState)) {
+		const VkPipelineDepthStencilStateCreateInfo& state = depthStencilState;
+		addValue(state.flags); addValue(state.depthTestEnable); addValue(state.depthWriteEnable); addValue(state.depthCompareOp);
+		addValue(state.depthBoundsTestEnable); addValue(state.stencilTestEnable);
+		addStencilOp(state.front);
+		addStencilOp(state.back);
+		addValue(state.minDepthBounds); addValue(state.maxDepthBounds);
+	}
+	if (present(createInfo.pColorBlendState)) {
+		addValue(colorBlendState.flags); addValue(colorBlendState.logicOpEnable); addValue(colorBlendState.logicOp);
+		addArray(blendAttachments);
+		add(colorBlendState.blendConstants, sizeof(colorBlendState.blendConstants));
+	}
+	if (present(createInfo.pDynamicState)) {
+		addValue(dynamicState.flags);
+		addArray(dynamicStates);
+	}
+	return key;
+}
+
+void MyPipelineRegistry::create(VkDevice device, VkPipelineCache pipelineCache)
+{
+	this->device = device;
+	this->pipelineCache = pipelineCache;
+}
+
+void MyPipelineRegistry::destroy()
+{
+	for (Variant& variant : variants) {
+		if (variant.pipeline != VK_NULL_HANDLE) {
+			vkDestroyPipeline(device, variant.pipeline, nullptr);
+		}
+	}
+	variants.clear();
+	variantKeys.clear();
+	variantLookup.clear();
+	pending.clear();
+	statistics = {};
+}
+
+void MyPipelineRegistry::request(const VkGraphicsPipelineCreateInfo& createInfo, VkPipeline* target)
+{
+	statistics.requests++;
+	std::unique_ptr<PipelineState> state = std::make_unique<PipelineState>(createInfo);
+	std::vector<uint8_t> key = state->key();
+	const uint64_t hash = hashKey(key);
+
+	auto range = variantLookup.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (variantKeys[it->second] == key) {
+			Variant& variant = variants[it->second];
+			if (variant.pipeline != VK_NULL_HANDLE) {
+				*target = variant.pipeline;
+			} else {
+				variant.targets.push_back(target);
+			}
+			return;
+		}
+	}
+
+	const size_t index = variants.size();
+	Variant variant;
+	variant.state = std::move(state);
+	variant.targets.push_back(target);
+	variants.push_back(std::move(variant));
+	variantKeys.push_back(std::move(key));
+	variantLookup.emplace(hash, index);
+	pending.push_back(index);
+	statistics.variants++;
+}
+
+void MyPipelineRegistry::compile()
+{
+	if (pending.empty()) {
+		return;
+	}
+	auto tStart = std::chrono::high_resolution_clock::now();
+
+	// Pipeline caches are internally synchronized, so all workers can share the same one
+	const uint32_t threadCount = std::max(1u, std::min(std::thread::hardware_concurrency(), static_cast<uint32_t>(pending.size())));
+	std::atomic<size_t> nextVariant{ 0 };
+	auto worker = [&]() {
+		for (size_t i = nextVariant++; i < pending.size(); i = nextVariant++) {
+			Variant& variant = variants[pending[i]];
+			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &variant.state->createInfo, nullptr, &variant.pipeline));
+		}
+	};
+	std::vector<std::thread> threads;
+	for (uint32_t i = 1; i < threadCount; i++) {
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	for (size_t index : pending) {
+		Variant& variant = variants[index];
+		for (VkPipeline* target : variant.targets) {
+			*target = variant.pipeline;
+		}
+		variant.targets.clear();
+		// The key is kept for later lookups, the state (and the shader modules it references) is no longer needed
+		variant.state.reset();
+	}
+
+	const double compileTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+	statistics.compileTime += compileTime;
+	statistics.threads = threadCount;
+	std::cout << "Pipeline registry: " << statistics.requests << " requests, " << statistics.variants << " unique variants, compiled " << pending.size() << " on " << threadCount << " thread(s) in " << compileTime << " ms" << std::endl;
+	pending.clear();
+}
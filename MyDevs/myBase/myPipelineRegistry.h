@@ -0,0 +1,98 @@
+#pragma once
+/*
+* Graphics pipeline variant registry
+*
+* Materials often only differ in a few specialization constants or fixed function states, so many of them end up
+* requesting identical pipelines. The registry keys every request by the complete create info state, creates each
+* unique variant once (in parallel on worker threads) and hands out the shared pipeline to all requests.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+
+class MyPipelineRegistry
+{
+public:
+	struct Statistics {
+		uint32_t requests{ 0 };
+		uint32_t variants{ 0 };
+		uint32_t threads{ 0 };
+		double compileTime{ 0.0 };
+	} statistics;
+
+	void create(VkDevice device, VkPipelineCache pipelineCache);
+	// Destroys all pipelines created by the registry
+	void destroy();
+
+	/**
+	* Request a pipeline for the given create info, the pipeline is created by the next call to compile()
+	* All state referenced by the create info is copied, so it doesn't need to outlive this call
+	* pNext chains of the create info and its state structures are not supported
+	*
+	* @param createInfo Complete graphics pipeline state
+	* @param target Receives the (possibly shared) pipeline handle once it has been compiled, must stay valid until then
+	*/
+	void request(const VkGraphicsPipelineCreateInfo& createInfo, VkPipeline* target);
+	/** @brief Create all pending unique variants in parallel and write the handles to all requesting targets */
+	void compile();
+
+private:
+	// Owning copy of a graphics pipeline create info and everything it points to
+	struct PipelineState {
+		struct Stage {
+			VkShaderStageFlagBits stage;
+			VkShaderModule module;
+			std::string entryPoint;
+			bool specialized{ false };
+			std::vector<VkSpecializationMapEntry> mapEntries;
+			std::vector<uint8_t> specializationData;
+			VkSpecializationInfo specializationInfo{};
+		};
+		VkGraphicsPipelineCreateInfo createInfo{};
+		std::vector<Stage> stages;
+		std::vector<VkPipelineShaderStageCreateInfo> stageCreateInfos;
+		VkPipelineVertexInputStateCreateInfo vertexInputState{};
+		std::vector<VkVertexInputBindingDescription> vertexBindings;
+		std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState{};
+		VkPipelineTessellationStateCreateInfo tessellationState{};
+		VkPipelineViewportStateCreateInfo viewportState{};
+		std::vector<VkViewport> viewports;
+		std::vector<VkRect2D> scissors;
+		VkPipelineRasterizationStateCreateInfo rasterizationState{};
+		VkPipelineMultisampleStateCreateInfo multisampleState{};
+		std::vector<VkSampleMask> sampleMask;
+		VkPipelineDepthStencilStateCreateInfo depthStencilState{};
+		VkPipelineColorBlendStateCreateInfo colorBlendState{};
+		std::vector<VkPipelineColorBlendAttachmentState> blendAttachments;
+		VkPipelineDynamicStateCreateInfo dynamicState{};
+		std::vector<VkDynamicState> dynamicStates;
+
+		PipelineState(const VkGraphicsPipelineCreateInfo& source);
+		// Serialized state used as the registry key, pointers are replaced by the data they point to
+		std::vector<uint8_t> key() const;
+	};
+
+	struct Variant {
+		// Heap allocated, so the pointers in its create info stay valid when the variant list grows
+		std::unique_ptr<PipelineState> state;
+		VkPipeline pipeline{ VK_NULL_HANDLE };
+		std::vector<VkPipeline*> targets;
+	};
+
+	VkDevice device{ VK_NULL_HANDLE };
+	VkPipelineCache pipelineCache{ VK_NULL_HANDLE };
+	std::vector<Variant> variants;
+	// Variants are looked up by a hash of their key, colliding keys are resolved by comparing the full key
+	std::unordered_multimap<uint64_t, size_t> variantLookup;
+	std::vector<std::vector<uint8_t>> variantKeys;
+	// Variants that have been requested but not created yet
+	std::vector<size_t> pending;
+};
@@ -0,0 +1,441 @@
+#include "mySceneAccelerationStructure.h"
+/*
+* Scene acceleration structures with per frame updates
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <algorithm>
+#include <chrono>
+
+// Number of joint matrices reserved per skinned mesh (matches myglTF::Mesh::UniformBlock)
+static const uint32_t maxJointsPerMesh = 64;
+
+void MySceneAccelerationStructure::create(MyVulkanRTBase* base, VkQueue queue, myglTF::Model* model, const glm::mat4& rootTransform, const std::string& skinningShaderFile)
+{
+	this->base = base;
+	this->model = model;
+	this->rootTransform = rootTransform;
+	device = base->vulkanDevice->logicalDevice;
+
+	VkPhysicalDeviceAccelerationStructurePropertiesKHR accelerationStructureProperties{};
+	accelerationStructureProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR;
+	VkPhysicalDeviceProperties2 deviceProperties2{};
+	deviceProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	deviceProperties2.pNext = &accelerationStructureProperties;
+	vkGetPhysicalDeviceProperties2(base->vulkanDevice->physicalDevice, &deviceProperties2);
+	scratchAlignment = std::max<VkDeviceSize>(accelerationStructureProperties.minAccelerationStructureScratchOffsetAlignment, 1);
+
+	// Skinned models store joints and weights with every vertex
+	vertexStride = model->skins.empty() ? sizeof(myglTF::VertexSimple) : sizeof(myglTF::VertexSkinning);
+	sceneRadius = std::max(model->dimensions.radius, 0.001f);
+
+	// Skinned meshes are deformed into a copy of the vertex buffer, so the original bind pose vertices stay untouched
+	uint32_t deformingCount = 0;
+	for (auto node : model->linearNodes) {
+		if (node->mesh && node->skin) {
+			deformingCount++;
+		}
+	}
+	if (deformingCount > 0) {
+		const VkDeviceSize vertexBufferSize = (VkDeviceSize)model->vertices.count * vertexStride;
+		VK_CHECK_RESULT(base->vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&skinnedVertexBuffer,
+			vertexBufferSize));
+		VkCommandBuffer copyCmd = base->vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		VkBufferCopy copyRegion{ 0, 0, vertexBufferSize };
+		vkCmdCopyBuffer(copyCmd, model->vertices.buffer, skinnedVertexBuffer.buffer, 1, &copyRegion);
+		base->vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
+
+		VK_CHECK_RESULT(base->vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&jointBuffer,
+			(VkDeviceSize)deformingCount * maxJointsPerMesh * sizeof(glm::mat4)));
+		VK_CHECK_RESULT(jointBuffer.map());
+		createSkinningPipeline(skinningShaderFile);
+	}
+
+	// One BLAS per mesh node with one geometry per primitive
+	const uint64_t vertexBufferDeviceAddress = base->getBufferDeviceAddress(model->vertices.buffer);
+	const uint64_t skinnedVertexBufferDeviceAddress = (deformingCount > 0) ? base->getBufferDeviceAddress(skinnedVertexBuffer.buffer) : 0;
+	const uint64_t indexBufferDeviceAddress = base->getBufferDeviceAddress(model->indices.buffer);
+	uint32_t jointCount = 0;
+	for (auto node : model->linearNodes) {
+		if (!node->mesh) {
+			continue;
+		}
+		BLAS blas{};
+		blas.node = node;
+		blas.deforming = (node->skin != nullptr);
+		blas.firstGeometry = static_cast<uint32_t>(geometries.size());
+		blas.boundsMin = glm::vec3(FLT_MAX);
+		blas.boundsMax = glm::vec3(-FLT_MAX);
+		if (blas.deforming) {
+			blas.firstJoint = jointCount;
+			jointCount += maxJointsPerMesh;
+		}
+		for (auto primitive : node->mesh->primitives) {
+			if (primitive->indexCount == 0) {
+				continue;
+			}
+			Geometry geometry{};
+			geometry.node = node;
+			geometry.primitive = primitive;
+			geometry.vertexBufferDeviceAddress = blas.deforming ? skinnedVertexBufferDeviceAddress : vertexBufferDeviceAddress;
+			geometry.indexBufferDeviceAddress = indexBufferDeviceAddress + primitive->firstIndex * sizeof(uint32_t);
+			geometries.push_back(geometry);
+
+			VkAccelerationStructureGeometryKHR accelerationStructureGeometry{};
+			accelerationStructureGeometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+			accelerationStructureGeometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
+			accelerationStructureGeometry.geometry.triangles.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
+			accelerationStructureGeometry.geometry.triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
+			accelerationStructureGeometry.geometry.triangles.vertexData.deviceAddress = geometry.vertexBufferDeviceAddress;
+			accelerationStructureGeometry.geometry.triangles.maxVertex = model->vertices.count - 1;
+			accelerationStructureGeometry.geometry.triangles.vertexStride = vertexStride;
+			accelerationStructureGeometry.geometry.triangles.indexType = VK_INDEX_TYPE_UINT32;
+			accelerationStructureGeometry.geometry.triangles.indexData.deviceAddress = geometry.indexBufferDeviceAddress;
+			blas.geometries.push_back(accelerationStructureGeometry);
+
+			VkAccelerationStructureBuildRangeInfoKHR buildRange{};
+			buildRange.primitiveCount = primitive->indexCount / 3;
+			blas.buildRanges.push_back(buildRange);
+
+			blas.boundsMin = glm::min(blas.boundsMin, primitive->dimensions.min);
+			blas.boundsMax = glm::max(blas.boundsMax, primitive->dimensions.max);
+		}
+		if (!blas.geometries.empty()) {
+			blases.push_back(blas);
+		}
+	}
+	if (blases.empty()) {
+		vks::tools::exitFatal("The model does not contain any geometry for the acceleration structures", -1);
+	}
+
+	// Create the acceleration structures and lay out the scratch memory
+	// All BLAS are built once with a temporary scratch buffer, the persistent scratch buffer only covers the ones updated per frame
+	VkDeviceSize initialScratchSize = 0;
+	VkDeviceSize scratchSize = 0;
+	std::vector<VkDeviceSize> initialScratchOffsets;
+	for (auto& blas : blases) {
+		VkAccelerationStructureBuildGeometryInfoKHR buildGeometryInfo = blasBuildInfo(blas);
+		std::vector<uint32_t> maxPrimitiveCounts;
+		for (auto& buildRange : blas.buildRanges) {
+			maxPrimitiveCounts.push_back(buildRange.primitiveCount);
+		}
+		VkAccelerationStructureBuildSizesInfoKHR buildSizesInfo{};
+		buildSizesInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
+		base->vkGetAccelerationStructureBuildSizesKHR(device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &buildGeometryInfo, maxPrimitiveCounts.data(), &buildSizesInfo);
+		base->createAccelerationStructure(blas.accelerationStructure, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, buildSizesInfo);
+		initialScratchOffsets.push_back(initialScratchSize);
+		initialScratchSize += vks::tools::alignedVkSize(buildSizesInfo.buildScratchSize, scratchAlignment);
+		if (blas.deforming) {
+			blas.scratchOffset = scratchSize;
+			scratchSize += vks::tools::alignedVkSize(std::max(buildSizesInfo.buildScratchSize, buildSizesInfo.updateScratchSize), scratchAlignment);
+		}
+	}
+
+	// TLAS with one instance per BLAS
+	VK_CHECK_RESULT(base->vulkanDevice->createBuffer(
+		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&instanceBuffer,
+		blases.size() * sizeof(VkAccelerationStructureInstanceKHR)));
+	VK_CHECK_RESULT(instanceBuffer.map());
+	writeInstances();
+	instanceBuildTransforms.resize(blases.size());
+	for (size_t i = 0; i < blases.size(); i++) {
+		instanceBuildTransforms[i] = instanceTransform(blases[i]);
+	}
+
+	tlasGeometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+	tlasGeometry.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+	tlasGeometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
+	tlasGeometry.geometry.instances.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
+	tlasGeometry.geometry.instances.arrayOfPointers = VK_FALSE;
+	tlasGeometry.geometry.instances.data.deviceAddress = base->getBufferDeviceAddress(instanceBuffer.buffer);
+
+	VkAccelerationStructureBuildGeometryInfoKHR tlasGeometryInfo = tlasBuildInfo();
+	const uint32_t instanceCount = static_cast<uint32_t>(blases.size());
+	VkAccelerationStructureBuildSizesInfoKHR tlasSizesInfo{};
+	tlasSizesInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
+	base->vkGetAccelerationStructureBuildSizesKHR(device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &tlasGeometryInfo, &instanceCount, &tlasSizesInfo);
+	base->createAccelerationStructure(TLAS, VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR, tlasSizesInfo);
+	tlasScratchOffset = scratchSize;
+	scratchSize += vks::tools::alignedVkSize(std::max(tlasSizesInfo.buildScratchSize, tlasSizesInfo.updateScratchSize), scratchAlignment);
+	scratchBuffer = base->createScratchBuffer(scratchSize);
+
+	// Initial builds, all BLAS are built with a single command
+	// Skinned BLAS are built from the bind pose vertices copied above, so their build pose is the identity and the first update rebuilds them if the current pose differs
+	ScratchBuffer initialScratchBuffer = base->createScratchBuffer(initialScratchSize);
+	std::vector<VkAccelerationStructureBuildGeometryInfoKHR> buildGeometryInfos;
+	std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> buildRangeInfos;
+	for (size_t i = 0; i < blases.size(); i++) {
+		VkAccelerationStructureBuildGeometryInfoKHR buildGeometryInfo = blasBuildInfo(blases[i]);
+		buildGeometryInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+		buildGeometryInfo.dstAccelerationStructure = blases[i].accelerationStructure.handle;
+		buildGeometryInfo.scratchData.deviceAddress = initialScratchBuffer.deviceAddress + initialScratchOffsets[i];
+		buildGeometryInfos.push_back(buildGeometryInfo);
+		buildRangeInfos.push_back(blases[i].buildRanges.data());
+		if (blases[i].deforming) {
+			blases[i].buildPose.assign(maxJointsPerMesh, glm::mat4(1.0f));
+		}
+	}
+	VkCommandBuffer commandBuffer = base->vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+	base->vkCmdBuildAccelerationStructuresKHR(commandBuffer, static_cast<uint32_t>(buildGeometryInfos.size()), buildGeometryInfos.data(), buildRangeInfos.data());
+	VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+	memoryBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+	memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	tlasGeometryInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+	tlasGeometryInfo.dstAccelerationStructure = TLAS.handle;
+	tlasGeometryInfo.scratchData.deviceAddress = scratchBuffer.deviceAddress + tlasScratchOffset;
+	VkAccelerationStructureBuildRangeInfoKHR tlasBuildRange{};
+	tlasBuildRange.primitiveCount = instanceCount;
+	const VkAccelerationStructureBuildRangeInfoKHR* pTlasBuildRange = &tlasBuildRange;
+	base->vkCmdBuildAccelerationStructuresKHR(commandBuffer, 1, &tlasGeometryInfo, &pTlasBuildRange);
+	base->vulkanDevice->flushCommandBuffer(commandBuffer, queue);
+	base->deleteScratchBuffer(initialScratchBuffer);
+
+	// Timestamps for the per frame update cost
+	if (base->vulkanDevice->properties.limits.timestampComputeAndGraphics) {
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = 2;
+		VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &queryPool));
+	}
+
+	statistics.blasCount = static_cast<uint32_t>(blases.size());
+	statistics.deformingBlasCount = deformingCount;
+	statistics.instanceCount = instanceCount;
+}
+
+void MySceneAccelerationStructure::destroy()
+{
+	for (auto& blas : blases) {
+		base->deleteAccelerationStructure(blas.accelerationStructure);
+	}
+	blases.clear();
+	geometries.clear();
+	base->deleteAccelerationStructure(TLAS);
+	base->deleteScratchBuffer(scratchBuffer);
+	instanceBuffer.destroy();
+	skinnedVertexBuffer.destroy();
+	jointBuffer.destroy();
+	if (skinningPipeline != VK_NULL_HANDLE) {
+		vkDestroyPipeline(device, skinningPipeline, nullptr);
+		vkDestroyPipelineLayout(device, skinningPipelineLayout, nullptr);
+	}
+	if (queryPool != VK_NULL_HANDLE) {
+		vkDestroyQueryPool(device, queryPool, nullptr);
+	}
+}
+
+void MySceneAccelerationStructure::update(VkCommandBuffer commandBuffer)
+{
+	auto tStart = std::chrono::high_resolution_clock::now();
+
+	if (queryPool != VK_NULL_HANDLE) {
+		// The previous frame has finished, so its timestamps are available
+		if (timestampsPending) {
+			uint64_t timestamps[2];
+			if (vkGetQueryPoolResults(device, queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+				statistics.gpuTime = (float)((double)(timestamps[1] - timestamps[0]) * base->vulkanDevice->properties.limits.timestampPeriod / 1000000.0);
+			}
+		}
+		vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+	}
+
+	const VkPipelineStageFlags consumerStages = base->rayQueryOnly ? (VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT) : VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR;
+
+	// The previous frame's traversal has to be done before the skinned vertices and acceleration structures are overwritten
+	VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+	memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+	vkCmdPipelineBarrier(commandBuffer, consumerStages, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+	writeInstances();
+
+	statistics.blasRefits = 0;
+	statistics.blasRebuilds = 0;
+	statistics.tlasRebuilt = false;
+
+	// Skin deforming meshes into the skinned vertex buffer
+	if (skinningPipeline != VK_NULL_HANDLE) {
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, skinningPipeline);
+		const uint64_t sourceAddress = base->getBufferDeviceAddress(model->vertices.buffer);
+		const uint64_t targetAddress = base->getBufferDeviceAddress(skinnedVertexBuffer.buffer);
+		const uint64_t jointAddress = base->getBufferDeviceAddress(jointBuffer.buffer);
+		glm::mat4* jointMatrices = (glm::mat4*)jointBuffer.mapped;
+		for (auto& blas : blases) {
+			if (!blas.deforming) {
+				continue;
+			}
+			memcpy(jointMatrices + blas.firstJoint, blas.node->mesh->uniformBlock.jointMatrix, maxJointsPerMesh * sizeof(glm::mat4));
+			for (auto primitive : blas.node->mesh->primitives) {
+				if (primitive->vertexCount == 0) {
+					continue;
+				}
+				SkinningPushConstants pushConstants{};
+				pushConstants.sourceVertices = sourceAddress;
+				pushConstants.targetVertices = targetAddress;
+				pushConstants.jointMatrices = jointAddress + blas.firstJoint * sizeof(glm::mat4);
+				pushConstants.firstVertex = primitive->firstVertex;
+				pushConstants.vertexCount = primitive->vertexCount;
+				vkCmdPushConstants(commandBuffer, skinningPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SkinningPushConstants), &pushConstants);
+				vkCmdDispatch(commandBuffer, (primitive->vertexCount + 63) / 64, 1, 1);
+			}
+		}
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR | consumerStages, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	// Refit deforming BLAS, or rebuild them if the pose moved too far away from the one the hierarchy was built for
+	std::vector<VkAccelerationStructureBuildGeometryInfoKHR> buildGeometryInfos;
+	std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> buildRangeInfos;
+	for (auto& blas : blases) {
+		if (!blas.deforming) {
+			continue;
+		}
+		const glm::mat4* jointMatrices = blas.node->mesh->uniformBlock.jointMatrix;
+		const uint32_t jointCount = std::min(static_cast<uint32_t>(blas.node->mesh->uniformBlock.jointcount), maxJointsPerMesh);
+		const float meshRadius = std::max(glm::length(blas.boundsMax - blas.boundsMin) * 0.5f, 0.001f);
+		bool rebuild = (blas.refits >= settings.blasMaxRefits);
+		for (uint32_t i = 0; i < jointCount && !rebuild; i++) {
+			rebuild = maxCornerDistance(jointMatrices[i], blas.buildPose[i], blas.boundsMin, blas.boundsMax) / meshRadius > settings.blasRebuildDeformation;
+		}
+		VkAccelerationStructureBuildGeometryInfoKHR buildGeometryInfo = blasBuildInfo(blas);
+		buildGeometryInfo.dstAccelerationStructure = blas.accelerationStructure.handle;
+		buildGeometryInfo.scratchData.deviceAddress = scratchBuffer.deviceAddress + blas.scratchOffset;
+		if (rebuild) {
+			buildGeometryInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+			blas.buildPose.assign(jointMatrices, jointMatrices + maxJointsPerMesh);
+			blas.refits = 0;
+			statistics.blasRebuilds++;
+		} else {
+			buildGeometryInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR;
+			buildGeometryInfo.srcAccelerationStructure = blas.accelerationStructure.handle;
+			blas.refits++;
+			statistics.blasRefits++;
+		}
+		buildGeometryInfos.push_back(buildGeometryInfo);
+		buildRangeInfos.push_back(blas.buildRanges.data());
+	}
+	if (!buildGeometryInfos.empty()) {
+		base->vkCmdBuildAccelerationStructuresKHR(commandBuffer, static_cast<uint32_t>(buildGeometryInfos.size()), buildGeometryInfos.data(), buildRangeInfos.data());
+		memoryBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+		memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	// Update the TLAS, instances that moved far from where they were at the last build degrade its hierarchy so it's rebuilt instead
+	bool rebuildTLAS = false;
+	for (size_t i = 0; i < blases.size() && !rebuildTLAS; i++) {
+		rebuildTLAS = maxCornerDistance(instanceTransform(blases[i]), instanceBuildTransforms[i], blases[i].boundsMin, blases[i].boundsMax) > settings.tlasRebuildMovement * sceneRadius;
+	}
+	VkAccelerationStructureBuildGeometryInfoKHR tlasGeometryInfo = tlasBuildInfo();
+	tlasGeometryInfo.dstAccelerationStructure = TLAS.handle;
+	tlasGeometryInfo.scratchData.deviceAddress = scratchBuffer.deviceAddress + tlasScratchOffset;
+	if (rebuildTLAS) {
+		tlasGeometryInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+		for (size_t i = 0; i < blases.size(); i++) {
+			instanceBuildTransforms[i] = instanceTransform(blases[i]);
+		}
+		statistics.tlasRebuilt = true;
+	} else {
+		tlasGeometryInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR;
+		tlasGeometryInfo.srcAccelerationStructure = TLAS.handle;
+	}
+	VkAccelerationStructureBuildRangeInfoKHR tlasBuildRange{};
+	tlasBuildRange.primitiveCount = static_cast<uint32_t>(blases.size());
+	const VkAccelerationStructureBuildRangeInfoKHR* pTlasBuildRange = &tlasBuildRange;
+	base->vkCmdBuildAccelerationStructuresKHR(commandBuffer, 1, &tlasGeometryInfo, &pTlasBuildRange);
+
+	memoryBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+	memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, consumerStages, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+	if (queryPool != VK_NULL_HANDLE) {
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, queryPool, 1);
+		timestampsPending = true;
+	}
+
+	auto tEnd = std::chrono::high_resolution_clock::now();
+	statistics.cpuTime = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+}
+
+// Largest distance a corner of the given box is moved to when transformed by a instead of b
+float MySceneAccelerationStructure::maxCornerDistance(const glm::mat4& a, const glm::mat4& b, const glm::vec3& min, const glm::vec3& max)
+{
+	float distance = 0.0f;
+	for (uint32_t i = 0; i < 8; i++) {
+		const glm::vec4 corner((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z, 1.0f);
+		distance = std::max(distance, glm::length(glm::vec3(a * corner) - glm::vec3(b * corner)));
+	}
+	return distance;
+}
+
+glm::mat4 MySceneAccelerationStructure::instanceTransform(const BLAS& blas) const
+{
+	return rootTransform * blas.node->getMatrix();
+}
+
+void MySceneAccelerationStructure::writeInstances()
+{
+	VkAccelerationStructureInstanceKHR* instances = (VkAccelerationStructureInstanceKHR*)instanceBuffer.mapped;
+	for (size_t i = 0; i < blases.size(); i++) {
+		// Vulkan expects a row major 3x4 matrix
+		const glm::mat4 transform = glm::transpose(instanceTransform(blases[i]));
+		VkAccelerationStructureInstanceKHR& instance = instances[i];
+		memcpy(&instance.transform, &transform, sizeof(VkTransformMatrixKHR));
+		instance.instanceCustomIndex = blases[i].firstGeometry;
+		instance.mask = 0xFF;
+		instance.instanceShaderBindingTableRecordOffset = 0;
+		instance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
+		instance.accelerationStructureReference = blases[i].accelerationStructure.deviceAddress;
+	}
+}
+
+VkAccelerationStructureBuildGeometryInfoKHR MySceneAccelerationStructure::blasBuildInfo(const BLAS& blas) const
+{
+	VkAccelerationStructureBuildGeometryInfoKHR buildGeometryInfo{};
+	buildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+	buildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+	buildGeometryInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+	if (blas.deforming) {
+		buildGeometryInfo.flags |= VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+	}
+	buildGeometryInfo.geometryCount = static_cast<uint32_t>(blas.geometries.size());
+	buildGeometryInfo.pGeometries = blas.geometries.data();
+	return buildGeometryInfo;
+}
+
+VkAccelerationStructureBuildGeometryInfoKHR MySceneAccelerationStructure::tlasBuildInfo() const
+{
+	VkAccelerationStructureBuildGeometryInfoKHR buildGeometryInfo{};
+	buildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+	buildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+	buildGeometryInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+	buildGeometryInfo.geometryCount = 1;
+	buildGeometryInfo.pGeometries = &tlasGeometry;
+	return buildGeometryInfo;
+}
+
+void MySceneAccelerationStructure::createSkinningPipeline(const std::string& skinningShaderFile)
+{
+	VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(SkinningPushConstants), 0);
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(nullptr, 0);
+	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+	pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+	VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &skinningPipelineLayout));
+
+	VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(skinningPipelineLayout, 0);
+	computePipelineCreateInfo.stage = base->loadShader(skinningShaderFile, VK_SHADER_STAGE_COMPUTE_BIT);
+	VK_CHECK_RESULT(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &skinningPipeline));
+}
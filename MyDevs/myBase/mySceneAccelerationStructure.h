@@ -0,0 +1,143 @@
+#pragma once
+/*
+* Scene acceleration structures with per frame updates
+*
+* Builds one bottom level acceleration structure (BLAS) per glTF mesh node and a top level acceleration structure (TLAS) with one
+* instance per node. Every frame the instance transforms are written from the node world matrices, skinned meshes are skinned in
+* a compute pass and their BLAS is refit, and the TLAS is updated. All of this is recorded into the frame's command buffer.
+* Refits are cheap but keep the hierarchy of the pose it was built for, so its quality degrades as the mesh deforms. A BLAS is
+* rebuilt once its joints moved the mesh bounds too far away from the last build pose (or after a number of refits), the TLAS is
+* rebuilt the same way based on how far its instances moved.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <string>
+#include <vector>
+
+#include "myVulkanRTBase.h"
+#include "myglTFModel.h"
+
+class MySceneAccelerationStructure
+{
+public:
+	struct Settings {
+		// A deforming BLAS is rebuilt once a joint moved its mesh bounds further than this (relative to the mesh radius) from the last build pose
+		float blasRebuildDeformation{ 0.25f };
+		// A deforming BLAS is also rebuilt after this many refits
+		uint32_t blasMaxRefits{ 120 };
+		// The TLAS is rebuilt once an instance moved further than this (relative to the scene radius) from the last build
+		float tlasRebuildMovement{ 0.1f };
+	} settings;
+
+	struct Statistics {
+		uint32_t blasCount{ 0 };
+		uint32_t deformingBlasCount{ 0 };
+		uint32_t instanceCount{ 0 };
+		// Work recorded by the last update
+		uint32_t blasRefits{ 0 };
+		uint32_t blasRebuilds{ 0 };
+		bool tlasRebuilt{ false };
+		// GPU time of the last finished update in milliseconds (if the device supports timestamps)
+		float gpuTime{ 0.0f };
+		// CPU time of the last update in milliseconds
+		double cpuTime{ 0.0 };
+	} statistics;
+
+	// Geometry of a mesh primitive as seen by the ray tracing shaders, geometries are stored in the order they are addressed with
+	// gl_InstanceCustomIndexEXT + gl_GeometryIndexEXT
+	struct Geometry {
+		myglTF::Node* node;
+		myglTF::Primitive* primitive;
+		// Skinned geometries point to the skinned copy of the vertices
+		uint64_t vertexBufferDeviceAddress;
+		uint64_t indexBufferDeviceAddress;
+	};
+	std::vector<Geometry> geometries;
+	// Vertex stride of the model (and the skinned vertices) in bytes
+	uint32_t vertexStride{ 0 };
+
+	AccelerationStructure TLAS{};
+
+	/**
+	* Build the acceleration structures for the current state of the model's nodes
+	*
+	* @param base Ray tracing base providing the acceleration structure functions
+	* @param queue Queue used for the initial builds
+	* @param model Model to build the acceleration structures for, its vertex and index buffers need to be usable as build inputs and have device addresses
+	*              (skinned models also need storage and transfer source usage for their vertex buffer)
+	* @param rootTransform Transform applied to all instances
+	* @param skinningShaderFile SPIR-V file of the compute shader used for skinning
+	*/
+	void create(MyVulkanRTBase* base, VkQueue queue, myglTF::Model* model, const glm::mat4& rootTransform, const std::string& skinningShaderFile);
+	void destroy();
+
+	/**
+	* Record the acceleration structure updates for the current node transforms and joint matrices (as set by myglTF::Node::update)
+	* Has to be recorded outside of a render pass before the acceleration structures are used, and the previous frame has to be finished
+	*
+	* @param commandBuffer Frame command buffer
+	*/
+	void update(VkCommandBuffer commandBuffer);
+
+private:
+	struct BLAS {
+		AccelerationStructure accelerationStructure{};
+		myglTF::Node* node{ nullptr };
+		std::vector<VkAccelerationStructureGeometryKHR> geometries;
+		std::vector<VkAccelerationStructureBuildRangeInfoKHR> buildRanges;
+		uint32_t firstGeometry{ 0 };
+		// Mesh bounds in node space
+		glm::vec3 boundsMin{ 0.0f };
+		glm::vec3 boundsMax{ 0.0f };
+		bool deforming{ false };
+		uint32_t refits{ 0 };
+		// Joint matrices of the pose the BLAS was last built for
+		std::vector<glm::mat4> buildPose;
+		// Offsets into the joint matrix buffer and the scratch buffer
+		uint32_t firstJoint{ 0 };
+		VkDeviceSize scratchOffset{ 0 };
+	};
+
+	// Matches the push constant block of the skinning shader
+	struct SkinningPushConstants {
+		uint64_t sourceVertices;
+		uint64_t targetVertices;
+		uint64_t jointMatrices;
+		uint32_t firstVertex;
+		uint32_t vertexCount;
+	};
+
+	MyVulkanRTBase* base{ nullptr };
+	myglTF::Model* model{ nullptr };
+	VkDevice device{ VK_NULL_HANDLE };
+	glm::mat4 rootTransform{ 1.0f };
+	VkDeviceSize scratchAlignment{ 0 };
+
+	std::vector<BLAS> blases;
+	// Instance buffer is written by the host every frame
+	vks::Buffer instanceBuffer;
+	VkAccelerationStructureGeometryKHR tlasGeometry{};
+	std::vector<glm::mat4> instanceBuildTransforms;
+	VkDeviceSize tlasScratchOffset{ 0 };
+	float sceneRadius{ 1.0f };
+
+	// Skinning of deforming meshes
+	vks::Buffer skinnedVertexBuffer;
+	vks::Buffer jointBuffer;
+	VkPipelineLayout skinningPipelineLayout{ VK_NULL_HANDLE };
+	VkPipeline skinningPipeline{ VK_NULL_HANDLE };
+
+	// Scratch memory for the per frame updates, each deforming BLAS and the TLAS have their own range
+	ScratchBuffer scratchBuffer{};
+
+	VkQueryPool queryPool{ VK_NULL_HANDLE };
+	bool timestampsPending{ false };
+
+	static float maxCornerDistance(const glm::mat4& a, const glm::mat4& b, const glm::vec3& min, const glm::vec3& max);
+	glm::mat4 instanceTransform(const BLAS& blas) const;
+	void writeInstances();
+	VkAccelerationStructureBuildGeometryInfoKHR blasBuildInfo(const BLAS& blas) const;
+	VkAccelerationStructureBuildGeometryInfoKHR tlasBuildInfo() const;
+	void createSkinningPipeline(const std::string& skinningShaderFile);
+};
@@ -0,0 +1,300 @@
+#include "myTemporalDenoiser.h"
+/*
+* Temporal accumulation and spatial denoising for ray traced lighting
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <algorithm>
+
+// Matches the flags of temporal.comp
+#define TEMPORAL_FLAG_ACCUMULATE 1
+#define TEMPORAL_FLAG_REPROJECT 2
+
+// Timestamps written per frame: begin, ray tracing done, temporal done, filter done, composite done
+#define TIMESTAMP_COUNT 5
+
+void MyTemporalDenoiser::create(VulkanExampleBase* base, VkQueue queue, const std::string& shaderPath, uint32_t width, uint32_t height, VkImageView outputView, VkShaderStageFlags stageFlags)
+{
+	this->base = base;
+	this->queue = queue;
+	this->width = width;
+	this->height = height;
+	this->outputView = outputView;
+	vulkanDevice = base->vulkanDevice;
+	device = vulkanDevice->logicalDevice;
+
+	createImages();
+
+	std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+		// Binding 0: Lighting, G-buffer and history images
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT | stageFlags, 0, ImageCount),
+		// Binding 1: Albedo
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT | stageFlags, 1),
+		// Binding 2: Output
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+	};
+	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &descriptorSetLayout));
+
+	std::vector<VkDescriptorPoolSize> poolSizes = {
+		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, ImageCount + 2)
+	};
+	VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes, 1);
+	VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCI, nullptr, &descriptorPool));
+	VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
+	VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
+	updateDescriptorSet();
+
+	// All passes share one layout, the push constant range covers the largest block
+	VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, static_cast<uint32_t>(std::max({ sizeof(TemporalPushConstants), sizeof(AtrousPushConstants), sizeof(CompositePushConstants) })), 0);
+	VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+	pipelineLayoutCI.pushConstantRangeCount = 1;
+	pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+	VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &pipelineLayout));
+
+	VkComputePipelineCreateInfo computePipelineCI = vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
+	computePipelineCI.stage = base->loadShader(shaderPath + "temporal.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+	VK_CHECK_RESULT(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &computePipelineCI, nullptr, &pipelines.temporal));
+	computePipelineCI.stage = base->loadShader(shaderPath + "atrous.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+	VK_CHECK_RESULT(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &computePipelineCI, nullptr, &pipelines.atrous));
+	computePipelineCI.stage = base->loadShader(shaderPath + "composite.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+	VK_CHECK_RESULT(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &computePipelineCI, nullptr, &pipelines.composite));
+
+	if (vulkanDevice->properties.limits.timestampComputeAndGraphics) {
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = TIMESTAMP_COUNT;
+		VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &queryPool));
+	}
+}
+
+void MyTemporalDenoiser::resize(uint32_t width, uint32_t height, VkImageView outputView)
+{
+	this->width = width;
+	this->height = height;
+	this->outputView = outputView;
+	for (auto& image : images) {
+		destroyImage(image);
+	}
+	destroyImage(albedo);
+	createImages();
+	updateDescriptorSet();
+}
+
+void MyTemporalDenoiser::destroy()
+{
+	for (auto& image : images) {
+		destroyImage(image);
+	}
+	destroyImage(albedo);
+	vkDestroyPipeline(device, pipelines.temporal, nullptr);
+	vkDestroyPipeline(device, pipelines.atrous, nullptr);
+	vkDestroyPipeline(device, pipelines.composite, nullptr);
+	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+	vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+	if (queryPool != VK_NULL_HANDLE) {
+		vkDestroyQueryPool(device, queryPool, nullptr);
+	}
+}
+
+void MyTemporalDenoiser::reset()
+{
+	historyValid = false;
+}
+
+uint32_t MyTemporalDenoiser::currentGBuffer() const
+{
+	return GBuffer0 + parity;
+}
+
+void MyTemporalDenoiser::begin(VkCommandBuffer commandBuffer)
+{
+	if (queryPool == VK_NULL_HANDLE) {
+		return;
+	}
+	// The previous frame has finished, so its timestamps are available
+	if (timestampsPending) {
+		uint64_t timestamps[TIMESTAMP_COUNT];
+		if (vkGetQueryPoolResults(device, queryPool, 0, TIMESTAMP_COUNT, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+			const double period = vulkanDevice->properties.limits.timestampPeriod / 1000000.0;
+			statistics.renderTime = (float)((timestamps[1] - timestamps[0]) * period);
+			statistics.temporalTime = (float)((timestamps[2] - timestamps[1]) * period);
+			statistics.filterTime = (float)((timestamps[3] - timestamps[2]) * period);
+			statistics.compositeTime = (float)((timestamps[4] - timestamps[3]) * period);
+		}
+	}
+	vkCmdResetQueryPool(commandBuffer, queryPool, 0, TIMESTAMP_COUNT);
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+}
+
+void MyTemporalDenoiser::record(VkCommandBuffer commandBuffer)
+{
+	const uint32_t groupCountX = (width + 7) / 8;
+	const uint32_t groupCountY = (height + 7) / 8;
+
+	// Inputs are written by the ray tracing shaders
+	VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	if (queryPool != VK_NULL_HANDLE) {
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, queryPool, 1);
+	}
+
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+
+	// Temporal accumulation, writes the accumulated image that doesn't hold the history
+	const bool accumulate = settings.temporal && historyValid;
+	const uint32_t accumulated = (history == Accumulated0) ? Accumulated1 : Accumulated0;
+	TemporalPushConstants temporalPushConstants{};
+	temporalPushConstants.noisy = Noisy;
+	temporalPushConstants.gbuffer = GBuffer0 + parity;
+	temporalPushConstants.gbufferPrevious = GBuffer0 + (parity ^ 1);
+	temporalPushConstants.motion = Motion;
+	temporalPushConstants.history = history;
+	temporalPushConstants.moments = Moments0 + parity;
+	temporalPushConstants.momentsPrevious = Moments0 + (parity ^ 1);
+	temporalPushConstants.target = accumulated;
+	temporalPushConstants.flags = (accumulate ? TEMPORAL_FLAG_ACCUMULATE : 0) | (settings.reprojection ? TEMPORAL_FLAG_REPROJECT : 0);
+	// Without reprojection the history is reset on camera movement, so it can converge without limit
+	temporalPushConstants.alphaMin = settings.reprojection ? 1.0f / (float)std::max(settings.maxHistory, 1) : 0.0f;
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.temporal);
+	vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(TemporalPushConstants), &temporalPushConstants);
+	vkCmdDispatch(commandBuffer, groupCountX, groupCountY, 1);
+	statistics.accumulatedFrames = accumulate ? statistics.accumulatedFrames + 1 : 1;
+
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	if (queryPool != VK_NULL_HANDLE) {
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, queryPool, 2);
+	}
+
+	// A-trous passes, the first one overwrites the old history and becomes the history for the next frame
+	uint32_t lighting = accumulated;
+	uint32_t nextHistory = accumulated;
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.atrous);
+	for (int32_t i = 0; i < settings.atrousIterations; i++) {
+		AtrousPushConstants atrousPushConstants{};
+		atrousPushConstants.source = lighting;
+		atrousPushConstants.target = (i == 0) ? history : ((i & 1) ? Filtered0 : Filtered1);
+		atrousPushConstants.gbuffer = GBuffer0 + parity;
+		atrousPushConstants.stepSize = 1 << i;
+		atrousPushConstants.phiColor = settings.phiColor;
+		atrousPushConstants.phiNormal = settings.phiNormal;
+		atrousPushConstants.phiDepth = settings.phiDepth;
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(AtrousPushConstants), &atrousPushConstants);
+		vkCmdDispatch(commandBuffer, groupCountX, groupCountY, 1);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		lighting = atrousPushConstants.target;
+		if (i == 0) {
+			nextHistory = history;
+		}
+	}
+	if (queryPool != VK_NULL_HANDLE) {
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, queryPool, 3);
+	}
+
+	// Modulate with the albedo into the output image
+	CompositePushConstants compositePushConstants{};
+	compositePushConstants.source = (settings.debugView == DebugView::NoisyInput) ? (uint32_t)Noisy : lighting;
+	compositePushConstants.moments = Moments0 + parity;
+	compositePushConstants.view = settings.debugView;
+	compositePushConstants.maxHistory = (float)std::max(settings.maxHistory, 1);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.composite);
+	vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CompositePushConstants), &compositePushConstants);
+	vkCmdDispatch(commandBuffer, groupCountX, groupCountY, 1);
+
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	if (queryPool != VK_NULL_HANDLE) {
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, queryPool, 4);
+		timestampsPending = true;
+	}
+
+	history = nextHistory;
+	historyValid = true;
+	parity ^= 1;
+}
+
+void MyTemporalDenoiser::createImage(StorageImage& image, VkFormat format)
+{
+	VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+	imageCI.imageType = VK_IMAGE_TYPE_2D;
+	imageCI.format = format;
+	imageCI.extent = { width, height, 1 };
+	imageCI.mipLevels = 1;
+	imageCI.arrayLayers = 1;
+	imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCI.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &image.image));
+
+	VkMemoryRequirements memReqs;
+	vkGetImageMemoryRequirements(device, image.image, &memReqs);
+	VkMemoryAllocateInfo memoryAllocateInfo = vks::initializers::memoryAllocateInfo();
+	memoryAllocateInfo.allocationSize = memReqs.size;
+	memoryAllocateInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	VK_CHECK_RESULT(vkAllocateMemory(device, &memoryAllocateInfo, nullptr, &image.memory));
+	VK_CHECK_RESULT(vkBindImageMemory(device, image.image, image.memory, 0));
+
+	VkImageViewCreateInfo imageViewCI = vks::initializers::imageViewCreateInfo();
+	imageViewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	imageViewCI.format = format;
+	imageViewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	imageViewCI.image = image.image;
+	VK_CHECK_RESULT(vkCreateImageView(device, &imageViewCI, nullptr, &image.view));
+}
+
+void MyTemporalDenoiser::destroyImage(StorageImage& image)
+{
+	vkDestroyImageView(device, image.view, nullptr);
+	vkDestroyImage(device, image.image, nullptr);
+	vkFreeMemory(device, image.memory, nullptr);
+	image = {};
+}
+
+void MyTemporalDenoiser::createImages()
+{
+	for (auto& image : images) {
+		createImage(image, VK_FORMAT_R16G16B16A16_SFLOAT);
+	}
+	createImage(albedo, VK_FORMAT_R8G8B8A8_UNORM);
+
+	// Images stay in general layout, they're cleared so the first frame doesn't read undefined history
+	VkCommandBuffer commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+	VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	VkClearColorValue clearColor{};
+	for (uint32_t i = 0; i <= ImageCount; i++) {
+		VkImage image = (i < ImageCount) ? images[i].image : albedo.image;
+		vks::tools::setImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresourceRange);
+		vkCmdClearColorImage(commandBuffer, image, VK_IMAGE_LAYOUT_GENERAL, &clearColor, 1, &subresourceRange);
+	}
+	vulkanDevice->flushCommandBuffer(commandBuffer, queue);
+
+	parity = 0;
+	history = Accumulated0;
+	historyValid = false;
+	timestampsPending = false;
+}
+
+void MyTemporalDenoiser::updateDescriptorSet()
+{
+	std::vector<VkDescriptorImageInfo> imageDescriptors(ImageCount);
+	for (uint32_t i = 0; i < ImageCount; i++) {
+		imageDescriptors[i] = vks::initializers::descriptorImageInfo(VK_NULL_HANDLE, images[i].view, VK_IMAGE_LAYOUT_GENERAL);
+	}
+	VkDescriptorImageInfo albedoDescriptor = vks::initializers::descriptorImageInfo(VK_NULL_HANDLE, albedo.view, VK_IMAGE_LAYOUT_GENERAL);
+	VkDescriptorImageInfo outputDescriptor = vks::initializers::descriptorImageInfo(VK_NULL_HANDLE, outputView, VK_IMAGE_LAYOUT_GENERAL);
+	std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+		vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0, imageDescriptors.data(), ImageCount),
+		vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, &albedoDescriptor),
+		vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2, &outputDescriptor),
+	};
+	vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+}
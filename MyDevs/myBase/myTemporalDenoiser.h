@@ -0,0 +1,178 @@
+#pragma once
+/*
+* Temporal accumulation and spatial denoising for ray traced lighting
+*
+* The ray tracing pass writes noisy (demodulated) lighting, the albedo, a small G-buffer (normal and hit distance) and motion
+* vectors derived from the camera matrices into the denoiser's images. The denoiser then
+* - reprojects the accumulated lighting of the previous frames with the motion vectors and blends it with the new samples,
+*   rejecting history where the reprojected normal or distance doesn't match (disocclusion),
+* - tracks the first two moments of the luminance to estimate the per pixel variance,
+* - runs a number of edge-aware a-trous wavelet passes whose luminance weights are scaled by that variance, so noisy pixels
+*   are filtered more than converged ones, and feeds the first pass back as the history,
+* - multiplies the result with the albedo into the output image.
+* All passes are compute shaders with the images addressed by index from one storage image array.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <string>
+
+#include "vulkanexamplebase.h"
+
+class MyTemporalDenoiser
+{
+public:
+	// Indices into the storage image array (rgba16f) at binding 0 of the denoiser's descriptor set
+	enum Image : uint32_t {
+		// Noisy lighting of the current frame
+		Noisy = 0,
+		// World space normal and hit distance (0 for background), alternates between frames
+		GBuffer0,
+		GBuffer1,
+		// Screen space motion to the previous frame in xy, distance of the hit to the previous camera position in z
+		Motion,
+		// Luminance moments and history length, alternates between frames
+		Moments0,
+		Moments1,
+		// Accumulated lighting with the variance in alpha, alternates between frames
+		Accumulated0,
+		Accumulated1,
+		// Ping pong targets for the remaining a-trous passes
+		Filtered0,
+		Filtered1,
+		ImageCount
+	};
+
+	enum DebugView : int32_t {
+		Final = 0,
+		NoisyInput,
+		Lighting,
+		Variance,
+		HistoryLength
+	};
+
+	struct Settings {
+		// Blend with the reprojected history, otherwise every frame is filtered on its own
+		bool temporal{ true };
+		// Reproject the history with the motion vectors, otherwise the history has to be reset whenever the camera moves
+		// but converges without limit while it stands still
+		bool reprojection{ true };
+		// Number of frames the history is limited to when reprojecting, lower values reduce ghosting but converge to a noisier result
+		int32_t maxHistory{ 32 };
+		// Number of a-trous passes, each doubles the filter footprint
+		int32_t atrousIterations{ 4 };
+		// Edge stopping strengths
+		float phiColor{ 4.0f };
+		float phiNormal{ 128.0f };
+		float phiDepth{ 1.0f };
+		int32_t debugView{ DebugView::Final };
+	} settings;
+
+	struct Statistics {
+		// GPU times in milliseconds of the last finished frame (if the device supports timestamps)
+		float renderTime{ 0.0f };
+		float temporalTime{ 0.0f };
+		float filterTime{ 0.0f };
+		float compositeTime{ 0.0f };
+		// Frames accumulated since the last reset
+		uint32_t accumulatedFrames{ 0 };
+	} statistics;
+
+	VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
+	VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
+
+	/**
+	* Create the images and the compute pipelines
+	*
+	* @param base Example base used to load the shaders
+	* @param queue Queue used for the initial image layout transitions
+	* @param shaderPath Path containing temporal.comp.spv, atrous.comp.spv and composite.comp.spv
+	* @param width Width of the images
+	* @param height Height of the images
+	* @param outputView View of the rgba8 storage image the denoised result is written to (in general layout)
+	* @param stageFlags Additional shader stages that write the input images through the descriptor set
+	*/
+	void create(VulkanExampleBase* base, VkQueue queue, const std::string& shaderPath, uint32_t width, uint32_t height, VkImageView outputView, VkShaderStageFlags stageFlags);
+	/** @brief Recreate the images for a new size, this resets the history */
+	void resize(uint32_t width, uint32_t height, VkImageView outputView);
+	void destroy();
+
+	/** @brief Discard the history, e.g. after the camera moved while not reprojecting */
+	void reset();
+	/** @brief G-buffer image the ray tracing pass has to write to in the current frame */
+	uint32_t currentGBuffer() const;
+
+	/** @brief Record the start of the frame, has to be called before the commands writing the input images */
+	void begin(VkCommandBuffer commandBuffer);
+	/** @brief Record the denoising passes, the output image is ready for transfer reads afterwards */
+	void record(VkCommandBuffer commandBuffer);
+
+private:
+	struct StorageImage {
+		VkImage image{ VK_NULL_HANDLE };
+		VkDeviceMemory memory{ VK_NULL_HANDLE };
+		VkImageView view{ VK_NULL_HANDLE };
+	};
+
+	// Pass parameters, image members are indices into the image array
+	struct TemporalPushConstants {
+		uint32_t noisy;
+		uint32_t gbuffer;
+		uint32_t gbufferPrevious;
+		uint32_t motion;
+		uint32_t history;
+		uint32_t moments;
+		uint32_t momentsPrevious;
+		uint32_t target;
+		uint32_t flags;
+		float alphaMin;
+	};
+	struct AtrousPushConstants {
+		uint32_t source;
+		uint32_t target;
+		uint32_t gbuffer;
+		int32_t stepSize;
+		float phiColor;
+		float phiNormal;
+		float phiDepth;
+	};
+	struct CompositePushConstants {
+		uint32_t source;
+		uint32_t moments;
+		int32_t view;
+		float maxHistory;
+	};
+
+	VulkanExampleBase* base{ nullptr };
+	vks::VulkanDevice* vulkanDevice{ nullptr };
+	VkDevice device{ VK_NULL_HANDLE };
+	VkQueue queue{ VK_NULL_HANDLE };
+	uint32_t width{ 0 };
+	uint32_t height{ 0 };
+
+	StorageImage images[ImageCount];
+	StorageImage albedo;
+	VkImageView outputView{ VK_NULL_HANDLE };
+
+	VkDescriptorPool descriptorPool{ VK_NULL_HANDLE };
+	VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
+	struct Pipelines {
+		VkPipeline temporal{ VK_NULL_HANDLE };
+		VkPipeline atrous{ VK_NULL_HANDLE };
+		VkPipeline composite{ VK_NULL_HANDLE };
+	} pipelines;
+
+	// Alternates every frame between the G-buffer and moments images
+	uint32_t parity{ 0 };
+	// Accumulated image holding the history for the next frame
+	uint32_t history{ Accumulated0 };
+	bool historyValid{ false };
+
+	VkQueryPool queryPool{ VK_NULL_HANDLE };
+	bool timestampsPending{ false };
+
+	void createImage(StorageImage& image, VkFormat format);
+	void destroyImage(StorageImage& image);
+	void createImages();
+	void updateDescriptorSet();
+};
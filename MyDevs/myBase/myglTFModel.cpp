@@ -1,6 +1,10 @@
 #include "myglTFModel.h"
 #include "myIncludesCPUGPU.h"
 
+#include <atomic>
+#include <chrono>
+#include <thread>
+
 VkMemoryPropertyFlags myglTF::Model::memoryPropertyFlags = 0;
 uint32_t myglTF::Model::descriptorBindingFlags = myglTF::DescriptorBindingFlags::ImageBaseColor | myglTF::DescriptorBindingFlags::ImageNormalMap;
 
@@ -304,14 +308,89 @@ void myglTF::Model::loadSkins(tinygltf::Model& gltfModel)
 
 void myglTF::Model::loadImages(tinygltf::Model& gltfModel, vks::VulkanDevice* device, VkQueue transferQueue)
 {
-	for (tinygltf::Image& image : gltfModel.images) {
+	auto tStart = std::chrono::high_resolution_clock::now();
+
+	// Decode images and parse KTX2 containers in parallel, uploads are done sequentially afterwards
+	const uint32_t imageCount = static_cast<uint32_t>(gltfModel.images.size());
+	std::vector<vks::ktx2::Texture> ktx2Textures(imageCount);
+	std::vector<bool> isKtx2(imageCount, false);
+	std::vector<std::string> messages(imageCount);
+	std::atomic<uint32_t> nextImage{ 0 };
+	auto decodeImages = [&]() {
+		for (uint32_t i = nextImage++; i < imageCount; i = nextImage++) {
+			tinygltf::Image& image = gltfModel.images[i];
+			if (!image.as_is) {
+				continue;
+			}
+			std::vector<unsigned char> bytes;
+			bytes.swap(image.image);
+			image.as_is = false;
+			const bool ktx2 = (image.mimeType == "image/ktx2") || ((image.uri.find_last_of(".") != std::string::npos) && (image.uri.substr(image.uri.find_last_of(".") + 1) == "ktx2"));
+			bool valid = false;
+			std::string error;
+			if (ktx2) {
+				valid = vks::ktx2::loadFromMemory(bytes.data(), bytes.size(), ktx2Textures[i], &error) && ktx2Textures[i].isUploadable(device, &error);
+				isKtx2[i] = valid;
+			} else {
+				std::string warning;
+				valid = tinygltf::LoadImageData(&image, i, &error, &warning, 0, 0, bytes.data(), static_cast<int>(bytes.size()), nullptr);
+				// Most devices don't support RGB only on Vulkan so convert if necessary
+				if (valid && (image.component == 3)) {
+					std::vector<unsigned char> rgba(static_cast<size_t>(image.width) * image.height * 4, 255);
+					for (size_t j = 0; j < static_cast<size_t>(image.width) * image.height; j++) {
+						memcpy(&rgba[j * 4], &image.image[j * 3], 3);
+					}
+					image.image.swap(rgba);
+					image.component = 4;
+				}
+			}
+			if (!valid) {
+				messages[i] = "Image " + std::to_string(i) + " (" + (image.uri.empty() ? image.mimeType : image.uri) + ") could not be used: " + error;
+				// Materials referencing this image will use a glTF fallback source if there is one (see getTextureSource)
+				image.width = 1;
+				image.height = 1;
+				image.component = 4;
+				image.image.assign(4, 255);
+			}
+		}
+	};
+	const uint32_t threadCount = std::max(std::min(std::thread::hardware_concurrency(), imageCount), 1u);
+	std::vector<std::thread> threads;
+	for (uint32_t i = 1; i < threadCount; i++) {
+		threads.emplace_back(decodeImages);
+	}
+	decodeImages();
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	auto tDecode = std::chrono::high_resolution_clock::now();
+
+	VkDeviceSize memorySize = 0;
+	VkDeviceSize uncompressedMemorySize = 0;
+	uint32_t ktx2Count = 0;
+	for (uint32_t i = 0; i < imageCount; i++) {
+		if (!messages[i].empty()) {
+			std::cout << messages[i] << "\n";
+		}
 		myglTF::Texture texture;
-		texture.fromglTfImage(image, path, device, transferQueue);
+		texture.fromglTfImage(gltfModel.images[i], path, device, transferQueue, isKtx2[i] ? &ktx2Textures[i] : nullptr);
 		texture.index = static_cast<uint32_t>(textures.size());
+		texture.placeholder = !messages[i].empty();
 		textures.push_back(texture);
+		memorySize += texture.memorySize;
+		// RGBA8 with a full mip chain, as used for images decoded from png/jpg
+		uncompressedMemorySize += static_cast<VkDeviceSize>(texture.width) * texture.height * 4 * 4 / 3;
+		ktx2Count += isKtx2[i] ? 1 : 0;
 	}
 	// Create an empty texture to be used for empty material images
 	createEmptyTexture(transferQueue);
+
+	auto tEnd = std::chrono::high_resolution_clock::now();
+	if (imageCount > 0) {
+		std::cout << "Loaded " << imageCount << " images (" << ktx2Count << " KTX2) in " << std::chrono::duration<double, std::milli>(tEnd - tStart).count() << " ms"
+			<< " (decode " << std::chrono::duration<double, std::milli>(tDecode - tStart).count() << " ms on " << threadCount << " threads)"
+			<< ", device memory " << memorySize / (1024.0 * 1024.0) << " MB (" << uncompressedMemorySize / (1024.0 * 1024.0) << " MB as RGBA8)\n";
+	}
 }
 
 void myglTF::Model::loadMaterials(tinygltf::Model& gltfModel)
@@ -319,11 +398,11 @@ void myglTF::Model::loadMaterials(tinygltf::Model& gltfModel)
 	for (tinygltf::Material& mat : gltfModel.materials) {
 		myglTF::Material material(device);
 		if (mat.values.find("baseColorTexture") != mat.values.end()) {
-			material.baseColorTexture = getTexture(gltfModel.textures[mat.values["baseColorTexture"].TextureIndex()].source);
+			material.baseColorTexture = getTexture(getTextureSource(gltfModel.textures[mat.values["baseColorTexture"].TextureIndex()]));
 		}
 		// Metallic roughness workflow
 		if (mat.values.find("metallicRoughnessTexture") != mat.values.end()) {
-			material.metallicRoughnessTexture = getTexture(gltfModel.textures[mat.values["metallicRoughnessTexture"].TextureIndex()].source);
+			material.metallicRoughnessTexture = getTexture(getTextureSource(gltfModel.textures[mat.values["metallicRoughnessTexture"].TextureIndex()]));
 		}
 		if (mat.values.find("roughnessFactor") != mat.values.end()) {
 			material.roughnessFactor = static_cast<float>(mat.values["roughnessFactor"].Factor());
@@ -335,16 +414,16 @@ void myglTF::Model::loadMaterials(tinygltf::Model& gltfModel)
 			material.baseColorFactor = glm::make_vec4(mat.values["baseColorFactor"].ColorFactor().data());
 		}
 		if (mat.additionalValues.find("normalTexture") != mat.additionalValues.end()) {
-			material.normalTexture = getTexture(gltfModel.textures[mat.additionalValues["normalTexture"].TextureIndex()].source);
+			material.normalTexture = getTexture(getTextureSource(gltfModel.textures[mat.additionalValues["normalTexture"].TextureIndex()]));
 		}
 		else {
 			material.normalTexture = &emptyTexture;
 		}
 		if (mat.additionalValues.find("emissiveTexture") != mat.additionalValues.end()) {
-			material.emissiveTexture = getTexture(gltfModel.textures[mat.additionalValues["emissiveTexture"].TextureIndex()].source);
+			material.emissiveTexture = getTexture(getTextureSource(gltfModel.textures[mat.additionalValues["emissiveTexture"].TextureIndex()]));
 		}
 		if (mat.additionalValues.find("occlusionTexture") != mat.additionalValues.end()) {
-			material.occlusionTexture = getTexture(gltfModel.textures[mat.additionalValues["occlusionTexture"].TextureIndex()].source);
+			material.occlusionTexture = getTexture(getTextureSource(gltfModel.textures[mat.additionalValues["occlusionTexture"].TextureIndex()]));
 		}
 		if (mat.additionalValues.find("alphaMode") != mat.additionalValues.end()) {
 			tinygltf::Parameter param = mat.additionalValues["alphaMode"];
@@ -358,6 +437,7 @@ void myglTF::Model::loadMaterials(tinygltf::Model& gltfModel)
 		if (mat.additionalValues.find("alphaCutoff") != mat.additionalValues.end()) {
 			material.alphaCutoff = static_cast<float>(mat.additionalValues["alphaCutoff"].Factor());
 		}
+		material.doubleSided = mat.doubleSided;
 
 		materials.push_back(material);
 	}
@@ -1160,7 +1240,7 @@ void myglTF::Texture::destroy()
 }
 
 void myglTF::Texture::fromglTfImage(tinygltf::Image& gltfimage, std::string path, vks::VulkanDevice* device,
-	VkQueue copyQueue)
+	VkQueue copyQueue, const vks::ktx2::Texture* ktx2Texture)
 {
 	this->device = device;
 
@@ -1172,9 +1252,16 @@ void myglTF::Texture::fromglTfImage(tinygltf::Image& gltfimage, std::string path
 		}
 	}
 
-	VkFormat format;
-
-	if (!isKtx) {
+	if (ktx2Texture) {
+		// Texture is stored in a KTX2 container with a GPU format and pre-computed mips, so it can be uploaded as is
+		width = ktx2Texture->width;
+		height = ktx2Texture->height;
+		mipLevels = static_cast<uint32_t>(ktx2Texture->levels.size());
+		format = ktx2Texture->format;
+		memorySize = vks::ktx2::createImage(*ktx2Texture, device, copyQueue, VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, image, deviceMemory);
+		imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	}
+	else if (!isKtx) {
 		// Texture was loaded using STB_Image
 
 		unsigned char* buffer = nullptr;
@@ -1257,6 +1344,7 @@ void myglTF::Texture::fromglTfImage(tinygltf::Image& gltfimage, std::string path
 		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
 		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
+		memorySize = memReqs.size;
 
 		VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 
@@ -1472,6 +1560,7 @@ void myglTF::Texture::fromglTfImage(tinygltf::Image& gltfimage, std::string path
 		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
 		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
+		memorySize = memReqs.size;
 
 		VkImageSubresourceRange subresourceRange = {};
 		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -1523,8 +1612,7 @@ void myglTF::Texture::fromglTfImage(tinygltf::Image& gltfimage, std::string path
 
 myglTF::Material::~Material()
 {
-	if (traditionalPipeline)
-		vkDestroyPipeline(device->logicalDevice, traditionalPipeline, nullptr);
+	// The traditional pipeline is owned by the pipeline registry that created it, as it may be shared with other materials
 }
 
 void myglTF::Material::createDescriptorSet(VkDescriptorPool descriptorPool, VkDescriptorSetLayout descriptorSetLayout,
@@ -1667,6 +1755,20 @@ myglTF::Texture* myglTF::Model::getTexture(uint32_t index)
 	return nullptr;
 }
 
+// Prefers the KTX2 image of textures using KHR_texture_basisu if it could be loaded, falls back to the regular glTF image source otherwise
+int32_t myglTF::Model::getTextureSource(const tinygltf::Texture& texture)
+{
+	auto extension = texture.extensions.find("KHR_texture_basisu");
+	if ((extension != texture.extensions.end()) && extension->second.Has("source")) {
+		const int32_t source = extension->second.Get("source").GetNumberAsInt();
+		const bool loaded = (source >= 0) && (source < static_cast<int32_t>(textures.size())) && !textures[source].placeholder;
+		if (loaded || (texture.source < 0)) {
+			return source;
+		}
+	}
+	return texture.source;
+}
+
 void myglTF::Model::createEmptyTexture(VkQueue transferQueue)
 {
 	emptyTexture.device = device;
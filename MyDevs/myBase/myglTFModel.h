@@ -23,6 +23,7 @@
 
 #include "vulkan/vulkan.h"
 #include "VulkanDevice.h"
+#include "VulkanKTX2.h"
 
 #include <ktx.h>
 #include <ktxvulkan.h>
@@ -55,7 +56,10 @@ namespace myglTF
 			}
 		}
 
-		return tinygltf::LoadImageData(image, imageIndex, error, warning, req_width, req_height, bytes, size, userData);
+		// Keep the encoded data, images (including KTX2) are decoded in parallel by Model::loadImages
+		image->image.assign(bytes, bytes + size);
+		image->as_is = true;
+		return true;
 	}
 
 	inline bool loadImageDataFuncEmpty(tinygltf::Image* image, const int imageIndex, std::string* error, std::string* warning, int req_width, int req_height, const unsigned char* bytes, int size, void* userData)
@@ -100,10 +104,16 @@ namespace myglTF
 		uint32_t layerCount;
 		VkDescriptorImageInfo descriptor;
 		VkSampler sampler;
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		// Size of the device memory backing the image
+		VkDeviceSize memorySize = 0;
+		// Image data could not be loaded and was replaced with a 1x1 white image
+		bool placeholder = false;
 		uint32_t index;
 		void updateDescriptor();
 		void destroy();
-		void fromglTfImage(tinygltf::Image& gltfimage, std::string path, vks::VulkanDevice* device, VkQueue copyQueue);
+		// If ktx2Texture is set, its pre-computed mip chain is uploaded instead of the glTF image
+		void fromglTfImage(tinygltf::Image& gltfimage, std::string path, vks::VulkanDevice* device, VkQueue copyQueue, const vks::ktx2::Texture* ktx2Texture = nullptr);
 	};
 
 	/*
@@ -114,6 +124,7 @@ namespace myglTF
 		enum AlphaMode { ALPHAMODE_OPAQUE, ALPHAMODE_MASK, ALPHAMODE_BLEND };
 		AlphaMode alphaMode = ALPHAMODE_OPAQUE;
 		float alphaCutoff = 1.0f;
+		bool doubleSided = false;
 		float metallicFactor = 1.0f;
 		float roughnessFactor = 1.0f;
 		glm::vec4 baseColorFactor = glm::vec4(1.0f);
@@ -128,6 +139,7 @@ namespace myglTF
 
 		VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
 		VkDescriptorSet meshShaderDescriptorSet{ VK_NULL_HANDLE };
+		// Not owned by the material, identical materials share the same pipeline
 		VkPipeline traditionalPipeline{ VK_NULL_HANDLE };
 
 		Material(vks::VulkanDevice* device) : device(device) {};
@@ -290,6 +302,7 @@ namespace myglTF
 		static uint32_t descriptorBindingFlags;
 	private:
 		myglTF::Texture* getTexture(uint32_t index);
+		int32_t getTextureSource(const tinygltf::Texture& texture);
 		myglTF::Texture emptyTexture;
 		void createEmptyTexture(VkQueue transferQueue);
 		/**
@@ -55,6 +55,7 @@ MyMeshShader::MyMeshShader() : VulkanExampleBase()
 MyMeshShader::~MyMeshShader()
 {
 	if (device) {
+		pipelineRegistry.destroy();
 		vkDestroyPipelineLayout(device, traditionalPipelineLayout, nullptr);
 		vkDestroyPipelineLayout(device, meshShaderPipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.scene, nullptr);
@@ -220,7 +221,9 @@ void MyMeshShader::preparePipelines()
 	//meshShaderStages[0] = loadShader(getShadersPath() + "myMeshShader/meshshader.mesh.spv", VK_SHADER_STAGE_MESH_BIT_EXT);
 	//meshShaderStages[1] = loadShader(getShadersPath() + "myMeshShader/meshshader.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
 
-	// POI: Instead if using a few fixed pipelines, we create one traditionalPipeline for each material using the properties of that material
+	// POI: Instead if using a few fixed pipelines, we request one traditionalPipeline for each material using the properties of that material
+	// Materials with identical properties share a pipeline, the unique ones are compiled in parallel
+	pipelineRegistry.create(device, pipelineCache);
 	for (auto &material : model.materials) {
 
 		// traditional pipeline
@@ -248,12 +251,14 @@ void MyMeshShader::preparePipelines()
 		traditionalShaderStages[1].pSpecializationInfo = &specializationInfo;
 
 		// For double sided materials, culling will be disabled
-		rasterizationStateCI.cullMode = VK_CULL_MODE_BACK_BIT;
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &material.traditionalPipeline));
+		rasterizationStateCI.cullMode = material.doubleSided ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
+		pipelineRegistry.request(pipelineCI, &material.traditionalPipeline);
 
 	}
+	pipelineRegistry.compile();
 
-	// mesh shader pipeline
+	// mesh shader pipeline, shared by all materials
+	rasterizationStateCI.cullMode = VK_CULL_MODE_BACK_BIT;
 	pipelineCI.layout = meshShaderPipelineLayout;
 	pipelineCI.pVertexInputState = nullptr;
 	pipelineCI.pInputAssemblyState = nullptr;
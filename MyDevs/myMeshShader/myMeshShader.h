@@ -25,6 +25,7 @@
 #include "myIncludes.h"
 #include "vulkanexamplebase.h"
 #include "myglTFModel.h"
+#include "myPipelineRegistry.h"
 
 class MyMeshShader : public VulkanExampleBase
 {
@@ -45,6 +46,8 @@ public:
 
 	VkPipelineLayout traditionalPipelineLayout{ VK_NULL_HANDLE };
 	VkPipelineLayout meshShaderPipelineLayout{ VK_NULL_HANDLE };
+	// Owns the per-material pipelines, materials with identical state share a pipeline
+	MyPipelineRegistry pipelineRegistry;
 	VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
 
 	struct DescriptorSetLayouts {
@@ -41,11 +41,8 @@ MyRayTracingBasic::~MyRayTracingBasic()
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 		deleteStorageImage();
-		deleteAccelerationStructure(BLAS);
-		deleteAccelerationStructure(TLAS);
-		vertexBuffer.destroy();
-		indexBuffer.destroy();
-		transformBuffer.destroy();
+		sceneAS.destroy();
+		denoiser.destroy();
 		shaderBindingTables.raygen.destroy();
 		shaderBindingTables.miss.destroy();
 		shaderBindingTables.hit.destroy();
@@ -54,106 +51,22 @@ MyRayTracingBasic::~MyRayTracingBasic()
 	}
 }
 
-void MyRayTracingBasic::createAccelerationStructureBuffer(AccelerationStructure& accelerationStructure,
-                                                             VkAccelerationStructureBuildSizesInfoKHR buildSizeInfo)
+void MyRayTracingBasic::createAccelerationStructures()
 {
-	VkBufferCreateInfo bufferCreateInfo{};
-	bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferCreateInfo.size = buildSizeInfo.accelerationStructureSize;
-	bufferCreateInfo.usage = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
-	VK_CHECK_RESULT(vkCreateBuffer(device, &bufferCreateInfo, nullptr, &accelerationStructure.buffer));
-	VkMemoryRequirements memoryRequirements{};
-	vkGetBufferMemoryRequirements(device, accelerationStructure.buffer, &memoryRequirements);
-	VkMemoryAllocateFlagsInfo memoryAllocateFlagsInfo{};
-	memoryAllocateFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
-	memoryAllocateFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
-	VkMemoryAllocateInfo memoryAllocateInfo{};
-	memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memoryAllocateInfo.pNext = &memoryAllocateFlagsInfo;
-	memoryAllocateInfo.allocationSize = memoryRequirements.size;
-	memoryAllocateInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(device, &memoryAllocateInfo, nullptr, &accelerationStructure.memory));
-	VK_CHECK_RESULT(vkBindBufferMemory(device, accelerationStructure.buffer, accelerationStructure.memory, 0));
-}
-
-void MyRayTracingBasic::createBottomLevelAccelerationStructure()
-{
-	// Use transform matrices from the glTF nodes
-	std::vector<VkTransformMatrixKHR> transformMatrices{};
-	for (auto node : model.linearNodes) {
-		if (node->mesh) {
-			for (auto primitive : node->mesh->primitives) {
-				if (primitive->indexCount > 0) {
-					VkTransformMatrixKHR transformMatrix{};
-					auto m = glm::mat3x4(glm::transpose(node->getMatrix()));
-					memcpy(&transformMatrix, (void*)&m, sizeof(glm::mat3x4));
-					transformMatrices.push_back(transformMatrix);
-				}
-			}
-		}
-	}
+	// We flip the matrix [1][1] = -1.0f to accomodate for the glTF up vector
+	glm::mat4 rootTransform = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, -1.0f, 1.0f));
+	sceneAS.create(this, queue, &model, rootTransform, getShadersPath() + "myRaytracingBasic/skinning.comp.spv");
 
-	// Transform buffer
-	VK_CHECK_RESULT(vulkanDevice->createBuffer(
-		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		&transformBuffer,
-		static_cast<uint32_t>(transformMatrices.size()) * sizeof(VkTransformMatrixKHR),
-		transformMatrices.data()));
-
-	// Build
-	// One geometry per glTF node, so we can index materials using gl_GeometryIndexEXT
-	std::vector<uint32_t> maxPrimitiveCounts{};
-	std::vector<VkAccelerationStructureGeometryKHR> geometries{};
-	std::vector<VkAccelerationStructureBuildRangeInfoKHR> buildRangeInfos{};
-	std::vector<VkAccelerationStructureBuildRangeInfoKHR*> pBuildRangeInfos{};
+	// One geometry node per BLAS geometry, so we can index materials using gl_InstanceCustomIndexEXT + gl_GeometryIndexEXT
 	std::vector<GeometryNode> geometryNodes{};
-	for (auto node : model.linearNodes) {
-		if (node->mesh) {
-			for (auto primitive : node->mesh->primitives) {
-				if (primitive->indexCount > 0) {
-					VkDeviceOrHostAddressConstKHR vertexBufferDeviceAddress{};
-					VkDeviceOrHostAddressConstKHR indexBufferDeviceAddress{};
-					VkDeviceOrHostAddressConstKHR transformBufferDeviceAddress{};
-
-					vertexBufferDeviceAddress.deviceAddress = getBufferDeviceAddress(model.vertices.buffer);// +primitive->firstVertex * sizeof(vkglTF::Vertex);
-					indexBufferDeviceAddress.deviceAddress = getBufferDeviceAddress(model.indices.buffer) + primitive->firstIndex * sizeof(uint32_t);
-					transformBufferDeviceAddress.deviceAddress = getBufferDeviceAddress(transformBuffer.buffer) + static_cast<uint32_t>(geometryNodes.size()) * sizeof(VkTransformMatrixKHR);
-
-					VkAccelerationStructureGeometryKHR geometry{};
-					geometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
-					geometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
-					geometry.geometry.triangles.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
-					geometry.geometry.triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
-					geometry.geometry.triangles.vertexData = vertexBufferDeviceAddress;
-					geometry.geometry.triangles.maxVertex = model.vertices.count;
-					//geometry.geometry.triangles.maxVertex = primitive->vertexCount;
-					geometry.geometry.triangles.vertexStride = sizeof(myglTF::VertexSimple);
-					geometry.geometry.triangles.indexType = VK_INDEX_TYPE_UINT32;
-					geometry.geometry.triangles.indexData = indexBufferDeviceAddress;
-					geometry.geometry.triangles.transformData = transformBufferDeviceAddress;
-					geometries.push_back(geometry);
-					maxPrimitiveCounts.push_back(primitive->indexCount / 3);
-
-					VkAccelerationStructureBuildRangeInfoKHR buildRangeInfo{};
-					buildRangeInfo.firstVertex = 0;
-					buildRangeInfo.primitiveOffset = 0; // primitive->firstIndex * sizeof(uint32_t);
-					buildRangeInfo.primitiveCount = primitive->indexCount / 3;
-					buildRangeInfo.transformOffset = 0;
-					buildRangeInfos.push_back(buildRangeInfo);
-
-					GeometryNode geometryNode{};
-					geometryNode.vertexBufferDeviceAddress = vertexBufferDeviceAddress.deviceAddress;
-					geometryNode.indexBufferDeviceAddress = indexBufferDeviceAddress.deviceAddress;
-					geometryNode.textureIndexBaseColor = primitive->material.baseColorTexture->index;
-					geometryNode.textureIndexOcclusion = primitive->material.occlusionTexture ? primitive->material.occlusionTexture->index : -1;
-					geometryNodes.push_back(geometryNode);
-				}
-			}
-		}
-	}
-	for (auto& rangeInfo : buildRangeInfos) {
-		pBuildRangeInfos.push_back(&rangeInfo);
+	for (auto& geometry : sceneAS.geometries) {
+		GeometryNode geometryNode{};
+		geometryNode.vertexBufferDeviceAddress = geometry.vertexBufferDeviceAddress;
+		geometryNode.indexBufferDeviceAddress = geometry.indexBufferDeviceAddress;
+		geometryNode.textureIndexBaseColor = geometry.primitive->material.baseColorTexture->index;
+		geometryNode.textureIndexOcclusion = geometry.primitive->material.occlusionTexture ? geometry.primitive->material.occlusionTexture->index : -1;
+		geometryNode.vertexStride = sceneAS.vertexStride / sizeof(glm::vec4);
+		geometryNodes.push_back(geometryNode);
 	}
 
 	vks::Buffer stagingBuffer;
@@ -174,163 +87,6 @@ void MyRayTracingBasic::createBottomLevelAccelerationStructure()
 	vulkanDevice->copyBuffer(&stagingBuffer, &geometryNodesBuffer, queue);
 
 	stagingBuffer.destroy();
-
-	// Get size info
-	VkAccelerationStructureBuildGeometryInfoKHR accelerationStructureBuildGeometryInfo{};
-	accelerationStructureBuildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
-	accelerationStructureBuildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-	accelerationStructureBuildGeometryInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
-	accelerationStructureBuildGeometryInfo.geometryCount = static_cast<uint32_t>(geometries.size());
-	accelerationStructureBuildGeometryInfo.pGeometries = geometries.data();
-
-	VkAccelerationStructureBuildSizesInfoKHR accelerationStructureBuildSizesInfo{};
-	accelerationStructureBuildSizesInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
-	vkGetAccelerationStructureBuildSizesKHR(
-		device,
-		VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
-		&accelerationStructureBuildGeometryInfo,
-		maxPrimitiveCounts.data(),
-		&accelerationStructureBuildSizesInfo);
-
-	createAccelerationStructureBuffer(BLAS, accelerationStructureBuildSizesInfo);
-
-	VkAccelerationStructureCreateInfoKHR accelerationStructureCreateInfo{};
-	accelerationStructureCreateInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
-	accelerationStructureCreateInfo.buffer = BLAS.buffer;
-	accelerationStructureCreateInfo.size = accelerationStructureBuildSizesInfo.accelerationStructureSize;
-	accelerationStructureCreateInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-	vkCreateAccelerationStructureKHR(device, &accelerationStructureCreateInfo, nullptr, &BLAS.handle);
-
-	// Create a small scratch buffer used during build of the bottom level acceleration structure
-	ScratchBuffer scratchBuffer = createScratchBuffer(accelerationStructureBuildSizesInfo.buildScratchSize);
-
-	accelerationStructureBuildGeometryInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
-	accelerationStructureBuildGeometryInfo.dstAccelerationStructure = BLAS.handle;
-	accelerationStructureBuildGeometryInfo.scratchData.deviceAddress = scratchBuffer.deviceAddress;
-
-	const VkAccelerationStructureBuildRangeInfoKHR* buildOffsetInfo = buildRangeInfos.data();
-
-	// Build the acceleration structure on the device via a one-time command buffer submission
-	// Some implementations may support acceleration structure building on the host (VkPhysicalDeviceAccelerationStructureFeaturesKHR->accelerationStructureHostCommands), but we prefer device builds
-	VkCommandBuffer commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-	vkCmdBuildAccelerationStructuresKHR(
-		commandBuffer,
-		1,
-		&accelerationStructureBuildGeometryInfo,
-		pBuildRangeInfos.data());
-	vulkanDevice->flushCommandBuffer(commandBuffer, queue);
-
-	VkAccelerationStructureDeviceAddressInfoKHR accelerationDeviceAddressInfo{};
-	accelerationDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
-	accelerationDeviceAddressInfo.accelerationStructure = BLAS.handle;
-	BLAS.deviceAddress = vkGetAccelerationStructureDeviceAddressKHR(device, &accelerationDeviceAddressInfo);
-
-	deleteScratchBuffer(scratchBuffer);
-}
-
-void MyRayTracingBasic::createTopLevelAccelerationStructure()
-{
-	// We flip the matrix [1][1] = -1.0f to accomodate for the glTF up vector
-	VkTransformMatrixKHR transformMatrix = {
-		1.0f, 0.0f, 0.0f, 0.0f,
-		0.0f, -1.0f, 0.0f, 0.0f,
-		0.0f, 0.0f, 1.0f, 0.0f };
-
-	VkAccelerationStructureInstanceKHR instance{};
-	instance.transform = transformMatrix;
-	instance.instanceCustomIndex = 0;
-	instance.mask = 0xFF;
-	instance.instanceShaderBindingTableRecordOffset = 0;
-	instance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
-	instance.accelerationStructureReference = BLAS.deviceAddress;
-
-	// Buffer for instance data
-	vks::Buffer instancesBuffer;
-	VK_CHECK_RESULT(vulkanDevice->createBuffer(
-		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		&instancesBuffer,
-		sizeof(VkAccelerationStructureInstanceKHR),
-		&instance));
-
-	VkDeviceOrHostAddressConstKHR instanceDataDeviceAddress{};
-	instanceDataDeviceAddress.deviceAddress = getBufferDeviceAddress(instancesBuffer.buffer);
-
-	VkAccelerationStructureGeometryKHR accelerationStructureGeometry{};
-	accelerationStructureGeometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
-	accelerationStructureGeometry.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
-	accelerationStructureGeometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
-	accelerationStructureGeometry.geometry.instances.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
-	accelerationStructureGeometry.geometry.instances.arrayOfPointers = VK_FALSE;
-	accelerationStructureGeometry.geometry.instances.data = instanceDataDeviceAddress;
-
-	// Get size info
-	/*
-		The pSrcAccelerationStructure, dstAccelerationStructure, and mode members of pBuildInfo are ignored. Any VkDeviceOrHostAddressKHR members of pBuildInfo are ignored by this command, except that the hostAddress member of VkAccelerationStructureGeometryTrianglesDataKHR::transformData will be examined to check if it is NULL.*
-		*/
-	VkAccelerationStructureBuildGeometryInfoKHR accelerationStructureBuildGeometryInfo{};
-	accelerationStructureBuildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
-	accelerationStructureBuildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
-	accelerationStructureBuildGeometryInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
-	accelerationStructureBuildGeometryInfo.geometryCount = 1;
-	accelerationStructureBuildGeometryInfo.pGeometries = &accelerationStructureGeometry;
-
-	uint32_t primitive_count = 1;
-
-	VkAccelerationStructureBuildSizesInfoKHR accelerationStructureBuildSizesInfo{};
-	accelerationStructureBuildSizesInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
-	vkGetAccelerationStructureBuildSizesKHR(
-		device,
-		VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
-		&accelerationStructureBuildGeometryInfo,
-		&primitive_count,
-		&accelerationStructureBuildSizesInfo);
-
-	createAccelerationStructureBuffer(TLAS, accelerationStructureBuildSizesInfo);
-
-	VkAccelerationStructureCreateInfoKHR accelerationStructureCreateInfo{};
-	accelerationStructureCreateInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
-	accelerationStructureCreateInfo.buffer = TLAS.buffer;
-	accelerationStructureCreateInfo.size = accelerationStructureBuildSizesInfo.accelerationStructureSize;
-	accelerationStructureCreateInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
-	vkCreateAccelerationStructureKHR(device, &accelerationStructureCreateInfo, nullptr, &TLAS.handle);
-
-	// Create a small scratch buffer used during build of the top level acceleration structure
-	ScratchBuffer scratchBuffer = createScratchBuffer(accelerationStructureBuildSizesInfo.buildScratchSize);
-
-	VkAccelerationStructureBuildGeometryInfoKHR accelerationBuildGeometryInfo{};
-	accelerationBuildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
-	accelerationBuildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
-	accelerationBuildGeometryInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
-	accelerationBuildGeometryInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
-	accelerationBuildGeometryInfo.dstAccelerationStructure = TLAS.handle;
-	accelerationBuildGeometryInfo.geometryCount = 1;
-	accelerationBuildGeometryInfo.pGeometries = &accelerationStructureGeometry;
-	accelerationBuildGeometryInfo.scratchData.deviceAddress = scratchBuffer.deviceAddress;
-
-	VkAccelerationStructureBuildRangeInfoKHR accelerationStructureBuildRangeInfo{};
-	accelerationStructureBuildRangeInfo.primitiveCount = 1;
-	accelerationStructureBuildRangeInfo.primitiveOffset = 0;
-	accelerationStructureBuildRangeInfo.firstVertex = 0;
-	accelerationStructureBuildRangeInfo.transformOffset = 0;
-	std::vector<VkAccelerationStructureBuildRangeInfoKHR*> accelerationBuildStructureRangeInfos = { &accelerationStructureBuildRangeInfo };
-
-	// Build the acceleration structure on the device via a one-time command buffer submission
-	// Some implementations may support acceleration structure building on the host (VkPhysicalDeviceAccelerationStructureFeaturesKHR->accelerationStructureHostCommands), but we prefer device builds
-	VkCommandBuffer commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-	vkCmdBuildAccelerationStructuresKHR(
-		commandBuffer,
-		1,
-		&accelerationBuildGeometryInfo,
-		accelerationBuildStructureRangeInfos.data());
-	vulkanDevice->flushCommandBuffer(commandBuffer, queue);
-
-	VkAccelerationStructureDeviceAddressInfoKHR accelerationDeviceAddressInfo{};
-	accelerationDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
-	accelerationDeviceAddressInfo.accelerationStructure = TLAS.handle;
-
-	deleteScratchBuffer(scratchBuffer);
-	instancesBuffer.destroy();
 }
 
 void MyRayTracingBasic::createShaderBindingTables()
@@ -361,8 +117,6 @@ void MyRayTracingBasic::createRayTracingPipeline()
 	std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
 		// Binding 0: Top level acceleration structure
 		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, 0),
-		// Binding 1: Ray tracing result image
-		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_RAYGEN_BIT_KHR, 1),
 		// Binding 2: Uniform buffer
 		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR, 2),
 		// Binding 3: Texture image
@@ -376,13 +130,12 @@ void MyRayTracingBasic::createRayTracingPipeline()
 	// Unbound set
 	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT setLayoutBindingFlags{};
 	setLayoutBindingFlags.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
-	setLayoutBindingFlags.bindingCount = 6;
+	setLayoutBindingFlags.bindingCount = 5;
 	std::vector<VkDescriptorBindingFlagsEXT> descriptorBindingFlags = {
 		0,
 		0,
 		0,
 		0,
-		0,
 		VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT
 	};
 	setLayoutBindingFlags.pBindingFlags = descriptorBindingFlags.data();
@@ -391,7 +144,9 @@ void MyRayTracingBasic::createRayTracingPipeline()
 	descriptorSetLayoutCI.pNext = &setLayoutBindingFlags;
 	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCI, nullptr, &descriptorSetLayout));
 
-	VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+	// Set 1: Denoiser input images written by the ray generation shader
+	std::array<VkDescriptorSetLayout, 2> setLayouts = { descriptorSetLayout, denoiser.descriptorSetLayout };
+	VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(setLayouts.data(), static_cast<uint32_t>(setLayouts.size()));
 	VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &pipelineLayout));
 
 	/*
@@ -453,7 +208,8 @@ void MyRayTracingBasic::createRayTracingPipeline()
 	rayTracingPipelineCI.pStages = shaderStages.data();
 	rayTracingPipelineCI.groupCount = static_cast<uint32_t>(shaderGroups.size());
 	rayTracingPipelineCI.pGroups = shaderGroups.data();
-	rayTracingPipelineCI.maxPipelineRayRecursionDepth = 1;
+	// Shadow and ambient occlusion rays are traced from the closest hit shader
+	rayTracingPipelineCI.maxPipelineRayRecursionDepth = 2;
 	rayTracingPipelineCI.layout = pipelineLayout;
 	VK_CHECK_RESULT(vkCreateRayTracingPipelinesKHR(device, VK_NULL_HANDLE, VK_NULL_HANDLE, 1, &rayTracingPipelineCI, nullptr, &pipeline));
 }
@@ -463,7 +219,6 @@ void MyRayTracingBasic::createDescriptorSets()
 	uint32_t imageCount = static_cast<uint32_t>(model.textures.size());
 	std::vector<VkDescriptorPoolSize> poolSizes = {
 		{ VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1 },
-		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
 		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },
 		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },
 		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 },
@@ -484,7 +239,7 @@ void MyRayTracingBasic::createDescriptorSets()
 
 	VkWriteDescriptorSetAccelerationStructureKHR descriptorAccelerationStructureInfo = vks::initializers::writeDescriptorSetAccelerationStructureKHR();
 	descriptorAccelerationStructureInfo.accelerationStructureCount = 1;
-	descriptorAccelerationStructureInfo.pAccelerationStructures = &TLAS.handle;
+	descriptorAccelerationStructureInfo.pAccelerationStructures = &sceneAS.TLAS.handle;
 
 	VkWriteDescriptorSet accelerationStructureWrite{};
 	accelerationStructureWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -495,13 +250,9 @@ void MyRayTracingBasic::createDescriptorSets()
 	accelerationStructureWrite.descriptorCount = 1;
 	accelerationStructureWrite.descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
 
-	VkDescriptorImageInfo storageImageDescriptor{ VK_NULL_HANDLE, storageImage.view, VK_IMAGE_LAYOUT_GENERAL };
-
 	std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
 		// Binding 0: Top level acceleration structure
 		accelerationStructureWrite,
-		// Binding 1: Ray tracing result image
-		vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, &storageImageDescriptor),
 		// Binding 2: Uniform data
 		vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &uniformBuffer.descriptor),
 		// Binding 4: Geometry node information SSBO
@@ -547,10 +298,8 @@ void MyRayTracingBasic::handleResize()
 {
 	// Recreate image
 	createStorageImage(swapChain.colorFormat, { width, height, 1 });
-	// Update descriptor
-	VkDescriptorImageInfo storageImageDescriptor{ VK_NULL_HANDLE, storageImage.view, VK_IMAGE_LAYOUT_GENERAL };
-	VkWriteDescriptorSet resultImageWrite = vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, &storageImageDescriptor);
-	vkUpdateDescriptorSets(device, 1, &resultImageWrite, 0, VK_NULL_HANDLE);
+	// Recreate the denoiser images, this also updates the output image descriptor
+	denoiser.resize(width, height, storageImage.view);
 	resized = false;
 }
 
@@ -561,19 +310,34 @@ void MyRayTracingBasic::buildCommandBuffers()
 		handleResize();
 	}
 
+	for (uint32_t i = 0; i < static_cast<uint32_t>(drawCmdBuffers.size()); ++i)
+	{
+		buildCommandBuffer(i);
+	}
+}
+
+void MyRayTracingBasic::buildCommandBuffer(uint32_t i)
+{
 	VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
 	VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
 
-	for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
 	{
 		VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
+		/*
+			Update the acceleration structures for the current node transforms and skinned poses
+		*/
+		sceneAS.update(drawCmdBuffers[i]);
+
+		denoiser.begin(drawCmdBuffers[i]);
+
 		/*
 			Dispatch the ray tracing commands
 		*/
 		vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, pipeline);
-		vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, pipelineLayout, 0, 1, &descriptorSet, 0, 0);
+		std::array<VkDescriptorSet, 2> descriptorSets = { descriptorSet, denoiser.descriptorSet };
+		vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, pipelineLayout, 0, static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(), 0, 0);
 
 		VkStridedDeviceAddressRegionKHR emptySbtEntry = {};
 		vkCmdTraceRaysKHR(
@@ -586,6 +350,11 @@ void MyRayTracingBasic::buildCommandBuffers()
 			height,
 			1);
 
+		/*
+			Accumulate and denoise the lighting, the result is written to the storage image
+		*/
+		denoiser.record(drawCmdBuffers[i]);
+
 		/*
 			Copy ray tracing output to swap chain image
 		*/
@@ -640,10 +409,14 @@ void MyRayTracingBasic::updateUniformBuffers()
 {
 	uniformData.projInverse = glm::inverse(camera.matrices.perspective);
 	uniformData.viewInverse = glm::inverse(camera.matrices.view);
-	// This value is used to accumulate multiple frames into the finale picture
-	// It's required as ray tracing needs to do multiple passes for transparency
-	// In this sample we use noise offset by this frame index to shoot rays for transparency into different directions
-	// Once enough frames with random ray directions have been accumulated, it looks like proper transparency
+	// Motion vectors are calculated against the camera of the last frame
+	uniformData.viewProjPrevious = viewProjection;
+	uniformData.cameraPositionPrevious = cameraPosition;
+	viewProjection = camera.matrices.perspective * camera.matrices.view;
+	cameraPosition = uniformData.viewInverse[3];
+	uniformData.gbufferIndex = denoiser.currentGBuffer();
+	// This value is used to seed the random numbers for the subpixel jitter, transparency and the shadow and ambient occlusion rays
+	// The denoiser accumulates the resulting noise over multiple frames
 	uniformData.frame++;
 	memcpy(uniformBuffer.mapped, &uniformData, sizeof(uniformData));
 }
@@ -662,6 +435,9 @@ void MyRayTracingBasic::getEnabledFeatures()
 	enabledAccelerationStructureFeatures.accelerationStructure = VK_TRUE;
 	enabledAccelerationStructureFeatures.pNext = &enabledRayTracingPipelineFeatures;
 
+	// The denoiser addresses its images by index
+	enabledFeatures.shaderStorageImageArrayDynamicIndexing = VK_TRUE;
+
 	physicalDeviceDescriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
 	physicalDeviceDescriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
 	physicalDeviceDescriptorIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
@@ -675,8 +451,15 @@ void MyRayTracingBasic::getEnabledFeatures()
 
 void MyRayTracingBasic::loadAssets()
 {
-	myglTF::Model::memoryPropertyFlags = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
-	model.loadFromFile(getAssetPath() + "models/sponza/sponza.gltf", vulkanDevice, queue/*, myglTF::FileLoadingFlags::PreTransformVertices*/);
+	// Skinned vertices are copied from the model's vertex buffer
+	myglTF::Model::memoryPropertyFlags = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	modelFile = getAssetPath() + "models/sponza/sponza.gltf";
+	for (size_t i = 0; i < args.size(); i++) {
+		if ((std::string(args[i]) == "--model") && (i + 1 < args.size())) {
+			modelFile = args[i + 1];
+		}
+	}
+	model.loadFromFile(modelFile, vulkanDevice, queue/*, myglTF::FileLoadingFlags::PreTransformVertices*/);
 	//model.loadFromFile(getAssetPath() + "models/FlightHelmet/glTF/FlightHelmet.gltf", vulkanDevice, queue);
 }
 
@@ -691,10 +474,10 @@ void MyRayTracingBasic::prepare()
 	loadAssets();
 
 	// Create the acceleration structures used to render the ray traced scene
-	createBottomLevelAccelerationStructure();
-	createTopLevelAccelerationStructure();
+	createAccelerationStructures();
 
 	createStorageImage(swapChain.colorFormat, { width, height, 1 });
+	denoiser.create(this, queue, getShadersPath() + "myRaytracingBasic/", width, height, storageImage.view, VK_SHADER_STAGE_RAYGEN_BIT_KHR);
 	createUniformBuffer();
 	createRayTracingPipeline();
 	createShaderBindingTables();
@@ -706,6 +489,7 @@ void MyRayTracingBasic::prepare()
 void MyRayTracingBasic::draw()
 {
 	VulkanExampleBase::prepareFrame();
+	buildCommandBuffer(currentBuffer);
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
 	VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
@@ -716,14 +500,68 @@ void MyRayTracingBasic::render()
 {
 	if (!prepared)
 		return;
+	bool animated = false;
+	if (animate && !paused && !model.animations.empty()) {
+		animationTimer += frameTimer;
+		if (animationTimer > model.animations[animationIndex].end) {
+			animationTimer -= model.animations[animationIndex].end;
+		}
+		model.updateAnimation(animationIndex, animationTimer);
+		animated = true;
+	}
 	updateUniformBuffers();
-	if (camera.updated) {
-		// If the camera's view has been updated we reset the frame accumulation
-		uniformData.frame = -1;
+	if ((camera.updated || animated) && !denoiser.settings.reprojection) {
+		// Without reprojection the accumulated history is only valid for an unchanged view
+		denoiser.reset();
 	}
 	draw();
 }
 
+void MyRayTracingBasic::OnUpdateUIOverlay(vks::UIOverlay* overlay)
+{
+	if (!model.animations.empty() && overlay->header("Animation")) {
+		overlay->checkBox("Animate", &animate);
+		overlay->sliderInt("Animation", (int32_t*)&animationIndex, 0, static_cast<int32_t>(model.animations.size()) - 1);
+	}
+	if (overlay->header("Acceleration structures")) {
+		const MySceneAccelerationStructure::Statistics& statistics = sceneAS.statistics;
+		overlay->text("BLAS: %d (%d deforming)", statistics.blasCount, statistics.deformingBlasCount);
+		overlay->text("Instances: %d", statistics.instanceCount);
+		overlay->text("BLAS refits: %d, rebuilds: %d", statistics.blasRefits, statistics.blasRebuilds);
+		overlay->text("TLAS: %s", statistics.tlasRebuilt ? "rebuilt" : "updated");
+		overlay->text("GPU build: %.3f ms", statistics.gpuTime);
+		overlay->text("CPU record: %.3f ms", statistics.cpuTime);
+		overlay->sliderFloat("BLAS rebuild", &sceneAS.settings.blasRebuildDeformation, 0.0f, 1.0f);
+		overlay->sliderFloat("TLAS rebuild", &sceneAS.settings.tlasRebuildMovement, 0.0f, 1.0f);
+	}
+	if (overlay->header("Sampling")) {
+		overlay->sliderInt("Samples per pixel", (int32_t*)&uniformData.samplesPerPixel, 1, 8);
+		overlay->sliderInt("AO rays", (int32_t*)&uniformData.aoRays, 0, 8);
+		overlay->sliderFloat("AO radius", &uniformData.aoRadius, 0.1f, 10.0f);
+	}
+	if (overlay->header("Denoiser")) {
+		MyTemporalDenoiser::Settings& settings = denoiser.settings;
+		overlay->checkBox("Temporal accumulation", &settings.temporal);
+		if (overlay->checkBox("Reprojection", &settings.reprojection)) {
+			denoiser.reset();
+		}
+		overlay->sliderInt("Max history", &settings.maxHistory, 1, 128);
+		overlay->sliderInt("A-trous passes", &settings.atrousIterations, 0, 6);
+		overlay->sliderFloat("Color phi", &settings.phiColor, 0.1f, 16.0f);
+		overlay->sliderFloat("Normal phi", &settings.phiNormal, 1.0f, 256.0f);
+		overlay->sliderFloat("Depth phi", &settings.phiDepth, 0.1f, 8.0f);
+		const std::vector<std::string> debugViews = { "Final", "Noisy input", "Lighting", "Variance", "History length" };
+		overlay->comboBox("View", &settings.debugView, debugViews);
+		// Quality vs. time: GPU cost of the ray tracing and the denoising passes
+		const MyTemporalDenoiser::Statistics& statistics = denoiser.statistics;
+		overlay->text("Accumulated frames: %d", statistics.accumulatedFrames);
+		overlay->text("Ray tracing: %.3f ms", statistics.renderTime);
+		overlay->text("Temporal: %.3f ms", statistics.temporalTime);
+		overlay->text("A-trous: %.3f ms", statistics.filterTime);
+		overlay->text("Composite: %.3f ms", statistics.compositeTime);
+	}
+}
+
 MyRayTracingBasic* myRayTracingBasic;
 LRESULT CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 {
@@ -11,6 +11,8 @@
 #include "myIncludes.h"
 #include "myVulkanRTBase.h"
 #include "myglTFModel.h"
+#include "mySceneAccelerationStructure.h"
+#include "myTemporalDenoiser.h"
 
 #define VK_GLTF_MATERIAL_IDS
 #include "myglTFModel.h"
@@ -18,19 +20,17 @@
 class MyRayTracingBasic : public MyVulkanRTBase
 {
 public:
-	AccelerationStructure TLAS{};
-	AccelerationStructure BLAS{};
-
-	vks::Buffer vertexBuffer;
-	vks::Buffer indexBuffer;
-	uint32_t indexCount{ 0 };
-	vks::Buffer transformBuffer;
+	// Acceleration structures for the model, updated every frame for animated nodes and skinned meshes
+	MySceneAccelerationStructure sceneAS;
 
 	struct GeometryNode {
 		uint64_t vertexBufferDeviceAddress;
 		uint64_t indexBufferDeviceAddress;
 		int32_t textureIndexBaseColor;
 		int32_t textureIndexOcclusion;
+		// Vertex stride in vec4s
+		uint32_t vertexStride;
+		uint32_t _pad;
 	};
 	vks::Buffer geometryNodesBuffer;
 
@@ -46,33 +46,47 @@ public:
 	struct UniformData {
 		glm::mat4 viewInverse;
 		glm::mat4 projInverse;
+		// Used to derive the motion vectors for the denoiser
+		glm::mat4 viewProjPrevious;
+		glm::vec4 cameraPositionPrevious;
+		// Direction towards the sun
+		glm::vec4 lightDirection{ glm::normalize(glm::vec3(-0.3f, -1.0f, -0.25f)), 0.0f };
 		uint32_t frame{ 0 };
+		uint32_t samplesPerPixel{ 1 };
+		uint32_t aoRays{ 1 };
+		uint32_t gbufferIndex{ 0 };
+		float aoRadius{ 2.0f };
 	} uniformData;
+	// Camera matrices of the last frame
+	glm::mat4 viewProjection{ 1.0f };
+	glm::vec4 cameraPosition{ 0.0f };
 	vks::Buffer uniformBuffer;
 
+	// Accumulates and filters the noisy shadows and ambient occlusion, and writes the final image to the storage image
+	MyTemporalDenoiser denoiser;
+
 	VkPipeline pipeline{ VK_NULL_HANDLE };
 	VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
 	VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
 	VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
 
 	myglTF::Model model;
+	// Can be overriden with --model <file.gltf>
+	std::string modelFile;
+	bool animate{ true };
+	uint32_t animationIndex{ 0 };
+	float animationTimer{ 0.0f };
 
 	VkPhysicalDeviceDescriptorIndexingFeaturesEXT physicalDeviceDescriptorIndexingFeatures{};
 public:
 	MyRayTracingBasic();
 	~MyRayTracingBasic();
 
-	void createAccelerationStructureBuffer(AccelerationStructure& accelerationStructure, VkAccelerationStructureBuildSizesInfoKHR buildSizeInfo);
-
 	/*
-		Create the bottom level acceleration structure that contains the scene's actual geometry (vertices, triangles)
+		Create the acceleration structures (one BLAS per glTF mesh node, one TLAS instance per node) and the geometry node buffer
+		used by the hit shaders to look up vertices and materials with gl_InstanceCustomIndexEXT + gl_GeometryIndexEXT
 	*/
-	void createBottomLevelAccelerationStructure();
-
-	/*
-		The top level acceleration structure contains the scene's object instances
-	*/
-	void createTopLevelAccelerationStructure();
+	void createAccelerationStructures();
 
 	/*
 		Create the Shader Binding Tables that binds the programs and top-level acceleration structure
@@ -114,6 +128,8 @@ public:
 		Command buffer generation
 	*/
 	void buildCommandBuffers();
+	// The acceleration structure updates are recorded into the frame's command buffer, so it's rebuilt every frame
+	void buildCommandBuffer(uint32_t index);
 
 	void updateUniformBuffers();
 
@@ -126,4 +142,6 @@ public:
 	void draw();
 
 	virtual void render();
+
+	virtual void OnUpdateUIOverlay(vks::UIOverlay* overlay);
 };
\ No newline at end of file
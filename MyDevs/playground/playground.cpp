@@ -34,9 +34,7 @@ glTFModel::~glTFModel()
 		vkDestroySampler(vulkanDevice->logicalDevice, image.texture.sampler, nullptr);
 		vkFreeMemory(vulkanDevice->logicalDevice, image.texture.deviceMemory, nullptr);
 	}
-	for (Material material : materials) {
-		vkDestroyPipeline(vulkanDevice->logicalDevice, material.traditionalPipeline, nullptr);
-	}
+	// Material pipelines are owned by the pipeline registry
 }
 
 /*
@@ -297,6 +295,7 @@ VulkanExample::VulkanExample() : VulkanExampleBase()
 VulkanExample::~VulkanExample()
 {
 	if (device) {
+		pipelineRegistry.destroy();
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.matrices, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.textures, nullptr);
@@ -575,7 +574,9 @@ void VulkanExample::preparePipelines()
 	shaderStages[0] = loadShader(getShadersPath() + "playground/scene.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
 	shaderStages[1] = loadShader(getShadersPath() + "playground/scene.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
 
-	// POI: Instead if using a few fixed pipelines, we create one pipeline for each material using the properties of that material
+	// POI: Instead if using a few fixed pipelines, we request one pipeline for each material using the properties of that material
+	// Materials with identical properties share a pipeline, the unique ones are compiled in parallel
+	pipelineRegistry.create(device, pipelineCache);
 	for (auto &material : glTFScene.materials) {
 
 		struct MaterialSpecializationData {
@@ -597,8 +598,9 @@ void VulkanExample::preparePipelines()
 		// For double sided materials, culling will be disabled
 		rasterizationStateCI.cullMode = material.doubleSided ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
 
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &material.traditionalPipeline));
+		pipelineRegistry.request(pipelineCI, &material.traditionalPipeline);
 	}
+	pipelineRegistry.compile();
 }
 
 void VulkanExample::prepareUniformBuffers()
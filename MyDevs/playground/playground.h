@@ -23,6 +23,7 @@
 #include "tiny_gltf.h"
 
 #include "vulkanexamplebase.h"
+#include "myPipelineRegistry.h"
 
 
  // Contains everything required to render a basic glTF scene in Vulkan
@@ -148,6 +149,8 @@ public:
 
 	VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
 	VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
+	// Owns the material pipelines, materials with identical state share a pipeline
+	MyPipelineRegistry pipelineRegistry;
 
 	struct DescriptorSetLayouts {
 		VkDescriptorSetLayout matrices{ VK_NULL_HANDLE };
@@ -4,11 +4,13 @@
 # Runs all samples in benchmark mode and stores all validation messages into a single text file
 
 # Note: Needs to be copied to where the binary files have been compiled (e.g. build/windows/bin/debug)
+# Pass --headless to render offscreen without a window (e.g. on build servers using a software Vulkan implementation)
 
 import glob
 import subprocess
 import os
 import platform
+import sys
 
 if os.path.exists("validation_output.txt"):
   os.remove("validation_output.txt")
@@ -16,8 +18,12 @@ if platform.system() == 'Linux' or platform.system() == 'Darwin':
     binaries = "./*"
 else:
     binaries = "*.exe"  
+headless = "--headless" in sys.argv
 for sample in glob.glob(binaries):
-    # Skip headless samples, as they require a manual keypress
+    # Skip the standalone headless samples, as they require a manual keypress
     if "headless" in sample:
        continue
-    subprocess.call("%s -v -vl -b -bfs %s" % (sample, 50), shell=True)
\ No newline at end of file
+    if headless:
+        subprocess.call("%s -v -vl --headless -hlf %s" % (sample, 50), shell=True)
+    else:
+        subprocess.call("%s -v -vl -b -bfs %s" % (sample, 50), shell=True)
\ No newline at end of file
@@ -0,0 +1,169 @@
+/*
+* Vulkan async compute scheduling helper
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanAsyncCompute.h"
+
+namespace vks
+{
+	void AsyncCompute::create(vks::VulkanDevice* device, VkDeviceSize bufferSize, VkBufferUsageFlags bufferUsage, const void* initialData, VkQueue transferQueue)
+	{
+		this->device = device;
+		// createLogicalDevice prefers a queue family that only supports compute, which is what allows the work to overlap
+		queueFamilyIndex = device->queueFamilyIndices.compute;
+		dedicatedQueue = queueFamilyIndex != device->queueFamilyIndices.graphics;
+		vkGetDeviceQueue(device->logicalDevice, queueFamilyIndex, 0, &queue);
+		commandPool = device->createCommandPool(queueFamilyIndex);
+		for (auto& commandBuffer : commandBuffers) {
+			commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, commandPool);
+		}
+
+		VkSemaphoreTypeCreateInfoKHR semaphoreTypeCI{};
+		semaphoreTypeCI.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+		semaphoreTypeCI.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+		semaphoreTypeCI.initialValue = 0;
+		VkSemaphoreCreateInfo semaphoreCI = vks::initializers::semaphoreCreateInfo();
+		semaphoreCI.pNext = &semaphoreTypeCI;
+		VK_CHECK_RESULT(vkCreateSemaphore(device->logicalDevice, &semaphoreCI, nullptr, &computeTimeline.handle));
+		VK_CHECK_RESULT(vkCreateSemaphore(device->logicalDevice, &semaphoreCI, nullptr, &graphicsTimeline.handle));
+		computeTimeline.value = 0;
+		graphicsTimeline.value = 0;
+
+		// Both queue families access the buffers, concurrent sharing avoids the ownership transfer barriers on every step
+		const std::array<uint32_t, 2> queueFamilyIndices = { device->queueFamilyIndices.graphics, queueFamilyIndex };
+		for (auto& buffer : storageBuffers) {
+			VkBufferCreateInfo bufferCI = vks::initializers::bufferCreateInfo(bufferUsage | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, bufferSize);
+			if (dedicatedQueue) {
+				bufferCI.sharingMode = VK_SHARING_MODE_CONCURRENT;
+				bufferCI.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilyIndices.size());
+				bufferCI.pQueueFamilyIndices = queueFamilyIndices.data();
+			}
+			VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCI, nullptr, &buffer.buffer));
+			VkMemoryRequirements memReqs;
+			vkGetBufferMemoryRequirements(device->logicalDevice, buffer.buffer, &memReqs);
+			VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+			memAlloc.allocationSize = memReqs.size;
+			memAlloc.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAlloc, nullptr, &buffer.memory));
+			buffer.device = device->logicalDevice;
+			buffer.size = bufferSize;
+			buffer.alignment = memReqs.alignment;
+			buffer.usageFlags = bufferCI.usage;
+			buffer.memoryPropertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+			buffer.setupDescriptor();
+			VK_CHECK_RESULT(buffer.bind());
+		}
+
+		// Upload the initial data to both buffers
+		vks::Buffer stagingBuffer;
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, bufferSize, const_cast<void*>(initialData)));
+		VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		VkBufferCopy copyRegion{ 0, 0, bufferSize };
+		for (auto& buffer : storageBuffers) {
+			vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, buffer.buffer, 1, &copyRegion);
+		}
+		device->flushCommandBuffer(copyCmd, transferQueue, true);
+		stagingBuffer.destroy();
+	}
+
+	void AsyncCompute::destroy()
+	{
+		if (!device) {
+			return;
+		}
+		for (auto& buffer : storageBuffers) {
+			buffer.destroy();
+		}
+		vkDestroySemaphore(device->logicalDevice, computeTimeline.handle, nullptr);
+		vkDestroySemaphore(device->logicalDevice, graphicsTimeline.handle, nullptr);
+		vkDestroyCommandPool(device->logicalDevice, commandPool, nullptr);
+		device = nullptr;
+	}
+
+	uint32_t AsyncCompute::renderBufferIndex() const
+	{
+		// Frame N renders the results of step N
+		return static_cast<uint32_t>(graphicsTimeline.value % 2);
+	}
+
+	void AsyncCompute::cmdCopyPreviousStep(VkCommandBuffer commandBuffer, uint32_t bufferIndex, VkPipelineStageFlags dstStageMask)
+	{
+		// Make the writes of the previous step (submitted earlier on the same queue) visible to the copy
+		VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+		const vks::Buffer& src = storageBuffers[1 - bufferIndex];
+		const vks::Buffer& dst = storageBuffers[bufferIndex];
+		VkBufferCopy copyRegion{ 0, 0, dst.size };
+		vkCmdCopyBuffer(commandBuffer, src.buffer, dst.buffer, 1, &copyRegion);
+
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStageMask, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	void AsyncCompute::submitCompute()
+	{
+		const uint64_t lastStep = graphicsTimeline.value + (overlap ? 1 : 0);
+		while (computeTimeline.value < lastStep) {
+			const uint64_t step = computeTimeline.value + 1;
+			const uint32_t bufferIndex = static_cast<uint32_t>(step % 2);
+			if (onSubmitStep) {
+				onSubmitStep(step, bufferIndex);
+			}
+			// The buffer written by this step was last read by the frame rendering step - 2
+			const uint64_t waitValue = (step >= 2) ? step - 1 : 0;
+			const VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+			VkTimelineSemaphoreSubmitInfoKHR timelineSubmitInfo{ VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR };
+			timelineSubmitInfo.waitSemaphoreValueCount = 1;
+			timelineSubmitInfo.pWaitSemaphoreValues = &waitValue;
+			timelineSubmitInfo.signalSemaphoreValueCount = 1;
+			timelineSubmitInfo.pSignalSemaphoreValues = &step;
+			VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+			submitInfo.pNext = &timelineSubmitInfo;
+			submitInfo.waitSemaphoreCount = 1;
+			submitInfo.pWaitSemaphores = &graphicsTimeline.handle;
+			submitInfo.pWaitDstStageMask = &waitStageMask;
+			submitInfo.signalSemaphoreCount = 1;
+			submitInfo.pSignalSemaphores = &computeTimeline.handle;
+			submitInfo.commandBufferCount = 1;
+			submitInfo.pCommandBuffers = &commandBuffers[bufferIndex];
+			VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+			computeTimeline.value = step;
+		}
+	}
+
+	void AsyncCompute::submitGraphics(VkQueue graphicsQueue, VkCommandBuffer commandBuffer, VkSemaphore waitSemaphore, VkSemaphore signalSemaphore, VkPipelineStageFlags dataWaitStageMask)
+	{
+		const uint64_t frame = graphicsTimeline.value;
+		// Values for binary semaphores are ignored
+		const std::array<uint64_t, 2> waitValues = { 0, frame };
+		const std::array<uint64_t, 2> signalValues = { 0, frame + 1 };
+		const std::array<VkSemaphore, 2> waitSemaphores = { waitSemaphore, computeTimeline.handle };
+		const std::array<VkSemaphore, 2> signalSemaphores = { signalSemaphore, graphicsTimeline.handle };
+		const std::array<VkPipelineStageFlags, 2> waitStageMasks = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, dataWaitStageMask };
+
+		VkTimelineSemaphoreSubmitInfoKHR timelineSubmitInfo{ VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR };
+		timelineSubmitInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+		timelineSubmitInfo.pWaitSemaphoreValues = waitValues.data();
+		timelineSubmitInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+		timelineSubmitInfo.pSignalSemaphoreValues = signalValues.data();
+		VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+		submitInfo.pNext = &timelineSubmitInfo;
+		submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+		submitInfo.pWaitSemaphores = waitSemaphores.data();
+		submitInfo.pWaitDstStageMask = waitStageMasks.data();
+		submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+		submitInfo.pSignalSemaphores = signalSemaphores.data();
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		VK_CHECK_RESULT(vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE));
+		graphicsTimeline.value = frame + 1;
+	}
+}
@@ -0,0 +1,81 @@
+/*
+* Vulkan async compute scheduling helper
+*
+* Runs a simulation on a dedicated compute queue, overlapped with rendering
+* Simulation step N+1 writes to one of two storage buffers while the graphics queue renders the result of step N from the other one
+* Ordering between the queues is done with two timeline semaphores instead of binary semaphore ping-pong
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <array>
+#include <functional>
+
+#include "vulkan/vulkan.h"
+#include "VulkanBuffer.h"
+#include "VulkanDevice.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	class AsyncCompute
+	{
+	public:
+		struct Timeline {
+			VkSemaphore handle{ VK_NULL_HANDLE };
+			uint64_t value{ 0 };
+		};
+
+		vks::VulkanDevice* device{ nullptr };
+		VkQueue queue{ VK_NULL_HANDLE };
+		uint32_t queueFamilyIndex{ 0 };
+		// True if compute runs on a different queue family than graphics, overlap is only possible in that case
+		bool dedicatedQueue{ false };
+		VkCommandPool commandPool{ VK_NULL_HANDLE };
+		// Simulation step N is executed with commandBuffers[N % 2] and writes to storageBuffers[N % 2]
+		std::array<VkCommandBuffer, 2> commandBuffers{};
+		// Double buffered simulation data, shared between the queue families (no ownership transfers required)
+		std::array<vks::Buffer, 2> storageBuffers{};
+		// Signalled with the index of each finished simulation step, step 0 is the initial data
+		Timeline computeTimeline;
+		// Signalled with the number of finished frames
+		Timeline graphicsTimeline;
+		// If enabled, step N+1 is computed while step N is rendered, otherwise each frame waits for its own step
+		bool overlap{ true };
+		// Called before a simulation step is submitted, e.g. to update per-step uniform data
+		std::function<void(uint64_t step, uint32_t bufferIndex)> onSubmitStep;
+
+		/**
+		* Create the compute queue, command buffers, timeline semaphores and storage buffers
+		*
+		* @param device Vulkan device, must have the timeline semaphore feature enabled
+		* @param bufferSize Size of each of the two storage buffers
+		* @param bufferUsage Additional usage flags for the storage buffers (e.g. VK_BUFFER_USAGE_VERTEX_BUFFER_BIT)
+		* @param initialData Simulation data for step 0, copied to both buffers
+		* @param transferQueue Queue used for uploading the initial data
+		*/
+		void create(vks::VulkanDevice* device, VkDeviceSize bufferSize, VkBufferUsageFlags bufferUsage, const void* initialData, VkQueue transferQueue);
+		void destroy();
+
+		/** @brief Index of the storage buffer the current frame reads the simulation results from */
+		uint32_t renderBufferIndex() const;
+		/** @brief Record copying the previous step's results into the buffer written by this step, for simulations that update their data in place */
+		void cmdCopyPreviousStep(VkCommandBuffer commandBuffer, uint32_t bufferIndex, VkPipelineStageFlags dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		/** @brief Submit all simulation steps required by the current frame to the compute queue */
+		void submitCompute();
+		/**
+		* Submit the graphics work of the current frame, waiting for its simulation step and signalling the graphics timeline
+		*
+		* @param graphicsQueue Queue to submit to
+		* @param commandBuffer Command buffer rendering from storageBuffers[renderBufferIndex()]
+		* @param waitSemaphore Binary semaphore to wait on (e.g. present complete)
+		* @param signalSemaphore Binary semaphore to signal (e.g. render complete)
+		* @param dataWaitStageMask Stage at which the simulation results are first accessed
+		*/
+		void submitGraphics(VkQueue graphicsQueue, VkCommandBuffer commandBuffer, VkSemaphore waitSemaphore, VkSemaphore signalSemaphore, VkPipelineStageFlags dataWaitStageMask = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+	};
+}
@@ -0,0 +1,384 @@
+/*
+* Bounding volume hierarchy for compute shader ray tracing
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanBVH.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <iostream>
+#include <thread>
+
+namespace vks
+{
+	struct BVH::AABB {
+		glm::vec3 min{ FLT_MAX };
+		glm::vec3 max{ -FLT_MAX };
+
+		void grow(const glm::vec3& point)
+		{
+			min = glm::min(min, point);
+			max = glm::max(max, point);
+		}
+		void grow(const AABB& other)
+		{
+			min = glm::min(min, other.min);
+			max = glm::max(max, other.max);
+		}
+		float area() const
+		{
+			const glm::vec3 extent = max - min;
+			return (extent.x < 0.0f) ? 0.0f : 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+		}
+	};
+
+	struct BVH::BuildNode {
+		AABB bounds;
+		std::unique_ptr<BuildNode> children[2];
+		// Range in the primitive index array, only used by leaves
+		uint32_t first{ 0 };
+		uint32_t count{ 0 };
+
+		bool leaf() const { return !children[0]; }
+	};
+
+	struct BVH::BuildContext {
+		const BuildSettings& settings;
+		std::vector<AABB> bounds;
+		std::vector<glm::vec3> centroids;
+		// Triangle indices, reordered during the build so every node covers a contiguous range
+		std::vector<uint32_t> primitives;
+		// Subtrees are only built on their own threads up to this depth, so the number of threads stays bounded
+		uint32_t maxParallelDepth{ 0 };
+
+		BuildContext(const BuildSettings& settings) : settings(settings) {}
+	};
+
+	std::unique_ptr<BVH::BuildNode> BVH::buildRecursive(BuildContext& context, uint32_t first, uint32_t count, uint32_t depth)
+	{
+		const BuildSettings& settings = context.settings;
+		std::unique_ptr<BuildNode> node = std::make_unique<BuildNode>();
+		node->first = first;
+		node->count = count;
+
+		AABB centroidBounds;
+		for (uint32_t i = first; i < first + count; i++) {
+			node->bounds.grow(context.bounds[context.primitives[i]]);
+			centroidBounds.grow(context.centroids[context.primitives[i]]);
+		}
+		if (count == 1) {
+			return node;
+		}
+
+		// Find the cheapest binned split over all axes
+		struct Bin {
+			AABB bounds;
+			uint32_t count{ 0 };
+		};
+		std::array<Bin, maxBinCount> bins;
+		std::array<float, maxBinCount> rightAreas;
+		std::array<uint32_t, maxBinCount> rightCounts;
+		const float rootArea = std::max(node->bounds.area(), FLT_MIN);
+		float bestCost = FLT_MAX;
+		int32_t bestAxis = -1;
+		uint32_t bestBin = 0;
+		for (int32_t axis = 0; axis < 3; axis++) {
+			const float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+			if (extent <= 0.0f) {
+				continue;
+			}
+			std::fill(bins.begin(), bins.begin() + settings.binCount, Bin());
+			const float binScale = settings.binCount / extent;
+			for (uint32_t i = first; i < first + count; i++) {
+				const uint32_t primitive = context.primitives[i];
+				const uint32_t bin = std::min(static_cast<uint32_t>((context.centroids[primitive][axis] - centroidBounds.min[axis]) * binScale), settings.binCount - 1);
+				bins[bin].count++;
+				bins[bin].bounds.grow(context.bounds[primitive]);
+			}
+			// Sweep from the right to get the area and count on the right side of every split plane, then from the left to evaluate the splits
+			AABB right;
+			uint32_t rightCount = 0;
+			for (uint32_t i = settings.binCount - 1; i > 0; i--) {
+				right.grow(bins[i].bounds);
+				rightCount += bins[i].count;
+				rightAreas[i] = right.area();
+				rightCounts[i] = rightCount;
+			}
+			AABB left;
+			uint32_t leftCount = 0;
+			for (uint32_t i = 1; i < settings.binCount; i++) {
+				left.grow(bins[i - 1].bounds);
+				leftCount += bins[i - 1].count;
+				if ((leftCount == 0) || (rightCounts[i] == 0)) {
+					continue;
+				}
+				const float cost = settings.traversalCost + settings.intersectionCost * (left.area() * leftCount + rightAreas[i] * rightCounts[i]) / rootArea;
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = i;
+				}
+			}
+		}
+
+		const float leafCost = settings.intersectionCost * count;
+		if ((count <= settings.maxLeafSize) && ((bestAxis == -1) || (leafCost <= bestCost))) {
+			return node;
+		}
+
+		uint32_t middle;
+		if (bestAxis != -1) {
+			const float binScale = settings.binCount / (centroidBounds.max[bestAxis] - centroidBounds.min[bestAxis]);
+			auto split = std::partition(context.primitives.begin() + first, context.primitives.begin() + first + count, [&](uint32_t primitive) {
+				const uint32_t bin = std::min(static_cast<uint32_t>((context.centroids[primitive][bestAxis] - centroidBounds.min[bestAxis]) * binScale), settings.binCount - 1);
+				return bin < bestBin;
+			});
+			middle = static_cast<uint32_t>(split - context.primitives.begin());
+		} else {
+			middle = first;
+		}
+		if ((middle == first) || (middle == first + count)) {
+			// All centroids coincide, so any split is as good as another
+			middle = first + count / 2;
+		}
+
+		const uint32_t leftCount = middle - first;
+		const uint32_t rightCount = count - leftCount;
+		if ((settings.parallelThreshold > 0) && (count > settings.parallelThreshold) && (depth < context.maxParallelDepth)) {
+			// Both halves work on disjoint ranges of the primitive array, so they can be built concurrently
+			std::future<std::unique_ptr<BuildNode>> left = std::async(std::launch::async, &BVH::buildRecursive, std::ref(context), first, leftCount, depth + 1);
+			node->children[1] = buildRecursive(context, middle, rightCount, depth + 1);
+			node->children[0] = left.get();
+		} else {
+			node->children[0] = buildRecursive(context, first, leftCount, depth + 1);
+			node->children[1] = buildRecursive(context, middle, rightCount, depth + 1);
+		}
+		return node;
+	}
+
+	uint32_t BVH::collapse(const BuildContext& context, const BuildNode* node, uint32_t depth)
+	{
+		statistics.maxDepth = std::max(statistics.maxDepth, depth);
+
+		// Pull grandchildren up into the node until it has four children, always opening the largest inner child
+		std::vector<const BuildNode*> children;
+		if (node->leaf()) {
+			children.push_back(node);
+		} else {
+			children = { node->children[0].get(), node->children[1].get() };
+		}
+		while (children.size() < 4) {
+			int32_t largest = -1;
+			for (int32_t i = 0; i < static_cast<int32_t>(children.size()); i++) {
+				if (!children[i]->leaf() && ((largest == -1) || (children[i]->bounds.area() > children[largest]->bounds.area()))) {
+					largest = i;
+				}
+			}
+			if (largest == -1) {
+				break;
+			}
+			const BuildNode* opened = children[largest];
+			children[largest] = opened->children[0].get();
+			children.push_back(opened->children[1].get());
+		}
+
+		const uint32_t index = static_cast<uint32_t>(nodes.size());
+		nodes.emplace_back();
+
+		// Quantization step per axis is the smallest power of two that covers the node extent in 255 steps
+		Node packed{};
+		packed.origin = node->bounds.min;
+		glm::vec3 scale;
+		for (uint32_t axis = 0; axis < 3; axis++) {
+			const float extent = node->bounds.max[axis] - node->bounds.min[axis];
+			int32_t exponent = (extent > 0.0f) ? static_cast<int32_t>(std::ceil(std::log2(extent / 255.0f))) : -126;
+			exponent = std::clamp(exponent, -126, 127);
+			while ((exponent < 127) && (std::ldexp(255.0f, exponent) < extent)) {
+				exponent++;
+			}
+			scale[axis] = std::ldexp(1.0f, exponent);
+			packed.exponents |= static_cast<uint32_t>(exponent + 128) << (axis * 8);
+		}
+
+		for (uint32_t i = 0; i < 4; i++) {
+			if (i >= children.size()) {
+				packed.children[i] = emptyChild;
+				continue;
+			}
+			const BuildNode* child = children[i];
+			// Bounds are rounded outwards, the decoded bounds are checked with the same arithmetic the shader uses
+			for (uint32_t axis = 0; axis < 3; axis++) {
+				int32_t qMin = std::clamp(static_cast<int32_t>(std::floor((child->bounds.min[axis] - packed.origin[axis]) / scale[axis])), 0, 255);
+				while ((qMin > 0) && (packed.origin[axis] + qMin * scale[axis] > child->bounds.min[axis])) {
+					qMin--;
+				}
+				int32_t qMax = std::clamp(static_cast<int32_t>(std::ceil((child->bounds.max[axis] - packed.origin[axis]) / scale[axis])), 0, 255);
+				while ((qMax < 255) && (packed.origin[axis] + qMax * scale[axis] < child->bounds.max[axis])) {
+					qMax++;
+				}
+				packed.childMin[i] |= static_cast<uint32_t>(qMin) << (axis * 8);
+				packed.childMax[i] |= static_cast<uint32_t>(qMax) << (axis * 8);
+			}
+			if (child->leaf()) {
+				statistics.leaves++;
+				const uint32_t firstTriangle = static_cast<uint32_t>(triangles.size());
+				for (uint32_t p = child->first; p < child->first + child->count; p++) {
+					triangles.push_back(sourceTriangles[context.primitives[p]]);
+				}
+				packed.children[i] = leafFlag | (child->count << 24) | firstTriangle;
+			} else {
+				packed.children[i] = collapse(context, child, depth + 1);
+			}
+		}
+
+		nodes[index] = packed;
+		return index;
+	}
+
+	void BVH::build(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, const std::vector<uint32_t>& colors)
+	{
+		assert(indices.size() % 3 == 0);
+		assert((settings.binCount > 1) && (settings.binCount <= maxBinCount) && (settings.maxLeafSize > 0) && (settings.maxLeafSize <= maxLeafTriangles));
+		const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+		assert(triangleCount < maxTriangles);
+		assert(colors.empty() || (colors.size() == triangleCount));
+
+		nodes.clear();
+		triangles.clear();
+		statistics = Statistics();
+		statistics.triangles = triangleCount;
+		if (triangleCount == 0) {
+			return;
+		}
+
+		auto tStart = std::chrono::high_resolution_clock::now();
+
+		BuildContext context(settings);
+		context.bounds.resize(triangleCount);
+		context.centroids.resize(triangleCount);
+		context.primitives.resize(triangleCount);
+		sourceTriangles.resize(triangleCount);
+		for (uint32_t i = 0; i < triangleCount; i++) {
+			const glm::vec3& v0 = positions[indices[i * 3 + 0]];
+			const glm::vec3& v1 = positions[indices[i * 3 + 1]];
+			const glm::vec3& v2 = positions[indices[i * 3 + 2]];
+			context.bounds[i].grow(v0);
+			context.bounds[i].grow(v1);
+			context.bounds[i].grow(v2);
+			context.centroids[i] = (context.bounds[i].min + context.bounds[i].max) * 0.5f;
+			context.primitives[i] = i;
+			Triangle& triangle = sourceTriangles[i];
+			triangle.v0 = v0;
+			triangle.e1 = v1 - v0;
+			triangle.e2 = v2 - v0;
+			triangle.color = colors.empty() ? 0xffffffff : colors[i];
+			triangle.id = i;
+		}
+		const uint32_t threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+		context.maxParallelDepth = static_cast<uint32_t>(std::ceil(std::log2(static_cast<float>(threadCount))));
+
+		std::unique_ptr<BuildNode> root = buildRecursive(context, 0, triangleCount, 0);
+
+		auto tBuilt = std::chrono::high_resolution_clock::now();
+		statistics.buildTime = std::chrono::duration<double, std::milli>(tBuilt - tStart).count();
+
+		// SAH cost of the binary tree, used to compare build settings
+		const float rootArea = std::max(root->bounds.area(), FLT_MIN);
+		std::vector<const BuildNode*> stack = { root.get() };
+		while (!stack.empty()) {
+			const BuildNode* node = stack.back();
+			stack.pop_back();
+			if (node->leaf()) {
+				statistics.sahCost += settings.intersectionCost * node->count * node->bounds.area() / rootArea;
+			} else {
+				statistics.sahCost += settings.traversalCost * node->bounds.area() / rootArea;
+				stack.push_back(node->children[0].get());
+				stack.push_back(node->children[1].get());
+			}
+		}
+
+		nodes.reserve(triangleCount / 2);
+		triangles.reserve(triangleCount);
+		collapse(context, root.get(), 0);
+		statistics.nodes = static_cast<uint32_t>(nodes.size());
+		sourceTriangles.clear();
+		sourceTriangles.shrink_to_fit();
+
+		statistics.collapseTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tBuilt).count();
+	}
+
+	void BVH::childBounds(const Node& node, uint32_t child, glm::vec3& min, glm::vec3& max)
+	{
+		for (uint32_t axis = 0; axis < 3; axis++) {
+			const float scale = std::ldexp(1.0f, static_cast<int32_t>((node.exponents >> (axis * 8)) & 0xff) - 128);
+			min[axis] = node.origin[axis] + static_cast<float>((node.childMin[child] >> (axis * 8)) & 0xff) * scale;
+			max[axis] = node.origin[axis] + static_cast<float>((node.childMax[child] >> (axis * 8)) & 0xff) * scale;
+		}
+	}
+
+	bool BVH::validate() const
+	{
+		if (nodes.empty()) {
+			return triangles.empty();
+		}
+		bool valid = true;
+		std::vector<uint32_t> references(statistics.triangles, 0);
+
+		// Returns the exact bounds of everything below a node, while checking them against the quantized bounds stored in the node
+		auto validateNode = [&](auto& self, uint32_t index) -> AABB {
+			const Node& node = nodes[index];
+			AABB nodeBounds;
+			for (uint32_t i = 0; i < 4; i++) {
+				if (node.children[i] == emptyChild) {
+					continue;
+				}
+				AABB bounds;
+				if (node.children[i] & leafFlag) {
+					const uint32_t first = node.children[i] & (maxTriangles - 1);
+					const uint32_t count = (node.children[i] >> 24) & maxLeafTriangles;
+					for (uint32_t t = first; t < first + count; t++) {
+						const Triangle& triangle = triangles[t];
+						bounds.grow(triangle.v0);
+						bounds.grow(triangle.v0 + triangle.e1);
+						bounds.grow(triangle.v0 + triangle.e2);
+						if (triangle.id < references.size()) {
+							references[triangle.id]++;
+						}
+					}
+				} else {
+					bounds = self(self, node.children[i]);
+				}
+				glm::vec3 min, max;
+				childBounds(node, i, min, max);
+				// Vertices reconstructed from the edges may differ in the last bit from the source data
+				const glm::vec3 tolerance = glm::max(glm::abs(bounds.min), glm::abs(bounds.max)) * 1e-6f;
+				if (glm::any(glm::greaterThan(min, bounds.min + tolerance)) || glm::any(glm::lessThan(max, bounds.max - tolerance))) {
+					std::cerr << "BVH node " << index << " child " << i << " bounds don't contain its contents\n";
+					valid = false;
+				}
+				nodeBounds.grow(bounds);
+			}
+			return nodeBounds;
+		};
+		validateNode(validateNode, 0);
+
+		if (triangles.size() != statistics.triangles) {
+			std::cerr << "BVH contains " << triangles.size() << " triangles instead of " << statistics.triangles << "\n";
+			valid = false;
+		}
+		if (std::any_of(references.begin(), references.end(), [](uint32_t count) { return count != 1; })) {
+			std::cerr << "BVH doesn't reference every triangle exactly once\n";
+			valid = false;
+		}
+		return valid;
+	}
+}
@@ -0,0 +1,118 @@
+/*
+* Bounding volume hierarchy for compute shader ray tracing
+*
+* Builds a binary BVH over triangles on the CPU using binned SAH (surface area heuristic) splits, with large subtrees built in parallel
+* The binary tree is then collapsed into a four wide BVH whose child bounds are quantized to 8 bits relative to the parent bounds,
+* so a node with all four children fits into 64 bytes (a single cache line) and is read with a few wide loads on the GPU
+* Nodes and triangles are stored in depth first order, so the triangles of a leaf are contiguous and siblings are close in memory
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	class BVH
+	{
+	public:
+		// Child slot values of a node, inner children store the node index
+		static const uint32_t emptyChild = 0xffffffff;
+		static const uint32_t leafFlag = 0x80000000;
+		// Leaves store the first triangle in the lower 24 bits and the triangle count in the next 7 bits
+		static const uint32_t maxLeafTriangles = 127;
+		static const uint32_t maxTriangles = 1 << 24;
+		static const uint32_t maxBinCount = 32;
+
+		// GPU node layout (std430), 64 bytes
+		struct Node {
+			// Minimum of the node bounds, children are quantized relative to this
+			glm::vec3 origin;
+			// Per axis power of two exponents (biased by 128) of the quantization step, packed into 8 bits each
+			uint32_t exponents;
+			// Quantized child bounds with 8 bits per axis
+			uint32_t childMin[4];
+			uint32_t childMax[4];
+			// Node index, leaf (leafFlag | count << 24 | first triangle) or emptyChild
+			uint32_t children[4];
+		};
+
+		// GPU triangle layout (std430), 48 bytes, edges are precomputed for the ray triangle test
+		struct Triangle {
+			glm::vec3 v0;
+			// Packed RGBA8 color
+			uint32_t color;
+			glm::vec3 e1;
+			// Index of the triangle in the input data
+			uint32_t id;
+			glm::vec3 e2;
+			float _pad;
+		};
+
+		struct BuildSettings {
+			// Number of bins per axis evaluated for each split
+			uint32_t binCount{ 16 };
+			// Leaves are only created for ranges up to this size if the SAH deems them cheaper than splitting further
+			uint32_t maxLeafSize{ 8 };
+			// Relative costs of traversing a node and intersecting a triangle used by the SAH
+			float traversalCost{ 1.0f };
+			float intersectionCost{ 1.0f };
+			// Subtrees with more triangles than this are built on their own threads (0 disables parallel builds)
+			uint32_t parallelThreshold{ 8192 };
+		} settings;
+
+		struct Statistics {
+			uint32_t triangles{ 0 };
+			uint32_t nodes{ 0 };
+			uint32_t leaves{ 0 };
+			uint32_t maxDepth{ 0 };
+			// SAH cost of the binary tree relative to the root surface area
+			float sahCost{ 0.0f };
+			double buildTime{ 0.0 };
+			double collapseTime{ 0.0 };
+		} statistics;
+
+		std::vector<Node> nodes;
+		std::vector<Triangle> triangles;
+
+		/**
+		* Build the hierarchy for an indexed triangle list, replacing any previous contents
+		*
+		* @param positions Vertex positions
+		* @param indices Three indices per triangle
+		* @param colors (Optional) Packed RGBA8 color per triangle
+		*/
+		void build(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, const std::vector<uint32_t>& colors = {});
+
+		/**
+		* Check that every triangle is referenced exactly once and that the quantized bounds of every node contain everything below it
+		*
+		* @return True if the hierarchy is consistent
+		*/
+		bool validate() const;
+
+		/** @brief Decode the bounds of a child of a node */
+		static void childBounds(const Node& node, uint32_t child, glm::vec3& min, glm::vec3& max);
+
+	private:
+		struct AABB;
+		struct BuildNode;
+		struct BuildContext;
+
+		// Triangles in input order, only kept during the build
+		std::vector<Triangle> sourceTriangles;
+
+		static std::unique_ptr<BuildNode> buildRecursive(BuildContext& context, uint32_t first, uint32_t count, uint32_t depth);
+		uint32_t collapse(const BuildContext& context, const BuildNode* node, uint32_t depth);
+	};
+}
@@ -0,0 +1,223 @@
+/*
+* Vulkan compute bloom
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanBloom.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace vks
+{
+	struct PushConstants {
+		int32_t sourceLevel;
+		// Set for the first downsample pass, which reads the source image
+		int32_t prefilter;
+		float threshold;
+		float knee;
+		float scatter;
+	};
+
+	// Work groups of both passes cover 8x8 texels of the level they write
+	static const uint32_t workGroupSize = 8;
+
+	void Bloom::create(vks::VulkanDevice* device, VkQueue queue, vks::ShaderModuleCache& shaderCache, const std::string& shadersPath, VkImageView sourceView, VkImageLayout sourceLayout, uint32_t sourceWidth, uint32_t sourceHeight)
+	{
+		this->device = device;
+		VkDevice logicalDevice = device->logicalDevice;
+
+		width = std::max((sourceWidth + 1) / 2, 1u);
+		height = std::max((sourceHeight + 1) / 2, 1u);
+		mipLevels = std::min({ settings.mipLevels, maxMipLevels, static_cast<uint32_t>(floor(log2(std::min(width, height)))) + 1 });
+		mipLevels = std::max(mipLevels, 1u);
+
+		// Half precision is enough for the bloom and supported for storage images on all implementations
+		const VkFormat format = VK_FORMAT_R16G16B16A16_SFLOAT;
+		VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+		imageCI.imageType = VK_IMAGE_TYPE_2D;
+		imageCI.format = format;
+		imageCI.extent = { width, height, 1 };
+		imageCI.mipLevels = mipLevels;
+		imageCI.arrayLayers = 1;
+		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCI.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VK_CHECK_RESULT(vkCreateImage(logicalDevice, &imageCI, nullptr, &image));
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(logicalDevice, image, &memReqs);
+		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(vkAllocateMemory(logicalDevice, &memAlloc, nullptr, &memory));
+		VK_CHECK_RESULT(vkBindImageMemory(logicalDevice, image, memory, 0));
+
+		VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+		viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewCI.format = format;
+		viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 };
+		viewCI.image = image;
+		VK_CHECK_RESULT(vkCreateImageView(logicalDevice, &viewCI, nullptr, &view));
+		for (uint32_t i = 0; i < mipLevels; i++) {
+			viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1 };
+			VK_CHECK_RESULT(vkCreateImageView(logicalDevice, &viewCI, nullptr, &mipViews[i]));
+		}
+
+		// The passes only use texelFetch, the bilinear filter is for upsampling the first level when it's added to the scene
+		VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+		samplerCI.magFilter = VK_FILTER_LINEAR;
+		samplerCI.minFilter = VK_FILTER_LINEAR;
+		samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.minLod = 0.0f;
+		samplerCI.maxLod = static_cast<float>(mipLevels);
+		VK_CHECK_RESULT(vkCreateSampler(logicalDevice, &samplerCI, nullptr, &sampler));
+		descriptor = { sampler, mipViews[0], VK_IMAGE_LAYOUT_GENERAL };
+
+		// Descriptors
+		// Binding 0 : Source image or mip chain
+		// Binding 1 : Level written by the pass
+		const uint32_t setCount = mipLevels * 2 - 1;
+		std::vector<VkDescriptorPoolSize> poolSizes = {
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, setCount),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, setCount),
+		};
+		VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes, setCount);
+		VK_CHECK_RESULT(vkCreateDescriptorPool(logicalDevice, &descriptorPoolCI, nullptr, &descriptorPool));
+
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+		};
+		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(logicalDevice, &descriptorSetLayoutCI, nullptr, &descriptorSetLayout));
+
+		VkDescriptorImageInfo sourceDescriptor{ sampler, sourceView, sourceLayout };
+		VkDescriptorImageInfo chainDescriptor{ sampler, view, VK_IMAGE_LAYOUT_GENERAL };
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
+		for (uint32_t i = 0; i < mipLevels; i++) {
+			VkDescriptorImageInfo levelDescriptor{ VK_NULL_HANDLE, mipViews[i], VK_IMAGE_LAYOUT_GENERAL };
+			// Downsampling into level i reads the source for the first level, the previous level for all others
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(logicalDevice, &allocInfo, &downsampleSets[i]));
+			std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+				vks::initializers::writeDescriptorSet(downsampleSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, (i == 0) ? &sourceDescriptor : &chainDescriptor),
+				vks::initializers::writeDescriptorSet(downsampleSets[i], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, &levelDescriptor),
+			};
+			// Upsampling into level i reads the next smaller level, the last level isn't upsampled into
+			if (i < mipLevels - 1) {
+				VK_CHECK_RESULT(vkAllocateDescriptorSets(logicalDevice, &allocInfo, &upsampleSets[i]));
+				writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(upsampleSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &chainDescriptor));
+				writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(upsampleSets[i], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, &levelDescriptor));
+			}
+			vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+		}
+
+		// Pipelines
+		VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(PushConstants), 0);
+		pipelineLayoutCI.pushConstantRangeCount = 1;
+		pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(logicalDevice, &pipelineLayoutCI, nullptr, &pipelineLayout));
+		downsamplePipeline = createPipeline(shaderCache, shadersPath + "base/bloomdownsample.comp.spv");
+		upsamplePipeline = createPipeline(shaderCache, shadersPath + "base/bloomupsample.comp.spv");
+
+		VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		vks::tools::setImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 });
+		device->flushCommandBuffer(commandBuffer, queue, true);
+	}
+
+	VkPipeline Bloom::createPipeline(vks::ShaderModuleCache& shaderCache, const std::string& fileName)
+	{
+		VkDevice logicalDevice = device->logicalDevice;
+		VkPipelineShaderStageCreateInfo shaderStage{};
+		shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		shaderStage.module = shaderCache.get(fileName);
+		shaderStage.pName = "main";
+		assert(shaderStage.module != VK_NULL_HANDLE);
+		VkComputePipelineCreateInfo computePipelineCI = vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
+		computePipelineCI.stage = shaderStage;
+		VkPipeline pipeline;
+		VK_CHECK_RESULT(vkCreateComputePipelines(logicalDevice, VK_NULL_HANDLE, 1, &computePipelineCI, nullptr, &pipeline));
+		return pipeline;
+	}
+
+	void Bloom::destroy()
+	{
+		if (!device) {
+			return;
+		}
+		VkDevice logicalDevice = device->logicalDevice;
+		vkDestroyPipeline(logicalDevice, downsamplePipeline, nullptr);
+		vkDestroyPipeline(logicalDevice, upsamplePipeline, nullptr);
+		vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
+		vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+		downsampleSets = {};
+		upsampleSets = {};
+		vkDestroySampler(logicalDevice, sampler, nullptr);
+		for (uint32_t i = 0; i < mipLevels; i++) {
+			vkDestroyImageView(logicalDevice, mipViews[i], nullptr);
+		}
+		mipViews = {};
+		vkDestroyImageView(logicalDevice, view, nullptr);
+		vkDestroyImage(logicalDevice, image, nullptr);
+		vkFreeMemory(logicalDevice, memory, nullptr);
+		device = nullptr;
+	}
+
+	void Bloom::cmdApply(VkCommandBuffer commandBuffer, VkPipelineStageFlags dstStageMask)
+	{
+		const VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 };
+		// Reads of the previous bloom must be done before overwriting it
+		vks::tools::insertImageMemoryBarrier(commandBuffer, image,
+			0, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+			dstStageMask, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			subresourceRange);
+
+		PushConstants pushConstants{};
+		pushConstants.threshold = settings.threshold;
+		pushConstants.knee = settings.threshold * settings.softKnee;
+		pushConstants.scatter = settings.scatter;
+
+		// Every pass reads the level written by the previous one
+		auto dispatch = [&](VkDescriptorSet descriptorSet, uint32_t level) {
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+			const uint32_t levelWidth = std::max(width >> level, 1u);
+			const uint32_t levelHeight = std::max(height >> level, 1u);
+			vkCmdDispatch(commandBuffer, (levelWidth + workGroupSize - 1) / workGroupSize, (levelHeight + workGroupSize - 1) / workGroupSize, 1);
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		};
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, downsamplePipeline);
+		for (uint32_t i = 0; i < mipLevels; i++) {
+			pushConstants.sourceLevel = (i == 0) ? 0 : static_cast<int32_t>(i - 1);
+			pushConstants.prefilter = (i == 0) ? 1 : 0;
+			dispatch(downsampleSets[i], i);
+		}
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, upsamplePipeline);
+		pushConstants.prefilter = 0;
+		for (uint32_t i = mipLevels - 1; i > 0; i--) {
+			pushConstants.sourceLevel = static_cast<int32_t>(i);
+			dispatch(upsampleSets[i - 1], i - 1);
+		}
+
+		vks::tools::insertImageMemoryBarrier(commandBuffer, image,
+			VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+			VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStageMask,
+			subresourceRange);
+	}
+}
@@ -0,0 +1,96 @@
+/*
+* Vulkan compute bloom
+*
+* Builds a bloom mip chain from an image with compute shaders, one dispatch per level and direction:
+* The downsample passes filter the source into progressively smaller levels with a 13 tap filter (with a brightness
+* threshold and firefly suppression for the first level), the upsample passes then blend each level with a 3x3 tent
+* filtered version of the next smaller one, so the first level ends up with the combined bloom of all levels
+* Both passes read the texels of their work group's tile into shared memory once and filter from there
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+#include "VulkanShaderCache.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	class Bloom
+	{
+	public:
+		static const uint32_t maxMipLevels = 8;
+
+		struct Settings {
+			// Number of levels in the mip chain, read on creation (limited by the source size)
+			uint32_t mipLevels{ 6 };
+			// Brightness above which the source contributes to the bloom (0 = everything contributes)
+			float threshold{ 0.0f };
+			// Width of the soft transition around the threshold, relative to the threshold
+			float softKnee{ 0.5f };
+			// Weight of the upsampled smaller levels against the current one, larger values give a wider bloom
+			float scatter{ 0.7f };
+		} settings;
+
+		/*
+		* Mip chain, always kept in the general layout
+		* Level 0 has half the resolution of the source and contains the final bloom after cmdApply
+		*/
+		VkImage image{ VK_NULL_HANDLE };
+		VkDeviceMemory memory{ VK_NULL_HANDLE };
+		VkImageView view{ VK_NULL_HANDLE };
+		VkSampler sampler{ VK_NULL_HANDLE };
+		// Bilinear sampled first level, to be added to the scene color
+		VkDescriptorImageInfo descriptor{};
+		uint32_t width{ 0 };
+		uint32_t height{ 0 };
+		uint32_t mipLevels{ 0 };
+
+		/**
+		* Create the mip chain and the compute pipelines for a source image
+		*
+		* @param device Device to create the bloom on
+		* @param queue Queue used for initialization
+		* @param shaderCache Shader module cache the compute shaders are loaded through
+		* @param shadersPath Shader path of the example
+		* @param sourceView View of the image the bloom is generated from, which needs to be created with VK_IMAGE_USAGE_SAMPLED_BIT
+		* @param sourceLayout Layout of the source image when the bloom is applied
+		* @param sourceWidth Width of the source image
+		* @param sourceHeight Height of the source image
+		*/
+		void create(vks::VulkanDevice* device, VkQueue queue, vks::ShaderModuleCache& shaderCache, const std::string& shadersPath, VkImageView sourceView, VkImageLayout sourceLayout, uint32_t sourceWidth, uint32_t sourceHeight);
+		void destroy();
+
+		/**
+		* Record the downsample and upsample passes, must be recorded outside of a render pass
+		* Writes to the source image need to be visible to the compute shader stage, e.g. through the external dependency of the render pass that wrote it
+		*
+		* @param commandBuffer Command buffer to record to
+		* @param dstStageMask Pipeline stages that read the bloom
+		*/
+		void cmdApply(VkCommandBuffer commandBuffer, VkPipelineStageFlags dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+	private:
+		vks::VulkanDevice* device{ nullptr };
+		std::array<VkImageView, maxMipLevels> mipViews{};
+		VkDescriptorPool descriptorPool{ VK_NULL_HANDLE };
+		VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
+		// One set per pass, reading the source or the next larger/smaller level and writing a single level
+		std::array<VkDescriptorSet, maxMipLevels> downsampleSets{};
+		std::array<VkDescriptorSet, maxMipLevels> upsampleSets{};
+		VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
+		VkPipeline downsamplePipeline{ VK_NULL_HANDLE };
+		VkPipeline upsamplePipeline{ VK_NULL_HANDLE };
+
+		VkPipeline createPipeline(vks::ShaderModuleCache& shaderCache, const std::string& fileName);
+	};
+}
@@ -0,0 +1,634 @@
+/*
+* CPU particle simulation backends
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanCpuSimulation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "threadpool.hpp"
+#include "simd.hpp"
+
+namespace vks
+{
+	namespace
+	{
+		// Relative difference of two vectors, absolute for values with a magnitude below one
+		float relativeError(const glm::vec3& value, const glm::vec3& reference)
+		{
+			return glm::length(value - reference) / std::max(glm::length(reference), 1.0f);
+		}
+	}
+
+	SimulationThreads::SimulationThreads()
+	{
+		threadPool = std::unique_ptr<vks::ThreadPool>(new vks::ThreadPool());
+	}
+
+	SimulationThreads::~SimulationThreads()
+	{
+	}
+
+	void SimulationThreads::setThreadCount(uint32_t count)
+	{
+		if (count == 0) {
+			count = std::max(std::thread::hardware_concurrency(), 1u);
+		}
+		if (count != threadCount) {
+			threadCount = count;
+			threadPool->setThreadCount(threadCount);
+		}
+	}
+
+	void SimulationThreads::parallelFor(uint32_t count, uint32_t granularity, const std::function<void(uint32_t begin, uint32_t end)>& func)
+	{
+		if (threadCount == 0) {
+			setThreadCount(0);
+		}
+		const uint32_t rangeSize = ((count + threadCount - 1) / threadCount + granularity - 1) / granularity * granularity;
+		// Not worth waking up other threads for a single range
+		if (rangeSize >= count) {
+			func(0, count);
+			return;
+		}
+		for (uint32_t t = 0; t < threadCount; t++) {
+			const uint32_t begin = std::min(t * rangeSize, count);
+			const uint32_t end = std::min(begin + rangeSize, count);
+			if (begin == end) {
+				break;
+			}
+			threadPool->threads[t]->addJob([&func, begin, end] { func(begin, end); });
+		}
+		threadPool->wait();
+	}
+
+	/*
+		N-body simulation
+	*/
+
+	void NBodySimulation::setParticles(const Particle* particles, uint32_t count)
+	{
+		particleCount = count;
+		for (auto* values : { &posX, &posY, &posZ, &posW, &velX, &velY, &velZ, &velW, &accX, &accY, &accZ }) {
+			values->resize(particleCount);
+		}
+		for (uint32_t i = 0; i < particleCount; i++) {
+			posX[i] = particles[i].pos.x;
+			posY[i] = particles[i].pos.y;
+			posZ[i] = particles[i].pos.z;
+			posW[i] = particles[i].pos.w;
+			velX[i] = particles[i].vel.x;
+			velY[i] = particles[i].vel.y;
+			velZ[i] = particles[i].vel.z;
+			velW[i] = particles[i].vel.w;
+		}
+	}
+
+	void NBodySimulation::getParticles(Particle* particles) const
+	{
+		for (uint32_t i = 0; i < particleCount; i++) {
+			particles[i].pos = glm::vec4(posX[i], posY[i], posZ[i], posW[i]);
+			particles[i].vel = glm::vec4(velX[i], velY[i], velZ[i], velW[i]);
+		}
+	}
+
+	void NBodySimulation::accumulateDirect(uint32_t begin, uint32_t end)
+	{
+		const float gravity = parameters.gravity;
+		const float power = parameters.power;
+		const float soften = parameters.soften;
+		std::fill(accX.begin() + begin, accX.begin() + end, 0.0f);
+		std::fill(accY.begin() + begin, accY.begin() + end, 0.0f);
+		std::fill(accZ.begin() + begin, accZ.begin() + end, 0.0f);
+
+#if !defined(VKS_SIMD_NONE)
+		// The power is applied as a product of fourth roots, so it needs to be a multiple of 0.25
+		const float quarterPowers = power * 4.0f;
+		const uint32_t rootCount = static_cast<uint32_t>(quarterPowers);
+		const bool useSimd = settings.simd && (quarterPowers == (float)rootCount) && (rootCount >= 1) && (rootCount <= 8);
+#endif
+
+		for (uint32_t tile = 0; tile < particleCount; tile += directTileSize) {
+			const uint32_t tileEnd = std::min(tile + directTileSize, particleCount);
+			uint32_t i = begin;
+#if !defined(VKS_SIMD_NONE)
+			if (useSimd) {
+				const simd::vfloat vsoften = simd::set(soften);
+				for (; i + simd::width <= end; i += simd::width) {
+					const simd::vfloat px = simd::load(&posX[i]);
+					const simd::vfloat py = simd::load(&posY[i]);
+					const simd::vfloat pz = simd::load(&posZ[i]);
+					simd::vfloat ax = simd::load(&accX[i]);
+					simd::vfloat ay = simd::load(&accY[i]);
+					simd::vfloat az = simd::load(&accZ[i]);
+					for (uint32_t j = tile; j < tileEnd; j++) {
+						const simd::vfloat dx = simd::sub(simd::set(posX[j]), px);
+						const simd::vfloat dy = simd::sub(simd::set(posY[j]), py);
+						const simd::vfloat dz = simd::sub(simd::set(posZ[j]), pz);
+						const simd::vfloat d2 = simd::add(simd::add(simd::mul(dx, dx), simd::mul(dy, dy)), simd::add(simd::mul(dz, dz), vsoften));
+						const simd::vfloat root = simd::sqrt(simd::sqrt(d2));
+						simd::vfloat denominator = root;
+						for (uint32_t r = 1; r < rootCount; r++) {
+							denominator = simd::mul(denominator, root);
+						}
+						const simd::vfloat f = simd::div(simd::set(gravity * posW[j]), denominator);
+						ax = simd::add(ax, simd::mul(dx, f));
+						ay = simd::add(ay, simd::mul(dy, f));
+						az = simd::add(az, simd::mul(dz, f));
+					}
+					simd::store(&accX[i], ax);
+					simd::store(&accY[i], ay);
+					simd::store(&accZ[i], az);
+				}
+			}
+#endif
+			for (; i < end; i++) {
+				float ax = 0.0f, ay = 0.0f, az = 0.0f;
+				for (uint32_t j = tile; j < tileEnd; j++) {
+					const float dx = posX[j] - posX[i];
+					const float dy = posY[j] - posY[i];
+					const float dz = posZ[j] - posZ[i];
+					const float f = gravity * posW[j] / powf(dx * dx + dy * dy + dz * dz + soften, power);
+					ax += dx * f;
+					ay += dy * f;
+					az += dz * f;
+				}
+				accX[i] += ax;
+				accY[i] += ay;
+				accZ[i] += az;
+			}
+		}
+	}
+
+	void NBodySimulation::buildTree()
+	{
+		nodes.clear();
+		nodeParticles.resize(particleCount);
+		sortBuffer.resize(particleCount);
+		for (uint32_t i = 0; i < particleCount; i++) {
+			nodeParticles[i] = i;
+		}
+
+		// The root is a cube around all attracting particles
+		glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+		if (particleCount > 0) {
+			boundsMin = boundsMax = glm::vec3(posX[0], posY[0], posZ[0]);
+		}
+		for (uint32_t i = 1; i < particleCount; i++) {
+			const glm::vec3 p(posX[i], posY[i], posZ[i]);
+			boundsMin = glm::min(boundsMin, p);
+			boundsMax = glm::max(boundsMax, p);
+		}
+		const glm::vec3 extent = boundsMax - boundsMin;
+		Node root{};
+		root.center = (boundsMin + boundsMax) * 0.5f;
+		root.halfSize = std::max(std::max(extent.x, extent.y), extent.z) * 0.5f + 1e-3f;
+		root.begin = 0;
+		root.end = particleCount;
+		nodes.push_back(root);
+		buildNode(0, 0);
+	}
+
+	void NBodySimulation::buildNode(uint32_t nodeIndex, uint32_t depth)
+	{
+		const uint32_t begin = nodes[nodeIndex].begin;
+		const uint32_t end = nodes[nodeIndex].end;
+
+		if ((end - begin <= maxLeafParticles) || (depth >= maxTreeDepth)) {
+			Node& node = nodes[nodeIndex];
+			node.firstChild = 0;
+			node.mass = 0.0f;
+			glm::vec3 weightedCenter(0.0f);
+			for (uint32_t i = begin; i < end; i++) {
+				const uint32_t p = nodeParticles[i];
+				node.mass += posW[p];
+				weightedCenter += glm::vec3(posX[p], posY[p], posZ[p]) * posW[p];
+			}
+			node.massCenter = (node.mass != 0.0f) ? weightedCenter / node.mass : node.center;
+			return;
+		}
+
+		// Sort the particles into the octants of the node
+		const glm::vec3 center = nodes[nodeIndex].center;
+		const float childHalfSize = nodes[nodeIndex].halfSize * 0.5f;
+		auto octant = [&](uint32_t p) {
+			return (posX[p] >= center.x ? 1u : 0u) | (posY[p] >= center.y ? 2u : 0u) | (posZ[p] >= center.z ? 4u : 0u);
+		};
+		std::array<uint32_t, 8> counts{};
+		for (uint32_t i = begin; i < end; i++) {
+			counts[octant(nodeParticles[i])]++;
+		}
+		std::array<uint32_t, 9> offsets{};
+		offsets[0] = begin;
+		for (uint32_t c = 0; c < 8; c++) {
+			offsets[c + 1] = offsets[c] + counts[c];
+		}
+		std::array<uint32_t, 8> write{};
+		std::copy(offsets.begin(), offsets.begin() + 8, write.begin());
+		for (uint32_t i = begin; i < end; i++) {
+			const uint32_t p = nodeParticles[i];
+			sortBuffer[write[octant(p)]++] = p;
+		}
+		std::copy(sortBuffer.begin() + begin, sortBuffer.begin() + end, nodeParticles.begin() + begin);
+
+		// Children are stored next to each other, nodes may be reallocated while building them so only indices are kept
+		const uint32_t firstChild = static_cast<uint32_t>(nodes.size());
+		nodes[nodeIndex].firstChild = firstChild;
+		for (uint32_t c = 0; c < 8; c++) {
+			Node child{};
+			child.center = center + glm::vec3((c & 1) ? childHalfSize : -childHalfSize, (c & 2) ? childHalfSize : -childHalfSize, (c & 4) ? childHalfSize : -childHalfSize);
+			child.halfSize = childHalfSize;
+			child.begin = offsets[c];
+			child.end = offsets[c + 1];
+			nodes.push_back(child);
+		}
+		float mass = 0.0f;
+		glm::vec3 weightedCenter(0.0f);
+		for (uint32_t c = 0; c < 8; c++) {
+			buildNode(firstChild + c, depth + 1);
+			mass += nodes[firstChild + c].mass;
+			weightedCenter += nodes[firstChild + c].massCenter * nodes[firstChild + c].mass;
+		}
+		Node& node = nodes[nodeIndex];
+		node.mass = mass;
+		node.massCenter = (mass != 0.0f) ? weightedCenter / mass : node.center;
+	}
+
+	void NBodySimulation::accumulateBarnesHut(uint32_t begin, uint32_t end)
+	{
+		const float gravity = parameters.gravity;
+		const float power = parameters.power;
+		const float soften = parameters.soften;
+		const float theta2 = settings.theta * settings.theta;
+		// Each inner node pushes at most eight children per level
+		std::array<uint32_t, maxTreeDepth * 8 + 1> stack;
+
+		for (uint32_t i = begin; i < end; i++) {
+			const glm::vec3 p(posX[i], posY[i], posZ[i]);
+			glm::vec3 acceleration(0.0f);
+			uint32_t stackSize = 0;
+			stack[stackSize++] = 0;
+			while (stackSize > 0) {
+				const Node& node = nodes[stack[--stackSize]];
+				if (node.begin == node.end) {
+					continue;
+				}
+				if (node.firstChild == 0) {
+					for (uint32_t n = node.begin; n < node.end; n++) {
+						const uint32_t s = nodeParticles[n];
+						const glm::vec3 d = glm::vec3(posX[s], posY[s], posZ[s]) - p;
+						acceleration += gravity * d * posW[s] / powf(glm::dot(d, d) + soften, power);
+					}
+					continue;
+				}
+				const glm::vec3 d = node.massCenter - p;
+				const float distance2 = glm::dot(d, d);
+				const float size = node.halfSize * 2.0f;
+				if (size * size < theta2 * distance2) {
+					acceleration += gravity * d * node.mass / powf(distance2 + soften, power);
+				} else {
+					for (uint32_t c = 0; c < 8; c++) {
+						stack[stackSize++] = node.firstChild + c;
+					}
+				}
+			}
+			accX[i] = acceleration.x;
+			accY[i] = acceleration.y;
+			accZ[i] = acceleration.z;
+		}
+	}
+
+	void NBodySimulation::integrate(uint32_t begin, uint32_t end)
+	{
+		// Same order as the shader: velocities are updated first and positions are moved with the new velocities (including w)
+		const float deltaT = parameters.deltaT;
+		for (uint32_t i = begin; i < end; i++) {
+			velX[i] += deltaT * accX[i];
+			velY[i] += deltaT * accY[i];
+			velZ[i] += deltaT * accZ[i];
+			velW[i] += 0.1f * deltaT;
+			if (velW[i] > 1.0f) {
+				velW[i] -= 1.0f;
+			}
+			posX[i] += deltaT * velX[i];
+			posY[i] += deltaT * velY[i];
+			posZ[i] += deltaT * velZ[i];
+			posW[i] += deltaT * velW[i];
+		}
+	}
+
+	void NBodySimulation::step(uint32_t stepCount)
+	{
+		auto tStart = std::chrono::high_resolution_clock::now();
+		threads.setThreadCount(settings.threadCount);
+		for (uint32_t s = 0; s < stepCount; s++) {
+			if (settings.method == BarnesHut) {
+				buildTree();
+				threads.parallelFor(particleCount, 64, [this](uint32_t begin, uint32_t end) { accumulateBarnesHut(begin, end); });
+			} else {
+				threads.parallelFor(particleCount, 64, [this](uint32_t begin, uint32_t end) { accumulateDirect(begin, end); });
+			}
+			threads.parallelFor(particleCount, 64, [this](uint32_t begin, uint32_t end) { integrate(begin, end); });
+		}
+		auto tEnd = std::chrono::high_resolution_clock::now();
+		const double seconds = std::chrono::duration<double>(tEnd - tStart).count();
+		statistics.stepTime = (stepCount > 0) ? static_cast<float>(seconds * 1000.0 / stepCount) : 0.0f;
+		statistics.particleStepsPerSecond = (seconds > 0.0) ? (double)particleCount * stepCount / seconds : 0.0;
+	}
+
+	SimulationComparison NBodySimulation::compare(const Particle* particles, float tolerance) const
+	{
+		SimulationComparison comparison{};
+		float maxError = -1.0f;
+		for (uint32_t i = 0; i < particleCount; i++) {
+			const float positionError = relativeError(glm::vec3(particles[i].pos), glm::vec3(posX[i], posY[i], posZ[i]));
+			const float velocityError = relativeError(glm::vec3(particles[i].vel), glm::vec3(velX[i], velY[i], velZ[i]));
+			comparison.maxPositionError = std::max(comparison.maxPositionError, positionError);
+			comparison.maxVelocityError = std::max(comparison.maxVelocityError, velocityError);
+			if (std::max(positionError, velocityError) > maxError) {
+				maxError = std::max(positionError, velocityError);
+				comparison.worstParticle = i;
+			}
+		}
+		comparison.passed = (comparison.maxPositionError <= tolerance) && (comparison.maxVelocityError <= tolerance);
+		return comparison;
+	}
+
+	/*
+		Cloth simulation
+	*/
+
+	void ClothSimulation::setParticles(const Particle* particles, uint32_t width, uint32_t height)
+	{
+		gridWidth = width;
+		gridHeight = height;
+		const uint32_t count = gridWidth * gridHeight;
+		for (State& state : states) {
+			for (auto* values : { &state.posX, &state.posY, &state.posZ, &state.velX, &state.velY, &state.velZ }) {
+				values->resize(count);
+			}
+		}
+		uvs.resize(count);
+		normalX.resize(count);
+		normalY.resize(count);
+		normalZ.resize(count);
+		current = 0;
+		State& state = states[current];
+		for (uint32_t i = 0; i < count; i++) {
+			state.posX[i] = particles[i].pos.x;
+			state.posY[i] = particles[i].pos.y;
+			state.posZ[i] = particles[i].pos.z;
+			state.velX[i] = particles[i].vel.x;
+			state.velY[i] = particles[i].vel.y;
+			state.velZ[i] = particles[i].vel.z;
+			uvs[i] = particles[i].uv;
+			normalX[i] = particles[i].normal.x;
+			normalY[i] = particles[i].normal.y;
+			normalZ[i] = particles[i].normal.z;
+		}
+	}
+
+	void ClothSimulation::getParticles(Particle* particles) const
+	{
+		const State& state = states[current];
+		for (uint32_t i = 0; i < gridWidth * gridHeight; i++) {
+			particles[i].pos = glm::vec4(state.posX[i], state.posY[i], state.posZ[i], 1.0f);
+			particles[i].vel = glm::vec4(state.velX[i], state.velY[i], state.velZ[i], 0.0f);
+			particles[i].uv = uvs[i];
+			particles[i].normal = glm::vec4(normalX[i], normalY[i], normalZ[i], 0.0f);
+		}
+	}
+
+	void ClothSimulation::updateParticle(const State& in, State& out, uint32_t x, uint32_t y)
+	{
+		const uint32_t index = y * gridWidth + x;
+		const uint32_t w = gridWidth;
+		const glm::vec3 pos(in.posX[index], in.posY[index], in.posZ[index]);
+		const glm::vec3 vel(in.velX[index], in.velY[index], in.velZ[index]);
+
+		// Initial force from gravity
+		glm::vec3 force = glm::vec3(parameters.gravity) * parameters.particleMass;
+
+		// Spring forces from neighboring particles
+		auto spring = [&](uint32_t other, float restDist) {
+			const glm::vec3 dist = glm::vec3(in.posX[other], in.posY[other], in.posZ[other]) - pos;
+			force += glm::normalize(dist) * parameters.springStiffness * (glm::length(dist) - restDist);
+		};
+		const bool left = x > 0;
+		const bool right = x < gridWidth - 1;
+		const bool lower = y > 0;
+		const bool upper = y < gridHeight - 1;
+		if (left) {
+			spring(index - 1, parameters.restDistH);
+		}
+		if (right) {
+			spring(index + 1, parameters.restDistH);
+		}
+		if (upper) {
+			spring(index + w, parameters.restDistV);
+		}
+		if (lower) {
+			spring(index - w, parameters.restDistV);
+		}
+		if (left && upper) {
+			spring(index + w - 1, parameters.restDistD);
+		}
+		if (left && lower) {
+			spring(index - w - 1, parameters.restDistD);
+		}
+		if (right && upper) {
+			spring(index + w + 1, parameters.restDistD);
+		}
+		if (right && lower) {
+			spring(index - w + 1, parameters.restDistD);
+		}
+
+		force += -parameters.damping * vel;
+
+		// Integrate
+		const float deltaT = parameters.deltaT;
+		const glm::vec3 f = force * (1.0f / parameters.particleMass);
+		const glm::vec3 newPos = pos + vel * deltaT + 0.5f * f * deltaT * deltaT;
+		const glm::vec3 newVel = vel + f * deltaT;
+		out.posX[index] = newPos.x;
+		out.posY[index] = newPos.y;
+		out.posZ[index] = newPos.z;
+		out.velX[index] = newVel.x;
+		out.velY[index] = newVel.y;
+		out.velZ[index] = newVel.z;
+	}
+
+	void ClothSimulation::updateNormal(const State& in, uint32_t x, uint32_t y)
+	{
+		const uint32_t index = y * gridWidth + x;
+		const uint32_t w = gridWidth;
+		const glm::vec3 pos(in.posX[index], in.posY[index], in.posZ[index]);
+		auto edge = [&](uint32_t other) { return glm::vec3(in.posX[other], in.posY[other], in.posZ[other]) - pos; };
+		glm::vec3 normal(0.0f);
+		glm::vec3 a, b, c;
+		if (y > 0) {
+			if (x > 0) {
+				a = edge(index - 1);
+				b = edge(index - w - 1);
+				c = edge(index - w);
+				normal += glm::cross(a, b) + glm::cross(b, c);
+			}
+			if (x < gridWidth - 1) {
+				a = edge(index - w);
+				b = edge(index - w + 1);
+				c = edge(index + 1);
+				normal += glm::cross(a, b) + glm::cross(b, c);
+			}
+		}
+		if (y < gridHeight - 1) {
+			if (x > 0) {
+				a = edge(index + w);
+				b = edge(index + w - 1);
+				c = edge(index - 1);
+				normal += glm::cross(a, b) + glm::cross(b, c);
+			}
+			if (x < gridWidth - 1) {
+				a = edge(index + 1);
+				b = edge(index + w + 1);
+				c = edge(index + w);
+				normal += glm::cross(a, b) + glm::cross(b, c);
+			}
+		}
+		normal = glm::normalize(normal);
+		normalX[index] = normal.x;
+		normalY[index] = normal.y;
+		normalZ[index] = normal.z;
+	}
+
+	void ClothSimulation::updateRows(const State& in, State& out, uint32_t firstRow, uint32_t endRow, bool calculateNormals)
+	{
+		const uint32_t w = gridWidth;
+		for (uint32_t y = firstRow; y < endRow; y++) {
+			uint32_t x = 0;
+#if !defined(VKS_SIMD_NONE)
+			// Interior particles have all eight neighbors, so several of them are updated at once without any branches
+			if (settings.simd && (y > 0) && (y < gridHeight - 1)) {
+				const simd::vfloat deltaT = simd::set(parameters.deltaT);
+				const simd::vfloat halfDeltaT2 = simd::set(0.5f * parameters.deltaT * parameters.deltaT);
+				const simd::vfloat stiffness = simd::set(parameters.springStiffness);
+				const simd::vfloat damping = simd::set(parameters.damping);
+				const simd::vfloat invMass = simd::set(1.0f / parameters.particleMass);
+				const simd::vfloat restH = simd::set(parameters.restDistH);
+				const simd::vfloat restV = simd::set(parameters.restDistV);
+				const simd::vfloat restD = simd::set(parameters.restDistD);
+				updateParticle(in, out, 0, y);
+				for (x = 1; x + simd::width <= w - 1; x += simd::width) {
+					const uint32_t index = y * w + x;
+					const simd::vfloat px = simd::load(&in.posX[index]);
+					const simd::vfloat py = simd::load(&in.posY[index]);
+					const simd::vfloat pz = simd::load(&in.posZ[index]);
+					simd::vfloat fx = simd::set(parameters.gravity.x * parameters.particleMass);
+					simd::vfloat fy = simd::set(parameters.gravity.y * parameters.particleMass);
+					simd::vfloat fz = simd::set(parameters.gravity.z * parameters.particleMass);
+					auto spring = [&](uint32_t other, simd::vfloat restDist) {
+						const simd::vfloat dx = simd::sub(simd::load(&in.posX[other]), px);
+						const simd::vfloat dy = simd::sub(simd::load(&in.posY[other]), py);
+						const simd::vfloat dz = simd::sub(simd::load(&in.posZ[other]), pz);
+						const simd::vfloat length = simd::sqrt(simd::add(simd::add(simd::mul(dx, dx), simd::mul(dy, dy)), simd::mul(dz, dz)));
+						// normalize(dist) * stiffness * (length - restDist)
+						const simd::vfloat s = simd::div(simd::mul(stiffness, simd::sub(length, restDist)), length);
+						fx = simd::add(fx, simd::mul(dx, s));
+						fy = simd::add(fy, simd::mul(dy, s));
+						fz = simd::add(fz, simd::mul(dz, s));
+					};
+					spring(index - 1, restH);
+					spring(index + 1, restH);
+					spring(index + w, restV);
+					spring(index - w, restV);
+					spring(index + w - 1, restD);
+					spring(index - w - 1, restD);
+					spring(index + w + 1, restD);
+					spring(index - w + 1, restD);
+
+					const simd::vfloat vx = simd::load(&in.velX[index]);
+					const simd::vfloat vy = simd::load(&in.velY[index]);
+					const simd::vfloat vz = simd::load(&in.velZ[index]);
+					const simd::vfloat ax = simd::mul(simd::sub(fx, simd::mul(damping, vx)), invMass);
+					const simd::vfloat ay = simd::mul(simd::sub(fy, simd::mul(damping, vy)), invMass);
+					const simd::vfloat az = simd::mul(simd::sub(fz, simd::mul(damping, vz)), invMass);
+					simd::store(&out.posX[index], simd::add(px, simd::add(simd::mul(vx, deltaT), simd::mul(ax, halfDeltaT2))));
+					simd::store(&out.posY[index], simd::add(py, simd::add(simd::mul(vy, deltaT), simd::mul(ay, halfDeltaT2))));
+					simd::store(&out.posZ[index], simd::add(pz, simd::add(simd::mul(vz, deltaT), simd::mul(az, halfDeltaT2))));
+					simd::store(&out.velX[index], simd::add(vx, simd::mul(ax, deltaT)));
+					simd::store(&out.velY[index], simd::add(vy, simd::mul(ay, deltaT)));
+					simd::store(&out.velZ[index], simd::add(vz, simd::mul(az, deltaT)));
+				}
+			}
+#endif
+			for (; x < w; x++) {
+				updateParticle(in, out, x, y);
+			}
+
+			// Sphere collision
+			const glm::vec3 spherePos(parameters.spherePos);
+			const float collisionRadius = parameters.sphereRadius + 0.01f;
+			for (uint32_t i = y * w; i < (y + 1) * w; i++) {
+				const glm::vec3 sphereDist = glm::vec3(out.posX[i], out.posY[i], out.posZ[i]) - spherePos;
+				if (glm::length(sphereDist) < collisionRadius) {
+					// If the particle is inside the sphere, push it to the outer radius
+					const glm::vec3 pos = spherePos + glm::normalize(sphereDist) * collisionRadius;
+					out.posX[i] = pos.x;
+					out.posY[i] = pos.y;
+					out.posZ[i] = pos.z;
+					// Cancel out velocity
+					out.velX[i] = out.velY[i] = out.velZ[i] = 0.0f;
+				}
+			}
+
+			// Normals are calculated from the input positions, like the shader does
+			if (calculateNormals) {
+				for (uint32_t nx = 0; nx < w; nx++) {
+					updateNormal(in, nx, y);
+				}
+			}
+		}
+	}
+
+	void ClothSimulation::step(uint32_t iterations, bool calculateNormals)
+	{
+		auto tStart = std::chrono::high_resolution_clock::now();
+		threads.setThreadCount(settings.threadCount);
+		for (uint32_t i = 0; i < iterations; i++) {
+			const State& in = states[current];
+			State& out = states[1 - current];
+			const bool normals = calculateNormals && (i == iterations - 1);
+			// Ranges of at least 16 rows, small grids aren't worth splitting further
+			threads.parallelFor(gridHeight, 16, [&](uint32_t begin, uint32_t end) { updateRows(in, out, begin, end, normals); });
+			current = 1 - current;
+		}
+		auto tEnd = std::chrono::high_resolution_clock::now();
+		const double seconds = std::chrono::duration<double>(tEnd - tStart).count();
+		statistics.stepTime = (iterations > 0) ? static_cast<float>(seconds * 1000.0 / iterations) : 0.0f;
+		statistics.particleStepsPerSecond = (seconds > 0.0) ? (double)getParticleCount() * iterations / seconds : 0.0;
+	}
+
+	SimulationComparison ClothSimulation::compare(const Particle* particles, float tolerance) const
+	{
+		const State& state = states[current];
+		SimulationComparison comparison{};
+		float maxError = -1.0f;
+		for (uint32_t i = 0; i < gridWidth * gridHeight; i++) {
+			const float positionError = relativeError(glm::vec3(particles[i].pos), glm::vec3(state.posX[i], state.posY[i], state.posZ[i]));
+			const float velocityError = relativeError(glm::vec3(particles[i].vel), glm::vec3(state.velX[i], state.velY[i], state.velZ[i]));
+			comparison.maxPositionError = std::max(comparison.maxPositionError, positionError);
+			comparison.maxVelocityError = std::max(comparison.maxVelocityError, velocityError);
+			if (std::max(positionError, velocityError) > maxError) {
+				maxError = std::max(positionError, velocityError);
+				comparison.worstParticle = i;
+			}
+		}
+		comparison.passed = (comparison.maxPositionError <= tolerance) && (comparison.maxVelocityError <= tolerance);
+		return comparison;
+	}
+}
@@ -0,0 +1,217 @@
+/*
+* CPU particle simulation backends
+*
+* C++ mirrors of the n-body and cloth compute shaders, used as a fallback if the simulation can't run on the device and as a reference
+* the GPU results can be validated against (e.g. on a software Vulkan device in headless mode)
+* Particles are stored as structures of arrays, so forces are accumulated for several particles at once with the SIMD wrappers,
+* and the particles are split across worker threads
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	class ThreadPool;
+
+	// Result of comparing a CPU simulation against simulation data read back from the device
+	struct SimulationComparison {
+		// Largest position and velocity differences, relative to the magnitude of the CPU values (absolute below a magnitude of one)
+		float maxPositionError{ 0.0f };
+		float maxVelocityError{ 0.0f };
+		// Particle with the largest error
+		uint32_t worstParticle{ 0 };
+		bool passed{ false };
+	};
+
+	// Timing of the last simulation call
+	struct SimulationStatistics {
+		float stepTime{ 0.0f };
+		// Throughput in simulated particles times steps per second
+		double particleStepsPerSecond{ 0.0 };
+	};
+
+	// Splits work across a thread pool, shared by the simulation backends
+	class SimulationThreads
+	{
+	public:
+		SimulationThreads();
+		~SimulationThreads();
+		/** @brief Set the number of worker threads, 0 selects the number of hardware threads */
+		void setThreadCount(uint32_t count);
+		uint32_t getThreadCount() const { return threadCount; }
+		/** @brief Call func for consecutive ranges of [0, count) on all threads and wait for them, ranges are multiples of granularity */
+		void parallelFor(uint32_t count, uint32_t granularity, const std::function<void(uint32_t begin, uint32_t end)>& func);
+	private:
+		std::unique_ptr<vks::ThreadPool> threadPool;
+		uint32_t threadCount{ 0 };
+	};
+
+	class NBodySimulation
+	{
+	public:
+		// Same layout as the particles in the storage buffers of the compute shader
+		struct Particle {
+			// xyz = position, w = mass
+			glm::vec4 pos;
+			// xyz = velocity, w = gradient texture position
+			glm::vec4 vel;
+		};
+
+		enum Method {
+			// Tiled O(N^2) sum over all attracting particles, the same as the compute shader
+			Direct = 0,
+			// Octree approximation that treats distant groups of particles as a single body
+			BarnesHut = 1
+		};
+
+		// Mirror of the compute shader uniform block
+		struct Parameters {
+			float deltaT{ 0.0f };
+			float gravity{ 0.002f };
+			float power{ 0.75f };
+			float soften{ 0.05f };
+		} parameters;
+
+		struct Settings {
+			Method method{ Direct };
+			// Barnes-Hut opening angle, nodes smaller than theta times their distance are treated as a single body
+			float theta{ 0.5f };
+			// Number of worker threads, 0 uses all hardware threads
+			uint32_t threadCount{ 0 };
+			// Accumulate forces with the SIMD wrappers, only used if power is a multiple of 0.25 (up to 2.0)
+			bool simd{ true };
+		} settings;
+
+		SimulationStatistics statistics;
+
+		void setParticles(const Particle* particles, uint32_t count);
+		void getParticles(Particle* particles) const;
+		uint32_t getParticleCount() const { return particleCount; }
+
+		/** @brief Advance the simulation, each step accumulates the forces of all particles and integrates them afterwards */
+		void step(uint32_t stepCount = 1);
+		/**
+		* Compare the simulation state against particles read back from the device
+		*
+		* @param particles Device particles, particleCount entries
+		* @param tolerance Largest relative position and velocity error that passes
+		*/
+		SimulationComparison compare(const Particle* particles, float tolerance) const;
+
+	private:
+		struct Node {
+			// Center and half size of the node's cube
+			glm::vec3 center;
+			float halfSize;
+			glm::vec3 massCenter;
+			float mass;
+			// Index of the first of eight children, 0 for leaves (the root can't be a child)
+			uint32_t firstChild;
+			// Range of the node's particles in nodeParticles
+			uint32_t begin;
+			uint32_t end;
+		};
+		static const uint32_t maxLeafParticles = 8;
+		static const uint32_t maxTreeDepth = 24;
+		// Attracting particles processed per tile of the direct method, so the tile stays in the L1 cache
+		static const uint32_t directTileSize = 1024;
+
+		uint32_t particleCount{ 0 };
+		std::vector<float> posX, posY, posZ, posW;
+		std::vector<float> velX, velY, velZ, velW;
+		std::vector<float> accX, accY, accZ;
+		std::vector<Node> nodes;
+		std::vector<uint32_t> nodeParticles;
+		std::vector<uint32_t> sortBuffer;
+		SimulationThreads threads;
+
+		void accumulateDirect(uint32_t begin, uint32_t end);
+		void buildTree();
+		void buildNode(uint32_t nodeIndex, uint32_t depth);
+		void accumulateBarnesHut(uint32_t begin, uint32_t end);
+		void integrate(uint32_t begin, uint32_t end);
+	};
+
+	class ClothSimulation
+	{
+	public:
+		// Same layout as the particles in the storage buffers of the compute shader
+		struct Particle {
+			glm::vec4 pos;
+			glm::vec4 vel;
+			glm::vec4 uv;
+			glm::vec4 normal;
+		};
+
+		// Mirror of the compute shader uniform block
+		struct Parameters {
+			float deltaT{ 0.0f };
+			float particleMass{ 0.1f };
+			float springStiffness{ 2000.0f };
+			float damping{ 0.25f };
+			float restDistH{ 0.0f };
+			float restDistV{ 0.0f };
+			float restDistD{ 0.0f };
+			float sphereRadius{ 1.0f };
+			glm::vec4 spherePos{ 0.0f };
+			glm::vec4 gravity{ 0.0f, 9.8f, 0.0f, 0.0f };
+		} parameters;
+
+		struct Settings {
+			// Number of worker threads, 0 uses all hardware threads
+			uint32_t threadCount{ 0 };
+			// Accumulate spring forces of interior particles with the SIMD wrappers
+			bool simd{ true };
+		} settings;
+
+		SimulationStatistics statistics;
+
+		/** @brief Set the particles of a grid, row by row */
+		void setParticles(const Particle* particles, uint32_t gridWidth, uint32_t gridHeight);
+		void getParticles(Particle* particles) const;
+		uint32_t getParticleCount() const { return gridWidth * gridHeight; }
+
+		/**
+		* Advance the simulation, each iteration is one dispatch of the compute shader
+		*
+		* @param iterations Number of iterations
+		* @param calculateNormals Calculate the normals in the last iteration, as the shader does if its calculateNormals push constant is set
+		*/
+		void step(uint32_t iterations, bool calculateNormals = true);
+		/** @brief Compare the simulation state against particles read back from the device (see NBodySimulation::compare) */
+		SimulationComparison compare(const Particle* particles, float tolerance) const;
+
+	private:
+		struct State {
+			std::vector<float> posX, posY, posZ;
+			std::vector<float> velX, velY, velZ;
+		};
+
+		uint32_t gridWidth{ 0 };
+		uint32_t gridHeight{ 0 };
+		// Iterations read from one state and write to the other
+		std::array<State, 2> states;
+		uint32_t current{ 0 };
+		std::vector<glm::vec4> uvs;
+		std::vector<float> normalX, normalY, normalZ;
+		SimulationThreads threads;
+
+		void updateRows(const State& in, State& out, uint32_t firstRow, uint32_t endRow, bool calculateNormals);
+		void updateParticle(const State& in, State& out, uint32_t x, uint32_t y);
+		void updateNormal(const State& in, uint32_t x, uint32_t y);
+	};
+}
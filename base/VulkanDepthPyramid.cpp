@@ -0,0 +1,258 @@
+/*
+* Vulkan hierarchical depth (Hi-Z) pyramid
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanDepthPyramid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace vks
+{
+	struct PushConstants {
+		uint32_t mipLevels;
+		uint32_t workGroupCount;
+	};
+
+	static uint32_t nextPowerOfTwo(uint32_t value)
+	{
+		uint32_t result = 1;
+		while (result < value) {
+			result <<= 1;
+		}
+		return result;
+	}
+
+	bool DepthPyramid::create(vks::VulkanDevice* device, VkQueue queue, vks::ShaderModuleCache& shaderCache, const std::string& shadersPath, VkImage depthImage, VkFormat depthFormat, uint32_t depthWidth, uint32_t depthHeight, const std::vector<uint32_t>& queueFamilyIndices)
+	{
+		this->device = device;
+		this->depthImage = depthImage;
+		this->depthFormat = depthFormat;
+		this->depthWidth = depthWidth;
+		this->depthHeight = depthHeight;
+		VkDevice logicalDevice = device->logicalDevice;
+
+		// Power of two dimensions make every level exactly half the size of the previous one
+		width = nextPowerOfTwo((depthWidth + 1) / 2);
+		height = nextPowerOfTwo((depthHeight + 1) / 2);
+		mipLevels = static_cast<uint32_t>(floor(log2(std::max(width, height)))) + 1;
+		if (mipLevels > maxMipLevels) {
+			vks::tools::exitFatal("Depth attachment is too large for the depth pyramid", -1);
+		}
+
+		// Pyramid image
+		std::vector<uint32_t> queueFamilies = queueFamilyIndices;
+		std::sort(queueFamilies.begin(), queueFamilies.end());
+		queueFamilies.erase(std::unique(queueFamilies.begin(), queueFamilies.end()), queueFamilies.end());
+		VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+		imageCI.imageType = VK_IMAGE_TYPE_2D;
+		imageCI.format = VK_FORMAT_R32G32_SFLOAT;
+		imageCI.extent = { width, height, 1 };
+		imageCI.mipLevels = mipLevels;
+		imageCI.arrayLayers = 1;
+		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCI.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		if (queueFamilies.size() > 1) {
+			imageCI.sharingMode = VK_SHARING_MODE_CONCURRENT;
+			imageCI.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+			imageCI.pQueueFamilyIndices = queueFamilies.data();
+		}
+		VK_CHECK_RESULT(vkCreateImage(logicalDevice, &imageCI, nullptr, &image));
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(logicalDevice, image, &memReqs);
+		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(vkAllocateMemory(logicalDevice, &memAlloc, nullptr, &memory));
+		VK_CHECK_RESULT(vkBindImageMemory(logicalDevice, image, memory, 0));
+
+		VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+		viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewCI.format = VK_FORMAT_R32G32_SFLOAT;
+		viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 };
+		viewCI.image = image;
+		VK_CHECK_RESULT(vkCreateImageView(logicalDevice, &viewCI, nullptr, &view));
+		// The shader always binds all possible levels, unused ones point to the last level but are never written
+		for (uint32_t i = 0; i < mipLevels; i++) {
+			viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1 };
+			VK_CHECK_RESULT(vkCreateImageView(logicalDevice, &viewCI, nullptr, &mipViews[i]));
+		}
+
+		// Depth only view of the attachment, the base class view may include the stencil aspect
+		viewCI.format = depthFormat;
+		viewCI.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+		viewCI.image = depthImage;
+		VK_CHECK_RESULT(vkCreateImageView(logicalDevice, &viewCI, nullptr, &depthView));
+
+		// Depth and pyramid are only accessed with texelFetch, so the sampler just needs to be valid
+		VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+		samplerCI.magFilter = VK_FILTER_NEAREST;
+		samplerCI.minFilter = VK_FILTER_NEAREST;
+		samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.minLod = 0.0f;
+		samplerCI.maxLod = static_cast<float>(mipLevels);
+		VK_CHECK_RESULT(vkCreateSampler(logicalDevice, &samplerCI, nullptr, &sampler));
+		descriptor = { sampler, view, VK_IMAGE_LAYOUT_GENERAL };
+
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &counterBuffer, sizeof(uint32_t)));
+
+		// Descriptors
+		// Binding 0 : Depth attachment
+		// Binding 1 : Storage image views for all pyramid levels
+		// Binding 2 : Work group counter
+		std::vector<VkDescriptorPoolSize> poolSizes = {
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, maxMipLevels),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1),
+		};
+		VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes, 1);
+		VK_CHECK_RESULT(vkCreateDescriptorPool(logicalDevice, &descriptorPoolCI, nullptr, &descriptorPool));
+
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 1, maxMipLevels),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+		};
+		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(logicalDevice, &descriptorSetLayoutCI, nullptr, &descriptorSetLayout));
+
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(logicalDevice, &allocInfo, &descriptorSet));
+
+		VkDescriptorImageInfo depthDescriptor{ sampler, depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+		std::array<VkDescriptorImageInfo, maxMipLevels> mipDescriptors;
+		for (uint32_t i = 0; i < maxMipLevels; i++) {
+			mipDescriptors[i] = { VK_NULL_HANDLE, mipViews[std::min(i, mipLevels - 1)], VK_IMAGE_LAYOUT_GENERAL };
+		}
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &depthDescriptor),
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, mipDescriptors.data(), maxMipLevels),
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &counterBuffer.descriptor),
+		};
+		vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+		// Start with a zeroed counter and a pyramid covering the full depth range
+		VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		vkCmdFillBuffer(commandBuffer, counterBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+		const VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 };
+		vks::tools::setImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresourceRange);
+		const VkClearColorValue clearValue = { { 0.0f, 1.0f, 0.0f, 0.0f } };
+		vkCmdClearColorImage(commandBuffer, image, VK_IMAGE_LAYOUT_GENERAL, &clearValue, 1, &subresourceRange);
+		VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		device->flushCommandBuffer(commandBuffer, queue, true);
+
+		// Pipeline
+		VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(PushConstants), 0);
+		pipelineLayoutCI.pushConstantRangeCount = 1;
+		pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(logicalDevice, &pipelineLayoutCI, nullptr, &pipelineLayout));
+
+		// Without the reduction shader the pyramid keeps covering the full depth range, so nothing is culled against it
+		VkShaderModule shaderModule = shaderCache.get(shadersPath + "base/depthpyramid.comp.spv");
+		if (shaderModule == VK_NULL_HANDLE) {
+			std::cerr << "Depth pyramid shader is missing for this shader type, the pyramid won't be built\n";
+			return false;
+		}
+		VkPipelineShaderStageCreateInfo shaderStage{};
+		shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		shaderStage.module = shaderModule;
+		shaderStage.pName = "main";
+		VkComputePipelineCreateInfo computePipelineCI = vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
+		computePipelineCI.stage = shaderStage;
+		VK_CHECK_RESULT(vkCreateComputePipelines(logicalDevice, VK_NULL_HANDLE, 1, &computePipelineCI, nullptr, &pipeline));
+
+		// Each work group covers 64x64 texels of the first level
+		workGroupCount[0] = (width + 63) / 64;
+		workGroupCount[1] = (height + 63) / 64;
+
+		return true;
+	}
+
+	void DepthPyramid::destroy()
+	{
+		if (!device) {
+			return;
+		}
+		VkDevice logicalDevice = device->logicalDevice;
+		vkDestroyPipeline(logicalDevice, pipeline, nullptr);
+		vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
+		vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+		counterBuffer.destroy();
+		vkDestroySampler(logicalDevice, sampler, nullptr);
+		vkDestroyImageView(logicalDevice, depthView, nullptr);
+		for (uint32_t i = 0; i < mipLevels; i++) {
+			vkDestroyImageView(logicalDevice, mipViews[i], nullptr);
+		}
+		mipViews = {};
+		vkDestroyImageView(logicalDevice, view, nullptr);
+		vkDestroyImage(logicalDevice, image, nullptr);
+		vkFreeMemory(logicalDevice, memory, nullptr);
+		pipeline = VK_NULL_HANDLE;
+		device = nullptr;
+	}
+
+	VkImageAspectFlags DepthPyramid::depthAspectMask() const
+	{
+		// Layout transitions have to include both aspects of combined depth stencil formats
+		VkImageAspectFlags aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		if (vks::tools::formatHasStencil(depthFormat)) {
+			aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+		}
+		return aspectMask;
+	}
+
+	void DepthPyramid::cmdBuild(VkCommandBuffer commandBuffer, VkPipelineStageFlags dstStageMask)
+	{
+		if (pipeline == VK_NULL_HANDLE) {
+			return;
+		}
+		const VkImageSubresourceRange depthRange = { depthAspectMask(), 0, 1, 0, 1 };
+		const VkImageSubresourceRange pyramidRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 };
+
+		// Depth writes of the render pass need to be finished, and reads of the previous pyramid contents must be done before overwriting them
+		vks::tools::insertImageMemoryBarrier(commandBuffer, depthImage,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			depthRange);
+		vks::tools::insertImageMemoryBarrier(commandBuffer, image,
+			VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+			dstStageMask, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			pyramidRange);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+		const PushConstants pushConstants{ mipLevels, workGroupCount[0] * workGroupCount[1] };
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+		vkCmdDispatch(commandBuffer, workGroupCount[0], workGroupCount[1], 1);
+
+		vks::tools::insertImageMemoryBarrier(commandBuffer, image,
+			VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+			VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStageMask,
+			pyramidRange);
+		// Return the depth attachment to the layout the render pass left it in
+		vks::tools::insertImageMemoryBarrier(commandBuffer, depthImage,
+			0, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			depthRange);
+	}
+}
@@ -0,0 +1,95 @@
+/*
+* Vulkan hierarchical depth (Hi-Z) pyramid
+*
+* Builds a min/max depth mip chain from a depth attachment in a single compute dispatch
+* Each work group reduces a 128x128 pixel tile to the first seven levels, the last work group to finish (determined with an
+* atomic counter) then reduces the remaining levels from the tile results, so no further dispatches or barriers are required
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanBuffer.h"
+#include "VulkanDevice.h"
+#include "VulkanShaderCache.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	class DepthPyramid
+	{
+	public:
+		// Upper limit of the single pass reduction (levels of an 8192x8192 depth attachment)
+		static const uint32_t maxMipLevels = 13;
+
+		/*
+		* Pyramid image with the minimum depth in r and the maximum depth in g, always kept in the general layout
+		* Level 0 has half the resolution of the depth attachment (rounded up to a power of two), so a texel (x, y) at
+		* level n covers the depth pixels [x, x + 1) * 2^(n + 1) and culling shaders should access it with texelFetch
+		*/
+		VkImage image{ VK_NULL_HANDLE };
+		VkDeviceMemory memory{ VK_NULL_HANDLE };
+		VkImageView view{ VK_NULL_HANDLE };
+		VkSampler sampler{ VK_NULL_HANDLE };
+		VkDescriptorImageInfo descriptor{};
+		uint32_t width{ 0 };
+		uint32_t height{ 0 };
+		uint32_t mipLevels{ 0 };
+
+		/**
+		* Create the pyramid for a depth attachment, which needs to be created with VK_IMAGE_USAGE_SAMPLED_BIT
+		* The pyramid is initialized to the full depth range, so nothing is culled against it before the first build
+		* Requires the shaderStorageImageExtendedFormats feature, as the levels are written as rg32f storage images
+		*
+		* @param device Device to create the pyramid on
+		* @param queue Queue used for initialization
+		* @param shaderCache Shader module cache the compute shader is loaded through
+		* @param shadersPath Shader path of the example
+		* @param depthImage Depth attachment
+		* @param depthFormat Format of the depth attachment
+		* @param depthWidth Width of the depth attachment
+		* @param depthHeight Height of the depth attachment
+		* @param queueFamilyIndices (Optional) Queue families that access the pyramid, concurrent sharing is used if they differ
+		*
+		* @return False if the compute shader is not available for the shader type, the pyramid then stays at the full depth range and cmdBuild does nothing
+		*/
+		bool create(vks::VulkanDevice* device, VkQueue queue, vks::ShaderModuleCache& shaderCache, const std::string& shadersPath, VkImage depthImage, VkFormat depthFormat, uint32_t depthWidth, uint32_t depthHeight, const std::vector<uint32_t>& queueFamilyIndices = {});
+		void destroy();
+
+		/**
+		* Record the pyramid build, must be recorded outside of a render pass
+		* The depth attachment is expected (and left) in VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL after it has been written by the preceding render pass
+		*
+		* @param commandBuffer Command buffer to record to
+		* @param dstStageMask Pipeline stages that read the pyramid after the build
+		*/
+		void cmdBuild(VkCommandBuffer commandBuffer, VkPipelineStageFlags dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	private:
+		vks::VulkanDevice* device{ nullptr };
+		VkImage depthImage{ VK_NULL_HANDLE };
+		VkFormat depthFormat{ VK_FORMAT_UNDEFINED };
+		VkImageView depthView{ VK_NULL_HANDLE };
+		uint32_t depthWidth{ 0 };
+		uint32_t depthHeight{ 0 };
+		std::array<VkImageView, maxMipLevels> mipViews{};
+		// Counts finished work groups, reset by the last one
+		vks::Buffer counterBuffer;
+		VkDescriptorPool descriptorPool{ VK_NULL_HANDLE };
+		VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
+		VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
+		VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
+		VkPipeline pipeline{ VK_NULL_HANDLE };
+		uint32_t workGroupCount[2]{};
+
+		VkImageAspectFlags depthAspectMask() const;
+	};
+}
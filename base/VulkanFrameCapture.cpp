@@ -0,0 +1,420 @@
+/*
+* Vulkan frame capture
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanFrameCapture.h"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FRAME_CAPTURE_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FRAME_CAPTURE_NEON
+#endif
+
+namespace vks
+{
+	// Convert a row of 8 bit RGBA/BGRA pixels to RGB
+	static void convertRow(const uint8_t* src, uint8_t* dst, uint32_t count, bool swizzle)
+	{
+		uint32_t x = 0;
+#if defined(FRAME_CAPTURE_SSE2)
+		// Four pixels per iteration, the 16 byte store writes 4 bytes past the 12 bytes of output, so the last pixels are left to the scalar loop
+		// SSE2 has no byte shuffle, so red and blue are swapped with shifts in each pixel and the alpha bytes are squeezed out with 64 bit shifts
+		const __m128i lowQuadword = _mm_set_epi32(0, 0, -1, -1);
+		const __m128i greenAlpha = _mm_set1_epi32(0xff00ff00);
+		const __m128i byte0 = _mm_set1_epi32(0x000000ff);
+		const __m128i lowPixel = _mm_set_epi32(0, 0x00ffffff, 0, 0x00ffffff);
+		const __m128i highPixel = _mm_set_epi32(0x0000ffff, 0xff000000, 0x0000ffff, 0xff000000);
+		for (; x + 6 <= count; x += 4) {
+			__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+			if (swizzle) {
+				pixels = _mm_or_si128(_mm_and_si128(pixels, greenAlpha), _mm_or_si128(_mm_slli_epi32(_mm_and_si128(pixels, byte0), 16), _mm_and_si128(_mm_srli_epi32(pixels, 16), byte0)));
+			}
+			// Each 64 bit half holds two pixels, move the RGB bytes of the second one next to the first to get 6 bytes per half
+			const __m128i packed = _mm_or_si128(_mm_and_si128(pixels, lowPixel), _mm_and_si128(_mm_srli_epi64(pixels, 8), highPixel));
+			// Then move the upper 6 bytes down next to the lower ones
+			const __m128i rgb = _mm_or_si128(_mm_and_si128(packed, lowQuadword), _mm_srli_si128(_mm_andnot_si128(lowQuadword, packed), 2));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 3), rgb);
+		}
+#elif defined(FRAME_CAPTURE_NEON)
+		// Sixteen pixels per iteration, deinterleaving loads and interleaving stores do the swizzle for free
+		for (; x + 16 <= count; x += 16) {
+			const uint8x16x4_t pixels = vld4q_u8(src + x * 4);
+			uint8x16x3_t rgb;
+			rgb.val[0] = swizzle ? pixels.val[2] : pixels.val[0];
+			rgb.val[1] = pixels.val[1];
+			rgb.val[2] = swizzle ? pixels.val[0] : pixels.val[2];
+			vst3q_u8(dst + x * 3, rgb);
+		}
+#endif
+		const uint32_t r = swizzle ? 2 : 0;
+		const uint32_t b = swizzle ? 0 : 2;
+		for (; x < count; x++) {
+			dst[x * 3 + 0] = src[x * 4 + r];
+			dst[x * 3 + 1] = src[x * 4 + 1];
+			dst[x * 3 + 2] = src[x * 4 + b];
+		}
+	}
+
+	static uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0)
+	{
+		// Function local statics are initialized thread safe, the workers may write PNG files concurrently
+		static const std::array<uint32_t, 256> table = [] {
+			std::array<uint32_t, 256> table{};
+			for (uint32_t i = 0; i < 256; i++) {
+				uint32_t c = i;
+				for (uint32_t k = 0; k < 8; k++) {
+					c = (c & 1) ? 0xedb88320u ^ (c >> 1) : (c >> 1);
+				}
+				table[i] = c;
+			}
+			return table;
+		}();
+		crc = ~crc;
+		for (size_t i = 0; i < size; i++) {
+			crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+		}
+		return ~crc;
+	}
+
+	static uint32_t adler32(const uint8_t* data, size_t size)
+	{
+		uint32_t a = 1, b = 0;
+		while (size > 0) {
+			// Largest number of bytes that can be summed up before the 32 bit sums could overflow
+			const size_t blockSize = std::min<size_t>(size, 5552);
+			for (size_t i = 0; i < blockSize; i++) {
+				a += data[i];
+				b += a;
+			}
+			a %= 65521;
+			b %= 65521;
+			data += blockSize;
+			size -= blockSize;
+		}
+		return (b << 16) | a;
+	}
+
+	static void appendBigEndian(std::vector<uint8_t>& output, uint32_t value)
+	{
+		output.push_back(static_cast<uint8_t>(value >> 24));
+		output.push_back(static_cast<uint8_t>(value >> 16));
+		output.push_back(static_cast<uint8_t>(value >> 8));
+		output.push_back(static_cast<uint8_t>(value));
+	}
+
+	static void appendPNGChunk(std::vector<uint8_t>& output, const char* type, const uint8_t* data, size_t size)
+	{
+		appendBigEndian(output, static_cast<uint32_t>(size));
+		const size_t start = output.size();
+		output.insert(output.end(), type, type + 4);
+		output.insert(output.end(), data, data + size);
+		appendBigEndian(output, crc32(output.data() + start, size + 4));
+	}
+
+	// Captures are meant to be written at frame rate, so PNG files use stored (uncompressed) deflate blocks, trading file size for encoding speed
+	static void encodePNG(std::vector<uint8_t>& output, const uint8_t* data, uint32_t width, uint32_t height, size_t rowPitch, bool swizzle)
+	{
+		const size_t rowSize = (size_t)width * 3 + 1;
+		std::vector<uint8_t> rows(rowSize * height);
+		for (uint32_t y = 0; y < height; y++) {
+			// Filter type none
+			rows[y * rowSize] = 0;
+			convertRow(data + y * rowPitch, &rows[y * rowSize + 1], width, swizzle);
+		}
+
+		const size_t blockCount = std::max<size_t>((rows.size() + 65534) / 65535, 1);
+		std::vector<uint8_t> zlib;
+		zlib.reserve(rows.size() + blockCount * 5 + 6);
+		// Deflate, 32K window, no preset dictionary, check bits for the header
+		zlib.push_back(0x78);
+		zlib.push_back(0x01);
+		for (size_t offset = 0, block = 0; block < blockCount; block++) {
+			const uint16_t length = static_cast<uint16_t>(std::min<size_t>(rows.size() - offset, 65535));
+			zlib.push_back((block == blockCount - 1) ? 1 : 0);
+			zlib.push_back(static_cast<uint8_t>(length));
+			zlib.push_back(static_cast<uint8_t>(length >> 8));
+			zlib.push_back(static_cast<uint8_t>(~length));
+			zlib.push_back(static_cast<uint8_t>(~length >> 8));
+			zlib.insert(zlib.end(), rows.begin() + offset, rows.begin() + offset + length);
+			offset += length;
+		}
+		appendBigEndian(zlib, adler32(rows.data(), rows.size()));
+
+		const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+		output.reserve(zlib.size() + 64);
+		output.insert(output.end(), signature, signature + 8);
+		// 8 bit RGB, no interlacing
+		std::vector<uint8_t> header;
+		appendBigEndian(header, width);
+		appendBigEndian(header, height);
+		header.insert(header.end(), { 8, 2, 0, 0, 0 });
+		appendPNGChunk(output, "IHDR", header.data(), header.size());
+		appendPNGChunk(output, "IDAT", zlib.data(), zlib.size());
+		appendPNGChunk(output, "IEND", nullptr, 0);
+	}
+
+	static void encodePPM(std::vector<uint8_t>& output, const uint8_t* data, uint32_t width, uint32_t height, size_t rowPitch, bool swizzle)
+	{
+		const std::string header = "P6\n" + std::to_string(width) + "\n" + std::to_string(height) + "\n255\n";
+		const size_t rowSize = (size_t)width * 3;
+		output.resize(header.size() + rowSize * height);
+		std::copy(header.begin(), header.end(), output.begin());
+		for (uint32_t y = 0; y < height; y++) {
+			convertRow(data + y * rowPitch, &output[header.size() + y * rowSize], width, swizzle);
+		}
+	}
+
+	bool FrameCapture::writeImage(const std::string& fileName, const uint8_t* data, uint32_t width, uint32_t height, size_t rowPitch, bool swizzle)
+	{
+		std::vector<uint8_t> output;
+		const bool png = (fileName.size() > 4) && (fileName.compare(fileName.size() - 4, 4, ".png") == 0);
+		if (png) {
+			encodePNG(output, data, width, height, rowPitch, swizzle);
+		} else {
+			encodePPM(output, data, width, height, rowPitch, swizzle);
+		}
+		std::ofstream file(fileName, std::ios::out | std::ios::binary);
+		if (!file.is_open()) {
+			std::cerr << "Could not open " << fileName << " for writing\n";
+			return false;
+		}
+		file.write(reinterpret_cast<const char*>(output.data()), output.size());
+		return file.good();
+	}
+
+	bool FrameCapture::formatSupported(VkFormat format)
+	{
+		switch (format) {
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SRGB:
+		case VK_FORMAT_B8G8R8A8_UNORM:
+		case VK_FORMAT_B8G8R8A8_SRGB:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	void FrameCapture::create(vks::VulkanDevice* device, uint32_t queueFamilyIndex, uint32_t slotCount, uint32_t workerCount)
+	{
+		assert(slotCount > 0);
+		this->device = device;
+		commandPool = device->createCommandPool(queueFamilyIndex, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+
+		// Cached memory makes reading the captures on the CPU a lot faster than write combined memory, but may need explicit invalidation
+		memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		for (uint32_t i = 0; i < device->memoryProperties.memoryTypeCount; i++) {
+			const VkMemoryPropertyFlags flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+			if ((device->memoryProperties.memoryTypes[i].propertyFlags & flags) == flags) {
+				memoryPropertyFlags = flags;
+				break;
+			}
+		}
+
+		slots.resize(slotCount);
+		std::vector<VkCommandBuffer> commandBuffers(slotCount);
+		VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, slotCount);
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(device->logicalDevice, &cmdBufAllocateInfo, commandBuffers.data()));
+		VkFenceCreateInfo fenceCI = vks::initializers::fenceCreateInfo();
+		for (uint32_t i = 0; i < slotCount; i++) {
+			slots[i].commandBuffer = commandBuffers[i];
+			VK_CHECK_RESULT(vkCreateFence(device->logicalDevice, &fenceCI, nullptr, &slots[i].fence));
+		}
+		nextSlot = 0;
+
+		if (workerCount == 0) {
+			workerCount = std::max(std::thread::hardware_concurrency() / 2, 1u);
+		}
+		stopWorkers = false;
+		for (uint32_t i = 0; i < workerCount; i++) {
+			workers.push_back(std::thread(&FrameCapture::worker, this));
+		}
+	}
+
+	void FrameCapture::destroy()
+	{
+		if (!device) {
+			return;
+		}
+		flush();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopWorkers = true;
+		}
+		jobAvailable.notify_all();
+		for (auto& worker : workers) {
+			worker.join();
+		}
+		workers.clear();
+		for (auto& slot : slots) {
+			vkDestroyFence(device->logicalDevice, slot.fence, nullptr);
+			slot.buffer.destroy();
+		}
+		slots.clear();
+		vkDestroyCommandPool(device->logicalDevice, commandPool, nullptr);
+		device = nullptr;
+	}
+
+	VkCommandBuffer FrameCapture::recordCapture(VkImage image, VkFormat format, VkImageLayout layout, uint32_t width, uint32_t height, const std::string& fileName)
+	{
+		assert(formatSupported(format));
+		Slot& slot = slots[nextSlot];
+
+		// Slots are reused in order, so the oldest capture needs to have been written before its slot can be recorded to again
+		submitFinished(false);
+		std::unique_lock<std::mutex> lock(mutex);
+		if (slot.state != SlotState::Free) {
+			if (dropFrames) {
+				statistics.dropped++;
+				return VK_NULL_HANDLE;
+			}
+			statistics.stalls++;
+			if (slot.state == SlotState::InFlight) {
+				lock.unlock();
+				VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, 1, &slot.fence, VK_TRUE, UINT64_MAX));
+				submitFinished(false);
+				lock.lock();
+			}
+			slotWritten.wait(lock, [&slot] { return slot.state == SlotState::Free; });
+		}
+		lock.unlock();
+
+		const VkDeviceSize size = (VkDeviceSize)width * height * 4;
+		if (slot.buffer.size < size) {
+			slot.buffer.destroy();
+			slot.buffer = vks::Buffer();
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, memoryPropertyFlags, &slot.buffer, size));
+			VK_CHECK_RESULT(slot.buffer.map());
+		}
+		slot.fileName = fileName;
+		slot.width = width;
+		slot.height = height;
+		slot.swizzle = (format == VK_FORMAT_B8G8R8A8_UNORM) || (format == VK_FORMAT_B8G8R8A8_SRGB);
+
+		VkCommandBuffer commandBuffer = slot.commandBuffer;
+		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+		cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
+
+		const VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		vks::tools::insertImageMemoryBarrier(commandBuffer, image, VK_ACCESS_MEMORY_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, layout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, subresourceRange);
+
+		// Plain copy into a tightly packed buffer, the format conversion is done by the workers
+		VkBufferImageCopy copyRegion{};
+		copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		copyRegion.imageExtent = { width, height, 1 };
+		vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer.buffer, 1, &copyRegion);
+
+		vks::tools::insertImageMemoryBarrier(commandBuffer, image, VK_ACCESS_TRANSFER_READ_BIT, 0, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, layout, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, subresourceRange);
+
+		VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
+		bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		bufferBarrier.buffer = slot.buffer.buffer;
+		bufferBarrier.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+
+		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+
+		VK_CHECK_RESULT(vkResetFences(device->logicalDevice, 1, &slot.fence));
+		{
+			std::lock_guard<std::mutex> stateLock(mutex);
+			slot.state = SlotState::InFlight;
+		}
+		statistics.captured++;
+		lastSlot = nextSlot;
+		nextSlot = (nextSlot + 1) % static_cast<uint32_t>(slots.size());
+		return commandBuffer;
+	}
+
+	VkFence FrameCapture::fence() const
+	{
+		return slots[lastSlot].fence;
+	}
+
+	void FrameCapture::submitFinished(bool wait)
+	{
+		// Only the recording thread moves slots into and out of the in flight state
+		std::vector<uint32_t> inFlight;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (uint32_t i = 0; i < static_cast<uint32_t>(slots.size()); i++) {
+				if (slots[i].state == SlotState::InFlight) {
+					inFlight.push_back(i);
+				}
+			}
+		}
+		for (uint32_t index : inFlight) {
+			Slot& slot = slots[index];
+			if (wait) {
+				VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, 1, &slot.fence, VK_TRUE, UINT64_MAX));
+			} else if (vkGetFenceStatus(device->logicalDevice, slot.fence) != VK_SUCCESS) {
+				continue;
+			}
+			if (!(memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+				VK_CHECK_RESULT(slot.buffer.invalidate());
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			slot.state = SlotState::Writing;
+			jobs.push_back(index);
+			jobAvailable.notify_one();
+		}
+	}
+
+	void FrameCapture::update()
+	{
+		submitFinished(false);
+	}
+
+	void FrameCapture::flush()
+	{
+		submitFinished(true);
+		std::unique_lock<std::mutex> lock(mutex);
+		slotWritten.wait(lock, [this] {
+			return std::all_of(slots.begin(), slots.end(), [](const Slot& slot) { return slot.state == SlotState::Free; });
+		});
+	}
+
+	bool FrameCapture::idle()
+	{
+		update();
+		std::lock_guard<std::mutex> lock(mutex);
+		return std::all_of(slots.begin(), slots.end(), [](const Slot& slot) { return slot.state == SlotState::Free; });
+	}
+
+	void FrameCapture::worker()
+	{
+		while (true) {
+			uint32_t index;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				jobAvailable.wait(lock, [this] { return stopWorkers || !jobs.empty(); });
+				if (jobs.empty()) {
+					return;
+				}
+				index = jobs.front();
+				jobs.pop_front();
+			}
+			// The slot isn't touched by the recording thread until it has been marked as free again
+			Slot& slot = slots[index];
+			if (writeImage(slot.fileName, static_cast<const uint8_t*>(slot.buffer.mapped), slot.width, slot.height, (size_t)slot.width * 4, slot.swizzle)) {
+				statistics.written++;
+			}
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				slot.state = SlotState::Free;
+			}
+			slotWritten.notify_all();
+		}
+	}
+}
@@ -0,0 +1,132 @@
+/*
+* Vulkan frame capture
+*
+* Copies images into a ring of persistently mapped readback buffers without waiting on the GPU
+* Finished copies are detected by polling their fences some frames later and are then converted and written to disk by worker threads,
+* so taking screenshots or capturing every single frame to an image sequence (e.g. for visual regression tests) doesn't stall rendering
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanBuffer.h"
+#include "VulkanDevice.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	class FrameCapture
+	{
+	public:
+		struct Statistics {
+			// Number of copies recorded
+			std::atomic<uint32_t> captured{ 0 };
+			// Number of files written by the workers
+			std::atomic<uint32_t> written{ 0 };
+			// Number of captures that were skipped because all slots were busy (only if dropFrames is set)
+			std::atomic<uint32_t> dropped{ 0 };
+			// Number of times recording had to wait for a slot to become available
+			std::atomic<uint32_t> stalls{ 0 };
+		} statistics;
+
+		// Skip captures instead of waiting for a busy slot, keeps the frame rate but may leave gaps in an image sequence
+		bool dropFrames{ false };
+
+		/**
+		* Create the readback ring and start the worker threads
+		*
+		* @param device Device to create the buffers on
+		* @param queueFamilyIndex Family of the queue the capture command buffers are submitted to
+		* @param slotCount Number of captures that can be in flight (or being written) at the same time
+		* @param workerCount Number of threads that convert and write the images, 0 uses half of the hardware threads
+		*/
+		void create(vks::VulkanDevice* device, uint32_t queueFamilyIndex, uint32_t slotCount = 4, uint32_t workerCount = 0);
+		/** @brief Wait for all pending captures to be written and release all resources */
+		void destroy();
+
+		/** @brief Returns true for the (8 bit RGBA or BGRA) formats that can be captured */
+		static bool formatSupported(VkFormat format);
+
+		/**
+		* Record the copy of an image to the next free slot
+		* The returned command buffer needs to be submitted after the commands that rendered the image (in the same or a later
+		* batch on the same queue), using the fence returned by fence(), with VK_NULL_HANDLE being returned if the capture was dropped
+		*
+		* @param image Image to capture, needs to be created with VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+		* @param format Format of the image
+		* @param layout Layout of the image, which is transitioned to the transfer source layout and back
+		* @param width Width of the image
+		* @param height Height of the image
+		* @param fileName File to write, a .png extension selects PNG, everything else is written as PPM
+		*/
+		VkCommandBuffer recordCapture(VkImage image, VkFormat format, VkImageLayout layout, uint32_t width, uint32_t height, const std::string& fileName);
+		/** @brief Fence that signals completion of the last recorded capture */
+		VkFence fence() const;
+
+		/** @brief Check for finished copies and hand them to the workers, doesn't block */
+		void update();
+		/** @brief Wait until all recorded captures have been written to disk */
+		void flush();
+		/** @brief Returns true if there are no captures in flight or being written */
+		bool idle();
+
+		/**
+		* Write 8 bit RGBA or BGRA pixel data as RGB to a PPM or PNG file (depending on the extension) in a single write
+		*
+		* @param fileName File to write
+		* @param data Pixel data
+		* @param width Width in pixels
+		* @param height Height in pixels
+		* @param rowPitch Distance between rows in bytes
+		* @param swizzle Source data is BGRA
+		*
+		* @return True if the file has been written
+		*/
+		static bool writeImage(const std::string& fileName, const uint8_t* data, uint32_t width, uint32_t height, size_t rowPitch, bool swizzle);
+
+	private:
+		enum class SlotState { Free, InFlight, Writing };
+
+		struct Slot {
+			vks::Buffer buffer;
+			VkCommandBuffer commandBuffer{ VK_NULL_HANDLE };
+			VkFence fence{ VK_NULL_HANDLE };
+			SlotState state{ SlotState::Free };
+			std::string fileName;
+			uint32_t width{ 0 };
+			uint32_t height{ 0 };
+			bool swizzle{ false };
+		};
+
+		vks::VulkanDevice* device{ nullptr };
+		VkCommandPool commandPool{ VK_NULL_HANDLE };
+		VkMemoryPropertyFlags memoryPropertyFlags{ 0 };
+		std::vector<Slot> slots;
+		// Index of the next slot to record to, slots are used in order so captures finish in order
+		uint32_t nextSlot{ 0 };
+		uint32_t lastSlot{ 0 };
+
+		// Slot states are shared with the workers
+		std::mutex mutex;
+		std::condition_variable slotWritten;
+		std::condition_variable jobAvailable;
+		std::deque<uint32_t> jobs;
+		std::vector<std::thread> workers;
+		bool stopWorkers{ false };
+
+		void worker();
+		void submitFinished(bool wait);
+	};
+}
@@ -0,0 +1,101 @@
+/*
+* G-buffer layouts shared by the deferred shading examples
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanGBufferLayout.h"
+
+namespace vks
+{
+	void GBufferLayout::create(VkPhysicalDevice physicalDevice, Type type)
+	{
+		this->type = type;
+		colorTargets.clear();
+		if (type == Compact) {
+			// Rendering to snorm formats is optional, the encoded normals are within [-1, 1] so half floats can store them as well
+			VkFormat normalFormat = VK_FORMAT_R16G16_SNORM;
+			VkFormatProperties normalFormatProps;
+			vkGetPhysicalDeviceFormatProperties(physicalDevice, normalFormat, &normalFormatProps);
+			if (!(normalFormatProps.optimalTilingFeatures & VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT)) {
+				normalFormat = VK_FORMAT_R16G16_SFLOAT;
+			}
+			colorTargets.push_back({ "Normal (octahedral)", normalFormat });
+			colorTargets.push_back({ "Albedo", VK_FORMAT_R8G8B8A8_UNORM });
+			// Sampling a combined depth stencil image would require a separate depth view, so only depth formats are considered
+			// D16 is guaranteed to support both usages
+			const std::vector<VkFormat> formatList = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM };
+			const VkFormatFeatureFlags requiredFeatures = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+			depthFormat = VK_FORMAT_UNDEFINED;
+			for (auto& format : formatList) {
+				VkFormatProperties formatProps;
+				vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProps);
+				if ((formatProps.optimalTilingFeatures & requiredFeatures) == requiredFeatures) {
+					depthFormat = format;
+					break;
+				}
+			}
+			assert(depthFormat != VK_FORMAT_UNDEFINED);
+		} else {
+			colorTargets.push_back({ "Position", VK_FORMAT_R16G16B16A16_SFLOAT });
+			colorTargets.push_back({ "Normal", VK_FORMAT_R16G16B16A16_SFLOAT });
+			colorTargets.push_back({ "Albedo", VK_FORMAT_R8G8B8A8_UNORM });
+			VkBool32 validDepthFormat = vks::tools::getSupportedDepthFormat(physicalDevice, &depthFormat);
+			assert(validDepthFormat);
+		}
+	}
+
+	bool GBufferLayout::sampledDepth() const
+	{
+		return type == Compact;
+	}
+
+	uint32_t GBufferLayout::bytesPerPixel() const
+	{
+		uint32_t size = 0;
+		for (auto& target : colorTargets) {
+			size += getFormatSize(target.format);
+		}
+		if (sampledDepth()) {
+			size += getFormatSize(depthFormat);
+		}
+		return size;
+	}
+
+	GBufferLayout::Bandwidth GBufferLayout::estimateBandwidth(VkExtent2D gBufferExtent, uint32_t gBufferSamples, VkExtent2D compositionExtent, uint32_t compositionSamples) const
+	{
+		// Depth testing itself isn't counted, the depth attachment only adds traffic if it's stored for the composition pass
+		Bandwidth bandwidth{};
+		bandwidth.gBufferWrite = (VkDeviceSize)gBufferExtent.width * gBufferExtent.height * gBufferSamples * bytesPerPixel();
+		bandwidth.compositionRead = (VkDeviceSize)compositionExtent.width * compositionExtent.height * compositionSamples * bytesPerPixel();
+		return bandwidth;
+	}
+
+	const char* GBufferLayout::getName(Type type)
+	{
+		return (type == Compact) ? "Compact" : "Reference";
+	}
+
+	uint32_t GBufferLayout::getFormatSize(VkFormat format)
+	{
+		switch (format) {
+		case VK_FORMAT_R16G16B16A16_SFLOAT:
+		case VK_FORMAT_D32_SFLOAT_S8_UINT:
+			return 8;
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R16G16_SNORM:
+		case VK_FORMAT_R16G16_SFLOAT:
+		case VK_FORMAT_D32_SFLOAT:
+		case VK_FORMAT_D24_UNORM_S8_UINT:
+		case VK_FORMAT_D16_UNORM_S8_UINT:
+			return 4;
+		case VK_FORMAT_D16_UNORM:
+			return 2;
+		default:
+			assert(!"Unsupported G-buffer format");
+			return 0;
+		}
+	}
+}
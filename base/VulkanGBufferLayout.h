@@ -0,0 +1,80 @@
+/*
+* G-buffer layouts shared by the deferred shading examples
+*
+* The reference layout stores world space positions and normals in rgba16f targets next to the albedo (20 bytes per pixel).
+* The compact layout drops the position target and reconstructs positions from the depth attachment in the composition pass,
+* encodes normals octahedrally into two 16 bit snorm channels (half floats if the device can't render to rg16 snorm) and keeps
+* albedo and specular intensity in rgba8. Including the depth attachment that now has to be stored, that's 12 bytes per pixel
+* (with 32 bit depth).
+* The composition pass samples the targets at binding 1 (positions or depth), 2 (normals) and 3 (albedo), the shaders select the
+* layout with a specialization constant (see shaders/glsl/base/gbuffer.glsl)
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	class GBufferLayout
+	{
+	public:
+		enum Type : int32_t {
+			Reference = 0,
+			Compact = 1
+		};
+
+		// Id of the specialization constant selecting the layout in the G-buffer and composition shaders
+		static const uint32_t specializationConstantId = 1;
+
+		struct Target {
+			const char* name;
+			VkFormat format;
+		};
+
+		// Estimated attachment traffic of the passes in bytes, ignoring caches and framebuffer compression
+		struct Bandwidth {
+			VkDeviceSize gBufferWrite{ 0 };
+			VkDeviceSize compositionRead{ 0 };
+		};
+
+		Type type{ Reference };
+		// Color attachments in the order of the G-buffer fragment shader outputs
+		std::vector<Target> colorTargets;
+		VkFormat depthFormat{ VK_FORMAT_UNDEFINED };
+
+		/**
+		* Select the targets of a layout
+		*
+		* @param physicalDevice Physical device used to select the depth format, the compact layout requires one that can be sampled
+		* @param type Layout to select
+		*/
+		void create(VkPhysicalDevice physicalDevice, Type type);
+
+		/** @brief Positions are reconstructed from the depth attachment, so it has to be stored and sampled by the composition pass */
+		bool sampledDepth() const;
+		/** @brief Bytes per pixel and sample that are stored by the G-buffer pass and read back by the composition pass */
+		uint32_t bytesPerPixel() const;
+		/**
+		* Estimate the attachment traffic of a frame
+		*
+		* @param gBufferExtent Size of the G-buffer attachments
+		* @param gBufferSamples Sample count of the G-buffer attachments
+		* @param compositionExtent Number of pixels shaded by the composition pass
+		* @param compositionSamples Number of samples the composition pass reads per pixel
+		*/
+		Bandwidth estimateBandwidth(VkExtent2D gBufferExtent, uint32_t gBufferSamples, VkExtent2D compositionExtent, uint32_t compositionSamples) const;
+
+		static const char* getName(Type type);
+
+	private:
+		static uint32_t getFormatSize(VkFormat format);
+	};
+}
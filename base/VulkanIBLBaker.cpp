@@ -0,0 +1,466 @@
+/*
+* Vulkan image based lighting baker
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanIBLBaker.h"
+
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+
+namespace vks
+{
+	// Increase if the shaders or the layout of the cached maps change, so outdated cache files are no longer used
+	static const uint32_t cacheVersion = 1;
+
+	// Push constants shared by all IBL compute shaders
+	struct PushConstants {
+		uint32_t dim;
+		float roughness;
+		uint32_t numSamples;
+		float deltaPhi;
+		float deltaTheta;
+	};
+
+	// 64-bit FNV-1a hash, pass the result of a previous call to hash multiple blocks of data
+	static uint64_t fnv1a(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++) {
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+		}
+		return hash;
+	}
+
+	static std::string toHex(uint64_t value)
+	{
+		std::stringstream ss;
+		ss << std::hex << std::setw(16) << std::setfill('0') << value;
+		return ss.str();
+	}
+
+	static uint32_t texelSize(VkFormat format)
+	{
+		switch (format) {
+		case VK_FORMAT_R16G16_SFLOAT:
+			return 4;
+		case VK_FORMAT_R16G16B16A16_SFLOAT:
+			return 8;
+		case VK_FORMAT_R32G32B32A32_SFLOAT:
+			return 16;
+		default:
+			return 0;
+		}
+	}
+
+	static void imageBarrier(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask, uint32_t levelCount, uint32_t layerCount)
+	{
+		VkImageMemoryBarrier imageMemoryBarrier = vks::initializers::imageMemoryBarrier();
+		imageMemoryBarrier.oldLayout = oldLayout;
+		imageMemoryBarrier.newLayout = newLayout;
+		imageMemoryBarrier.srcAccessMask = srcAccessMask;
+		imageMemoryBarrier.dstAccessMask = dstAccessMask;
+		imageMemoryBarrier.image = image;
+		imageMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, layerCount };
+		vkCmdPipelineBarrier(commandBuffer, srcStageMask, dstStageMask, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+	}
+
+	IBLBaker::IBLBaker(vks::VulkanDevice* device, VkQueue queue, vks::ShaderModuleCache& shaderCache, const std::string& shadersPath)
+		: device(device), queue(queue), shaderCache(shaderCache), shadersPath(shadersPath)
+	{
+		// The asset path ends with a separator, so the first parent_path() only strips that
+		cacheDirectory = (std::filesystem::path(getAssetPath()).parent_path().parent_path() / "cache" / "ibl").string();
+#if defined(__ANDROID__)
+		// There is no writable working directory on Android
+		useCache = false;
+#endif
+	}
+
+	bool IBLBaker::hashFile(const std::string& filename, uint64_t& hash) const
+	{
+		std::ifstream file(filename, std::ios::binary | std::ios::ate);
+		if (!file.is_open()) {
+			return false;
+		}
+		std::vector<char> bytes(static_cast<size_t>(file.tellg()));
+		file.seekg(0, std::ios::beg);
+		file.read(bytes.data(), bytes.size());
+		hash = fnv1a(bytes.data(), bytes.size(), hash);
+		return true;
+	}
+
+	uint64_t IBLBaker::hashSettings() const
+	{
+		return fnv1a(&settings, sizeof(Settings), fnv1a(&cacheVersion, sizeof(cacheVersion)));
+	}
+
+	bool IBLBaker::loadFromCache(Target& target)
+	{
+		if (!std::filesystem::exists(target.cacheFile)) {
+			return false;
+		}
+		ktx2::Texture texture;
+		std::string error;
+		if (!ktx2::loadFromFile(target.cacheFile, texture, &error)) {
+			std::cerr << "Could not load IBL cache file " << target.cacheFile << ": " << error << "\n";
+			return false;
+		}
+		if ((texture.format != target.format) || (texture.width != target.dim) || (texture.height != target.dim) || (texture.levels.size() != target.mipLevels) || (texture.faceCount != target.layerCount)) {
+			std::cerr << "Ignoring IBL cache file " << target.cacheFile << " with mismatching format or dimensions\n";
+			return false;
+		}
+		if (!texture.isUploadable(device, &error)) {
+			std::cerr << "Ignoring IBL cache file " << target.cacheFile << ": " << error << "\n";
+			return false;
+		}
+		ktx2::createImage(texture, device, queue, VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, target.texture->image, target.texture->deviceMemory);
+		finalizeTarget(target);
+		return true;
+	}
+
+	void IBLBaker::createTarget(Target& target)
+	{
+		// Cube maps are written as storage images, the BRDF LUT is written to a buffer and copied to the image
+		VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+		imageCI.imageType = VK_IMAGE_TYPE_2D;
+		imageCI.format = target.format;
+		imageCI.extent = { target.dim, target.dim, 1 };
+		imageCI.mipLevels = target.mipLevels;
+		imageCI.arrayLayers = target.layerCount;
+		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		if (target.layerCount == 6) {
+			imageCI.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+			imageCI.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+		}
+		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCI, nullptr, &target.texture->image));
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device->logicalDevice, target.texture->image, &memReqs);
+		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAlloc, nullptr, &target.texture->deviceMemory));
+		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, target.texture->image, target.texture->deviceMemory, 0));
+		finalizeTarget(target);
+	}
+
+	void IBLBaker::finalizeTarget(Target& target)
+	{
+		vks::Texture* texture = target.texture;
+		texture->device = device;
+		texture->width = target.dim;
+		texture->height = target.dim;
+		texture->mipLevels = target.mipLevels;
+		texture->layerCount = target.layerCount;
+		texture->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+		viewCI.viewType = (target.layerCount == 6) ? VK_IMAGE_VIEW_TYPE_CUBE : VK_IMAGE_VIEW_TYPE_2D;
+		viewCI.format = target.format;
+		viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, target.mipLevels, 0, target.layerCount };
+		viewCI.image = texture->image;
+		VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCI, nullptr, &texture->view));
+
+		VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+		samplerCI.magFilter = VK_FILTER_LINEAR;
+		samplerCI.minFilter = VK_FILTER_LINEAR;
+		samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.minLod = 0.0f;
+		samplerCI.maxLod = static_cast<float>(target.mipLevels);
+		samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+		VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCI, nullptr, &texture->sampler));
+
+		texture->descriptor.imageView = texture->view;
+		texture->descriptor.sampler = texture->sampler;
+		texture->descriptor.imageLayout = texture->imageLayout;
+	}
+
+	void IBLBaker::bake(const std::string& environmentFile, vks::TextureCubeMap& environmentCube, vks::Texture2D& lutBrdf, vks::TextureCubeMap& irradianceCube, vks::TextureCubeMap& prefilteredCube)
+	{
+		auto tStart = std::chrono::high_resolution_clock::now();
+		statistics = {};
+
+		auto mipCount = [](uint32_t dim) { return static_cast<uint32_t>(floor(log2(dim))) + 1; };
+		Target brdfTarget{ &lutBrdf, VK_FORMAT_R16G16_SFLOAT, settings.brdfLutDim, 1, 1 };
+		Target irradianceTarget{ &irradianceCube, VK_FORMAT_R32G32B32A32_SFLOAT, settings.irradianceDim, mipCount(settings.irradianceDim), 6 };
+		Target prefilteredTarget{ &prefilteredCube, VK_FORMAT_R16G16B16A16_SFLOAT, settings.prefilteredDim, mipCount(settings.prefilteredDim), 6 };
+		const std::array<Target*, 2> cubeTargets = { &irradianceTarget, &prefilteredTarget };
+
+		// The BRDF LUT only depends on the settings, the cube maps also depend on the environment map
+		bool writeCache = useCache;
+		if (useCache) {
+			const uint64_t settingsHash = hashSettings();
+			uint64_t environmentHash = settingsHash;
+			if (hashFile(environmentFile, environmentHash)) {
+				const std::filesystem::path directory(cacheDirectory);
+				brdfTarget.cacheFile = (directory / ("brdflut_" + toHex(settingsHash) + ".ktx2")).string();
+				irradianceTarget.cacheFile = (directory / ("irradiance_" + toHex(environmentHash) + ".ktx2")).string();
+				prefilteredTarget.cacheFile = (directory / ("prefiltered_" + toHex(environmentHash) + ".ktx2")).string();
+				for (Target* target : { &brdfTarget, &irradianceTarget, &prefilteredTarget }) {
+					target->cached = loadFromCache(*target);
+					statistics.cachedMaps += target->cached ? 1 : 0;
+				}
+			} else {
+				std::cerr << "Could not read " << environmentFile << " for hashing, IBL maps won't be cached\n";
+				writeCache = false;
+			}
+		}
+		statistics.cacheLoadTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+
+		if (statistics.cachedMaps == 3) {
+			std::cout << "Loading IBL maps from cache took " << statistics.cacheLoadTime << " ms" << std::endl;
+			return;
+		}
+
+		auto tBakeStart = std::chrono::high_resolution_clock::now();
+		VkDevice logicalDevice = device->logicalDevice;
+
+		// Compute pipelines, all shaders share the same layout
+		// Binding 0 : Environment map (cube maps)
+		// Binding 1 : Mip level of the target cube map
+		// Binding 2 : Half float output buffer (BRDF LUT)
+		VkDescriptorSetLayout descriptorSetLayout;
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+		};
+		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(logicalDevice, &descriptorSetLayoutCI, nullptr, &descriptorSetLayout));
+
+		VkPipelineLayout pipelineLayout;
+		VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(PushConstants), 0);
+		pipelineLayoutCI.pushConstantRangeCount = 1;
+		pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(logicalDevice, &pipelineLayoutCI, nullptr, &pipelineLayout));
+
+		auto createPipeline = [&](const std::string& shader) {
+			VkPipelineShaderStageCreateInfo shaderStage = {};
+			shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			shaderStage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+			shaderStage.module = shaderCache.get(shadersPath + "base/" + shader);
+			shaderStage.pName = "main";
+			assert(shaderStage.module != VK_NULL_HANDLE);
+			VkComputePipelineCreateInfo computePipelineCI = vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
+			computePipelineCI.stage = shaderStage;
+			VkPipeline pipeline;
+			VK_CHECK_RESULT(vkCreateComputePipelines(logicalDevice, VK_NULL_HANDLE, 1, &computePipelineCI, nullptr, &pipeline));
+			return pipeline;
+		};
+		VkPipeline brdfPipeline = brdfTarget.cached ? VK_NULL_HANDLE : createPipeline("iblbrdflut.comp.spv");
+		VkPipeline irradiancePipeline = irradianceTarget.cached ? VK_NULL_HANDLE : createPipeline("iblirradiance.comp.spv");
+		VkPipeline prefilterPipeline = prefilteredTarget.cached ? VK_NULL_HANDLE : createPipeline("iblprefilter.comp.spv");
+
+		// One descriptor set per dispatch
+		const uint32_t cubeMipCount = irradianceTarget.mipLevels + prefilteredTarget.mipLevels;
+		std::vector<VkDescriptorPoolSize> poolSizes = {
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, cubeMipCount),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, cubeMipCount),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1),
+		};
+		VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes, cubeMipCount + 1);
+		VkDescriptorPool descriptorPool;
+		VK_CHECK_RESULT(vkCreateDescriptorPool(logicalDevice, &descriptorPoolCI, nullptr, &descriptorPool));
+		auto allocateDescriptorSet = [&]() {
+			VkDescriptorSet descriptorSet;
+			VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(logicalDevice, &allocInfo, &descriptorSet));
+			return descriptorSet;
+		};
+
+		// All baked levels are copied into a single host visible buffer for writing the cache files
+		std::vector<Target*> bakedTargets;
+		for (Target* target : { &brdfTarget, &irradianceTarget, &prefilteredTarget }) {
+			if (!target->cached) {
+				createTarget(*target);
+				bakedTargets.push_back(target);
+			}
+		}
+		auto levelSize = [](const Target& target, uint32_t level) {
+			const VkDeviceSize dim = std::max(1u, target.dim >> level);
+			return dim * dim * target.layerCount * texelSize(target.format);
+		};
+		std::vector<VkDeviceSize> readbackOffsets;
+		VkDeviceSize readbackSize = 0;
+		for (Target* target : bakedTargets) {
+			readbackOffsets.push_back(readbackSize);
+			for (uint32_t level = 0; level < target->mipLevels; level++) {
+				readbackSize += levelSize(*target, level);
+			}
+		}
+		vks::Buffer readbackBuffer;
+		if (writeCache) {
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &readbackBuffer, readbackSize));
+		}
+
+		VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		size_t readbackIndex = 0;
+
+		// BRDF LUT
+		vks::Buffer lutBuffer;
+		if (!brdfTarget.cached) {
+			const uint32_t dim = brdfTarget.dim;
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &lutBuffer, levelSize(brdfTarget, 0)));
+			VkDescriptorSet descriptorSet = allocateDescriptorSet();
+			VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &lutBuffer.descriptor);
+			vkUpdateDescriptorSets(logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
+
+			PushConstants pushConstants{ dim, 0.0f, settings.brdfLutSamples, 0.0f, 0.0f };
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, brdfPipeline);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+			vkCmdDispatch(commandBuffer, (dim + 7) / 8, (dim + 7) / 8, 1);
+
+			VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
+			bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			bufferBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferBarrier.buffer = lutBuffer.buffer;
+			bufferBarrier.size = VK_WHOLE_SIZE;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+
+			imageBarrier(commandBuffer, lutBrdf.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 1, 1);
+			VkBufferImageCopy copyRegion{};
+			copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+			copyRegion.imageExtent = { dim, dim, 1 };
+			vkCmdCopyBufferToImage(commandBuffer, lutBuffer.buffer, lutBrdf.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+			imageBarrier(commandBuffer, lutBrdf.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 1, 1);
+
+			if (writeCache) {
+				VkBufferCopy bufferCopy{ 0, readbackOffsets[readbackIndex], levelSize(brdfTarget, 0) };
+				vkCmdCopyBuffer(commandBuffer, lutBuffer.buffer, readbackBuffer.buffer, 1, &bufferCopy);
+			}
+			readbackIndex++;
+		}
+
+		// Irradiance and pre-filtered cube maps, each mip level is written through a separate storage image view
+		std::vector<VkImageView> storageViews;
+		for (Target* target : cubeTargets) {
+			if (target->cached) {
+				continue;
+			}
+			const bool irradiance = (target == &irradianceTarget);
+			VkImage image = target->texture->image;
+			imageBarrier(commandBuffer, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 0, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, target->mipLevels, 6);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, irradiance ? irradiancePipeline : prefilterPipeline);
+			for (uint32_t level = 0; level < target->mipLevels; level++) {
+				const uint32_t dim = std::max(1u, target->dim >> level);
+
+				VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+				viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+				viewCI.format = target->format;
+				viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 6 };
+				viewCI.image = image;
+				VkImageView storageView;
+				VK_CHECK_RESULT(vkCreateImageView(logicalDevice, &viewCI, nullptr, &storageView));
+				storageViews.push_back(storageView);
+
+				VkDescriptorSet descriptorSet = allocateDescriptorSet();
+				VkDescriptorImageInfo storageImageDescriptor = vks::initializers::descriptorImageInfo(VK_NULL_HANDLE, storageView, VK_IMAGE_LAYOUT_GENERAL);
+				std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+					vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &environmentCube.descriptor),
+					vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, &storageImageDescriptor),
+				};
+				vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+				PushConstants pushConstants{ dim, 0.0f, 0, 0.0f, 0.0f };
+				if (irradiance) {
+					pushConstants.deltaPhi = settings.irradianceDeltaPhi;
+					pushConstants.deltaTheta = settings.irradianceDeltaTheta;
+				} else {
+					pushConstants.roughness = (float)level / (float)(target->mipLevels - 1);
+					pushConstants.numSamples = settings.prefilteredSamples;
+				}
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+				vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+				vkCmdDispatch(commandBuffer, (dim + 7) / 8, (dim + 7) / 8, 6);
+			}
+
+			if (writeCache) {
+				imageBarrier(commandBuffer, image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, target->mipLevels, 6);
+				std::vector<VkBufferImageCopy> copyRegions(target->mipLevels);
+				VkDeviceSize offset = readbackOffsets[readbackIndex];
+				for (uint32_t level = 0; level < target->mipLevels; level++) {
+					const uint32_t dim = std::max(1u, target->dim >> level);
+					copyRegions[level] = {};
+					copyRegions[level].bufferOffset = offset;
+					copyRegions[level].imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 6 };
+					copyRegions[level].imageExtent = { dim, dim, 1 };
+					offset += levelSize(*target, level);
+				}
+				vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer.buffer, static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+				imageBarrier(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, target->mipLevels, 6);
+			} else {
+				imageBarrier(commandBuffer, image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, target->mipLevels, 6);
+			}
+			readbackIndex++;
+		}
+
+		if (writeCache) {
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		}
+
+		// Everything is generated with a single submission
+		device->flushCommandBuffer(commandBuffer, queue, true);
+		statistics.bakeTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tBakeStart).count();
+
+		if (writeCache) {
+			auto tWriteStart = std::chrono::high_resolution_clock::now();
+			std::error_code errorCode;
+			std::filesystem::create_directories(cacheDirectory, errorCode);
+			VK_CHECK_RESULT(readbackBuffer.map());
+			for (size_t i = 0; i < bakedTargets.size(); i++) {
+				const Target& target = *bakedTargets[i];
+				std::vector<VkDeviceSize> levelSizes(target.mipLevels);
+				for (uint32_t level = 0; level < target.mipLevels; level++) {
+					levelSizes[level] = levelSize(target, level);
+				}
+				std::string error;
+				const uint8_t* levelData = static_cast<const uint8_t*>(readbackBuffer.mapped) + readbackOffsets[i];
+				if (!ktx2::saveToFile(target.cacheFile, target.format, target.dim, target.dim, target.layerCount, levelData, levelSizes, &error)) {
+					std::cerr << "Could not write IBL cache file: " << error << "\n";
+				}
+			}
+			readbackBuffer.destroy();
+			statistics.cacheWriteTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tWriteStart).count();
+		}
+
+		for (VkImageView storageView : storageViews) {
+			vkDestroyImageView(logicalDevice, storageView, nullptr);
+		}
+		if (lutBuffer.buffer != VK_NULL_HANDLE) {
+			lutBuffer.destroy();
+		}
+		for (VkPipeline pipeline : { brdfPipeline, irradiancePipeline, prefilterPipeline }) {
+			if (pipeline != VK_NULL_HANDLE) {
+				vkDestroyPipeline(logicalDevice, pipeline, nullptr);
+			}
+		}
+		vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
+		vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+
+		std::cout << "Baking " << bakedTargets.size() << " IBL map(s) took " << statistics.bakeTime << " ms";
+		if (statistics.cachedMaps > 0) {
+			std::cout << ", loading " << statistics.cachedMaps << " from cache took " << statistics.cacheLoadTime << " ms";
+		}
+		if (writeCache) {
+			std::cout << ", writing the cache took " << statistics.cacheWriteTime << " ms";
+		}
+		std::cout << std::endl;
+	}
+}
@@ -0,0 +1,88 @@
+/*
+* Vulkan image based lighting baker
+*
+* Generates the BRDF look-up table, irradiance cube and pre-filtered environment cube used for image based lighting
+* All maps are generated with compute shaders in a single submission and cached on disk as KTX2 files, keyed by a hash of the environment map
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+#include "VulkanKTX2.h"
+#include "VulkanShaderCache.h"
+#include "VulkanTexture.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	class IBLBaker
+	{
+	public:
+		struct Settings {
+			uint32_t brdfLutDim{ 512 };
+			uint32_t brdfLutSamples{ 1024 };
+			uint32_t irradianceDim{ 64 };
+			float irradianceDeltaPhi{ (2.0f * float(M_PI)) / 180.0f };
+			float irradianceDeltaTheta{ (0.5f * float(M_PI)) / 64.0f };
+			uint32_t prefilteredDim{ 512 };
+			uint32_t prefilteredSamples{ 32 };
+		} settings;
+
+		struct Statistics {
+			// Number of maps that were loaded from the cache (0 to 3)
+			uint32_t cachedMaps{ 0 };
+			double cacheLoadTime{ 0.0 };
+			double bakeTime{ 0.0 };
+			double cacheWriteTime{ 0.0 };
+		} statistics;
+
+		// Cached maps are stored in (and loaded from) this directory, defaults to cache/ibl next to the assets directory
+		std::string cacheDirectory;
+		bool useCache{ true };
+
+		IBLBaker(vks::VulkanDevice* device, VkQueue queue, vks::ShaderModuleCache& shaderCache, const std::string& shadersPath);
+
+		/**
+		* Load the image based lighting maps for an environment map from the cache, or bake and cache them if they're not available
+		*
+		* @param environmentFile File the environment cube map was loaded from, its contents are used as the cache key
+		* @param environmentCube Environment cube map with a full mip chain
+		* @param lutBrdf Target for the BRDF look-up table (R16G16_SFLOAT)
+		* @param irradianceCube Target for the irradiance cube (R32G32B32A32_SFLOAT)
+		* @param prefilteredCube Target for the pre-filtered environment cube (R16G16B16A16_SFLOAT), roughness increases with the mip level
+		*/
+		void bake(const std::string& environmentFile, vks::TextureCubeMap& environmentCube, vks::Texture2D& lutBrdf, vks::TextureCubeMap& irradianceCube, vks::TextureCubeMap& prefilteredCube);
+
+	private:
+		struct Target {
+			vks::Texture* texture;
+			VkFormat format;
+			uint32_t dim;
+			uint32_t mipLevels;
+			uint32_t layerCount;
+			std::string cacheFile;
+			bool cached{ false };
+		};
+
+		vks::VulkanDevice* device;
+		VkQueue queue;
+		// The compute shaders are loaded through the shader module cache of the example
+		vks::ShaderModuleCache& shaderCache;
+		std::string shadersPath;
+
+		bool hashFile(const std::string& filename, uint64_t& hash) const;
+		uint64_t hashSettings() const;
+		bool loadFromCache(Target& target);
+		void createTarget(Target& target);
+		void finalizeTarget(Target& target);
+	};
+}
@@ -0,0 +1,338 @@
+/*
+* Vulkan KTX2 texture container loader
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanKTX2.h"
+
+namespace vks
+{
+	namespace ktx2
+	{
+		static const uint8_t identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+		// File header, directly followed by the level index
+		struct Header {
+			uint8_t identifier[12];
+			uint32_t vkFormat;
+			uint32_t typeSize;
+			uint32_t pixelWidth;
+			uint32_t pixelHeight;
+			uint32_t pixelDepth;
+			uint32_t layerCount;
+			uint32_t faceCount;
+			uint32_t levelCount;
+			uint32_t supercompressionScheme;
+			uint32_t dfdByteOffset;
+			uint32_t dfdByteLength;
+			uint32_t kvdByteOffset;
+			uint32_t kvdByteLength;
+			uint64_t sgdByteOffset;
+			uint64_t sgdByteLength;
+		};
+
+		static std::string formatName(VkFormat format)
+		{
+			switch (format) {
+#define STR(r) case VK_FORMAT_ ##r: return #r
+				STR(BC1_RGB_UNORM_BLOCK);
+				STR(BC1_RGB_SRGB_BLOCK);
+				STR(BC7_UNORM_BLOCK);
+				STR(BC7_SRGB_BLOCK);
+				STR(ASTC_4x4_UNORM_BLOCK);
+				STR(ASTC_4x4_SRGB_BLOCK);
+				STR(ETC2_R8G8B8_UNORM_BLOCK);
+				STR(ETC2_R8G8B8_SRGB_BLOCK);
+				STR(ETC2_R8G8B8A8_UNORM_BLOCK);
+				STR(ETC2_R8G8B8A8_SRGB_BLOCK);
+				STR(R8G8B8A8_UNORM);
+				STR(R8G8B8A8_SRGB);
+#undef STR
+			default:
+				return "VkFormat " + std::to_string(format);
+			}
+		}
+
+		bool Texture::isBasisUniversal() const
+		{
+			return (supercompressionScheme == SupercompressionBasisLZ) || (colorModel == ColorModelETC1S) || (colorModel == ColorModelUASTC);
+		}
+
+		bool Texture::isUploadable(vks::VulkanDevice* device, std::string* reason) const
+		{
+			if (isBasisUniversal()) {
+				if (reason) *reason = "Basis Universal payloads are not supported, only KTX2 files without supercompression can be loaded";
+				return false;
+			}
+			if (supercompressionScheme != SupercompressionNone) {
+				if (reason) *reason = "supercompression scheme " + std::to_string(supercompressionScheme) + " is not supported";
+				return false;
+			}
+			if (format == VK_FORMAT_UNDEFINED) {
+				if (reason) *reason = "undefined image format";
+				return false;
+			}
+			if (((faceCount != 1) && (faceCount != 6)) || (depth > 1) || (layerCount > 1)) {
+				if (reason) *reason = "only 2D textures and cube maps are supported";
+				return false;
+			}
+			VkFormatProperties formatProperties;
+			vkGetPhysicalDeviceFormatProperties(device->physicalDevice, format, &formatProperties);
+			if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+				if (reason) *reason = formatName(format) + " is not supported by the device";
+				return false;
+			}
+			return true;
+		}
+
+		VkDeviceSize Texture::levelDataSize() const
+		{
+			VkDeviceSize size = 0;
+			for (const Level& level : levels) {
+				size += level.byteLength;
+			}
+			return size;
+		}
+
+		bool loadFromMemory(const uint8_t* bytes, size_t size, Texture& texture, std::string* error)
+		{
+			if ((size < sizeof(Header)) || (memcmp(bytes, identifier, sizeof(identifier)) != 0)) {
+				if (error) *error = "not a KTX2 file";
+				return false;
+			}
+			Header header;
+			memcpy(&header, bytes, sizeof(Header));
+
+			texture.format = static_cast<VkFormat>(header.vkFormat);
+			texture.width = header.pixelWidth;
+			texture.height = header.pixelHeight;
+			texture.depth = header.pixelDepth;
+			texture.layerCount = header.layerCount;
+			texture.faceCount = header.faceCount;
+			texture.supercompressionScheme = header.supercompressionScheme;
+
+			// A level count of zero requests mip generation at load time, we only use the base level in that case
+			const uint32_t levelCount = std::max(header.levelCount, 1u);
+			if (sizeof(Header) + levelCount * sizeof(Level) > size) {
+				if (error) *error = "truncated level index";
+				return false;
+			}
+			texture.levels.resize(levelCount);
+			memcpy(texture.levels.data(), bytes + sizeof(Header), levelCount * sizeof(Level));
+			for (const Level& level : texture.levels) {
+				if (level.byteOffset + level.byteLength > size) {
+					if (error) *error = "level data exceeds file size";
+					return false;
+				}
+			}
+
+			// Basic data format descriptor block, only used to identify Basis Universal payloads
+			// Layout: total size, 2 words of block header, followed by the color model
+			if ((header.dfdByteLength >= 28) && (header.dfdByteOffset + header.dfdByteLength <= size)) {
+				const uint8_t* dfd = bytes + header.dfdByteOffset;
+				texture.colorModel = dfd[12];
+			}
+
+			texture.data.assign(bytes, bytes + size);
+			return true;
+		}
+
+		bool loadFromFile(const std::string& filename, Texture& texture, std::string* error)
+		{
+			std::vector<uint8_t> bytes;
+#if defined(__ANDROID__)
+			AAsset* asset = AAssetManager_open(androidApp->activity->assetManager, filename.c_str(), AASSET_MODE_STREAMING);
+			if (!asset) {
+				if (error) *error = "could not open " + filename;
+				return false;
+			}
+			bytes.resize(AAsset_getLength(asset));
+			AAsset_read(asset, bytes.data(), bytes.size());
+			AAsset_close(asset);
+#else
+			std::ifstream file(filename, std::ios::binary | std::ios::ate);
+			if (!file.is_open()) {
+				if (error) *error = "could not open " + filename;
+				return false;
+			}
+			bytes.resize(static_cast<size_t>(file.tellg()));
+			file.seekg(0, std::ios::beg);
+			file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+#endif
+			return loadFromMemory(bytes.data(), bytes.size(), texture, error);
+		}
+
+		bool saveToFile(const std::string& filename, VkFormat format, uint32_t width, uint32_t height, uint32_t faceCount, const uint8_t* levelData, const std::vector<VkDeviceSize>& levelSizes, std::string* error)
+		{
+			// Channel layout for the basic data format descriptor
+			uint32_t channelCount = 0;
+			uint32_t channelSize = 0;
+			bool floatingPoint = true;
+			switch (format) {
+			case VK_FORMAT_R8G8B8A8_UNORM:
+			case VK_FORMAT_R8G8B8A8_SRGB:
+				channelCount = 4; channelSize = 1; floatingPoint = false;
+				break;
+			case VK_FORMAT_R16G16_SFLOAT:
+				channelCount = 2; channelSize = 2;
+				break;
+			case VK_FORMAT_R16G16B16A16_SFLOAT:
+				channelCount = 4; channelSize = 2;
+				break;
+			case VK_FORMAT_R32G32B32A32_SFLOAT:
+				channelCount = 4; channelSize = 4;
+				break;
+			default:
+				if (error) *error = "writing " + formatName(format) + " is not supported";
+				return false;
+			}
+			const uint32_t texelSize = channelCount * channelSize;
+			const uint32_t levelCount = static_cast<uint32_t>(levelSizes.size());
+
+			// Basic data format descriptor: total size, block header, color model information and one sample per channel
+			std::vector<uint8_t> dfd(4 + 24 + 16 * channelCount, 0);
+			auto write16 = [&dfd](size_t offset, uint16_t value) { memcpy(&dfd[offset], &value, sizeof(value)); };
+			auto write32 = [&dfd](size_t offset, uint32_t value) { memcpy(&dfd[offset], &value, sizeof(value)); };
+			write32(0, static_cast<uint32_t>(dfd.size()));
+			write16(8, 2);
+			write16(10, static_cast<uint16_t>(dfd.size() - 4));
+			dfd[12] = 1;
+			dfd[13] = 1;
+			dfd[14] = (format == VK_FORMAT_R8G8B8A8_SRGB) ? 2 : 1;
+			dfd[20] = static_cast<uint8_t>(texelSize);
+			for (uint32_t i = 0; i < channelCount; i++) {
+				const size_t sampleOffset = 4 + 24 + i * 16;
+				// Channels R, G, B and alpha (15)
+				const uint8_t channelType = (i == 3) ? 15 : static_cast<uint8_t>(i);
+				write16(sampleOffset, static_cast<uint16_t>(i * channelSize * 8));
+				dfd[sampleOffset + 2] = static_cast<uint8_t>(channelSize * 8 - 1);
+				if (floatingPoint) {
+					// Float and signed qualifiers, limits are -1.0 and 1.0
+					dfd[sampleOffset + 3] = channelType | 0x80 | 0x40;
+					write32(sampleOffset + 8, 0xBF800000);
+					write32(sampleOffset + 12, 0x3F800000);
+				} else {
+					dfd[sampleOffset + 3] = channelType;
+					write32(sampleOffset + 12, 0xFF);
+				}
+			}
+
+			Header header{};
+			memcpy(header.identifier, identifier, sizeof(identifier));
+			header.vkFormat = format;
+			header.typeSize = channelSize;
+			header.pixelWidth = width;
+			header.pixelHeight = height;
+			header.faceCount = faceCount;
+			header.levelCount = levelCount;
+			header.dfdByteOffset = static_cast<uint32_t>(sizeof(Header) + levelCount * sizeof(Level));
+			header.dfdByteLength = static_cast<uint32_t>(dfd.size());
+
+			// Level data is stored from the smallest to the largest level, each one aligned to the texel size
+			std::vector<Level> levels(levelCount);
+			uint64_t offset = header.dfdByteOffset + header.dfdByteLength;
+			for (int32_t i = levelCount - 1; i >= 0; i--) {
+				offset = (offset + texelSize - 1) / texelSize * texelSize;
+				levels[i].byteOffset = offset;
+				levels[i].byteLength = levelSizes[i];
+				levels[i].uncompressedByteLength = levelSizes[i];
+				offset += levelSizes[i];
+			}
+
+			std::vector<uint8_t> bytes(offset, 0);
+			memcpy(bytes.data(), &header, sizeof(Header));
+			memcpy(bytes.data() + sizeof(Header), levels.data(), levels.size() * sizeof(Level));
+			memcpy(bytes.data() + header.dfdByteOffset, dfd.data(), dfd.size());
+			VkDeviceSize srcOffset = 0;
+			for (uint32_t i = 0; i < levelCount; i++) {
+				memcpy(bytes.data() + levels[i].byteOffset, levelData + srcOffset, levelSizes[i]);
+				srcOffset += levelSizes[i];
+			}
+
+			std::ofstream file(filename, std::ios::binary);
+			if (!file.is_open()) {
+				if (error) *error = "could not open " + filename + " for writing";
+				return false;
+			}
+			file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+			if (!file.good()) {
+				if (error) *error = "could not write " + filename;
+				return false;
+			}
+			return true;
+		}
+
+		VkDeviceSize createImage(const Texture& texture, vks::VulkanDevice* device, VkQueue copyQueue, VkImageUsageFlags imageUsageFlags, VkImageLayout imageLayout, VkImage& image, VkDeviceMemory& memory)
+		{
+			const uint32_t mipLevels = static_cast<uint32_t>(texture.levels.size());
+
+			// Levels are tightly packed into the staging buffer, KTX2 aligns level sizes to the format's block size
+			vks::Buffer stagingBuffer;
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, texture.levelDataSize()));
+			VK_CHECK_RESULT(stagingBuffer.map());
+
+			std::vector<VkBufferImageCopy> bufferCopyRegions;
+			VkDeviceSize offset = 0;
+			for (uint32_t i = 0; i < mipLevels; i++) {
+				const Level& level = texture.levels[i];
+				memcpy(static_cast<uint8_t*>(stagingBuffer.mapped) + offset, texture.data.data() + level.byteOffset, level.byteLength);
+				VkBufferImageCopy bufferCopyRegion = {};
+				bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				bufferCopyRegion.imageSubresource.mipLevel = i;
+				bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
+				// All faces of a level are stored consecutively
+				bufferCopyRegion.imageSubresource.layerCount = texture.faceCount;
+				bufferCopyRegion.imageExtent.width = std::max(1u, texture.width >> i);
+				bufferCopyRegion.imageExtent.height = std::max(1u, texture.height >> i);
+				bufferCopyRegion.imageExtent.depth = 1;
+				bufferCopyRegion.bufferOffset = offset;
+				bufferCopyRegions.push_back(bufferCopyRegion);
+				offset += level.byteLength;
+			}
+			stagingBuffer.unmap();
+
+			VkImageCreateInfo imageCreateInfo = vks::initializers::imageCreateInfo();
+			imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageCreateInfo.format = texture.format;
+			imageCreateInfo.mipLevels = mipLevels;
+			imageCreateInfo.arrayLayers = texture.faceCount;
+			imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			imageCreateInfo.extent = { texture.width, texture.height, 1 };
+			imageCreateInfo.usage = imageUsageFlags | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+			if (texture.faceCount == 6) {
+				imageCreateInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+			}
+			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
+
+			VkMemoryRequirements memReqs;
+			vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
+			VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
+			memAllocInfo.allocationSize = memReqs.size;
+			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &memory));
+			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, memory, 0));
+
+			VkImageSubresourceRange subresourceRange = {};
+			subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			subresourceRange.baseMipLevel = 0;
+			subresourceRange.levelCount = mipLevels;
+			subresourceRange.layerCount = texture.faceCount;
+
+			VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
+			vkCmdCopyBufferToImage(copyCmd, stagingBuffer.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(bufferCopyRegions.size()), bufferCopyRegions.data());
+			vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, imageLayout, subresourceRange);
+			device->flushCommandBuffer(copyCmd, copyQueue);
+
+			stagingBuffer.destroy();
+
+			return memReqs.size;
+		}
+	}
+}
@@ -0,0 +1,93 @@
+/*
+* Vulkan KTX2 texture container loader
+*
+* Reads KTX2 (https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html) files and uploads their pre-computed mip chain
+* The bundled libktx only supports KTX1, so this implements the container format itself
+* Only files without supercompression are supported, Basis Universal payloads are detected and rejected as there is no transcoder
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	namespace ktx2
+	{
+		enum SupercompressionScheme {
+			SupercompressionNone = 0,
+			SupercompressionBasisLZ = 1,
+			SupercompressionZstandard = 2,
+			SupercompressionZLIB = 3
+		};
+
+		// Color models from the data format descriptor that identify Basis Universal payloads
+		enum ColorModel {
+			ColorModelETC1S = 163,
+			ColorModelUASTC = 166
+		};
+
+		struct Level {
+			uint64_t byteOffset;
+			uint64_t byteLength;
+			uint64_t uncompressedByteLength;
+		};
+
+		struct Texture {
+			VkFormat format = VK_FORMAT_UNDEFINED;
+			uint32_t width = 0;
+			uint32_t height = 0;
+			uint32_t depth = 0;
+			uint32_t layerCount = 0;
+			uint32_t faceCount = 1;
+			uint32_t supercompressionScheme = SupercompressionNone;
+			uint32_t colorModel = 0;
+			// Level 0 is the base level
+			std::vector<Level> levels;
+			// Complete file contents, level offsets are relative to the start of the file
+			std::vector<uint8_t> data;
+
+			bool isBasisUniversal() const;
+			// Returns true if the image data can be copied to the device as-is (no supercompression and a format the device can sample from)
+			bool isUploadable(vks::VulkanDevice* device, std::string* reason = nullptr) const;
+			// Size of the image data of all levels
+			VkDeviceSize levelDataSize() const;
+		};
+
+		bool loadFromMemory(const uint8_t* bytes, size_t size, Texture& texture, std::string* error = nullptr);
+		bool loadFromFile(const std::string& filename, Texture& texture, std::string* error = nullptr);
+
+		/**
+		* Write an uncompressed 2D texture or cube map to a KTX2 file
+		*
+		* @param levelData Image data of all levels starting with the base level, each level contains all of its faces
+		* @param levelSizes Size of each level in levelData
+		*/
+		bool saveToFile(const std::string& filename, VkFormat format, uint32_t width, uint32_t height, uint32_t faceCount, const uint8_t* levelData, const std::vector<VkDeviceSize>& levelSizes, std::string* error = nullptr);
+
+		/**
+		* Create an optimal tiled image for the texture and upload all of its mip levels with a single copy
+		* Cube maps are created with six array layers and the cube compatible flag
+		*
+		* @param texture Texture to upload, must be uploadable
+		* @param device Vulkan device to create the image on
+		* @param copyQueue Queue used for the staging copy (must support transfer)
+		* @param imageUsageFlags Usage flags for the image (transfer destination is always added)
+		* @param imageLayout Layout the image is transitioned to after the upload
+		* @param image Created image
+		* @param memory Device local memory backing the image
+		*
+		* @return Size of the device memory allocated for the image
+		*/
+		VkDeviceSize createImage(const Texture& texture, vks::VulkanDevice* device, VkQueue copyQueue, VkImageUsageFlags imageUsageFlags, VkImageLayout imageLayout, VkImage& image, VkDeviceMemory& memory);
+	}
+}
@@ -0,0 +1,378 @@
+/*
+* Vulkan layered shadow map
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanLayeredShadowMap.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace vks
+{
+	void LayeredShadowMap::create(vks::VulkanDevice* device, uint32_t width, uint32_t height, uint32_t layerCount, VkFormat colorFormat, VkFormat depthFormat, bool cube)
+	{
+		assert(layerCount > 0 && layerCount <= maxLayers);
+		assert(!cube || layerCount == 6);
+		this->device = device;
+		this->width = width;
+		this->height = height;
+		this->layerCount = layerCount;
+		this->colorFormat = colorFormat;
+		this->depthFormat = depthFormat;
+		VkDevice logicalDevice = device->logicalDevice;
+
+		if (!device->enabledFeatures.geometryShader) {
+			settings.layered = false;
+		}
+
+		clearRenderPass = createRenderPass(VK_ATTACHMENT_LOAD_OP_CLEAR, VK_IMAGE_LAYOUT_UNDEFINED, true);
+		cacheRenderPass = createRenderPass(VK_ATTACHMENT_LOAD_OP_CLEAR, VK_IMAGE_LAYOUT_UNDEFINED, false);
+		loadRenderPass = createRenderPass(VK_ATTACHMENT_LOAD_OP_LOAD, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true);
+		renderPass = clearRenderPass;
+
+		createTarget(shadowMap, true);
+		createTarget(cache, false);
+
+		const bool sampleColor = (colorFormat != VK_FORMAT_UNDEFINED);
+		image = sampleColor ? shadowMap.color.image : shadowMap.depth.image;
+
+		VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+		viewCI.viewType = cube ? VK_IMAGE_VIEW_TYPE_CUBE : VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+		viewCI.format = sampleColor ? colorFormat : depthFormat;
+		viewCI.subresourceRange = { sampleColor ? VK_IMAGE_ASPECT_COLOR_BIT : VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, layerCount };
+		viewCI.image = image;
+		VK_CHECK_RESULT(vkCreateImageView(logicalDevice, &viewCI, nullptr, &view));
+
+		VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+		samplerCI.magFilter = VK_FILTER_LINEAR;
+		samplerCI.minFilter = VK_FILTER_LINEAR;
+		samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.addressModeV = samplerCI.addressModeU;
+		samplerCI.addressModeW = samplerCI.addressModeU;
+		samplerCI.maxAnisotropy = 1.0f;
+		samplerCI.minLod = 0.0f;
+		samplerCI.maxLod = 1.0f;
+		samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+		VK_CHECK_RESULT(vkCreateSampler(logicalDevice, &samplerCI, nullptr, &sampler));
+
+		descriptor.sampler = sampler;
+		descriptor.imageView = view;
+		descriptor.imageLayout = sampleColor ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+		layerMatrices.clear();
+		cacheValid = false;
+	}
+
+	void LayeredShadowMap::destroy()
+	{
+		if (!device) {
+			return;
+		}
+		VkDevice logicalDevice = device->logicalDevice;
+		vkDestroySampler(logicalDevice, sampler, nullptr);
+		vkDestroyImageView(logicalDevice, view, nullptr);
+		destroyTarget(shadowMap);
+		destroyTarget(cache);
+		vkDestroyRenderPass(logicalDevice, clearRenderPass, nullptr);
+		vkDestroyRenderPass(logicalDevice, cacheRenderPass, nullptr);
+		vkDestroyRenderPass(logicalDevice, loadRenderPass, nullptr);
+		device = nullptr;
+	}
+
+	void LayeredShadowMap::createAttachment(Attachment& attachment, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspectMask)
+	{
+		VkDevice logicalDevice = device->logicalDevice;
+
+		VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+		imageCI.imageType = VK_IMAGE_TYPE_2D;
+		imageCI.format = format;
+		imageCI.extent = { width, height, 1 };
+		imageCI.mipLevels = 1;
+		imageCI.arrayLayers = layerCount;
+		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCI.usage = usage;
+		imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		// Cube map views are only created for the sampled image, but the flag doesn't hurt for the others
+		if (layerCount == 6) {
+			imageCI.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+		}
+		VK_CHECK_RESULT(vkCreateImage(logicalDevice, &imageCI, nullptr, &attachment.image));
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(logicalDevice, attachment.image, &memReqs);
+		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+		memAlloc.allocationSize = memReqs.size;
+		memAlloc.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VK_CHECK_RESULT(vkAllocateMemory(logicalDevice, &memAlloc, nullptr, &attachment.memory));
+		VK_CHECK_RESULT(vkBindImageMemory(logicalDevice, attachment.image, attachment.memory, 0));
+
+		VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+		viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+		viewCI.format = format;
+		viewCI.subresourceRange = { aspectMask, 0, 1, 0, layerCount };
+		viewCI.image = attachment.image;
+		VK_CHECK_RESULT(vkCreateImageView(logicalDevice, &viewCI, nullptr, &attachment.view));
+		for (uint32_t i = 0; i < layerCount; i++) {
+			viewCI.subresourceRange = { aspectMask, 0, 1, i, 1 };
+			VK_CHECK_RESULT(vkCreateImageView(logicalDevice, &viewCI, nullptr, &attachment.layerViews[i]));
+		}
+	}
+
+	void LayeredShadowMap::destroyAttachment(Attachment& attachment)
+	{
+		VkDevice logicalDevice = device->logicalDevice;
+		for (uint32_t i = 0; i < layerCount; i++) {
+			vkDestroyImageView(logicalDevice, attachment.layerViews[i], nullptr);
+		}
+		vkDestroyImageView(logicalDevice, attachment.view, nullptr);
+		vkDestroyImage(logicalDevice, attachment.image, nullptr);
+		vkFreeMemory(logicalDevice, attachment.memory, nullptr);
+		attachment = {};
+	}
+
+	void LayeredShadowMap::createTarget(Target& target, bool sampled)
+	{
+		const bool hasColor = (colorFormat != VK_FORMAT_UNDEFINED);
+		// The shadow map is written by copies from the cache, the cache is only ever copied from
+		const VkImageUsageFlags transferUsage = sampled ? VK_IMAGE_USAGE_TRANSFER_DST_BIT : VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		if (hasColor) {
+			createAttachment(target.color, colorFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | transferUsage | (sampled ? VK_IMAGE_USAGE_SAMPLED_BIT : 0), VK_IMAGE_ASPECT_COLOR_BIT);
+		}
+		createAttachment(target.depth, depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | transferUsage | ((sampled && !hasColor) ? VK_IMAGE_USAGE_SAMPLED_BIT : 0), VK_IMAGE_ASPECT_DEPTH_BIT);
+
+		VkFramebufferCreateInfo framebufferCI = vks::initializers::framebufferCreateInfo();
+		framebufferCI.renderPass = clearRenderPass;
+		framebufferCI.width = width;
+		framebufferCI.height = height;
+
+		// The layered framebuffer is only usable with the geometry shader, it's cheap enough to always create it
+		std::vector<VkImageView> attachments;
+		if (hasColor) {
+			attachments.push_back(target.color.view);
+		}
+		attachments.push_back(target.depth.view);
+		framebufferCI.attachmentCount = static_cast<uint32_t>(attachments.size());
+		framebufferCI.pAttachments = attachments.data();
+		framebufferCI.layers = layerCount;
+		VK_CHECK_RESULT(vkCreateFramebuffer(device->logicalDevice, &framebufferCI, nullptr, &target.layeredFramebuffer));
+
+		framebufferCI.layers = 1;
+		for (uint32_t i = 0; i < layerCount; i++) {
+			attachments.clear();
+			if (hasColor) {
+				attachments.push_back(target.color.layerViews[i]);
+			}
+			attachments.push_back(target.depth.layerViews[i]);
+			framebufferCI.pAttachments = attachments.data();
+			VK_CHECK_RESULT(vkCreateFramebuffer(device->logicalDevice, &framebufferCI, nullptr, &target.layerFramebuffers[i]));
+		}
+	}
+
+	void LayeredShadowMap::destroyTarget(Target& target)
+	{
+		VkDevice logicalDevice = device->logicalDevice;
+		vkDestroyFramebuffer(logicalDevice, target.layeredFramebuffer, nullptr);
+		for (uint32_t i = 0; i < layerCount; i++) {
+			vkDestroyFramebuffer(logicalDevice, target.layerFramebuffers[i], nullptr);
+		}
+		if (target.color.image != VK_NULL_HANDLE) {
+			destroyAttachment(target.color);
+		}
+		destroyAttachment(target.depth);
+		target = {};
+	}
+
+	VkRenderPass LayeredShadowMap::createRenderPass(VkAttachmentLoadOp loadOp, VkImageLayout initialLayout, bool sampled)
+	{
+		const bool hasColor = (colorFormat != VK_FORMAT_UNDEFINED);
+
+		std::vector<VkAttachmentDescription> attachments;
+		VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+		VkAttachmentReference depthReference = { hasColor ? 1u : 0u, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+		VkAttachmentDescription attachment{};
+		attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		attachment.loadOp = loadOp;
+		attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachment.initialLayout = initialLayout;
+		if (hasColor) {
+			attachment.format = colorFormat;
+			attachment.finalLayout = sampled ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			attachments.push_back(attachment);
+		}
+		attachment.format = depthFormat;
+		if (sampled) {
+			// Depth is only sampled if there's no color attachment
+			attachment.finalLayout = hasColor ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		} else {
+			attachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		}
+		attachments.push_back(attachment);
+
+		VkSubpassDescription subpass{};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = hasColor ? 1 : 0;
+		subpass.pColorAttachments = hasColor ? &colorReference : nullptr;
+		subpass.pDepthStencilAttachment = &depthReference;
+
+		// The same dependencies work for all passes: Attachment writes wait for the copy from the cache and for earlier reads,
+		// later reads (sampling the shadow map or copying the cache) wait for the attachment writes
+		std::array<VkSubpassDependency, 2> dependencies{};
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = 0;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+		dependencies[1].srcSubpass = 0;
+		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+		dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+		VkRenderPassCreateInfo renderPassCI = vks::initializers::renderPassCreateInfo();
+		renderPassCI.attachmentCount = static_cast<uint32_t>(attachments.size());
+		renderPassCI.pAttachments = attachments.data();
+		renderPassCI.subpassCount = 1;
+		renderPassCI.pSubpasses = &subpass;
+		renderPassCI.dependencyCount = static_cast<uint32_t>(dependencies.size());
+		renderPassCI.pDependencies = dependencies.data();
+		VkRenderPass pass;
+		VK_CHECK_RESULT(vkCreateRenderPass(device->logicalDevice, &renderPassCI, nullptr, &pass));
+		return pass;
+	}
+
+	void LayeredShadowMap::setLayerMatrices(const std::vector<glm::mat4>& matrices)
+	{
+		assert(matrices.size() == layerCount);
+		if (layerMatrices.size() != matrices.size() || memcmp(layerMatrices.data(), matrices.data(), sizeof(glm::mat4) * matrices.size()) != 0) {
+			layerMatrices = matrices;
+			for (uint32_t i = 0; i < layerCount; i++) {
+				frustums[i].update(matrices[i]);
+			}
+			cacheValid = false;
+		}
+	}
+
+	void LayeredShadowMap::invalidateCache()
+	{
+		cacheValid = false;
+	}
+
+	uint32_t LayeredShadowMap::getLayerMask(const glm::vec3& center, float radius) const
+	{
+		uint32_t mask = 0;
+		for (uint32_t i = 0; i < layerCount; i++) {
+			bool visible = true;
+			for (uint32_t j = 0; j < frustums[i].planes.size() && visible; j++) {
+				if (j == vks::Frustum::BACK && !settings.cullNearPlane) {
+					continue;
+				}
+				const glm::vec4& plane = frustums[i].planes[j];
+				visible = (glm::dot(glm::vec3(plane), center) + plane.w > -radius);
+			}
+			if (visible) {
+				mask |= 1u << i;
+			}
+		}
+		return mask;
+	}
+
+	void LayeredShadowMap::cmdRenderPasses(VkCommandBuffer commandBuffer, VkRenderPass pass, Target& target, uint32_t casterFlags, const DrawFunction& draw)
+	{
+		std::array<VkClearValue, 2> clearValues{};
+		clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+		const bool hasColor = (colorFormat != VK_FORMAT_UNDEFINED);
+
+		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+		renderPassBeginInfo.renderPass = pass;
+		renderPassBeginInfo.renderArea.extent = { width, height };
+		renderPassBeginInfo.clearValueCount = hasColor ? 2 : 1;
+		renderPassBeginInfo.pClearValues = hasColor ? clearValues.data() : &clearValues[1];
+
+		const uint32_t passCount = settings.layered ? 1 : layerCount;
+		for (uint32_t i = 0; i < passCount; i++) {
+			renderPassBeginInfo.framebuffer = settings.layered ? target.layeredFramebuffer : target.layerFramebuffers[i];
+			vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+			vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+			VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+			vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+			draw(commandBuffer, casterFlags, settings.layered ? allLayers : i);
+			vkCmdEndRenderPass(commandBuffer);
+		}
+		statistics.renderPasses += passCount;
+	}
+
+	void LayeredShadowMap::cmdRestoreCache(VkCommandBuffer commandBuffer)
+	{
+		const bool hasColor = (colorFormat != VK_FORMAT_UNDEFINED);
+
+		// The previous contents of the shadow map are replaced, so the barrier only needs to wait for earlier reads
+		std::vector<Attachment*> dstAttachments = { &shadowMap.depth };
+		std::vector<Attachment*> srcAttachments = { &cache.depth };
+		// Layout transitions of combined depth stencil formats need to include both aspects
+		VkImageAspectFlags depthAspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		if (depthFormat >= VK_FORMAT_D16_UNORM_S8_UINT) {
+			depthAspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+		}
+		std::vector<VkImageAspectFlags> aspects = { depthAspectMask };
+		if (hasColor) {
+			dstAttachments.push_back(&shadowMap.color);
+			srcAttachments.push_back(&cache.color);
+			aspects.push_back(VK_IMAGE_ASPECT_COLOR_BIT);
+		}
+		for (size_t i = 0; i < dstAttachments.size(); i++) {
+			vks::tools::insertImageMemoryBarrier(
+				commandBuffer,
+				dstAttachments[i]->image,
+				0,
+				VK_ACCESS_TRANSFER_WRITE_BIT,
+				VK_IMAGE_LAYOUT_UNDEFINED,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				{ aspects[i], 0, 1, 0, layerCount });
+		}
+		// The cache is left in the transfer source layout by its render pass, whose external dependency also covers this copy
+		for (size_t i = 0; i < dstAttachments.size(); i++) {
+			VkImageCopy region{};
+			region.srcSubresource = { aspects[i], 0, 0, layerCount };
+			region.dstSubresource = { aspects[i], 0, 0, layerCount };
+			region.extent = { width, height, 1 };
+			vkCmdCopyImage(commandBuffer, srcAttachments[i]->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dstAttachments[i]->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+		}
+	}
+
+	void LayeredShadowMap::cmdUpdate(VkCommandBuffer commandBuffer, const DrawFunction& draw)
+	{
+		statistics = {};
+		if (!settings.cacheStaticCasters) {
+			cmdRenderPasses(commandBuffer, clearRenderPass, shadowMap, StaticCasters | DynamicCasters, draw);
+			statistics.staticPassRendered = true;
+			// The cache isn't updated while caching is disabled
+			cacheValid = false;
+			return;
+		}
+		if (!cacheValid) {
+			cmdRenderPasses(commandBuffer, cacheRenderPass, cache, StaticCasters, draw);
+			statistics.staticPassRendered = true;
+			cacheValid = true;
+		}
+		cmdRestoreCache(commandBuffer);
+		cmdRenderPasses(commandBuffer, loadRenderPass, shadowMap, DynamicCasters, draw);
+	}
+}
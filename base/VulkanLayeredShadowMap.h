@@ -0,0 +1,151 @@
+/*
+* Vulkan layered shadow map
+*
+* Shadow map with multiple layers (cube map faces or cascades) that are all rendered in one render pass: A geometry shader
+* instanced once per layer writes each triangle to the layers it's visible in (gl_Layer), the draws pass a mask of these
+* layers so the geometry shader can drop the invocations of layers the caster has been culled for
+* Devices without geometry shader support fall back to one render pass per layer, with draws culled for each layer on the CPU
+*
+* Depth of static casters can be kept in a separate cache that's only re-rendered if the layer matrices change or it's
+* invalidated, each frame then copies the cache into the shadow map and only renders the dynamic casters on top
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <array>
+#include <functional>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+#include "VulkanTools.h"
+#include "frustum.hpp"
+
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	class LayeredShadowMap
+	{
+	public:
+		static const uint32_t maxLayers = 8;
+		// Layer argument of the draw function for passes that render all layers at once
+		static const uint32_t allLayers = ~0u;
+
+		enum CasterFlags {
+			StaticCasters = 0x1,
+			DynamicCasters = 0x2
+		};
+
+		/**
+		* Records the draws of the casters selected by casterFlags
+		* For layer == allLayers the draws are rendered to all layers, with the geometry shader selecting layers from the draw's layer mask,
+		* otherwise only to the given layer, so draws culled for that layer can be skipped
+		*/
+		typedef std::function<void(VkCommandBuffer commandBuffer, uint32_t casterFlags, uint32_t layer)> DrawFunction;
+
+		struct Settings {
+			// Render all layers in one pass, requires the geometryShader feature to be enabled (falls back to one pass per layer otherwise)
+			bool layered{ true };
+			// Keep the depth of static casters in a cache and only render dynamic casters each frame
+			bool cacheStaticCasters{ true };
+			// Cull casters in front of the near plane of a layer, should be disabled if depth clamping lets them cast shadows (e.g. for directional lights)
+			bool cullNearPlane{ true };
+		} settings;
+
+		// Information on the last recorded update
+		struct Statistics {
+			// Static casters have been rendered (cache was invalid or caching is disabled)
+			bool staticPassRendered{ false };
+			// Render passes recorded for the update
+			uint32_t renderPasses{ 0 };
+		} statistics;
+
+		// Image that's sampled by the scene, the color image if a color format was passed on creation, depth otherwise
+		VkImage image{ VK_NULL_HANDLE };
+		VkImageView view{ VK_NULL_HANDLE };
+		VkSampler sampler{ VK_NULL_HANDLE };
+		VkDescriptorImageInfo descriptor{};
+		// All passes are compatible with this render pass
+		VkRenderPass renderPass{ VK_NULL_HANDLE };
+		uint32_t width{ 0 };
+		uint32_t height{ 0 };
+		uint32_t layerCount{ 0 };
+		VkFormat colorFormat{ VK_FORMAT_UNDEFINED };
+		VkFormat depthFormat{ VK_FORMAT_UNDEFINED };
+
+		/**
+		* Create the shadow map, the static caster cache and the render passes
+		*
+		* @param device Device to create the shadow map on
+		* @param width Width of the layers
+		* @param height Height of the layers
+		* @param layerCount Number of layers (at most maxLayers)
+		* @param colorFormat Format of an additional color attachment that's sampled instead of depth (e.g. distance to a point light), VK_FORMAT_UNDEFINED for depth only
+		* @param depthFormat Format of the depth attachment, needs to support sampling if no color format is used
+		* @param cube Sample the layers as a cube map (layerCount must be 6), otherwise as a 2D array
+		*/
+		void create(vks::VulkanDevice* device, uint32_t width, uint32_t height, uint32_t layerCount, VkFormat colorFormat, VkFormat depthFormat, bool cube);
+		void destroy();
+
+		/**
+		* Set the view projection matrices of the layers, used for culling
+		* Invalidates the static caster cache if any of them changed
+		*/
+		void setLayerMatrices(const std::vector<glm::mat4>& matrices);
+		/** @brief Force the static casters to be re-rendered on the next update, e.g. after static geometry has been moved */
+		void invalidateCache();
+		/** @brief Returns a mask of the layers whose frustum intersects a bounding sphere */
+		uint32_t getLayerMask(const glm::vec3& center, float radius) const;
+
+		/**
+		* Record the shadow map update, must be recorded outside of a render pass
+		* The command buffer is expected to be submitted, as a recorded static pass marks the cache as valid
+		*
+		* @param commandBuffer Command buffer to record to
+		* @param draw Function recording the caster draws, called once per pass (see DrawFunction)
+		*/
+		void cmdUpdate(VkCommandBuffer commandBuffer, const DrawFunction& draw);
+
+	private:
+		struct Attachment {
+			VkImage image{ VK_NULL_HANDLE };
+			VkDeviceMemory memory{ VK_NULL_HANDLE };
+			// All layers, used by the layered framebuffer
+			VkImageView view{ VK_NULL_HANDLE };
+			std::array<VkImageView, maxLayers> layerViews{};
+		};
+		// Shadow map and static caster cache, each with an optional color and a depth attachment
+		struct Target {
+			Attachment color;
+			Attachment depth;
+			VkFramebuffer layeredFramebuffer{ VK_NULL_HANDLE };
+			std::array<VkFramebuffer, maxLayers> layerFramebuffers{};
+		};
+
+		vks::VulkanDevice* device{ nullptr };
+		Target shadowMap;
+		Target cache;
+		// Clears the shadow map and leaves it ready for sampling
+		VkRenderPass clearRenderPass{ VK_NULL_HANDLE };
+		// Clears the cache and leaves it ready to be copied
+		VkRenderPass cacheRenderPass{ VK_NULL_HANDLE };
+		// Renders on top of the restored cache and leaves the shadow map ready for sampling
+		VkRenderPass loadRenderPass{ VK_NULL_HANDLE };
+		std::vector<glm::mat4> layerMatrices;
+		std::array<vks::Frustum, maxLayers> frustums;
+		bool cacheValid{ false };
+
+		void createAttachment(Attachment& attachment, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspectMask);
+		void destroyAttachment(Attachment& attachment);
+		void createTarget(Target& target, bool sampled);
+		void destroyTarget(Target& target);
+		VkRenderPass createRenderPass(VkAttachmentLoadOp loadOp, VkImageLayout initialLayout, bool sampled);
+		void cmdRenderPasses(VkCommandBuffer commandBuffer, VkRenderPass pass, Target& target, uint32_t casterFlags, const DrawFunction& draw);
+		void cmdRestoreCache(VkCommandBuffer commandBuffer);
+	};
+}
@@ -0,0 +1,132 @@
+/*
+* Clustered light culling
+*
+* The view frustum is split into a grid of clusters (froxels), with screen space tiles in x and y and exponentially distributed
+* depth slices in z. A compute pass tests all lights against the view space bounding box of every cluster and writes compact
+* per cluster lists of light indices, so shading only has to evaluate the lights that can actually reach a fragment.
+* Lights are stored in a storage buffer that is written by the host every frame, the grid and index lists are rebuilt on the GPU.
+* Shaders look up the lights of a fragment with shaders/glsl/base/lightclusters.glsl
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanBuffer.h"
+#include "VulkanDevice.h"
+#include "VulkanShaderCache.h"
+#include "VulkanTools.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	class LightClusters
+	{
+	public:
+		// Matches the light struct of the shaders (std430)
+		struct Light {
+			// World space
+			glm::vec3 position;
+			// Distance at which the light's contribution falls off to zero, used for culling
+			float range;
+			glm::vec3 color;
+			float intensity;
+		};
+
+		struct Settings {
+			// Number of clusters in x, y and z
+			uint32_t gridSize[3]{ 16, 9, 24 };
+			// Lights beyond this limit are dropped from a cluster (and counted in the statistics)
+			uint32_t maxLightsPerCluster{ 256 };
+		} settings;
+
+		struct Statistics {
+			// Number of light indices written by the last build
+			uint32_t lightIndexCount{ 0 };
+			// Number of clusters that had more lights than the limit
+			uint32_t saturatedClusterCount{ 0 };
+		} statistics;
+
+		// Host visible and persistently mapped, written by updateLights
+		vks::Buffer lightBuffer;
+		// Offset into the light index list and light count of each cluster (uvec2)
+		vks::Buffer clusterBuffer;
+		// Compact light index lists of all clusters
+		vks::Buffer lightIndexBuffer;
+		// Grid and depth slice parameters, used by the culling and the shading shaders
+		vks::Buffer uniformBuffer;
+
+		uint32_t maxLights{ 0 };
+		uint32_t lightCount{ 0 };
+
+		/**
+		* Create the buffers and the culling pipeline
+		*
+		* @param device Device to create the resources on
+		* @param queue Queue used for initialization
+		* @param shaderCache Shader module cache the compute shader is loaded through
+		* @param shadersPath Shader path of the example
+		* @param maxLights Maximum number of lights that can be passed to updateLights
+		*/
+		void create(vks::VulkanDevice* device, VkQueue queue, vks::ShaderModuleCache& shaderCache, const std::string& shadersPath, uint32_t maxLights);
+		void destroy();
+
+		/**
+		* Upload the lights, must not be called while a build of the previous frame is still executing
+		*
+		* @param lights Lights to cull
+		* @param count Number of lights, at most maxLights
+		*/
+		void updateLights(const Light* lights, uint32_t count);
+		/**
+		* Update the camera the clusters are built for
+		*
+		* @param view View matrix
+		* @param projection Projection matrix
+		* @param zNear Distance of the near plane, start of the first depth slice
+		* @param zFar Distance of the far plane, end of the last depth slice
+		*/
+		void updateView(const glm::mat4& view, const glm::mat4& projection, float zNear, float zFar);
+		/** @brief Read back the statistics of the last build, the device must have finished it */
+		void updateStatistics();
+
+		/**
+		* Record the light culling, must be recorded outside of a render pass
+		*
+		* @param commandBuffer Command buffer to record to
+		* @param dstStageMask Pipeline stages that read the cluster and light index buffers after the build
+		*/
+		void cmdBuild(VkCommandBuffer commandBuffer, VkPipelineStageFlags dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+		uint32_t clusterCount() const;
+
+	private:
+		struct Uniforms {
+			glm::mat4 view;
+			glm::mat4 inverseProjection;
+			// Grid size in xyz, light count in w
+			glm::uvec4 gridSize;
+			// Near plane, far plane and the scale and bias that map the logarithm of the view depth to a slice
+			glm::vec4 depthSlicing;
+			uint32_t maxLightsPerCluster;
+		} uniforms{};
+
+		vks::VulkanDevice* device{ nullptr };
+		// Light indices written and saturated clusters, reset at the start of every build and read back for the statistics
+		vks::Buffer counterBuffer;
+		VkDescriptorPool descriptorPool{ VK_NULL_HANDLE };
+		VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
+		VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
+		VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
+		VkPipeline pipeline{ VK_NULL_HANDLE };
+	};
+}
@@ -0,0 +1,166 @@
+/*
+* Vulkan query manager
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanQueryManager.h"
+
+namespace vks
+{
+	void QueryManager::create(vks::VulkanDevice* device, VkQueue queue, VkQueryType queryType, uint32_t frameCount, uint32_t maxQueries, bool conditionalRendering)
+	{
+		assert(queryType == VK_QUERY_TYPE_OCCLUSION || queryType == VK_QUERY_TYPE_TIMESTAMP);
+		// Predicates are only meaningful for occlusion queries
+		assert(!conditionalRendering || queryType == VK_QUERY_TYPE_OCCLUSION);
+		this->device = device;
+		this->queryType = queryType;
+		this->frameCount = frameCount;
+		this->maxQueries = maxQueries;
+		this->conditionalRendering = conditionalRendering;
+
+		frames.resize(frameCount);
+		for (auto& frame : frames) {
+			VkQueryPoolCreateInfo queryPoolCI{};
+			queryPoolCI.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolCI.queryType = queryType;
+			queryPoolCI.queryCount = maxQueries;
+			VK_CHECK_RESULT(vkCreateQueryPool(device->logicalDevice, &queryPoolCI, nullptr, &frame.queryPool));
+
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &frame.resultBuffer, maxQueries * sizeof(uint64_t)));
+			VK_CHECK_RESULT(frame.resultBuffer.map());
+			// Report one passed sample until the frame has been resolved, so nothing is considered hidden at start
+			uint64_t* results = static_cast<uint64_t*>(frame.resultBuffer.mapped);
+			for (uint32_t i = 0; i < maxQueries; i++) {
+				results[i] = 1;
+			}
+		}
+
+		if (conditionalRendering) {
+			vkCmdBeginConditionalRenderingEXT = reinterpret_cast<PFN_vkCmdBeginConditionalRenderingEXT>(vkGetDeviceProcAddr(device->logicalDevice, "vkCmdBeginConditionalRenderingEXT"));
+			vkCmdEndConditionalRenderingEXT = reinterpret_cast<PFN_vkCmdEndConditionalRenderingEXT>(vkGetDeviceProcAddr(device->logicalDevice, "vkCmdEndConditionalRenderingEXT"));
+			if (!vkCmdBeginConditionalRenderingEXT || !vkCmdEndConditionalRenderingEXT) {
+				vks::tools::exitFatal("Could not get the function pointers for conditional rendering, VK_EXT_conditional_rendering needs to be enabled", -1);
+			}
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_CONDITIONAL_RENDERING_BIT_EXT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &predicateBuffer, maxQueries * sizeof(uint32_t)));
+			VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			vkCmdFillBuffer(commandBuffer, predicateBuffer.buffer, 0, VK_WHOLE_SIZE, 1);
+			device->flushCommandBuffer(commandBuffer, queue, true);
+		}
+	}
+
+	void QueryManager::destroy()
+	{
+		if (!device) {
+			return;
+		}
+		for (auto& frame : frames) {
+			vkDestroyQueryPool(device->logicalDevice, frame.queryPool, nullptr);
+			frame.resultBuffer.destroy();
+		}
+		frames.clear();
+		if (conditionalRendering) {
+			predicateBuffer.destroy();
+		}
+		device = nullptr;
+	}
+
+	void QueryManager::cmdBeginFrame(VkCommandBuffer commandBuffer, uint32_t frame)
+	{
+		assert(frame < frameCount);
+		vkCmdResetQueryPool(commandBuffer, frames[frame].queryPool, 0, maxQueries);
+		frames[frame].queryCount = 0;
+	}
+
+	uint32_t QueryManager::cmdBeginQuery(VkCommandBuffer commandBuffer, uint32_t frame, VkQueryControlFlags flags)
+	{
+		Frame& target = frames[frame];
+		assert(target.queryCount < maxQueries);
+		const uint32_t query = target.queryCount++;
+		vkCmdBeginQuery(commandBuffer, target.queryPool, query, flags);
+		return query;
+	}
+
+	void QueryManager::cmdEndQuery(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t query)
+	{
+		vkCmdEndQuery(commandBuffer, frames[frame].queryPool, query);
+	}
+
+	uint32_t QueryManager::cmdWriteTimestamp(VkCommandBuffer commandBuffer, uint32_t frame, VkPipelineStageFlagBits stage)
+	{
+		assert(queryType == VK_QUERY_TYPE_TIMESTAMP);
+		Frame& target = frames[frame];
+		assert(target.queryCount < maxQueries);
+		const uint32_t query = target.queryCount++;
+		vkCmdWriteTimestamp(commandBuffer, stage, target.queryPool, query);
+		return query;
+	}
+
+	void QueryManager::cmdResolve(VkCommandBuffer commandBuffer, uint32_t frame)
+	{
+		Frame& source = frames[frame];
+		if (source.queryCount == 0) {
+			return;
+		}
+
+		// The wait bit only makes the copy wait on the GPU for the queries to finish, the host is never blocked
+		vkCmdCopyQueryPoolResults(commandBuffer, source.queryPool, 0, source.queryCount, source.resultBuffer.buffer, 0, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+
+		std::vector<VkBufferMemoryBarrier> bufferBarriers;
+		VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
+		bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		bufferBarrier.buffer = source.resultBuffer.buffer;
+		bufferBarrier.size = VK_WHOLE_SIZE;
+		bufferBarriers.push_back(bufferBarrier);
+		VkPipelineStageFlags dstStageMask = VK_PIPELINE_STAGE_HOST_BIT;
+
+		if (conditionalRendering) {
+			// Earlier conditional rendering in this frame reads the predicates that are about to be overwritten
+			VkBufferMemoryBarrier predicateBarrier = vks::initializers::bufferMemoryBarrier();
+			predicateBarrier.srcAccessMask = VK_ACCESS_CONDITIONAL_RENDERING_READ_BIT_EXT;
+			predicateBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			predicateBarrier.buffer = predicateBuffer.buffer;
+			predicateBarrier.size = VK_WHOLE_SIZE;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_CONDITIONAL_RENDERING_BIT_EXT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &predicateBarrier, 0, nullptr);
+
+			// Without the 64 bit flag, results are written as 32 bit values, which is what conditional rendering reads
+			vkCmdCopyQueryPoolResults(commandBuffer, source.queryPool, 0, source.queryCount, predicateBuffer.buffer, 0, sizeof(uint32_t), VK_QUERY_RESULT_WAIT_BIT);
+
+			predicateBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			predicateBarrier.dstAccessMask = VK_ACCESS_CONDITIONAL_RENDERING_READ_BIT_EXT;
+			bufferBarriers.push_back(predicateBarrier);
+			dstStageMask |= VK_PIPELINE_STAGE_CONDITIONAL_RENDERING_BIT_EXT;
+		}
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStageMask, 0, 0, nullptr, static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(), 0, nullptr);
+	}
+
+	void QueryManager::cmdBeginConditionalRendering(VkCommandBuffer commandBuffer, uint32_t query)
+	{
+		assert(conditionalRendering && query < maxQueries);
+		VkConditionalRenderingBeginInfoEXT conditionalRenderingBeginInfo{};
+		conditionalRenderingBeginInfo.sType = VK_STRUCTURE_TYPE_CONDITIONAL_RENDERING_BEGIN_INFO_EXT;
+		conditionalRenderingBeginInfo.buffer = predicateBuffer.buffer;
+		conditionalRenderingBeginInfo.offset = sizeof(uint32_t) * query;
+		vkCmdBeginConditionalRenderingEXT(commandBuffer, &conditionalRenderingBeginInfo);
+	}
+
+	void QueryManager::cmdEndConditionalRendering(VkCommandBuffer commandBuffer)
+	{
+		vkCmdEndConditionalRenderingEXT(commandBuffer);
+	}
+
+	uint64_t QueryManager::getResult(uint32_t frame, uint32_t query) const
+	{
+		assert(frame < frameCount && query < maxQueries);
+		return static_cast<const uint64_t*>(frames[frame].resultBuffer.mapped)[query];
+	}
+
+	uint32_t QueryManager::queryCount(uint32_t frame) const
+	{
+		return frames[frame].queryCount;
+	}
+}
@@ -0,0 +1,90 @@
+/*
+* Vulkan query manager
+*
+* Hands out query slots from one query pool per frame (command buffer) and resolves the results on the GPU with vkCmdCopyQueryPoolResults
+* Results are copied to a host visible buffer that's read once the frame's command buffer has finished executing again, so reading them never stalls,
+* and to a predicate buffer that can drive conditional rendering of later frames without any host round trip
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanBuffer.h"
+#include "VulkanDevice.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	class QueryManager
+	{
+	public:
+		uint32_t frameCount{ 0 };
+		uint32_t maxQueries{ 0 };
+
+		/**
+		* Create the query pools and result buffers
+		*
+		* @param device Device to create the pools on
+		* @param queue Queue used for initializing the buffers
+		* @param queryType Type of the queries (occlusion or timestamp, pipeline statistics are not supported)
+		* @param frameCount Number of frames that may record queries independently, usually the number of command buffers
+		* @param maxQueries Maximum number of queries per frame
+		* @param conditionalRendering Also resolve results into a predicate buffer for conditional rendering, requires VK_EXT_conditional_rendering
+		*/
+		void create(vks::VulkanDevice* device, VkQueue queue, VkQueryType queryType, uint32_t frameCount, uint32_t maxQueries, bool conditionalRendering = false);
+		void destroy();
+
+		/** @brief Reset the queries of a frame, must be recorded outside of a render pass before any query of the frame */
+		void cmdBeginFrame(VkCommandBuffer commandBuffer, uint32_t frame);
+		/**
+		* Allocate the next query slot of a frame and begin the query
+		* Queries recorded in the same order in every frame get the same index, which is also used to look up their predicate
+		*
+		* @return Index of the query
+		*/
+		uint32_t cmdBeginQuery(VkCommandBuffer commandBuffer, uint32_t frame, VkQueryControlFlags flags = 0);
+		void cmdEndQuery(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t query);
+		/** @brief Allocate a query slot and write a timestamp to it (timestamp queries only) */
+		uint32_t cmdWriteTimestamp(VkCommandBuffer commandBuffer, uint32_t frame, VkPipelineStageFlagBits stage);
+		/** @brief Copy the results of all queries of a frame to the result buffers, must be recorded outside of a render pass after the last query */
+		void cmdResolve(VkCommandBuffer commandBuffer, uint32_t frame);
+
+		/**
+		* Begin a conditionally rendered section that's skipped if the last resolved result of the query was zero (e.g. no samples passed)
+		* Until a result has been resolved, the section is always executed
+		*/
+		void cmdBeginConditionalRendering(VkCommandBuffer commandBuffer, uint32_t query);
+		void cmdEndConditionalRendering(VkCommandBuffer commandBuffer);
+
+		/**
+		* Get the result of a query from the last execution of a frame's command buffer, doesn't wait for anything
+		* Must only be called once that execution has finished (e.g. after waiting for the frame's fence), returns 1 if the frame hasn't been executed yet
+		*/
+		uint64_t getResult(uint32_t frame, uint32_t query) const;
+		/** @brief Number of queries recorded for a frame */
+		uint32_t queryCount(uint32_t frame) const;
+
+	private:
+		struct Frame {
+			VkQueryPool queryPool{ VK_NULL_HANDLE };
+			uint32_t queryCount{ 0 };
+			// 64 bit results, persistently mapped
+			vks::Buffer resultBuffer;
+		};
+
+		vks::VulkanDevice* device{ nullptr };
+		VkQueryType queryType{ VK_QUERY_TYPE_OCCLUSION };
+		std::vector<Frame> frames;
+		// 32 bit results of the last resolved frame, shared by all frames as they're executed in order
+		vks::Buffer predicateBuffer;
+		bool conditionalRendering{ false };
+		PFN_vkCmdBeginConditionalRenderingEXT vkCmdBeginConditionalRenderingEXT{ nullptr };
+		PFN_vkCmdEndConditionalRenderingEXT vkCmdEndConditionalRenderingEXT{ nullptr };
+	};
+}
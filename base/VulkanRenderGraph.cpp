@@ -0,0 +1,728 @@
+/*
+* Vulkan render graph with automatic barriers and transient attachment aliasing
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanRenderGraph.h"
+#include "VulkanDebug.h"
+
+#include <algorithm>
+
+namespace vks
+{
+	static const VkAccessFlags writeAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	static bool isDepthFormat(VkFormat format)
+	{
+		switch (format) {
+		case VK_FORMAT_D16_UNORM:
+		case VK_FORMAT_X8_D24_UNORM_PACK32:
+		case VK_FORMAT_D32_SFLOAT:
+		case VK_FORMAT_D16_UNORM_S8_UINT:
+		case VK_FORMAT_D24_UNORM_S8_UINT:
+		case VK_FORMAT_D32_SFLOAT_S8_UINT:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	static VkImageAspectFlags getAspectMask(VkFormat format)
+	{
+		if (!isDepthFormat(format)) {
+			return VK_IMAGE_ASPECT_COLOR_BIT;
+		}
+		VkImageAspectFlags aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		if (vks::tools::formatHasStencil(format)) {
+			aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+		}
+		return aspectMask;
+	}
+
+	static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	void RenderGraph::create(vks::VulkanDevice* device)
+	{
+		this->device = device;
+	}
+
+	void RenderGraph::destroy()
+	{
+		if (device) {
+			clear();
+		}
+	}
+
+	void RenderGraph::clear()
+	{
+		destroyObjects();
+		passes.clear();
+		resources.clear();
+		statistics = {};
+	}
+
+	void RenderGraph::destroyObjects()
+	{
+		VkDevice logicalDevice = device->logicalDevice;
+		resetFramebuffers();
+		for (auto& pass : passes) {
+			if (pass.renderPass != VK_NULL_HANDLE) {
+				vkDestroyRenderPass(logicalDevice, pass.renderPass, nullptr);
+				pass.renderPass = VK_NULL_HANDLE;
+			}
+			pass.barriers.clear();
+			pass.culled = false;
+		}
+		for (auto& resource : resources) {
+			if (resource.imported) {
+				continue;
+			}
+			if (resource.view != VK_NULL_HANDLE) {
+				vkDestroyImageView(logicalDevice, resource.view, nullptr);
+			}
+			if (resource.image != VK_NULL_HANDLE) {
+				vkDestroyImage(logicalDevice, resource.image, nullptr);
+			}
+			resource.view = VK_NULL_HANDLE;
+			resource.image = VK_NULL_HANDLE;
+			resource.heap = invalidHandle;
+		}
+		for (auto& heap : heaps) {
+			vkFreeMemory(logicalDevice, heap.memory, nullptr);
+		}
+		heaps.clear();
+		finalBarriers.clear();
+	}
+
+	RenderGraph::ResourceHandle RenderGraph::createImage(const std::string& name, const ImageDesc& desc)
+	{
+		Resource resource{};
+		resource.name = name;
+		resource.desc = desc;
+		resource.aspectMask = getAspectMask(desc.format);
+		resources.push_back(resource);
+		return static_cast<ResourceHandle>(resources.size() - 1);
+	}
+
+	RenderGraph::ResourceHandle RenderGraph::importImage(const std::string& name, const ImportedImage& image)
+	{
+		Resource resource{};
+		resource.name = name;
+		resource.imported = true;
+		resource.importedImage = image;
+		resource.image = image.image;
+		resource.view = image.view;
+		resource.aspectMask = getAspectMask(image.format);
+		resources.push_back(resource);
+		return static_cast<ResourceHandle>(resources.size() - 1);
+	}
+
+	void RenderGraph::updateImportedImage(ResourceHandle resource, VkImage image, VkImageView view, uint32_t width, uint32_t height)
+	{
+		assert(resources[resource].imported);
+		Resource& importedResource = resources[resource];
+		importedResource.importedImage.image = image;
+		importedResource.importedImage.view = view;
+		importedResource.importedImage.width = width;
+		importedResource.importedImage.height = height;
+		importedResource.image = image;
+		importedResource.view = view;
+	}
+
+	RenderGraph::PassHandle RenderGraph::addPass(const std::string& name, bool graphics, std::function<void(VkCommandBuffer)> execute)
+	{
+		Pass pass{};
+		pass.name = name;
+		pass.graphics = graphics;
+		pass.execute = execute;
+		passes.push_back(pass);
+		return static_cast<PassHandle>(passes.size() - 1);
+	}
+
+	RenderGraph::PassHandle RenderGraph::addGraphicsPass(const std::string& name, std::function<void(VkCommandBuffer)> execute)
+	{
+		return addPass(name, true, execute);
+	}
+
+	RenderGraph::PassHandle RenderGraph::addComputePass(const std::string& name, std::function<void(VkCommandBuffer)> execute)
+	{
+		return addPass(name, false, execute);
+	}
+
+	void RenderGraph::addAccess(PassHandle pass, const Access& access)
+	{
+		// Multiple accesses of a pass to the same image are merged, they all have to use the same layout
+		for (auto& existing : passes[pass].accesses) {
+			if (existing.resource == access.resource) {
+				if (existing.layout != access.layout) {
+					vks::tools::exitFatal("Render graph pass \"" + passes[pass].name + "\" accesses \"" + resources[access.resource].name + "\" in different layouts", -1);
+				}
+				existing.stageMask |= access.stageMask;
+				existing.accessMask |= access.accessMask;
+				existing.usage |= access.usage;
+				existing.read = existing.read || access.read;
+				existing.write = existing.write || access.write;
+				return;
+			}
+		}
+		passes[pass].accesses.push_back(access);
+	}
+
+	void RenderGraph::addColorAttachment(PassHandle pass, ResourceHandle resource, VkAttachmentLoadOp loadOp, VkClearColorValue clearValue)
+	{
+		assert(passes[pass].graphics);
+		Attachment attachment{};
+		attachment.resource = resource;
+		attachment.loadOp = loadOp;
+		attachment.clearValue.color = clearValue;
+		passes[pass].colorAttachments.push_back(attachment);
+
+		const bool load = (loadOp == VK_ATTACHMENT_LOAD_OP_LOAD);
+		Access access{};
+		access.resource = resource;
+		access.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		access.stageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		access.accessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | (load ? VK_ACCESS_COLOR_ATTACHMENT_READ_BIT : 0);
+		access.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		access.read = load;
+		access.write = true;
+		addAccess(pass, access);
+	}
+
+	void RenderGraph::setDepthStencilAttachment(PassHandle pass, ResourceHandle resource, VkAttachmentLoadOp loadOp, VkClearDepthStencilValue clearValue)
+	{
+		assert(passes[pass].graphics);
+		assert(passes[pass].depthStencilAttachment.resource == invalidHandle);
+		Attachment& attachment = passes[pass].depthStencilAttachment;
+		attachment.resource = resource;
+		attachment.loadOp = loadOp;
+		attachment.clearValue.depthStencil = clearValue;
+
+		Access access{};
+		access.resource = resource;
+		access.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		access.stageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		// Depth testing reads the attachment even if it has been cleared
+		access.accessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		access.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		access.read = (loadOp == VK_ATTACHMENT_LOAD_OP_LOAD);
+		access.write = true;
+		addAccess(pass, access);
+	}
+
+	void RenderGraph::addSampledImage(PassHandle pass, ResourceHandle resource, VkPipelineStageFlags stageMask)
+	{
+		Access access{};
+		access.resource = resource;
+		access.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		access.stageMask = stageMask;
+		access.accessMask = VK_ACCESS_SHADER_READ_BIT;
+		access.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+		access.read = true;
+		access.write = false;
+		addAccess(pass, access);
+	}
+
+	void RenderGraph::addStorageImage(PassHandle pass, ResourceHandle resource, bool write, VkPipelineStageFlags stageMask)
+	{
+		Access access{};
+		access.resource = resource;
+		access.layout = VK_IMAGE_LAYOUT_GENERAL;
+		access.stageMask = stageMask;
+		access.accessMask = VK_ACCESS_SHADER_READ_BIT | (write ? VK_ACCESS_SHADER_WRITE_BIT : 0);
+		access.usage = VK_IMAGE_USAGE_STORAGE_BIT;
+		// Storage images may be written partially, so the previous contents are always considered as read
+		access.read = true;
+		access.write = write;
+		addAccess(pass, access);
+	}
+
+	void RenderGraph::setSideEffects(PassHandle pass)
+	{
+		passes[pass].sideEffects = true;
+	}
+
+	void RenderGraph::cullPasses()
+	{
+		// Walk the passes backwards and keep those that write something a kept pass (or the application) reads later on
+		std::vector<bool> required(resources.size(), false);
+		for (size_t i = 0; i < resources.size(); i++) {
+			required[i] = resources[i].imported;
+		}
+		for (size_t i = passes.size(); i-- > 0;) {
+			Pass& pass = passes[i];
+			bool contributes = pass.sideEffects || !settings.culling;
+			for (auto& access : pass.accesses) {
+				contributes = contributes || (access.write && required[access.resource]);
+			}
+			pass.culled = !contributes;
+			if (pass.culled) {
+				continue;
+			}
+			// Passes before this one only need to provide what it reads, images it overwrites completely are no longer required from them
+			for (auto& access : pass.accesses) {
+				if (access.write && !access.read) {
+					required[access.resource] = false;
+				}
+			}
+			for (auto& access : pass.accesses) {
+				if (access.read) {
+					required[access.resource] = true;
+				}
+			}
+		}
+		statistics.passCount = static_cast<uint32_t>(passes.size());
+		statistics.culledPassCount = static_cast<uint32_t>(std::count_if(passes.begin(), passes.end(), [](const Pass& pass) { return pass.culled; }));
+	}
+
+	void RenderGraph::computeLifetimes()
+	{
+		for (auto& resource : resources) {
+			resource.firstPass = invalidHandle;
+			resource.lastPass = invalidHandle;
+		}
+		for (uint32_t i = 0; i < static_cast<uint32_t>(passes.size()); i++) {
+			if (passes[i].culled) {
+				continue;
+			}
+			for (auto& access : passes[i].accesses) {
+				Resource& resource = resources[access.resource];
+				if (resource.firstPass == invalidHandle) {
+					resource.firstPass = i;
+				}
+				resource.lastPass = i;
+			}
+		}
+	}
+
+	bool RenderGraph::aliases(const Resource& a, const Resource& b) const
+	{
+		if (a.heap == invalidHandle || a.heap != b.heap) {
+			return false;
+		}
+		return (a.offset < b.offset + b.memoryRequirements.size) && (b.offset < a.offset + a.memoryRequirements.size);
+	}
+
+	void RenderGraph::allocateImages()
+	{
+		VkDevice logicalDevice = device->logicalDevice;
+
+		std::vector<VkImageUsageFlags> usage(resources.size(), 0);
+		for (auto& pass : passes) {
+			if (pass.culled) {
+				continue;
+			}
+			for (auto& access : pass.accesses) {
+				usage[access.resource] |= access.usage;
+			}
+		}
+
+		// Create the images to get their memory requirements
+		std::vector<ResourceHandle> transients;
+		for (ResourceHandle i = 0; i < static_cast<ResourceHandle>(resources.size()); i++) {
+			Resource& resource = resources[i];
+			if (resource.imported || resource.firstPass == invalidHandle) {
+				continue;
+			}
+			VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+			imageCI.imageType = VK_IMAGE_TYPE_2D;
+			imageCI.format = resource.desc.format;
+			imageCI.extent = { resource.desc.width, resource.desc.height, 1 };
+			imageCI.mipLevels = 1;
+			imageCI.arrayLayers = 1;
+			imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageCI.usage = usage[i] | resource.desc.usage;
+			imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VK_CHECK_RESULT(vkCreateImage(logicalDevice, &imageCI, nullptr, &resource.image));
+			vkGetImageMemoryRequirements(logicalDevice, resource.image, &resource.memoryRequirements);
+			transients.push_back(i);
+		}
+
+		// Place the largest images first, each at the lowest offset of its memory type's heap that doesn't overlap an image that's alive at the same time
+		// All images use optimal tiling, so the buffer image granularity doesn't need to be taken into account
+		std::stable_sort(transients.begin(), transients.end(), [this](ResourceHandle a, ResourceHandle b) { return resources[a].memoryRequirements.size > resources[b].memoryRequirements.size; });
+		std::vector<ResourceHandle> placed;
+		for (ResourceHandle handle : transients) {
+			Resource& resource = resources[handle];
+			const uint32_t memoryTypeIndex = device->getMemoryType(resource.memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			auto heap = std::find_if(heaps.begin(), heaps.end(), [memoryTypeIndex](const Heap& heap) { return heap.memoryTypeIndex == memoryTypeIndex; });
+			if (heap == heaps.end()) {
+				Heap newHeap{};
+				newHeap.memoryTypeIndex = memoryTypeIndex;
+				heap = heaps.insert(heaps.end(), newHeap);
+			}
+			resource.heap = static_cast<uint32_t>(heap - heaps.begin());
+
+			VkDeviceSize offset = 0;
+			bool moved = true;
+			while (moved) {
+				moved = false;
+				offset = alignUp(offset, resource.memoryRequirements.alignment);
+				for (ResourceHandle other : placed) {
+					const Resource& otherResource = resources[other];
+					const bool overlappingLifetimes = (resource.firstPass <= otherResource.lastPass) && (otherResource.firstPass <= resource.lastPass);
+					if (otherResource.heap != resource.heap || (settings.aliasing && !overlappingLifetimes)) {
+						continue;
+					}
+					const VkDeviceSize otherEnd = otherResource.offset + otherResource.memoryRequirements.size;
+					if ((offset < otherEnd) && (otherResource.offset < offset + resource.memoryRequirements.size)) {
+						offset = otherEnd;
+						moved = true;
+					}
+				}
+			}
+			resource.offset = offset;
+			heap->size = std::max(heap->size, offset + resource.memoryRequirements.size);
+			placed.push_back(handle);
+			statistics.transientMemoryUnaliased += resource.memoryRequirements.size;
+		}
+
+		for (auto& heap : heaps) {
+			VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+			memAlloc.allocationSize = heap.size;
+			memAlloc.memoryTypeIndex = heap.memoryTypeIndex;
+			VK_CHECK_RESULT(vkAllocateMemory(logicalDevice, &memAlloc, nullptr, &heap.memory));
+			statistics.transientMemory += heap.size;
+		}
+		statistics.heapCount = static_cast<uint32_t>(heaps.size());
+		statistics.transientImageCount = static_cast<uint32_t>(transients.size());
+
+		for (ResourceHandle handle : transients) {
+			Resource& resource = resources[handle];
+			VK_CHECK_RESULT(vkBindImageMemory(logicalDevice, resource.image, heaps[resource.heap].memory, resource.offset));
+			VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+			viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewCI.format = resource.desc.format;
+			viewCI.subresourceRange = { resource.aspectMask, 0, 1, 0, 1 };
+			viewCI.image = resource.image;
+			VK_CHECK_RESULT(vkCreateImageView(logicalDevice, &viewCI, nullptr, &resource.view));
+		}
+	}
+
+	void RenderGraph::createRenderPasses()
+	{
+		for (uint32_t i = 0; i < static_cast<uint32_t>(passes.size()); i++) {
+			Pass& pass = passes[i];
+			if (!pass.graphics) {
+				continue;
+			}
+			if (pass.colorAttachments.empty() && pass.depthStencilAttachment.resource == invalidHandle) {
+				vks::tools::exitFatal("Render graph pass \"" + pass.name + "\" has no attachments", -1);
+			}
+
+			std::vector<Attachment> attachments = pass.colorAttachments;
+			if (pass.depthStencilAttachment.resource != invalidHandle) {
+				attachments.push_back(pass.depthStencilAttachment);
+			}
+			std::vector<VkAttachmentDescription> attachmentDescs(attachments.size());
+			for (size_t j = 0; j < attachments.size(); j++) {
+				const Resource& resource = resources[attachments[j].resource];
+				const bool depthStencil = (j == pass.colorAttachments.size());
+				// Attachments nobody reads after this pass don't need to be written back to memory
+				const bool store = pass.culled || resource.imported || (resource.lastPass > i);
+				const VkImageLayout layout = depthStencil ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+				attachmentDescs[j].format = getFormat(resource);
+				attachmentDescs[j].samples = VK_SAMPLE_COUNT_1_BIT;
+				attachmentDescs[j].loadOp = attachments[j].loadOp;
+				attachmentDescs[j].storeOp = store ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+				const bool stencil = (resource.aspectMask & VK_IMAGE_ASPECT_STENCIL_BIT) != 0;
+				attachmentDescs[j].stencilLoadOp = stencil ? attachments[j].loadOp : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+				attachmentDescs[j].stencilStoreOp = stencil ? attachmentDescs[j].storeOp : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+				// Layout transitions are done by the graph's barriers
+				attachmentDescs[j].initialLayout = layout;
+				attachmentDescs[j].finalLayout = layout;
+			}
+
+			std::vector<VkAttachmentReference> colorReferences;
+			for (uint32_t j = 0; j < static_cast<uint32_t>(pass.colorAttachments.size()); j++) {
+				colorReferences.push_back({ j, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
+			}
+			VkAttachmentReference depthReference = { static_cast<uint32_t>(pass.colorAttachments.size()), VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+			VkSubpassDescription subpass = {};
+			subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+			subpass.colorAttachmentCount = static_cast<uint32_t>(colorReferences.size());
+			subpass.pColorAttachments = colorReferences.data();
+			subpass.pDepthStencilAttachment = (pass.depthStencilAttachment.resource != invalidHandle) ? &depthReference : nullptr;
+
+			VkRenderPassCreateInfo renderPassCI = vks::initializers::renderPassCreateInfo();
+			renderPassCI.attachmentCount = static_cast<uint32_t>(attachmentDescs.size());
+			renderPassCI.pAttachments = attachmentDescs.data();
+			renderPassCI.subpassCount = 1;
+			renderPassCI.pSubpasses = &subpass;
+			VK_CHECK_RESULT(vkCreateRenderPass(device->logicalDevice, &renderPassCI, nullptr, &pass.renderPass));
+		}
+	}
+
+	void RenderGraph::computeBarriers()
+	{
+		// Simulate the state of every image through the passes and insert a barrier wherever an access doesn't match it
+		struct State {
+			VkImageLayout layout;
+			// Stages and access of the last write (or layout transition)
+			VkPipelineStageFlags writeStageMask;
+			VkAccessFlags writeAccessMask;
+			// Stages that have read the image since then, reads in other stages need the last write to be made visible to them first
+			VkPipelineStageFlags readStageMask;
+		};
+		std::vector<State> states(resources.size());
+		for (size_t i = 0; i < resources.size(); i++) {
+			const Resource& resource = resources[i];
+			if (resource.imported) {
+				states[i] = { resource.importedImage.initialLayout, resource.importedImage.initialStageMask, resource.importedImage.initialAccessMask, 0 };
+			} else {
+				// Contents of transient images are discarded from frame to frame
+				states[i] = { VK_IMAGE_LAYOUT_UNDEFINED, 0, 0, 0 };
+			}
+		}
+
+		// The first barrier of a transient image has to wait for the last accesses to its memory, which are only known after the whole frame has been simulated
+		struct FirstBarrier {
+			uint32_t pass;
+			size_t barrier;
+		};
+		std::vector<FirstBarrier> firstBarriers(resources.size(), { invalidHandle, 0 });
+
+		for (uint32_t i = 0; i < static_cast<uint32_t>(passes.size()); i++) {
+			Pass& pass = passes[i];
+			pass.barriers.clear();
+			pass.srcStageMask = 0;
+			pass.dstStageMask = 0;
+			if (pass.culled) {
+				continue;
+			}
+			for (auto& access : pass.accesses) {
+				State& state = states[access.resource];
+				const bool layoutChange = (state.layout != access.layout);
+				bool hazard = false;
+				if (access.write) {
+					// Write after write and write after read
+					hazard = (state.writeStageMask | state.readStageMask) != 0;
+				} else {
+					// Read after write, unless the write has already been made visible to the stages of this read
+					hazard = (state.writeStageMask != 0) && ((access.stageMask & ~state.readStageMask) != 0);
+				}
+				if (layoutChange || hazard) {
+					Barrier barrier{};
+					barrier.resource = access.resource;
+					barrier.oldLayout = state.layout;
+					barrier.newLayout = access.layout;
+					barrier.srcAccessMask = state.writeAccessMask;
+					barrier.dstAccessMask = access.accessMask;
+					if (!resources[access.resource].imported && firstBarriers[access.resource].pass == invalidHandle) {
+						firstBarriers[access.resource] = { i, pass.barriers.size() };
+					}
+					pass.barriers.push_back(barrier);
+					pass.srcStageMask |= state.writeStageMask | state.readStageMask;
+					pass.dstStageMask |= access.stageMask;
+				} else {
+					statistics.elidedBarrierCount++;
+				}
+				state.layout = access.layout;
+				if (access.write) {
+					state.writeStageMask = access.stageMask;
+					state.writeAccessMask = access.accessMask & writeAccessMask;
+					state.readStageMask = 0;
+				} else {
+					state.readStageMask |= access.stageMask;
+				}
+			}
+		}
+
+		for (size_t i = 0; i < resources.size(); i++) {
+			resources[i].lastStageMask = states[i].writeStageMask | states[i].readStageMask;
+			resources[i].lastWriteAccessMask = states[i].writeAccessMask;
+		}
+
+		// Wait for the previous frame's accesses to the image itself and to all images sharing its memory
+		for (size_t i = 0; i < resources.size(); i++) {
+			if (firstBarriers[i].pass == invalidHandle) {
+				continue;
+			}
+			Pass& pass = passes[firstBarriers[i].pass];
+			Barrier& barrier = pass.barriers[firstBarriers[i].barrier];
+			for (size_t j = 0; j < resources.size(); j++) {
+				if (j == i || aliases(resources[i], resources[j])) {
+					pass.srcStageMask |= resources[j].lastStageMask;
+					barrier.srcAccessMask |= resources[j].lastWriteAccessMask;
+				}
+			}
+		}
+
+		// Transition imported images to their final layouts
+		finalBarriers.clear();
+		finalSrcStageMask = 0;
+		for (size_t i = 0; i < resources.size(); i++) {
+			const Resource& resource = resources[i];
+			if (!resource.imported || resource.importedImage.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED || resource.importedImage.finalLayout == states[i].layout) {
+				continue;
+			}
+			Barrier barrier{};
+			barrier.resource = static_cast<ResourceHandle>(i);
+			barrier.oldLayout = states[i].layout;
+			barrier.newLayout = resource.importedImage.finalLayout;
+			barrier.srcAccessMask = states[i].writeAccessMask;
+			barrier.dstAccessMask = 0;
+			finalBarriers.push_back(barrier);
+			finalSrcStageMask |= states[i].writeStageMask | states[i].readStageMask;
+		}
+
+		statistics.imageBarrierCount = static_cast<uint32_t>(finalBarriers.size());
+		statistics.pipelineBarrierCount = finalBarriers.empty() ? 0 : 1;
+		for (auto& pass : passes) {
+			statistics.imageBarrierCount += static_cast<uint32_t>(pass.barriers.size());
+			statistics.pipelineBarrierCount += pass.barriers.empty() ? 0 : 1;
+		}
+	}
+
+	void RenderGraph::compile()
+	{
+		assert(device);
+		destroyObjects();
+		statistics = {};
+		cullPasses();
+		computeLifetimes();
+		allocateImages();
+		createRenderPasses();
+		computeBarriers();
+	}
+
+	void RenderGraph::recordBarriers(VkCommandBuffer commandBuffer, const std::vector<Barrier>& barriers, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask) const
+	{
+		if (barriers.empty()) {
+			return;
+		}
+		std::vector<VkImageMemoryBarrier> imageBarriers(barriers.size());
+		for (size_t i = 0; i < barriers.size(); i++) {
+			const Resource& resource = resources[barriers[i].resource];
+			imageBarriers[i] = vks::initializers::imageMemoryBarrier();
+			imageBarriers[i].image = resource.image;
+			imageBarriers[i].oldLayout = barriers[i].oldLayout;
+			imageBarriers[i].newLayout = barriers[i].newLayout;
+			imageBarriers[i].srcAccessMask = barriers[i].srcAccessMask;
+			imageBarriers[i].dstAccessMask = barriers[i].dstAccessMask;
+			imageBarriers[i].subresourceRange = { resource.aspectMask, 0, 1, 0, 1 };
+		}
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			(srcStageMask != 0) ? srcStageMask : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+			dstStageMask,
+			0,
+			0, nullptr,
+			0, nullptr,
+			static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+	}
+
+	VkFramebuffer RenderGraph::getFramebuffer(Pass& pass)
+	{
+		std::vector<VkImageView> views;
+		for (auto& attachment : pass.colorAttachments) {
+			views.push_back(resources[attachment.resource].view);
+		}
+		if (pass.depthStencilAttachment.resource != invalidHandle) {
+			views.push_back(resources[pass.depthStencilAttachment.resource].view);
+		}
+		auto cached = pass.framebuffers.find(views);
+		if (cached != pass.framebuffers.end()) {
+			return cached->second;
+		}
+		const ResourceHandle first = pass.colorAttachments.empty() ? pass.depthStencilAttachment.resource : pass.colorAttachments[0].resource;
+		const VkExtent2D extent = getExtent(resources[first]);
+		VkFramebufferCreateInfo framebufferCI = vks::initializers::framebufferCreateInfo();
+		framebufferCI.renderPass = pass.renderPass;
+		framebufferCI.attachmentCount = static_cast<uint32_t>(views.size());
+		framebufferCI.pAttachments = views.data();
+		framebufferCI.width = extent.width;
+		framebufferCI.height = extent.height;
+		framebufferCI.layers = 1;
+		VkFramebuffer framebuffer;
+		VK_CHECK_RESULT(vkCreateFramebuffer(device->logicalDevice, &framebufferCI, nullptr, &framebuffer));
+		pass.framebuffers[views] = framebuffer;
+		return framebuffer;
+	}
+
+	void RenderGraph::resetFramebuffers()
+	{
+		for (auto& pass : passes) {
+			for (auto& framebuffer : pass.framebuffers) {
+				vkDestroyFramebuffer(device->logicalDevice, framebuffer.second, nullptr);
+			}
+			pass.framebuffers.clear();
+		}
+	}
+
+	void RenderGraph::execute(VkCommandBuffer commandBuffer)
+	{
+		for (auto& pass : passes) {
+			if (pass.culled) {
+				continue;
+			}
+			vks::debugutils::cmdBeginLabel(commandBuffer, pass.name, glm::vec4(0.5f, 0.76f, 0.34f, 1.0f));
+			recordBarriers(commandBuffer, pass.barriers, pass.srcStageMask, pass.dstStageMask);
+			if (pass.graphics) {
+				std::vector<VkClearValue> clearValues;
+				for (auto& attachment : pass.colorAttachments) {
+					clearValues.push_back(attachment.clearValue);
+				}
+				if (pass.depthStencilAttachment.resource != invalidHandle) {
+					clearValues.push_back(pass.depthStencilAttachment.clearValue);
+				}
+				const ResourceHandle first = pass.colorAttachments.empty() ? pass.depthStencilAttachment.resource : pass.colorAttachments[0].resource;
+				const VkExtent2D extent = getExtent(resources[first]);
+
+				VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+				renderPassBeginInfo.renderPass = pass.renderPass;
+				renderPassBeginInfo.framebuffer = getFramebuffer(pass);
+				renderPassBeginInfo.renderArea.extent = extent;
+				renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+				renderPassBeginInfo.pClearValues = clearValues.data();
+				vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+				VkViewport viewport = vks::initializers::viewport((float)extent.width, (float)extent.height, 0.0f, 1.0f);
+				vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+				VkRect2D scissor = vks::initializers::rect2D(extent.width, extent.height, 0, 0);
+				vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+				pass.execute(commandBuffer);
+				vkCmdEndRenderPass(commandBuffer);
+			} else {
+				pass.execute(commandBuffer);
+			}
+			vks::debugutils::cmdEndLabel(commandBuffer);
+		}
+		recordBarriers(commandBuffer, finalBarriers, finalSrcStageMask, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+	}
+
+	VkRenderPass RenderGraph::getRenderPass(PassHandle pass) const
+	{
+		return passes[pass].renderPass;
+	}
+
+	VkImageView RenderGraph::getImageView(ResourceHandle resource) const
+	{
+		return resources[resource].view;
+	}
+
+	bool RenderGraph::isCulled(PassHandle pass) const
+	{
+		return passes[pass].culled;
+	}
+
+	VkFormat RenderGraph::getFormat(const Resource& resource) const
+	{
+		return resource.imported ? resource.importedImage.format : resource.desc.format;
+	}
+
+	VkExtent2D RenderGraph::getExtent(const Resource& resource) const
+	{
+		if (resource.imported) {
+			return { resource.importedImage.width, resource.importedImage.height };
+		}
+		return { resource.desc.width, resource.desc.height };
+	}
+}
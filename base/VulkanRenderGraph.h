@@ -0,0 +1,222 @@
+/*
+* Vulkan render graph with automatic barriers and transient attachment aliasing
+*
+* Passes declare the images they write as attachments (or storage images) and the images they read, and record their commands
+* in a callback. Compiling the graph then
+* - culls passes whose results are never read by a later pass or written to an imported image,
+* - computes the lifetime (first and last pass) of every transient image,
+* - places transient images with disjoint lifetimes at overlapping offsets of shared memory heaps,
+* - creates a render pass per graphics pass with store ops that discard attachments nobody reads afterwards,
+* - derives the image barriers between passes from the declared accesses, batched into one vkCmdPipelineBarrier per pass.
+* Transient images only live for the duration of a frame, their contents are undefined at the start of the next one.
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	class RenderGraph
+	{
+	public:
+		typedef uint32_t ResourceHandle;
+		typedef uint32_t PassHandle;
+		static const uint32_t invalidHandle = ~0u;
+
+		// Description of an image owned by the graph
+		struct ImageDesc {
+			VkFormat format{ VK_FORMAT_UNDEFINED };
+			uint32_t width{ 0 };
+			uint32_t height{ 0 };
+			// Usage in addition to the usage derived from the passes
+			VkImageUsageFlags usage{ 0 };
+		};
+
+		// Image owned by the application, e.g. a swap chain image
+		struct ImportedImage {
+			VkImage image{ VK_NULL_HANDLE };
+			VkImageView view{ VK_NULL_HANDLE };
+			VkFormat format{ VK_FORMAT_UNDEFINED };
+			uint32_t width{ 0 };
+			uint32_t height{ 0 };
+			// State of the image when the graph starts executing, the stage and access masks have to cover the last
+			// access before the graph (or the stage a semaphore wait is done at)
+			VkImageLayout initialLayout{ VK_IMAGE_LAYOUT_UNDEFINED };
+			VkPipelineStageFlags initialStageMask{ VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT };
+			VkAccessFlags initialAccessMask{ 0 };
+			// Layout the image is transitioned to after the last pass, undefined leaves it in the layout of its last access
+			VkImageLayout finalLayout{ VK_IMAGE_LAYOUT_UNDEFINED };
+		};
+
+		struct Settings {
+			// Let transient images with disjoint lifetimes share memory
+			bool aliasing{ true };
+			// Skip passes that don't contribute to an imported image
+			bool culling{ true };
+		} settings;
+
+		struct Statistics {
+			uint32_t passCount{ 0 };
+			uint32_t culledPassCount{ 0 };
+			uint32_t transientImageCount{ 0 };
+			uint32_t heapCount{ 0 };
+			// Memory of the transient images with and without aliasing in bytes
+			VkDeviceSize transientMemory{ 0 };
+			VkDeviceSize transientMemoryUnaliased{ 0 };
+			// Per execution of the graph
+			uint32_t imageBarrierCount{ 0 };
+			uint32_t pipelineBarrierCount{ 0 };
+			// Accesses that didn't need a barrier as the image already was in the required state
+			uint32_t elidedBarrierCount{ 0 };
+		} statistics;
+
+		void create(vks::VulkanDevice* device);
+		/** @brief Destroy all Vulkan objects and remove all passes and resources */
+		void destroy();
+		/** @brief Remove all passes and resources (and destroy the objects created by compile) to declare a new graph */
+		void clear();
+
+		/** @brief Declare an image that's created (and aliased) by the graph, it's only allocated if a pass that isn't culled accesses it */
+		ResourceHandle createImage(const std::string& name, const ImageDesc& desc);
+		/** @brief Declare an image owned by the application, writes to imported images are the outputs of the graph */
+		ResourceHandle importImage(const std::string& name, const ImportedImage& image);
+		/** @brief Change the image backing an imported resource, e.g. to the current swap chain image before recording */
+		void updateImportedImage(ResourceHandle resource, VkImage image, VkImageView view, uint32_t width, uint32_t height);
+
+		/**
+		* Add a pass that renders to its attachments inside a render pass created by the graph
+		* The viewport and scissor are set to the attachment size before the callback is invoked
+		*
+		* @param name Name of the pass, used for debug labels
+		* @param execute Callback recording the pass' commands
+		*/
+		PassHandle addGraphicsPass(const std::string& name, std::function<void(VkCommandBuffer)> execute);
+		/** @brief Add a pass that records its commands outside of a render pass, e.g. compute dispatches */
+		PassHandle addComputePass(const std::string& name, std::function<void(VkCommandBuffer)> execute);
+
+		// Accesses of a pass, attachments are bound in the order they are added
+		void addColorAttachment(PassHandle pass, ResourceHandle resource, VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR, VkClearColorValue clearValue = {});
+		void setDepthStencilAttachment(PassHandle pass, ResourceHandle resource, VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR, VkClearDepthStencilValue clearValue = { 1.0f, 0 });
+		void addSampledImage(PassHandle pass, ResourceHandle resource, VkPipelineStageFlags stageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+		void addStorageImage(PassHandle pass, ResourceHandle resource, bool write, VkPipelineStageFlags stageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		/** @brief Mark a pass as having effects outside of the graph (e.g. writing buffers), so it's never culled */
+		void setSideEffects(PassHandle pass);
+
+		/** @brief Cull passes, allocate the transient images and create the render passes and barriers, the device must not use a previously compiled graph */
+		void compile();
+		/** @brief Record all passes that haven't been culled, must be recorded outside of a render pass */
+		void execute(VkCommandBuffer commandBuffer);
+		/** @brief Destroy the cached framebuffers, has to be called when imported images are destroyed (e.g. on resize) */
+		void resetFramebuffers();
+
+		/** @brief Render pass of a graphics pass for pipeline creation, also valid for culled passes */
+		VkRenderPass getRenderPass(PassHandle pass) const;
+		/** @brief View of an image, null for transient images that haven't been allocated */
+		VkImageView getImageView(ResourceHandle resource) const;
+		bool isCulled(PassHandle pass) const;
+
+	private:
+		struct Access {
+			ResourceHandle resource;
+			VkImageLayout layout;
+			VkPipelineStageFlags stageMask;
+			VkAccessFlags accessMask;
+			VkImageUsageFlags usage;
+			bool read;
+			bool write;
+		};
+
+		struct Attachment {
+			ResourceHandle resource{ invalidHandle };
+			VkAttachmentLoadOp loadOp{ VK_ATTACHMENT_LOAD_OP_DONT_CARE };
+			VkClearValue clearValue{};
+		};
+
+		struct Barrier {
+			ResourceHandle resource;
+			VkImageLayout oldLayout;
+			VkImageLayout newLayout;
+			VkAccessFlags srcAccessMask;
+			VkAccessFlags dstAccessMask;
+		};
+
+		struct Pass {
+			std::string name;
+			bool graphics{ false };
+			bool sideEffects{ false };
+			bool culled{ false };
+			std::function<void(VkCommandBuffer)> execute;
+			std::vector<Attachment> colorAttachments;
+			Attachment depthStencilAttachment{};
+			std::vector<Access> accesses;
+			VkRenderPass renderPass{ VK_NULL_HANDLE };
+			// Framebuffers by attachment views, imported images may change between executions
+			std::map<std::vector<VkImageView>, VkFramebuffer> framebuffers;
+			// Barriers recorded before the pass
+			std::vector<Barrier> barriers;
+			VkPipelineStageFlags srcStageMask{ 0 };
+			VkPipelineStageFlags dstStageMask{ 0 };
+		};
+
+		struct Resource {
+			std::string name;
+			bool imported{ false };
+			ImageDesc desc{};
+			ImportedImage importedImage{};
+			VkImage image{ VK_NULL_HANDLE };
+			VkImageView view{ VK_NULL_HANDLE };
+			VkImageAspectFlags aspectMask{ 0 };
+			// Lifetime as indices into the pass list, invalid if no pass that isn't culled accesses the image
+			uint32_t firstPass{ invalidHandle };
+			uint32_t lastPass{ invalidHandle };
+			// Placement in the memory heaps
+			VkMemoryRequirements memoryRequirements{};
+			uint32_t heap{ invalidHandle };
+			VkDeviceSize offset{ 0 };
+			// Stages and writes of the last accesses in a frame, the first barrier of the next frame (or of an image aliasing
+			// the same memory) has to wait for them
+			VkPipelineStageFlags lastStageMask{ 0 };
+			VkAccessFlags lastWriteAccessMask{ 0 };
+		};
+
+		struct Heap {
+			uint32_t memoryTypeIndex{ 0 };
+			VkDeviceSize size{ 0 };
+			VkDeviceMemory memory{ VK_NULL_HANDLE };
+		};
+
+		vks::VulkanDevice* device{ nullptr };
+		std::vector<Pass> passes;
+		std::vector<Resource> resources;
+		std::vector<Heap> heaps;
+		// Transitions of imported images to their final layouts after the last pass
+		std::vector<Barrier> finalBarriers;
+		VkPipelineStageFlags finalSrcStageMask{ 0 };
+
+		PassHandle addPass(const std::string& name, bool graphics, std::function<void(VkCommandBuffer)> execute);
+		void addAccess(PassHandle pass, const Access& access);
+		void cullPasses();
+		void computeLifetimes();
+		void allocateImages();
+		void createRenderPasses();
+		void computeBarriers();
+		void recordBarriers(VkCommandBuffer commandBuffer, const std::vector<Barrier>& barriers, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask) const;
+		VkFramebuffer getFramebuffer(Pass& pass);
+		VkFormat getFormat(const Resource& resource) const;
+		VkExtent2D getExtent(const Resource& resource) const;
+		bool aliases(const Resource& a, const Resource& b) const;
+		void destroyObjects();
+	};
+}
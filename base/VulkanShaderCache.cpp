@@ -0,0 +1,350 @@
+/*
+* Vulkan shader module cache
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanShaderCache.h"
+
+#include <chrono>
+#include <filesystem>
+
+#if !defined(_WIN32) && !defined(VK_USE_PLATFORM_ANDROID_KHR)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace vks
+{
+	// Pack file layout: header, entry table (each entry followed by its path), SPIR-V data at 8 byte aligned offsets
+	static const uint32_t packMagic = 0x4b565053; // "SPVK"
+	static const uint32_t packVersion = 1;
+
+	struct PackHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t entryCount;
+		uint32_t reserved;
+	};
+
+	struct PackEntryHeader {
+		uint64_t fileTime;
+		uint64_t hash;
+		uint64_t offset;
+		uint32_t size;
+		uint32_t pathLength;
+	};
+
+	// 64-bit FNV-1a hash
+	static uint64_t fnv1a(const void* data, size_t size)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++) {
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+		}
+		return hash;
+	}
+
+	static size_t align8(size_t value)
+	{
+		return (value + 7) & ~size_t(7);
+	}
+
+	void ShaderModuleCache::create(VkDevice device, const std::string& name)
+	{
+		this->device = device;
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+		// Shaders are read from the (already compressed) apk assets
+		usePack = false;
+#endif
+		if (usePack) {
+			packFile = (std::filesystem::path(packDirectory) / (name + ".spvpack")).string();
+			mapPack();
+		}
+	}
+
+	void ShaderModuleCache::destroy()
+	{
+		if (device == VK_NULL_HANDLE) {
+			return;
+		}
+		if (usePack && packOutdated) {
+			writePack();
+		}
+		for (auto& [fileName, module] : modules) {
+			if (module.owner) {
+				vkDestroyShaderModule(device, module.module, nullptr);
+			}
+		}
+		modules.clear();
+		contentLookup.clear();
+		packEntries.clear();
+		unmapPack();
+		device = VK_NULL_HANDLE;
+	}
+
+	VkShaderModule ShaderModuleCache::get(const std::string& fileName, bool* created)
+	{
+		assert(device != VK_NULL_HANDLE);
+		statistics.requests++;
+		if (created) {
+			*created = false;
+		}
+
+		auto cached = modules.find(fileName);
+		if (cached != modules.end()) {
+			return cached->second.module;
+		}
+
+		auto tStart = std::chrono::high_resolution_clock::now();
+		Module module{};
+		bool packed = false;
+#if !defined(VK_USE_PLATFORM_ANDROID_KHR)
+		// Checking the time stamp is much cheaper than reading the file, so an up-to-date pack entry is used as is
+		auto packEntry = packEntries.find(fileName);
+		if (packEntry != packEntries.end()) {
+			std::error_code errorCode;
+			const auto writeTime = std::filesystem::last_write_time(fileName, errorCode);
+			if (!errorCode && static_cast<uint64_t>(writeTime.time_since_epoch().count()) == packEntry->second.fileTime) {
+				module.fileTime = packEntry->second.fileTime;
+				module.hash = packEntry->second.hash;
+				module.data = packEntry->second.data;
+				module.size = packEntry->second.size;
+				packed = true;
+			}
+		}
+#endif
+		if (!packed) {
+			if (!readFile(fileName, module.code, module.fileTime)) {
+				std::cerr << "Error: Could not open shader file \"" << fileName << "\"" << "\n";
+				return VK_NULL_HANDLE;
+			}
+			module.data = module.code.data();
+			module.size = module.code.size() * sizeof(uint32_t);
+			module.hash = fnv1a(module.data, module.size);
+			packOutdated = true;
+		}
+		statistics.readTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+
+		// Identical SPIR-V loaded from a different path shares the existing module
+		auto range = contentLookup.equal_range(module.hash);
+		for (auto it = range.first; it != range.second; it++) {
+			const Module& other = modules.at(it->second);
+			if (other.size == module.size && memcmp(other.data, module.data, module.size) == 0) {
+				module.module = other.module;
+				break;
+			}
+		}
+
+		if (module.module == VK_NULL_HANDLE) {
+			tStart = std::chrono::high_resolution_clock::now();
+			VkShaderModuleCreateInfo moduleCreateInfo{};
+			moduleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+			moduleCreateInfo.codeSize = module.size;
+			moduleCreateInfo.pCode = module.data;
+			VK_CHECK_RESULT(vkCreateShaderModule(device, &moduleCreateInfo, nullptr, &module.module));
+			statistics.moduleCreationTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+			statistics.modules++;
+			if (packed) {
+				statistics.packedModules++;
+			}
+			module.owner = true;
+			if (created) {
+				*created = true;
+			}
+		}
+
+		const VkShaderModule shaderModule = module.module;
+		contentLookup.emplace(module.hash, fileName);
+		// Moving the module doesn't invalidate data, as it points into either the mapping or the heap storage of code
+		modules.emplace(fileName, std::move(module));
+		return shaderModule;
+	}
+
+	bool ShaderModuleCache::mapPack()
+	{
+#if defined(_WIN32)
+		fileHandle = CreateFileA(packFile.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (fileHandle == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(sizeof(PackHeader))) {
+			unmapPack();
+			return false;
+		}
+		mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mappingHandle) {
+			unmapPack();
+			return false;
+		}
+		mappedData = static_cast<const uint8_t*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+		mappedSize = static_cast<size_t>(fileSize.QuadPart);
+#elif !defined(VK_USE_PLATFORM_ANDROID_KHR)
+		int fd = open(packFile.c_str(), O_RDONLY);
+		if (fd == -1) {
+			return false;
+		}
+		struct stat fileStat;
+		if (fstat(fd, &fileStat) != 0 || fileStat.st_size < static_cast<off_t>(sizeof(PackHeader))) {
+			close(fd);
+			return false;
+		}
+		void* mapping = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		// The mapping stays valid after closing the descriptor
+		close(fd);
+		if (mapping == MAP_FAILED) {
+			return false;
+		}
+		mappedData = static_cast<const uint8_t*>(mapping);
+		mappedSize = static_cast<size_t>(fileStat.st_size);
+#endif
+		if (!mappedData) {
+			unmapPack();
+			return false;
+		}
+
+		PackHeader header;
+		memcpy(&header, mappedData, sizeof(PackHeader));
+		if (header.magic != packMagic || header.version != packVersion) {
+			unmapPack();
+			return false;
+		}
+		size_t offset = sizeof(PackHeader);
+		for (uint32_t i = 0; i < header.entryCount; i++) {
+			PackEntryHeader entryHeader;
+			if (offset + sizeof(PackEntryHeader) > mappedSize) {
+				break;
+			}
+			memcpy(&entryHeader, mappedData + offset, sizeof(PackEntryHeader));
+			offset += sizeof(PackEntryHeader);
+			if ((offset + entryHeader.pathLength > mappedSize) || (entryHeader.offset + entryHeader.size > mappedSize) || (entryHeader.offset % 8 != 0)) {
+				break;
+			}
+			const std::string path(reinterpret_cast<const char*>(mappedData + offset), entryHeader.pathLength);
+			offset = align8(offset + entryHeader.pathLength);
+			// The mapping is page aligned, so data at 8 byte aligned offsets can be passed to the driver as is
+			packEntries[path] = { entryHeader.fileTime, entryHeader.hash, reinterpret_cast<const uint32_t*>(mappedData + entryHeader.offset), entryHeader.size };
+		}
+		return true;
+	}
+
+	void ShaderModuleCache::unmapPack()
+	{
+#if defined(_WIN32)
+		if (mappedData) {
+			UnmapViewOfFile(mappedData);
+		}
+		if (mappingHandle) {
+			CloseHandle(mappingHandle);
+			mappingHandle = nullptr;
+		}
+		if (fileHandle != INVALID_HANDLE_VALUE) {
+			CloseHandle(fileHandle);
+			fileHandle = INVALID_HANDLE_VALUE;
+		}
+#elif !defined(VK_USE_PLATFORM_ANDROID_KHR)
+		if (mappedData) {
+			munmap(const_cast<uint8_t*>(mappedData), mappedSize);
+		}
+#endif
+		mappedData = nullptr;
+		mappedSize = 0;
+	}
+
+	void ShaderModuleCache::writePack()
+	{
+		struct Entry {
+			const std::string* path;
+			uint64_t fileTime;
+			uint64_t hash;
+			const uint32_t* data;
+			size_t size;
+		};
+		std::vector<Entry> entries;
+		for (auto& [fileName, module] : modules) {
+			entries.push_back({ &fileName, module.fileTime, module.hash, module.data, module.size });
+		}
+		// Keep entries for shaders that weren't loaded during this run (e.g. only used by optional features)
+		for (auto& [fileName, packEntry] : packEntries) {
+			if (modules.find(fileName) == modules.end()) {
+				entries.push_back({ &fileName, packEntry.fileTime, packEntry.hash, packEntry.data, packEntry.size });
+			}
+		}
+
+		size_t dataOffset = sizeof(PackHeader);
+		for (auto& entry : entries) {
+			dataOffset = align8(dataOffset + sizeof(PackEntryHeader) + entry.path->size());
+		}
+
+		std::error_code errorCode;
+		std::filesystem::create_directories(packDirectory, errorCode);
+		// The pack may still be mapped, so the new one is written to a temporary file and moved in place once the mapping is released
+		const std::string tempFile = packFile + ".tmp";
+		std::ofstream os(tempFile, std::ios::binary | std::ios::trunc);
+		if (!os.is_open()) {
+			std::cerr << "Could not write shader pack \"" << packFile << "\"\n";
+			return;
+		}
+		const uint64_t padding = 0;
+		const PackHeader header{ packMagic, packVersion, static_cast<uint32_t>(entries.size()), 0 };
+		os.write(reinterpret_cast<const char*>(&header), sizeof(PackHeader));
+		size_t offset = sizeof(PackHeader);
+		for (auto& entry : entries) {
+			const PackEntryHeader entryHeader{ entry.fileTime, entry.hash, dataOffset, static_cast<uint32_t>(entry.size), static_cast<uint32_t>(entry.path->size()) };
+			os.write(reinterpret_cast<const char*>(&entryHeader), sizeof(PackEntryHeader));
+			os.write(entry.path->data(), entry.path->size());
+			const size_t end = offset + sizeof(PackEntryHeader) + entry.path->size();
+			os.write(reinterpret_cast<const char*>(&padding), align8(end) - end);
+			offset = align8(end);
+			dataOffset = align8(dataOffset + entry.size);
+		}
+		for (auto& entry : entries) {
+			os.write(reinterpret_cast<const char*>(entry.data), entry.size);
+			os.write(reinterpret_cast<const char*>(&padding), align8(entry.size) - entry.size);
+		}
+		os.close();
+
+		unmapPack();
+		packEntries.clear();
+		std::filesystem::rename(tempFile, packFile, errorCode);
+		if (errorCode) {
+			std::cerr << "Could not write shader pack \"" << packFile << "\": " << errorCode.message() << "\n";
+		}
+	}
+
+	bool ShaderModuleCache::readFile(const std::string& fileName, std::vector<uint32_t>& code, uint64_t& fileTime)
+	{
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+		AAsset* asset = AAssetManager_open(assetManager, fileName.c_str(), AASSET_MODE_STREAMING);
+		if (!asset) {
+			return false;
+		}
+		size_t size = AAsset_getLength(asset);
+		code.resize((size + 3) / 4);
+		AAsset_read(asset, code.data(), size);
+		AAsset_close(asset);
+		fileTime = 0;
+#else
+		std::ifstream is(fileName, std::ios::binary | std::ios::in | std::ios::ate);
+		if (!is.is_open()) {
+			return false;
+		}
+		size_t size = is.tellg();
+		is.seekg(0, std::ios::beg);
+		// SPIR-V is a stream of 32-bit words, reading into a word vector gives the alignment the driver expects
+		code.resize((size + 3) / 4);
+		is.read(reinterpret_cast<char*>(code.data()), size);
+		is.close();
+		std::error_code errorCode;
+		const auto writeTime = std::filesystem::last_write_time(fileName, errorCode);
+		fileTime = errorCode ? 0 : static_cast<uint64_t>(writeTime.time_since_epoch().count());
+#endif
+		return size > 0;
+	}
+}
@@ -0,0 +1,107 @@
+/*
+* Vulkan shader module cache
+*
+* Shader modules are created once per file and content, so loading the same shader for several pipelines returns the same module
+* Optionally the SPIR-V of all shaders used by an example is stored in a single pack file that is memory mapped on the next start,
+* so modules are created directly from the mapping instead of opening and reading every single file
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	class ShaderModuleCache
+	{
+	public:
+		struct Statistics {
+			// Number of loadShader calls
+			uint32_t requests{ 0 };
+			// Number of unique modules that have actually been created
+			uint32_t modules{ 0 };
+			// Number of modules whose SPIR-V was taken from the pack file
+			uint32_t packedModules{ 0 };
+			double readTime{ 0.0 };
+			double moduleCreationTime{ 0.0 };
+		} statistics;
+
+		// Pack files are stored in (and loaded from) this directory, relative to the working directory
+		std::string packDirectory{ "cache/shaders" };
+		// Writing the pack is opt-in (e.g. via --shaderpack), as it creates files outside of the build and asset directories
+		bool usePack{ false };
+
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+		AAssetManager* assetManager{ nullptr };
+#endif
+
+		/**
+		* Set up the cache and map the pack file for an example (if one exists)
+		*
+		* @param device Logical device the modules are created on
+		* @param name Name of the example, used as the pack file name
+		*/
+		void create(VkDevice device, const std::string& name);
+		/** @brief Destroy all modules and (re)write the pack file if shaders had to be loaded from their files */
+		void destroy();
+
+		/**
+		* Get the shader module for a SPIR-V file, the module is only created on the first request for a file (or content)
+		*
+		* @param fileName Path of the SPIR-V file
+		* @param created Optional, set to true if the module was newly created by this call
+		*
+		* @return Shader module owned by the cache, VK_NULL_HANDLE if the file could not be loaded
+		*/
+		VkShaderModule get(const std::string& fileName, bool* created = nullptr);
+
+	private:
+		struct Module {
+			uint64_t hash{ 0 };
+			uint64_t fileTime{ 0 };
+			VkShaderModule module{ VK_NULL_HANDLE };
+			// Modules shared with another path with identical content are only destroyed by their owner
+			bool owner{ false };
+			// Points either into the mapped pack or into code
+			const uint32_t* data{ nullptr };
+			size_t size{ 0 };
+			std::vector<uint32_t> code;
+		};
+		struct PackEntry {
+			uint64_t fileTime;
+			uint64_t hash;
+			const uint32_t* data;
+			size_t size;
+		};
+
+		VkDevice device{ VK_NULL_HANDLE };
+		std::string packFile;
+		// Modules by file name, and file names by content hash so identical shaders at different paths share a module
+		std::unordered_map<std::string, Module> modules;
+		std::unordered_multimap<uint64_t, std::string> contentLookup;
+		std::unordered_map<std::string, PackEntry> packEntries;
+		// Set when a shader had to be loaded from its file, the pack is rewritten on destruction
+		bool packOutdated{ false };
+
+		const uint8_t* mappedData{ nullptr };
+		size_t mappedSize{ 0 };
+#if defined(_WIN32)
+		HANDLE fileHandle{ INVALID_HANDLE_VALUE };
+		HANDLE mappingHandle{ nullptr };
+#endif
+
+		bool mapPack();
+		void unmapPack();
+		void writePack();
+		bool readFile(const std::string& fileName, std::vector<uint32_t>& code, uint64_t& fileTime);
+	};
+}
@@ -201,6 +201,84 @@ void VulkanSwapChain::initSurface(screen_context_t screen_context, screen_window
 	colorSpace = selectedFormat.colorSpace;
 }
 
+void VulkanSwapChain::initHeadless(VkQueue queue, uint32_t queueFamilyIndex)
+{
+	headless = true;
+	headlessQueue = queue;
+	queueNodeIndex = queueFamilyIndex;
+	// Use the format most commonly returned for window surfaces, so render passes and pipelines match the windowed path
+	colorFormat = VK_FORMAT_B8G8R8A8_UNORM;
+	colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+}
+
+void VulkanSwapChain::createHeadlessImages(uint32_t width, uint32_t height)
+{
+	destroyHeadlessImages();
+
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+	// Same image count a surface would typically return (minImageCount + 1)
+	imageCount = 3;
+	images.resize(imageCount);
+	imageViews.resize(imageCount);
+	headlessMemory.resize(imageCount);
+	headlessImageIndex = imageCount - 1;
+	for (uint32_t i = 0; i < imageCount; i++)
+	{
+		VkImageCreateInfo imageCI{};
+		imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageCI.imageType = VK_IMAGE_TYPE_2D;
+		imageCI.format = colorFormat;
+		imageCI.extent = { width, height, 1 };
+		imageCI.mipLevels = 1;
+		imageCI.arrayLayers = 1;
+		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &images[i]));
+
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device, images[i], &memReqs);
+		VkMemoryAllocateInfo memAllocInfo{};
+		memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		memAllocInfo.allocationSize = memReqs.size;
+		memAllocInfo.memoryTypeIndex = UINT32_MAX;
+		for (uint32_t j = 0; j < memoryProperties.memoryTypeCount; j++) {
+			if ((memReqs.memoryTypeBits & (1 << j)) && (memoryProperties.memoryTypes[j].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+				memAllocInfo.memoryTypeIndex = j;
+				break;
+			}
+		}
+		if (memAllocInfo.memoryTypeIndex == UINT32_MAX) {
+			vks::tools::exitFatal("Could not find a memory type for the headless swapchain images!", -1);
+		}
+		VK_CHECK_RESULT(vkAllocateMemory(device, &memAllocInfo, nullptr, &headlessMemory[i]));
+		VK_CHECK_RESULT(vkBindImageMemory(device, images[i], headlessMemory[i], 0));
+
+		VkImageViewCreateInfo colorAttachmentView{};
+		colorAttachmentView.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		colorAttachmentView.format = colorFormat;
+		colorAttachmentView.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		colorAttachmentView.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		colorAttachmentView.image = images[i];
+		VK_CHECK_RESULT(vkCreateImageView(device, &colorAttachmentView, nullptr, &imageViews[i]));
+	}
+}
+
+void VulkanSwapChain::destroyHeadlessImages()
+{
+	for (size_t i = 0; i < headlessMemory.size(); i++) {
+		vkDestroyImageView(device, imageViews[i], nullptr);
+		vkDestroyImage(device, images[i], nullptr);
+		vkFreeMemory(device, headlessMemory[i], nullptr);
+	}
+	headlessMemory.clear();
+	images.clear();
+	imageViews.clear();
+}
+
 void VulkanSwapChain::setContext(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice device)
 {
 	this->instance = instance;
@@ -214,6 +292,11 @@ void VulkanSwapChain::create(uint32_t& width, uint32_t& height, bool vsync, bool
 	assert(device);
 	assert(instance);
 
+	if (headless) {
+		createHeadlessImages(width, height);
+		return;
+	}
+
 	// Store the current swap chain handle so we can use it later on to ease up recreation
 	VkSwapchainKHR oldSwapchain = swapChain;
 
@@ -375,6 +458,17 @@ void VulkanSwapChain::create(uint32_t& width, uint32_t& height, bool vsync, bool
 
 VkResult VulkanSwapChain::acquireNextImage(VkSemaphore presentCompleteSemaphore, uint32_t& imageIndex)
 {
+	if (headless) {
+		// Offscreen images are simply cycled, the semaphore is signaled with an empty submission so callers can wait on it as usual
+		imageIndex = headlessImageIndex = (headlessImageIndex + 1) % imageCount;
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		if (presentCompleteSemaphore != VK_NULL_HANDLE) {
+			submitInfo.signalSemaphoreCount = 1;
+			submitInfo.pSignalSemaphores = &presentCompleteSemaphore;
+		}
+		return vkQueueSubmit(headlessQueue, 1, &submitInfo, VK_NULL_HANDLE);
+	}
 	// By setting timeout to UINT64_MAX we will always wait until the next image has been acquired or an actual error is thrown
 	// With that we don't have to handle VK_NOT_READY
 	return vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, presentCompleteSemaphore, (VkFence)nullptr, &imageIndex);
@@ -382,6 +476,19 @@ VkResult VulkanSwapChain::acquireNextImage(VkSemaphore presentCompleteSemaphore,
 
 VkResult VulkanSwapChain::queuePresent(VkQueue queue, uint32_t imageIndex, VkSemaphore waitSemaphore)
 {
+	if (headless) {
+		// Nothing is presented, but the wait semaphore still needs to be unsignaled before it's signaled again by the next frame
+		if (waitSemaphore == VK_NULL_HANDLE) {
+			return VK_SUCCESS;
+		}
+		VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.waitSemaphoreCount = 1;
+		submitInfo.pWaitSemaphores = &waitSemaphore;
+		submitInfo.pWaitDstStageMask = &waitStageMask;
+		return vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+	}
 	VkPresentInfoKHR presentInfo = {};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 	presentInfo.pNext = NULL;
@@ -400,6 +507,10 @@ VkResult VulkanSwapChain::queuePresent(VkQueue queue, uint32_t imageIndex, VkSem
 
 void VulkanSwapChain::cleanup()
 {
+	if (headless) {
+		destroyHeadlessImages();
+		return;
+	}
 	if (swapChain != VK_NULL_HANDLE) {
 		for (auto i = 0; i < images.size(); i++) {
 			vkDestroyImageView(device, imageViews[i], nullptr);
@@ -34,6 +34,13 @@ private:
 	VkDevice device{ VK_NULL_HANDLE };
 	VkPhysicalDevice physicalDevice{ VK_NULL_HANDLE };
 	VkSurfaceKHR surface{ VK_NULL_HANDLE };
+	// Offscreen images used in place of presentable images when running headless
+	bool headless{ false };
+	VkQueue headlessQueue{ VK_NULL_HANDLE };
+	std::vector<VkDeviceMemory> headlessMemory{};
+	uint32_t headlessImageIndex{ 0 };
+	void createHeadlessImages(uint32_t width, uint32_t height);
+	void destroyHeadlessImages();
 public:
 	VkFormat colorFormat{};
 	VkColorSpaceKHR colorSpace{};
@@ -65,6 +72,15 @@ public:
 #elif defined(VK_USE_PLATFORM_SCREEN_QNX)
 	void initSurface(screen_context_t screen_context, screen_window_t screen_window);
 #endif
+	/**
+	* Use offscreen images instead of a surface backed swapchain (no window and no presentation)
+	*
+	* @param queue Queue used to signal and wait on the semaphores passed to acquireNextImage and queuePresent
+	* @param queueFamilyIndex Queue family index of the queue
+	*/
+	void initHeadless(VkQueue queue, uint32_t queueFamilyIndex);
+	/* Returns true if the swapchain renders to offscreen images */
+	bool isHeadless() const { return headless; }
 	/* Set the Vulkan objects required for swapchain creation and management, must be called before swapchain creation */
 	void setContext(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice device);
 	/**
@@ -0,0 +1,623 @@
+/*
+* Quadtree terrain with streamed chunks
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanTerrainQuadtree.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TERRAIN_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define TERRAIN_NEON
+#endif
+
+namespace vks
+{
+	/*
+		Height sources
+	*/
+
+	MemoryHeightSource::MemoryHeightSource(std::vector<uint16_t>&& data, uint32_t dim) : data(std::move(data)), dim(dim)
+	{
+		assert(this->data.size() == (size_t)dim * dim);
+	}
+
+	uint32_t MemoryHeightSource::size() const
+	{
+		return dim;
+	}
+
+	void MemoryHeightSource::read(int32_t x, int32_t y, uint32_t step, uint32_t countX, uint32_t countY, uint16_t* dst)
+	{
+		const int32_t last = (int32_t)dim - 1;
+		for (uint32_t row = 0; row < countY; row++) {
+			const int32_t sy = std::clamp(y + (int32_t)(row * step), 0, last);
+			const uint16_t* src = &data[(size_t)sy * dim];
+			for (uint32_t column = 0; column < countX; column++) {
+				*dst++ = src[std::clamp(x + (int32_t)(column * step), 0, last)];
+			}
+		}
+	}
+
+	FileHeightSource::FileHeightSource(const std::string& fileName)
+	{
+		file.open(fileName, std::ios::binary | std::ios::ate);
+		if (!file.is_open()) {
+			return;
+		}
+		const size_t fileSize = (size_t)file.tellg();
+		const uint32_t size = (uint32_t)std::sqrt((double)(fileSize / sizeof(uint16_t)));
+		if ((size >= 2) && ((size_t)size * size * sizeof(uint16_t) == fileSize)) {
+			dim = size;
+		}
+	}
+
+	bool FileHeightSource::valid() const
+	{
+		return dim > 0;
+	}
+
+	uint32_t FileHeightSource::size() const
+	{
+		return dim;
+	}
+
+	void FileHeightSource::read(int32_t x, int32_t y, uint32_t step, uint32_t countX, uint32_t countY, uint16_t* dst)
+	{
+		// Each row is read with a single read covering all requested samples, samples are stored as little endian
+		const int32_t last = (int32_t)dim - 1;
+		const int32_t first = std::clamp(x, 0, last);
+		const int32_t span = std::clamp(x + (int32_t)((countX - 1) * step), 0, last) - first + 1;
+		std::vector<uint16_t> row(span);
+		std::lock_guard<std::mutex> lock(fileMutex);
+		for (uint32_t r = 0; r < countY; r++) {
+			const int32_t sy = std::clamp(y + (int32_t)(r * step), 0, last);
+			file.seekg(((std::streamoff)sy * dim + first) * sizeof(uint16_t));
+			file.read(reinterpret_cast<char*>(row.data()), span * sizeof(uint16_t));
+			for (uint32_t column = 0; column < countX; column++) {
+				*dst++ = row[std::clamp(x + (int32_t)(column * step), 0, last) - first];
+			}
+		}
+	}
+
+	/*
+		Normal calculation
+	*/
+
+	// Calculate normals for a row of vertices from the heights of the rows above, at and below them using a sobel filter
+	// The rows contain one additional height to the left and right of the vertices
+	static void computeNormalRow(const float* r0, const float* r1, const float* r2, float scale, uint32_t count, float* nx, float* ny, float* nz)
+	{
+		uint32_t i = 0;
+#if defined(TERRAIN_SSE2)
+		const __m128 s = _mm_set1_ps(scale);
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 two = _mm_set1_ps(2.0f);
+		const __m128 quarter = _mm_set1_ps(0.25f);
+		for (; i + 4 <= count; i += 4) {
+			const __m128 a0 = _mm_loadu_ps(r0 + i), b0 = _mm_loadu_ps(r0 + i + 1), c0 = _mm_loadu_ps(r0 + i + 2);
+			const __m128 a1 = _mm_loadu_ps(r1 + i), c1 = _mm_loadu_ps(r1 + i + 2);
+			const __m128 a2 = _mm_loadu_ps(r2 + i), b2 = _mm_loadu_ps(r2 + i + 1), c2 = _mm_loadu_ps(r2 + i + 2);
+			const __m128 gx = _mm_add_ps(_mm_add_ps(_mm_sub_ps(a0, c0), _mm_mul_ps(two, _mm_sub_ps(a1, c1))), _mm_sub_ps(a2, c2));
+			const __m128 gz = _mm_sub_ps(_mm_add_ps(_mm_add_ps(a0, _mm_mul_ps(two, b0)), c0), _mm_add_ps(_mm_add_ps(a2, _mm_mul_ps(two, b2)), c2));
+			__m128 x = _mm_mul_ps(gx, s);
+			__m128 z = _mm_mul_ps(gz, s);
+			const __m128 y = _mm_mul_ps(quarter, _mm_sqrt_ps(_mm_max_ps(_mm_setzero_ps(), _mm_sub_ps(_mm_sub_ps(one, _mm_mul_ps(x, x)), _mm_mul_ps(z, z)))));
+			x = _mm_mul_ps(x, two);
+			z = _mm_mul_ps(z, two);
+			const __m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z))));
+			_mm_storeu_ps(nx + i, _mm_mul_ps(x, invLength));
+			_mm_storeu_ps(ny + i, _mm_mul_ps(y, invLength));
+			_mm_storeu_ps(nz + i, _mm_mul_ps(z, invLength));
+		}
+#elif defined(TERRAIN_NEON)
+		const float32x4_t s = vdupq_n_f32(scale);
+		const float32x4_t one = vdupq_n_f32(1.0f);
+		const float32x4_t two = vdupq_n_f32(2.0f);
+		const float32x4_t quarter = vdupq_n_f32(0.25f);
+		for (; i + 4 <= count; i += 4) {
+			const float32x4_t a0 = vld1q_f32(r0 + i), b0 = vld1q_f32(r0 + i + 1), c0 = vld1q_f32(r0 + i + 2);
+			const float32x4_t a1 = vld1q_f32(r1 + i), c1 = vld1q_f32(r1 + i + 2);
+			const float32x4_t a2 = vld1q_f32(r2 + i), b2 = vld1q_f32(r2 + i + 1), c2 = vld1q_f32(r2 + i + 2);
+			const float32x4_t gx = vaddq_f32(vaddq_f32(vsubq_f32(a0, c0), vmulq_f32(two, vsubq_f32(a1, c1))), vsubq_f32(a2, c2));
+			const float32x4_t gz = vsubq_f32(vaddq_f32(vaddq_f32(a0, vmulq_f32(two, b0)), c0), vaddq_f32(vaddq_f32(a2, vmulq_f32(two, b2)), c2));
+			float32x4_t x = vmulq_f32(gx, s);
+			float32x4_t z = vmulq_f32(gz, s);
+			const float32x4_t y = vmulq_f32(quarter, vsqrtq_f32(vmaxq_f32(vdupq_n_f32(0.0f), vsubq_f32(vsubq_f32(one, vmulq_f32(x, x)), vmulq_f32(z, z)))));
+			x = vmulq_f32(x, two);
+			z = vmulq_f32(z, two);
+			const float32x4_t invLength = vdivq_f32(one, vsqrtq_f32(vaddq_f32(vaddq_f32(vmulq_f32(x, x), vmulq_f32(y, y)), vmulq_f32(z, z))));
+			vst1q_f32(nx + i, vmulq_f32(x, invLength));
+			vst1q_f32(ny + i, vmulq_f32(y, invLength));
+			vst1q_f32(nz + i, vmulq_f32(z, invLength));
+		}
+#endif
+		for (; i < count; i++) {
+			const float gx = (r0[i] - r0[i + 2]) + 2.0f * (r1[i] - r1[i + 2]) + (r2[i] - r2[i + 2]);
+			const float gz = (r0[i] + 2.0f * r0[i + 1] + r0[i + 2]) - (r2[i] + 2.0f * r2[i + 1] + r2[i + 2]);
+			float x = gx * scale;
+			float z = gz * scale;
+			// The missing up component is calculated from the filtered x and z axis, the first value controls the bump strength
+			const float y = 0.25f * std::sqrt(std::max(0.0f, 1.0f - x * x - z * z));
+			x *= 2.0f;
+			z *= 2.0f;
+			const float invLength = 1.0f / std::sqrt(x * x + y * y + z * z);
+			nx[i] = x * invLength;
+			ny[i] = y * invLength;
+			nz[i] = z * invLength;
+		}
+	}
+
+	/*
+		Quadtree
+	*/
+
+	void TerrainQuadtree::create(vks::VulkanDevice* device, VkQueue queue, std::unique_ptr<HeightSource> source)
+	{
+		this->device = device;
+		this->source = std::move(source);
+		dim = this->source->size();
+		assert(dim >= 2);
+
+		// The root covers the whole heightmap, every level below halves the area covered by a chunk
+		levels = 1;
+		while ((chunkQuads << (levels - 1)) < dim - 1) {
+			levels++;
+		}
+		statistics.levels = levels;
+		nodesPerEdge.resize(levels);
+		for (uint32_t level = 0; level < levels; level++) {
+			const uint32_t nodeQuads = chunkQuads << level;
+			nodesPerEdge[level] = (dim - 1 + nodeQuads - 1) / nodeQuads;
+		}
+
+		computeBounds();
+		createIndexBuffer(queue);
+
+		// The vertex pool is written by the host, so prefer memory that is both device local and host visible if the device has it
+		VkMemoryPropertyFlags memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		VkBool32 deviceLocalHostVisible = VK_FALSE;
+		device->getMemoryType(0xffffffff, memoryPropertyFlags | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &deviceLocalHostVisible);
+		if (deviceLocalHostVisible) {
+			memoryPropertyFlags |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		}
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, memoryPropertyFlags, &vertexBuffer, (VkDeviceSize)settings.maxResidentChunks * chunkVertexCount * sizeof(Vertex)));
+		VK_CHECK_RESULT(vertexBuffer.map());
+		freeSlots.resize(settings.maxResidentChunks);
+		for (uint32_t i = 0; i < settings.maxResidentChunks; i++) {
+			freeSlots[i] = settings.maxResidentChunks - 1 - i;
+		}
+
+		// Everything falls back to the root, so it's built right away and never evicted
+		std::vector<Vertex> vertices;
+		buildChunk(levels - 1, 0, 0, vertices);
+		const uint32_t rootSlot = freeSlots.back();
+		freeSlots.pop_back();
+		memcpy(static_cast<Vertex*>(vertexBuffer.mapped) + rootSlot * chunkVertexCount, vertices.data(), chunkVertexCount * sizeof(Vertex));
+		chunks[nodeKey(levels - 1, 0, 0)] = { rootSlot, ChunkState::Ready, 0, levels - 1 };
+
+		stopWorkers = false;
+		const uint32_t workerCount = (settings.workerCount > 0) ? settings.workerCount : std::max(std::thread::hardware_concurrency() / 2, 1u);
+		for (uint32_t i = 0; i < workerCount; i++) {
+			workers.push_back(std::thread(&TerrainQuadtree::worker, this));
+		}
+	}
+
+	void TerrainQuadtree::destroy()
+	{
+		if (!device) {
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopWorkers = true;
+			jobs.clear();
+		}
+		jobAvailable.notify_all();
+		for (auto& worker : workers) {
+			worker.join();
+		}
+		workers.clear();
+		vertexBuffer.destroy();
+		indexBuffer.destroy();
+		chunks.clear();
+		freeSlots.clear();
+		retiredSlots.clear();
+		finishedJobs.clear();
+		source.reset();
+		device = nullptr;
+	}
+
+	float TerrainQuadtree::worldSize() const
+	{
+		return (float)(dim - 1) * settings.sampleSpacing;
+	}
+
+	uint64_t TerrainQuadtree::nodeKey(uint32_t level, uint32_t x, uint32_t y)
+	{
+		return ((uint64_t)level << 48) | ((uint64_t)x << 24) | (uint64_t)y;
+	}
+
+	bool TerrainQuadtree::nodeExists(uint32_t level, uint32_t x, uint32_t y) const
+	{
+		return (x < nodesPerEdge[level]) && (y < nodesPerEdge[level]);
+	}
+
+	float TerrainQuadtree::worldPosition(uint32_t sample) const
+	{
+		// The terrain is centered at the origin
+		return ((float)std::min(sample, dim - 1) - (float)(dim - 1) * 0.5f) * settings.sampleSpacing;
+	}
+
+	void TerrainQuadtree::nodeBox(uint32_t level, uint32_t x, uint32_t y, glm::vec3& min, glm::vec3& max) const
+	{
+		const uint32_t nodeQuads = chunkQuads << level;
+		const glm::vec2& bounds = nodeBounds[level][y * nodesPerEdge[level] + x];
+		// Heights grow towards negative y
+		min = glm::vec3(worldPosition(x * nodeQuads), -bounds.y * heightScale, worldPosition(y * nodeQuads));
+		max = glm::vec3(worldPosition((x + 1) * nodeQuads), -bounds.x * heightScale, worldPosition((y + 1) * nodeQuads));
+	}
+
+	static float boxDistance(const glm::vec3& min, const glm::vec3& max, const glm::vec3& point)
+	{
+		const glm::vec3 d = glm::max(glm::max(min - point, point - max), glm::vec3(0.0f));
+		return glm::length(d);
+	}
+
+	void TerrainQuadtree::computeBounds()
+	{
+		auto tStart = std::chrono::high_resolution_clock::now();
+
+		// The finest level is computed from all samples, reading one row of nodes at a time (on multiple threads)
+		nodeBounds.resize(levels);
+		nodeBounds[0].resize(nodesPerEdge[0] * nodesPerEdge[0]);
+		std::atomic<uint32_t> nextRow{ 0 };
+		auto computeRows = [&]() {
+			std::vector<uint16_t> samples((size_t)dim * (chunkQuads + 1));
+			for (uint32_t row = nextRow++; row < nodesPerEdge[0]; row = nextRow++) {
+				source->read(0, row * chunkQuads, 1, dim, chunkQuads + 1, samples.data());
+				for (uint32_t column = 0; column < nodesPerEdge[0]; column++) {
+					uint16_t minHeight = 0xffff;
+					uint16_t maxHeight = 0;
+					const uint32_t first = column * chunkQuads;
+					const uint32_t last = std::min(first + chunkQuads, dim - 1);
+					for (uint32_t y = 0; y <= chunkQuads; y++) {
+						const uint16_t* src = &samples[(size_t)y * dim];
+						for (uint32_t x = first; x <= last; x++) {
+							minHeight = std::min(minHeight, src[x]);
+							maxHeight = std::max(maxHeight, src[x]);
+						}
+					}
+					nodeBounds[0][row * nodesPerEdge[0] + column] = glm::vec2((float)minHeight / 65535.0f - settings.skirtDepth, (float)maxHeight / 65535.0f);
+				}
+			}
+		};
+		std::vector<std::thread> threads;
+		const uint32_t threadCount = std::min(std::max(std::thread::hardware_concurrency(), 1u), nodesPerEdge[0]);
+		for (uint32_t i = 1; i < threadCount; i++) {
+			threads.push_back(std::thread(computeRows));
+		}
+		computeRows();
+		for (auto& thread : threads) {
+			thread.join();
+		}
+
+		// Coarser levels combine the bounds of their children, coarser chunks use a subset of the samples, so these are conservative
+		for (uint32_t level = 1; level < levels; level++) {
+			const uint32_t count = nodesPerEdge[level];
+			const uint32_t childCount = nodesPerEdge[level - 1];
+			nodeBounds[level].resize(count * count);
+			for (uint32_t y = 0; y < count; y++) {
+				for (uint32_t x = 0; x < count; x++) {
+					glm::vec2 bounds(std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+					for (uint32_t child = 0; child < 4; child++) {
+						const uint32_t cx = x * 2 + (child & 1);
+						const uint32_t cy = y * 2 + (child >> 1);
+						if ((cx < childCount) && (cy < childCount)) {
+							const glm::vec2& childBounds = nodeBounds[level - 1][cy * childCount + cx];
+							bounds.x = std::min(bounds.x, childBounds.x);
+							bounds.y = std::max(bounds.y, childBounds.y);
+						}
+					}
+					nodeBounds[level][y * count + x] = bounds;
+				}
+			}
+		}
+
+		auto tEnd = std::chrono::high_resolution_clock::now();
+		statistics.boundsTime = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+	}
+
+	void TerrainQuadtree::createIndexBuffer(VkQueue queue)
+	{
+		// Indices are sorted by quadrant, so parts of a chunk can be drawn when not all of its children are available
+		const uint32_t rowLength = chunkQuads + 1;
+		const uint32_t half = chunkQuads / 2;
+		auto gridIndex = [rowLength](uint32_t x, uint32_t y) { return (uint16_t)(y * rowLength + x); };
+		auto skirtIndex = [rowLength](uint32_t edge, uint32_t i) { return (uint16_t)(chunkGridVertices + edge * rowLength + i); };
+		std::vector<uint16_t> indices;
+		for (uint32_t quadrant = 0; quadrant < 4; quadrant++) {
+			const uint32_t qx = (quadrant & 1) * half;
+			const uint32_t qy = (quadrant >> 1) * half;
+			for (uint32_t y = qy; y < qy + half; y++) {
+				for (uint32_t x = qx; x < qx + half; x++) {
+					// All quads are split along the same diagonal as the quads of the coarser level, so fully morphed vertices match it exactly
+					const uint16_t a = gridIndex(x, y), b = gridIndex(x + 1, y), c = gridIndex(x, y + 1), d = gridIndex(x + 1, y + 1);
+					indices.insert(indices.end(), { a, c, d, a, d, b });
+				}
+			}
+			// Skirts along the chunk edges touched by this quadrant (edges are top, bottom, left and right)
+			const uint32_t horizontalEdge = (quadrant >> 1) ? 1 : 0;
+			const uint32_t horizontalRow = (quadrant >> 1) ? chunkQuads : 0;
+			const uint32_t verticalEdge = (quadrant & 1) ? 3 : 2;
+			const uint32_t verticalColumn = (quadrant & 1) ? chunkQuads : 0;
+			for (uint32_t i = 0; i < half; i++) {
+				const uint32_t x = qx + i;
+				const uint32_t y = qy + i;
+				indices.insert(indices.end(), { gridIndex(x, horizontalRow), skirtIndex(horizontalEdge, x), skirtIndex(horizontalEdge, x + 1), gridIndex(x, horizontalRow), skirtIndex(horizontalEdge, x + 1), gridIndex(x + 1, horizontalRow) });
+				indices.insert(indices.end(), { gridIndex(verticalColumn, y), skirtIndex(verticalEdge, y), skirtIndex(verticalEdge, y + 1), gridIndex(verticalColumn, y), skirtIndex(verticalEdge, y + 1), gridIndex(verticalColumn, y + 1) });
+			}
+		}
+		quadrantIndexCount = static_cast<uint32_t>(indices.size()) / 4;
+
+		vks::Buffer stagingBuffer;
+		const VkDeviceSize bufferSize = indices.size() * sizeof(uint16_t);
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, bufferSize, indices.data()));
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &indexBuffer, bufferSize));
+		device->copyBuffer(&stagingBuffer, &indexBuffer, queue);
+		stagingBuffer.destroy();
+	}
+
+	void TerrainQuadtree::buildChunk(uint32_t level, uint32_t x, uint32_t y, std::vector<Vertex>& vertices)
+	{
+		const uint32_t step = 1 << level;
+		const uint32_t rowLength = chunkQuads + 1;
+		const uint32_t x0 = x * chunkQuads * step;
+		const uint32_t y0 = y * chunkQuads * step;
+
+		// Heights with a border of one sample for the normals
+		const uint32_t count = chunkQuads + 3;
+		std::vector<uint16_t> samples(count * count);
+		source->read((int32_t)x0 - (int32_t)step, (int32_t)y0 - (int32_t)step, step, count, count, samples.data());
+		std::vector<float> heights(count * count);
+		for (size_t i = 0; i < samples.size(); i++) {
+			heights[i] = (float)samples[i] / 65535.0f;
+		}
+
+		// The height differences are scaled to a fixed world distance, so normals look the same on all levels
+		const float normalScale = settings.normalScale / ((float)step * settings.sampleSpacing);
+		std::vector<float> nx(chunkGridVertices), ny(chunkGridVertices), nz(chunkGridVertices);
+		for (uint32_t j = 0; j < rowLength; j++) {
+			computeNormalRow(&heights[j * count], &heights[(j + 1) * count], &heights[(j + 2) * count], normalScale, rowLength, &nx[j * rowLength], &ny[j * rowLength], &nz[j * rowLength]);
+		}
+
+		vertices.resize(chunkVertexCount);
+		for (uint32_t j = 0; j < rowLength; j++) {
+			for (uint32_t i = 0; i < rowLength; i++) {
+				Vertex& vertex = vertices[j * rowLength + i];
+				vertex.pos = glm::vec3(worldPosition(x0 + i * step), heights[(j + 1) * count + i + 1], worldPosition(y0 + j * step));
+				vertex.normal = glm::vec3(nx[j * rowLength + i], ny[j * rowLength + i], nz[j * rowLength + i]);
+			}
+		}
+
+		// Morph targets are the heights and normals of the coarser level, which are interpolated along its edges and diagonals
+		for (uint32_t j = 0; j < rowLength; j++) {
+			for (uint32_t i = 0; i < rowLength; i++) {
+				const uint32_t oddX = i & 1;
+				const uint32_t oddY = j & 1;
+				const Vertex& a = vertices[(j - oddY) * rowLength + i - oddX];
+				const Vertex& b = vertices[(j + oddY) * rowLength + i + oddX];
+				Vertex& vertex = vertices[j * rowLength + i];
+				vertex.morph = glm::vec4(glm::normalize(a.normal + b.normal), (a.pos.y + b.pos.y) * 0.5f);
+			}
+		}
+
+		// Skirts duplicate the edge vertices moved down
+		for (uint32_t edge = 0; edge < 4; edge++) {
+			for (uint32_t i = 0; i < rowLength; i++) {
+				const uint32_t gx = (edge < 2) ? i : ((edge == 2) ? 0 : chunkQuads);
+				const uint32_t gy = (edge < 2) ? ((edge == 0) ? 0 : chunkQuads) : i;
+				Vertex vertex = vertices[gy * rowLength + gx];
+				vertex.pos.y -= settings.skirtDepth;
+				vertex.morph.w -= settings.skirtDepth;
+				vertices[chunkGridVertices + edge * rowLength + i] = vertex;
+			}
+		}
+	}
+
+	void TerrainQuadtree::worker()
+	{
+		std::vector<Vertex> vertices;
+		while (true) {
+			Request job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				jobAvailable.wait(lock, [this] { return stopWorkers || !jobs.empty(); });
+				if (stopWorkers) {
+					return;
+				}
+				job = jobs.front();
+				jobs.pop_front();
+			}
+			auto tStart = std::chrono::high_resolution_clock::now();
+			// Vertices are built in local memory and then copied, as the pool may be uncached memory that is slow to read from
+			buildChunk(job.level, job.x, job.y, vertices);
+			// The slot isn't used by any draw until the chunk has been marked as ready
+			memcpy(static_cast<Vertex*>(vertexBuffer.mapped) + (size_t)job.slot * chunkVertexCount, vertices.data(), chunkVertexCount * sizeof(Vertex));
+			auto tEnd = std::chrono::high_resolution_clock::now();
+			statistics.buildTimeMicroseconds += (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(tEnd - tStart).count();
+			statistics.builtChunks++;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				finishedJobs.push_back(job.key);
+			}
+		}
+	}
+
+	void TerrainQuadtree::update(const glm::vec3& cameraPos, vks::Frustum& frustum, float heightScale)
+	{
+		this->cameraPos = cameraPos;
+		this->heightScale = heightScale;
+		frame++;
+
+		// Chunks finished by the workers can be drawn from now on
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (uint64_t key : finishedJobs) {
+				chunks[key].state = ChunkState::Ready;
+			}
+			finishedJobs.clear();
+		}
+		while (!retiredSlots.empty() && (retiredSlots.front().first + slotReuseDelay <= frame)) {
+			freeSlots.push_back(retiredSlots.front().second);
+			retiredSlots.pop_front();
+		}
+
+		// Distance based LOD ranges, the root is used at any distance
+		const float chunkSize = (float)chunkQuads * settings.sampleSpacing;
+		lodRanges.resize(levels);
+		for (uint32_t level = 0; level < levels; level++) {
+			lodRanges[level] = std::max(settings.lodDistance, 2.0f) * chunkSize * (float)(1 << level);
+		}
+		lodRanges[levels - 1] = std::numeric_limits<float>::max();
+
+		drawCommands.clear();
+		requests.clear();
+		statistics.culledNodes = 0;
+		selectNode(levels - 1, 0, 0, frustum);
+		processRequests();
+
+		statistics.drawnChunks = static_cast<uint32_t>(drawCommands.size());
+		statistics.pendingChunks = 0;
+		for (auto& chunk : chunks) {
+			if (chunk.second.state == ChunkState::Pending) {
+				statistics.pendingChunks++;
+			}
+		}
+		statistics.residentChunks = static_cast<uint32_t>(chunks.size()) - statistics.pendingChunks;
+	}
+
+	bool TerrainQuadtree::selectNode(uint32_t level, uint32_t x, uint32_t y, vks::Frustum& frustum)
+	{
+		glm::vec3 min, max;
+		nodeBox(level, x, y, min, max);
+		// Outside of this level's range, the parent covers this area
+		if (boxDistance(min, max, cameraPos) > lodRanges[level]) {
+			return false;
+		}
+		if (!frustum.checkSphere((min + max) * 0.5f, glm::length(max - min) * 0.5f)) {
+			statistics.culledNodes++;
+			return true;
+		}
+		chunks[nodeKey(level, x, y)].lastUsed = frame;
+		if ((level == 0) || (boxDistance(min, max, cameraPos) > lodRanges[level - 1])) {
+			drawNode(level, x, y, -1);
+			return true;
+		}
+		// Parts of the node that aren't covered by its children (as they're not resident yet or out of range) are drawn by the node itself
+		for (uint32_t quadrant = 0; quadrant < 4; quadrant++) {
+			const uint32_t cx = x * 2 + (quadrant & 1);
+			const uint32_t cy = y * 2 + (quadrant >> 1);
+			if (!nodeExists(level - 1, cx, cy)) {
+				continue;
+			}
+			bool covered = false;
+			auto child = chunks.find(nodeKey(level - 1, cx, cy));
+			if (child == chunks.end()) {
+				request(level - 1, cx, cy);
+			} else if (child->second.state == ChunkState::Ready) {
+				covered = selectNode(level - 1, cx, cy, frustum);
+			}
+			if (!covered) {
+				drawNode(level, x, y, quadrant);
+			}
+		}
+		return true;
+	}
+
+	void TerrainQuadtree::drawNode(uint32_t level, uint32_t x, uint32_t y, int32_t quadrant)
+	{
+		DrawCommand drawCommand{};
+		drawCommand.vertexOffset = (int32_t)(chunks[nodeKey(level, x, y)].slot * chunkVertexCount);
+		drawCommand.firstIndex = (quadrant < 0) ? 0 : quadrant * quadrantIndexCount;
+		drawCommand.indexCount = (quadrant < 0) ? 4 * quadrantIndexCount : quadrantIndexCount;
+		drawCommand.level = level;
+		if (level == levels - 1) {
+			// The root never morphs
+			drawCommand.morphStart = std::numeric_limits<float>::max();
+			drawCommand.morphEnd = std::numeric_limits<float>::max();
+		} else {
+			const float previousRange = (level > 0) ? lodRanges[level - 1] : 0.0f;
+			drawCommand.morphEnd = lodRanges[level];
+			drawCommand.morphStart = drawCommand.morphEnd - (drawCommand.morphEnd - previousRange) * settings.morphRatio;
+		}
+		drawCommands.push_back(drawCommand);
+	}
+
+	void TerrainQuadtree::request(uint32_t level, uint32_t x, uint32_t y)
+	{
+		glm::vec3 min, max;
+		nodeBox(level, x, y, min, max);
+		requests.push_back({ nodeKey(level, x, y), level, x, y, 0, boxDistance(min, max, cameraPos) });
+	}
+
+	bool TerrainQuadtree::evictLeastRecentlyUsed()
+	{
+		// Chunks used in this frame and chunks that are still being built can't be evicted
+		auto candidate = chunks.end();
+		for (auto it = chunks.begin(); it != chunks.end(); it++) {
+			const Chunk& chunk = it->second;
+			if ((chunk.state == ChunkState::Ready) && (chunk.lastUsed < frame) && (chunk.level < levels - 1)) {
+				if ((candidate == chunks.end()) || (chunk.lastUsed < candidate->second.lastUsed)) {
+					candidate = it;
+				}
+			}
+		}
+		if (candidate == chunks.end()) {
+			return false;
+		}
+		// Previous frames may still read from the slot
+		retiredSlots.push_back({ frame, candidate->second.slot });
+		chunks.erase(candidate);
+		statistics.evictedChunks++;
+		return true;
+	}
+
+	void TerrainQuadtree::processRequests()
+	{
+		// Coarse levels first, as finer levels can't be used without them, then by distance
+		std::sort(requests.begin(), requests.end(), [](const Request& a, const Request& b) {
+			return (a.level != b.level) ? (a.level > b.level) : (a.distance < b.distance);
+		});
+		const uint32_t requestCount = std::min(static_cast<uint32_t>(requests.size()), settings.maxRequestsPerFrame);
+
+		// Keep enough slots free (or about to become free) for the requests
+		while ((freeSlots.size() + retiredSlots.size() < requestCount) && evictLeastRecentlyUsed()) {}
+
+		uint32_t issued = 0;
+		for (auto& request : requests) {
+			if ((issued == requestCount) || freeSlots.empty()) {
+				break;
+			}
+			request.slot = freeSlots.back();
+			freeSlots.pop_back();
+			chunks[request.key] = { request.slot, ChunkState::Pending, frame, request.level };
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				jobs.push_back(request);
+			}
+			jobAvailable.notify_one();
+			issued++;
+		}
+	}
+}
@@ -0,0 +1,246 @@
+/*
+* Quadtree terrain with streamed chunks
+*
+* The heightmap is covered by a quadtree of chunks that all have the same vertex count, with each level halving the sample density
+* Chunks are selected per frame based on their distance to the camera (continuous distance based LOD), culled against the view frustum
+* and morphed towards the next coarser level close to the end of their LOD range, so there are no popping or cracks between levels
+* Chunk vertex data is built from the heightmap on worker threads and written to a fixed size pool, so arbitrarily large heightmaps
+* (e.g. 16k x 16k samples streamed from a file) can be rendered within a fixed memory budget
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanBuffer.h"
+#include "VulkanDevice.h"
+#include "VulkanTools.h"
+#include "frustum.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	/** @brief Source of 16 bit height samples for the terrain, reads may be called from multiple threads at once */
+	class HeightSource
+	{
+	public:
+		virtual ~HeightSource() {}
+		/** @brief Width and height of the (square) heightmap in samples */
+		virtual uint32_t size() const = 0;
+		/**
+		* Read a grid of samples, samples outside of the heightmap are clamped to the border
+		*
+		* @param x First sample on the x axis (may be negative)
+		* @param y First sample on the y axis (may be negative)
+		* @param step Distance between two samples that are read
+		* @param countX Number of samples to read on the x axis
+		* @param countY Number of samples to read on the y axis
+		* @param dst Target for countX * countY samples
+		*/
+		virtual void read(int32_t x, int32_t y, uint32_t step, uint32_t countX, uint32_t countY, uint16_t* dst) = 0;
+	};
+
+	/** @brief Heightmap that is completely stored in memory */
+	class MemoryHeightSource : public HeightSource
+	{
+	public:
+		MemoryHeightSource(std::vector<uint16_t>&& data, uint32_t dim);
+		uint32_t size() const override;
+		void read(int32_t x, int32_t y, uint32_t step, uint32_t countX, uint32_t countY, uint16_t* dst) override;
+	private:
+		std::vector<uint16_t> data;
+		uint32_t dim;
+	};
+
+	/** @brief Raw square 16 bit heightmap file that is read on demand, so only the parts required for the current chunks are loaded */
+	class FileHeightSource : public HeightSource
+	{
+	public:
+		FileHeightSource(const std::string& fileName);
+		/** @brief Returns false if the file could not be opened or doesn't contain a square 16 bit heightmap */
+		bool valid() const;
+		uint32_t size() const override;
+		void read(int32_t x, int32_t y, uint32_t step, uint32_t countX, uint32_t countY, uint16_t* dst) override;
+	private:
+		std::ifstream file;
+		std::mutex fileMutex;
+		uint32_t dim{ 0 };
+	};
+
+	class TerrainQuadtree
+	{
+	public:
+		// Number of quads along the edge of a chunk
+		static const uint32_t chunkQuads = 32;
+		// All chunks share one index buffer with 16 bit indices
+		static const VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+		static const uint32_t chunkGridVertices = (chunkQuads + 1) * (chunkQuads + 1);
+		// Each chunk has a skirt around its edges, hiding gaps to neighbours that are not fully morphed
+		static const uint32_t chunkVertexCount = chunkGridVertices + 4 * (chunkQuads + 1);
+
+		struct Vertex {
+			// World position on the x and z axis, the y component stores the normalized height which is scaled in the shader
+			glm::vec3 pos;
+			glm::vec3 normal;
+			// Normal and height of the next coarser level at this position that the vertex is morphed to
+			glm::vec4 morph;
+		};
+
+		struct Settings {
+			// Distance between two heightmap samples in world units
+			float sampleSpacing{ 0.125f };
+			// Distance up to which the finest level is used in multiples of the size of a finest level chunk, doubles with every level
+			// Needs to be larger than two, so vertices are fully morphed before the next level starts
+			float lodDistance{ 3.0f };
+			// Part of the LOD range at its end in which the vertices are morphed to the next level
+			float morphRatio{ 0.35f };
+			// Depth of the chunk skirts in normalized height units
+			float skirtDepth{ 0.02f };
+			// Distance in world units the height differences for the normals are scaled to, larger values give stronger normals
+			float normalScale{ 2.0f };
+			// Number of chunks that can be resident, this is the vertex memory budget
+			uint32_t maxResidentChunks{ 512 };
+			// Number of chunks that may be requested per frame
+			uint32_t maxRequestsPerFrame{ 32 };
+			// Number of threads building chunks, 0 uses half of the hardware threads
+			uint32_t workerCount{ 0 };
+		} settings;
+
+		struct DrawCommand {
+			int32_t vertexOffset;
+			uint32_t firstIndex;
+			uint32_t indexCount;
+			// Distances between which the chunk's vertices are morphed to the next level
+			float morphStart;
+			float morphEnd;
+			uint32_t level;
+		};
+		// Chunks selected by the last update
+		std::vector<DrawCommand> drawCommands;
+
+		struct Statistics {
+			uint32_t levels{ 0 };
+			uint32_t residentChunks{ 0 };
+			uint32_t drawnChunks{ 0 };
+			uint32_t culledNodes{ 0 };
+			uint32_t pendingChunks{ 0 };
+			uint32_t evictedChunks{ 0 };
+			std::atomic<uint32_t> builtChunks{ 0 };
+			// Accumulated time the workers spent building chunks
+			std::atomic<uint64_t> buildTimeMicroseconds{ 0 };
+			double boundsTime{ 0.0 };
+		} statistics;
+
+		// Vertex pool with one slot per resident chunk and the index buffer shared by all chunks
+		vks::Buffer vertexBuffer;
+		vks::Buffer indexBuffer;
+
+		/**
+		* Create the buffers, compute the bounds of all nodes and load the coarsest levels
+		*
+		* @param device Device to create the buffers on
+		* @param queue Queue used for uploading the index buffer
+		* @param source Heightmap the terrain is built from
+		*/
+		void create(vks::VulkanDevice* device, VkQueue queue, std::unique_ptr<HeightSource> source);
+		/** @brief Stop the workers and release all resources */
+		void destroy();
+
+		/**
+		* Select the chunks to draw for the current camera, request missing chunks and fill the draw commands
+		* Freed vertex pool slots are only reused some frames later, so chunks can be written while previous frames are still in flight
+		*
+		* @param cameraPos Camera position in world space
+		* @param frustum View frustum in world space
+		* @param heightScale Scale applied to the normalized heights in the shader (heights grow towards negative y)
+		*/
+		void update(const glm::vec3& cameraPos, vks::Frustum& frustum, float heightScale);
+
+		/** @brief Size of the terrain along the x and z axis in world units */
+		float worldSize() const;
+
+	private:
+		// Slots freed by evictions are held back for this many updates before they're reused
+		static const uint32_t slotReuseDelay = 3;
+
+		enum class ChunkState { Pending, Ready };
+
+		struct Chunk {
+			uint32_t slot;
+			ChunkState state;
+			uint32_t lastUsed;
+			uint32_t level;
+		};
+
+		struct Request {
+			uint64_t key;
+			uint32_t level;
+			uint32_t x;
+			uint32_t y;
+			uint32_t slot;
+			float distance;
+		};
+
+		vks::VulkanDevice* device{ nullptr };
+		std::unique_ptr<HeightSource> source;
+		uint32_t dim{ 0 };
+		uint32_t levels{ 0 };
+		float heightScale{ 1.0f };
+		glm::vec3 cameraPos{ 0.0f };
+
+		// Minimum and maximum normalized height of each node per level
+		std::vector<std::vector<glm::vec2>> nodeBounds;
+		std::vector<uint32_t> nodesPerEdge;
+		std::vector<float> lodRanges;
+
+		uint32_t quadrantIndexCount{ 0 };
+
+		// Resident (or pending) chunks by node key
+		std::unordered_map<uint64_t, Chunk> chunks;
+		std::vector<uint32_t> freeSlots;
+		std::deque<std::pair<uint32_t, uint32_t>> retiredSlots;
+		std::vector<Request> requests;
+		uint32_t frame{ 0 };
+
+		// Build jobs are shared with the workers
+		std::mutex mutex;
+		std::condition_variable jobAvailable;
+		std::deque<Request> jobs;
+		std::vector<uint64_t> finishedJobs;
+		std::vector<std::thread> workers;
+		bool stopWorkers{ false };
+
+		static uint64_t nodeKey(uint32_t level, uint32_t x, uint32_t y);
+		bool nodeExists(uint32_t level, uint32_t x, uint32_t y) const;
+		void nodeBox(uint32_t level, uint32_t x, uint32_t y, glm::vec3& min, glm::vec3& max) const;
+		float worldPosition(uint32_t sample) const;
+
+		void computeBounds();
+		void createIndexBuffer(VkQueue queue);
+		bool selectNode(uint32_t level, uint32_t x, uint32_t y, vks::Frustum& frustum);
+		void drawNode(uint32_t level, uint32_t x, uint32_t y, int32_t quadrant);
+		void request(uint32_t level, uint32_t x, uint32_t y);
+		void processRequests();
+		bool evictLeastRecentlyUsed();
+
+		void worker();
+		void buildChunk(uint32_t level, uint32_t x, uint32_t y, std::vector<Vertex>& vertices);
+	};
+}
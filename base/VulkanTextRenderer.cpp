@@ -0,0 +1,652 @@
+/*
+* Vulkan instanced text rendering
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanTextRenderer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include <glm/gtc/packing.hpp>
+
+namespace vks
+{
+	// Character as stored in BMFont files, in atlas pixels
+	struct BMChar {
+		uint32_t id;
+		int32_t x, y;
+		int32_t width, height;
+		int32_t xoffset, yoffset;
+		int32_t xadvance;
+	};
+
+	// Block types of the binary BMFont format (version 3)
+	enum BMBlockType {
+		BMBlockInfo = 1,
+		BMBlockCommon = 2,
+		BMBlockPages = 3,
+		BMBlockChars = 4,
+		BMBlockKerning = 5
+	};
+	static const uint8_t bmHeader[4] = { 'B', 'M', 'F', 3 };
+	static const size_t bmCharSize = 20;
+	static const size_t bmKerningSize = 10;
+
+	template <typename T>
+	static T readValue(const uint8_t* data)
+	{
+		T value;
+		memcpy(&value, data, sizeof(T));
+		return value;
+	}
+
+	template <typename T>
+	static void writeValue(std::vector<uint8_t>& data, T value)
+	{
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+		data.insert(data.end(), bytes, bytes + sizeof(T));
+	}
+
+	static uint64_t kerningKey(uint32_t first, uint32_t second)
+	{
+		return (static_cast<uint64_t>(first) << 32) | second;
+	}
+
+	static uint16_t packUnorm16(float value)
+	{
+		return static_cast<uint16_t>(std::round(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+	}
+
+	// Decodes the UTF-8 sequence at index and moves the index past it, invalid bytes are returned as they are
+	static uint32_t decodeUTF8(const std::string& string, size_t& index)
+	{
+		uint8_t lead = static_cast<uint8_t>(string[index++]);
+		uint32_t length = (lead >= 0xf0) ? 3 : (lead >= 0xe0) ? 2 : (lead >= 0xc0) ? 1 : 0;
+		if (length == 0 || index + length > string.size()) {
+			return lead;
+		}
+		uint32_t codepoint = lead & (0x3f >> length);
+		for (uint32_t i = 0; i < length; i++) {
+			codepoint = (codepoint << 6) | (static_cast<uint8_t>(string[index++]) & 0x3f);
+		}
+		return codepoint;
+	}
+
+	/*
+		Font
+	*/
+
+	Font::Font()
+	{
+		clear();
+	}
+
+	void Font::clear()
+	{
+		glyphs.clear();
+		codepoints.clear();
+		latinGlyphs.fill(-1);
+		otherGlyphs.clear();
+		kerning.clear();
+		size = lineHeight = base = 0.0f;
+		atlasWidth = atlasHeight = 0;
+	}
+
+	void Font::addGlyph(uint32_t codepoint, const Glyph& glyph)
+	{
+		if (const Glyph* existing = getGlyph(codepoint)) {
+			glyphs[existing - glyphs.data()] = glyph;
+			return;
+		}
+		uint32_t index = static_cast<uint32_t>(glyphs.size());
+		glyphs.push_back(glyph);
+		codepoints.push_back(codepoint);
+		if (codepoint < latinGlyphs.size()) {
+			latinGlyphs[codepoint] = static_cast<int32_t>(index);
+		} else {
+			otherGlyphs[codepoint] = index;
+		}
+	}
+
+	void Font::addKerning(uint32_t first, uint32_t second, float amount)
+	{
+		kerning[kerningKey(first, second)] = amount;
+	}
+
+	float Font::getKerning(uint32_t first, uint32_t second) const
+	{
+		auto it = kerning.find(kerningKey(first, second));
+		return (it != kerning.end()) ? it->second : 0.0f;
+	}
+
+	bool Font::loadFromFile(const std::string& filename, std::string* error)
+	{
+		std::vector<uint8_t> bytes;
+#if defined(__ANDROID__)
+		AAsset* asset = AAssetManager_open(androidApp->activity->assetManager, filename.c_str(), AASSET_MODE_STREAMING);
+		if (!asset) {
+			if (error) *error = "could not open " + filename;
+			return false;
+		}
+		bytes.resize(AAsset_getLength(asset));
+		AAsset_read(asset, bytes.data(), bytes.size());
+		AAsset_close(asset);
+#else
+		std::ifstream file(filename, std::ios::binary | std::ios::ate);
+		if (!file.is_open()) {
+			if (error) *error = "could not open " + filename;
+			return false;
+		}
+		bytes.resize(static_cast<size_t>(file.tellg()));
+		file.seekg(0, std::ios::beg);
+		file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+#endif
+		return loadFromMemory(bytes.data(), bytes.size(), error);
+	}
+
+	bool Font::loadFromMemory(const uint8_t* data, size_t dataSize, std::string* error)
+	{
+		clear();
+		bool result = (dataSize >= sizeof(bmHeader) && memcmp(data, bmHeader, sizeof(bmHeader)) == 0) ? parseBinary(data, dataSize, error) : parseText(reinterpret_cast<const char*>(data), dataSize, error);
+		if (!result) {
+			clear();
+		}
+		return result;
+	}
+
+	static void addChars(Font& font, const std::vector<BMChar>& chars)
+	{
+		const glm::vec2 atlasSize((float)font.atlasWidth, (float)font.atlasHeight);
+		for (const BMChar& c : chars) {
+			Font::Glyph glyph;
+			glyph.offset = glm::vec2((float)c.xoffset, (float)c.yoffset);
+			glyph.size = glm::vec2((float)c.width, (float)c.height);
+			glyph.uvRect = glm::vec4(glm::vec2((float)c.x, (float)c.y) / atlasSize, glm::vec2((float)(c.x + c.width), (float)(c.y + c.height)) / atlasSize);
+			glyph.advance = (float)c.xadvance;
+			font.addGlyph(c.id, glyph);
+		}
+	}
+
+	// Reads the "tag key=value key=value ..." lines of the text format in place
+	bool Font::parseText(const char* data, size_t dataSize, std::string* error)
+	{
+		std::vector<BMChar> chars;
+		const char* end = data + dataSize;
+		const char* lineStart = data;
+		while (lineStart < end) {
+			const char* lineEnd = std::find(lineStart, end, '\n');
+			const char* pos = lineStart;
+			lineStart = lineEnd + 1;
+
+			auto skipSpaces = [&]() { while (pos < lineEnd && (*pos == ' ' || *pos == '\t' || *pos == '\r')) pos++; };
+			skipSpaces();
+			const char* tagStart = pos;
+			while (pos < lineEnd && *pos != ' ' && *pos != '\t') pos++;
+			std::string tag(tagStart, pos);
+			if (tag != "info" && tag != "common" && tag != "char" && tag != "kerning") {
+				continue;
+			}
+
+			BMChar c{};
+			uint32_t first = 0, second = 0;
+			int32_t amount = 0;
+			while (true) {
+				skipSpaces();
+				const char* keyStart = pos;
+				while (pos < lineEnd && *pos != '=') pos++;
+				if (pos >= lineEnd) {
+					break;
+				}
+				std::string key(keyStart, pos++);
+				// Quoted values (e.g. the face name) are skipped, all values that are read are integers
+				if (pos < lineEnd && *pos == '"') {
+					pos = std::find(pos + 1, lineEnd, '"') + 1;
+					continue;
+				}
+				char value[32]{};
+				size_t length = 0;
+				while (pos < lineEnd && *pos != ' ' && *pos != '\t' && *pos != '\r') {
+					if (length < sizeof(value) - 1) value[length++] = *pos;
+					pos++;
+				}
+				int32_t number = static_cast<int32_t>(strtol(value, nullptr, 10));
+
+				if (tag == "info") {
+					// Negative sizes denote fonts that match the character height instead of the cell height
+					if (key == "size") size = (float)std::abs(number);
+				} else if (tag == "common") {
+					if (key == "lineHeight") lineHeight = (float)number;
+					else if (key == "base") base = (float)number;
+					else if (key == "scaleW") atlasWidth = number;
+					else if (key == "scaleH") atlasHeight = number;
+				} else if (tag == "char") {
+					if (key == "id") c.id = number;
+					else if (key == "x") c.x = number;
+					else if (key == "y") c.y = number;
+					else if (key == "width") c.width = number;
+					else if (key == "height") c.height = number;
+					else if (key == "xoffset") c.xoffset = number;
+					else if (key == "yoffset") c.yoffset = number;
+					else if (key == "xadvance") c.xadvance = number;
+				} else {
+					if (key == "first") first = number;
+					else if (key == "second") second = number;
+					else if (key == "amount") amount = number;
+				}
+			}
+
+			if (tag == "char") {
+				chars.push_back(c);
+			} else if (tag == "kerning") {
+				addKerning(first, second, (float)amount);
+			}
+		}
+
+		if (atlasWidth == 0 || atlasHeight == 0) {
+			if (error) *error = "font has no common block with the atlas size";
+			return false;
+		}
+		addChars(*this, chars);
+		return true;
+	}
+
+	bool Font::parseBinary(const uint8_t* data, size_t dataSize, std::string* error)
+	{
+		std::vector<BMChar> chars;
+		size_t offset = sizeof(bmHeader);
+		while (offset + 5 <= dataSize) {
+			uint8_t type = data[offset];
+			uint32_t blockSize = readValue<uint32_t>(data + offset + 1);
+			offset += 5;
+			if (offset + blockSize > dataSize) {
+				if (error) *error = "binary font block exceeds the file size";
+				return false;
+			}
+			const uint8_t* block = data + offset;
+			switch (type) {
+			case BMBlockInfo:
+				if (blockSize >= 2) {
+					size = (float)std::abs(readValue<int16_t>(block));
+				}
+				break;
+			case BMBlockCommon:
+				if (blockSize >= 8) {
+					lineHeight = (float)readValue<uint16_t>(block);
+					base = (float)readValue<uint16_t>(block + 2);
+					atlasWidth = readValue<uint16_t>(block + 4);
+					atlasHeight = readValue<uint16_t>(block + 6);
+				}
+				break;
+			case BMBlockChars:
+				chars.reserve(blockSize / bmCharSize);
+				for (size_t i = 0; i + bmCharSize <= blockSize; i += bmCharSize) {
+					const uint8_t* record = block + i;
+					BMChar c;
+					c.id = readValue<uint32_t>(record);
+					c.x = readValue<uint16_t>(record + 4);
+					c.y = readValue<uint16_t>(record + 6);
+					c.width = readValue<uint16_t>(record + 8);
+					c.height = readValue<uint16_t>(record + 10);
+					c.xoffset = readValue<int16_t>(record + 12);
+					c.yoffset = readValue<int16_t>(record + 14);
+					c.xadvance = readValue<int16_t>(record + 16);
+					chars.push_back(c);
+				}
+				break;
+			case BMBlockKerning:
+				for (size_t i = 0; i + bmKerningSize <= blockSize; i += bmKerningSize) {
+					const uint8_t* record = block + i;
+					addKerning(readValue<uint32_t>(record), readValue<uint32_t>(record + 4), (float)readValue<int16_t>(record + 8));
+				}
+				break;
+			}
+			offset += blockSize;
+		}
+
+		if (atlasWidth == 0 || atlasHeight == 0) {
+			if (error) *error = "font has no common block with the atlas size";
+			return false;
+		}
+		addChars(*this, chars);
+		return true;
+	}
+
+	bool Font::saveBinary(const std::string& filename, std::string* error) const
+	{
+		std::vector<uint8_t> data(bmHeader, bmHeader + sizeof(bmHeader));
+		auto beginBlock = [&data](BMBlockType type, size_t size) {
+			data.push_back(static_cast<uint8_t>(type));
+			writeValue<uint32_t>(data, static_cast<uint32_t>(size));
+		};
+
+		// Info: font size, bit field, char set, stretch, anti-aliasing, padding, spacing, outline and an empty face name
+		beginBlock(BMBlockInfo, 15);
+		writeValue<int16_t>(data, static_cast<int16_t>(size));
+		writeValue<uint8_t>(data, 0);
+		writeValue<uint8_t>(data, 0);
+		writeValue<uint16_t>(data, 100);
+		writeValue<uint8_t>(data, 1);
+		data.insert(data.end(), 8, 0);
+
+		// Common: line height, base, atlas size, page count, bit field and channel contents
+		beginBlock(BMBlockCommon, 15);
+		writeValue<uint16_t>(data, static_cast<uint16_t>(lineHeight));
+		writeValue<uint16_t>(data, static_cast<uint16_t>(base));
+		writeValue<uint16_t>(data, static_cast<uint16_t>(atlasWidth));
+		writeValue<uint16_t>(data, static_cast<uint16_t>(atlasHeight));
+		writeValue<uint16_t>(data, 1);
+		data.insert(data.end(), 5, 0);
+
+		// Pages: the atlas texture isn't referenced by name
+		beginBlock(BMBlockPages, 1);
+		data.push_back(0);
+
+		beginBlock(BMBlockChars, glyphs.size() * bmCharSize);
+		const glm::vec2 atlasSize((float)atlasWidth, (float)atlasHeight);
+		for (size_t i = 0; i < glyphs.size(); i++) {
+			const Glyph& glyph = glyphs[i];
+			const glm::vec2 atlasPos = glm::round(glm::vec2(glyph.uvRect.x, glyph.uvRect.y) * atlasSize);
+			writeValue<uint32_t>(data, codepoints[i]);
+			writeValue<uint16_t>(data, static_cast<uint16_t>(atlasPos.x));
+			writeValue<uint16_t>(data, static_cast<uint16_t>(atlasPos.y));
+			writeValue<uint16_t>(data, static_cast<uint16_t>(std::round(glyph.size.x)));
+			writeValue<uint16_t>(data, static_cast<uint16_t>(std::round(glyph.size.y)));
+			writeValue<int16_t>(data, static_cast<int16_t>(std::round(glyph.offset.x)));
+			writeValue<int16_t>(data, static_cast<int16_t>(std::round(glyph.offset.y)));
+			writeValue<int16_t>(data, static_cast<int16_t>(std::round(glyph.advance)));
+			// Page and channel
+			writeValue<uint8_t>(data, 0);
+			writeValue<uint8_t>(data, 15);
+		}
+
+		if (!kerning.empty()) {
+			beginBlock(BMBlockKerning, kerning.size() * bmKerningSize);
+			for (const auto& pair : kerning) {
+				writeValue<uint32_t>(data, static_cast<uint32_t>(pair.first >> 32));
+				writeValue<uint32_t>(data, static_cast<uint32_t>(pair.first & 0xffffffff));
+				writeValue<int16_t>(data, static_cast<int16_t>(std::round(pair.second)));
+			}
+		}
+
+		std::ofstream file(filename, std::ios::binary);
+		if (!file.is_open()) {
+			if (error) *error = "could not open " + filename + " for writing";
+			return false;
+		}
+		file.write(reinterpret_cast<const char*>(data.data()), data.size());
+		return true;
+	}
+
+	/*
+		Text renderer
+	*/
+
+	// Ranges in the instance buffer are allocated in steps of this many glyphs, so texts can grow a bit without moving all others
+	static const uint32_t instanceRangeGranularity = 16;
+
+	void TextRenderer::create(vks::VulkanDevice* device, const vks::Font* font, uint32_t maxGlyphs)
+	{
+		this->device = device;
+		this->font = font;
+		createBuffer(std::max(maxGlyphs, instanceRangeGranularity));
+	}
+
+	void TextRenderer::createBuffer(uint32_t capacity)
+	{
+		instanceBuffer.destroy();
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &instanceBuffer, capacity * sizeof(GlyphInstance)));
+		VK_CHECK_RESULT(instanceBuffer.map());
+		bufferCapacity = capacity;
+	}
+
+	void TextRenderer::destroy()
+	{
+		if (!device) {
+			return;
+		}
+		instanceBuffer.destroy();
+		texts.clear();
+		dirtyTexts.clear();
+		instanceCount = 0;
+		bufferCapacity = 0;
+		device = nullptr;
+	}
+
+	uint32_t TextRenderer::addText()
+	{
+		// Removed texts are reused along with their range in the instance buffer
+		uint32_t handle = 0;
+		while (handle < texts.size() && texts[handle].used) {
+			handle++;
+		}
+		if (handle == texts.size()) {
+			texts.emplace_back();
+		}
+		Text& text = texts[handle];
+		text.used = true;
+		text.visible = true;
+		return handle;
+	}
+
+	void TextRenderer::removeText(uint32_t handle)
+	{
+		Text& text = texts[handle];
+		text.used = false;
+		text.string.clear();
+		text.glyphs.clear();
+		text.extent = glm::vec2(0.0f);
+		markDirty(handle);
+	}
+
+	void TextRenderer::setText(uint32_t handle, const std::string& string, const glm::vec2& position, TextAlign align, const glm::vec4& color, float scale)
+	{
+		Text& text = texts[handle];
+		const uint32_t packedColor = glm::packUnorm4x8(color);
+		const bool layoutChanged = (text.string != string) || (text.align != align) || (text.scale != scale);
+		if (!layoutChanged && text.position == position && text.color == packedColor) {
+			return;
+		}
+		text.position = position;
+		text.color = packedColor;
+		if (layoutChanged) {
+			text.string = string;
+			text.align = align;
+			text.scale = scale;
+			layout(text);
+			pendingLayouts++;
+			if (text.glyphs.size() > text.capacity) {
+				repack = true;
+			}
+		}
+		markDirty(handle);
+	}
+
+	void TextRenderer::setVisible(uint32_t handle, bool visible)
+	{
+		if (texts[handle].visible != visible) {
+			texts[handle].visible = visible;
+			markDirty(handle);
+		}
+	}
+
+	glm::vec2 TextRenderer::getExtent(uint32_t handle) const
+	{
+		return texts[handle].extent;
+	}
+
+	void TextRenderer::markDirty(uint32_t handle)
+	{
+		if (!texts[handle].dirty) {
+			texts[handle].dirty = true;
+			dirtyTexts.push_back(handle);
+		}
+	}
+
+	void TextRenderer::layout(Text& text)
+	{
+		text.glyphs.clear();
+		text.extent = glm::vec2(0.0f);
+		const float scale = text.scale;
+		const bool kerning = font->hasKerning();
+		glm::vec2 pen(0.0f);
+		size_t lineStart = 0;
+		uint32_t previous = 0;
+
+		// Glyphs are laid out left aligned and moved once the width of their line is known
+		auto endLine = [&]() {
+			const float shift = (text.align == alignCenter) ? -pen.x * 0.5f : (text.align == alignRight) ? -pen.x : 0.0f;
+			for (size_t i = lineStart; i < text.glyphs.size(); i++) {
+				text.glyphs[i].offset.x += shift;
+			}
+			text.extent.x = std::max(text.extent.x, pen.x);
+			lineStart = text.glyphs.size();
+		};
+
+		size_t index = 0;
+		while (index < text.string.size()) {
+			const uint32_t codepoint = decodeUTF8(text.string, index);
+			if (codepoint == '\n') {
+				endLine();
+				pen = glm::vec2(0.0f, pen.y + font->lineHeight * scale);
+				previous = 0;
+				continue;
+			}
+			const Font::Glyph* glyph = font->getGlyph(codepoint);
+			if (!glyph) {
+				previous = 0;
+				continue;
+			}
+			if (kerning && previous != 0) {
+				pen.x += font->getKerning(previous, codepoint) * scale;
+			}
+			// Glyphs without a visible part (e.g. spaces) only advance the pen
+			if (glyph->size.x > 0.0f && glyph->size.y > 0.0f) {
+				LayoutGlyph layoutGlyph;
+				layoutGlyph.offset = pen + glyph->offset * scale;
+				layoutGlyph.size = glyph->size * scale;
+				for (uint32_t i = 0; i < 4; i++) {
+					layoutGlyph.uvRect[i] = packUnorm16(glyph->uvRect[i]);
+				}
+				text.glyphs.push_back(layoutGlyph);
+			}
+			pen.x += glyph->advance * scale;
+			previous = codepoint;
+		}
+		endLine();
+		text.extent.y = pen.y + font->lineHeight * scale;
+	}
+
+	void TextRenderer::writeText(Text& text)
+	{
+		GlyphInstance* instances = static_cast<GlyphInstance*>(instanceBuffer.mapped) + text.firstInstance;
+		const uint32_t count = (text.used && text.visible) ? static_cast<uint32_t>(text.glyphs.size()) : 0;
+		for (uint32_t i = 0; i < count; i++) {
+			const LayoutGlyph& glyph = text.glyphs[i];
+			GlyphInstance& instance = instances[i];
+			instance.position = text.position + glyph.offset;
+			instance.size = glyph.size;
+			memcpy(instance.uvRect, glyph.uvRect, sizeof(instance.uvRect));
+			instance.color = text.color;
+		}
+		// Clear the instances that were written before but aren't used anymore
+		if (count < text.writtenCount) {
+			std::fill(instances + count, instances + text.writtenCount, GlyphInstance{});
+		}
+		text.writtenCount = count;
+		statistics.glyphsWritten += count;
+	}
+
+	void TextRenderer::repackTexts()
+	{
+		uint32_t total = 0;
+		for (Text& text : texts) {
+			if (!text.used) {
+				text.firstInstance = text.capacity = text.writtenCount = 0;
+				continue;
+			}
+			// Leave some room to grow, so e.g. counters that gain a digit don't cause another repack
+			const uint32_t glyphCount = static_cast<uint32_t>(text.glyphs.size());
+			text.firstInstance = total;
+			text.capacity = (glyphCount + glyphCount / 4 + instanceRangeGranularity - 1) / instanceRangeGranularity * instanceRangeGranularity;
+			// The new range contains instances of other texts, so all of it needs to be cleared
+			text.writtenCount = text.capacity;
+			total += text.capacity;
+		}
+		if (total > bufferCapacity) {
+			createBuffer(std::max(total, bufferCapacity * 2));
+		}
+		dirtyTexts.clear();
+		for (uint32_t i = 0; i < static_cast<uint32_t>(texts.size()); i++) {
+			texts[i].dirty = false;
+			if (texts[i].used) {
+				markDirty(i);
+			}
+		}
+		repack = false;
+	}
+
+	bool TextRenderer::update()
+	{
+		statistics = Statistics();
+		statistics.textsLaidOut = pendingLayouts;
+		pendingLayouts = 0;
+		if (dirtyTexts.empty() && !repack) {
+			return false;
+		}
+
+		const VkBuffer previousBuffer = instanceBuffer.buffer;
+		const uint32_t previousInstanceCount = instanceCount;
+		if (repack) {
+			repackTexts();
+			statistics.repacked = true;
+		}
+		for (uint32_t handle : dirtyTexts) {
+			writeText(texts[handle]);
+			texts[handle].dirty = false;
+		}
+		dirtyTexts.clear();
+
+		// Draw up to the last range that contains glyphs
+		instanceCount = 0;
+		for (const Text& text : texts) {
+			if (text.writtenCount > 0) {
+				instanceCount = std::max(instanceCount, text.firstInstance + text.writtenCount);
+			}
+		}
+		return (instanceCount != previousInstanceCount) || (instanceBuffer.buffer != previousBuffer);
+	}
+
+	void TextRenderer::cmdDraw(VkCommandBuffer commandBuffer)
+	{
+		if (instanceCount == 0) {
+			return;
+		}
+		VkDeviceSize offset = 0;
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &instanceBuffer.buffer, &offset);
+		vkCmdDraw(commandBuffer, 4, instanceCount, 0, 0);
+	}
+
+	const VkPipelineVertexInputStateCreateInfo* TextRenderer::getPipelineVertexInputState()
+	{
+		inputBinding = vks::initializers::vertexInputBindingDescription(0, sizeof(GlyphInstance), VK_VERTEX_INPUT_RATE_INSTANCE);
+		inputAttributes = {
+			vks::initializers::vertexInputAttributeDescription(0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(GlyphInstance, position)),
+			vks::initializers::vertexInputAttributeDescription(0, 1, VK_FORMAT_R32G32_SFLOAT, offsetof(GlyphInstance, size)),
+			vks::initializers::vertexInputAttributeDescription(0, 2, VK_FORMAT_R16G16B16A16_UNORM, offsetof(GlyphInstance, uvRect)),
+			vks::initializers::vertexInputAttributeDescription(0, 3, VK_FORMAT_R8G8B8A8_UNORM, offsetof(GlyphInstance, color)),
+		};
+		inputState = vks::initializers::pipelineVertexInputStateCreateInfo();
+		inputState.vertexBindingDescriptionCount = 1;
+		inputState.pVertexBindingDescriptions = &inputBinding;
+		inputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(inputAttributes.size());
+		inputState.pVertexAttributeDescriptions = inputAttributes.data();
+		return &inputState;
+	}
+}
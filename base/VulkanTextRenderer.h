@@ -0,0 +1,212 @@
+/*
+* Vulkan instanced text rendering
+*
+* Lays out strings with the metrics of a bitmap font and renders all glyphs with a single instanced draw: Every glyph is
+* one instance (position, size, atlas rectangle and color) that the vertex shader expands to a quad of four vertices
+* Laid out strings are cached per text, so only texts whose string, alignment or scale changed are laid out again and only
+* texts that changed in any way are written to the instance buffer, unchanged texts don't cost anything per update
+*
+* Font metrics can be read from AngelCode BMFont files (http://www.angelcode.com/products/bmfont/doc/file_format.html),
+* either in the text or the preparsed binary format, or added glyph by glyph (e.g. from a baked stb font)
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <array>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanBuffer.h"
+#include "VulkanDevice.h"
+#include "VulkanTools.h"
+
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	class Font
+	{
+	public:
+		struct Glyph {
+			// Offset of the quad from the pen position (top of the line) and its size in font pixels
+			glm::vec2 offset{ 0.0f };
+			glm::vec2 size{ 0.0f };
+			// Rectangle of the glyph in the atlas in normalized texture coordinates (left, top, right, bottom)
+			glm::vec4 uvRect{ 0.0f };
+			float advance{ 0.0f };
+		};
+
+		// Size the font was rasterized with in pixels
+		float size{ 0.0f };
+		float lineHeight{ 0.0f };
+		// Distance from the top of the line to the baseline
+		float base{ 0.0f };
+		uint32_t atlasWidth{ 0 };
+		uint32_t atlasHeight{ 0 };
+
+		Font();
+
+		/**
+		* Load font metrics from an AngelCode BMFont file, the binary format is detected by its header
+		*
+		* @param filename Path of the .fnt file
+		* @param error Optional string receiving the reason if loading fails
+		* @return True if the font was loaded
+		*/
+		bool loadFromFile(const std::string& filename, std::string* error = nullptr);
+		bool loadFromMemory(const uint8_t* data, size_t dataSize, std::string* error = nullptr);
+		/** @brief Store the metrics in the binary BMFont format, which loads without any text parsing */
+		bool saveBinary(const std::string& filename, std::string* error = nullptr) const;
+
+		void clear();
+		void addGlyph(uint32_t codepoint, const Glyph& glyph);
+		void addKerning(uint32_t first, uint32_t second, float amount);
+		/** @brief Returns the glyph of a codepoint, or nullptr if the font doesn't contain it */
+		const Glyph* getGlyph(uint32_t codepoint) const
+		{
+			if (codepoint < latinGlyphs.size()) {
+				int32_t index = latinGlyphs[codepoint];
+				return (index >= 0) ? &glyphs[index] : nullptr;
+			}
+			auto it = otherGlyphs.find(codepoint);
+			return (it != otherGlyphs.end()) ? &glyphs[it->second] : nullptr;
+		}
+		float getKerning(uint32_t first, uint32_t second) const;
+		bool hasKerning() const { return !kerning.empty(); }
+
+	private:
+		std::vector<Glyph> glyphs;
+		std::vector<uint32_t> codepoints;
+		// Glyph indices for the first 256 codepoints are looked up directly, all others through the map
+		std::array<int32_t, 256> latinGlyphs;
+		std::unordered_map<uint32_t, uint32_t> otherGlyphs;
+		// Kerning amounts keyed by the codepoints of both characters
+		std::unordered_map<uint64_t, float> kerning;
+
+		bool parseText(const char* data, size_t dataSize, std::string* error);
+		bool parseBinary(const uint8_t* data, size_t dataSize, std::string* error);
+	};
+
+	class TextRenderer
+	{
+	public:
+		enum TextAlign { alignLeft, alignCenter, alignRight };
+
+		// Per instance vertex data of a single glyph, empty glyphs (e.g. of removed texts) have a size of zero
+		struct GlyphInstance {
+			// Top left corner and size of the quad, in the units the texts are positioned in
+			glm::vec2 position;
+			glm::vec2 size;
+			// Atlas rectangle as normalized 16 bit values
+			uint16_t uvRect[4];
+			// RGBA8
+			uint32_t color;
+		};
+
+		// Information on the last update
+		struct Statistics {
+			// Texts that had to be laid out again since the previous update
+			uint32_t textsLaidOut{ 0 };
+			// Glyph instances written to the instance buffer
+			uint32_t glyphsWritten{ 0 };
+			// All texts had to be moved, e.g. because one outgrew its range in the instance buffer
+			bool repacked{ false };
+		} statistics;
+
+		// Host visible instance buffer, bound to binding 0 by cmdDraw
+		vks::Buffer instanceBuffer;
+		// Number of instances drawn, includes the unused instances at the end of each text's range
+		uint32_t instanceCount{ 0 };
+
+		/**
+		* Create the instance buffer
+		*
+		* @param device Device to create the buffer on
+		* @param font Font used to lay out all texts, needs to stay valid until the renderer is destroyed
+		* @param maxGlyphs Initial capacity of the instance buffer, grows if the texts need more
+		*/
+		void create(vks::VulkanDevice* device, const vks::Font* font, uint32_t maxGlyphs = 4096);
+		void destroy();
+
+		/** @brief Add an empty text and return its handle */
+		uint32_t addText();
+		void removeText(uint32_t text);
+		/**
+		* Set the contents of a text, does nothing if none of the arguments changed
+		* Changing only the position or color moves the cached layout without laying it out again
+		*
+		* @param text Handle of the text
+		* @param string UTF-8 encoded string, may contain line breaks
+		* @param position Position of the first line's pen, the point the text is aligned to
+		* @param align Horizontal alignment of the lines relative to the position
+		* @param color Color the glyphs are multiplied with
+		* @param scale Size of a font pixel in the units of the position
+		*/
+		void setText(uint32_t text, const std::string& string, const glm::vec2& position, TextAlign align = alignLeft, const glm::vec4& color = glm::vec4(1.0f), float scale = 1.0f);
+		void setVisible(uint32_t text, bool visible);
+		/** @brief Width and height of a text's layout, in the units of its position */
+		glm::vec2 getExtent(uint32_t text) const;
+
+		/**
+		* Write the texts that changed since the last update to the instance buffer
+		* The buffer is written from the host, so it must not be in use by the device
+		*
+		* @return True if instanceCount or the instance buffer changed, so command buffers that were recorded with cmdDraw need to be rebuilt
+		*/
+		bool update();
+		/** @brief Bind the instance buffer and draw all glyphs, the pipeline needs to use the input state from getPipelineVertexInputState */
+		void cmdDraw(VkCommandBuffer commandBuffer);
+
+		/** @brief Vertex input state for pipelines drawing the glyphs as a four vertex triangle strip (see GlyphInstance), stays valid as long as the renderer */
+		const VkPipelineVertexInputStateCreateInfo* getPipelineVertexInputState();
+
+	private:
+		// Glyph of a laid out string, relative to the text's position
+		struct LayoutGlyph {
+			glm::vec2 offset;
+			glm::vec2 size;
+			uint16_t uvRect[4];
+		};
+		struct Text {
+			std::string string;
+			glm::vec2 position{ 0.0f };
+			float scale{ 1.0f };
+			TextAlign align{ alignLeft };
+			uint32_t color{ 0xffffffff };
+			bool visible{ true };
+			bool used{ false };
+			bool dirty{ false };
+			std::vector<LayoutGlyph> glyphs;
+			glm::vec2 extent{ 0.0f };
+			// Range in the instance buffer, instances past the written glyphs are kept empty
+			uint32_t firstInstance{ 0 };
+			uint32_t capacity{ 0 };
+			uint32_t writtenCount{ 0 };
+		};
+
+		vks::VulkanDevice* device{ nullptr };
+		const vks::Font* font{ nullptr };
+		std::vector<Text> texts;
+		std::vector<uint32_t> dirtyTexts;
+		uint32_t bufferCapacity{ 0 };
+		bool repack{ false };
+		// Texts laid out since the last update
+		uint32_t pendingLayouts{ 0 };
+		// Referenced by the pipeline vertex input state
+		VkVertexInputBindingDescription inputBinding{};
+		std::array<VkVertexInputAttributeDescription, 4> inputAttributes{};
+		VkPipelineVertexInputStateCreateInfo inputState{};
+
+		void createBuffer(uint32_t capacity);
+		void layout(Text& text);
+		void markDirty(uint32_t text);
+		void writeText(Text& text);
+		void repackTexts();
+	};
+}
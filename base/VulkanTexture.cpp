@@ -55,8 +55,8 @@ namespace vks
 	/**
 	* Load a 2D texture including all mip levels
 	*
-	* @param filename File to load (supports .ktx)
-	* @param format Vulkan format of the image data stored in the file
+	* @param filename File to load (supports .ktx and .ktx2)
+	* @param format Vulkan format of the image data stored in the file (ignored for .ktx2, which stores the format)
 	* @param device Vulkan device to create the texture on
 	* @param copyQueue Queue used for the texture staging copy commands (must support transfer)
 	* @param (Optional) imageUsageFlags Usage flags for the texture's image (defaults to VK_IMAGE_USAGE_SAMPLED_BIT)
@@ -66,6 +66,11 @@ namespace vks
 	*/
 	void Texture2D::loadFromFile(std::string filename, VkFormat format, vks::VulkanDevice *device, VkQueue copyQueue, VkImageUsageFlags imageUsageFlags, VkImageLayout imageLayout, bool forceLinear)
 	{
+		if (filename.substr(filename.find_last_of(".") + 1) == "ktx2") {
+			loadFromKTX2File(filename, device, copyQueue, imageUsageFlags, imageLayout);
+			return;
+		}
+
 		ktxTexture* ktxTexture;
 		ktxResult result = loadKTXFile(filename, &ktxTexture);
 		assert(result == KTX_SUCCESS);
@@ -330,6 +335,60 @@ namespace vks
 		updateDescriptor();
 	}
 
+	/**
+	* Load a 2D texture including all pre-computed mip levels from a KTX2 file
+	* The image data is uploaded as stored in the file, so it must use a format supported by the device and no supercompression
+	*
+	* @param filename KTX2 file to load
+	* @param device Vulkan device to create the texture on
+	* @param copyQueue Queue used for the texture staging copy commands (must support transfer)
+	* @param (Optional) imageUsageFlags Usage flags for the texture's image (defaults to VK_IMAGE_USAGE_SAMPLED_BIT)
+	* @param (Optional) imageLayout Usage layout for the texture (defaults VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+	*/
+	void Texture2D::loadFromKTX2File(std::string filename, vks::VulkanDevice *device, VkQueue copyQueue, VkImageUsageFlags imageUsageFlags, VkImageLayout imageLayout)
+	{
+		ktx2::Texture ktx2Texture;
+		std::string error;
+		if (!ktx2::loadFromFile(filename, ktx2Texture, &error)) {
+			vks::tools::exitFatal("Could not load texture from " + filename + ": " + error + "\n\nMake sure the assets submodule has been checked out and is up-to-date.", -1);
+		}
+		if (!ktx2Texture.isUploadable(device, &error)) {
+			vks::tools::exitFatal("Could not load texture from " + filename + ": " + error, -1);
+		}
+
+		this->device = device;
+		this->imageLayout = imageLayout;
+		width = ktx2Texture.width;
+		height = ktx2Texture.height;
+		mipLevels = static_cast<uint32_t>(ktx2Texture.levels.size());
+		layerCount = 1;
+
+		ktx2::createImage(ktx2Texture, device, copyQueue, imageUsageFlags, imageLayout, image, deviceMemory);
+
+		VkSamplerCreateInfo samplerCreateInfo = vks::initializers::samplerCreateInfo();
+		samplerCreateInfo.magFilter = VK_FILTER_LINEAR;
+		samplerCreateInfo.minFilter = VK_FILTER_LINEAR;
+		samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		samplerCreateInfo.compareOp = VK_COMPARE_OP_NEVER;
+		samplerCreateInfo.maxLod = (float)mipLevels;
+		samplerCreateInfo.maxAnisotropy = device->enabledFeatures.samplerAnisotropy ? device->properties.limits.maxSamplerAnisotropy : 1.0f;
+		samplerCreateInfo.anisotropyEnable = device->enabledFeatures.samplerAnisotropy;
+		samplerCreateInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+		VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCreateInfo, nullptr, &sampler));
+
+		VkImageViewCreateInfo viewCreateInfo = vks::initializers::imageViewCreateInfo();
+		viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewCreateInfo.format = ktx2Texture.format;
+		viewCreateInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 };
+		viewCreateInfo.image = image;
+		VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCreateInfo, nullptr, &view));
+
+		updateDescriptor();
+	}
+
 	/**
 	* Creates a 2D texture from a buffer
 	*
@@ -20,6 +20,7 @@
 
 #include "VulkanBuffer.h"
 #include "VulkanDevice.h"
+#include "VulkanKTX2.h"
 #include "VulkanTools.h"
 
 #if defined(__ANDROID__)
@@ -58,6 +59,12 @@ class Texture2D : public Texture
 	    VkImageUsageFlags  imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
 	    VkImageLayout      imageLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
 	    bool               forceLinear     = false);
+	void loadFromKTX2File(
+	    std::string        filename,
+	    vks::VulkanDevice *device,
+	    VkQueue            copyQueue,
+	    VkImageUsageFlags  imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
+	    VkImageLayout      imageLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 	void fromBuffer(
 	    void *             buffer,
 	    VkDeviceSize       bufferSize,
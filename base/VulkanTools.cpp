@@ -403,8 +403,9 @@ namespace vks
 			{
 				size_t size = is.tellg();
 				is.seekg(0, std::ios::beg);
-				char* shaderCode = new char[size];
-				is.read(shaderCode, size);
+				// Read into 32-bit words, as SPIR-V passed to the driver needs to be 4 byte aligned
+				std::vector<uint32_t> shaderCode((size + 3) / 4);
+				is.read(reinterpret_cast<char*>(shaderCode.data()), size);
 				is.close();
 
 				assert(size > 0);
@@ -413,12 +414,10 @@ namespace vks
 				VkShaderModuleCreateInfo moduleCreateInfo{};
 				moduleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
 				moduleCreateInfo.codeSize = size;
-				moduleCreateInfo.pCode = (uint32_t*)shaderCode;
+				moduleCreateInfo.pCode = shaderCode.data();
 
 				VK_CHECK_RESULT(vkCreateShaderModule(device, &moduleCreateInfo, NULL, &shaderModule));
 
-				delete[] shaderCode;
-
 				return shaderModule;
 			}
 			else
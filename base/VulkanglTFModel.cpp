@@ -1328,6 +1328,11 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 	vkDestroyBuffer(device->logicalDevice, indexStaging.buffer, nullptr);
 	vkFreeMemory(device->logicalDevice, indexStaging.memory, nullptr);
 
+	if (fileLoadingFlags & FileLoadingFlags::KeepHostData) {
+		vertexData = std::move(vertexBuffer);
+		indexData = std::move(indexBuffer);
+	}
+
 	getSceneDimensions();
 
 	// Setup descriptors
@@ -241,7 +241,9 @@ namespace vkglTF
 		PreTransformVertices = 0x00000001,
 		PreMultiplyVertexColors = 0x00000002,
 		FlipY = 0x00000004,
-		DontLoadImages = 0x00000008
+		DontLoadImages = 0x00000008,
+		// Keep a copy of the (pre-transformed) vertex and index data in host memory, e.g. for building acceleration structures on the CPU
+		KeepHostData = 0x00000010
 	};
 
 	enum RenderFlags {
@@ -274,6 +276,10 @@ namespace vkglTF
 			VkDeviceMemory memory;
 		} indices;
 
+		// Only filled if the model was loaded with FileLoadingFlags::KeepHostData
+		std::vector<Vertex> vertexData;
+		std::vector<uint32_t> indexData;
+
 		std::vector<Node*> nodes;
 		std::vector<Node*> linearNodes;
 
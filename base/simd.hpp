@@ -0,0 +1,128 @@
+/*
+* Thin wrappers around the SIMD instruction sets used by the examples to process multiple values at once
+*
+* Only one instruction set is compiled in, selected by the compiler flags: 8 wide AVX2 (enabled with the USE_AVX2 CMake option), 4 wide SSE2 (always available on x64) or 4 wide NEON
+* If none of them is available, VKS_SIMD_NONE is defined and code should fall back to a scalar path
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace simd
+{
+#if defined(__AVX2__)
+	#define VKS_SIMD_NAME "AVX2"
+	const uint32_t width = 8;
+	typedef __m256 vfloat;
+	typedef __m256i vint;
+	inline vfloat load(const float* p) { return _mm256_loadu_ps(p); }
+	inline void store(float* p, vfloat a) { _mm256_storeu_ps(p, a); }
+	inline vfloat set(float a) { return _mm256_set1_ps(a); }
+	inline vint loadi(const int32_t* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+	inline vint seti(int32_t a) { return _mm256_set1_epi32(a); }
+	inline vfloat add(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+	inline vfloat sub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+	inline vfloat mul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+	inline vfloat div(vfloat a, vfloat b) { return _mm256_div_ps(a, b); }
+	inline vfloat sqrt(vfloat a) { return _mm256_sqrt_ps(a); }
+	inline vfloat floor(vfloat a) { return _mm256_floor_ps(a); }
+	// Only used on values that already are integral
+	inline vint toInt(vfloat a) { return _mm256_cvtps_epi32(a); }
+	inline vint addi(vint a, vint b) { return _mm256_add_epi32(a, b); }
+	inline vint andi(vint a, vint b) { return _mm256_and_si256(a, b); }
+	inline vint lessThan(vint a, vint b) { return _mm256_cmpgt_epi32(b, a); }
+	inline vint equal(vint a, vint b) { return _mm256_cmpeq_epi32(a, b); }
+	// Returns a where the mask is set, b otherwise
+	inline vfloat select(vint mask, vfloat a, vfloat b) { return _mm256_blendv_ps(b, a, _mm256_castsi256_ps(mask)); }
+	// Flips the sign where the mask is set
+	inline vfloat negate(vint mask, vfloat a) { return _mm256_xor_ps(a, _mm256_and_ps(_mm256_castsi256_ps(mask), _mm256_set1_ps(-0.0f))); }
+	inline vint gather(const uint32_t* table, vint index) { return _mm256_i32gather_epi32(reinterpret_cast<const int*>(table), index, 4); }
+#elif defined(__SSE2__) || defined(_M_X64)
+	#define VKS_SIMD_NAME "SSE2"
+	const uint32_t width = 4;
+	typedef __m128 vfloat;
+	typedef __m128i vint;
+	inline vfloat load(const float* p) { return _mm_loadu_ps(p); }
+	inline void store(float* p, vfloat a) { _mm_storeu_ps(p, a); }
+	inline vfloat set(float a) { return _mm_set1_ps(a); }
+	inline vint loadi(const int32_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+	inline vint seti(int32_t a) { return _mm_set1_epi32(a); }
+	inline vfloat add(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+	inline vfloat sub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+	inline vfloat mul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+	inline vfloat div(vfloat a, vfloat b) { return _mm_div_ps(a, b); }
+	inline vfloat sqrt(vfloat a) { return _mm_sqrt_ps(a); }
+	inline vfloat floor(vfloat a)
+	{
+		// SSE2 has no rounding instruction, so truncate and subtract one where that rounded up (negative values)
+		const vfloat t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+		return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.0f)));
+	}
+	inline vint toInt(vfloat a) { return _mm_cvttps_epi32(a); }
+	inline vint addi(vint a, vint b) { return _mm_add_epi32(a, b); }
+	inline vint andi(vint a, vint b) { return _mm_and_si128(a, b); }
+	inline vint lessThan(vint a, vint b) { return _mm_cmplt_epi32(a, b); }
+	inline vint equal(vint a, vint b) { return _mm_cmpeq_epi32(a, b); }
+	inline vfloat select(vint mask, vfloat a, vfloat b)
+	{
+		const vfloat m = _mm_castsi128_ps(mask);
+		return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+	}
+	inline vfloat negate(vint mask, vfloat a) { return _mm_xor_ps(a, _mm_and_ps(_mm_castsi128_ps(mask), _mm_set1_ps(-0.0f))); }
+	inline vint gather(const uint32_t* table, vint index)
+	{
+		alignas(16) uint32_t i[4];
+		_mm_store_si128(reinterpret_cast<vint*>(i), index);
+		return _mm_setr_epi32(table[i[0]], table[i[1]], table[i[2]], table[i[3]]);
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	#define VKS_SIMD_NAME "NEON"
+	const uint32_t width = 4;
+	typedef float32x4_t vfloat;
+	typedef int32x4_t vint;
+	inline vfloat load(const float* p) { return vld1q_f32(p); }
+	inline void store(float* p, vfloat a) { vst1q_f32(p, a); }
+	inline vfloat set(float a) { return vdupq_n_f32(a); }
+	inline vint loadi(const int32_t* p) { return vld1q_s32(p); }
+	inline vint seti(int32_t a) { return vdupq_n_s32(a); }
+	inline vfloat add(vfloat a, vfloat b) { return vaddq_f32(a, b); }
+	inline vfloat sub(vfloat a, vfloat b) { return vsubq_f32(a, b); }
+	inline vfloat mul(vfloat a, vfloat b) { return vmulq_f32(a, b); }
+	inline vfloat div(vfloat a, vfloat b) { return vdivq_f32(a, b); }
+	inline vfloat sqrt(vfloat a) { return vsqrtq_f32(a); }
+	inline vfloat floor(vfloat a) { return vrndmq_f32(a); }
+	inline vint toInt(vfloat a) { return vcvtq_s32_f32(a); }
+	inline vint addi(vint a, vint b) { return vaddq_s32(a, b); }
+	inline vint andi(vint a, vint b) { return vandq_s32(a, b); }
+	inline vint lessThan(vint a, vint b) { return vreinterpretq_s32_u32(vcltq_s32(a, b)); }
+	inline vint equal(vint a, vint b) { return vreinterpretq_s32_u32(vceqq_s32(a, b)); }
+	inline vfloat select(vint mask, vfloat a, vfloat b) { return vbslq_f32(vreinterpretq_u32_s32(mask), a, b); }
+	inline vfloat negate(vint mask, vfloat a) { return vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(a), vandq_u32(vreinterpretq_u32_s32(mask), vdupq_n_u32(0x80000000)))); }
+	inline vint gather(const uint32_t* table, vint index)
+	{
+		// NEON has no gather, so the lanes are loaded one by one
+		uint32x4_t r = vdupq_n_u32(table[vgetq_lane_s32(index, 0)]);
+		r = vsetq_lane_u32(table[vgetq_lane_s32(index, 1)], r, 1);
+		r = vsetq_lane_u32(table[vgetq_lane_s32(index, 2)], r, 2);
+		r = vsetq_lane_u32(table[vgetq_lane_s32(index, 3)], r, 3);
+		return vreinterpretq_s32_u32(r);
+	}
+#else
+	#define VKS_SIMD_NONE
+	#define VKS_SIMD_NAME "none"
+	const uint32_t width = 1;
+#endif
+}
@@ -215,6 +215,14 @@ std::string VulkanExampleBase::getShadersPath() const
 	return getShaderBasePath() + shaderDir + "/";
 }
 
+void VulkanExampleBase::requireGlslShaders()
+{
+	if (shaderDir != "glsl") {
+		std::cerr << "This example only supports GLSL shaders, ignoring shader type '" << shaderDir << "'\n";
+		shaderDir = "glsl";
+	}
+}
+
 void VulkanExampleBase::createPipelineCache()
 {
 	VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
@@ -242,7 +250,7 @@ void VulkanExampleBase::prepare()
 #endif
 
 
-	settings.overlay = settings.overlay && (!benchmark.active);
+	settings.overlay = settings.overlay && (!benchmark.active) && (!settings.headless);
 	if (settings.overlay) {
 		ui.device = vulkanDevice;
 		ui.queue = queue;
@@ -260,14 +268,13 @@ VkPipelineShaderStageCreateInfo VulkanExampleBase::loadShader(std::string fileNa
 	VkPipelineShaderStageCreateInfo shaderStage = {};
 	shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	shaderStage.stage = stage;
-#if defined(VK_USE_PLATFORM_ANDROID_KHR)
-	shaderStage.module = vks::tools::loadShader(androidApp->activity->assetManager, fileName.c_str(), device);
-#else
-	shaderStage.module = vks::tools::loadShader(fileName.c_str(), device);
-#endif
+	bool created = false;
+	shaderStage.module = shaderCache.get(fileName, &created);
 	shaderStage.pName = "main";
 	assert(shaderStage.module != VK_NULL_HANDLE);
-	shaderModules.push_back(shaderStage.module);
+	if (created) {
+		shaderModules.push_back(shaderStage.module);
+	}
 	return shaderStage;
 }
 
@@ -323,6 +330,9 @@ void VulkanExampleBase::nextFrame()
 
 void VulkanExampleBase::renderLoop()
 {
+	// All shaders used at startup have been loaded by now
+	std::cout << "Shader modules: " << shaderCache.statistics.modules << " created for " << shaderCache.statistics.requests << " requests ("
+		<< shaderCache.statistics.packedModules << " from pack), read " << shaderCache.statistics.readTime << " ms, creation " << shaderCache.statistics.moduleCreationTime << " ms\n";
 // SRS - for non-apple plaforms, handle benchmarking here within VulkanExampleBase::renderLoop()
 //     - for macOS, handle benchmarking within NSApp rendering loop via displayLinkOutputCb()
 #if !(defined(VK_USE_PLATFORM_IOS_MVK) || defined(VK_USE_PLATFORM_MACOS_MVK) || defined(VK_USE_PLATFORM_METAL_EXT))
@@ -352,6 +362,11 @@ void VulkanExampleBase::renderLoop()
 	}
 #endif
 
+	if (settings.headless) {
+		renderHeadless();
+		return;
+	}
+
 	destWidth = width;
 	destHeight = height;
 	lastTimestamp = std::chrono::high_resolution_clock::now();
@@ -700,6 +715,107 @@ void VulkanExampleBase::renderLoop()
 	}
 }
 
+void VulkanExampleBase::renderHeadless()
+{
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << "Headless run\n";
+	std::cout << "device : " << deviceProperties.deviceName << "\n";
+	std::cout << "size   : " << width << "x" << height << "\n";
+	std::cout << "frames : " << headlessSettings.frameCount << "\n";
+
+	std::vector<double> frameTimes;
+	frameTimes.reserve(headlessSettings.frameCount);
+	lastTimestamp = std::chrono::high_resolution_clock::now();
+	uint32_t intervalFrames = 0;
+	double intervalTime = 0.0;
+	for (uint32_t frame = 0; frame < headlessSettings.frameCount; frame++) {
+		auto tStart = std::chrono::high_resolution_clock::now();
+		render();
+		auto tEnd = std::chrono::high_resolution_clock::now();
+		double tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+		frameTimes.push_back(tDiff);
+
+		// Animations advance with a fixed time step, so captured frames are reproducible independent of device speed
+		frameTimer = 1.0f / 60.0f;
+		camera.update(frameTimer);
+		if (!paused) {
+			timer += timerSpeed * frameTimer;
+			if (timer > 1.0) {
+				timer -= 1.0f;
+			}
+		}
+
+		if (std::find(headlessSettings.captureFrames.begin(), headlessSettings.captureFrames.end(), frame) != headlessSettings.captureFrames.end()) {
+			captureHeadlessFrame(frame);
+		}
+
+		// Stream frame time statistics once per second
+		intervalFrames++;
+		intervalTime += tDiff;
+		if (std::chrono::duration<double, std::milli>(tEnd - lastTimestamp).count() > 1000.0) {
+			lastFPS = static_cast<uint32_t>(intervalFrames * 1000.0 / intervalTime);
+			std::cout << "frame " << frame << ": " << (intervalTime / intervalFrames) << " ms avg (" << lastFPS << " fps)\n";
+			intervalFrames = 0;
+			intervalTime = 0.0;
+			lastTimestamp = tEnd;
+		}
+	}
+	vkDeviceWaitIdle(device);
+
+	if (frameTimes.empty()) {
+		return;
+	}
+	std::vector<double> sortedFrameTimes = frameTimes;
+	std::sort(sortedFrameTimes.begin(), sortedFrameTimes.end());
+	const double tAvg = std::accumulate(frameTimes.begin(), frameTimes.end(), 0.0) / (double)frameTimes.size();
+	const double tP95 = sortedFrameTimes[std::min(sortedFrameTimes.size() - 1, (size_t)(sortedFrameTimes.size() * 0.95))];
+	std::cout << "Headless run finished\n";
+	std::cout << "min    : " << sortedFrameTimes.front() << " ms\n";
+	std::cout << "avg    : " << tAvg << " ms (" << (1000.0 / tAvg) << " fps)\n";
+	std::cout << "p95    : " << tP95 << " ms\n";
+	std::cout << "max    : " << sortedFrameTimes.back() << " ms\n";
+}
+
+void VulkanExampleBase::captureHeadlessFrame(uint32_t frameIndex)
+{
+	// submitFrame waits for the queue to become idle, so the last rendered image can be read back right away
+	VkImage srcImage = swapChain.images[currentBuffer];
+	const VkDeviceSize imageSize = (VkDeviceSize)width * height * 4;
+
+	vks::Buffer readbackBuffer;
+	VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &readbackBuffer, imageSize));
+
+	VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, cmdPool, true);
+	const VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	vks::tools::setImageLayout(copyCmd, srcImage, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, subresourceRange);
+	VkBufferImageCopy copyRegion{};
+	copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	copyRegion.imageExtent = { width, height, 1 };
+	vkCmdCopyImageToBuffer(copyCmd, srcImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer.buffer, 1, &copyRegion);
+	vks::tools::setImageLayout(copyCmd, srcImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, subresourceRange);
+	vulkanDevice->flushCommandBuffer(copyCmd, queue, cmdPool);
+
+	VK_CHECK_RESULT(readbackBuffer.map());
+	const uint8_t* data = static_cast<const uint8_t*>(readbackBuffer.mapped);
+
+	// 64-bit FNV-1a hash of the raw image data, can be compared against reference values for regression testing
+	uint64_t hash = 14695981039346656037ull;
+	for (VkDeviceSize i = 0; i < imageSize; i++) {
+		hash = (hash ^ data[i]) * 1099511628211ull;
+	}
+	std::cout << "frame " << frameIndex << " hash: " << std::hex << std::setw(16) << std::setfill('0') << hash << std::dec << std::setfill(' ') << "\n";
+
+	if (headlessSettings.dumpFrames) {
+		const std::string filename = name + "_" + std::to_string(frameIndex) + ".ppm";
+		// PPM stores RGB, so BGR(A) images need to be swizzled
+		const bool colorSwizzle = (swapChain.colorFormat == VK_FORMAT_B8G8R8A8_SRGB) || (swapChain.colorFormat == VK_FORMAT_B8G8R8A8_UNORM) || (swapChain.colorFormat == VK_FORMAT_B8G8R8A8_SNORM);
+		vks::FrameCapture::writeImage(filename, data, width, height, (size_t)width * 4, colorSwizzle);
+		std::cout << "frame " << frameIndex << " written to " << filename << "\n";
+	}
+
+	readbackBuffer.destroy();
+}
+
 void VulkanExampleBase::updateOverlay()
 {
 	if (!settings.overlay)
@@ -824,6 +940,11 @@ VulkanExampleBase::VulkanExampleBase()
 	commandLineParser.add("benchmarkresultfile", { "-bf", "--benchfilename" }, 1, "Set file name for benchmark results");
 	commandLineParser.add("benchmarkresultframes", { "-bt", "--benchframetimes" }, 0, "Save frame times to benchmark results file");
 	commandLineParser.add("benchmarkframes", { "-bfs", "--benchmarkframes" }, 1, "Only render the given number of frames");
+	commandLineParser.add("headless", { "-hl", "--headless" }, 0, "Render offscreen without a window and without presenting");
+	commandLineParser.add("headlessframes", { "-hlf", "--headlessframes" }, 1, "Number of frames to render in headless mode");
+	commandLineParser.add("headlesscapture", { "-hlc", "--headlesscapture" }, 1, "Comma separated list of frames to hash in headless mode");
+	commandLineParser.add("headlessdump", { "-hld", "--headlessdump" }, 0, "Write captured headless frames to PPM files");
+	commandLineParser.add("shaderpack", { "-sp", "--shaderpack" }, 0, "Store the SPIR-V of the example in a pack file under cache/shaders and load it from there");
 #if (!(defined(VK_USE_PLATFORM_IOS_MVK) || defined(VK_USE_PLATFORM_MACOS_MVK) || defined(VK_USE_PLATFORM_METAL_EXT)))
 	commandLineParser.add("resourcepath", { "-rp", "--resourcepath" }, 1, "Set path for dir where assets and shaders folder is present");
 #endif
@@ -882,6 +1003,32 @@ VulkanExampleBase::VulkanExampleBase()
 	if (commandLineParser.isSet("benchmarkframes")) {
 		benchmark.outputFrames = commandLineParser.getValueAsInt("benchmarkframes", benchmark.outputFrames);
 	}
+	if (commandLineParser.isSet("headless")) {
+		settings.headless = true;
+		vks::tools::errorModeSilent = true;
+	}
+	if (commandLineParser.isSet("headlessframes")) {
+		headlessSettings.frameCount = commandLineParser.getValueAsInt("headlessframes", headlessSettings.frameCount);
+	}
+	if (commandLineParser.isSet("headlesscapture")) {
+		std::stringstream frameList(commandLineParser.getValueAsString("headlesscapture", ""));
+		std::string frame;
+		while (std::getline(frameList, frame, ',')) {
+			char* numConvPtr;
+			long frameIndex = strtol(frame.c_str(), &numConvPtr, 10);
+			if (frame.empty() || (*numConvPtr != '\0') || (frameIndex < 0)) {
+				std::cerr << "Invalid frame index '" << frame << "' for headless capture, must be a non-negative number\n";
+				continue;
+			}
+			headlessSettings.captureFrames.push_back(static_cast<uint32_t>(frameIndex));
+		}
+	}
+	if (commandLineParser.isSet("headlessdump")) {
+		headlessSettings.dumpFrames = true;
+	}
+	if (commandLineParser.isSet("shaderpack")) {
+		shaderCache.usePack = true;
+	}
 #if (!(defined(VK_USE_PLATFORM_IOS_MVK) || defined(VK_USE_PLATFORM_MACOS_MVK) || defined(VK_USE_PLATFORM_METAL_EXT)))
 	if(commandLineParser.isSet("resourcepath")) {
 		vks::tools::resourcePath = commandLineParser.getValueAsString("resourcepath", "");
@@ -930,9 +1077,13 @@ VulkanExampleBase::VulkanExampleBase()
 #elif defined(_DIRECT2DISPLAY)
 
 #elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
-	initWaylandConnection();
+	if (!settings.headless) {
+		initWaylandConnection();
+	}
 #elif defined(VK_USE_PLATFORM_XCB_KHR)
-	initxcbConnection();
+	if (!settings.headless) {
+		initxcbConnection();
+	}
 #endif
 
 #if defined(_WIN32)
@@ -963,10 +1114,7 @@ VulkanExampleBase::~VulkanExampleBase()
 		vkDestroyFramebuffer(device, frameBuffer, nullptr);
 	}
 
-	for (auto& shaderModule : shaderModules)
-	{
-		vkDestroyShaderModule(device, shaderModule, nullptr);
-	}
+	shaderCache.destroy();
 	vkDestroyImageView(device, depthStencil.view, nullptr);
 	vkDestroyImage(device, depthStencil.image, nullptr);
 	vkFreeMemory(device, depthStencil.memory, nullptr);
@@ -1008,6 +1156,9 @@ VulkanExampleBase::~VulkanExampleBase()
 	if (dfb)
 		dfb->Release(dfb);
 #elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
+	if (settings.headless) {
+		return;
+	}
 	xdg_toplevel_destroy(xdg_toplevel);
 	xdg_surface_destroy(xdg_surface);
 	wl_surface_destroy(surface);
@@ -1022,8 +1173,10 @@ VulkanExampleBase::~VulkanExampleBase()
 	wl_registry_destroy(registry);
 	wl_display_disconnect(display);
 #elif defined(VK_USE_PLATFORM_XCB_KHR)
-	xcb_destroy_window(connection, window);
-	xcb_disconnect(connection);
+	if (!settings.headless) {
+		xcb_destroy_window(connection, window);
+		xcb_disconnect(connection);
+	}
 #elif defined(VK_USE_PLATFORM_SCREEN_QNX)
 	screen_destroy_event(screen_event);
 	screen_destroy_window(screen_window);
@@ -1129,6 +1282,11 @@ bool VulkanExampleBase::initVulkan()
 	}
 	device = vulkanDevice->logicalDevice;
 
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+	shaderCache.assetManager = androidApp->activity->assetManager;
+#endif
+	shaderCache.create(device, name);
+
 	// Get a graphics queue from the device
 	vkGetDeviceQueue(device, vulkanDevice->queueFamilyIndices.graphics, 0, &queue);
 
@@ -1208,6 +1366,11 @@ HWND VulkanExampleBase::setupWindow(HINSTANCE hinstance, WNDPROC wndproc)
 {
 	this->windowInstance = hinstance;
 
+	if (settings.headless) {
+		setupConsole("Vulkan example");
+		return nullptr;
+	}
+
 	WNDCLASSEX wndClass{};
 
 	wndClass.cbSize = sizeof(WNDCLASSEX);
@@ -2531,6 +2694,9 @@ static const struct xdg_toplevel_listener xdg_toplevel_listener = {
 
 struct xdg_surface *VulkanExampleBase::setupWindow()
 {
+	if (settings.headless) {
+		return nullptr;
+	}
 	surface = wl_compositor_create_surface(compositor);
 	xdg_surface = xdg_wm_base_get_xdg_surface(shell, surface);
 
@@ -2561,6 +2727,10 @@ static inline xcb_intern_atom_reply_t* intern_atom_helper(xcb_connection_t *conn
 // Set up a window using XCB and request event types
 xcb_window_t VulkanExampleBase::setupWindow()
 {
+	if (settings.headless) {
+		return 0;
+	}
+
 	uint32_t value_mask, value_list[32];
 
 	window = xcb_generate_id(connection);
@@ -3091,7 +3261,7 @@ void VulkanExampleBase::setupDepthStencil()
 	imageCI.arrayLayers = 1;
 	imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
 	imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-	imageCI.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	imageCI.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | depthStencilUsage;
 
 	VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &depthStencil.image));
 	VkMemoryRequirements memReqs{};
@@ -3314,6 +3484,11 @@ void VulkanExampleBase::windowResized() {}
 
 void VulkanExampleBase::createSurface()
 {
+	// Headless runs render into offscreen images that don't require a platform surface
+	if (settings.headless) {
+		swapChain.initHeadless(queue, vulkanDevice->queueFamilyIndices.graphics);
+		return;
+	}
 #if defined(_WIN32)
 	swapChain.initSurface(windowInstance, window);
 #elif defined(VK_USE_PLATFORM_ANDROID_KHR)
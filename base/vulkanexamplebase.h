@@ -47,6 +47,7 @@
 #include <random>
 #include <algorithm>
 #include <sys/stat.h>
+#include <sstream>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -70,6 +71,8 @@
 #include "VulkanBuffer.h"
 #include "VulkanDevice.h"
 #include "VulkanTexture.h"
+#include "VulkanShaderCache.h"
+#include "VulkanFrameCapture.h"
 
 #include "VulkanInitializers.hpp"
 #include "camera.hpp"
@@ -92,10 +95,14 @@ private:
 	void createSwapChain();
 	void createCommandBuffers();
 	void destroyCommandBuffers();
+	void renderHeadless();
+	void captureHeadlessFrame(uint32_t frameIndex);
 	std::string shaderDir = "glsl";
 protected:
 	// Returns the path to the root of the glsl, hlsl or slang shader directory.
 	std::string getShadersPath() const;
+	// Selects the GLSL shaders for examples whose shaders are only up to date in GLSL (must be called in the derived constructor)
+	void requireGlslShaders();
 
 	// Frame counter to display fps
 	uint32_t frameCounter = 0;
@@ -144,8 +151,10 @@ protected:
 	uint32_t currentBuffer = 0;
 	// Descriptor set pool
 	VkDescriptorPool descriptorPool{ VK_NULL_HANDLE };
-	// List of shader modules created (stored for cleanup)
+	// List of unique shader modules created by loadShader (owned by the shader cache)
 	std::vector<VkShaderModule> shaderModules;
+	// Shares shader modules between pipelines that load the same file and packs the SPIR-V of the example into a single file
+	vks::ShaderModuleCache shaderCache;
 	// Pipeline cache object
 	VkPipelineCache pipelineCache{ VK_NULL_HANDLE };
 	// Wraps the swap chain to present images (framebuffers) to the windowing system
@@ -159,6 +168,8 @@ protected:
 	} semaphores{};
 	std::vector<VkFence> waitFences;
 	bool requiresStencil{ false };
+	// Additional usage flags for the depth stencil image, e.g. to sample it once the render pass has finished
+	VkImageUsageFlags depthStencilUsage{ 0 };
 public:
 	bool prepared = false;
 	bool resized = false;
@@ -187,8 +198,20 @@ public:
 		bool vsync = false;
 		/** @brief Enable UI overlay */
 		bool overlay = true;
+		/** @brief Render into offscreen images without a window or presentation (see --headless) */
+		bool headless = false;
 	} settings;
 
+	/** @brief Options for headless runs that can be changed by command line arguments */
+	struct HeadlessSettings {
+		/** @brief Number of frames to render before exiting */
+		uint32_t frameCount = 100;
+		/** @brief Indices of frames whose content is hashed (and optionally written to disk) */
+		std::vector<uint32_t> captureFrames;
+		/** @brief Write captured frames to PPM files in addition to hashing them */
+		bool dumpFrames = false;
+	} headlessSettings;
+
 	/** @brief State of gamepad input (only used on Android) */
 	struct {
 		glm::vec2 axisLeft = glm::vec2(0.0f);
@@ -1,5 +1,10 @@
 /*
-* Vulkan Example - Implements a separable two-pass fullscreen blur (also known as bloom)
+* Vulkan Example - Implements a fullscreen bloom effect
+*
+* The glowing parts of the scene are rendered to an offscreen target and blurred with one of two methods:
+* Separable blur: A fixed size (FB_DIM) target is blurred with a vertical and a horizontal fullscreen pass
+* Compute mip chain: A window sized target is progressively downsampled and upsampled with compute shaders (see vks::Bloom)
+* The time spent on the bloom is measured with timestamps, a comparison of both methods can be run from the UI
 *
 * Copyright (C) 2016 - 2023 Sascha Willems - www.saschawillems.de
 *
@@ -8,7 +13,8 @@
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
-
+#include "VulkanBloom.h"
+#include "VulkanQueryManager.h"
 
 // Offscreen frame buffer properties
 #define FB_DIM 256
@@ -19,6 +25,13 @@ class VulkanExample : public VulkanExampleBase
 public:
 	bool bloom = true;
 
+	enum BloomMethod : int32_t {
+		SeparableBlur = 0,
+		ComputeMipChain = 1
+	};
+	int32_t bloomMethod = ComputeMipChain;
+	vks::Bloom bloomFilter;
+
 	vks::TextureCubeMap cubemap;
 
 	struct {
@@ -52,6 +65,7 @@ public:
 	struct {
 		VkPipeline blurVert;
 		VkPipeline blurHorz;
+		VkPipeline composite;
 		VkPipeline glowPass;
 		VkPipeline phongPass;
 		VkPipeline skyBox;
@@ -65,6 +79,7 @@ public:
 	struct {
 		VkDescriptorSet blurVert;
 		VkDescriptorSet blurHorz;
+		VkDescriptorSet composite;
 		VkDescriptorSet scene;
 		VkDescriptorSet skyBox;
 	} descriptorSets;
@@ -90,11 +105,31 @@ public:
 		VkRenderPass renderPass;
 		VkSampler sampler;
 		std::array<FrameBuffer, 2> framebuffers;
+		// Window sized glow target for the compute bloom
+		FrameBuffer glow;
 	} offscreenPass;
 
+	// The bloom cost is measured from the start of the frame to the main render pass and around the composition of the bloom
+	vks::QueryManager timestamps;
+	bool timestampsSupported{ false };
+	float bloomTime{ 0.0f };
+
+	// Alternately measures both bloom methods at the current resolution
+	struct {
+		bool active{ false };
+		int32_t previousMethod{ ComputeMipChain };
+		uint32_t frame{ 0 };
+		const uint32_t warmupFrames{ 30 };
+		const uint32_t measuredFrames{ 240 };
+		float results[2]{};
+		bool hasResults{ false };
+	} comparison;
+
 	VulkanExample() : VulkanExampleBase()
 	{
 		title = "Bloom (offscreen rendering)";
+		// The compute bloom passes only have GLSL shaders
+		requireGlslShaders();
 		timerSpeed *= 0.5f;
 		camera.type = Camera::CameraType::lookat;
 		camera.setPosition(glm::vec3(0.0f, 0.0f, -10.25f));
@@ -112,20 +147,19 @@ public:
 		// Frame buffer
 		for (auto& framebuffer : offscreenPass.framebuffers)
 		{
-			// Attachments
-			vkDestroyImageView(device, framebuffer.color.view, nullptr);
-			vkDestroyImage(device, framebuffer.color.image, nullptr);
-			vkFreeMemory(device, framebuffer.color.mem, nullptr);
-			vkDestroyImageView(device, framebuffer.depth.view, nullptr);
-			vkDestroyImage(device, framebuffer.depth.image, nullptr);
-			vkFreeMemory(device, framebuffer.depth.mem, nullptr);
-
-			vkDestroyFramebuffer(device, framebuffer.framebuffer, nullptr);
+			destroyOffscreenFramebuffer(&framebuffer);
 		}
+		destroyOffscreenFramebuffer(&offscreenPass.glow);
 		vkDestroyRenderPass(device, offscreenPass.renderPass, nullptr);
 
+		bloomFilter.destroy();
+		if (timestampsSupported) {
+			timestamps.destroy();
+		}
+
 		vkDestroyPipeline(device, pipelines.blurHorz, nullptr);
 		vkDestroyPipeline(device, pipelines.blurVert, nullptr);
+		vkDestroyPipeline(device, pipelines.composite, nullptr);
 		vkDestroyPipeline(device, pipelines.phongPass, nullptr);
 		vkDestroyPipeline(device, pipelines.glowPass, nullptr);
 		vkDestroyPipeline(device, pipelines.skyBox, nullptr);
@@ -144,16 +178,29 @@ public:
 		cubemap.destroy();
 	}
 
+	void destroyOffscreenFramebuffer(FrameBuffer *frameBuf)
+	{
+		// Attachments
+		vkDestroyImageView(device, frameBuf->color.view, nullptr);
+		vkDestroyImage(device, frameBuf->color.image, nullptr);
+		vkFreeMemory(device, frameBuf->color.mem, nullptr);
+		vkDestroyImageView(device, frameBuf->depth.view, nullptr);
+		vkDestroyImage(device, frameBuf->depth.image, nullptr);
+		vkFreeMemory(device, frameBuf->depth.mem, nullptr);
+
+		vkDestroyFramebuffer(device, frameBuf->framebuffer, nullptr);
+	}
+
 	// Setup the offscreen framebuffer for rendering the mirrored scene
 	// The color attachment of this framebuffer will then be sampled from
-	void prepareOffscreenFramebuffer(FrameBuffer *frameBuf, VkFormat colorFormat, VkFormat depthFormat)
+	void prepareOffscreenFramebuffer(FrameBuffer *frameBuf, VkFormat colorFormat, VkFormat depthFormat, uint32_t fbWidth, uint32_t fbHeight)
 	{
 		// Color attachment
 		VkImageCreateInfo image = vks::initializers::imageCreateInfo();
 		image.imageType = VK_IMAGE_TYPE_2D;
 		image.format = colorFormat;
-		image.extent.width = FB_DIM;
-		image.extent.height = FB_DIM;
+		image.extent.width = fbWidth;
+		image.extent.height = fbHeight;
 		image.extent.depth = 1;
 		image.mipLevels = 1;
 		image.arrayLayers = 1;
@@ -222,8 +269,8 @@ public:
 		fbufCreateInfo.renderPass = offscreenPass.renderPass;
 		fbufCreateInfo.attachmentCount = 2;
 		fbufCreateInfo.pAttachments = attachments;
-		fbufCreateInfo.width = FB_DIM;
-		fbufCreateInfo.height = FB_DIM;
+		fbufCreateInfo.width = fbWidth;
+		fbufCreateInfo.height = fbHeight;
 		fbufCreateInfo.layers = 1;
 
 		VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &frameBuf->framebuffer));
@@ -290,7 +337,8 @@ public:
 		dependencies[1].srcSubpass = 0;
 		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
 		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		// The glow target is read by the compute bloom
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
 		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 		dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 		dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
@@ -323,8 +371,19 @@ public:
 		VK_CHECK_RESULT(vkCreateSampler(device, &sampler, nullptr, &offscreenPass.sampler));
 
 		// Create two frame buffers
-		prepareOffscreenFramebuffer(&offscreenPass.framebuffers[0], FB_COLOR_FORMAT, fbDepthFormat);
-		prepareOffscreenFramebuffer(&offscreenPass.framebuffers[1], FB_COLOR_FORMAT, fbDepthFormat);
+		prepareOffscreenFramebuffer(&offscreenPass.framebuffers[0], FB_COLOR_FORMAT, fbDepthFormat, FB_DIM, FB_DIM);
+		prepareOffscreenFramebuffer(&offscreenPass.framebuffers[1], FB_COLOR_FORMAT, fbDepthFormat, FB_DIM, FB_DIM);
+		prepareBloom();
+	}
+
+	// The glow target and the bloom mip chain of the compute bloom depend on the window size
+	void prepareBloom()
+	{
+		VkFormat fbDepthFormat;
+		VkBool32 validDepthFormat = vks::tools::getSupportedDepthFormat(physicalDevice, &fbDepthFormat);
+		assert(validDepthFormat);
+		prepareOffscreenFramebuffer(&offscreenPass.glow, FB_COLOR_FORMAT, fbDepthFormat, width, height);
+		bloomFilter.create(vulkanDevice, queue, shaderCache, getShadersPath(), offscreenPass.glow.color.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, width, height);
 	}
 
 	void buildCommandBuffers()
@@ -336,30 +395,41 @@ public:
 		VkRect2D scissor;
 
 		/*
-			The blur method used in this example is multi pass and renders the vertical blur first and then the horizontal one
+			The separable blur method renders the vertical blur first and then the horizontal one
 			While it's possible to blur in one pass, this method is widely used as it requires far less samples to generate the blur
+			The compute bloom instead builds a mip chain from a window sized glow target, which gives a wider bloom that doesn't depend on a fixed resolution
 		*/
 
+		const bool computeBloom = bloom && (bloomMethod == ComputeMipChain);
+
 		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
 		{
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
+			if (timestampsSupported) {
+				timestamps.cmdBeginFrame(drawCmdBuffers[i], i);
+				timestamps.cmdWriteTimestamp(drawCmdBuffers[i], i, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+			}
+
 			if (bloom) {
 				clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
 				clearValues[1].depthStencil = { 1.0f, 0 };
 
+				const uint32_t glowWidth = computeBloom ? width : offscreenPass.width;
+				const uint32_t glowHeight = computeBloom ? height : offscreenPass.height;
+
 				VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
 				renderPassBeginInfo.renderPass = offscreenPass.renderPass;
-				renderPassBeginInfo.framebuffer = offscreenPass.framebuffers[0].framebuffer;
-				renderPassBeginInfo.renderArea.extent.width = offscreenPass.width;
-				renderPassBeginInfo.renderArea.extent.height = offscreenPass.height;
+				renderPassBeginInfo.framebuffer = computeBloom ? offscreenPass.glow.framebuffer : offscreenPass.framebuffers[0].framebuffer;
+				renderPassBeginInfo.renderArea.extent.width = glowWidth;
+				renderPassBeginInfo.renderArea.extent.height = glowHeight;
 				renderPassBeginInfo.clearValueCount = 2;
 				renderPassBeginInfo.pClearValues = clearValues;
 
-				viewport = vks::initializers::viewport((float)offscreenPass.width, (float)offscreenPass.height, 0.0f, 1.0f);
+				viewport = vks::initializers::viewport((float)glowWidth, (float)glowHeight, 0.0f, 1.0f);
 				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
 
-				scissor = vks::initializers::rect2D(offscreenPass.width, offscreenPass.height, 0, 0);
+				scissor = vks::initializers::rect2D(glowWidth, glowHeight, 0, 0);
 				vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
 				/*
@@ -375,22 +445,33 @@ public:
 
 				vkCmdEndRenderPass(drawCmdBuffers[i]);
 
-				/*
-					Second render pass: Vertical blur
+				if (computeBloom) {
+					/*
+						Compute bloom: Downsample and upsample the glow target, the result is added when rendering the scene
+					*/
+					bloomFilter.cmdApply(drawCmdBuffers[i], VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+				} else {
+					/*
+						Second render pass: Vertical blur
 
-					Render contents of the first pass into a second framebuffer and apply a vertical blur
-					This is the first blur pass, the horizontal blur is applied when rendering on top of the scene
-				*/
+						Render contents of the first pass into a second framebuffer and apply a vertical blur
+						This is the first blur pass, the horizontal blur is applied when rendering on top of the scene
+					*/
 
-				renderPassBeginInfo.framebuffer = offscreenPass.framebuffers[1].framebuffer;
+					renderPassBeginInfo.framebuffer = offscreenPass.framebuffers[1].framebuffer;
 
-				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+					vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.blur, 0, 1, &descriptorSets.blurVert, 0, NULL);
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.blurVert);
-				vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
+					vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.blur, 0, 1, &descriptorSets.blurVert, 0, NULL);
+					vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.blurVert);
+					vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
 
-				vkCmdEndRenderPass(drawCmdBuffers[i]);
+					vkCmdEndRenderPass(drawCmdBuffers[i]);
+				}
+			}
+
+			if (timestampsSupported) {
+				timestamps.cmdWriteTimestamp(drawCmdBuffers[i], i, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
 			}
 
 			/*
@@ -398,10 +479,10 @@ public:
 			*/
 
 			/*
-				Third render pass: Scene rendering with applied vertical blur
-
-				Renders the scene and the (vertically blurred) contents of the second framebuffer and apply a horizontal blur
+				Third render pass: Scene rendering with applied bloom
 
+				Renders the scene and adds the bloom, either by applying the horizontal blur to the contents of the second framebuffer
+				or by sampling the first level of the bloom mip chain
 			*/
 			{
 				clearValues[0].color = defaultClearColor;
@@ -433,19 +514,31 @@ public:
 				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.phongPass);
 				models.ufo.draw(drawCmdBuffers[i]);
 
+				if (timestampsSupported) {
+					timestamps.cmdWriteTimestamp(drawCmdBuffers[i], i, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+				}
+
 				if (bloom)
 				{
-					vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.blur, 0, 1, &descriptorSets.blurHorz, 0, NULL);
-					vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.blurHorz);
+					vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.blur, 0, 1, computeBloom ? &descriptorSets.composite : &descriptorSets.blurHorz, 0, NULL);
+					vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, computeBloom ? pipelines.composite : pipelines.blurHorz);
 					vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
 				}
 
+				if (timestampsSupported) {
+					timestamps.cmdWriteTimestamp(drawCmdBuffers[i], i, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+				}
+
 				drawUI(drawCmdBuffers[i]);
 
 				vkCmdEndRenderPass(drawCmdBuffers[i]);
 
 			}
 
+			if (timestampsSupported) {
+				timestamps.cmdResolve(drawCmdBuffers[i], i);
+			}
+
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 		}
 	}
@@ -463,10 +556,10 @@ public:
 	{
 		// Pool
 		std::vector<VkDescriptorPoolSize> poolSizes = {
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 8),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 6)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 9),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 7)
 		};
-		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 5);
+		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 6);
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 
 		// Layouts
@@ -512,6 +605,9 @@ public:
 			vks::initializers::writeDescriptorSet(descriptorSets.blurHorz, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &offscreenPass.framebuffers[1].descriptor),	// Binding 1: Fragment shader texture sampler
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+		// Compute bloom composition
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocInfo, &descriptorSets.composite));
+		updateBloomDescriptor();
 
 		// Scene rendering
 		descriptorSetAllocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.scene, 1);
@@ -530,6 +626,16 @@ public:
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 	}
 
+	// The bloom mip chain is recreated with the window size
+	void updateBloomDescriptor()
+	{
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			vks::initializers::writeDescriptorSet(descriptorSets.composite, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.blurParams.descriptor),			// Binding 0: Fragment shader uniform buffer
+			vks::initializers::writeDescriptorSet(descriptorSets.composite, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &bloomFilter.descriptor),				// Binding 1: First level of the bloom mip chain
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	}
+
 	void preparePipelines()
 	{
 		// Layouts
@@ -592,6 +698,10 @@ public:
 		pipelineCI.renderPass = renderPass;
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.blurHorz));
 
+		// Compute bloom composition pipeline, adds the bloom mip chain using the same blend state
+		shaderStages[1] = loadShader(getShadersPath() + "bloom/composite.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.composite));
+
 		// Phong pass (3D model)
 		pipelineCI.pVertexInputState = vkglTF::Vertex::getPipelineVertexInputState({vkglTF::VertexComponent::Position, vkglTF::VertexComponent::UV, vkglTF::VertexComponent::Color, vkglTF::VertexComponent::Normal});
 		pipelineCI.layout = pipelineLayouts.scene;
@@ -679,9 +789,25 @@ public:
 		memcpy(uniformBuffers.blurParams.mapped, &ubos.blurParams, sizeof(ubos.blurParams));
 	}
 
+	void prepareTimestamps()
+	{
+		timestampsSupported = (vulkanDevice->properties.limits.timestampComputeAndGraphics == VK_TRUE) && (vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].timestampValidBits > 0);
+		if (timestampsSupported) {
+			timestamps.create(vulkanDevice, queue, VK_QUERY_TYPE_TIMESTAMP, static_cast<uint32_t>(drawCmdBuffers.size()), 4);
+		}
+	}
+
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
+		// The previous submission of this command buffer has finished, so its timestamps can be read without waiting
+		if (timestampsSupported) {
+			const float period = vulkanDevice->properties.limits.timestampPeriod / 1000000.0f;
+			bloomTime = ((timestamps.getResult(currentBuffer, 1) - timestamps.getResult(currentBuffer, 0)) + (timestamps.getResult(currentBuffer, 3) - timestamps.getResult(currentBuffer, 2))) * period;
+			if (comparison.active) {
+				updateComparison();
+			}
+		}
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
@@ -694,12 +820,61 @@ public:
 		loadAssets();
 		prepareUniformBuffers();
 		prepareOffscreen();
+		prepareTimestamps();
 		setupDescriptors();
 		preparePipelines();
 		buildCommandBuffers();
 		prepared = true;
 	}
 
+	// Measure the separable blur first, then the compute bloom
+	void startComparison()
+	{
+		comparison.active = true;
+		comparison.previousMethod = bloomMethod;
+		comparison.frame = 0;
+		comparison.results[0] = comparison.results[1] = 0.0f;
+		comparison.hasResults = false;
+		bloom = true;
+		bloomMethod = SeparableBlur;
+	}
+
+	// Accumulate the bloom time of the current method and switch to the next one once enough frames have been measured
+	// All previous frames have finished at this point, so the command buffers can be rebuilt
+	void updateComparison()
+	{
+		comparison.frame++;
+		if (comparison.frame <= comparison.warmupFrames) {
+			return;
+		}
+		comparison.results[bloomMethod] += bloomTime / (float)comparison.measuredFrames;
+		if (comparison.frame < comparison.warmupFrames + comparison.measuredFrames) {
+			return;
+		}
+		comparison.frame = 0;
+		if (bloomMethod == SeparableBlur) {
+			bloomMethod = ComputeMipChain;
+		} else {
+			comparison.active = false;
+			comparison.hasResults = true;
+			bloomMethod = comparison.previousMethod;
+			std::cout << "Bloom at " << width << "x" << height << " (average GPU times over " << comparison.measuredFrames << " frames):\n";
+			std::cout << "Separable blur (" << FB_DIM << "x" << FB_DIM << "): " << comparison.results[SeparableBlur] << " ms\n";
+			std::cout << "Compute mip chain (" << bloomFilter.mipLevels << " levels): " << comparison.results[ComputeMipChain] << " ms\n";
+		}
+		buildCommandBuffers();
+	}
+
+	// The glow target and the bloom mip chain match the window size
+	virtual void windowResized()
+	{
+		destroyOffscreenFramebuffer(&offscreenPass.glow);
+		bloomFilter.destroy();
+		prepareBloom();
+		updateBloomDescriptor();
+		buildCommandBuffers();
+	}
+
 	virtual void render()
 	{
 		if (!prepared)
@@ -717,10 +892,32 @@ public:
 			if (overlay->checkBox("Bloom", &bloom)) {
 				buildCommandBuffers();
 			}
-			if (overlay->inputFloat("Scale", &ubos.blurParams.blurScale, 0.1f, 2)) {
+			overlay->comboBox("Method", &bloomMethod, { "Separable blur", "Compute mip chain" });
+			if (bloomMethod == SeparableBlur) {
+				if (overlay->inputFloat("Scale", &ubos.blurParams.blurScale, 0.1f, 2)) {
+					updateUniformBuffersBlur();
+				}
+			} else {
+				overlay->sliderFloat("Scatter", &bloomFilter.settings.scatter, 0.0f, 1.0f);
+			}
+			if (overlay->sliderFloat("Strength", &ubos.blurParams.blurStrength, 0.0f, 4.0f)) {
 				updateUniformBuffersBlur();
 			}
 		}
+		if (timestampsSupported && overlay->header("Timings")) {
+			if (bloom) {
+				overlay->text("Bloom: %.3f ms", bloomTime);
+			}
+			if (comparison.active) {
+				overlay->text("Measuring %s...", (bloomMethod == SeparableBlur) ? "separable blur" : "compute mip chain");
+			} else if (overlay->button("Compare methods")) {
+				startComparison();
+			}
+			if (comparison.hasResults) {
+				overlay->text("Separable blur: %.3f ms", comparison.results[SeparableBlur]);
+				overlay->text("Compute mip chain: %.3f ms", comparison.results[ComputeMipChain]);
+			}
+		}
 	}
 };
 
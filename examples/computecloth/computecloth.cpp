@@ -3,6 +3,9 @@
 *
 * A compute shader updates a shader storage buffer that contains particles held together by springs and also does basic
 * collision detection against a sphere. This storage buffer is then used as the vertex input for the graphics part of the sample
+* The simulation runs on a separate compute queue using vks::AsyncCompute, so that the next simulation step is calculated while the current one is rendered
+* A C++ mirror of the simulation (vks::ClothSimulation) can run in place of the compute shader and is used to validate its results
+* Pass --validatecpu to validate every frame (e.g. on a software device in headless mode) or --cpubenchmark to measure the CPU simulation's throughput
 *
 * Copyright (C) 2016-2025 by Sascha Willems - www.saschawillems.de
 *
@@ -11,29 +14,21 @@
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "VulkanAsyncCompute.h"
+#include "VulkanCpuSimulation.h"
 
 
 class VulkanExample : public VulkanExampleBase
 {
 public:
-	uint32_t readSet{ 0 };
 	uint32_t indexCount{ 0 };
 	bool simulateWind{ false };
-	// This will be set to true, if the device has a dedicated queue from a compute only queue family
-	// With such a queue graphics and compute workloads can run in parallel, but this also requires additional barriers (often called "async compute")
-	// These barriers will release and acquire the resources used in graphics and compute between the different queue families
-	bool dedicatedComputeQueue{ false };
 
 	vks::Texture2D textureCloth;
 	vkglTF::Model modelSphere;
 
-	// The cloth is made from a grid of particles
-	struct Particle {
-		glm::vec4 pos;
-		glm::vec4 vel;
-		glm::vec4 uv;
-		glm::vec4 normal;
-	};
+	// The cloth is made from a grid of particles, the layout is shared with the CPU simulation
+	typedef vks::ClothSimulation::Particle Particle;
 
 	// Cloth definition parameters
 	struct Cloth {
@@ -43,12 +38,12 @@ public:
 
 	// We put the resource "types" into structs to make this sample easier to understand
 
-	// We use two buffers for our cloth simulation: One with the input cloth data and one for outputting updated values
-	// The compute pipeline will update the output buffer, and the graphics pipeline will it as a vertex buffer
-	struct StorageBuffers {
-		vks::Buffer input;
-		vks::Buffer output;
-	} storageBuffers;
+	// Each simulation step runs a number of iterations, and every iteration reads the cloth from one buffer and writes the updated values to another one
+	// The final result of a step ends up in one of the two storage buffers of the async compute helper, which the graphics pipeline uses as a vertex buffer
+	// While the next step is calculated into one of them, the other one is displayed, so the iterations in between alternate with a scratch buffer only used by compute
+	// The buffers, the compute queue and the synchronization between compute and graphics are managed by the async compute helper
+	vks::AsyncCompute asyncCompute;
+	vks::Buffer scratchBuffer;
 
 	// Resources for the graphics part of the example
 	struct Graphics {
@@ -61,6 +56,8 @@ public:
 		} pipelines;
 		// The vertices will be stored in the shader storage buffers, so we only need an index buffer in this structure
 		vks::Buffer indices;
+		// Render the results of odd simulation steps (drawCmdBuffers render the even ones)
+		std::vector<VkCommandBuffer> oddStepCommandBuffers;
 		struct UniformData {
 			glm::mat4 projection;
 			glm::mat4 view;
@@ -70,19 +67,14 @@ public:
 	} graphics;
 
 	// Resources for the compute part of the example
-	// Number of compute command buffers: set to 1 for serialized processing or 2 for in-parallel with graphics queue
-	static constexpr size_t computeCommandBufferCount = 2 ;
+	// Number of simulation iterations per frame
+	// Iterations **must** be an even number, so that the final iteration writes from the scratch buffer into the step's storage buffer
+	static constexpr uint32_t iterations = 64;
+	static_assert(iterations % 2 == 0, "Simulation iterations must be an even number");
 	struct Compute {
-		typedef struct Semaphores_t {
-			VkSemaphore ready{ VK_NULL_HANDLE };
-			VkSemaphore complete{ VK_NULL_HANDLE };
-		} semaphores_t;
-		std::array<semaphores_t, computeCommandBufferCount> semaphores{};
-		VkQueue queue{ VK_NULL_HANDLE };
-		VkCommandPool commandPool{ VK_NULL_HANDLE };
-		std::array<VkCommandBuffer, computeCommandBufferCount> commandBuffers{};
 		VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
-		std::array<VkDescriptorSet, 2> descriptorSets{ VK_NULL_HANDLE };
+		// Per storage buffer: previous step to scratch, scratch to this step's buffer and this step's buffer to scratch
+		std::array<std::array<VkDescriptorSet, 3>, 2> descriptorSets{};
 		VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
 		VkPipeline pipeline{ VK_NULL_HANDLE };
 		struct UniformData {
@@ -100,9 +92,29 @@ public:
 			glm::vec4 gravity{ 0.0f, 9.8f, 0.0f, 0.0f };
 			glm::ivec2 particleCount{ 0 };
 		} uniformData;
-		vks::Buffer uniformBuffer;
+		// A simulation step may still be executing while the next one is submitted, so each one has its own uniform buffer
+		std::array<vks::Buffer, 2> uniformBuffers;
 	} compute;
 
+	// CPU mirror of the simulation, used in place of the compute shader and to validate its results
+	struct Cpu {
+		vks::ClothSimulation simulation;
+		bool enabled{ false };
+		// Host visible vertex buffer the results of the CPU simulation are rendered from
+		vks::Buffer vertexBuffer;
+		// Result of the last validation of the compute shader results
+		vks::SimulationComparison comparison;
+		bool validated{ false };
+		// Validate the compute shader results after every frame (--validatecpu)
+		bool validateEachFrame{ false };
+		// Measure the throughput of the CPU simulation after preparing the particles (--cpubenchmark)
+		bool benchmark{ false };
+	} cpu;
+	// Largest relative error of a compute shader result that passes validation
+	const float validationTolerance{ 1e-3f };
+
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR enabledTimelineSemaphoreFeaturesKHR{};
+
 	VulkanExample() : VulkanExampleBase()
 	{
 		title = "Compute shader cloth simulation";
@@ -110,6 +122,22 @@ public:
 		camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 512.0f);
 		camera.setRotation(glm::vec3(-30.0f, -45.0f, 0.0f));
 		camera.setTranslation(glm::vec3(0.0f, 0.0f, -5.0f));
+
+		// Compute and graphics are synchronized with timeline semaphores
+		enabledInstanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+		enabledDeviceExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+		enabledTimelineSemaphoreFeaturesKHR.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+		enabledTimelineSemaphoreFeaturesKHR.timelineSemaphore = VK_TRUE;
+		deviceCreatepNextChain = &enabledTimelineSemaphoreFeaturesKHR;
+
+		for (size_t i = 0; i < args.size(); i++) {
+			if (std::string(args[i]) == "--validatecpu") {
+				cpu.validateEachFrame = true;
+			}
+			if (std::string(args[i]) == "--cpubenchmark") {
+				cpu.benchmark = true;
+			}
+		}
 	}
 
 	~VulkanExample()
@@ -122,22 +150,23 @@ public:
 			vkDestroyPipeline(device, graphics.pipelines.sphere, nullptr);
 			vkDestroyPipelineLayout(device, graphics.pipelineLayout, nullptr);
 			vkDestroyDescriptorSetLayout(device, graphics.descriptorSetLayout, nullptr);
+			if (!graphics.oddStepCommandBuffers.empty()) {
+				vkFreeCommandBuffers(device, cmdPool, static_cast<uint32_t>(graphics.oddStepCommandBuffers.size()), graphics.oddStepCommandBuffers.data());
+			}
 			textureCloth.destroy();
 
 			// Compute
-			compute.uniformBuffer.destroy();
+			for (auto& uniformBuffer : compute.uniformBuffers) {
+				uniformBuffer.destroy();
+			}
 			vkDestroyPipelineLayout(device, compute.pipelineLayout, nullptr);
 			vkDestroyDescriptorSetLayout(device, compute.descriptorSetLayout, nullptr);
 			vkDestroyPipeline(device, compute.pipeline, nullptr);
-			for (uint32_t i = 0; i < compute.semaphores.size(); i++) {
-				vkDestroySemaphore(device, compute.semaphores[i].ready, nullptr);
-				vkDestroySemaphore(device, compute.semaphores[i].complete, nullptr);
-			}
-			vkDestroyCommandPool(device, compute.commandPool, nullptr);
 
 			// SSBOs
-			storageBuffers.input.destroy();
-			storageBuffers.output.destroy();
+			asyncCompute.destroy();
+			scratchBuffer.destroy();
+			cpu.vertexBuffer.destroy();
 		}
 	}
 
@@ -156,89 +185,22 @@ public:
 		textureCloth.loadFromFile(getAssetPath() + "textures/vulkan_cloth_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
 	}
 
-	void addGraphicsToComputeBarriers(VkCommandBuffer commandBuffer, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask)
-	{
-		if (dedicatedComputeQueue) {
-			VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
-			bufferBarrier.srcAccessMask = srcAccessMask;
-			bufferBarrier.dstAccessMask = dstAccessMask;
-			bufferBarrier.srcQueueFamilyIndex = vulkanDevice->queueFamilyIndices.graphics;
-			bufferBarrier.dstQueueFamilyIndex = vulkanDevice->queueFamilyIndices.compute;
-			bufferBarrier.size = VK_WHOLE_SIZE;
-
-			std::vector<VkBufferMemoryBarrier> bufferBarriers;
-			bufferBarrier.buffer = storageBuffers.input.buffer;
-			bufferBarriers.push_back(bufferBarrier);
-			bufferBarrier.buffer = storageBuffers.output.buffer;
-			bufferBarriers.push_back(bufferBarrier);
-			vkCmdPipelineBarrier(commandBuffer,
-				srcStageMask,
-				dstStageMask,
-				VK_FLAGS_NONE,
-				0, nullptr,
-				static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
-				0, nullptr);
-		}
-	}
-
-	void addComputeToComputeBarriers(VkCommandBuffer commandBuffer, uint32_t readSet)
+	// Make the results of the previous dispatches on the compute queue visible to the next one
+	void addComputeToComputeBarrier(VkCommandBuffer commandBuffer)
 	{
-		VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
-		bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-		bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		bufferBarrier.size = VK_WHOLE_SIZE;
-		std::vector<VkBufferMemoryBarrier> bufferBarriers;
-		if (readSet == 0)
-		{
-			// SRS - we have written to output.buffer and need a memory barrier before reading it
-			//	   - don't need a memory barrier for input.buffer, the execution barrier is enough
-			bufferBarrier.buffer = storageBuffers.output.buffer;
-			bufferBarriers.push_back(bufferBarrier);
-		}
-		else //if (readSet == 1)
-		{
-			// SRS - we have written to input.buffer and need a memory barrier before reading it
-			//	   - don't need a memory barrier for output.buffer, the execution barrier is enough
-			bufferBarrier.buffer = storageBuffers.input.buffer;
-			bufferBarriers.push_back(bufferBarrier);
-		}
+		VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
 		vkCmdPipelineBarrier(
 			commandBuffer,
 			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
 			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
 			VK_FLAGS_NONE,
+			1, &memoryBarrier,
 			0, nullptr,
-			static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
 			0, nullptr);
 	}
 
-	void addComputeToGraphicsBarriers(VkCommandBuffer commandBuffer, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask)
-	{
-		if (dedicatedComputeQueue) {
-			VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
-			bufferBarrier.srcAccessMask = srcAccessMask;
-			bufferBarrier.dstAccessMask = dstAccessMask;
-			bufferBarrier.srcQueueFamilyIndex = vulkanDevice->queueFamilyIndices.compute;
-			bufferBarrier.dstQueueFamilyIndex = vulkanDevice->queueFamilyIndices.graphics;
-			bufferBarrier.size = VK_WHOLE_SIZE;
-			std::vector<VkBufferMemoryBarrier> bufferBarriers;
-			bufferBarrier.buffer = storageBuffers.input.buffer;
-			bufferBarriers.push_back(bufferBarrier);
-			bufferBarrier.buffer = storageBuffers.output.buffer;
-			bufferBarriers.push_back(bufferBarrier);
-			vkCmdPipelineBarrier(
-				commandBuffer,
-				srcStageMask,
-				dstStageMask,
-				VK_FLAGS_NONE,
-				0, nullptr,
-				static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
-				0, nullptr);
-		}
-	}
-
 	void buildCommandBuffers()
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
@@ -256,48 +218,60 @@ public:
 		renderPassBeginInfo.clearValueCount = 2;
 		renderPassBeginInfo.pClearValues = clearValues;
 
-		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
-		{
-			// Set target frame buffer
-			renderPassBeginInfo.framebuffer = frameBuffers[i];
+		// Each simulation step is rendered from a different storage buffer, so we need one set of command buffers per buffer
+		if (graphics.oddStepCommandBuffers.size() != drawCmdBuffers.size()) {
+			if (!graphics.oddStepCommandBuffers.empty()) {
+				vkFreeCommandBuffers(device, cmdPool, static_cast<uint32_t>(graphics.oddStepCommandBuffers.size()), graphics.oddStepCommandBuffers.data());
+			}
+			graphics.oddStepCommandBuffers.resize(drawCmdBuffers.size());
+			VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(cmdPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, static_cast<uint32_t>(graphics.oddStepCommandBuffers.size()));
+			VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, graphics.oddStepCommandBuffers.data()));
+		}
 
-			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
+		for (uint32_t bufferIndex = 0; bufferIndex < 2; bufferIndex++)
+		{
+			std::vector<VkCommandBuffer>& commandBuffers = (bufferIndex == 0) ? drawCmdBuffers : graphics.oddStepCommandBuffers;
+			for (int32_t i = 0; i < commandBuffers.size(); ++i)
+			{
+				// Set target frame buffer
+				renderPassBeginInfo.framebuffer = frameBuffers[i];
 
-			// Acquire storage buffers from compute queue
-			addComputeToGraphicsBarriers(drawCmdBuffers[i], 0, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+				VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffers[i], &cmdBufInfo));
 
-			// Draw the particle system using the update vertex buffer
+				// No queue family ownership transfers required, the storage buffers are shared between the compute and graphics queue families
 
-			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+				// Draw the particle system using the update vertex buffer
 
-			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
-			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+				vkCmdBeginRenderPass(commandBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-			VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
-			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+				VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+				vkCmdSetViewport(commandBuffers[i], 0, 1, &viewport);
 
-			VkDeviceSize offsets[1] = { 0 };
+				VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+				vkCmdSetScissor(commandBuffers[i], 0, 1, &scissor);
 
-			// Render sphere
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelines.sphere);
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelineLayout, 0, 1, &graphics.descriptorSet, 0, NULL);
-			modelSphere.draw(drawCmdBuffers[i]);
+				VkDeviceSize offsets[1] = { 0 };
 
-			// Render cloth
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelines.cloth);
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelineLayout, 0, 1, &graphics.descriptorSet, 0, NULL);
-			vkCmdBindIndexBuffer(drawCmdBuffers[i], graphics.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1, &storageBuffers.output.buffer, offsets);
-			vkCmdDrawIndexed(drawCmdBuffers[i], indexCount, 1, 0, 0, 0);
+				// Render sphere
+				vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelines.sphere);
+				vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelineLayout, 0, 1, &graphics.descriptorSet, 0, NULL);
+				modelSphere.draw(commandBuffers[i]);
 
-			drawUI(drawCmdBuffers[i]);
+				// Render cloth
+				vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelines.cloth);
+				vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelineLayout, 0, 1, &graphics.descriptorSet, 0, NULL);
+				vkCmdBindIndexBuffer(commandBuffers[i], graphics.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+				// The results of the CPU simulation are rendered from a host visible buffer instead
+				VkBuffer vertexBuffer = cpu.enabled ? cpu.vertexBuffer.buffer : asyncCompute.storageBuffers[bufferIndex].buffer;
+				vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, &vertexBuffer, offsets);
+				vkCmdDrawIndexed(commandBuffers[i], indexCount, 1, 0, 0, 0);
 
-			vkCmdEndRenderPass(drawCmdBuffers[i]);
+				drawUI(commandBuffers[i]);
 
-			// release the storage buffers to the compute queue
-			addGraphicsToComputeBarriers(drawCmdBuffers[i], VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+				vkCmdEndRenderPass(commandBuffers[i]);
 
-			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+				VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffers[i]));
+			}
 		}
 
 	}
@@ -305,44 +279,40 @@ public:
 	void buildComputeCommandBuffer()
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
-		cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-
-		for (uint32_t i = 0; i < compute.commandBuffers.size(); i++) {
 
-			VK_CHECK_RESULT(vkBeginCommandBuffer(compute.commandBuffers[i], &cmdBufInfo));
+		// Simulation step N uses command buffer N % 2, which writes its final result to storage buffer N % 2
+		for (uint32_t i = 0; i < 2; i++) {
+			VkCommandBuffer commandBuffer = asyncCompute.commandBuffers[i];
+			VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
 
-			// Acquire the storage buffers from the graphics queue
-			addGraphicsToComputeBarriers(compute.commandBuffers[i], 0, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+			// The previous step was submitted earlier to the same queue, wait for it to finish writing its result and the scratch buffer
+			addComputeToComputeBarrier(commandBuffer);
 
-			vkCmdBindPipeline(compute.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipeline);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipeline);
 
 			uint32_t calculateNormals = 0;
-			vkCmdPushConstants(compute.commandBuffers[i], compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &calculateNormals);
+			vkCmdPushConstants(commandBuffer, compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &calculateNormals);
 
 			// Dispatch the compute job
-			// SRS - Iterations **must** be an even number, so that readSet starts at 1 and the final result ends up in output.buffer with readSet equal to 0
-			const uint32_t iterations = 64;
 			for (uint32_t j = 0; j < iterations; j++) {
-				readSet = 1 - readSet;
-				vkCmdBindDescriptorSets(compute.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSets[readSet], 0, 0);
+				// The first iteration starts with the result of the previous step, after that odd iterations write to this step's buffer and even ones to the scratch buffer
+				const uint32_t descriptorSet = (j == 0) ? 0 : ((j % 2 == 1) ? 1 : 2);
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSets[i][descriptorSet], 0, 0);
 
 				if (j == iterations - 1) {
 					calculateNormals = 1;
-					vkCmdPushConstants(compute.commandBuffers[i], compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &calculateNormals);
+					vkCmdPushConstants(commandBuffer, compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &calculateNormals);
 				}
 
-				vkCmdDispatch(compute.commandBuffers[i], cloth.gridsize.x / 10, cloth.gridsize.y / 10, 1);
+				vkCmdDispatch(commandBuffer, cloth.gridsize.x / 10, cloth.gridsize.y / 10, 1);
 
-				// Don't add a barrier on the last iteration of the loop, since we'll have an explicit release to the graphics queue
+				// Don't add a barrier on the last iteration of the loop, the graphics queue waits for the whole step with the compute timeline semaphore
 				if (j != iterations - 1) {
-					addComputeToComputeBarriers(compute.commandBuffers[i], readSet);
+					addComputeToComputeBarrier(commandBuffer);
 				}
-
 			}
 
-			// release the storage buffers back to the graphics queue
-			addComputeToGraphicsBarriers(compute.commandBuffers[i], VK_ACCESS_SHADER_WRITE_BIT, 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
-			vkEndCommandBuffer(compute.commandBuffers[i]);
+			vkEndCommandBuffer(commandBuffer);
 		}
 	}
 
@@ -369,43 +339,16 @@ public:
 
 		VkDeviceSize storageBufferSize = particleBuffer.size() * sizeof(Particle);
 
-		// Staging
-		// SSBO won't be changed on the host after upload so copy to device local memory
-
-		vks::Buffer stagingBuffer;
+		// The storage buffers will be used as storage buffers for the compute pipeline and as vertex buffers in the graphics pipeline
+		// SSBOs won't be changed on the host after upload, so the async compute helper copies them to device local memory
+		asyncCompute.create(vulkanDevice, storageBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, particleBuffer.data(), queue);
+		// The scratch buffer for the intermediate iterations is only accessed by the compute queue
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &scratchBuffer, storageBufferSize));
 
-		vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&stagingBuffer,
-			storageBufferSize,
-			particleBuffer.data());
-
-		// SSBOs will be used both as storage buffers (compute) and vertex buffers (graphics)
-		vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			&storageBuffers.input,
-			storageBufferSize);
-
-		vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			&storageBuffers.output,
-			storageBufferSize);
-
-		// Copy from staging buffer
-		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		VkBufferCopy copyRegion = {};
-		copyRegion.size = storageBufferSize;
-		vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, storageBuffers.output.buffer, 1, &copyRegion);
-		// Add an initial release barrier to the graphics queue,
-		// so that when the compute command buffer executes for the first time
-		// it doesn't complain about a lack of a corresponding "release" to its "acquire"
-		addGraphicsToComputeBarriers(copyCmd, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
-		vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
-
-		stagingBuffer.destroy();
+		// The CPU simulation starts with the same particles
+		cpu.simulation.setParticles(particleBuffer.data(), cloth.gridsize.x, cloth.gridsize.y);
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &cpu.vertexBuffer, storageBufferSize, particleBuffer.data()));
+		VK_CHECK_RESULT(cpu.vertexBuffer.map());
 
 		// Indices
 		std::vector<uint32_t> indices;
@@ -420,6 +363,7 @@ public:
 		uint32_t indexBufferSize = static_cast<uint32_t>(indices.size()) * sizeof(uint32_t);
 		indexCount = static_cast<uint32_t>(indices.size());
 
+		vks::Buffer stagingBuffer;
 		vulkanDevice->createBuffer(
 			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
@@ -434,8 +378,8 @@ public:
 			indexBufferSize);
 
 		// Copy from staging buffer
-		copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		copyRegion = {};
+		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		VkBufferCopy copyRegion = {};
 		copyRegion.size = indexBufferSize;
 		vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, graphics.indices.buffer, 1, &copyRegion);
 		vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
@@ -452,11 +396,11 @@ public:
 
 		// Descriptor pool
 		std::vector<VkDescriptorPoolSize> poolSizes = {
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 7),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 12),
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2)
 		};
-		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 3);
+		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 7);
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 
 		// Descriptor layout
@@ -548,12 +492,16 @@ public:
 	// Prepare the resources used for the compute part of the sample
 	void prepareCompute()
 	{
-		// Create a compute capable device queue
-		vkGetDeviceQueue(device, vulkanDevice->queueFamilyIndices.compute, 0, &compute.queue);
+		// The compute queue has been set up by the async compute helper
 
-		// Uniform buffer for passing data to the compute shader
-		vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &compute.uniformBuffer, sizeof(Compute::UniformData));
-		VK_CHECK_RESULT(compute.uniformBuffer.map());
+		// Uniform buffers for passing data to the compute shader, one per simulation step in flight
+		for (uint32_t i = 0; i < 2; i++) {
+			vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &compute.uniformBuffers[i], sizeof(Compute::UniformData));
+			VK_CHECK_RESULT(compute.uniformBuffers[i].map());
+		}
+		asyncCompute.onSubmitStep = [this](uint64_t step, uint32_t bufferIndex) {
+			memcpy(compute.uniformBuffers[bufferIndex].mapped, &compute.uniformData, sizeof(Compute::UniformData));
+		};
 
 		// Set some initial values
 		float dx = cloth.size.x / (cloth.gridsize.x - 1);
@@ -582,48 +530,31 @@ public:
 		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &compute.pipelineLayout));
 
-		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &compute.descriptorSetLayout, 1);
-
-		// Create two descriptor sets with input and output buffers switched
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &compute.descriptorSets[0]));
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &compute.descriptorSets[1]));
-
-		std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets = {
-			vks::initializers::writeDescriptorSet(compute.descriptorSets[0], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &storageBuffers.input.descriptor),
-			vks::initializers::writeDescriptorSet(compute.descriptorSets[0], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &storageBuffers.output.descriptor),
-			vks::initializers::writeDescriptorSet(compute.descriptorSets[0], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &compute.uniformBuffer.descriptor),
-
-			vks::initializers::writeDescriptorSet(compute.descriptorSets[1], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &storageBuffers.output.descriptor),
-			vks::initializers::writeDescriptorSet(compute.descriptorSets[1], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &storageBuffers.input.descriptor),
-			vks::initializers::writeDescriptorSet(compute.descriptorSets[1], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &compute.uniformBuffer.descriptor)
-		};
-
-		vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, NULL);
+		// Create three descriptor sets per storage buffer with the input and output buffers of the iterations of a step
+		for (uint32_t i = 0; i < 2; i++) {
+			const std::array<std::pair<vks::Buffer*, vks::Buffer*>, 3> inputOutput = {
+				std::make_pair(&asyncCompute.storageBuffers[1 - i], &scratchBuffer),
+				std::make_pair(&scratchBuffer, &asyncCompute.storageBuffers[i]),
+				std::make_pair(&asyncCompute.storageBuffers[i], &scratchBuffer),
+			};
+			for (uint32_t j = 0; j < 3; j++) {
+				VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &compute.descriptorSetLayout, 1);
+				VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &compute.descriptorSets[i][j]));
+				std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets = {
+					vks::initializers::writeDescriptorSet(compute.descriptorSets[i][j], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &inputOutput[j].first->descriptor),
+					vks::initializers::writeDescriptorSet(compute.descriptorSets[i][j], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &inputOutput[j].second->descriptor),
+					vks::initializers::writeDescriptorSet(compute.descriptorSets[i][j], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &compute.uniformBuffers[i].descriptor)
+				};
+				vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, nullptr);
+			}
+		}
 
 		// Create pipeline
 		VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(compute.pipelineLayout, 0);
 		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computecloth/cloth.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
 		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipeline));
 
-		// Separate command pool as queue family for compute may be different than graphics
-		VkCommandPoolCreateInfo cmdPoolInfo = {};
-		cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-		cmdPoolInfo.queueFamilyIndex = vulkanDevice->queueFamilyIndices.compute;
-		cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-		VK_CHECK_RESULT(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &compute.commandPool));
-
-		// Create a command buffer for compute operations
-		VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(compute.commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, static_cast<uint32_t>(compute.commandBuffers.size()));
-		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &compute.commandBuffers[0]));
-
-		// Semaphores for graphics / compute synchronization
-		VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
-		for (uint32_t i = 0; i < compute.semaphores.size(); i++) {
-			VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &compute.semaphores[i].ready));
-			VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &compute.semaphores[i].complete));
-		}
-
-		// Build a single command buffer containing the compute dispatch commands
+		// Build the command buffers containing the compute dispatch commands
 		buildComputeCommandBuffer();
 	}
 
@@ -647,86 +578,161 @@ public:
 		else {
 			compute.uniformData.deltaT = 0.0f;
 		}
-		memcpy(compute.uniformBuffer.mapped, &compute.uniformData, sizeof(Compute::UniformData));
+		// Copied to the uniform buffer of a step when it's submitted (see prepareCompute)
 	}
 
-	void updateGraphicsUBO()
+	// Copy between a storage buffer and a host visible buffer on the compute queue, as the scratch buffer is owned by the compute queue family
+	void copyStorageBuffer(vks::Buffer& src, vks::Buffer& dst)
 	{
-		graphics.uniformData.projection = camera.matrices.perspective;
-		graphics.uniformData.view = camera.matrices.view;
-		memcpy(graphics.uniformBuffer.mapped, &graphics.uniformData, sizeof(Graphics::UniformData));
+		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, asyncCompute.commandPool, true);
+		VkBufferCopy copyRegion{ 0, 0, src.size };
+		vkCmdCopyBuffer(copyCmd, src.buffer, dst.buffer, 1, &copyRegion);
+		vulkanDevice->flushCommandBuffer(copyCmd, asyncCompute.queue, asyncCompute.commandPool);
 	}
 
-	void draw()
+	void readStorageBuffer(vks::Buffer& buffer, void* data)
 	{
-		// As we use both graphics and compute, frame submission is a bit more involved
-		// We'll be using semaphores to synchronize between the compute shader updating the cloth and the graphics pipeline drawing it
+		vks::Buffer stagingBuffer;
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, buffer.size));
+		copyStorageBuffer(buffer, stagingBuffer);
+		VK_CHECK_RESULT(stagingBuffer.map());
+		memcpy(data, stagingBuffer.mapped, buffer.size);
+		stagingBuffer.destroy();
+	}
 
-		static bool firstDraw = true;
-		static uint32_t computeSubmitIndex{ 0 }, graphicsSubmitIndex{ 0 };
-		if (computeCommandBufferCount > 1)
-		{
-			// SRS - if we are double buffering the compute queue, swap the compute command buffer indices
-			graphicsSubmitIndex = computeSubmitIndex;
-			computeSubmitIndex = 1 - graphicsSubmitIndex;
-		}
+	void writeStorageBuffer(vks::Buffer& buffer, const void* data)
+	{
+		vks::Buffer stagingBuffer;
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, buffer.size, const_cast<void*>(data)));
+		copyStorageBuffer(stagingBuffer, buffer);
+		stagingBuffer.destroy();
+	}
 
-		VkSubmitInfo computeSubmitInfo = vks::initializers::submitInfo();
-		VkPipelineStageFlags computeWaitDstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
-		if (!firstDraw) {
-			computeSubmitInfo.waitSemaphoreCount = 1;
-			computeSubmitInfo.pWaitSemaphores = &compute.semaphores[computeSubmitIndex].ready;
-			computeSubmitInfo.pWaitDstStageMask = &computeWaitDstStageMask;
-		}
-		else {
-			firstDraw = false;
-			if (computeCommandBufferCount > 1)
-			{
-				// SRS - if we are double buffering the compute queue, submit extra command buffer at start
-				computeSubmitInfo.signalSemaphoreCount = 1;
-				computeSubmitInfo.pSignalSemaphores = &compute.semaphores[graphicsSubmitIndex].complete;
-				computeSubmitInfo.commandBufferCount = 1;
-				computeSubmitInfo.pCommandBuffers = &compute.commandBuffers[graphicsSubmitIndex];
-
-				VK_CHECK_RESULT(vkQueueSubmit(compute.queue, 1, &computeSubmitInfo, VK_NULL_HANDLE));
-
-				// Add an extra set of acquire and release barriers to the graphics queue,
-				// so that when the second compute command buffer executes for the first time
-				// it doesn't complain about a lack of a corresponding "acquire" to its "release" and vice versa
-				VkCommandBuffer barrierCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-				addComputeToGraphicsBarriers(barrierCmd, 0, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
-				addGraphicsToComputeBarriers(barrierCmd, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
-				vulkanDevice->flushCommandBuffer(barrierCmd, queue, true);
+	// Switch between simulating on the device and on the CPU, the new backend continues from the state of the previous one
+	void setCpuSimulation(bool enabled)
+	{
+		vkDeviceWaitIdle(device);
+		std::vector<Particle> particles(cloth.gridsize.x * cloth.gridsize.y);
+		if (enabled) {
+			readStorageBuffer(asyncCompute.storageBuffers[asyncCompute.computeTimeline.value % 2], particles.data());
+			cpu.simulation.setParticles(particles.data(), cloth.gridsize.x, cloth.gridsize.y);
+			memcpy(cpu.vertexBuffer.mapped, particles.data(), particles.size() * sizeof(Particle));
+		} else {
+			// Both buffers are overwritten, as the next frame may render the step before the latest one
+			cpu.simulation.getParticles(particles.data());
+			for (auto& storageBuffer : asyncCompute.storageBuffers) {
+				writeStorageBuffer(storageBuffer, particles.data());
 			}
 		}
-		computeSubmitInfo.signalSemaphoreCount = 1;
-		computeSubmitInfo.pSignalSemaphores = &compute.semaphores[computeSubmitIndex].complete;
-		computeSubmitInfo.commandBufferCount = 1;
-		computeSubmitInfo.pCommandBuffers = &compute.commandBuffers[computeSubmitIndex];
+		cpu.enabled = enabled;
+		buildCommandBuffers();
+	}
 
-		VK_CHECK_RESULT(vkQueueSubmit(compute.queue, 1, &computeSubmitInfo, VK_NULL_HANDLE));
+	void updateCpuSimulationParameters(vks::ClothSimulation& simulation, const Compute::UniformData& uniformData)
+	{
+		simulation.parameters.deltaT = uniformData.deltaT;
+		simulation.parameters.particleMass = uniformData.particleMass;
+		simulation.parameters.springStiffness = uniformData.springStiffness;
+		simulation.parameters.damping = uniformData.damping;
+		simulation.parameters.restDistH = uniformData.restDistH;
+		simulation.parameters.restDistV = uniformData.restDistV;
+		simulation.parameters.restDistD = uniformData.restDistD;
+		simulation.parameters.sphereRadius = uniformData.sphereRadius;
+		simulation.parameters.spherePos = uniformData.spherePos;
+		simulation.parameters.gravity = uniformData.gravity;
+	}
 
-		// Submit graphics commands
-		VulkanExampleBase::prepareFrame();
+	// Run the last iteration of the latest simulation step on the CPU and compare the results
+	void validateSimulation()
+	{
+		vkDeviceWaitIdle(device);
+		const uint64_t step = asyncCompute.computeTimeline.value;
+		if (step == 0) {
+			return;
+		}
+		// The last iteration of step N reads from the scratch buffer and writes to buffer N % 2, with the uniform data the step was submitted with
+		std::vector<Particle> input(cloth.gridsize.x * cloth.gridsize.y), output(cloth.gridsize.x * cloth.gridsize.y);
+		readStorageBuffer(scratchBuffer, input.data());
+		readStorageBuffer(asyncCompute.storageBuffers[step % 2], output.data());
+		Compute::UniformData uniformData;
+		memcpy(&uniformData, compute.uniformBuffers[step % 2].mapped, sizeof(Compute::UniformData));
+
+		vks::ClothSimulation reference;
+		updateCpuSimulationParameters(reference, uniformData);
+		reference.setParticles(input.data(), cloth.gridsize.x, cloth.gridsize.y);
+		reference.step(1, true);
+		cpu.comparison = reference.compare(output.data(), validationTolerance);
+		cpu.validated = true;
+		std::cout << "Step " << step << " validation " << (cpu.comparison.passed ? "passed" : "FAILED") << ": max. position error " << cpu.comparison.maxPositionError << ", max. velocity error " << cpu.comparison.maxVelocityError << " (particle " << cpu.comparison.worstParticle << ")\n";
+	}
 
-		VkPipelineStageFlags waitDstStageMask[2] = {
-			submitPipelineStages, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
-		};
-		VkSemaphore waitSemaphores[2] = {
-			semaphores.presentComplete, compute.semaphores[graphicsSubmitIndex].complete
+	// Measure the throughput of the CPU simulation with different settings, doesn't use the device
+	void runCpuBenchmark()
+	{
+		std::vector<Particle> particles(cloth.gridsize.x * cloth.gridsize.y);
+		cpu.simulation.getParticles(particles.data());
+		struct Configuration {
+			const char* name;
+			bool simd;
+			uint32_t threadCount;
 		};
-		VkSemaphore signalSemaphores[2] = {
-			semaphores.renderComplete, compute.semaphores[graphicsSubmitIndex].ready
+		const std::vector<Configuration> configurations = {
+			{ "scalar, 1 thread", false, 1 },
+			{ "SIMD, 1 thread", true, 1 },
+			{ "SIMD, all threads", true, 0 },
 		};
+		// One second of simulation at 60 frames per second
+		const uint32_t frameCount = 60;
+		Compute::UniformData uniformData = compute.uniformData;
+		uniformData.deltaT = (1.0f / 60.0f) * 0.0025f;
+		std::cout << "CPU simulation benchmark: " << particles.size() << " particles, " << frameCount * iterations << " iterations\n";
+		for (const Configuration& configuration : configurations) {
+			vks::ClothSimulation simulation;
+			updateCpuSimulationParameters(simulation, uniformData);
+			simulation.settings.simd = configuration.simd;
+			simulation.settings.threadCount = configuration.threadCount;
+			simulation.setParticles(particles.data(), cloth.gridsize.x, cloth.gridsize.y);
+			float frameTime = 0.0f;
+			double throughput = 0.0;
+			for (uint32_t i = 0; i < frameCount; i++) {
+				simulation.step(iterations);
+				frameTime += simulation.statistics.stepTime * iterations;
+				throughput += simulation.statistics.particleStepsPerSecond;
+			}
+			std::cout << configuration.name << ": " << frameTime / frameCount << " ms per frame, " << throughput / frameCount << " particle steps/s\n";
+		}
+	}
 
-		submitInfo.waitSemaphoreCount = 2;
-		submitInfo.pWaitDstStageMask = waitDstStageMask;
-		submitInfo.pWaitSemaphores = waitSemaphores;
-		submitInfo.signalSemaphoreCount = 2;
-		submitInfo.pSignalSemaphores = signalSemaphores;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+	void updateGraphicsUBO()
+	{
+		graphics.uniformData.projection = camera.matrices.perspective;
+		graphics.uniformData.view = camera.matrices.view;
+		memcpy(graphics.uniformBuffer.mapped, &graphics.uniformData, sizeof(Graphics::UniformData));
+	}
+
+	void draw()
+	{
+		if (cpu.enabled) {
+			// The CPU simulation runs in place of the compute shader, the previous frame has finished rendering from the vertex buffer
+			VulkanExampleBase::prepareFrame();
+			updateCpuSimulationParameters(cpu.simulation, compute.uniformData);
+			cpu.simulation.step(iterations);
+			cpu.simulation.getParticles(static_cast<Particle*>(cpu.vertexBuffer.mapped));
+			submitInfo.commandBufferCount = 1;
+			submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
+			VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+			VulkanExampleBase::submitFrame();
+			return;
+		}
+
+		// Submit the simulation step(s) required for this frame, with overlap enabled this is the step for the next frame
+		asyncCompute.submitCompute();
+
+		VulkanExampleBase::prepareFrame();
+
+		// Submit graphics commands, waiting for the simulation step of this frame
+		VkCommandBuffer commandBuffer = (asyncCompute.renderBufferIndex() == 0) ? drawCmdBuffers[currentBuffer] : graphics.oddStepCommandBuffers[currentBuffer];
+		asyncCompute.submitGraphics(queue, commandBuffer, semaphores.presentComplete, semaphores.renderComplete, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
 
 		VulkanExampleBase::submitFrame();
 	}
@@ -739,12 +745,13 @@ public:
 #ifdef DEBUG_FORCE_SHARED_GRAPHICS_COMPUTE_QUEUE
 		vulkanDevice->queueFamilyIndices.compute = vulkanDevice->queueFamilyIndices.graphics;
 #endif
-		// Check whether the compute queue family is distinct from the graphics queue family
-		dedicatedComputeQueue = vulkanDevice->queueFamilyIndices.graphics != vulkanDevice->queueFamilyIndices.compute;
 		loadAssets();
 		prepareStorageBuffers();
 		prepareGraphics();
 		prepareCompute();
+		if (cpu.benchmark) {
+			runCpuBenchmark();
+		}
 		prepared = true;
 	}
 
@@ -755,12 +762,32 @@ public:
 		updateGraphicsUBO();
 		updateComputeUBO();
 		draw();
+		if (cpu.validateEachFrame && !cpu.enabled) {
+			validateSimulation();
+		}
 	}
 
 	virtual void OnUpdateUIOverlay(vks::UIOverlay* overlay)
 	{
 		if (overlay->header("Settings")) {
 			overlay->checkBox("Simulate wind", &simulateWind);
+			overlay->checkBox("Async compute overlap", &asyncCompute.overlap);
+			overlay->text(asyncCompute.dedicatedQueue ? "Dedicated compute queue family" : "Compute shares the graphics queue");
+		}
+		if (overlay->header("CPU simulation")) {
+			bool cpuEnabled = cpu.enabled;
+			if (overlay->checkBox("Simulate on CPU", &cpuEnabled)) {
+				setCpuSimulation(cpuEnabled);
+			}
+			if (cpu.enabled) {
+				overlay->text("Frame: %.2f ms (%.1f M particle steps/s)", cpu.simulation.statistics.stepTime * iterations, cpu.simulation.statistics.particleStepsPerSecond / 1000000.0);
+			} else if (overlay->button("Validate compute results")) {
+				validateSimulation();
+			}
+			if (cpu.validated) {
+				overlay->text("Validation %s", cpu.comparison.passed ? "passed" : "failed");
+				overlay->text("Max. error: %.2e pos, %.2e vel", cpu.comparison.maxPositionError, cpu.comparison.maxVelocityError);
+			}
 		}
 	}
 };
@@ -9,6 +9,7 @@
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "VulkanDepthPyramid.h"
 #include "frustum.hpp"
 
 
@@ -25,6 +26,9 @@ class VulkanExample : public VulkanExampleBase
 {
 public:
 	bool fixedFrustum = false;
+	bool occlusionCulling = true;
+	// Occlusion culling is disabled if the depth pyramid can't be built with the selected shader type
+	bool depthPyramidAvailable = false;
 
 	// The model contains multiple versions of a single object with different levels of detail
 	vkglTF::Model lodModel;
@@ -55,6 +59,8 @@ public:
 		glm::mat4 modelview;
 		glm::vec4 cameraPos;
 		glm::vec4 frustumPlanes[6];
+		// xy = size of the depth attachment, z = depth pyramid levels (0 disables occlusion culling), w = object bounding radius
+		glm::vec4 depthPyramid;
 	} uboScene;
 
 	struct {
@@ -82,8 +88,11 @@ public:
 
 	// View frustum for culling invisible objects
 	vks::Frustum frustum;
+	// Hierarchical depth of the previous frame for culling occluded objects
+	vks::DepthPyramid depthPyramid;
 
 	uint32_t objectCount = 0;
+	float objectRadius = 1.0f;
 
 	VulkanExample() : VulkanExampleBase()
 	{
@@ -93,6 +102,10 @@ public:
 		camera.setTranslation(glm::vec3(0.5f, 0.0f, 0.0f));
 		camera.movementSpeed = 5.0f;
 		memset(&indirectStats, 0, sizeof(indirectStats));
+		// The depth attachment is read to build the depth pyramid
+		depthStencilUsage = VK_IMAGE_USAGE_SAMPLED_BIT;
+		// The culling shader with depth pyramid tests has only been written in GLSL
+		requireGlslShaders();
 	}
 
 	~VulkanExample()
@@ -112,6 +125,7 @@ public:
 			vkDestroyFence(device, compute.fence, nullptr);
 			vkDestroyCommandPool(device, compute.commandPool, nullptr);
 			vkDestroySemaphore(device, compute.semaphore, nullptr);
+			depthPyramid.destroy();
 		}
 	}
 
@@ -123,6 +137,8 @@ public:
 		}
 		// This is required for for using firstInstance
 		enabledFeatures.drawIndirectFirstInstance = VK_TRUE;
+		// The depth pyramid is written as an rg32f storage image
+		enabledFeatures.shaderStorageImageExtendedFormats = VK_TRUE;
 	}
 
 	void buildCommandBuffers()
@@ -208,6 +224,9 @@ public:
 
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
+			// Build the depth pyramid from this frame's depth, it's used for occlusion culling in the next frame
+			depthPyramid.cmdBuild(drawCmdBuffers[i]);
+
 			// Release barrier
 			if (vulkanDevice->queueFamilyIndices.graphics != vulkanDevice->queueFamilyIndices.compute)
 			{
@@ -339,7 +358,8 @@ public:
 		// Pool
 		std::vector<VkDescriptorPoolSize> poolSizes = {
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1)
 		};
 		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 2);
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
@@ -541,6 +561,9 @@ public:
 
 		stagingBuffer.destroy();
 
+		// Bounding sphere around the instance origin that contains all LODs, used for occlusion culling
+		objectRadius = glm::length(glm::max(glm::abs(lodModel.dimensions.min), glm::abs(lodModel.dimensions.max)));
+
 		// Shader storage buffer containing index offsets and counts for the LODs
 		struct LOD
 		{
@@ -624,6 +647,11 @@ public:
 				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 				VK_SHADER_STAGE_COMPUTE_BIT,
 				4),
+			// Binding 5: Depth pyramid (input)
+			vks::initializers::descriptorSetLayoutBinding(
+				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				5),
 		};
 
 		VkDescriptorSetLayoutCreateInfo descriptorLayout =
@@ -670,7 +698,13 @@ public:
 				compute.descriptorSet,
 				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 				4,
-				&compute.lodLevelsBuffers.descriptor)
+				&compute.lodLevelsBuffers.descriptor),
+			// Binding 5: Depth pyramid
+			vks::initializers::writeDescriptorSet(
+				compute.descriptorSet,
+				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				5,
+				&depthPyramid.descriptor)
 		};
 
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, nullptr);
@@ -724,6 +758,20 @@ public:
 		buildComputeCommandBuffer();
 	}
 
+	// The depth pyramid depends on the depth attachment, so it's (re)created along with it
+	void setupDepthStencil()
+	{
+		VulkanExampleBase::setupDepthStencil();
+		depthPyramid.destroy();
+		depthPyramidAvailable = depthPyramid.create(vulkanDevice, queue, shaderCache, getShadersPath(), depthStencil.image, depthFormat, width, height, { vulkanDevice->queueFamilyIndices.graphics, vulkanDevice->queueFamilyIndices.compute });
+		if (compute.descriptorSet != VK_NULL_HANDLE) {
+			VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 5, &depthPyramid.descriptor);
+			vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+			// Updating the descriptor invalidates the compute command buffer
+			buildComputeCommandBuffer();
+		}
+	}
+
 	void updateUniformBuffer()
 	{
 		uboScene.projection = camera.matrices.perspective;
@@ -734,6 +782,7 @@ public:
 			frustum.update(uboScene.projection * uboScene.modelview);
 			memcpy(uboScene.frustumPlanes, frustum.planes.data(), sizeof(glm::vec4) * 6);
 		}
+		uboScene.depthPyramid = glm::vec4((float)width, (float)height, (occlusionCulling && depthPyramidAvailable) ? (float)depthPyramid.mipLevels : 0.0f, objectRadius);
 		memcpy(uniformData.scene.mapped, &uboScene, sizeof(uboScene));
 	}
 
@@ -809,6 +858,9 @@ public:
 	{
 		if (overlay->header("Settings")) {
 			overlay->checkBox("Freeze frustum", &fixedFrustum);
+			if (depthPyramidAvailable) {
+				overlay->checkBox("Occlusion culling", &occlusionCulling);
+			}
 		}
 		if (overlay->header("Statistics")) {
 			overlay->text("Visible objects: %d", indirectStats.drawCount);
@@ -5,6 +5,9 @@
 * It calculates the particle system movement using two separate compute passes: calculating particle positions and integrating particles
 * For that a shader storage buffer is used which is then used as a vertex buffer for drawing the particle system with a graphics pipeline
 * To optimize performance, the compute shaders use shared memory
+* The simulation runs on a separate compute queue using vks::AsyncCompute, so that the next simulation step is calculated while the current one is rendered
+* A C++ mirror of the simulation (vks::NBodySimulation) can run in place of the compute shaders and is used to validate their results
+* Pass --validatecpu to validate every frame (e.g. on a software device in headless mode) or --cpubenchmark to measure the CPU simulation's throughput
 *
 * Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
 *
@@ -12,6 +15,8 @@
 */
 
 #include "vulkanexamplebase.h"
+#include "VulkanAsyncCompute.h"
+#include "VulkanCpuSimulation.h"
 
 #if defined(__ANDROID__)
 // Lower particle count on Android for performance reasons
@@ -28,25 +33,24 @@ public:
 		vks::Texture2D gradient;
 	} textures{};
 
-	// Particle Definition
-	struct Particle {
-		glm::vec4 pos;								// xyz = position, w = mass
-		glm::vec4 vel;								// xyz = velocity, w = gradient texture position
-	};
+	// Particle Definition, shared with the CPU simulation
+	// pos: xyz = position, w = mass
+	// vel: xyz = velocity, w = gradient texture position
+	typedef vks::NBodySimulation::Particle Particle;
 	uint32_t numParticles{ 0 };
 
-	// We use a shader storage buffer object to store the particlces
-	// This is updated by the compute pipeline and displayed as a vertex buffer by the graphics pipeline
-	vks::Buffer storageBuffer;
+	// We use two shader storage buffer objects to store the particles
+	// While the compute pipeline calculates the next simulation step into one of them, the graphics pipeline displays the other one as a vertex buffer
+	// The buffers, the compute queue and the synchronization between compute and graphics are managed by the async compute helper
+	vks::AsyncCompute asyncCompute;
 
 	// Resources for the graphics part of the example
 	struct Graphics {
-		uint32_t queueFamilyIndex;					// Used to check if compute and graphics queue families differ and require additional barriers
 		VkDescriptorSetLayout descriptorSetLayout;	// Particle system rendering shader binding layout
 		VkDescriptorSet descriptorSet;				// Particle system rendering shader bindings
 		VkPipelineLayout pipelineLayout;			// Layout of the graphics pipeline
 		VkPipeline pipeline;						// Particle rendering pipeline
-		VkSemaphore semaphore;                      // Execution dependency between compute & graphic submission
+		std::vector<VkCommandBuffer> oddStepCommandBuffers;	// Render the results of odd simulation steps (drawCmdBuffers render the even ones)
 		struct UniformData {
 			glm::mat4 projection;
 			glm::mat4 view;
@@ -57,13 +61,8 @@ public:
 
 	// Resources for the compute part of the example
 	struct Compute {
-		uint32_t queueFamilyIndex;					// Used to check if compute and graphics queue families differ and require additional barriers
-		VkQueue queue;								// Separate queue for compute commands (queue family may differ from the one used for graphics)
-		VkCommandPool commandPool;					// Use a separate command pool (queue family may differ from the one used for graphics)
-		VkCommandBuffer commandBuffer;				// Command buffer storing the dispatch commands and barriers
-		VkSemaphore semaphore;                      // Execution dependency between compute & graphic submission
 		VkDescriptorSetLayout descriptorSetLayout;	// Compute shader binding layout
-		VkDescriptorSet descriptorSet;				// Compute shader bindings
+		std::array<VkDescriptorSet, 2> descriptorSets;	// Compute shader bindings, one per storage buffer
 		VkPipelineLayout pipelineLayout;			// Layout of the compute pipeline
 		VkPipeline pipelineCalculate;				// Compute pipeline for N-Body velocity calculation (1st pass)
 		VkPipeline pipelineIntegrate;				// Compute pipeline for euler integration (2nd pass)
@@ -75,17 +74,64 @@ public:
 			float power{ 0.75f };
 			float soften{ 0.05f };
 		} uniformData;
-		vks::Buffer uniformBuffer;					// Uniform buffer object containing particle system parameters
+		std::array<vks::Buffer, 2> uniformBuffers;	// Uniform buffer objects containing particle system parameters, one per simulation step in flight
 	} compute;
 
+	// Size of the shared memory array of the calculate shader, which also decides which particles attract others
+	uint32_t sharedDataSize{ 0 };
+
+	// CPU mirror of the simulation, used in place of the compute shaders and to validate their results
+	struct Cpu {
+		vks::NBodySimulation simulation;
+		bool enabled{ false };
+		int32_t method{ vks::NBodySimulation::Direct };
+		// Host visible vertex buffer the results of the CPU simulation are rendered from
+		vks::Buffer vertexBuffer;
+		// Result of the last validation of the compute shader results
+		vks::SimulationComparison comparison;
+		bool validated{ false };
+		// Validate the compute shader results after every frame (--validatecpu)
+		bool validateEachFrame{ false };
+		// Measure the throughput of the CPU simulation after preparing the particles (--cpubenchmark)
+		bool benchmark{ false };
+	} cpu;
+	// Largest relative error of a compute shader result that passes validation
+	const float validationTolerance{ 1e-3f };
+
+	// Averaged frame times with and without overlapping compute and graphics
+	struct FrameTimes {
+		float overlap{ 0.0f };
+		float serial{ 0.0f };
+	} frameTimes;
+
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR enabledTimelineSemaphoreFeaturesKHR{};
+
 	VulkanExample() : VulkanExampleBase()
 	{
 		title = "Compute shader N-body system";
+		// The CPU simulation mirrors the GLSL calculate shader, which is the only one handling partial tiles
+		requireGlslShaders();
 		camera.type = Camera::CameraType::lookat;
 		camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 512.0f);
 		camera.setRotation(glm::vec3(-26.0f, 75.0f, 0.0f));
 		camera.setTranslation(glm::vec3(0.0f, 0.0f, -14.0f));
 		camera.movementSpeed = 2.5f;
+
+		// Compute and graphics are synchronized with timeline semaphores
+		enabledInstanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+		enabledDeviceExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+		enabledTimelineSemaphoreFeaturesKHR.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+		enabledTimelineSemaphoreFeaturesKHR.timelineSemaphore = VK_TRUE;
+		deviceCreatepNextChain = &enabledTimelineSemaphoreFeaturesKHR;
+
+		for (size_t i = 0; i < args.size(); i++) {
+			if (std::string(args[i]) == "--validatecpu") {
+				cpu.validateEachFrame = true;
+			}
+			if (std::string(args[i]) == "--cpubenchmark") {
+				cpu.benchmark = true;
+			}
+		}
 	}
 
 	~VulkanExample()
@@ -96,18 +142,21 @@ public:
 			vkDestroyPipeline(device, graphics.pipeline, nullptr);
 			vkDestroyPipelineLayout(device, graphics.pipelineLayout, nullptr);
 			vkDestroyDescriptorSetLayout(device, graphics.descriptorSetLayout, nullptr);
-			vkDestroySemaphore(device, graphics.semaphore, nullptr);
+			if (!graphics.oddStepCommandBuffers.empty()) {
+				vkFreeCommandBuffers(device, cmdPool, static_cast<uint32_t>(graphics.oddStepCommandBuffers.size()), graphics.oddStepCommandBuffers.data());
+			}
 
 			// Compute
-			compute.uniformBuffer.destroy();
+			for (auto& uniformBuffer : compute.uniformBuffers) {
+				uniformBuffer.destroy();
+			}
 			vkDestroyPipelineLayout(device, compute.pipelineLayout, nullptr);
 			vkDestroyDescriptorSetLayout(device, compute.descriptorSetLayout, nullptr);
 			vkDestroyPipeline(device, compute.pipelineCalculate, nullptr);
 			vkDestroyPipeline(device, compute.pipelineIntegrate, nullptr);
-			vkDestroySemaphore(device, compute.semaphore, nullptr);
-			vkDestroyCommandPool(device, compute.commandPool, nullptr);
 
-			storageBuffer.destroy();
+			asyncCompute.destroy();
+			cpu.vertexBuffer.destroy();
 
 			textures.particle.destroy();
 			textures.gradient.destroy();
@@ -137,86 +186,52 @@ public:
 		renderPassBeginInfo.clearValueCount = 2;
 		renderPassBeginInfo.pClearValues = clearValues;
 
-		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
+		// Each simulation step is rendered from a different storage buffer, so we need one set of command buffers per buffer
+		if (graphics.oddStepCommandBuffers.size() != drawCmdBuffers.size()) {
+			if (!graphics.oddStepCommandBuffers.empty()) {
+				vkFreeCommandBuffers(device, cmdPool, static_cast<uint32_t>(graphics.oddStepCommandBuffers.size()), graphics.oddStepCommandBuffers.data());
+			}
+			graphics.oddStepCommandBuffers.resize(drawCmdBuffers.size());
+			VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(cmdPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, static_cast<uint32_t>(graphics.oddStepCommandBuffers.size()));
+			VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, graphics.oddStepCommandBuffers.data()));
+		}
+
+		for (uint32_t bufferIndex = 0; bufferIndex < 2; bufferIndex++)
 		{
-			// Set target frame buffer
-			renderPassBeginInfo.framebuffer = frameBuffers[i];
+			std::vector<VkCommandBuffer>& commandBuffers = (bufferIndex == 0) ? drawCmdBuffers : graphics.oddStepCommandBuffers;
+			for (int32_t i = 0; i < commandBuffers.size(); ++i)
+			{
+				// Set target frame buffer
+				renderPassBeginInfo.framebuffer = frameBuffers[i];
 
-			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
+				VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffers[i], &cmdBufInfo));
 
-			// Acquire barrier
-			if (graphics.queueFamilyIndex != compute.queueFamilyIndex)
-			{
-				VkBufferMemoryBarrier buffer_barrier =
-				{
-					VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-					nullptr,
-					0,
-					VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-					compute.queueFamilyIndex,
-					graphics.queueFamilyIndex,
-					storageBuffer.buffer,
-					0,
-					storageBuffer.size
-				};
-
-				vkCmdPipelineBarrier(
-					drawCmdBuffers[i],
-					VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-					VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
-					0,
-					0, nullptr,
-					1, &buffer_barrier,
-					0, nullptr);
-			}
+				// No queue family ownership transfers required, the storage buffers are shared between the compute and graphics queue families
 
-			// Draw the particle system using the update vertex buffer
-			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+				// Draw the particle system using the update vertex buffer
+				vkCmdBeginRenderPass(commandBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
-			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+				VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+				vkCmdSetViewport(commandBuffers[i], 0, 1, &viewport);
 
-			VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
-			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+				VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+				vkCmdSetScissor(commandBuffers[i], 0, 1, &scissor);
 
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipeline);
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelineLayout, 0, 1, &graphics.descriptorSet, 0, nullptr);
+				vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipeline);
+				vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelineLayout, 0, 1, &graphics.descriptorSet, 0, nullptr);
 
-			VkDeviceSize offsets[1] = { 0 };
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1, &storageBuffer.buffer, offsets);
-			vkCmdDraw(drawCmdBuffers[i], numParticles, 1, 0, 0);
+				// The results of the CPU simulation are rendered from a host visible buffer instead
+				VkDeviceSize offsets[1] = { 0 };
+				VkBuffer vertexBuffer = cpu.enabled ? cpu.vertexBuffer.buffer : asyncCompute.storageBuffers[bufferIndex].buffer;
+				vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, &vertexBuffer, offsets);
+				vkCmdDraw(commandBuffers[i], numParticles, 1, 0, 0);
 
-			drawUI(drawCmdBuffers[i]);
+				drawUI(commandBuffers[i]);
 
-			vkCmdEndRenderPass(drawCmdBuffers[i]);
+				vkCmdEndRenderPass(commandBuffers[i]);
 
-			// Release barrier
-			if (graphics.queueFamilyIndex != compute.queueFamilyIndex)
-			{
-				VkBufferMemoryBarrier buffer_barrier =
-				{
-					VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-					nullptr,
-					VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-					0,
-					graphics.queueFamilyIndex,
-					compute.queueFamilyIndex,
-					storageBuffer.buffer,
-					0,
-					storageBuffer.size
-				};
-
-				vkCmdPipelineBarrier(
-					drawCmdBuffers[i],
-					VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
-					VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-					0,
-					0, nullptr,
-					1, &buffer_barrier,
-					0, nullptr);
+				VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffers[i]));
 			}
-
-			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 		}
 
 	}
@@ -225,91 +240,46 @@ public:
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
-		VK_CHECK_RESULT(vkBeginCommandBuffer(compute.commandBuffer, &cmdBufInfo));
-
-		// Acquire barrier
-		if (graphics.queueFamilyIndex != compute.queueFamilyIndex)
+		// Simulation step N uses command buffer N % 2, which updates storage buffer N % 2 in place
+		for (uint32_t i = 0; i < 2; i++)
 		{
-			VkBufferMemoryBarrier buffer_barrier =
-			{
-				VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-				nullptr,
-				0,
-				VK_ACCESS_SHADER_WRITE_BIT,
-				graphics.queueFamilyIndex,
-				compute.queueFamilyIndex,
-				storageBuffer.buffer,
-				0,
-				storageBuffer.size
-			};
+			VkCommandBuffer commandBuffer = asyncCompute.commandBuffers[i];
+			VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
+
+			// Start with the results of the previous simulation step
+			asyncCompute.cmdCopyPreviousStep(commandBuffer, i);
+
+			// First pass: Calculate particle movement
+			// -------------------------------------------------------------------------------------------------------
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineCalculate);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSets[i], 0, 0);
+			vkCmdDispatch(commandBuffer, numParticles / 256, 1, 1);
+
+			// Add memory barrier to ensure that the computer shader has finished writing to the buffer
+			VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
+			bufferBarrier.buffer = asyncCompute.storageBuffers[i].buffer;
+			bufferBarrier.size = asyncCompute.storageBuffers[i].descriptor.range;
+			bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 
 			vkCmdPipelineBarrier(
-				compute.commandBuffer,
-				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+				commandBuffer,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
 				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-				0,
+				VK_FLAGS_NONE,
 				0, nullptr,
-				1, &buffer_barrier,
+				1, &bufferBarrier,
 				0, nullptr);
-		}
 
-		// First pass: Calculate particle movement
-		// -------------------------------------------------------------------------------------------------------
-		vkCmdBindPipeline(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineCalculate);
-		vkCmdBindDescriptorSets(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSet, 0, 0);
-		vkCmdDispatch(compute.commandBuffer, numParticles / 256, 1, 1);
-
-		// Add memory barrier to ensure that the computer shader has finished writing to the buffer
-		VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
-		bufferBarrier.buffer = storageBuffer.buffer;
-		bufferBarrier.size = storageBuffer.descriptor.range;
-		bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-		bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		// Transfer ownership if compute and graphics queue family indices differ
-		bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-
-		vkCmdPipelineBarrier(
-			compute.commandBuffer,
-			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-			VK_FLAGS_NONE,
-			0, nullptr,
-			1, &bufferBarrier,
-			0, nullptr);
-
-		// Second pass: Integrate particles
-		// -------------------------------------------------------------------------------------------------------
-		vkCmdBindPipeline(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineIntegrate);
-		vkCmdDispatch(compute.commandBuffer, numParticles / 256, 1, 1);
-
-		// Release barrier
-		if (graphics.queueFamilyIndex != compute.queueFamilyIndex)
-		{
-			VkBufferMemoryBarrier buffer_barrier =
-			{
-				VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-				nullptr,
-				VK_ACCESS_SHADER_WRITE_BIT,
-				0,
-				compute.queueFamilyIndex,
-				graphics.queueFamilyIndex,
-				storageBuffer.buffer,
-				0,
-				storageBuffer.size
-			};
+			// Second pass: Integrate particles
+			// -------------------------------------------------------------------------------------------------------
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineIntegrate);
+			vkCmdDispatch(commandBuffer, numParticles / 256, 1, 1);
 
-			vkCmdPipelineBarrier(
-				compute.commandBuffer,
-				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-				VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-				0,
-				0, nullptr,
-				1, &buffer_barrier,
-				0, nullptr);
+			vkEndCommandBuffer(commandBuffer);
 		}
-
-		vkEndCommandBuffer(compute.commandBuffer);
 	}
 
 	// Setup and fill the compute shader storage buffers containing the particles
@@ -370,48 +340,113 @@ public:
 
 		VkDeviceSize storageBufferSize = particleBuffer.size() * sizeof(Particle);
 
-		// Staging
-		// SSBO won't be changed on the host after upload so copy to device local memory
+		// The storage buffers will be used as storage buffers for the compute pipeline and as vertex buffers in the graphics pipeline
+		// SSBOs won't be changed on the host after upload, so the async compute helper copies them to device local memory
+		asyncCompute.create(vulkanDevice, storageBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, particleBuffer.data(), queue);
+
+		// The CPU simulation starts with the same particles
+		cpu.simulation.setParticles(particleBuffer.data(), numParticles);
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &cpu.vertexBuffer, storageBufferSize, particleBuffer.data()));
+		VK_CHECK_RESULT(cpu.vertexBuffer.map());
+	}
 
+	// Copy the contents of a device local storage buffer to the host
+	void readStorageBuffer(vks::Buffer& buffer, void* data)
+	{
 		vks::Buffer stagingBuffer;
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, buffer.size));
+		vulkanDevice->copyBuffer(&buffer, &stagingBuffer, queue);
+		VK_CHECK_RESULT(stagingBuffer.map());
+		memcpy(data, stagingBuffer.mapped, buffer.size);
+		stagingBuffer.destroy();
+	}
 
-		vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, storageBufferSize, particleBuffer.data());
-		// The SSBO will be used as a storage buffer for the compute pipeline and as a vertex buffer in the graphics pipeline
-		vulkanDevice->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &storageBuffer, storageBufferSize);
-
-		// Copy from staging buffer to storage buffer
-		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		VkBufferCopy copyRegion = {};
-		copyRegion.size = storageBufferSize;
-		vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, storageBuffer.buffer, 1, &copyRegion);
-		// Execute a transfer barrier to the compute queue, if necessary
-		if (graphics.queueFamilyIndex != compute.queueFamilyIndex)
-		{
-			VkBufferMemoryBarrier buffer_barrier =
-			{
-				VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-				nullptr,
-				VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-				0,
-				graphics.queueFamilyIndex,
-				compute.queueFamilyIndex,
-				storageBuffer.buffer,
-				0,
-				storageBuffer.size
-			};
+	// Switch between simulating on the device and on the CPU, the new backend continues from the state of the previous one
+	void setCpuSimulation(bool enabled)
+	{
+		vkDeviceWaitIdle(device);
+		std::vector<Particle> particles(numParticles);
+		if (enabled) {
+			readStorageBuffer(asyncCompute.storageBuffers[asyncCompute.computeTimeline.value % 2], particles.data());
+			cpu.simulation.setParticles(particles.data(), numParticles);
+			memcpy(cpu.vertexBuffer.mapped, particles.data(), particles.size() * sizeof(Particle));
+		} else {
+			// Both buffers are overwritten, as the next frame may render the step before the latest one
+			cpu.simulation.getParticles(particles.data());
+			vks::Buffer stagingBuffer;
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, particles.size() * sizeof(Particle), particles.data()));
+			for (auto& storageBuffer : asyncCompute.storageBuffers) {
+				vulkanDevice->copyBuffer(&stagingBuffer, &storageBuffer, queue);
+			}
+			stagingBuffer.destroy();
+		}
+		cpu.enabled = enabled;
+		buildCommandBuffers();
+	}
 
-			vkCmdPipelineBarrier(
-				copyCmd,
-				VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
-				VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-				0,
-				0, nullptr,
-				1, &buffer_barrier,
-				0, nullptr);
+	void updateCpuSimulationParameters(vks::NBodySimulation& simulation, const Compute::UniformData& uniformData)
+	{
+		simulation.parameters.deltaT = uniformData.deltaT;
+		simulation.parameters.gravity = uniformData.gravity;
+		simulation.parameters.power = uniformData.power;
+		simulation.parameters.soften = uniformData.soften;
+	}
+
+	// Run the latest simulation step of the compute shaders on the CPU and compare the results
+	void validateSimulation()
+	{
+		vkDeviceWaitIdle(device);
+		const uint64_t step = asyncCompute.computeTimeline.value;
+		if (step == 0) {
+			return;
 		}
-		vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
+		// Step N updates buffer N % 2 from the results of step N - 1 in the other buffer, with the uniform data it was submitted with
+		std::vector<Particle> previousStep(numParticles), currentStep(numParticles);
+		readStorageBuffer(asyncCompute.storageBuffers[(step - 1) % 2], previousStep.data());
+		readStorageBuffer(asyncCompute.storageBuffers[step % 2], currentStep.data());
+		Compute::UniformData uniformData;
+		memcpy(&uniformData, compute.uniformBuffers[step % 2].mapped, sizeof(Compute::UniformData));
+
+		vks::NBodySimulation reference;
+		updateCpuSimulationParameters(reference, uniformData);
+		reference.setParticles(previousStep.data(), numParticles);
+		reference.step();
+		cpu.comparison = reference.compare(currentStep.data(), validationTolerance);
+		cpu.validated = true;
+		std::cout << "Step " << step << " validation " << (cpu.comparison.passed ? "passed" : "FAILED") << ": max. position error " << cpu.comparison.maxPositionError << ", max. velocity error " << cpu.comparison.maxVelocityError << " (particle " << cpu.comparison.worstParticle << ")\n";
+	}
 
-		stagingBuffer.destroy();
+	// Measure the throughput of the CPU simulation with different settings, doesn't use the device
+	void runCpuBenchmark()
+	{
+		std::vector<Particle> particles(numParticles);
+		cpu.simulation.getParticles(particles.data());
+		struct Configuration {
+			const char* name;
+			vks::NBodySimulation::Method method;
+			bool simd;
+			uint32_t threadCount;
+		};
+		const std::vector<Configuration> configurations = {
+			{ "direct, scalar, 1 thread", vks::NBodySimulation::Direct, false, 1 },
+			{ "direct, SIMD, 1 thread", vks::NBodySimulation::Direct, true, 1 },
+			{ "direct, SIMD, all threads", vks::NBodySimulation::Direct, true, 0 },
+			{ "Barnes-Hut, all threads", vks::NBodySimulation::BarnesHut, true, 0 },
+		};
+		const uint32_t stepCount = 2;
+		Compute::UniformData uniformData = compute.uniformData;
+		uniformData.deltaT = 0.05f / 60.0f;
+		std::cout << "CPU simulation benchmark: " << numParticles << " particles, " << stepCount << " steps\n";
+		for (const Configuration& configuration : configurations) {
+			vks::NBodySimulation simulation;
+			updateCpuSimulationParameters(simulation, uniformData);
+			simulation.settings.method = configuration.method;
+			simulation.settings.simd = configuration.simd;
+			simulation.settings.threadCount = configuration.threadCount;
+			simulation.setParticles(particles.data(), numParticles);
+			simulation.step(stepCount);
+			std::cout << configuration.name << ": " << simulation.statistics.stepTime << " ms per step, " << simulation.statistics.particleStepsPerSecond << " particle steps/s\n";
+		}
 	}
 
 	void prepareGraphics()
@@ -422,11 +457,11 @@ public:
 
 		// Descriptor pool
 		std::vector<VkDescriptorPoolSize> poolSizes = {
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2),
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2)
 		};
-		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 2);
+		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 3);
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 
 		// Descriptor layout
@@ -512,31 +547,23 @@ public:
 
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &graphics.pipeline));
 
-		// We use a semaphore to synchronize compute and graphics
-		VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
-		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &graphics.semaphore));
-
-		// Signal the semaphore for the first run
-		VkSubmitInfo submitInfo = vks::initializers::submitInfo();
-		submitInfo.signalSemaphoreCount = 1;
-		submitInfo.pSignalSemaphores = &graphics.semaphore;
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
-		VK_CHECK_RESULT(vkQueueWaitIdle(queue));
-
 		buildCommandBuffers();
 	}
 
 	void prepareCompute()
 	{
-		// Create a compute capable device queue
+		// The compute queue has been set up by the async compute helper
 		// The VulkanDevice::createLogicalDevice functions finds a compute capable queue and prefers queue families that only support compute
-		// Depending on the implementation this may result in different queue family indices for graphics and computes,
-		// requiring proper synchronization (see the memory barriers in buildComputeCommandBuffer)
-		vkGetDeviceQueue(device, compute.queueFamilyIndex, 0, &compute.queue);
 
-		// Compute shader uniform buffer block
-		vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &compute.uniformBuffer, sizeof(Compute::UniformData));
-		VK_CHECK_RESULT(compute.uniformBuffer.map());
+		// Compute shader uniform buffer blocks
+		// A simulation step may still be executing while the next one is submitted, so each one has its own uniform buffer
+		for (uint32_t i = 0; i < 2; i++) {
+			vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &compute.uniformBuffers[i], sizeof(Compute::UniformData));
+			VK_CHECK_RESULT(compute.uniformBuffers[i].map());
+		}
+		asyncCompute.onSubmitStep = [this](uint64_t step, uint32_t bufferIndex) {
+			memcpy(compute.uniformBuffers[bufferIndex].mapped, &compute.uniformData, sizeof(Compute::UniformData));
+		};
 
 		// Create compute pipeline
 		// Compute pipelines are created separate from graphics pipelines even if they use the same queue (family index)
@@ -551,16 +578,18 @@ public:
 		VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &compute.descriptorSetLayout));
 
-		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &compute.descriptorSetLayout, 1);
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &compute.descriptorSet));
+		for (uint32_t i = 0; i < 2; i++) {
+			VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &compute.descriptorSetLayout, 1);
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &compute.descriptorSets[i]));
 
-		std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets = {
-			// Binding 0 : Particle position storage buffer
-			vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &storageBuffer.descriptor),
-			// Binding 1 : Uniform buffer
-			vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,1,&compute.uniformBuffer.descriptor)
-		};
-		vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, nullptr);
+			std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets = {
+				// Binding 0 : Particle position storage buffer
+				vks::initializers::writeDescriptorSet(compute.descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &asyncCompute.storageBuffers[i].descriptor),
+				// Binding 1 : Uniform buffer
+				vks::initializers::writeDescriptorSet(compute.descriptorSets[i], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, &compute.uniformBuffers[i].descriptor)
+			};
+			vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, nullptr);
+		}
 
 		// Create pipelines
 		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&compute.descriptorSetLayout, 1);
@@ -572,7 +601,7 @@ public:
 		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computenbody/particle_calculate.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
 
 		// We want to use as much shared memory for the compute shader invocations as available, so we calculate it based on the device limits and pass it to the shader via specialization constants
-		uint32_t sharedDataSize = std::min((uint32_t)1024, (uint32_t)(vulkanDevice->properties.limits.maxComputeSharedMemorySize / sizeof(glm::vec4)));
+		sharedDataSize = std::min((uint32_t)1024, (uint32_t)(vulkanDevice->properties.limits.maxComputeSharedMemorySize / sizeof(glm::vec4)));
 		VkSpecializationMapEntry specializationMapEntry = vks::initializers::specializationMapEntry(0, 0, sizeof(uint32_t));
 		VkSpecializationInfo specializationInfo = vks::initializers::specializationInfo(1, &specializationMapEntry, sizeof(int32_t), &sharedDataSize);
 		computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
@@ -583,28 +612,14 @@ public:
 		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computenbody/particle_integrate.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
 		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipelineIntegrate));
 
-		// Separate command pool as queue family for compute may be different than graphics
-		VkCommandPoolCreateInfo cmdPoolInfo = {};
-		cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-		cmdPoolInfo.queueFamilyIndex = compute.queueFamilyIndex;
-		cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-		VK_CHECK_RESULT(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &compute.commandPool));
-
-		// Create a command buffer for compute operations
-		compute.commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, compute.commandPool);
-
-		// Semaphore for compute & graphics sync
-		VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
-		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &compute.semaphore));
-
-		// Build a single command buffer containing the compute dispatch commands
+		// Build the command buffers containing the compute dispatch commands
 		buildComputeCommandBuffer();
 	}
 
 	void updateComputeUniformBuffers()
 	{
+		// Copied to the uniform buffer of a step when it's submitted (see prepareCompute)
 		compute.uniformData.deltaT = paused ? 0.0f : frameTimer * 0.05f;
-		memcpy(compute.uniformBuffer.mapped, &compute.uniformData, sizeof(Compute::UniformData));
 	}
 
 	void updateGraphicsUniformBuffers()
@@ -618,50 +633,46 @@ public:
 	void prepare()
 	{
 		VulkanExampleBase::prepare();
-		// We will be using the queue family indices to check if graphics and compute queue families differ
-		// If that's the case, we need additional barriers for acquiring and releasing resources
-		graphics.queueFamilyIndex = vulkanDevice->queueFamilyIndices.graphics;
-		compute.queueFamilyIndex = vulkanDevice->queueFamilyIndices.compute;
 		loadAssets();
 		prepareStorageBuffers();
 		prepareGraphics();
 		prepareCompute();
+		if (cpu.benchmark) {
+			runCpuBenchmark();
+		}
 		prepared = true;
 	}
 
 	void draw()
 	{
-		// Wait for rendering finished
-		VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
-
-		// Submit compute commands
-		VkSubmitInfo computeSubmitInfo = vks::initializers::submitInfo();
-		computeSubmitInfo.commandBufferCount = 1;
-		computeSubmitInfo.pCommandBuffers = &compute.commandBuffer;
-		computeSubmitInfo.waitSemaphoreCount = 1;
-		computeSubmitInfo.pWaitSemaphores = &graphics.semaphore;
-		computeSubmitInfo.pWaitDstStageMask = &waitStageMask;
-		computeSubmitInfo.signalSemaphoreCount = 1;
-		computeSubmitInfo.pSignalSemaphores = &compute.semaphore;
-		VK_CHECK_RESULT(vkQueueSubmit(compute.queue, 1, &computeSubmitInfo, VK_NULL_HANDLE));
+		if (cpu.enabled) {
+			// The CPU simulation runs in place of the compute shaders, the previous frame has finished rendering from the vertex buffer
+			VulkanExampleBase::prepareFrame();
+			updateCpuSimulationParameters(cpu.simulation, compute.uniformData);
+			cpu.simulation.settings.method = static_cast<vks::NBodySimulation::Method>(cpu.method);
+			cpu.simulation.step();
+			cpu.simulation.getParticles(static_cast<Particle*>(cpu.vertexBuffer.mapped));
+			submitInfo.commandBufferCount = 1;
+			submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
+			VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+			VulkanExampleBase::submitFrame();
+			return;
+		}
 
-		VulkanExampleBase::prepareFrame();
+		// Submit the simulation step(s) required for this frame, with overlap enabled this is the step for the next frame
+		asyncCompute.submitCompute();
 
-		VkPipelineStageFlags graphicsWaitStageMasks[] = { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-		VkSemaphore graphicsWaitSemaphores[] = { compute.semaphore, semaphores.presentComplete };
-		VkSemaphore graphicsSignalSemaphores[] = { graphics.semaphore, semaphores.renderComplete };
+		VulkanExampleBase::prepareFrame();
 
-		// Submit graphics commands
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
-		submitInfo.waitSemaphoreCount = 2;
-		submitInfo.pWaitSemaphores = graphicsWaitSemaphores;
-		submitInfo.pWaitDstStageMask = graphicsWaitStageMasks;
-		submitInfo.signalSemaphoreCount = 2;
-		submitInfo.pSignalSemaphores = graphicsSignalSemaphores;
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+		// Submit graphics commands, waiting for the simulation step of this frame
+		VkCommandBuffer commandBuffer = (asyncCompute.renderBufferIndex() == 0) ? drawCmdBuffers[currentBuffer] : graphics.oddStepCommandBuffers[currentBuffer];
+		asyncCompute.submitGraphics(queue, commandBuffer, semaphores.presentComplete, semaphores.renderComplete, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
 
 		VulkanExampleBase::submitFrame();
+
+		// Track frame times separately for both modes, so they can be compared
+		float& frameTime = asyncCompute.overlap ? frameTimes.overlap : frameTimes.serial;
+		frameTime = (frameTime == 0.0f) ? frameTimer * 1000.0f : frameTime * 0.95f + frameTimer * 1000.0f * 0.05f;
 	}
 
 	virtual void render()
@@ -671,6 +682,37 @@ public:
 		updateComputeUniformBuffers();
 		updateGraphicsUniformBuffers();
 		draw();
+		if (cpu.validateEachFrame && !cpu.enabled) {
+			validateSimulation();
+		}
+	}
+
+	virtual void OnUpdateUIOverlay(vks::UIOverlay* overlay)
+	{
+		if (overlay->header("Settings")) {
+			overlay->checkBox("Async compute overlap", &asyncCompute.overlap);
+			overlay->text(asyncCompute.dedicatedQueue ? "Dedicated compute queue family" : "Compute shares the graphics queue");
+		}
+		if (overlay->header("CPU simulation")) {
+			bool cpuEnabled = cpu.enabled;
+			if (overlay->checkBox("Simulate on CPU", &cpuEnabled)) {
+				setCpuSimulation(cpuEnabled);
+			}
+			overlay->comboBox("Method", &cpu.method, { "Direct", "Barnes-Hut" });
+			if (cpu.enabled) {
+				overlay->text("Step: %.2f ms (%.1f M particle steps/s)", cpu.simulation.statistics.stepTime, cpu.simulation.statistics.particleStepsPerSecond / 1000000.0);
+			} else if (overlay->button("Validate compute results")) {
+				validateSimulation();
+			}
+			if (cpu.validated) {
+				overlay->text("Validation %s", cpu.comparison.passed ? "passed" : "failed");
+				overlay->text("Max. error: %.2e pos, %.2e vel", cpu.comparison.maxPositionError, cpu.comparison.maxVelocityError);
+			}
+		}
+		if (overlay->header("Frame times")) {
+			overlay->text("Overlapped: %.3f ms", frameTimes.overlap);
+			overlay->text("Serial: %.3f ms", frameTimes.serial);
+		}
 	}
 };
 
@@ -3,6 +3,7 @@
 * 
 * This samples implements a basic ray tracer with materials and reflections using a compute shader
 * Shader storage buffers are used to pass geometry information for spheres and planes to the computer shader
+* A triangle mesh loaded from glTF is traced through a four wide bounding volume hierarchy built on the CPU (see vks::BVH)
 * The compute shader then uses these as the scene geometry for ray tracing and outputs the results to a storage image
 * The graphics part of the sample then displays that image full screen
 * Not to be confused with actual hardware accelerated ray tracing
@@ -13,6 +14,10 @@
 */
 
 #include "vulkanexamplebase.h"
+#include "VulkanglTFModel.h"
+#include "VulkanBVH.h"
+#include "VulkanQueryManager.h"
+#include <glm/gtc/packing.hpp>
 
 class VulkanExample : public VulkanExampleBase
 {
@@ -33,6 +38,14 @@ public:
 		// Object properties for planes and spheres are passed via a shade storage buffer
 		// There is no vertex data, the compute shader calculates the primitives on the fly
 		vks::Buffer objectStorageBuffer;
+		// Hierarchy and triangles of the mesh
+		vks::Buffer bvhNodeBuffer;
+		vks::Buffer triangleBuffer;
+		// Ray counter written by the compute shader, host visible
+		vks::Buffer statisticsBuffer;
+		// Start and end timestamps of the dispatch
+		vks::QueryManager timestamps;
+		bool timestampsSupported{ false };
 		vks::Buffer uniformBuffer;										// Uniform buffer object containing scene parameters
 		VkQueue queue{ VK_NULL_HANDLE };								// Separate queue for compute commands (queue family may differ from the one used for graphics)
 		VkCommandPool commandPool{ VK_NULL_HANDLE };					// Use a separate command pool (queue family may differ from the one used for graphics)
@@ -48,10 +61,13 @@ public:
 			glm::vec4 fogColor = glm::vec4(0.0f);
 			struct {
 				glm::vec3 pos = glm::vec3(0.0f, 0.0f, 4.0f);
+				// std140 aligns the vec3 members to 16 bytes
+				float _pad0;
 				glm::vec3 lookat = glm::vec3(0.0f, 0.5f, 0.0f);
 				float fov = 10.0f;
 			} camera;
             glm::mat4 _pad;
+			int32_t meshEnabled{ 1 };
 		} uniformData;
 	} compute;
 
@@ -74,9 +90,19 @@ public:
 		glm::ivec2 _pad;
 	};
 
+	vks::BVH bvh;
+	bool bvhValid{ false };
+	struct {
+		uint32_t raysPerFrame{ 0 };
+		double dispatchTime{ 0.0 };
+		double raysPerSecond{ 0.0 };
+	} rayStatistics;
+
 	VulkanExample() : VulkanExampleBase()
 	{
 		title = "Compute shader ray tracing";
+		// The BVH traversal and its buffer bindings are only implemented in the GLSL compute shader
+		requireGlslShaders();
 		timerSpeed *= 0.25f;
 
 		camera.type = Camera::CameraType::lookat;
@@ -103,6 +129,10 @@ public:
 			vkDestroyCommandPool(device, compute.commandPool, nullptr);
 			compute.uniformBuffer.destroy();
 			compute.objectStorageBuffer.destroy();
+			compute.bvhNodeBuffer.destroy();
+			compute.triangleBuffer.destroy();
+			compute.statisticsBuffer.destroy();
+			compute.timestamps.destroy();
 
 			storageImage.destroy();
 		}
@@ -346,11 +376,35 @@ public:
 				1, &imageMemoryBarrier);
 		}
 
+		// Reset the ray counter
+		vkCmdFillBuffer(compute.commandBuffer, compute.statisticsBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+		VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
+		bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		bufferBarrier.buffer = compute.statisticsBuffer.buffer;
+		bufferBarrier.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(compute.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_FLAGS_NONE, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+
+		if (compute.timestampsSupported) {
+			compute.timestamps.cmdBeginFrame(compute.commandBuffer, 0);
+			compute.timestamps.cmdWriteTimestamp(compute.commandBuffer, 0, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+		}
+
 		vkCmdBindPipeline(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipeline);
 		vkCmdBindDescriptorSets(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSet, 0, 0);
 
 		vkCmdDispatch(compute.commandBuffer, storageImage.width / 16, storageImage.height / 16, 1);
 
+		if (compute.timestampsSupported) {
+			compute.timestamps.cmdWriteTimestamp(compute.commandBuffer, 0, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+			compute.timestamps.cmdResolve(compute.commandBuffer, 0);
+		}
+
+		// Make the ray counter visible to the host
+		bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(compute.commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, VK_FLAGS_NONE, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+
 		if (vulkanDevice->queueFamilyIndices.graphics != vulkanDevice->queueFamilyIndices.compute)
 		{
 			// Release barrier from compute queue
@@ -414,18 +468,49 @@ public:
 		addPlane(glm::vec3(-1.0f, 0.0f, 0.0f), roomDim, glm::vec3(1.0f, 0.0f, 0.0f), 32.0f);
 		addPlane(glm::vec3(1.0f, 0.0f, 0.0f), roomDim, glm::vec3(0.0f, 1.0f, 0.0f), 32.0f);
 
-		VkDeviceSize storageBufferSize = sceneObjects.size() * sizeof(SceneObject);
-
 		// Copy the data to the device
-		vks::Buffer stagingBuffer;
-		vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, storageBufferSize, sceneObjects.data());
-		vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &compute.objectStorageBuffer, storageBufferSize);
-		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		VkBufferCopy copyRegion = { 0, 0, storageBufferSize};
-		vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, compute.objectStorageBuffer.buffer, 1, &copyRegion);
-		vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
-
-		stagingBuffer.destroy();
+		auto uploadStorageBuffer = [this](vks::Buffer& buffer, const void* data, VkDeviceSize size) {
+			vks::Buffer stagingBuffer;
+			vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, size, const_cast<void*>(data));
+			vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &buffer, size);
+			VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			VkBufferCopy copyRegion = { 0, 0, size };
+			vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, buffer.buffer, 1, &copyRegion);
+			vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
+			stagingBuffer.destroy();
+		};
+
+		uploadStorageBuffer(compute.objectStorageBuffer, sceneObjects.data(), sceneObjects.size() * sizeof(SceneObject));
+		uploadStorageBuffer(compute.bvhNodeBuffer, bvh.nodes.data(), bvh.nodes.size() * sizeof(vks::BVH::Node));
+		uploadStorageBuffer(compute.triangleBuffer, bvh.triangles.data(), bvh.triangles.size() * sizeof(vks::BVH::Triangle));
+
+		vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &compute.statisticsBuffer, sizeof(uint32_t));
+		VK_CHECK_RESULT(compute.statisticsBuffer.map());
+	}
+
+	// Load a glTF mesh and build the bounding volume hierarchy the compute shader traces it with
+	void loadAssets()
+	{
+		vkglTF::Model model;
+		// Vertex data needs to stay in host memory for building the hierarchy
+		const uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::PreMultiplyVertexColors | vkglTF::FileLoadingFlags::DontLoadImages | vkglTF::FileLoadingFlags::KeepHostData;
+		model.loadFromFile(getAssetPath() + "models/chinesedragon.gltf", vulkanDevice, queue, glTFLoadingFlags);
+
+		// Fit the mesh into the back of the room, behind the spheres
+		const float scale = 3.0f / glm::max(model.dimensions.size.x, glm::max(model.dimensions.size.y, model.dimensions.size.z));
+		const glm::vec3 offset = glm::vec3(0.0f, -2.5f, -2.5f);
+		std::vector<glm::vec3> positions(model.vertexData.size());
+		for (size_t i = 0; i < model.vertexData.size(); i++) {
+			positions[i] = (model.vertexData[i].pos - model.dimensions.center) * scale + offset;
+		}
+		std::vector<uint32_t> colors(model.indexData.size() / 3);
+		for (size_t i = 0; i < colors.size(); i++) {
+			colors[i] = glm::packUnorm4x8(model.vertexData[model.indexData[i * 3]].color);
+		}
+
+		bvh.build(positions, model.indexData, colors);
+		bvhValid = bvh.validate();
+		std::cout << "BVH for " << bvh.statistics.triangles << " triangles built in " << bvh.statistics.buildTime << " ms (collapsed in " << bvh.statistics.collapseTime << " ms), " << bvh.statistics.nodes << " nodes, SAH cost " << bvh.statistics.sahCost << (bvhValid ? "" : ", validation failed") << "\n";
 	}
 
 	// The descriptor pool will be shared between graphics and compute
@@ -435,7 +520,7 @@ public:
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2),
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4),
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4),
 		};
 		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 3);
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
@@ -515,15 +600,21 @@ public:
 
 		// Setup descriptors
 
-		// The compute pipeline uses one set and four bindings
+		// The compute pipeline uses one set and six bindings
 		// Binding 0: Storage image for raytraced output
 		// Binding 1: Uniform buffer with parameters
 		// Binding 2: Shader storage buffer with scene object definitions
+		// Binding 3: Shader storage buffer with the mesh hierarchy nodes
+		// Binding 4: Shader storage buffer with the mesh triangles
+		// Binding 5: Shader storage buffer with the ray counter
 
 		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 0),
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 5),
 		};
 		VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr,	&compute.descriptorSetLayout));
@@ -534,6 +625,9 @@ public:
 			vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0, &storageImage.descriptor),
 			vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, &compute.uniformBuffer.descriptor),
 			vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &compute.objectStorageBuffer.descriptor),
+			vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &compute.bvhNodeBuffer.descriptor),
+			vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &compute.triangleBuffer.descriptor),
+			vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5, &compute.statisticsBuffer.descriptor),
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, nullptr);
 
@@ -560,6 +654,12 @@ public:
 		VkFenceCreateInfo fenceCreateInfo = vks::initializers::fenceCreateInfo();
 		VK_CHECK_RESULT(vkCreateFence(device, &fenceCreateInfo, nullptr, &compute.fence));
 
+		// Timestamps are used to measure the ray throughput, if the compute queue supports them
+		compute.timestampsSupported = vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.compute].timestampValidBits > 0;
+		if (compute.timestampsSupported) {
+			compute.timestamps.create(vulkanDevice, compute.queue, VK_QUERY_TYPE_TIMESTAMP, 1, 2);
+		}
+
 		// Build a single command buffer containing the compute dispatch commands
 		buildComputeCommandBuffer();
 	}
@@ -585,6 +685,7 @@ public:
 	void prepare()
 	{
 		VulkanExampleBase::prepare();
+		loadAssets();
 		prepareStorageImage();
 		prepareStorageBuffers();
 		prepareUniformBuffers();
@@ -608,6 +709,14 @@ public:
 		vkWaitForFences(device, 1, &compute.fence, VK_TRUE, UINT64_MAX);
 		vkResetFences(device, 1, &compute.fence);
 
+		// The dispatch has finished, so its statistics can be read without waiting
+		rayStatistics.raysPerFrame = *static_cast<uint32_t*>(compute.statisticsBuffer.mapped);
+		if (compute.timestampsSupported) {
+			const uint64_t ticks = compute.timestamps.getResult(0, 1) - compute.timestamps.getResult(0, 0);
+			rayStatistics.dispatchTime = ticks * (double)vulkanDevice->properties.limits.timestampPeriod / 1000000.0;
+			rayStatistics.raysPerSecond = (rayStatistics.dispatchTime > 0.0) ? rayStatistics.raysPerFrame / (rayStatistics.dispatchTime / 1000.0) : 0.0;
+		}
+
 		VulkanExampleBase::prepareFrame();
 
 		// Command buffer to be submitted to the queue
@@ -625,6 +734,26 @@ public:
 		updateUniformBuffers();
 		draw();
 	}
+
+	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
+	{
+		if (overlay->header("Settings")) {
+			overlay->checkBox("Triangle mesh", &compute.uniformData.meshEnabled);
+		}
+		if (overlay->header("Statistics")) {
+			overlay->text("Triangles: %u", bvh.statistics.triangles);
+			overlay->text("BVH nodes: %u (depth %u)", bvh.statistics.nodes, bvh.statistics.maxDepth);
+			overlay->text("BVH build: %.2f ms", bvh.statistics.buildTime + bvh.statistics.collapseTime);
+			if (!bvhValid) {
+				overlay->text("BVH validation failed");
+			}
+			overlay->text("Rays per frame: %.2f M", rayStatistics.raysPerFrame / 1000000.0);
+			if (compute.timestampsSupported) {
+				overlay->text("Dispatch: %.2f ms", rayStatistics.dispatchTime);
+				overlay->text("Ray throughput: %.1f Mrays/s", rayStatistics.raysPerSecond / 1000000.0);
+			}
+		}
+	}
 };
 
 VULKAN_EXAMPLE_MAIN()
@@ -5,7 +5,10 @@
 * albedo, normals, world positions are rendered to offscreen images which are then put together and lit
 * in a composition pass
 * Use the dropdown in the ui to switch between the final composition pass or the separate components
-* 
+* Both passes are declared in a render graph (see base/VulkanRenderGraph.h) that creates the G-buffer images, render passes and barriers
+* The G-buffer can be switched to a compact layout that reconstructs positions from depth (see base/VulkanGBufferLayout.h)
+* Lights are culled into view space clusters by a compute pass (see base/VulkanLightClusters.h), so the composition pass only
+* evaluates the lights close to each fragment and thousands of dynamic lights can be used
 * 
 * Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
 *
@@ -14,6 +17,12 @@
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "VulkanRenderGraph.h"
+#include "VulkanGBufferLayout.h"
+#include "VulkanQueryManager.h"
+#include "VulkanLightClusters.h"
+
+#define MAX_LIGHT_COUNT 16384
 
 class VulkanExample : public VulkanExampleBase
 {
@@ -43,15 +52,10 @@ public:
 		glm::vec4 instancePos[3];
 	} uniformDataOffscreen;
 
-	struct Light {
-		glm::vec4 position;
-		glm::vec3 color;
-		float radius;
-	};
-
 	struct UniformDataComposition {
-		Light lights[6];
 		glm::vec4 viewPos;
+		// Used to reconstruct positions from depth with the compact G-buffer layout
+		glm::mat4 inverseViewProjection;
 		int debugDisplayTarget = 0;
 	} uniformDataComposition;
 
@@ -74,33 +78,71 @@ public:
 
 	VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
 
-	// Framebuffers holding the deferred attachments
-	struct FrameBufferAttachment {
-		VkImage image;
-		VkDeviceMemory mem;
-		VkImageView view;
-		VkFormat format;
-	};
-	struct FrameBuffer {
-		int32_t width, height;
-		VkFramebuffer frameBuffer;
-		// One attachment for every component required for a deferred rendering setup
-		FrameBufferAttachment position, normal, albedo;
-		FrameBufferAttachment depth;
-		VkRenderPass renderPass;
-	} offScreenFrameBuf{};
+	vks::GBufferLayout gBufferLayout;
+
+	// The G-buffer attachments are transient images of the render graph, which also creates the render passes and barriers
+	vks::RenderGraph renderGraph;
+	struct {
+		// Color targets of the G-buffer layout
+		std::vector<vks::RenderGraph::ResourceHandle> gBuffer;
+		vks::RenderGraph::ResourceHandle depth;
+		vks::RenderGraph::ResourceHandle swapChainImage;
+		vks::RenderGraph::ResourceHandle depthStencil;
+	} graphResources{};
+	struct {
+		vks::RenderGraph::PassHandle gBuffer;
+		vks::RenderGraph::PassHandle composition;
+	} graphPasses{};
 
 	// One sampler for the frame buffer color attachments
 	VkSampler colorSampler{ VK_NULL_HANDLE };
 
-	VkCommandBuffer offScreenCmdBuffer{ VK_NULL_HANDLE };
-
-	// Semaphore used to synchronize between offscreen and final scene rendering
-	VkSemaphore offscreenSemaphore{ VK_NULL_HANDLE };
+	// GPU times of the passes are measured with timestamps written before, between and after them
+	vks::QueryManager timestamps;
+	bool timestampsSupported{ false };
+	// Command buffer currently recorded, used by the pass callbacks to write the timestamps
+	uint32_t recordingFrame{ 0 };
+	struct {
+		float lightCulling{ 0.0f };
+		float gBuffer{ 0.0f };
+		float composition{ 0.0f };
+	} passTimes;
+
+	// The first six lights are the scene's main lights, the others are small lights moving on random circles
+	vks::LightClusters lightClusters;
+	std::vector<vks::LightClusters::Light> lights;
+	struct LightAnimation {
+		glm::vec3 center;
+		float radius;
+		float speed;
+		float phase;
+	};
+	std::vector<LightAnimation> lightAnimations;
+	int32_t lightCount = 1024;
+
+	// Measures the GPU times of light culling and composition for increasing light counts
+	struct LightScalingResult {
+		uint32_t lightCount;
+		float lightCulling;
+		float composition;
+	};
+	struct {
+		const std::vector<uint32_t> lightCounts = { 64, 256, 1024, 4096, 16384 };
+		// Frames rendered with a new light count before measuring, the timestamps lag behind by the number of command buffers
+		const uint32_t warmupFrames = 16;
+		const uint32_t measuredFrames = 64;
+		bool active{ false };
+		uint32_t step{ 0 };
+		uint32_t frame{ 0 };
+		int32_t previousLightCount{ 0 };
+		std::vector<LightScalingResult> results;
+	} lightScaling;
 
 	VulkanExample() : VulkanExampleBase()
 	{
 		title = "Deferred shading";
+		// The compact G-buffer and the light clustering only have GLSL shaders
+		requireGlslShaders();
 		camera.type = Camera::CameraType::firstperson;
 		camera.movementSpeed = 5.0f;
 #ifndef __ANDROID__
@@ -116,27 +158,12 @@ public:
 		if (device) {
 			vkDestroySampler(device, colorSampler, nullptr);
 
-			// Frame buffer
-
-			// Color attachments
-			vkDestroyImageView(device, offScreenFrameBuf.position.view, nullptr);
-			vkDestroyImage(device, offScreenFrameBuf.position.image, nullptr);
-			vkFreeMemory(device, offScreenFrameBuf.position.mem, nullptr);
-
-			vkDestroyImageView(device, offScreenFrameBuf.normal.view, nullptr);
-			vkDestroyImage(device, offScreenFrameBuf.normal.image, nullptr);
-			vkFreeMemory(device, offScreenFrameBuf.normal.mem, nullptr);
+			renderGraph.destroy();
+			lightClusters.destroy();
 
-			vkDestroyImageView(device, offScreenFrameBuf.albedo.view, nullptr);
-			vkDestroyImage(device, offScreenFrameBuf.albedo.image, nullptr);
-			vkFreeMemory(device, offScreenFrameBuf.albedo.mem, nullptr);
-
-			// Depth attachment
-			vkDestroyImageView(device, offScreenFrameBuf.depth.view, nullptr);
-			vkDestroyImage(device, offScreenFrameBuf.depth.image, nullptr);
-			vkFreeMemory(device, offScreenFrameBuf.depth.mem, nullptr);
-
-			vkDestroyFramebuffer(device, offScreenFrameBuf.frameBuffer, nullptr);
+			if (timestampsSupported) {
+				timestamps.destroy();
+			}
 
 			vkDestroyPipeline(device, pipelines.composition, nullptr);
 			vkDestroyPipeline(device, pipelines.offscreen, nullptr);
@@ -149,14 +176,10 @@ public:
 			uniformBuffers.offscreen.destroy();
 			uniformBuffers.composition.destroy();
 
-			vkDestroyRenderPass(device, offScreenFrameBuf.renderPass, nullptr);
-
 			textures.model.colorMap.destroy();
 			textures.model.normalMap.destroy();
 			textures.floor.colorMap.destroy();
 			textures.floor.normalMap.destroy();
-
-			vkDestroySemaphore(device, offscreenSemaphore, nullptr);
 		}
 	}
 
@@ -169,197 +192,89 @@ public:
 		}
 	};
 
-	// Create a frame buffer attachment
-	void createAttachment(
-		VkFormat format,
-		VkImageUsageFlagBits usage,
-		FrameBufferAttachment *attachment)
+	// Declare the passes and the images they access, the render graph derives the render passes, barriers and memory layout from this
+	void prepareRenderGraph()
 	{
-		VkImageAspectFlags aspectMask = 0;
-		VkImageLayout imageLayout;
-
-		attachment->format = format;
-
-		if (usage & VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT)
-		{
-			aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		renderGraph.clear();
+
+		// Note: Instead of using fixed sizes, one could also match the window size and recreate the graph on resize
+		vks::RenderGraph::ImageDesc gBufferDesc{};
+		gBufferDesc.width = 2048;
+		gBufferDesc.height = 2048;
+
+		// Color targets of the current layout, (world space) positions, normals and albedo or encoded normals and albedo
+		graphResources.gBuffer.clear();
+		for (auto& target : gBufferLayout.colorTargets) {
+			gBufferDesc.format = target.format;
+			graphResources.gBuffer.push_back(renderGraph.createImage(target.name, gBufferDesc));
 		}
-		if (usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)
-		{
-			aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-			if (format >= VK_FORMAT_D16_UNORM_S8_UINT)
-				aspectMask |=VK_IMAGE_ASPECT_STENCIL_BIT;
-			imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		// With the reference layout, depth is only needed while filling the G-buffer, so it's never written back to memory
+		gBufferDesc.format = gBufferLayout.depthFormat;
+		graphResources.depth = renderGraph.createImage("G-Buffer depth", gBufferDesc);
+
+		// The images of the default frame buffers are imported, the swap chain image is set for each command buffer
+		vks::RenderGraph::ImportedImage swapChainImage{};
+		swapChainImage.format = swapChain.colorFormat;
+		// Rendering waits for the image to be acquired at the color attachment output stage
+		swapChainImage.initialStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		swapChainImage.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		graphResources.swapChainImage = renderGraph.importImage("Swap chain image", swapChainImage);
+		vks::RenderGraph::ImportedImage depthStencilImage{};
+		depthStencilImage.format = depthFormat;
+		depthStencilImage.initialStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		depthStencilImage.initialAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		graphResources.depthStencil = renderGraph.importImage("Depth stencil", depthStencilImage);
+
+		// First pass: Fill the G-buffer components using MRT
+		graphPasses.gBuffer = renderGraph.addGraphicsPass("G-Buffer", [this](VkCommandBuffer commandBuffer) {
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.offscreen);
+
+			// Floor
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.floor, 0, nullptr);
+			models.floor.draw(commandBuffer);
+
+			// We render multiple instances of a model
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.model, 0, nullptr);
+			models.model.bindBuffers(commandBuffer);
+			vkCmdDrawIndexed(commandBuffer, models.model.indices.count, 3, 0, 0, 0);
+		});
+		for (auto resource : graphResources.gBuffer) {
+			renderGraph.addColorAttachment(graphPasses.gBuffer, resource);
 		}
+		renderGraph.setDepthStencilAttachment(graphPasses.gBuffer, graphResources.depth);
 
-		assert(aspectMask > 0);
-
-		VkImageCreateInfo image = vks::initializers::imageCreateInfo();
-		image.imageType = VK_IMAGE_TYPE_2D;
-		image.format = format;
-		image.extent.width = offScreenFrameBuf.width;
-		image.extent.height = offScreenFrameBuf.height;
-		image.extent.depth = 1;
-		image.mipLevels = 1;
-		image.arrayLayers = 1;
-		image.samples = VK_SAMPLE_COUNT_1_BIT;
-		image.tiling = VK_IMAGE_TILING_OPTIMAL;
-		image.usage = usage | VK_IMAGE_USAGE_SAMPLED_BIT;
-
-		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
-		VkMemoryRequirements memReqs;
-
-		VK_CHECK_RESULT(vkCreateImage(device, &image, nullptr, &attachment->image));
-		vkGetImageMemoryRequirements(device, attachment->image, &memReqs);
-		memAlloc.allocationSize = memReqs.size;
-		memAlloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &attachment->mem));
-		VK_CHECK_RESULT(vkBindImageMemory(device, attachment->image, attachment->mem, 0));
-
-		VkImageViewCreateInfo imageView = vks::initializers::imageViewCreateInfo();
-		imageView.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		imageView.format = format;
-		imageView.subresourceRange = {};
-		imageView.subresourceRange.aspectMask = aspectMask;
-		imageView.subresourceRange.baseMipLevel = 0;
-		imageView.subresourceRange.levelCount = 1;
-		imageView.subresourceRange.baseArrayLayer = 0;
-		imageView.subresourceRange.layerCount = 1;
-		imageView.image = attachment->image;
-		VK_CHECK_RESULT(vkCreateImageView(device, &imageView, nullptr, &attachment->view));
-	}
-
-	// Prepare a new framebuffer and attachments for offscreen rendering (G-Buffer)
-	void prepareOffscreenFramebuffer()
-	{
-		// Note: Instead of using fixed sizes, one could also match the window size and recreate the attachments on resize
-		offScreenFrameBuf.width = 2048;
-		offScreenFrameBuf.height = 2048;
-
-		// Color attachments
-
-		// (World space) Positions
-		createAttachment(
-			VK_FORMAT_R16G16B16A16_SFLOAT,
-			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-			&offScreenFrameBuf.position);
-
-		// (World space) Normals
-		createAttachment(
-			VK_FORMAT_R16G16B16A16_SFLOAT,
-			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-			&offScreenFrameBuf.normal);
-
-		// Albedo (color)
-		createAttachment(
-			VK_FORMAT_R8G8B8A8_UNORM,
-			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-			&offScreenFrameBuf.albedo);
-
-		// Depth attachment
-
-		// Find a suitable depth format
-		VkFormat attDepthFormat;
-		VkBool32 validDepthFormat = vks::tools::getSupportedDepthFormat(physicalDevice, &attDepthFormat);
-		assert(validDepthFormat);
-
-		createAttachment(
-			attDepthFormat,
-			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-			&offScreenFrameBuf.depth);
-
-		// Set up separate renderpass with references to the color and depth attachments
-		std::array<VkAttachmentDescription, 4> attachmentDescs = {};
-
-		// Init attachment properties
-		for (uint32_t i = 0; i < 4; ++i)
-		{
-			attachmentDescs[i].samples = VK_SAMPLE_COUNT_1_BIT;
-			attachmentDescs[i].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-			attachmentDescs[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-			attachmentDescs[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-			attachmentDescs[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-			if (i == 3)
-			{
-				attachmentDescs[i].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-				attachmentDescs[i].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		// Second pass: Final composition
+		graphPasses.composition = renderGraph.addGraphicsPass("Composition", [this](VkCommandBuffer commandBuffer) {
+			// Written once the G-buffer pass has finished
+			if (timestampsSupported) {
+				timestamps.cmdWriteTimestamp(commandBuffer, recordingFrame, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
 			}
-			else
-			{
-				attachmentDescs[i].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-				attachmentDescs[i].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.composition, 0, nullptr);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.composition);
+			// This is done by simply drawing a full screen quad
+			// The fragment shader then combines the deferred attachments into the final image
+			// Note: Also used for debug display if debugDisplayTarget > 0
+			vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+			if (timestampsSupported) {
+				timestamps.cmdWriteTimestamp(commandBuffer, recordingFrame, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
 			}
+			drawUI(commandBuffer);
+		});
+		renderGraph.addColorAttachment(graphPasses.composition, graphResources.swapChainImage, VK_ATTACHMENT_LOAD_OP_CLEAR, { { 0.0f, 0.0f, 0.2f, 0.0f } });
+		renderGraph.setDepthStencilAttachment(graphPasses.composition, graphResources.depthStencil);
+		for (auto resource : graphResources.gBuffer) {
+			renderGraph.addSampledImage(graphPasses.composition, resource);
+		}
+		// The compact layout reconstructs positions from depth
+		if (gBufferLayout.sampledDepth()) {
+			renderGraph.addSampledImage(graphPasses.composition, graphResources.depth);
 		}
 
-		// Formats
-		attachmentDescs[0].format = offScreenFrameBuf.position.format;
-		attachmentDescs[1].format = offScreenFrameBuf.normal.format;
-		attachmentDescs[2].format = offScreenFrameBuf.albedo.format;
-		attachmentDescs[3].format = offScreenFrameBuf.depth.format;
-
-		std::vector<VkAttachmentReference> colorReferences;
-		colorReferences.push_back({ 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
-		colorReferences.push_back({ 1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
-		colorReferences.push_back({ 2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
-
-		VkAttachmentReference depthReference = {};
-		depthReference.attachment = 3;
-		depthReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-		VkSubpassDescription subpass = {};
-		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-		subpass.pColorAttachments = colorReferences.data();
-		subpass.colorAttachmentCount = static_cast<uint32_t>(colorReferences.size());
-		subpass.pDepthStencilAttachment = &depthReference;
-
-		// Use subpass dependencies for attachment layout transitions
-		std::array<VkSubpassDependency, 2> dependencies;
-
-		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-		dependencies[0].dstSubpass = 0;
-		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-		dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-		dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-		dependencies[1].srcSubpass = 0;
-		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-		dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-		dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-		VkRenderPassCreateInfo renderPassInfo = {};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-		renderPassInfo.pAttachments = attachmentDescs.data();
-		renderPassInfo.attachmentCount = static_cast<uint32_t>(attachmentDescs.size());
-		renderPassInfo.subpassCount = 1;
-		renderPassInfo.pSubpasses = &subpass;
-		renderPassInfo.dependencyCount = 2;
-		renderPassInfo.pDependencies = dependencies.data();
-
-		VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &offScreenFrameBuf.renderPass));
-
-		std::array<VkImageView,4> attachments;
-		attachments[0] = offScreenFrameBuf.position.view;
-		attachments[1] = offScreenFrameBuf.normal.view;
-		attachments[2] = offScreenFrameBuf.albedo.view;
-		attachments[3] = offScreenFrameBuf.depth.view;
-
-		VkFramebufferCreateInfo fbufCreateInfo = {};
-		fbufCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-		fbufCreateInfo.pNext = NULL;
-		fbufCreateInfo.renderPass = offScreenFrameBuf.renderPass;
-		fbufCreateInfo.pAttachments = attachments.data();
-		fbufCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-		fbufCreateInfo.width = offScreenFrameBuf.width;
-		fbufCreateInfo.height = offScreenFrameBuf.height;
-		fbufCreateInfo.layers = 1;
-		VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &offScreenFrameBuf.frameBuffer));
+		renderGraph.compile();
+	}
 
+	void prepareSampler()
+	{
 		// Create sampler to sample from the color attachments
 		VkSamplerCreateInfo sampler = vks::initializers::samplerCreateInfo();
 		sampler.magFilter = VK_FILTER_NEAREST;
@@ -376,58 +291,12 @@ public:
 		VK_CHECK_RESULT(vkCreateSampler(device, &sampler, nullptr, &colorSampler));
 	}
 
-	// Build command buffer for rendering the scene to the offscreen frame buffer attachments
-	void buildDeferredCommandBuffer()
+	void prepareTimestamps()
 	{
-		if (offScreenCmdBuffer == VK_NULL_HANDLE) {
-			offScreenCmdBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, false);
+		timestampsSupported = (vulkanDevice->properties.limits.timestampComputeAndGraphics == VK_TRUE) && (vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].timestampValidBits > 0);
+		if (timestampsSupported) {
+			timestamps.create(vulkanDevice, queue, VK_QUERY_TYPE_TIMESTAMP, static_cast<uint32_t>(drawCmdBuffers.size()), 4);
 		}
-
-		// Create a semaphore used to synchronize offscreen rendering and usage
-		VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
-		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &offscreenSemaphore));
-
-		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
-
-		// Clear values for all attachments written in the fragment shader
-		std::array<VkClearValue,4> clearValues;
-		clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-		clearValues[1].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-		clearValues[2].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-		clearValues[3].depthStencil = { 1.0f, 0 };
-
-		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-		renderPassBeginInfo.renderPass =  offScreenFrameBuf.renderPass;
-		renderPassBeginInfo.framebuffer = offScreenFrameBuf.frameBuffer;
-		renderPassBeginInfo.renderArea.extent.width = offScreenFrameBuf.width;
-		renderPassBeginInfo.renderArea.extent.height = offScreenFrameBuf.height;
-		renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-		renderPassBeginInfo.pClearValues = clearValues.data();
-
-		VK_CHECK_RESULT(vkBeginCommandBuffer(offScreenCmdBuffer, &cmdBufInfo));
-
-		vkCmdBeginRenderPass(offScreenCmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-		VkViewport viewport = vks::initializers::viewport((float)offScreenFrameBuf.width, (float)offScreenFrameBuf.height, 0.0f, 1.0f);
-		vkCmdSetViewport(offScreenCmdBuffer, 0, 1, &viewport);
-
-		VkRect2D scissor = vks::initializers::rect2D(offScreenFrameBuf.width, offScreenFrameBuf.height, 0, 0);
-		vkCmdSetScissor(offScreenCmdBuffer, 0, 1, &scissor);
-
-		vkCmdBindPipeline(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.offscreen);
-
-		// Floor
-		vkCmdBindDescriptorSets(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.floor, 0, nullptr);
-		models.floor.draw(offScreenCmdBuffer);
-
-		// We render multiple instances of a model
-		vkCmdBindDescriptorSets(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.model, 0, nullptr);
-		models.model.bindBuffers(offScreenCmdBuffer);
-		vkCmdDrawIndexed(offScreenCmdBuffer, models.model.indices.count, 3, 0, 0, 0);
-
-		vkCmdEndRenderPass(offScreenCmdBuffer);
-
-		VK_CHECK_RESULT(vkEndCommandBuffer(offScreenCmdBuffer));
 	}
 
 	void loadAssets()
@@ -445,57 +314,50 @@ public:
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
-		VkClearValue clearValues[2];
-		clearValues[0].color = { { 0.0f, 0.0f, 0.2f, 0.0f } };
-		clearValues[1].depthStencil = { 1.0f, 0 };
-
-		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-		renderPassBeginInfo.renderPass = renderPass;
-		renderPassBeginInfo.renderArea.offset.x = 0;
-		renderPassBeginInfo.renderArea.offset.y = 0;
-		renderPassBeginInfo.renderArea.extent.width = width;
-		renderPassBeginInfo.renderArea.extent.height = height;
-		renderPassBeginInfo.clearValueCount = 2;
-		renderPassBeginInfo.pClearValues = clearValues;
-
 		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
 		{
-			renderPassBeginInfo.framebuffer = frameBuffers[i];
+			renderGraph.updateImportedImage(graphResources.swapChainImage, swapChain.images[i], swapChain.imageViews[i], width, height);
+			renderGraph.updateImportedImage(graphResources.depthStencil, depthStencil.image, depthStencil.view, width, height);
 
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
-			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
-			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-
-			VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
-			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
-
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.composition, 0, nullptr);
+			recordingFrame = i;
+			if (timestampsSupported) {
+				timestamps.cmdBeginFrame(drawCmdBuffers[i], i);
+				timestamps.cmdWriteTimestamp(drawCmdBuffers[i], i, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+			}
 
-   			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.composition);
-			
-			// Final composition
-			// This is done by simply drawing a full screen quad
-			// The fragment shader then combines the deferred attachments into the final image
-			// Note: Also used for debug display if debugDisplayTarget > 0
-			vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
+			// The render graph only tracks images, so the light culling is recorded ahead of it and synchronizes its buffers itself
+			lightClusters.cmdBuild(drawCmdBuffers[i], VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+			if (timestampsSupported) {
+				timestamps.cmdWriteTimestamp(drawCmdBuffers[i], i, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+			}
 
-			drawUI(drawCmdBuffers[i]);
+			// Both passes are recorded into the same command buffer, the barriers between them are inserted by the render graph
+			renderGraph.execute(drawCmdBuffers[i]);
 
-			vkCmdEndRenderPass(drawCmdBuffers[i]);
+			if (timestampsSupported) {
+				timestamps.cmdResolve(drawCmdBuffers[i], i);
+			}
 
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 		}
 	}
 
+	// The frame buffers of the graph reference the swap chain and depth stencil images, which are recreated on resize
+	void setupFrameBuffer()
+	{
+		VulkanExampleBase::setupFrameBuffer();
+		renderGraph.resetFramebuffers();
+	}
+
 	void setupDescriptors()
 	{
 		// Pool
 		std::vector<VkDescriptorPoolSize> poolSizes = {
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 8),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 9)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 9),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 9),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 9)
 		};
 		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 3);
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
@@ -504,7 +366,7 @@ public:
 		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
 			// Binding 0 : Vertex shader uniform buffer
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0),
-			// Binding 1 : Position texture target / Scene colormap
+			// Binding 1 : Position (or depth) texture target / Scene colormap
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),
 			// Binding 2 : Normals texture target
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 2),
@@ -512,6 +374,14 @@ public:
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 3),
 			// Binding 4 : Fragment shader uniform buffer
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 4),
+			// Binding 5 : Lights
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 5),
+			// Binding 6 : Light clusters
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 6),
+			// Binding 7 : Light indices of the clusters
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 7),
+			// Binding 8 : Light cluster grid parameters
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 8),
 		};
 		VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &descriptorSetLayout));
@@ -520,38 +390,22 @@ public:
 		std::vector<VkWriteDescriptorSet> writeDescriptorSets;
 		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
 
-		// Image descriptors for the offscreen color attachments
-		VkDescriptorImageInfo texDescriptorPosition =
-			vks::initializers::descriptorImageInfo(
-				colorSampler,
-				offScreenFrameBuf.position.view,
-				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-		VkDescriptorImageInfo texDescriptorNormal =
-			vks::initializers::descriptorImageInfo(
-				colorSampler,
-				offScreenFrameBuf.normal.view,
-				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-		VkDescriptorImageInfo texDescriptorAlbedo =
-			vks::initializers::descriptorImageInfo(
-				colorSampler,
-				offScreenFrameBuf.albedo.view,
-				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
 		// Deferred composition
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets.composition));
 		writeDescriptorSets = {
-			// Binding 1 : Position texture target
-			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &texDescriptorPosition),
-			// Binding 2 : Normals texture target
-			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &texDescriptorNormal),
-			// Binding 3 : Albedo texture target
-			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &texDescriptorAlbedo),
 			// Binding 4 : Fragment shader uniform buffer
 			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4, &uniformBuffers.composition.descriptor),
+			// Binding 5 : Lights
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5, &lightClusters.lightBuffer.descriptor),
+			// Binding 6 : Light clusters
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6, &lightClusters.clusterBuffer.descriptor),
+			// Binding 7 : Light indices of the clusters
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 7, &lightClusters.lightIndexBuffer.descriptor),
+			// Binding 8 : Light cluster grid parameters
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 8, &lightClusters.uniformBuffer.descriptor),
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+		updateImageDescriptors();
 
 		// Offscreen (scene)
 
@@ -580,11 +434,39 @@ public:
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 	}
 
+	// Point the composition descriptors to the G-buffer images, which change whenever the graph is compiled
+	void updateImageDescriptors()
+	{
+		// Compact layout: depth, encoded normals and albedo, reference layout: positions, normals and albedo
+		std::vector<VkImageView> views;
+		if (gBufferLayout.sampledDepth()) {
+			views.push_back(renderGraph.getImageView(graphResources.depth));
+		}
+		for (auto resource : graphResources.gBuffer) {
+			views.push_back(renderGraph.getImageView(resource));
+		}
+		std::vector<VkDescriptorImageInfo> imageDescriptors;
+		for (auto view : views) {
+			imageDescriptors.push_back(vks::initializers::descriptorImageInfo(colorSampler, view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+		}
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			// Binding 1 : Position (or depth) texture target
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[0]),
+			// Binding 2 : Normals texture target
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &imageDescriptors[1]),
+			// Binding 3 : Albedo texture target
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &imageDescriptors[2]),
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	}
+
 	void preparePipelines()
 	{
-		// Pipeline layout
-		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
-		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout));
+		// Pipeline layout (shared by the pipelines of both G-buffer layouts)
+		if (pipelineLayout == VK_NULL_HANDLE) {
+			VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout));
+		}
 
 		// Pipelines
 		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
@@ -598,7 +480,7 @@ public:
 		VkPipelineDynamicStateCreateInfo dynamicState = vks::initializers::pipelineDynamicStateCreateInfo(dynamicStateEnables);
 		std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
 
-		VkGraphicsPipelineCreateInfo pipelineCI = vks::initializers::pipelineCreateInfo(pipelineLayout, renderPass);
+		VkGraphicsPipelineCreateInfo pipelineCI = vks::initializers::pipelineCreateInfo(pipelineLayout, renderGraph.getRenderPass(graphPasses.composition));
 		pipelineCI.pInputAssemblyState = &inputAssemblyState;
 		pipelineCI.pRasterizationState = &rasterizationState;
 		pipelineCI.pColorBlendState = &colorBlendState;
@@ -609,10 +491,16 @@ public:
 		pipelineCI.stageCount = static_cast<uint32_t>(shaderStages.size());
 		pipelineCI.pStages = shaderStages.data();
 
+		// The G-buffer layout is selected with a specialization constant in both passes
+		VkSpecializationMapEntry specializationEntry = vks::initializers::specializationMapEntry(vks::GBufferLayout::specializationConstantId, 0, sizeof(int32_t));
+		int32_t specializationData = gBufferLayout.type;
+		VkSpecializationInfo specializationInfo = vks::initializers::specializationInfo(1, &specializationEntry, sizeof(specializationData), &specializationData);
+
 		// Final fullscreen composition pass pipeline
 		rasterizationState.cullMode = VK_CULL_MODE_FRONT_BIT;
 		shaderStages[0] = loadShader(getShadersPath() + "deferred/deferred.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
 		shaderStages[1] = loadShader(getShadersPath() + "deferred/deferred.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+		shaderStages[1].pSpecializationInfo = &specializationInfo;
 		// Empty vertex input state, vertices are generated by the vertex shader
 		VkPipelineVertexInputStateCreateInfo emptyInputState = vks::initializers::pipelineVertexInputStateCreateInfo();
 		pipelineCI.pVertexInputState = &emptyInputState;
@@ -625,18 +513,15 @@ public:
 		// Offscreen pipeline
 		shaderStages[0] = loadShader(getShadersPath() + "deferred/mrt.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
 		shaderStages[1] = loadShader(getShadersPath() + "deferred/mrt.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+		shaderStages[1].pSpecializationInfo = &specializationInfo;
 
 		// Separate render pass
-		pipelineCI.renderPass = offScreenFrameBuf.renderPass;
+		pipelineCI.renderPass = renderGraph.getRenderPass(graphPasses.gBuffer);
 
 		// Blend attachment states required for all color attachments
 		// This is important, as color write mask will otherwise be 0x0 and you
 		// won't see anything rendered to the attachment
-		std::array<VkPipelineColorBlendAttachmentState, 3> blendAttachmentStates = {
-			vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE),
-			vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE),
-			vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE)
-		};
+		std::vector<VkPipelineColorBlendAttachmentState> blendAttachmentStates(gBufferLayout.colorTargets.size(), vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE));
 
 		colorBlendState.attachmentCount = static_cast<uint32_t>(blendAttachmentStates.size());
 		colorBlendState.pAttachments = blendAttachmentStates.data();
@@ -676,111 +561,119 @@ public:
 		memcpy(uniformBuffers.offscreen.mapped, &uniformDataOffscreen, sizeof(UniformDataOffscreen));
 	}
 
-	// Update lights and parameters passed to the composition shaders
+	// Parameters passed to the composition shaders
 	void updateUniformBufferComposition()
 	{
+		// Current view position
+		uniformDataComposition.viewPos = glm::vec4(camera.position, 0.0f) * glm::vec4(-1.0f, 1.0f, -1.0f, 1.0f);
+		uniformDataComposition.inverseViewProjection = glm::inverse(camera.matrices.perspective * camera.matrices.view);
+
+		uniformDataComposition.debugDisplayTarget = debugDisplayTarget;
+
+		memcpy(uniformBuffers.composition.mapped, &uniformDataComposition, sizeof(UniformDataComposition));
+	}
+
+	void prepareLights()
+	{
+		lightClusters.create(vulkanDevice, queue, shaderCache, getShadersPath(), MAX_LIGHT_COUNT);
+
+		// The scene's main lights light up the whole scene, so they have a large range
+		lights.resize(MAX_LIGHT_COUNT);
 		// White
-		uniformDataComposition.lights[0].position = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
-		uniformDataComposition.lights[0].color = glm::vec3(1.5f);
-		uniformDataComposition.lights[0].radius = 15.0f * 0.25f;
+		lights[0] = { glm::vec3(0.0f, 0.0f, 1.0f), 30.0f, glm::vec3(1.5f), 15.0f * 0.25f };
 		// Red
-		uniformDataComposition.lights[1].position = glm::vec4(-2.0f, 0.0f, 0.0f, 0.0f);
-		uniformDataComposition.lights[1].color = glm::vec3(1.0f, 0.0f, 0.0f);
-		uniformDataComposition.lights[1].radius = 15.0f;
+		lights[1] = { glm::vec3(-2.0f, 0.0f, 0.0f), 30.0f, glm::vec3(1.0f, 0.0f, 0.0f), 15.0f };
 		// Blue
-		uniformDataComposition.lights[2].position = glm::vec4(2.0f, -1.0f, 0.0f, 0.0f);
-		uniformDataComposition.lights[2].color = glm::vec3(0.0f, 0.0f, 2.5f);
-		uniformDataComposition.lights[2].radius = 5.0f;
+		lights[2] = { glm::vec3(2.0f, -1.0f, 0.0f), 30.0f, glm::vec3(0.0f, 0.0f, 2.5f), 5.0f };
 		// Yellow
-		uniformDataComposition.lights[3].position = glm::vec4(0.0f, -0.9f, 0.5f, 0.0f);
-		uniformDataComposition.lights[3].color = glm::vec3(1.0f, 1.0f, 0.0f);
-		uniformDataComposition.lights[3].radius = 2.0f;
+		lights[3] = { glm::vec3(0.0f, -0.9f, 0.5f), 30.0f, glm::vec3(1.0f, 1.0f, 0.0f), 2.0f };
 		// Green
-		uniformDataComposition.lights[4].position = glm::vec4(0.0f, -0.5f, 0.0f, 0.0f);
-		uniformDataComposition.lights[4].color = glm::vec3(0.0f, 1.0f, 0.2f);
-		uniformDataComposition.lights[4].radius = 5.0f;
+		lights[4] = { glm::vec3(0.0f, -0.5f, 0.0f), 30.0f, glm::vec3(0.0f, 1.0f, 0.2f), 5.0f };
 		// Yellow
-		uniformDataComposition.lights[5].position = glm::vec4(0.0f, -1.0f, 0.0f, 0.0f);
-		uniformDataComposition.lights[5].color = glm::vec3(1.0f, 0.7f, 0.3f);
-		uniformDataComposition.lights[5].radius = 25.0f;
+		lights[5] = { glm::vec3(0.0f, -1.0f, 0.0f), 30.0f, glm::vec3(1.0f, 0.7f, 0.3f), 25.0f };
+
+		// Small colored lights moving on circles above the floor (negative y is up)
+		std::default_random_engine rndEngine(benchmark.active ? 0 : (unsigned)time(nullptr));
+		std::uniform_real_distribution<float> rndDist(0.0f, 1.0f);
+		lightAnimations.resize(MAX_LIGHT_COUNT);
+		for (uint32_t i = 6; i < MAX_LIGHT_COUNT; i++) {
+			lightAnimations[i].center = glm::vec3(-8.0f + rndDist(rndEngine) * 16.0f, -0.1f - rndDist(rndEngine) * 2.4f, -8.0f + rndDist(rndEngine) * 16.0f);
+			lightAnimations[i].radius = 0.25f + rndDist(rndEngine) * 1.0f;
+			lightAnimations[i].speed = (rndDist(rndEngine) < 0.5f ? -1.0f : 1.0f) * (0.5f + rndDist(rndEngine));
+			lightAnimations[i].phase = rndDist(rndEngine) * glm::two_pi<float>();
+			const glm::vec3 color = glm::vec3(rndDist(rndEngine), rndDist(rndEngine), rndDist(rndEngine));
+			lights[i].range = 0.3f + rndDist(rndEngine) * 0.5f;
+			lights[i].color = color / std::max(color.r, std::max(color.g, color.b));
+			lights[i].intensity = 0.5f;
+		}
+		updateLights();
+	}
 
-		// Animate the lights
+	// Animate the lights and pass them to the light culling
+	void updateLights()
+	{
 		if (!paused) {
-			uniformDataComposition.lights[0].position.x = sin(glm::radians(360.0f * timer)) * 5.0f;
-			uniformDataComposition.lights[0].position.z = cos(glm::radians(360.0f * timer)) * 5.0f;
+			lights[0].position.x = sin(glm::radians(360.0f * timer)) * 5.0f;
+			lights[0].position.z = cos(glm::radians(360.0f * timer)) * 5.0f;
 
-			uniformDataComposition.lights[1].position.x = -4.0f + sin(glm::radians(360.0f * timer) + 45.0f) * 2.0f;
-			uniformDataComposition.lights[1].position.z = 0.0f + cos(glm::radians(360.0f * timer) + 45.0f) * 2.0f;
+			lights[1].position.x = -4.0f + sin(glm::radians(360.0f * timer) + 45.0f) * 2.0f;
+			lights[1].position.z = 0.0f + cos(glm::radians(360.0f * timer) + 45.0f) * 2.0f;
 
-			uniformDataComposition.lights[2].position.x = 4.0f + sin(glm::radians(360.0f * timer)) * 2.0f;
-			uniformDataComposition.lights[2].position.z = 0.0f + cos(glm::radians(360.0f * timer)) * 2.0f;
+			lights[2].position.x = 4.0f + sin(glm::radians(360.0f * timer)) * 2.0f;
+			lights[2].position.z = 0.0f + cos(glm::radians(360.0f * timer)) * 2.0f;
 
-			uniformDataComposition.lights[4].position.x = 0.0f + sin(glm::radians(360.0f * timer + 90.0f)) * 5.0f;
-			uniformDataComposition.lights[4].position.z = 0.0f - cos(glm::radians(360.0f * timer + 45.0f)) * 5.0f;
+			lights[4].position.x = 0.0f + sin(glm::radians(360.0f * timer + 90.0f)) * 5.0f;
+			lights[4].position.z = 0.0f - cos(glm::radians(360.0f * timer + 45.0f)) * 5.0f;
 
-			uniformDataComposition.lights[5].position.x = 0.0f + sin(glm::radians(-360.0f * timer + 135.0f)) * 10.0f;
-			uniformDataComposition.lights[5].position.z = 0.0f - cos(glm::radians(-360.0f * timer - 45.0f)) * 10.0f;
-		}
-
-		// Current view position
-		uniformDataComposition.viewPos = glm::vec4(camera.position, 0.0f) * glm::vec4(-1.0f, 1.0f, -1.0f, 1.0f);
+			lights[5].position.x = 0.0f + sin(glm::radians(-360.0f * timer + 135.0f)) * 10.0f;
+			lights[5].position.z = 0.0f - cos(glm::radians(-360.0f * timer - 45.0f)) * 10.0f;
 
-		uniformDataComposition.debugDisplayTarget = debugDisplayTarget;
+			for (int32_t i = 6; i < lightCount; i++) {
+				const LightAnimation& animation = lightAnimations[i];
+				const float angle = glm::two_pi<float>() * timer * animation.speed + animation.phase;
+				lights[i].position = animation.center + glm::vec3(sin(angle), 0.0f, cos(angle)) * animation.radius;
+			}
+		}
 
-		memcpy(uniformBuffers.composition.mapped, &uniformDataComposition, sizeof(UniformDataComposition));
+		// Only the active lights are uploaded and culled
+		lightClusters.updateLights(lights.data(), lightCount);
+		lightClusters.updateView(camera.matrices.view, camera.matrices.perspective, camera.getNearClip(), camera.getFarClip());
 	}
 
 	void prepare()
 	{
 		VulkanExampleBase::prepare();
 		loadAssets();
-		prepareOffscreenFramebuffer();
+		gBufferLayout.create(physicalDevice, vks::GBufferLayout::Reference);
+		renderGraph.create(vulkanDevice);
+		prepareRenderGraph();
+		prepareSampler();
+		prepareTimestamps();
+		prepareLights();
 		prepareUniformBuffers();
 		setupDescriptors();
 		preparePipelines();
 		buildCommandBuffers();
-		buildDeferredCommandBuffer();
 		prepared = true;
 	}
 
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
-
-		// The scene render command buffer has to wait for the offscreen
-		// rendering to be finished before we can use the framebuffer
-		// color image for sampling during final rendering
-		// To ensure this we use a dedicated offscreen synchronization
-		// semaphore that will be signaled when offscreen rendering
-		// has been finished
-		// This is necessary as an implementation may start both
-		// command buffers at the same time, there is no guarantee
-		// that command buffers will be executed in the order they
-		// have been submitted by the application
-
-		// Offscreen rendering
-
-		// Wait for swap chain presentation to finish
-		submitInfo.pWaitSemaphores = &semaphores.presentComplete;
-		// Signal ready with offscreen semaphore
-		submitInfo.pSignalSemaphores = &offscreenSemaphore;
-
-		// Submit work
+		// The previous submission of this command buffer has finished, so its timestamps can be read without waiting
+		if (timestampsSupported) {
+			const float period = vulkanDevice->properties.limits.timestampPeriod / 1000000.0f;
+			passTimes.lightCulling = (timestamps.getResult(currentBuffer, 1) - timestamps.getResult(currentBuffer, 0)) * period;
+			passTimes.gBuffer = (timestamps.getResult(currentBuffer, 2) - timestamps.getResult(currentBuffer, 1)) * period;
+			passTimes.composition = (timestamps.getResult(currentBuffer, 3) - timestamps.getResult(currentBuffer, 2)) * period;
+			if (lightScaling.active) {
+				updateLightScaling();
+			}
+		}
+		lightClusters.updateStatistics();
 		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &offScreenCmdBuffer;
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
-
-		// Scene rendering
-
-		// Wait for offscreen semaphore
-		submitInfo.pWaitSemaphores = &offscreenSemaphore;
-		// Signal ready with render complete semaphore
-		submitInfo.pSignalSemaphores = &semaphores.renderComplete;
-
-		// Submit work
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
-
 		VulkanExampleBase::submitFrame();
 	}
 
@@ -790,13 +683,108 @@ public:
 			return;
 		updateUniformBufferComposition();
 		updateUniformBufferOffscreen();
+		updateLights();
 		draw();
 	}
 
+	void startLightScaling()
+	{
+		lightScaling.active = true;
+		lightScaling.step = 0;
+		lightScaling.frame = 0;
+		lightScaling.previousLightCount = lightCount;
+		lightScaling.results.clear();
+		for (auto count : lightScaling.lightCounts) {
+			lightScaling.results.push_back({ count, 0.0f, 0.0f });
+		}
+		lightCount = lightScaling.lightCounts[0];
+	}
+
+	// Accumulate the pass times of the current step and advance to the next light count once enough frames have been measured
+	void updateLightScaling()
+	{
+		lightScaling.frame++;
+		if (lightScaling.frame <= lightScaling.warmupFrames) {
+			return;
+		}
+		LightScalingResult& result = lightScaling.results[lightScaling.step];
+		result.lightCulling += passTimes.lightCulling / (float)lightScaling.measuredFrames;
+		result.composition += passTimes.composition / (float)lightScaling.measuredFrames;
+		if (lightScaling.frame < lightScaling.warmupFrames + lightScaling.measuredFrames) {
+			return;
+		}
+		lightScaling.frame = 0;
+		lightScaling.step++;
+		if (lightScaling.step < lightScaling.lightCounts.size()) {
+			lightCount = lightScaling.lightCounts[lightScaling.step];
+			return;
+		}
+		lightScaling.active = false;
+		lightCount = lightScaling.previousLightCount;
+		std::cout << "Light count scaling (average GPU times over " << lightScaling.measuredFrames << " frames):\n";
+		for (auto& result : lightScaling.results) {
+			std::cout << result.lightCount << " lights: culling " << result.lightCulling << " ms, composition " << result.composition << " ms\n";
+		}
+	}
+
+	// Switch the G-buffer layout, which changes the attachments and with that the render passes and pipelines
+	// The command buffers are rebuilt by the base class after the UI has been updated
+	void changeGBufferLayout(vks::GBufferLayout::Type type)
+	{
+		vkDeviceWaitIdle(device);
+		gBufferLayout.create(physicalDevice, type);
+		prepareRenderGraph();
+		updateImageDescriptors();
+		vkDestroyPipeline(device, pipelines.composition, nullptr);
+		vkDestroyPipeline(device, pipelines.offscreen, nullptr);
+		preparePipelines();
+	}
+
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
 		if (overlay->header("Settings")) {
-			overlay->comboBox("Display", &debugDisplayTarget, { "Final composition", "Position", "Normals", "Albedo", "Specular" });
+			overlay->comboBox("Display", &debugDisplayTarget, { "Final composition", "Position", "Normals", "Albedo", "Specular", "Lights per cluster" });
+			int32_t layoutType = gBufferLayout.type;
+			if (overlay->comboBox("G-Buffer layout", &layoutType, { vks::GBufferLayout::getName(vks::GBufferLayout::Reference), vks::GBufferLayout::getName(vks::GBufferLayout::Compact) })) {
+				changeGBufferLayout(static_cast<vks::GBufferLayout::Type>(layoutType));
+			}
+		}
+		if (overlay->header("G-Buffer")) {
+			const vks::GBufferLayout::Bandwidth bandwidth = gBufferLayout.estimateBandwidth({ 2048, 2048 }, 1, { width, height }, 1);
+			overlay->text("%u bytes per pixel", gBufferLayout.bytesPerPixel());
+			overlay->text("G-Buffer pass writes: %.1f MB", (float)bandwidth.gBufferWrite / (1024.0f * 1024.0f));
+			overlay->text("Composition reads: %.1f MB", (float)bandwidth.compositionRead / (1024.0f * 1024.0f));
+			if (timestampsSupported) {
+				overlay->text("G-Buffer pass: %.2f ms", passTimes.gBuffer);
+				overlay->text("Composition pass: %.2f ms", passTimes.composition);
+			}
+		}
+		if (overlay->header("Light clusters")) {
+			if (!lightScaling.active) {
+				overlay->sliderInt("Light count", &lightCount, 6, MAX_LIGHT_COUNT);
+			}
+			overlay->text("Clusters: %u x %u x %u", lightClusters.settings.gridSize[0], lightClusters.settings.gridSize[1], lightClusters.settings.gridSize[2]);
+			overlay->text("Light indices: %u", lightClusters.statistics.lightIndexCount);
+			overlay->text("Saturated clusters: %u", lightClusters.statistics.saturatedClusterCount);
+			if (timestampsSupported) {
+				overlay->text("Light culling: %.2f ms", passTimes.lightCulling);
+				if (lightScaling.active) {
+					overlay->text("Measuring %u lights...", lightScaling.lightCounts[lightScaling.step]);
+				} else if (overlay->button("Light count scaling")) {
+					startLightScaling();
+				}
+				for (uint32_t i = 0; i < lightScaling.results.size() && (!lightScaling.active || i < lightScaling.step); i++) {
+					const LightScalingResult& result = lightScaling.results[i];
+					overlay->text("%5u lights: culling %.2f ms, composition %.2f ms", result.lightCount, result.lightCulling, result.composition);
+				}
+			}
+		}
+		if (overlay->header("Render graph")) {
+			const vks::RenderGraph::Statistics& stats = renderGraph.statistics;
+			overlay->text("Passes: %d (%d culled)", stats.passCount, stats.culledPassCount);
+			overlay->text("Image barriers: %d in %d batches (%d elided)", stats.imageBarrierCount, stats.pipelineBarrierCount, stats.elidedBarrierCount);
+			overlay->text("Transient memory: %.1f MB", (float)stats.transientMemory / (1024.0f * 1024.0f));
+			overlay->text("Without aliasing: %.1f MB", (float)stats.transientMemoryUnaliased / (1024.0f * 1024.0f));
 		}
 	}
 };
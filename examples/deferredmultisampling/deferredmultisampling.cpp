@@ -2,6 +2,7 @@
 * Vulkan Example - Multi sampling with explicit resolve for deferred shading example
 *
 * This sample adds hardware accelerated multi sampling to the deferred rendering sample
+* The G-buffer can be switched to a compact layout that reconstructs positions from depth (see base/VulkanGBufferLayout.h)
 * 
 * Copyright (C) 2023 by Sascha Willems - www.saschawillems.de
 *
@@ -11,6 +12,8 @@
 #include "vulkanexamplebase.h"
 #include "VulkanFrameBuffer.hpp"
 #include "VulkanglTFModel.h"
+#include "VulkanGBufferLayout.h"
+#include "VulkanQueryManager.h"
 
 class VulkanExample : public VulkanExampleBase
 {
@@ -52,6 +55,8 @@ public:
 	struct UniformDataComposition {
 		Light lights[6];
 		glm::vec4 viewPos;
+		// Used to reconstruct positions from depth with the compact G-buffer layout
+		glm::mat4 inverseViewProjection;
 		int32_t debugDisplayTarget = 0;
 	} uniformDataComposition;
 
@@ -76,16 +81,22 @@ public:
 
 	VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
 
+	vks::GBufferLayout gBufferLayout;
 	vks::Framebuffer* offscreenframeBuffers{};
 
-	VkCommandBuffer offScreenCmdBuffer{ VK_NULL_HANDLE };
-
-	// Semaphore used to synchronize between offscreen and final scene rendering
-	VkSemaphore offscreenSemaphore{ VK_NULL_HANDLE };
+	// GPU times of the passes are measured with timestamps written before, between and after them
+	vks::QueryManager timestamps;
+	bool timestampsSupported{ false };
+	struct {
+		float gBuffer{ 0.0f };
+		float composition{ 0.0f };
+	} passTimes;
 
 	VulkanExample() : VulkanExampleBase()
 	{
 		title = "Multi sampled deferred shading";
+		// The compact G-buffer encoding only has GLSL shaders
+		requireGlslShaders();
 		camera.type = Camera::CameraType::firstperson;
 		camera.movementSpeed = 5.0f;
 #ifndef __ANDROID__
@@ -122,7 +133,9 @@ public:
 			textures.background.colorMap.destroy();
 			textures.background.normalMap.destroy();
 
-			vkDestroySemaphore(device, offscreenSemaphore, nullptr);
+			if (timestampsSupported) {
+				timestamps.destroy();
+			}
 		}
 	}
 
@@ -153,7 +166,7 @@ public:
 		offscreenframeBuffers->height = 2048;
 #endif
 
-		// Four attachments (3 color, 1 depth)
+		// Color attachments of the G-buffer layout and one depth attachment
 		vks::AttachmentCreateInfo attachmentInfo = {};
 		attachmentInfo.width = offscreenframeBuffers->width;
 		attachmentInfo.height = offscreenframeBuffers->height;
@@ -162,26 +175,17 @@ public:
 		attachmentInfo.imageSampleCount = sampleCount;
 
 		// Color attachments
-		// Attachment 0: (World space) Positions
-		attachmentInfo.format = VK_FORMAT_R16G16B16A16_SFLOAT;
-		offscreenframeBuffers->addAttachment(attachmentInfo);
-
-		// Attachment 1: (World space) Normals
-		attachmentInfo.format = VK_FORMAT_R16G16B16A16_SFLOAT;
-		offscreenframeBuffers->addAttachment(attachmentInfo);
-
-		// Attachment 2: Albedo (color)
-		attachmentInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
-		offscreenframeBuffers->addAttachment(attachmentInfo);
+		// Reference layout: (World space) positions, (world space) normals and albedo (color)
+		// Compact layout: Octahedral encoded normals and albedo (color)
+		for (auto& target : gBufferLayout.colorTargets) {
+			attachmentInfo.format = target.format;
+			offscreenframeBuffers->addAttachment(attachmentInfo);
+		}
 
 		// Depth attachment
-		// Find a suitable depth format
-		VkFormat attDepthFormat;
-		VkBool32 validDepthFormat = vks::tools::getSupportedDepthFormat(physicalDevice, &attDepthFormat);
-		assert(validDepthFormat);
-
-		attachmentInfo.format = attDepthFormat;
-		attachmentInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		// The compact layout reconstructs positions from depth, so it's stored and sampled by the composition pass
+		attachmentInfo.format = gBufferLayout.depthFormat;
+		attachmentInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | (gBufferLayout.sampledDepth() ? VK_IMAGE_USAGE_SAMPLED_BIT : 0);
 		offscreenframeBuffers->addAttachment(attachmentInfo);
 
 		// Create sampler to sample from the color attachments
@@ -191,26 +195,15 @@ public:
 		VK_CHECK_RESULT(offscreenframeBuffers->createRenderPass());
 	}
 
-	// Build command buffer for rendering the scene to the offscreen frame buffer attachments
-	void buildDeferredCommandBuffer()
+	// Record the rendering of the scene to the offscreen frame buffer attachments
+	void buildDeferredCommands(VkCommandBuffer commandBuffer)
 	{
-		if (offScreenCmdBuffer == VK_NULL_HANDLE) {
-			offScreenCmdBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, false);
-		}
-
-		// Create a semaphore used to synchronize offscreen rendering and usage
-		if (offscreenSemaphore == VK_NULL_HANDLE) {
-			VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
-			VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &offscreenSemaphore));
-		}
-
-		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
-
 		// Clear values for all attachments written in the fragment shader
-		std::array<VkClearValue,4> clearValues;
-		clearValues[0].color = clearValues[1].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-		clearValues[2].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-		clearValues[3].depthStencil = { 1.0f, 0 };
+		std::vector<VkClearValue> clearValues(offscreenframeBuffers->attachments.size());
+		for (size_t i = 0; i < gBufferLayout.colorTargets.size(); i++) {
+			clearValues[i].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+		}
+		clearValues.back().depthStencil = { 1.0f, 0 };
 
 		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
 		renderPassBeginInfo.renderPass = offscreenframeBuffers->renderPass;
@@ -220,30 +213,32 @@ public:
 		renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
 		renderPassBeginInfo.pClearValues = clearValues.data();
 
-		VK_CHECK_RESULT(vkBeginCommandBuffer(offScreenCmdBuffer, &cmdBufInfo));
-
-		vkCmdBeginRenderPass(offScreenCmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 		VkViewport viewport = vks::initializers::viewport((float)offscreenframeBuffers->width, (float)offscreenframeBuffers->height, 0.0f, 1.0f);
-		vkCmdSetViewport(offScreenCmdBuffer, 0, 1, &viewport);
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
 		VkRect2D scissor = vks::initializers::rect2D(offscreenframeBuffers->width, offscreenframeBuffers->height, 0, 0);
-		vkCmdSetScissor(offScreenCmdBuffer, 0, 1, &scissor);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-		vkCmdBindPipeline(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, useSampleShading ? pipelines.offscreenSampleShading : pipelines.offscreen);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, useSampleShading ? pipelines.offscreenSampleShading : pipelines.offscreen);
 
 		// Background
-		vkCmdBindDescriptorSets(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.background, 0, nullptr);
-		models.background.draw(offScreenCmdBuffer);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.background, 0, nullptr);
+		models.background.draw(commandBuffer);
 
 		// Object
-		vkCmdBindDescriptorSets(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.model, 0, nullptr);
-		models.model.bindBuffers(offScreenCmdBuffer);
-		vkCmdDrawIndexed(offScreenCmdBuffer, models.model.indices.count, 3, 0, 0, 0);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.model, 0, nullptr);
+		models.model.bindBuffers(commandBuffer);
+		vkCmdDrawIndexed(commandBuffer, models.model.indices.count, 3, 0, 0, 0);
 
-		vkCmdEndRenderPass(offScreenCmdBuffer);
+		vkCmdEndRenderPass(commandBuffer);
 
-		VK_CHECK_RESULT(vkEndCommandBuffer(offScreenCmdBuffer));
+		// The render pass leaves the attachments in their read only layouts, the composition has to wait for the attachment writes
+		VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
 	}
 
 	void buildCommandBuffers()
@@ -270,6 +265,18 @@ public:
 
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
+			if (timestampsSupported) {
+				timestamps.cmdBeginFrame(drawCmdBuffers[i], i);
+				timestamps.cmdWriteTimestamp(drawCmdBuffers[i], i, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+			}
+
+			// Both passes are recorded into the same command buffer
+			buildDeferredCommands(drawCmdBuffers[i]);
+
+			if (timestampsSupported) {
+				timestamps.cmdWriteTimestamp(drawCmdBuffers[i], i, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+			}
+
 			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
@@ -285,10 +292,18 @@ public:
 			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, useMSAA ? pipelines.deferred : pipelines.deferredNoMSAA);
 			vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
 
+			if (timestampsSupported) {
+				timestamps.cmdWriteTimestamp(drawCmdBuffers[i], i, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+			}
+
 			drawUI(drawCmdBuffers[i]);
 
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
+			if (timestampsSupported) {
+				timestamps.cmdResolve(drawCmdBuffers[i], i);
+			}
+
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 		}
 	}
@@ -319,7 +334,7 @@ public:
 		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
 			// Binding 0 : Vertex shader uniform buffer
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0),
-			// Binding 1 : Position texture target / Scene colormap
+			// Binding 1 : Position (or depth) texture target / Scene colormap
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),
 			// Binding 2 : Normals texture target
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 2),
@@ -335,38 +350,14 @@ public:
 		std::vector<VkWriteDescriptorSet> writeDescriptorSets;
 		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
 
-		// Image descriptors for the offscreen color attachments
-		VkDescriptorImageInfo texDescriptorPosition =
-			vks::initializers::descriptorImageInfo(
-				offscreenframeBuffers->sampler,
-				offscreenframeBuffers->attachments[0].view,
-				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-		VkDescriptorImageInfo texDescriptorNormal =
-			vks::initializers::descriptorImageInfo(
-				offscreenframeBuffers->sampler,
-				offscreenframeBuffers->attachments[1].view,
-				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-		VkDescriptorImageInfo texDescriptorAlbedo =
-			vks::initializers::descriptorImageInfo(
-				offscreenframeBuffers->sampler,
-				offscreenframeBuffers->attachments[2].view,
-				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
 		// Deferred composition
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets.composition));
 		writeDescriptorSets = {
-			// Binding 1: World space position texture
-			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &texDescriptorPosition),
-			// Binding 2: World space normals texture
-			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &texDescriptorNormal),
-			// Binding 3: Albedo texture
-			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &texDescriptorAlbedo),
 			// Binding 4: Fragment shader uniform buffer
 			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4, &uniformBuffers.composition.descriptor),
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+		updateImageDescriptors();
 
 		// Offscreen (scene)
 
@@ -395,11 +386,35 @@ public:
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 	}
 
+	// Point the composition descriptors to the offscreen attachments, which change with the G-buffer layout
+	void updateImageDescriptors()
+	{
+		// Compact layout: depth, encoded normals and albedo, reference layout: positions, normals and albedo
+		std::vector<VkDescriptorImageInfo> imageDescriptors;
+		if (gBufferLayout.sampledDepth()) {
+			imageDescriptors.push_back(vks::initializers::descriptorImageInfo(offscreenframeBuffers->sampler, offscreenframeBuffers->attachments.back().view, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL));
+		}
+		for (size_t i = 0; i < gBufferLayout.colorTargets.size(); i++) {
+			imageDescriptors.push_back(vks::initializers::descriptorImageInfo(offscreenframeBuffers->sampler, offscreenframeBuffers->attachments[i].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+		}
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			// Binding 1: World space position (or depth) texture
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[0]),
+			// Binding 2: World space normals texture
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &imageDescriptors[1]),
+			// Binding 3: Albedo texture
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &imageDescriptors[2]),
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	}
+
 	void preparePipelines()
 	{
-		// Layout
-		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
-		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout));
+		// Layout (shared by the pipelines of both G-buffer layouts)
+		if (pipelineLayout == VK_NULL_HANDLE) {
+			VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout));
+		}
 
 		// Pipelines
 		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
@@ -430,19 +445,20 @@ public:
 		VkPipelineVertexInputStateCreateInfo emptyInputState = vks::initializers::pipelineVertexInputStateCreateInfo();
 		pipelineCI.pVertexInputState = &emptyInputState;
 
-		// Use specialization constants to pass number of samples to the shader (used for MSAA resolve)
-		VkSpecializationMapEntry specializationEntry{};
-		specializationEntry.constantID = 0;
-		specializationEntry.offset = 0;
-		specializationEntry.size = sizeof(uint32_t);
-
-		uint32_t specializationData = sampleCount;
+		// Use specialization constants to pass number of samples to the shader (used for MSAA resolve) and to select the G-buffer layout
+		struct SpecializationData {
+			uint32_t sampleCount;
+			int32_t gBufferLayout;
+		} specializationData;
+		specializationData.sampleCount = sampleCount;
+		specializationData.gBufferLayout = gBufferLayout.type;
+
+		std::array<VkSpecializationMapEntry, 2> specializationEntries = {
+			vks::initializers::specializationMapEntry(0, offsetof(SpecializationData, sampleCount), sizeof(uint32_t)),
+			vks::initializers::specializationMapEntry(vks::GBufferLayout::specializationConstantId, offsetof(SpecializationData, gBufferLayout), sizeof(int32_t))
+		};
 
-		VkSpecializationInfo specializationInfo;
-		specializationInfo.mapEntryCount = 1;
-		specializationInfo.pMapEntries = &specializationEntry;
-		specializationInfo.dataSize = sizeof(specializationData);
-		specializationInfo.pData = &specializationData;
+		VkSpecializationInfo specializationInfo = vks::initializers::specializationInfo(static_cast<uint32_t>(specializationEntries.size()), specializationEntries.data(), sizeof(specializationData), &specializationData);
 
 		rasterizationState.cullMode = VK_CULL_MODE_FRONT_BIT;
 
@@ -453,7 +469,7 @@ public:
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.deferred));
 
 		// No MSAA (1 sample)
-		specializationData = 1;
+		specializationData.sampleCount = 1;
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.deferredNoMSAA));
 
 		// Vertex input state from glTF model for pipeline rendering models
@@ -466,6 +482,8 @@ public:
 
 		shaderStages[0] = loadShader(getShadersPath() + "deferredmultisampling/mrt.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
 		shaderStages[1] = loadShader(getShadersPath() + "deferredmultisampling/mrt.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+		// The G-buffer shader only uses the layout constant, so the sample count entry is ignored
+		shaderStages[1].pSpecializationInfo = &specializationInfo;
 
 		//rasterizationState.polygonMode = VK_POLYGON_MODE_LINE;
 		//rasterizationState.lineWidth = 2.0f;
@@ -475,11 +493,7 @@ public:
 		// Blend attachment states required for all color attachments
 		// This is important, as color write mask will otherwise be 0x0 and you
 		// won't see anything rendered to the attachment
-		std::array<VkPipelineColorBlendAttachmentState, 3> blendAttachmentStates = {
-			vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE),
-			vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE),
-			vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE)
-		};
+		std::vector<VkPipelineColorBlendAttachmentState> blendAttachmentStates(gBufferLayout.colorTargets.size(), vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE));
 
 		colorBlendState.attachmentCount = static_cast<uint32_t>(blendAttachmentStates.size());
 		colorBlendState.pAttachments = blendAttachmentStates.data();
@@ -549,6 +563,7 @@ public:
 
 		// Current view position
 		uniformDataComposition.viewPos = glm::vec4(camera.position, 0.0f) * glm::vec4(-1.0f, 1.0f, -1.0f, 1.0f);
+		uniformDataComposition.inverseViewProjection = glm::inverse(camera.matrices.perspective * camera.matrices.view);
 		uniformDataComposition.debugDisplayTarget = debugDisplayTarget;
 
 		memcpy(uniformBuffers.composition.mapped, &uniformDataComposition, sizeof(UniformDataComposition));
@@ -559,42 +574,28 @@ public:
 		VulkanExampleBase::prepare();
 		sampleCount = getMaxUsableSampleCount();
 		loadAssets();
+		gBufferLayout.create(physicalDevice, vks::GBufferLayout::Reference);
 		deferredSetup();
+		prepareTimestamps();
 		prepareUniformBuffers();
 		setupDescriptors();
 		preparePipelines();
 		buildCommandBuffers();
-		buildDeferredCommandBuffer();
 		prepared = true;
 	}
 	
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
-
-		// Offscreen rendering
-
-		// Wait for swap chain presentation to finish
-		submitInfo.pWaitSemaphores = &semaphores.presentComplete;
-		// Signal ready with offscreen semaphore
-		submitInfo.pSignalSemaphores = &offscreenSemaphore;
-
-		// Submit work
+		// The previous submission of this command buffer has finished, so its timestamps can be read without waiting
+		if (timestampsSupported) {
+			const float period = vulkanDevice->properties.limits.timestampPeriod / 1000000.0f;
+			passTimes.gBuffer = (timestamps.getResult(currentBuffer, 1) - timestamps.getResult(currentBuffer, 0)) * period;
+			passTimes.composition = (timestamps.getResult(currentBuffer, 2) - timestamps.getResult(currentBuffer, 1)) * period;
+		}
 		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &offScreenCmdBuffer;
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
-
-		// Scene rendering
-
-		// Wait for offscreen semaphore
-		submitInfo.pWaitSemaphores = &offscreenSemaphore;
-		// Signal ready with render complete semaphore
-		submitInfo.pSignalSemaphores = &semaphores.renderComplete;
-
-		// Submit work
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
-
 		VulkanExampleBase::submitFrame();
 	}
 
@@ -603,9 +604,35 @@ public:
 		if (!prepared)
 			return;
 		updateUniformBufferOffscreen();
+		// Positions are reconstructed with the current camera matrices
+		updateUniformBufferDeferred();
 		draw();
 	}
 
+	void prepareTimestamps()
+	{
+		timestampsSupported = (vulkanDevice->properties.limits.timestampComputeAndGraphics == VK_TRUE) && (vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].timestampValidBits > 0);
+		if (timestampsSupported) {
+			timestamps.create(vulkanDevice, queue, VK_QUERY_TYPE_TIMESTAMP, static_cast<uint32_t>(drawCmdBuffers.size()), 3);
+		}
+	}
+
+	// Switch the G-buffer layout, which changes the offscreen attachments and with that the render pass and pipelines
+	// The command buffers are rebuilt by the base class after the UI has been updated
+	void changeGBufferLayout(vks::GBufferLayout::Type type)
+	{
+		vkDeviceWaitIdle(device);
+		gBufferLayout.create(physicalDevice, type);
+		delete offscreenframeBuffers;
+		deferredSetup();
+		updateImageDescriptors();
+		vkDestroyPipeline(device, pipelines.deferred, nullptr);
+		vkDestroyPipeline(device, pipelines.deferredNoMSAA, nullptr);
+		vkDestroyPipeline(device, pipelines.offscreen, nullptr);
+		vkDestroyPipeline(device, pipelines.offscreenSampleShading, nullptr);
+		preparePipelines();
+	}
+
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
 		if (overlay->header("Settings")) {
@@ -617,16 +644,32 @@ public:
 			}
 			if (vulkanDevice->features.sampleRateShading) {
 				if (overlay->checkBox("Sample rate shading", &useSampleShading)) {
-					buildDeferredCommandBuffer();
+					buildCommandBuffers();
 				}
 			}
+			int32_t layoutType = gBufferLayout.type;
+			if (overlay->comboBox("G-Buffer layout", &layoutType, { vks::GBufferLayout::getName(vks::GBufferLayout::Reference), vks::GBufferLayout::getName(vks::GBufferLayout::Compact) })) {
+				changeGBufferLayout(static_cast<vks::GBufferLayout::Type>(layoutType));
+			}
+		}
+		if (overlay->header("G-Buffer")) {
+			// The explicit resolve reads every sample, without MSAA only the first one is read
+			const vks::GBufferLayout::Bandwidth bandwidth = gBufferLayout.estimateBandwidth({ offscreenframeBuffers->width, offscreenframeBuffers->height }, sampleCount, { width, height }, useMSAA ? sampleCount : 1);
+			overlay->text("%u bytes per pixel and sample", gBufferLayout.bytesPerPixel());
+			overlay->text("G-Buffer pass writes: %.1f MB", (float)bandwidth.gBufferWrite / (1024.0f * 1024.0f));
+			overlay->text("Composition reads: %.1f MB", (float)bandwidth.compositionRead / (1024.0f * 1024.0f));
+			if (timestampsSupported) {
+				overlay->text("G-Buffer pass: %.2f ms", passTimes.gBuffer);
+				overlay->text("Composition pass: %.2f ms", passTimes.composition);
+			}
 		}
 	}
 
 	// Returns the maximum sample count usable by the platform
 	VkSampleCountFlagBits getMaxUsableSampleCount()
 	{
-		VkSampleCountFlags counts = std::min(deviceProperties.limits.framebufferColorSampleCounts, deviceProperties.limits.framebufferDepthSampleCounts);
+		// The attachments are also sampled, with the compact G-buffer layout that includes depth
+		VkSampleCountFlags counts = deviceProperties.limits.framebufferColorSampleCounts & deviceProperties.limits.framebufferDepthSampleCounts & deviceProperties.limits.sampledImageColorSampleCounts & deviceProperties.limits.sampledImageDepthSampleCounts;
 		// Note: Vulkan offers up to 64 bits, but we don't want to go higher than 8xMSAA in this sample)
 		if (counts & VK_SAMPLE_COUNT_8_BIT) { return VK_SAMPLE_COUNT_8_BIT; }
 		if (counts & VK_SAMPLE_COUNT_4_BIT) { return VK_SAMPLE_COUNT_4_BIT; }
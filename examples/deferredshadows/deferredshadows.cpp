@@ -2,6 +2,7 @@
 * Vulkan Example - Deferred shading with shadows from multiple light sources using geometry shader instancing
 *
 * This sample adds dynamic shadows (using shadow maps) to a deferred rendering setup
+* The G-buffer can be switched to a compact layout that reconstructs positions from depth (see base/VulkanGBufferLayout.h)
 * 
 * Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
 *
@@ -11,6 +12,8 @@
 #include "vulkanexamplebase.h"
 #include "VulkanFrameBuffer.hpp"
 #include "VulkanglTFModel.h"
+#include "VulkanGBufferLayout.h"
+#include "VulkanQueryManager.h"
 
 // Must match the LIGHT_COUNT define in the shadow and deferred shaders
 #define LIGHT_COUNT 3
@@ -73,6 +76,8 @@ public:
 	struct UniformDataComposition {
 		glm::vec4 viewPos;
 		Light lights[LIGHT_COUNT];
+		// Used to reconstruct positions from depth with the compact G-buffer layout
+		glm::mat4 inverseViewProjection;
 		uint32_t useShadows = 1;
 		int32_t debugDisplayTarget = 0;
 	} uniformDataComposition;
@@ -99,6 +104,8 @@ public:
 
 	VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
 
+	vks::GBufferLayout gBufferLayout;
+
 	struct {
 		// Framebuffer resources for the deferred pass
 		vks::Framebuffer *deferred;
@@ -106,14 +113,20 @@ public:
 		vks::Framebuffer *shadow;
 	} frameBuffers{};
 
-	VkCommandBuffer offScreenCmdBuffer{ VK_NULL_HANDLE };
-
-	// Semaphore used to synchronize between offscreen and final scene rendering
-	VkSemaphore offscreenSemaphore{ VK_NULL_HANDLE };
+	// GPU times of the passes are measured with timestamps written before, between and after them
+	vks::QueryManager timestamps;
+	bool timestampsSupported{ false };
+	struct {
+		float shadow{ 0.0f };
+		float gBuffer{ 0.0f };
+		float composition{ 0.0f };
+	} passTimes;
 
 	VulkanExample() : VulkanExampleBase()
 	{
 		title = "Deferred shading with shadows";
+		// The compact G-buffer and the layered shadow pass only have GLSL shaders
+		requireGlslShaders();
 		camera.type = Camera::CameraType::firstperson;
 #if defined(__ANDROID__)
 		camera.movementSpeed = 2.5f;
@@ -158,7 +171,9 @@ public:
 		textures.background.colorMap.destroy();
 		textures.background.normalMap.destroy();
 
-		vkDestroySemaphore(device, offscreenSemaphore, nullptr);
+		if (timestampsSupported) {
+			timestamps.destroy();
+		}
 	}
 
 	// Enable physical device features required for this example
@@ -243,7 +258,7 @@ public:
 		frameBuffers.deferred->height = 2048;
 #endif
 
-		// Four attachments (3 color, 1 depth)
+		// Color attachments of the G-buffer layout and one depth attachment
 		vks::AttachmentCreateInfo attachmentInfo = {};
 		attachmentInfo.width = frameBuffers.deferred->width;
 		attachmentInfo.height = frameBuffers.deferred->height;
@@ -251,26 +266,17 @@ public:
 		attachmentInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 
 		// Color attachments
-		// Attachment 0: (World space) Positions
-		attachmentInfo.format = VK_FORMAT_R16G16B16A16_SFLOAT;
-		frameBuffers.deferred->addAttachment(attachmentInfo);
-
-		// Attachment 1: (World space) Normals
-		attachmentInfo.format = VK_FORMAT_R16G16B16A16_SFLOAT;
-		frameBuffers.deferred->addAttachment(attachmentInfo);
-
-		// Attachment 2: Albedo (color)
-		attachmentInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
-		frameBuffers.deferred->addAttachment(attachmentInfo);
+		// Reference layout: (World space) positions, (world space) normals and albedo (color)
+		// Compact layout: Octahedral encoded normals and albedo (color)
+		for (auto& target : gBufferLayout.colorTargets) {
+			attachmentInfo.format = target.format;
+			frameBuffers.deferred->addAttachment(attachmentInfo);
+		}
 
 		// Depth attachment
-		// Find a suitable depth format
-		VkFormat attDepthFormat;
-		VkBool32 validDepthFormat = vks::tools::getSupportedDepthFormat(physicalDevice, &attDepthFormat);
-		assert(validDepthFormat);
-
-		attachmentInfo.format = attDepthFormat;
-		attachmentInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		// The compact layout reconstructs positions from depth, so it's stored and sampled by the composition pass
+		attachmentInfo.format = gBufferLayout.depthFormat;
+		attachmentInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | (gBufferLayout.sampledDepth() ? VK_IMAGE_USAGE_SAMPLED_BIT : 0);
 		frameBuffers.deferred->addAttachment(attachmentInfo);
 
 		// Create sampler to sample from the color attachments
@@ -293,21 +299,11 @@ public:
 		vkCmdDrawIndexed(cmdBuffer, models.model.indices.count, 3, 0, 0, 0);
 	}
 
-	// Build a secondary command buffer for rendering the scene values to the offscreen frame buffer attachments
-	void buildDeferredCommandBuffer()
+	// Record the shadow map and G-buffer passes, the timestamp between them is written to the given frame's queries
+	void buildDeferredCommands(VkCommandBuffer commandBuffer, uint32_t frame)
 	{
-		if (offScreenCmdBuffer == VK_NULL_HANDLE) {
-			offScreenCmdBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, false);
-		}
-
-		// Create a semaphore used to synchronize offscreen rendering and usage
-		VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
-		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &offscreenSemaphore));
-
-		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
-
 		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-		std::array<VkClearValue, 4> clearValues = {};
+		std::vector<VkClearValue> clearValues(frameBuffers.deferred->attachments.size());
 		VkViewport viewport;
 		VkRect2D scissor;
 
@@ -323,34 +319,36 @@ public:
 		renderPassBeginInfo.clearValueCount = 1;
 		renderPassBeginInfo.pClearValues = clearValues.data();
 
-		VK_CHECK_RESULT(vkBeginCommandBuffer(offScreenCmdBuffer, &cmdBufInfo));
-
 		viewport = vks::initializers::viewport((float)frameBuffers.shadow->width, (float)frameBuffers.shadow->height, 0.0f, 1.0f);
-		vkCmdSetViewport(offScreenCmdBuffer, 0, 1, &viewport);
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
 		scissor = vks::initializers::rect2D(frameBuffers.shadow->width, frameBuffers.shadow->height, 0, 0);
-		vkCmdSetScissor(offScreenCmdBuffer, 0, 1, &scissor);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
 		// Set depth bias (aka "Polygon offset")
 		vkCmdSetDepthBias(
-			offScreenCmdBuffer,
+			commandBuffer,
 			depthBiasConstant,
 			0.0f,
 			depthBiasSlope);
 
-		vkCmdBeginRenderPass(offScreenCmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-		vkCmdBindPipeline(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.shadowpass);
-		renderScene(offScreenCmdBuffer, true);
-		vkCmdEndRenderPass(offScreenCmdBuffer);
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.shadowpass);
+		renderScene(commandBuffer, true);
+		vkCmdEndRenderPass(commandBuffer);
+
+		if (timestampsSupported) {
+			timestamps.cmdWriteTimestamp(commandBuffer, frame, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+		}
 
 		// Second pass: Deferred calculations
 		// -------------------------------------------------------------------------------------------------------
 
 		// Clear values for all attachments written in the fragment shader
-		clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-		clearValues[1].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-		clearValues[2].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-		clearValues[3].depthStencil = { 1.0f, 0 };
+		for (size_t i = 0; i < gBufferLayout.colorTargets.size(); i++) {
+			clearValues[i].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+		}
+		clearValues.back().depthStencil = { 1.0f, 0 };
 
 		renderPassBeginInfo.renderPass = frameBuffers.deferred->renderPass;
 		renderPassBeginInfo.framebuffer = frameBuffers.deferred->framebuffer;
@@ -359,19 +357,23 @@ public:
 		renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
 		renderPassBeginInfo.pClearValues = clearValues.data();
 
-		vkCmdBeginRenderPass(offScreenCmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 		viewport = vks::initializers::viewport((float)frameBuffers.deferred->width, (float)frameBuffers.deferred->height, 0.0f, 1.0f);
-		vkCmdSetViewport(offScreenCmdBuffer, 0, 1, &viewport);
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
 		scissor = vks::initializers::rect2D(frameBuffers.deferred->width, frameBuffers.deferred->height, 0, 0);
-		vkCmdSetScissor(offScreenCmdBuffer, 0, 1, &scissor);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-		vkCmdBindPipeline(offScreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.offscreen);
-		renderScene(offScreenCmdBuffer, false);
-		vkCmdEndRenderPass(offScreenCmdBuffer);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.offscreen);
+		renderScene(commandBuffer, false);
+		vkCmdEndRenderPass(commandBuffer);
 
-		VK_CHECK_RESULT(vkEndCommandBuffer(offScreenCmdBuffer));
+		// The render passes leave the shadow map and G-buffer in their read only layouts, the composition has to wait for the attachment writes
+		VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
 	}
 
 	void loadAssets()
@@ -409,6 +411,18 @@ public:
 
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
+			if (timestampsSupported) {
+				timestamps.cmdBeginFrame(drawCmdBuffers[i], i);
+				timestamps.cmdWriteTimestamp(drawCmdBuffers[i], i, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+			}
+
+			// All passes are recorded into the same command buffer
+			buildDeferredCommands(drawCmdBuffers[i], i);
+
+			if (timestampsSupported) {
+				timestamps.cmdWriteTimestamp(drawCmdBuffers[i], i, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+			}
+
 			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
@@ -424,10 +438,18 @@ public:
 			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.deferred);
 			vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
 
+			if (timestampsSupported) {
+				timestamps.cmdWriteTimestamp(drawCmdBuffers[i], i, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+			}
+
 			drawUI(drawCmdBuffers[i]);
 
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
+			if (timestampsSupported) {
+				timestamps.cmdResolve(drawCmdBuffers[i], i);
+			}
+
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 		}
 	}
@@ -446,7 +468,7 @@ public:
 		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
 			// Binding 0: Vertex shader uniform buffer
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_GEOMETRY_BIT, 0),
-			// Binding 1: Position texture
+			// Binding 1: Position (or depth) texture
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),
 			// Binding 2: Normals texture
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 2),
@@ -464,25 +486,6 @@ public:
 		std::vector<VkWriteDescriptorSet> writeDescriptorSets;
 		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
 
-		// Image descriptors for the offscreen color attachments
-		VkDescriptorImageInfo texDescriptorPosition =
-			vks::initializers::descriptorImageInfo(
-				frameBuffers.deferred->sampler,
-				frameBuffers.deferred->attachments[0].view,
-				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-		VkDescriptorImageInfo texDescriptorNormal =
-			vks::initializers::descriptorImageInfo(
-				frameBuffers.deferred->sampler,
-				frameBuffers.deferred->attachments[1].view,
-				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-		VkDescriptorImageInfo texDescriptorAlbedo =
-			vks::initializers::descriptorImageInfo(
-				frameBuffers.deferred->sampler,
-				frameBuffers.deferred->attachments[2].view,
-				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
 		VkDescriptorImageInfo texDescriptorShadowMap =
 			vks::initializers::descriptorImageInfo(
 				frameBuffers.shadow->sampler,
@@ -492,18 +495,13 @@ public:
 		// Deferred composition
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets.composition));
 		writeDescriptorSets = {
-			// Binding 1: World space position texture
-			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &texDescriptorPosition),
-			// Binding 2: World space normals texture
-			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &texDescriptorNormal),
-			// Binding 3: Albedo texture
-			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &texDescriptorAlbedo),
 			// Binding 4: Fragment shader uniform buffer
 			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4, &uniformBuffers.composition.descriptor),
 			// Binding 5: Shadow map
 			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 5, &texDescriptorShadowMap),
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+		updateImageDescriptors();
 
 		// Offscreen (scene)
 
@@ -540,11 +538,35 @@ public:
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 	}
 
+	// Point the composition descriptors to the offscreen attachments, which change with the G-buffer layout
+	void updateImageDescriptors()
+	{
+		// Compact layout: depth, encoded normals and albedo, reference layout: positions, normals and albedo
+		std::vector<VkDescriptorImageInfo> imageDescriptors;
+		if (gBufferLayout.sampledDepth()) {
+			imageDescriptors.push_back(vks::initializers::descriptorImageInfo(frameBuffers.deferred->sampler, frameBuffers.deferred->attachments.back().view, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL));
+		}
+		for (size_t i = 0; i < gBufferLayout.colorTargets.size(); i++) {
+			imageDescriptors.push_back(vks::initializers::descriptorImageInfo(frameBuffers.deferred->sampler, frameBuffers.deferred->attachments[i].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+		}
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			// Binding 1: World space position (or depth) texture
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[0]),
+			// Binding 2: World space normals texture
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &imageDescriptors[1]),
+			// Binding 3: Albedo texture
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &imageDescriptors[2]),
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	}
+
 	void preparePipelines()
 	{
-		// Layout
-		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
-		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout));
+		// Layout (shared by the pipelines of both G-buffer layouts)
+		if (pipelineLayout == VK_NULL_HANDLE) {
+			VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout));
+		}
 
 		// Pipelines
 		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
@@ -569,10 +591,16 @@ public:
 		pipelineCI.stageCount = static_cast<uint32_t>(shaderStages.size());
 		pipelineCI.pStages = shaderStages.data();
 
+		// The G-buffer layout is selected with a specialization constant in both passes
+		VkSpecializationMapEntry specializationEntry = vks::initializers::specializationMapEntry(vks::GBufferLayout::specializationConstantId, 0, sizeof(int32_t));
+		int32_t specializationData = gBufferLayout.type;
+		VkSpecializationInfo specializationInfo = vks::initializers::specializationInfo(1, &specializationEntry, sizeof(specializationData), &specializationData);
+
 		// Final fullscreen composition pass pipeline
 		rasterizationState.cullMode = VK_CULL_MODE_FRONT_BIT;
 		shaderStages[0] = loadShader(getShadersPath() + "deferredshadows/deferred.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
 		shaderStages[1] = loadShader(getShadersPath() + "deferredshadows/deferred.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+		shaderStages[1].pSpecializationInfo = &specializationInfo;
 		// Empty vertex input state, vertices are generated by the vertex shader
 		VkPipelineVertexInputStateCreateInfo emptyInputState = vks::initializers::pipelineVertexInputStateCreateInfo();
 		pipelineCI.pVertexInputState = &emptyInputState;
@@ -589,17 +617,13 @@ public:
 		// Blend attachment states required for all color attachments
 		// This is important, as color write mask will otherwise be 0x0 and you
 		// won't see anything rendered to the attachment
-		std::array<VkPipelineColorBlendAttachmentState, 3> blendAttachmentStates =
-		{
-			vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE),
-			vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE),
-			vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE)
-		};
+		std::vector<VkPipelineColorBlendAttachmentState> blendAttachmentStates(gBufferLayout.colorTargets.size(), vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE));
 		colorBlendState.attachmentCount = static_cast<uint32_t>(blendAttachmentStates.size());
 		colorBlendState.pAttachments = blendAttachmentStates.data();
 
 		shaderStages[0] = loadShader(getShadersPath() + "deferredshadows/mrt.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
 		shaderStages[1] = loadShader(getShadersPath() + "deferredshadows/mrt.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+		shaderStages[1].pSpecializationInfo = &specializationInfo;
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.offscreen));
 
 		// Shadow mapping pipeline
@@ -702,6 +726,7 @@ public:
 		memcpy(uniformBuffers.shadowGeometryShader.mapped, &uniformDataShadows, sizeof(UniformDataShadows));
 
 		uniformDataComposition.viewPos = glm::vec4(camera.position, 0.0f) * glm::vec4(-1.0f, 1.0f, -1.0f, 1.0f);;
+		uniformDataComposition.inverseViewProjection = glm::inverse(camera.matrices.perspective * camera.matrices.view);
 		uniformDataComposition.debugDisplayTarget = debugDisplayTarget;
 
 		memcpy(uniformBuffers.composition.mapped, &uniformDataComposition, sizeof(uniformDataComposition));
@@ -711,46 +736,31 @@ public:
 	{
 		VulkanExampleBase::prepare();
 		loadAssets();
+		gBufferLayout.create(physicalDevice, vks::GBufferLayout::Reference);
 		deferredSetup();
 		shadowSetup();
+		prepareTimestamps();
 		initLights();
 		prepareUniformBuffers();
 		setupDescriptors();
 		preparePipelines();
 		buildCommandBuffers();
-		buildDeferredCommandBuffer();
 		prepared = true;
 	}
 
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
-
-		// Offscreen rendering
-
-		// Wait for swap chain presentation to finish
-		submitInfo.pWaitSemaphores = &semaphores.presentComplete;
-		// Signal ready with offscreen semaphore
-		submitInfo.pSignalSemaphores = &offscreenSemaphore;
-
-		// Submit work
-
-		// Shadow map pass
+		// The previous submission of this command buffer has finished, so its timestamps can be read without waiting
+		if (timestampsSupported) {
+			const float period = vulkanDevice->properties.limits.timestampPeriod / 1000000.0f;
+			passTimes.shadow = (timestamps.getResult(currentBuffer, 1) - timestamps.getResult(currentBuffer, 0)) * period;
+			passTimes.gBuffer = (timestamps.getResult(currentBuffer, 2) - timestamps.getResult(currentBuffer, 1)) * period;
+			passTimes.composition = (timestamps.getResult(currentBuffer, 3) - timestamps.getResult(currentBuffer, 2)) * period;
+		}
 		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &offScreenCmdBuffer;
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
-
-		// Scene rendering
-
-		// Wait for offscreen semaphore
-		submitInfo.pWaitSemaphores = &offscreenSemaphore;
-		// Signal ready with render complete semaphore
-		submitInfo.pSignalSemaphores = &semaphores.renderComplete;
-
-		// Submit work
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
-
 		VulkanExampleBase::submitFrame();
 	}
 
@@ -763,6 +773,29 @@ public:
 		draw();
 	}
 
+	void prepareTimestamps()
+	{
+		timestampsSupported = (vulkanDevice->properties.limits.timestampComputeAndGraphics == VK_TRUE) && (vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].timestampValidBits > 0);
+		if (timestampsSupported) {
+			timestamps.create(vulkanDevice, queue, VK_QUERY_TYPE_TIMESTAMP, static_cast<uint32_t>(drawCmdBuffers.size()), 4);
+		}
+	}
+
+	// Switch the G-buffer layout, which changes the offscreen attachments and with that the render pass and pipelines
+	// The command buffers are rebuilt by the base class after the UI has been updated
+	void changeGBufferLayout(vks::GBufferLayout::Type type)
+	{
+		vkDeviceWaitIdle(device);
+		gBufferLayout.create(physicalDevice, type);
+		delete frameBuffers.deferred;
+		deferredSetup();
+		updateImageDescriptors();
+		vkDestroyPipeline(device, pipelines.deferred, nullptr);
+		vkDestroyPipeline(device, pipelines.offscreen, nullptr);
+		vkDestroyPipeline(device, pipelines.shadowpass, nullptr);
+		preparePipelines();
+	}
+
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
 		if (overlay->header("Settings")) {
@@ -771,6 +804,21 @@ public:
 			if (overlay->checkBox("Shadows", &shadows)) {
 				uniformDataComposition.useShadows = shadows;
 			}
+			int32_t layoutType = gBufferLayout.type;
+			if (overlay->comboBox("G-Buffer layout", &layoutType, { vks::GBufferLayout::getName(vks::GBufferLayout::Reference), vks::GBufferLayout::getName(vks::GBufferLayout::Compact) })) {
+				changeGBufferLayout(static_cast<vks::GBufferLayout::Type>(layoutType));
+			}
+		}
+		if (overlay->header("G-Buffer")) {
+			const vks::GBufferLayout::Bandwidth bandwidth = gBufferLayout.estimateBandwidth({ frameBuffers.deferred->width, frameBuffers.deferred->height }, 1, { width, height }, 1);
+			overlay->text("%u bytes per pixel", gBufferLayout.bytesPerPixel());
+			overlay->text("G-Buffer pass writes: %.1f MB", (float)bandwidth.gBufferWrite / (1024.0f * 1024.0f));
+			overlay->text("Composition reads: %.1f MB", (float)bandwidth.compositionRead / (1024.0f * 1024.0f));
+			if (timestampsSupported) {
+				overlay->text("Shadow pass: %.2f ms", passTimes.shadow);
+				overlay->text("G-Buffer pass: %.2f ms", passTimes.gBuffer);
+				overlay->text("Composition pass: %.2f ms", passTimes.composition);
+			}
 		}
 	}
 };
@@ -11,37 +11,7 @@
 */
 
 #include "vulkanexamplebase.h"
-
-// Vertex layout for this example
-struct Vertex {
-	float pos[3];
-	float uv[2];
-};
-
-// AngelCode .fnt format structs and classes
-struct bmchar {
-	uint32_t x, y;
-	uint32_t width;
-	uint32_t height;
-	int32_t xoffset;
-	int32_t yoffset;
-	int32_t xadvance;
-	uint32_t page;
-};
-
-// Quick and dirty : We store complete ASCII table
-// Only chars present in the .fnt are filled with data, so not a complete, production ready solution!
-std::array<bmchar, 255> fontChars;
-
-int32_t nextValuePair(std::stringstream *stream)
-{
-	std::string pair;
-	*stream >> pair;
-	size_t spos = pair.find("=");
-	std::string value = pair.substr(spos + 1);
-	int32_t val = std::stoi(value);
-	return val;
-}
+#include "VulkanTextRenderer.h"
 
 class VulkanExample : public VulkanExampleBase
 {
@@ -53,9 +23,11 @@ public:
 		vks::Texture2D fontBitmap;
 	} textures;
 
-	vks::Buffer vertexBuffer;
-	vks::Buffer indexBuffer;
-	uint32_t indexCount{ 0 };
+	// Glyph metrics from the AngelCode .fnt file that the atlases were generated with
+	vks::Font font;
+	// Glyphs of the displayed text are drawn as instances (see vks::TextRenderer)
+	vks::TextRenderer text;
+	uint32_t textHandle{ 0 };
 
 	struct UniformData {
 		// Scene matrices
@@ -84,6 +56,8 @@ public:
 	VulkanExample() : VulkanExampleBase()
 	{
 		title = "Distance field font rendering";
+		// The instanced glyph rendering only has GLSL shaders
+		requireGlslShaders();
 		camera.type = Camera::CameraType::lookat;
 		camera.setPosition(glm::vec3(0.0f, 0.0f, -2.0f));
 		camera.setRotation(glm::vec3(0.0f));
@@ -99,73 +73,20 @@ public:
 			vkDestroyPipeline(device, pipelines.bitmap, nullptr);
 			vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 			vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
-			vertexBuffer.destroy();
-			indexBuffer.destroy();
+			text.destroy();
 			uniformBuffer.destroy();
 		}
 	}
 
-	// Basic parser for AngelCode bitmap font format files
-	// See http://www.angelcode.com/products/bmfont/doc/file_format.html for details
-	void parsebmFont()
-	{
-		std::string fileName = getAssetPath() + "font.fnt";
-
-#if defined(__ANDROID__)
-		// Font description file is stored inside the apk
-		// So we need to load it using the asset manager
-		AAsset* asset = AAssetManager_open(androidApp->activity->assetManager, fileName.c_str(), AASSET_MODE_STREAMING);
-		assert(asset);
-		size_t size = AAsset_getLength(asset);
-
-		assert(size > 0);
-
-		void *fileData = malloc(size);
-		AAsset_read(asset, fileData, size);
-		AAsset_close(asset);
-
-		std::stringbuf sbuf((const char*)fileData);
-		std::istream istream(&sbuf);
-#else
-		std::filebuf fileBuffer;
-		fileBuffer.open(fileName, std::ios::in);
-		std::istream istream(&fileBuffer);
-#endif
-
-		assert(istream.good());
-
-		while (!istream.eof())
-		{
-			std::string line;
-			std::stringstream lineStream;
-			std::getline(istream, line);
-			lineStream << line;
-
-			std::string info;
-			lineStream >> info;
-
-			if (info == "char")
-			{
-				// char id
-				uint32_t charid = nextValuePair(&lineStream);
-				// Char properties
-				fontChars[charid].x = nextValuePair(&lineStream);
-				fontChars[charid].y = nextValuePair(&lineStream);
-				fontChars[charid].width = nextValuePair(&lineStream);
-				fontChars[charid].height = nextValuePair(&lineStream);
-				fontChars[charid].xoffset = nextValuePair(&lineStream);
-				fontChars[charid].yoffset = nextValuePair(&lineStream);
-				fontChars[charid].xadvance = nextValuePair(&lineStream);
-				fontChars[charid].page = nextValuePair(&lineStream);
-			}
-		}
-
-	}
-
 	void loadAssets()
 	{
 		textures.fontSDF.loadFromFile(getAssetPath() + "textures/font_sdf_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
 		textures.fontBitmap.loadFromFile(getAssetPath() + "textures/font_bitmap_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
+		// Glyph metrics, either in the text or the preparsed binary BMFont format
+		std::string error;
+		if (!font.loadFromFile(getAssetPath() + "font.fnt", &error)) {
+			vks::tools::exitFatal("Could not load font metrics: " + error, -1);
+		}
 	}
 
 	void buildCommandBuffers()
@@ -199,14 +120,15 @@ public:
 			VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
 			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
-			VkDeviceSize offsets[1] = { 0 };
+			// Glyphs are laid out in font pixels, scale them to world units and center the text vertically
+			glm::mat4 textTransform = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.5f, 0.0f));
+			textTransform = glm::scale(textTransform, glm::vec3(1.0f / font.size));
+			vkCmdPushConstants(drawCmdBuffers[i], pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &textTransform);
 
 			// Signed distance field font
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.sdf, 0, NULL);
 			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.sdf);
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1, &vertexBuffer.buffer, offsets);
-			vkCmdBindIndexBuffer(drawCmdBuffers[i], indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(drawCmdBuffers[i], indexCount, 1, 0, 0, 0);
+			text.cmdDraw(drawCmdBuffers[i]);
 
 			// Linear filtered bitmap font
 			if (splitScreen)
@@ -215,7 +137,7 @@ public:
 				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
 				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.bitmap, 0, NULL);
 				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.bitmap);
-				vkCmdDrawIndexed(drawCmdBuffers[i], indexCount, 1, 0, 0, 0);
+				text.cmdDraw(drawCmdBuffers[i]);
 			}
 
 			drawUI(drawCmdBuffers[i]);
@@ -226,67 +148,13 @@ public:
 		}
 	}
 
-	// Creates a vertex and index buffer with triangle data containing the chars of the given text
-	void generateText(std:: string text)
+	// Lays out the given text centered around the origin, with one glyph instance per character
+	void generateText(const std::string& string)
 	{
-		std::vector<Vertex> vertices;
-		std::vector<uint32_t> indices;
-		uint32_t indexOffset = 0;
-
-		float w = static_cast<float>(textures.fontSDF.width);
-
-		float posx = 0.0f;
-		float posy = 0.0f;
-
-		for (uint32_t i = 0; i < text.size(); i++)
-		{
-			bmchar *charInfo = &fontChars[(int)text[i]];
-
-			if (charInfo->width == 0)
-				charInfo->width = 36;
-
-			float charw = ((float)(charInfo->width) / 36.0f);
-			float dimx = 1.0f * charw;
-			float charh = ((float)(charInfo->height) / 36.0f);
-			float dimy = 1.0f * charh;
-
-			float us = charInfo->x / w;
-			float ue = (charInfo->x + charInfo->width) / w;
-			float ts = charInfo->y / w;
-			float te = (charInfo->y + charInfo->height) / w;
-
-			float xo = charInfo->xoffset / 36.0f;
-			float yo = charInfo->yoffset / 36.0f;
-
-			posy = yo;
-
-			vertices.push_back({ { posx + dimx + xo,  posy + dimy, 0.0f }, { ue, te } });
-			vertices.push_back({ { posx + xo,         posy + dimy, 0.0f }, { us, te } });
-			vertices.push_back({ { posx + xo,         posy,        0.0f }, { us, ts } });
-			vertices.push_back({ { posx + dimx + xo,  posy,        0.0f }, { ue, ts } });
-
-			std::array<uint32_t, 6> letterIndices = { 0,1,2, 2,3,0 };
-			for (auto& index : letterIndices)
-			{
-				indices.push_back(indexOffset + index);
-			}
-			indexOffset += 4;
-
-			float advance = ((float)(charInfo->xadvance) / 36.0f);
-			posx += advance;
-		}
-		indexCount = static_cast<uint32_t>(indices.size());
-
-		// Center
-		for (auto& v : vertices)
-		{
-			v.pos[0] -= posx / 2.0f;
-			v.pos[1] -= 0.5f;
-		}
-
-		// Generate host accessible buffers for the text vertices and indices and upload the data
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &vertexBuffer, vertices.size() * sizeof(Vertex), vertices.data()));
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &indexBuffer, indices.size() * sizeof(uint32_t), indices.data()));
+		text.create(vulkanDevice, &font, static_cast<uint32_t>(string.size()));
+		textHandle = text.addText();
+		text.setText(textHandle, string, glm::vec2(0.0f), vks::TextRenderer::alignCenter);
+		text.update();
 	}
 
 	void setupDescriptors()
@@ -335,11 +203,15 @@ public:
 	void preparePipelines()
 	{
 		// Layout
+		// Push constant with the transformation of the text from font pixels to world space
+		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_VERTEX_BIT, sizeof(glm::mat4), 0);
 		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout));
 
 		// Pipelines
-		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
+		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP, 0, VK_FALSE);
 		VkPipelineRasterizationStateCreateInfo rasterizationState = vks::initializers::pipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE, 0);
 		VkPipelineColorBlendAttachmentState blendAttachmentState = vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_TRUE);
 		VkPipelineColorBlendStateCreateInfo colorBlendState = vks::initializers::pipelineColorBlendStateCreateInfo(1, &blendAttachmentState);
@@ -360,22 +232,9 @@ public:
 		blendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
 		blendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
 
-		// Vertex input state
-		std::vector<VkVertexInputBindingDescription> vertexInputBindings = {
-			vks::initializers::vertexInputBindingDescription(0, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX)
-		};
-		std::vector<VkVertexInputAttributeDescription> vertexInputAttributes = {
-			vks::initializers::vertexInputAttributeDescription(0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, pos)),
-			vks::initializers::vertexInputAttributeDescription(0, 1, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv)),
-		};
-		VkPipelineVertexInputStateCreateInfo vertexInputState = vks::initializers::pipelineVertexInputStateCreateInfo();
-		vertexInputState.vertexBindingDescriptionCount = static_cast<uint32_t>(vertexInputBindings.size());
-		vertexInputState.pVertexBindingDescriptions = vertexInputBindings.data();
-		vertexInputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexInputAttributes.size());
-		vertexInputState.pVertexAttributeDescriptions = vertexInputAttributes.data();
-
 		VkGraphicsPipelineCreateInfo pipelineCreateInfo = vks::initializers::pipelineCreateInfo(pipelineLayout, renderPass, 0);
-		pipelineCreateInfo.pVertexInputState = &vertexInputState;
+		// Glyphs are per instance vertex data, the quad corners are generated from the vertex index
+		pipelineCreateInfo.pVertexInputState = text.getPipelineVertexInputState();
 		pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
 		pipelineCreateInfo.pRasterizationState = &rasterizationState;
 		pipelineCreateInfo.pColorBlendState = &colorBlendState;
@@ -418,7 +277,6 @@ public:
 	void prepare()
 	{
 		VulkanExampleBase::prepare();
-		parsebmFont();
 		loadAssets();
 		generateText("Vulkan");
 		prepareUniformBuffers();
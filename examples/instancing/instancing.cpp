@@ -1,13 +1,22 @@
 /*
 * Vulkan Example - Instanced mesh rendering, uses a separate vertex buffer for instanced data
 *
+* The animated transforms of all instances are either composed on the CPU (SIMD, spread across worker threads) and streamed
+* through a persistently mapped ring buffer with one slice per frame, or generated in a compute shader
+* The compute shader then culls the instances against the view frustum and drops the ones that are too small on screen,
+* the visible ones are compacted into the instance list of a single indexed indirect draw
+*
 * Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#include <chrono>
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "threadpool.hpp"
+#include "simd.hpp"
+#include "frustum.hpp"
 
 #if defined(__ANDROID__)
 #define INSTANCE_COUNT 4096
@@ -15,6 +24,105 @@
 #define INSTANCE_COUNT 8192
 #endif
 
+// Static per instance data with the sines and cosines of the initial rotation angles, as structure of arrays for SIMD processing
+struct InstanceAngles {
+	std::vector<float> posX, posY, posZ;
+	std::vector<float> scale;
+	std::vector<float> sinX, cosX, sinY, cosY, sinZ, cosZ;
+};
+
+// Scalar and SIMD versions of the operations used to compose the transforms, so the composition is only written once
+struct ScalarOps {
+	typedef float vfloat;
+	static const uint32_t width = 1;
+	static vfloat load(const float* p) { return *p; }
+	static void store(float* p, vfloat a) { *p = a; }
+	static vfloat set(float a) { return a; }
+	static vfloat add(vfloat a, vfloat b) { return a + b; }
+	static vfloat sub(vfloat a, vfloat b) { return a - b; }
+	static vfloat mul(vfloat a, vfloat b) { return a * b; }
+};
+
+#if !defined(VKS_SIMD_NONE)
+struct SimdOps {
+	typedef simd::vfloat vfloat;
+	static const uint32_t width = simd::width;
+	static vfloat load(const float* p) { return simd::load(p); }
+	static void store(float* p, vfloat a) { simd::store(p, a); }
+	static vfloat set(float a) { return simd::set(a); }
+	static vfloat add(vfloat a, vfloat b) { return simd::add(a, b); }
+	static vfloat sub(vfloat a, vfloat b) { return simd::sub(a, b); }
+	static vfloat mul(vfloat a, vfloat b) { return simd::mul(a, b); }
+};
+#endif
+
+/*
+	Composes the animated 3x4 model matrices of instances [begin, end) in batches of Ops::width and returns the first instance that wasn't processed
+	The animation adds the same angle to the rotations of all instances, so the sines and cosines of the animated angles are derived from the
+	precomputed ones of the initial angles with the angle addition theorem, which leaves only multiplications and additions per instance
+	The rotation is the one the vertex shader used to calculate: global rotation around the planet * transpose(mz * my * mx) * scale
+*/
+template <typename Ops>
+uint32_t composeTransforms(const InstanceAngles& instances, uint32_t begin, uint32_t end, float locSpeed, float globSpeed, float* dst)
+{
+	typedef typename Ops::vfloat vfloat;
+	const vfloat sinLoc = Ops::set(sinf(locSpeed));
+	const vfloat cosLoc = Ops::set(cosf(locSpeed));
+	const vfloat sinGlob = Ops::set(sinf(globSpeed));
+	const vfloat cosGlob = Ops::set(cosf(globSpeed));
+	auto addSin = [](vfloat s, vfloat c, vfloat sinT, vfloat cosT) { return Ops::add(Ops::mul(s, cosT), Ops::mul(c, sinT)); };
+	auto addCos = [](vfloat s, vfloat c, vfloat sinT, vfloat cosT) { return Ops::sub(Ops::mul(c, cosT), Ops::mul(s, sinT)); };
+
+	alignas(32) float rows[12][Ops::width];
+	uint32_t i = begin;
+	for (; i + Ops::width <= end; i += Ops::width) {
+		const vfloat sinX = Ops::load(&instances.sinX[i]), cosX = Ops::load(&instances.cosX[i]);
+		const vfloat sinY = Ops::load(&instances.sinY[i]), cosY = Ops::load(&instances.cosY[i]);
+		const vfloat sinZ = Ops::load(&instances.sinZ[i]), cosZ = Ops::load(&instances.cosZ[i]);
+		const vfloat sx = addSin(sinX, cosX, sinLoc, cosLoc), cx = addCos(sinX, cosX, sinLoc, cosLoc);
+		const vfloat sy = addSin(sinY, cosY, sinLoc, cosLoc), cy = addCos(sinY, cosY, sinLoc, cosLoc);
+		const vfloat sz = addSin(sinZ, cosZ, sinLoc, cosLoc), cz = addCos(sinZ, cosZ, sinLoc, cosLoc);
+		const vfloat gs = addSin(sinY, cosY, sinGlob, cosGlob), gc = addCos(sinY, cosY, sinGlob, cosGlob);
+		const vfloat scale = Ops::load(&instances.scale[i]);
+
+		// Columns of mz * my * mx, which are the scaled rows of its transpose
+		const vfloat szsy = Ops::mul(sz, sy), czsy = Ops::mul(cz, sy);
+		const vfloat l00 = Ops::mul(scale, Ops::mul(cy, cx));
+		const vfloat l01 = Ops::mul(scale, Ops::sub(Ops::mul(cz, sx), Ops::mul(szsy, cx)));
+		const vfloat l02 = Ops::mul(scale, Ops::add(Ops::mul(sz, sx), Ops::mul(czsy, cx)));
+		const vfloat l10 = Ops::mul(scale, Ops::sub(Ops::set(0.0f), Ops::mul(cy, sx)));
+		const vfloat l11 = Ops::mul(scale, Ops::add(Ops::mul(cz, cx), Ops::mul(szsy, sx)));
+		const vfloat l12 = Ops::mul(scale, Ops::sub(Ops::mul(sz, cx), Ops::mul(czsy, sx)));
+		const vfloat l20 = Ops::mul(scale, Ops::sub(Ops::set(0.0f), sy));
+		const vfloat l21 = Ops::mul(scale, Ops::sub(Ops::set(0.0f), Ops::mul(sz, cy)));
+		const vfloat l22 = Ops::mul(scale, Ops::mul(cz, cy));
+
+		// Rotation around the planet (y axis) applied to the local transform and the position
+		const vfloat px = Ops::load(&instances.posX[i]), py = Ops::load(&instances.posY[i]), pz = Ops::load(&instances.posZ[i]);
+		Ops::store(rows[0], Ops::sub(Ops::mul(gc, l00), Ops::mul(gs, l20)));
+		Ops::store(rows[1], Ops::sub(Ops::mul(gc, l01), Ops::mul(gs, l21)));
+		Ops::store(rows[2], Ops::sub(Ops::mul(gc, l02), Ops::mul(gs, l22)));
+		Ops::store(rows[3], Ops::sub(Ops::mul(gc, px), Ops::mul(gs, pz)));
+		Ops::store(rows[4], l10);
+		Ops::store(rows[5], l11);
+		Ops::store(rows[6], l12);
+		Ops::store(rows[7], py);
+		Ops::store(rows[8], Ops::add(Ops::mul(gs, l00), Ops::mul(gc, l20)));
+		Ops::store(rows[9], Ops::add(Ops::mul(gs, l01), Ops::mul(gc, l21)));
+		Ops::store(rows[10], Ops::add(Ops::mul(gs, l02), Ops::mul(gc, l22)));
+		Ops::store(rows[11], Ops::add(Ops::mul(gs, px), Ops::mul(gc, pz)));
+
+		// Written sequentially, as the destination is uncached host visible memory
+		for (uint32_t lane = 0; lane < Ops::width; lane++) {
+			float* transform = dst + (size_t)(i + lane) * 12;
+			for (uint32_t j = 0; j < 12; j++) {
+				transform[j] = rows[j][lane];
+			}
+		}
+	}
+	return i;
+}
+
 class VulkanExample : public VulkanExampleBase
 {
 public:
@@ -30,19 +138,48 @@ public:
 	} models{};
 
 	// We provide position, rotation and scale per mesh instance
+	// Laid out to match the std430 layout of the compute shader's source instances
 	struct InstanceData {
 		glm::vec3 pos;
-		glm::vec3 rot;
 		float scale{ 0.0f };
+		glm::vec3 rot;
 		uint32_t texIndex{ 0 };
 	};
-	// Contains the instanced data
-	struct InstanceBuffer {
-		VkBuffer buffer{ VK_NULL_HANDLE };
-		VkDeviceMemory memory{ VK_NULL_HANDLE };
-		size_t size = 0;
-		VkDescriptorBufferInfo descriptor{ VK_NULL_HANDLE };
-	} instanceBuffer;
+	// Instance of the compacted list of visible instances, also used as per-instance vertex data
+	struct VisibleInstance {
+		glm::vec4 rows[3];
+		uint32_t texIndex;
+		uint32_t _pad[3];
+	};
+	// Size of an instance's transform in the ring buffer (rows of a 3x4 matrix)
+	static const uint32_t transformSize = sizeof(float) * 12;
+
+	const std::vector<uint32_t> instanceCounts = { INSTANCE_COUNT, 65536, 262144, 1048576 };
+	int32_t instanceCountIndex{ 0 };
+	uint32_t instanceCount{ INSTANCE_COUNT };
+	InstanceAngles instanceAngles;
+
+	// Static instance data, read by the compute shader
+	vks::Buffer instanceBuffer;
+	// Persistently mapped ring buffer for the transforms composed on the CPU, with one slice per command buffer
+	vks::Buffer transformRing;
+	VkDeviceSize transformSliceSize{ 0 };
+	// Compacted list of visible instances, written by the compute shader and sourced as instanced vertex data
+	vks::Buffer visibleInstanceBuffer;
+	// Indexed indirect draw for the rocks, the compute shader sets the instance count
+	vks::Buffer indirectDrawBuffer;
+	// Host visible copy of the indirect draw of each command buffer, to display the number of visible instances
+	vks::Buffer indirectReadbackBuffer;
+	uint32_t visibleInstanceCount{ 0 };
+
+	enum TransformSource { TransformsCompute = 0, TransformsCPU = 1 };
+	int32_t transformSource{ TransformsCompute };
+	bool frustumCulling{ true };
+	float minPixelSize{ 1.0f };
+
+	vks::ThreadPool threadPool;
+	uint32_t numThreads{ 1 };
+	float cpuTransformTime{ 0.0f };
 
 	struct UniformData {
 		glm::mat4 projection;
@@ -53,6 +190,22 @@ public:
 	} uniformData;
 	vks::Buffer uniformBuffer;
 
+	// Culling parameters for the compute shader
+	struct CullData {
+		glm::vec4 frustumPlanes[6];
+		glm::vec4 cameraPos;
+		float projectionScale;
+		float minPixelSize;
+		float boundingRadius;
+		float locSpeed;
+		float globSpeed;
+		uint32_t instanceCount;
+		uint32_t cpuTransforms;
+		uint32_t frustumCulling;
+	} cullData;
+	vks::Buffer cullUniformBuffer;
+	vks::Frustum frustum;
+
 	VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
 	struct {
 		VkPipeline instancedRocks{ VK_NULL_HANDLE };
@@ -66,13 +219,25 @@ public:
 		VkDescriptorSet planet{ VK_NULL_HANDLE };
 	} descriptorSets;
 
+	// Instance culling
+	struct {
+		VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
+		VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
+		VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
+		VkPipeline pipeline{ VK_NULL_HANDLE };
+	} cull;
+
 	VulkanExample() : VulkanExampleBase()
 	{
 		title = "Instanced mesh rendering";
+		// The GPU instance culling only has GLSL shaders
+		requireGlslShaders();
 		camera.type = Camera::CameraType::lookat;
 		camera.setPosition(glm::vec3(5.5f, -1.85f, -18.5f));
 		camera.setRotation(glm::vec3(-17.2f, -4.7f, 0.0f));
 		camera.setPerspective(60.0f, (float)width / (float)height, 1.0f, 256.0f);
+		numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+		threadPool.setThreadCount(numThreads);
 	}
 
 	~VulkanExample()
@@ -83,11 +248,16 @@ public:
 			vkDestroyPipeline(device, pipelines.starfield, nullptr);
 			vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 			vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
-			vkDestroyBuffer(device, instanceBuffer.buffer, nullptr);
-			vkFreeMemory(device, instanceBuffer.memory, nullptr);
+			vkDestroyPipeline(device, cull.pipeline, nullptr);
+			vkDestroyPipelineLayout(device, cull.pipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(device, cull.descriptorSetLayout, nullptr);
+			destroyInstanceBuffers();
+			indirectDrawBuffer.destroy();
+			indirectReadbackBuffer.destroy();
 			textures.rocks.destroy();
 			textures.planet.destroy();
 			uniformBuffer.destroy();
+			cullUniformBuffer.destroy();
 		}
 	}
 
@@ -122,6 +292,30 @@ public:
 
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
+			// Reset the indirect draw, the compute shader counts the visible instances
+			VkDrawIndexedIndirectCommand indirectDraw{};
+			indirectDraw.indexCount = models.rock.indices.count;
+			vkCmdUpdateBuffer(drawCmdBuffers[i], indirectDrawBuffer.buffer, 0, sizeof(VkDrawIndexedIndirectCommand), &indirectDraw);
+
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+			// Cull and compact the instances, the dynamic offset selects the slice of the transform ring buffer for this command buffer
+			uint32_t transformOffset = static_cast<uint32_t>(i * transformSliceSize);
+			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, cull.pipeline);
+			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, cull.pipelineLayout, 0, 1, &cull.descriptorSet, 1, &transformOffset);
+			vkCmdDispatch(drawCmdBuffers[i], (instanceCount + 63) / 64, 1, 1);
+
+			// Make the visible instances and the indirect draw available to the draw and the readback copy
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+			vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+			VkBufferCopy readbackRegion{ 0, i * sizeof(VkDrawIndexedIndirectCommand), sizeof(VkDrawIndexedIndirectCommand) };
+			vkCmdCopyBuffer(drawCmdBuffers[i], indirectDrawBuffer.buffer, indirectReadbackBuffer.buffer, 1, &readbackRegion);
+
 			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
@@ -147,13 +341,13 @@ public:
 			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.instancedRocks);
 			// Binding point 0 : Mesh vertex buffer
 			vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1, &models.rock.vertices.buffer, offsets);
-			// Binding point 1 : Instance data buffer
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], 1, 1, &instanceBuffer.buffer, offsets);
+			// Binding point 1 : Compacted list of visible instances
+			vkCmdBindVertexBuffers(drawCmdBuffers[i], 1, 1, &visibleInstanceBuffer.buffer, offsets);
 			// Bind index buffer
 			vkCmdBindIndexBuffer(drawCmdBuffers[i], models.rock.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
 
-			// Render instances
-			vkCmdDrawIndexed(drawCmdBuffers[i], models.rock.indices.count, INSTANCE_COUNT, 0, 0, 0);
+			// Render the visible instances, the instance count is taken from the buffer written by the compute shader
+			vkCmdDrawIndexedIndirect(drawCmdBuffers[i], indirectDrawBuffer.buffer, 0, 1, sizeof(VkDrawIndexedIndirectCommand));
 
 			drawUI(drawCmdBuffers[i]);
 
@@ -177,10 +371,12 @@ public:
 	{
 		// Pool
 		std::vector<VkDescriptorPoolSize> poolSizes = {
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3),
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1),
 		};
-		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 2);
+		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 3);
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 
 		// Layout
@@ -218,6 +414,39 @@ public:
 			vks::initializers::writeDescriptorSet(descriptorSets.planet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &textures.planet.descriptor)
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+		// Instance culling
+		setLayoutBindings = {
+			// Binding 0 : Culling parameters
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			// Binding 1 : Static instance data
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+			// Binding 2 : Transforms composed on the CPU, the current slice of the ring buffer is selected with a dynamic offset
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+			// Binding 3 : Compacted list of visible instances
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+			// Binding 4 : Indirect draw
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4),
+		};
+		descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &cull.descriptorSetLayout));
+		descripotrSetAllocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &cull.descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descripotrSetAllocInfo, &cull.descriptorSet));
+		updateCullDescriptorSet();
+	}
+
+	// The instance buffers are recreated if the number of instances changes
+	void updateCullDescriptorSet()
+	{
+		VkDescriptorBufferInfo transformDescriptor{ transformRing.buffer, 0, transformSliceSize };
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			vks::initializers::writeDescriptorSet(cull.descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &cullUniformBuffer.descriptor),
+			vks::initializers::writeDescriptorSet(cull.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &instanceBuffer.descriptor),
+			vks::initializers::writeDescriptorSet(cull.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 2, &transformDescriptor),
+			vks::initializers::writeDescriptorSet(cull.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &visibleInstanceBuffer.descriptor),
+			vks::initializers::writeDescriptorSet(cull.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &indirectDrawBuffer.descriptor),
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 	}
 
 	void preparePipelines()
@@ -260,7 +489,7 @@ public:
 			// Binding point 0: Mesh vertex layout description at per-vertex rate
 			vks::initializers::vertexInputBindingDescription(0, sizeof(vkglTF::Vertex), VK_VERTEX_INPUT_RATE_VERTEX),
 			// Binding point 1: Instanced data at per-instance rate
-			vks::initializers::vertexInputBindingDescription(1, sizeof(InstanceData), VK_VERTEX_INPUT_RATE_INSTANCE)
+			vks::initializers::vertexInputBindingDescription(1, sizeof(VisibleInstance), VK_VERTEX_INPUT_RATE_INSTANCE)
 		};
 
 		// Vertex attribute bindings
@@ -268,7 +497,7 @@ public:
 		// instanced.vert:
 		//	layout (location = 0) in vec3 inPos;		Per-Vertex
 		//	...
-		//	layout (location = 4) in vec3 instancePos;	Per-Instance
+		//	layout (location = 4) in vec4 instanceRow0;	Per-Instance
 		attributeDescriptions = {
 			// Per-vertex attributes
 			// These are advanced for each vertex fetched by the vertex shader
@@ -278,10 +507,10 @@ public:
 			vks::initializers::vertexInputAttributeDescription(0, 3, VK_FORMAT_R32G32B32_SFLOAT, sizeof(float) * 8),	// Location 3: Color
 			// Per-Instance attributes
 			// These are advanced for each instance rendered
-			vks::initializers::vertexInputAttributeDescription(1, 4, VK_FORMAT_R32G32B32_SFLOAT, 0),					// Location 4: Position
-			vks::initializers::vertexInputAttributeDescription(1, 5, VK_FORMAT_R32G32B32_SFLOAT, sizeof(float) * 3),	// Location 5: Rotation
-			vks::initializers::vertexInputAttributeDescription(1, 6, VK_FORMAT_R32_SFLOAT,sizeof(float) * 6),			// Location 6: Scale
-			vks::initializers::vertexInputAttributeDescription(1, 7, VK_FORMAT_R32_SINT, sizeof(float) * 7),			// Location 7: Texture array layer index
+			vks::initializers::vertexInputAttributeDescription(1, 4, VK_FORMAT_R32G32B32A32_SFLOAT, 0),					// Location 4: Model matrix row 0
+			vks::initializers::vertexInputAttributeDescription(1, 5, VK_FORMAT_R32G32B32A32_SFLOAT, sizeof(float) * 4),	// Location 5: Model matrix row 1
+			vks::initializers::vertexInputAttributeDescription(1, 6, VK_FORMAT_R32G32B32A32_SFLOAT, sizeof(float) * 8),	// Location 6: Model matrix row 2
+			vks::initializers::vertexInputAttributeDescription(1, 7, VK_FORMAT_R32_SINT, sizeof(float) * 12),			// Location 7: Texture array layer index
 		};
 		inputState.pVertexBindingDescriptions = bindingDescriptions.data();
 		inputState.pVertexAttributeDescriptions = attributeDescriptions.data();
@@ -313,20 +542,27 @@ public:
 		inputState.vertexBindingDescriptionCount = 0;
 		inputState.vertexAttributeDescriptionCount = 0;
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.starfield));
+
+		// Instance culling pipeline
+		pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(&cull.descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &cull.pipelineLayout));
+		VkComputePipelineCreateInfo computePipelineCI = vks::initializers::computePipelineCreateInfo(cull.pipelineLayout, 0);
+		computePipelineCI.stage = loadShader(getShadersPath() + "instancing/cull.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCI, nullptr, &cull.pipeline));
 	}
 
-	// Create a buffer with per-instance data that is sourced in the shaders
+	// Create the buffers with per-instance data that is sourced in the shaders
 	void prepareInstanceData()
 	{
 		std::vector<InstanceData> instanceData;
-		instanceData.resize(INSTANCE_COUNT);
+		instanceData.resize(instanceCount);
 
 		std::default_random_engine rndGenerator(benchmark.active ? 0 : (unsigned)time(nullptr));
 		std::uniform_real_distribution<float> uniformDist(0.0, 1.0);
 		std::uniform_int_distribution<uint32_t> rndTextureIndex(0, textures.rocks.layerCount);
 
 		// Distribute rocks randomly on two different rings
-		for (auto i = 0; i < INSTANCE_COUNT / 2; i++) {
+		for (uint32_t i = 0; i < instanceCount / 2; i++) {
 			glm::vec2 ring0 { 7.0f, 11.0f };
 			glm::vec2 ring1 { 14.0f, 18.0f };
 
@@ -344,66 +580,109 @@ public:
 			// Outer ring
 			rho = sqrt((pow(ring1[1], 2.0f) - pow(ring1[0], 2.0f)) * uniformDist(rndGenerator) + pow(ring1[0], 2.0f));
 			theta = static_cast<float>(2.0f * M_PI * uniformDist(rndGenerator));
-			instanceData[i + INSTANCE_COUNT / 2].pos = glm::vec3(rho*cos(theta), uniformDist(rndGenerator) * 0.5f - 0.25f, rho*sin(theta));
-			instanceData[i + INSTANCE_COUNT / 2].rot = glm::vec3(M_PI * uniformDist(rndGenerator), M_PI * uniformDist(rndGenerator), M_PI * uniformDist(rndGenerator));
-			instanceData[i + INSTANCE_COUNT / 2].scale = 1.5f + uniformDist(rndGenerator) - uniformDist(rndGenerator);
-			instanceData[i + INSTANCE_COUNT / 2].texIndex = rndTextureIndex(rndGenerator);
-			instanceData[i + INSTANCE_COUNT / 2].scale *= 0.75f;
+			instanceData[i + instanceCount / 2].pos = glm::vec3(rho*cos(theta), uniformDist(rndGenerator) * 0.5f - 0.25f, rho*sin(theta));
+			instanceData[i + instanceCount / 2].rot = glm::vec3(M_PI * uniformDist(rndGenerator), M_PI * uniformDist(rndGenerator), M_PI * uniformDist(rndGenerator));
+			instanceData[i + instanceCount / 2].scale = 1.5f + uniformDist(rndGenerator) - uniformDist(rndGenerator);
+			instanceData[i + instanceCount / 2].texIndex = rndTextureIndex(rndGenerator);
+			instanceData[i + instanceCount / 2].scale *= 0.75f;
 		}
 
-		instanceBuffer.size = instanceData.size() * sizeof(InstanceData);
+		// Structure of arrays with the sines and cosines of the initial angles for composing the transforms on the CPU
+		instanceAngles = InstanceAngles();
+		for (auto* values : { &instanceAngles.posX, &instanceAngles.posY, &instanceAngles.posZ, &instanceAngles.scale, &instanceAngles.sinX, &instanceAngles.cosX, &instanceAngles.sinY, &instanceAngles.cosY, &instanceAngles.sinZ, &instanceAngles.cosZ }) {
+			values->resize(instanceCount);
+		}
+		for (uint32_t i = 0; i < instanceCount; i++) {
+			const InstanceData& instance = instanceData[i];
+			instanceAngles.posX[i] = instance.pos.x;
+			instanceAngles.posY[i] = instance.pos.y;
+			instanceAngles.posZ[i] = instance.pos.z;
+			instanceAngles.scale[i] = instance.scale;
+			instanceAngles.sinX[i] = sinf(instance.rot.x);
+			instanceAngles.cosX[i] = cosf(instance.rot.x);
+			instanceAngles.sinY[i] = sinf(instance.rot.y);
+			instanceAngles.cosY[i] = cosf(instance.rot.y);
+			instanceAngles.sinZ[i] = sinf(instance.rot.z);
+			instanceAngles.cosZ[i] = cosf(instance.rot.z);
+		}
 
-		// Staging
 		// Instanced data is static, copy to device local memory
 		// This results in better performance
+		const VkDeviceSize instanceBufferSize = instanceData.size() * sizeof(InstanceData);
+		vks::Buffer stagingBuffer;
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, instanceBufferSize, instanceData.data()));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &instanceBuffer, instanceBufferSize));
+		vulkanDevice->copyBuffer(&stagingBuffer, &instanceBuffer, queue);
+		stagingBuffer.destroy();
+
+		// Ring buffer for the transforms composed on the CPU, slices need to be aligned for the dynamic offsets
+		const VkDeviceSize alignment = vulkanDevice->properties.limits.minStorageBufferOffsetAlignment;
+		transformSliceSize = (instanceCount * transformSize + alignment - 1) / alignment * alignment;
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &transformRing, transformSliceSize * drawCmdBuffers.size()));
+		VK_CHECK_RESULT(transformRing.map());
+
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &visibleInstanceBuffer, instanceCount * sizeof(VisibleInstance)));
+	}
+
+	void destroyInstanceBuffers()
+	{
+		instanceBuffer.destroy();
+		transformRing.destroy();
+		visibleInstanceBuffer.destroy();
+	}
+
+	void setInstanceCount(uint32_t count)
+	{
+		vkDeviceWaitIdle(device);
+		destroyInstanceBuffers();
+		instanceCount = count;
+		prepareInstanceData();
+		updateCullDescriptorSet();
+		buildCommandBuffers();
+	}
 
-		struct {
-			VkDeviceMemory memory;
-			VkBuffer buffer;
-		} stagingBuffer;
-
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			instanceBuffer.size,
-			&stagingBuffer.buffer,
-			&stagingBuffer.memory,
-			instanceData.data()));
-
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			instanceBuffer.size,
-			&instanceBuffer.buffer,
-			&instanceBuffer.memory));
-
-		// Copy to staging buffer
-		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-		VkBufferCopy copyRegion = { };
-		copyRegion.size = instanceBuffer.size;
-		vkCmdCopyBuffer(
-			copyCmd,
-			stagingBuffer.buffer,
-			instanceBuffer.buffer,
-			1,
-			&copyRegion);
-
-		vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
-
-		instanceBuffer.descriptor.range = instanceBuffer.size;
-		instanceBuffer.descriptor.buffer = instanceBuffer.buffer;
-		instanceBuffer.descriptor.offset = 0;
-
-		// Destroy staging resources
-		vkDestroyBuffer(device, stagingBuffer.buffer, nullptr);
-		vkFreeMemory(device, stagingBuffer.memory, nullptr);
+	void prepareIndirectDraw()
+	{
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &indirectDrawBuffer, sizeof(VkDrawIndexedIndirectCommand)));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &indirectReadbackBuffer, sizeof(VkDrawIndexedIndirectCommand) * drawCmdBuffers.size()));
+		VK_CHECK_RESULT(indirectReadbackBuffer.map());
+		memset(indirectReadbackBuffer.mapped, 0, sizeof(VkDrawIndexedIndirectCommand) * drawCmdBuffers.size());
+	}
+
+	// Compose the transforms of all instances into the ring buffer slice of a command buffer, spread across the worker threads
+	void updateTransformsCPU(uint32_t slice)
+	{
+		auto tStart = std::chrono::high_resolution_clock::now();
+		float* dst = reinterpret_cast<float*>(static_cast<uint8_t*>(transformRing.mapped) + slice * transformSliceSize);
+		// Ranges are multiples of 64 instances, so only the last one has a tail that's not a multiple of the SIMD width
+		const uint32_t rangeSize = ((instanceCount + numThreads - 1) / numThreads + 63) / 64 * 64;
+		const float locSpeed = uniformData.locSpeed;
+		const float globSpeed = uniformData.globSpeed;
+		for (uint32_t t = 0; t < numThreads; t++) {
+			const uint32_t begin = std::min(t * rangeSize, instanceCount);
+			const uint32_t end = std::min(begin + rangeSize, instanceCount);
+			if (begin == end) {
+				break;
+			}
+			threadPool.threads[t]->addJob([this, begin, end, locSpeed, globSpeed, dst] {
+				uint32_t i = begin;
+#if !defined(VKS_SIMD_NONE)
+				i = composeTransforms<SimdOps>(instanceAngles, i, end, locSpeed, globSpeed, dst);
+#endif
+				composeTransforms<ScalarOps>(instanceAngles, i, end, locSpeed, globSpeed, dst);
+			});
+		}
+		threadPool.wait();
+		auto tEnd = std::chrono::high_resolution_clock::now();
+		cpuTransformTime = std::chrono::duration<float, std::milli>(tEnd - tStart).count();
 	}
 
 	void prepareUniformBuffers()
 	{
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffer, sizeof(UniformData)));
 		VK_CHECK_RESULT(uniformBuffer.map());
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &cullUniformBuffer, sizeof(CullData)));
+		VK_CHECK_RESULT(cullUniformBuffer.map());
 
 		updateUniformBuffer();
 	}
@@ -419,6 +698,19 @@ public:
 		}
 
 		memcpy(uniformBuffer.mapped, &uniformData, sizeof(uniformData));
+
+		frustum.update(camera.matrices.perspective * camera.matrices.view);
+		memcpy(cullData.frustumPlanes, frustum.planes.data(), sizeof(glm::vec4) * 6);
+		cullData.cameraPos = glm::inverse(camera.matrices.view)[3];
+		cullData.projectionScale = camera.matrices.perspective[1][1] * (float)height * 0.5f;
+		cullData.minPixelSize = minPixelSize;
+		cullData.boundingRadius = models.rock.dimensions.radius;
+		cullData.locSpeed = uniformData.locSpeed;
+		cullData.globSpeed = uniformData.globSpeed;
+		cullData.instanceCount = instanceCount;
+		cullData.cpuTransforms = (transformSource == TransformsCPU) ? 1 : 0;
+		cullData.frustumCulling = frustumCulling ? 1 : 0;
+		memcpy(cullUniformBuffer.mapped, &cullData, sizeof(cullData));
 	}
 
 	void prepare()
@@ -426,6 +718,7 @@ public:
 		VulkanExampleBase::prepare();
 		loadAssets();
 		prepareInstanceData();
+		prepareIndirectDraw();
 		prepareUniformBuffers();
 		setupDescriptors();
 		preparePipelines();
@@ -436,10 +729,17 @@ public:
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
+		// The ring buffer slice of this frame's command buffer isn't in use by the device anymore
+		if (transformSource == TransformsCPU) {
+			updateTransformsCPU(currentBuffer);
+		}
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
 		VulkanExampleBase::submitFrame();
+		// The frame has finished executing, so the copy of its indirect draw can be read
+		const VkDrawIndexedIndirectCommand* indirectDraw = static_cast<const VkDrawIndexedIndirectCommand*>(indirectReadbackBuffer.mapped) + currentBuffer;
+		visibleInstanceCount = indirectDraw->instanceCount;
 	}
 
 	virtual void render()
@@ -454,8 +754,24 @@ public:
 
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
+		if (overlay->header("Settings")) {
+			std::vector<std::string> countNames;
+			for (uint32_t count : instanceCounts) {
+				countNames.push_back(std::to_string(count));
+			}
+			if (overlay->comboBox("Instances", &instanceCountIndex, countNames)) {
+				setInstanceCount(instanceCounts[instanceCountIndex]);
+			}
+			overlay->comboBox("Transforms", &transformSource, { "Compute shader", std::string("CPU (") + VKS_SIMD_NAME + ")" });
+			overlay->checkBox("Frustum culling", &frustumCulling);
+			overlay->sliderFloat("Min. pixel size", &minPixelSize, 0.0f, 8.0f);
+		}
 		if (overlay->header("Statistics")) {
-			overlay->text("Instances: %d", INSTANCE_COUNT);
+			overlay->text("Instances: %d", instanceCount);
+			overlay->text("Visible: %d", visibleInstanceCount);
+			if (transformSource == TransformsCPU) {
+				overlay->text("CPU transforms: %.2f ms (%d threads)", cpuTransformTime, numThreads);
+			}
 		}
 	}
 };
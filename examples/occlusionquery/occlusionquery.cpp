@@ -8,6 +8,7 @@
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "VulkanQueryManager.h"
 
 class VulkanExample : public VulkanExampleBase
 {
@@ -50,8 +51,16 @@ public:
 	VkDescriptorSet descriptorSet;
 	VkDescriptorSetLayout descriptorSetLayout;
 
-	// Pool that stores all occlusion queries
-	VkQueryPool queryPool;
+	// Allocates the occlusion queries for each command buffer and resolves their results without stalling
+	vks::QueryManager queryManager;
+	struct {
+		uint32_t teapot{ 0 };
+		uint32_t sphere{ 0 };
+	} queries;
+	// Skip drawing objects that were occluded in the previous frame (VK_EXT_conditional_rendering)
+	bool conditionalRenderingSupported = false;
+	bool conditionalRendering = false;
+	VkPhysicalDeviceConditionalRenderingFeaturesEXT conditionalRenderingFeatures{};
 
 	// Passed query samples
 	uint64_t passedSamples[2] = { 1,1 };
@@ -77,39 +86,37 @@ public:
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 
-		vkDestroyQueryPool(device, queryPool, nullptr);
+		queryManager.destroy();
 
 		uniformBuffers.occluder.destroy();
 		uniformBuffers.sphere.destroy();
 		uniformBuffers.teapot.destroy();
 	}
 
-	// Create a query pool for storing the occlusion query result
-	void setupQueryPool()
+	void getEnabledExtensions()
+	{
+		// Conditional rendering is optional, the example falls back to only coloring occluded objects
+		conditionalRenderingSupported = vulkanDevice->extensionSupported(VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME);
+		if (conditionalRenderingSupported) {
+			enabledDeviceExtensions.push_back(VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME);
+			conditionalRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_CONDITIONAL_RENDERING_FEATURES_EXT;
+			conditionalRenderingFeatures.conditionalRendering = VK_TRUE;
+			deviceCreatepNextChain = &conditionalRenderingFeatures;
+		}
+	}
+
+	// One query pool per command buffer, so each can record and resolve its queries independently
+	void setupQueryManager()
 	{
-		VkQueryPoolCreateInfo queryPoolInfo = {};
-		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
-		queryPoolInfo.queryType = VK_QUERY_TYPE_OCCLUSION;
-		queryPoolInfo.queryCount = 2;
-		VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, NULL, &queryPool));
+		queryManager.create(vulkanDevice, queue, VK_QUERY_TYPE_OCCLUSION, static_cast<uint32_t>(drawCmdBuffers.size()), 2, conditionalRenderingSupported);
 	}
 
-	// Retrieves the results of the occlusion queries submitted to the command buffer
+	// Reads the results of the previous execution of the command buffer that's about to be submitted
+	// They were copied to a host visible buffer on the GPU, so this never waits for the queries
 	void getQueryResults()
 	{
-		// We use vkGetQueryResults to copy the results into a host visible buffer
-		vkGetQueryPoolResults(
-			device,
-			queryPool,
-			0,
-			2,
-			sizeof(passedSamples),
-			passedSamples,
-			sizeof(uint64_t),
-			// Store results a 64 bit values and wait until the results have been finished
-			// If you don't want to wait, you can use VK_QUERY_RESULT_WITH_AVAILABILITY_BIT
-			// which also returns the state of the result (ready) in the result
-			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+		passedSamples[0] = queryManager.getResult(currentBuffer, queries.teapot);
+		passedSamples[1] = queryManager.getResult(currentBuffer, queries.sphere);
 	}
 
 	void buildCommandBuffers()
@@ -136,9 +143,9 @@ public:
 
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
-			// Reset query pool
+			// Reset the queries of this command buffer
 			// Must be done outside of render pass
-			vkCmdResetQueryPool(drawCmdBuffers[i], queryPool, 0, 2);
+			queryManager.cmdBeginFrame(drawCmdBuffers[i], i);
 
 			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
@@ -166,16 +173,16 @@ public:
 			models.plane.draw(drawCmdBuffers[i]);
 
 			// Teapot
-			vkCmdBeginQuery(drawCmdBuffers[i], queryPool, 0, VK_FLAGS_NONE);
+			queries.teapot = queryManager.cmdBeginQuery(drawCmdBuffers[i], i);
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.teapot, 0, NULL);
 			models.teapot.draw(drawCmdBuffers[i]);
-			vkCmdEndQuery(drawCmdBuffers[i], queryPool, 0);
+			queryManager.cmdEndQuery(drawCmdBuffers[i], i, queries.teapot);
 
 			// Sphere
-			vkCmdBeginQuery(drawCmdBuffers[i], queryPool, 1, VK_FLAGS_NONE);
+			queries.sphere = queryManager.cmdBeginQuery(drawCmdBuffers[i], i);
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.sphere, 0, NULL);
 			models.sphere.draw(drawCmdBuffers[i]);
-			vkCmdEndQuery(drawCmdBuffers[i], queryPool, 1);
+			queryManager.cmdEndQuery(drawCmdBuffers[i], i, queries.sphere);
 
 			// Visible pass
 			// Clear color and depth attachments
@@ -203,12 +210,25 @@ public:
 			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.solid);
 
 			// Teapot
+			// With conditional rendering, objects that were occluded in the previous frame are skipped on the GPU
+			if (conditionalRendering) {
+				queryManager.cmdBeginConditionalRendering(drawCmdBuffers[i], queries.teapot);
+			}
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.teapot, 0, NULL);
 			models.teapot.draw(drawCmdBuffers[i]);
+			if (conditionalRendering) {
+				queryManager.cmdEndConditionalRendering(drawCmdBuffers[i]);
+			}
 
 			// Sphere
+			if (conditionalRendering) {
+				queryManager.cmdBeginConditionalRendering(drawCmdBuffers[i], queries.sphere);
+			}
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.sphere, 0, NULL);
 			models.sphere.draw(drawCmdBuffers[i]);
+			if (conditionalRendering) {
+				queryManager.cmdEndConditionalRendering(drawCmdBuffers[i]);
+			}
 
 			// Occluder
 			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.occluder);
@@ -219,6 +239,9 @@ public:
 
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
+			// Copy the query results for the host and for conditional rendering of the next frame
+			queryManager.cmdResolve(drawCmdBuffers[i], i);
+
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 		}
 	}
@@ -384,7 +407,7 @@ public:
 	{
 		VulkanExampleBase::prepare();
 		loadAssets();
-		setupQueryPool();
+		setupQueryManager();
 		prepareUniformBuffers();
 		setupDescriptors();
 		preparePipelines();
@@ -394,13 +417,13 @@ public:
 
 	void draw()
 	{
-		updateUniformBuffers();
 		VulkanExampleBase::prepareFrame();
+		// Results of the last execution of this command buffer are used to color occluded objects
+		getQueryResults();
+		updateUniformBuffers();
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
-		// Read query results for displaying in next frame
-		getQueryResults();
 		VulkanExampleBase::submitFrame();
 	}
 
@@ -413,6 +436,11 @@ public:
 
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
+		if (conditionalRenderingSupported && overlay->header("Settings")) {
+			if (overlay->checkBox("Skip occluded objects", &conditionalRendering)) {
+				buildCommandBuffers();
+			}
+		}
 		if (overlay->header("Occlusion query results")) {
 			overlay->text("Teapot: %d samples passed", passedSamples[0]);
 			overlay->text("Sphere: %d samples passed", passedSamples[1]);
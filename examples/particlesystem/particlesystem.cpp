@@ -1,7 +1,12 @@
 /*
-* Vulkan Example - CPU based particle system
-* 
-* This sample renders a particle system that is updated on the host (by the CPU) and rendered by the GPU using a vertex buffer
+* Vulkan Example - Particle system
+*
+* This sample renders a fire and smoke particle system that is either simulated on the GPU with compute shaders or on the host (by the CPU)
+* GPU: Dead particles are emitted again from a dead list, the simulation returns faded out particles to it and compacts the alive ones
+* into a list that's depth sorted with a bitonic sort and drawn indirectly. Random numbers are generated with a counter based hash,
+* so no random state needs to be stored per particle
+* CPU: Particles are stored as a structure of arrays and updated with SIMD instructions, then uploaded every frame and sorted on the GPU
+* Both simulations can be scaled to millions of particles, the UI shows the time spent in each stage
 *
 * Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
 *
@@ -10,8 +15,13 @@
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "VulkanQueryManager.h"
+#include "simd.hpp"
 
-#define PARTICLE_COUNT 512
+// Capacity of the particle buffers, has to be a power of two (the sort list is not padded further)
+#define MAX_PARTICLE_COUNT (1 << 21)
+// The host simulation uploads all particles every frame, which limits the number of particles it can handle
+#define MAX_CPU_PARTICLE_COUNT (1 << 20)
 
 #define FLAME_RADIUS 8.0f
 
@@ -20,15 +30,71 @@
 #define PARTICLE_TYPE_FLAME 0
 #define PARTICLE_TYPE_SMOKE 1
 
+// Particle as stored in the storage buffer used for simulation and rendering, matches shaders/glsl/particlesystem/particle.glsl
 struct Particle {
-	glm::vec4 pos;
-	glm::vec4 color;
+	// xyz = position, w = size
+	glm::vec4 position;
+	// xyz = velocity, w = rotation speed
+	glm::vec4 velocity;
+	float color;
 	float alpha;
-	float size;
 	float rotation;
 	uint32_t type;
-	glm::vec4 vel;
-	float rotationSpeed;
+	uint32_t alive;
+	uint32_t pad[3];
+};
+
+// View depth and index of an alive particle
+struct SortEntry {
+	float depth;
+	uint32_t index;
+};
+
+// Counters of the GPU simulation, also contains the arguments for the indirect emission dispatch and the indirect draw
+struct Counters {
+	uint32_t deadCount;
+	uint32_t emitCount;
+	uint32_t aliveCount;
+	uint32_t pad;
+	VkDispatchIndirectCommand emitDispatch;
+	uint32_t pad1;
+	VkDrawIndirectCommand drawArgs;
+};
+
+// Counter based random numbers (PCG hash), same as in the shaders
+// Every particle and frame gets its own sequence, which (unlike a shared engine) could also be generated in parallel
+static inline uint32_t pcgHash(uint32_t value)
+{
+	const uint32_t state = value * 747796405u + 2891336453u;
+	const uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+struct Random {
+	uint32_t state;
+	Random(uint32_t index, uint32_t frame) : state(pcgHash(index ^ pcgHash(frame))) {}
+	// Uniformly distributed in [0, range)
+	float operator()(float range)
+	{
+		state = pcgHash(state);
+		return float(state >> 8u) * (1.0f / 16777216.0f) * range;
+	}
+};
+
+// Host side particle state stored as a structure of arrays, so the update can process multiple particles per instruction
+struct ParticleArrays {
+	std::vector<float> positionX, positionY, positionZ;
+	std::vector<float> velocityX, velocityY, velocityZ;
+	std::vector<float> color, alpha, size, rotation, rotationSpeed;
+	std::vector<int32_t> type;
+
+	void resize(size_t count)
+	{
+		for (auto array : { &positionX, &positionY, &positionZ, &velocityX, &velocityY, &velocityZ, &color, &alpha, &size, &rotation, &rotationSpeed }) {
+			array->resize(count);
+		}
+		type.resize(count);
+	}
 };
 
 class VulkanExample : public VulkanExampleBase
@@ -54,28 +120,41 @@ public:
 	glm::vec3 minVel = glm::vec3(-3.0f, 0.5f, -3.0f);
 	glm::vec3 maxVel = glm::vec3(3.0f, 7.0f, 3.0f);
 
-	struct Particles {
-		VkBuffer buffer{ VK_NULL_HANDLE };
-		VkDeviceMemory memory{ VK_NULL_HANDLE };
-		// Store the mapped address of the particle data for reuse
-		void *mappedMemory;
-		// Size of the particle buffer in bytes
-		size_t size{ 0 };
-	} particles;
+	enum Backend : int32_t {
+		CPU = 0,
+		GPU = 1
+	};
+	int32_t backend = GPU;
+	const std::vector<uint32_t> particleCounts = { 512, 16384, 131072, 1048576, 2097152 };
+	int32_t particleCountIndex = 2;
+	bool depthSorting = true;
+
+	struct {
+		// Particles of both simulations (device local)
+		vks::Buffer particles;
+		// Indices of dead particles that are emitted again
+		vks::Buffer deadList;
+		// Alive particles with their view depth, sorted for rendering
+		vks::Buffer sortList;
+		vks::Buffer counters;
+		// Particles written by the host simulation (host visible), copied to the particle buffer every frame
+		vks::Buffer upload;
+	} buffers;
 
 	struct {
 		vks::Buffer particles;
 		vks::Buffer environment;
+		vks::Buffer simulation;
 	} uniformBuffers;
 
 	struct UniformDataParticles {
 		glm::mat4 projection;
 		glm::mat4 modelView;
-		// The viewport dimension is used by the particle system vertex shader 
+		// The viewport dimension is used by the particle system vertex shader
 		// to calculate the absolute point size based on the current viewport size
 		glm::vec2 viewportDim;
 		// This is the base point size for all particles
-		float pointSize{ 10.0f };
+		float pointSize{ 8.0f };
 	} uniformDataParticles;
 
 	struct UniformDataEnvironment {
@@ -85,32 +164,75 @@ public:
 		glm::vec4 lightPos = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
 	} uniformDataEnvironment;
 
+	struct UniformDataSimulation {
+		glm::mat4 modelView;
+		// xyz = position, w = radius
+		glm::vec4 emitter;
+		glm::vec4 minVel;
+		glm::vec4 maxVel;
+		float frameTimer;
+		uint32_t frame;
+		uint32_t particleCount;
+	} uniformDataSimulation;
+
+	// Mode selects the variant of the indirect argument, simulation and sort shaders, the others are only used by the sort
+	struct ComputePushConstants {
+		uint32_t mode;
+		uint32_t n;
+		uint32_t k;
+		uint32_t j;
+	};
+
 	struct {
 		VkPipeline particles{ VK_NULL_HANDLE };
 		VkPipeline environment{ VK_NULL_HANDLE };
+		VkPipeline indirect{ VK_NULL_HANDLE };
+		VkPipeline emit{ VK_NULL_HANDLE };
+		VkPipeline simulate{ VK_NULL_HANDLE };
+		VkPipeline sort{ VK_NULL_HANDLE };
 	} pipelines;
 
 	VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
 	VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
+	VkPipelineLayout computePipelineLayout{ VK_NULL_HANDLE };
+	VkDescriptorSetLayout computeDescriptorSetLayout{ VK_NULL_HANDLE };
 
 	struct {
 		VkDescriptorSet particles{ VK_NULL_HANDLE };
 		VkDescriptorSet environment{ VK_NULL_HANDLE };
+		VkDescriptorSet compute{ VK_NULL_HANDLE };
 	} descriptorSets;
 
-	std::vector<Particle> particleBuffer{};
+	ParticleArrays cpuParticles;
+	// Seeds the random numbers of both simulations
+	uint32_t simulationFrame{ 0 };
 
-	std::default_random_engine rndEngine;
+	// GPU times of the stages are measured with timestamps written before, between and after them
+	vks::QueryManager timestamps;
+	bool timestampsSupported{ false };
+	struct {
+		// Emission on the GPU, copying the host particles for the CPU simulation
+		float emit{ 0.0f };
+		float simulate{ 0.0f };
+		float sort{ 0.0f };
+		float render{ 0.0f };
+	} passTimes;
+	struct {
+		float simulate{ 0.0f };
+		float upload{ 0.0f };
+	} cpuTimes;
 
 	VulkanExample() : VulkanExampleBase()
 	{
-		title = "CPU based particle system";
+		title = "Particle system";
+		// The GPU simulation and depth sorting only have GLSL shaders
+		requireGlslShaders();
 		camera.type = Camera::CameraType::lookat;
 		camera.setPosition(glm::vec3(0.0f, 0.0f, -75.0f));
 		camera.setRotation(glm::vec3(-15.0f, 45.0f, 0.0f));
 		camera.setPerspective(60.0f, (float)width / (float)height, 1.0f, 256.0f);
 		timerSpeed *= 8.0f;
-		rndEngine.seed(benchmark.active ? 0 : (unsigned)time(nullptr));
+		simulationFrame = benchmark.active ? 0 : (uint32_t)time(nullptr);
 	}
 
 	~VulkanExample()
@@ -123,16 +245,29 @@ public:
 
 			vkDestroyPipeline(device, pipelines.particles, nullptr);
 			vkDestroyPipeline(device, pipelines.environment, nullptr);
+			vkDestroyPipeline(device, pipelines.indirect, nullptr);
+			vkDestroyPipeline(device, pipelines.emit, nullptr);
+			vkDestroyPipeline(device, pipelines.simulate, nullptr);
+			vkDestroyPipeline(device, pipelines.sort, nullptr);
 
 			vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 			vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+			vkDestroyPipelineLayout(device, computePipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(device, computeDescriptorSetLayout, nullptr);
 
-			vkUnmapMemory(device, particles.memory);
-			vkDestroyBuffer(device, particles.buffer, nullptr);
-			vkFreeMemory(device, particles.memory, nullptr);
+			buffers.particles.destroy();
+			buffers.deadList.destroy();
+			buffers.sortList.destroy();
+			buffers.counters.destroy();
+			buffers.upload.destroy();
 
 			uniformBuffers.environment.destroy();
 			uniformBuffers.particles.destroy();
+			uniformBuffers.simulation.destroy();
+
+			if (timestampsSupported) {
+				timestamps.destroy();
+			}
 
 			vkDestroySampler(device, textures.particles.sampler, nullptr);
 		}
@@ -146,6 +281,50 @@ public:
 		};
 	}
 
+	uint32_t particleCount() const
+	{
+		return particleCounts[particleCountIndex];
+	}
+
+	// Make the results of a compute pass visible to the following stages
+	void computeBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask)
+	{
+		VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = dstAccessMask;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStageMask, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	void dispatch(VkCommandBuffer commandBuffer, VkPipeline pipeline, const ComputePushConstants& pushConstants, uint32_t groupCount)
+	{
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		vkCmdPushConstants(commandBuffer, computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &pushConstants);
+		vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+	}
+
+	// Bitonic sort of the list of alive particles, padded to a power of two
+	// Steps with distances below 1024 entries are done in shared memory, only the larger ones need a dispatch each
+	void recordSort(VkCommandBuffer commandBuffer)
+	{
+		const uint32_t blockSize = 1024;
+		uint32_t n = blockSize;
+		while (n < particleCount()) {
+			n <<= 1;
+		}
+		const VkPipelineStageFlags computeStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		const VkAccessFlags computeAccess = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		dispatch(commandBuffer, pipelines.sort, { 0, n, 0, 0 }, n / blockSize);
+		computeBarrier(commandBuffer, computeStage, computeAccess);
+		for (uint32_t k = blockSize * 2; k <= n; k <<= 1) {
+			for (uint32_t j = k >> 1; j >= blockSize; j >>= 1) {
+				dispatch(commandBuffer, pipelines.sort, { 1, n, k, j }, n / blockSize);
+				computeBarrier(commandBuffer, computeStage, computeAccess);
+			}
+			dispatch(commandBuffer, pipelines.sort, { 2, n, k, 0 }, n / blockSize);
+			computeBarrier(commandBuffer, computeStage, computeAccess);
+		}
+	}
+
 	void buildCommandBuffers()
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
@@ -163,6 +342,9 @@ public:
 		renderPassBeginInfo.clearValueCount = 2;
 		renderPassBeginInfo.pClearValues = clearValues;
 
+		const VkPipelineStageFlags computeStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		const VkAccessFlags computeAccess = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
 		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
 		{
 			// Set target frame buffer
@@ -170,6 +352,55 @@ public:
 
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
+			if (timestampsSupported) {
+				timestamps.cmdBeginFrame(drawCmdBuffers[i], i);
+				timestamps.cmdWriteTimestamp(drawCmdBuffers[i], i, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+			}
+
+			// The particle buffers must no longer be read by the previous frame's draw
+			vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | computeStage, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout, 0, 1, &descriptorSets.compute, 0, nullptr);
+
+			// Emission arguments, also resets the number of alive particles
+			dispatch(drawCmdBuffers[i], pipelines.indirect, { 0, 0, 0, 0 }, 1);
+			computeBarrier(drawCmdBuffers[i], computeStage | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, computeAccess | VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+
+			if (backend == GPU) {
+				// Emit new particles into the slots of dead ones
+				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.emit);
+				vkCmdDispatchIndirect(drawCmdBuffers[i], buffers.counters.buffer, offsetof(Counters, emitDispatch));
+				computeBarrier(drawCmdBuffers[i], computeStage, computeAccess);
+			} else {
+				// Copy the particles simulated on the host
+				VkBufferCopy copyRegion = { 0, 0, VkDeviceSize(particleCount()) * sizeof(Particle) };
+				vkCmdCopyBuffer(drawCmdBuffers[i], buffers.upload.buffer, buffers.particles.buffer, 1, &copyRegion);
+				VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+				memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				memoryBarrier.dstAccessMask = computeAccess;
+				vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_TRANSFER_BIT, computeStage, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			}
+			if (timestampsSupported) {
+				timestamps.cmdWriteTimestamp(drawCmdBuffers[i], i, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+			}
+
+			// Simulate (GPU only) and compact the alive particles into the sort list, then write the draw arguments
+			dispatch(drawCmdBuffers[i], pipelines.simulate, { backend == GPU ? 1u : 0u, 0, 0, 0 }, (particleCount() + 255) / 256);
+			computeBarrier(drawCmdBuffers[i], computeStage, computeAccess);
+			dispatch(drawCmdBuffers[i], pipelines.indirect, { 1, 0, 0, 0 }, 1);
+			computeBarrier(drawCmdBuffers[i], computeStage, computeAccess);
+			if (timestampsSupported) {
+				timestamps.cmdWriteTimestamp(drawCmdBuffers[i], i, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+			}
+
+			if (depthSorting) {
+				recordSort(drawCmdBuffers[i]);
+			}
+			computeBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+			if (timestampsSupported) {
+				timestamps.cmdWriteTimestamp(drawCmdBuffers[i], i, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+			}
+
 			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
@@ -178,140 +409,207 @@ public:
 			VkRect2D scissor = vks::initializers::rect2D(width, height, 0,0);
 			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
-			VkDeviceSize offsets[1] = { 0 };
-
 			// Environment
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.environment, 0, nullptr);
 			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.environment);
 			environment.draw(drawCmdBuffers[i]);
 
-			// Particle system (no index buffer)
+			// Particle system, the vertex shader fetches the particles in sorted order from the storage buffers
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.particles, 0, nullptr);
 			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.particles);
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1, &particles.buffer, offsets);
-			vkCmdDraw(drawCmdBuffers[i], static_cast<uint32_t>(particleBuffer.size()), 1, 0, 0);
+			vkCmdDrawIndirect(drawCmdBuffers[i], buffers.counters.buffer, offsetof(Counters, drawArgs), 1, sizeof(VkDrawIndirectCommand));
+
+			if (timestampsSupported) {
+				timestamps.cmdWriteTimestamp(drawCmdBuffers[i], i, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+			}
 
 			drawUI(drawCmdBuffers[i]);
 
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
+			if (timestampsSupported) {
+				timestamps.cmdResolve(drawCmdBuffers[i], i);
+			}
+
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 		}
 	}
 
-	float rnd(float range)
+	void initParticle(uint32_t index, Random& rnd)
 	{
-		std::uniform_real_distribution<float> rndDist(0.0f, range);
-		return rndDist(rndEngine);
-	}
-
-	void initParticle(Particle *particle, glm::vec3 emitterPos)
-	{
-		particle->vel = glm::vec4(0.0f, minVel.y + rnd(maxVel.y - minVel.y), 0.0f, 0.0f);
-		particle->alpha = rnd(0.75f);
-		particle->size = 1.0f + rnd(0.5f);
-		particle->color = glm::vec4(1.0f);
-		particle->type = PARTICLE_TYPE_FLAME;
-		particle->rotation = rnd(2.0f * float(M_PI));
-		particle->rotationSpeed = rnd(2.0f) - rnd(2.0f);
+		ParticleArrays& p = cpuParticles;
+		p.velocityX[index] = 0.0f;
+		p.velocityY[index] = minVel.y + rnd(maxVel.y - minVel.y);
+		p.velocityZ[index] = 0.0f;
+		p.alpha[index] = rnd(0.75f);
+		p.size[index] = 1.0f + rnd(0.5f);
+		p.color[index] = 1.0f;
+		p.type[index] = PARTICLE_TYPE_FLAME;
+		p.rotation[index] = rnd(2.0f * float(M_PI));
+		p.rotationSpeed[index] = rnd(2.0f) - rnd(2.0f);
 
 		// Get random sphere point
 		float theta = rnd(2.0f * float(M_PI));
 		float phi = rnd(float(M_PI)) - float(M_PI) / 2.0f;
 		float r = rnd(FLAME_RADIUS);
 
-		particle->pos.x = r * cos(theta) * cos(phi);
-		particle->pos.y = r * sin(phi);
-		particle->pos.z = r * sin(theta) * cos(phi);
-
-		particle->pos += glm::vec4(emitterPos, 0.0f);
+		p.positionX[index] = emitterPos.x + r * cos(theta) * cos(phi);
+		p.positionY[index] = emitterPos.y + r * sin(phi);
+		p.positionZ[index] = emitterPos.z + r * sin(theta) * cos(phi);
 	}
 
 	// Change the type of a particle, e.g. from flame to smoke
-	void transitionParticle(Particle *particle)
+	void transitionParticle(uint32_t index)
 	{
-		switch (particle->type)
+		ParticleArrays& p = cpuParticles;
+		Random rnd(index, simulationFrame ^ 0x80000000u);
+		switch (p.type[index])
 		{
 		case PARTICLE_TYPE_FLAME:
 			// Flame particles have a chance of turning into smoke
 			if (rnd(1.0f) < 0.05f)
 			{
-				particle->alpha = 0.0f;
-				particle->color = glm::vec4(0.25f + rnd(0.25f));
-				particle->pos.x *= 0.5f;
-				particle->pos.z *= 0.5f;
-				particle->vel = glm::vec4(rnd(1.0f) - rnd(1.0f), (minVel.y * 2) + rnd(maxVel.y - minVel.y), rnd(1.0f) - rnd(1.0f), 0.0f);
-				particle->size = 1.0f + rnd(0.5f);
-				particle->rotationSpeed = rnd(1.0f) - rnd(1.0f);
-				particle->type = PARTICLE_TYPE_SMOKE;
+				p.alpha[index] = 0.0f;
+				p.color[index] = 0.25f + rnd(0.25f);
+				p.positionX[index] *= 0.5f;
+				p.positionZ[index] *= 0.5f;
+				p.velocityX[index] = rnd(1.0f) - rnd(1.0f);
+				p.velocityY[index] = (minVel.y * 2) + rnd(maxVel.y - minVel.y);
+				p.velocityZ[index] = rnd(1.0f) - rnd(1.0f);
+				p.size[index] = 1.0f + rnd(0.5f);
+				p.rotationSpeed[index] = rnd(1.0f) - rnd(1.0f);
+				p.type[index] = PARTICLE_TYPE_SMOKE;
 			}
 			else
 			{
-				initParticle(particle, emitterPos);
+				initParticle(index, rnd);
 			}
 			break;
 		case PARTICLE_TYPE_SMOKE:
 			// Respawn at end of life
-			initParticle(particle, emitterPos);
+			initParticle(index, rnd);
 			break;
 		}
 	}
 
-	// Initialize the particle system and create a vertex buffer for rendering the particles
+	// Create the buffers for the maximum number of particles, so changing the count doesn't require new descriptors
 	void prepareParticles()
 	{
-		particleBuffer.resize(PARTICLE_COUNT);
-		for (auto& particle : particleBuffer)
-		{
-			initParticle(&particle, emitterPos);
-			particle.alpha = 1.0f - (abs(particle.pos.y) / (FLAME_RADIUS * 2.0f));
-		}
-
-		particles.size = particleBuffer.size() * sizeof(Particle);
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &buffers.particles, MAX_PARTICLE_COUNT * sizeof(Particle)));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &buffers.deadList, MAX_PARTICLE_COUNT * sizeof(uint32_t)));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &buffers.sortList, MAX_PARTICLE_COUNT * sizeof(SortEntry)));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &buffers.counters, sizeof(Counters)));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &buffers.upload, MAX_CPU_PARTICLE_COUNT * sizeof(Particle)));
+		VK_CHECK_RESULT(buffers.upload.map());
+		resetParticles();
+	}
 
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			particles.size,
-			&particles.buffer,
-			&particles.memory,
-			particleBuffer.data()));
+	// Restart the simulation of the current backend with the current particle count
+	void resetParticles()
+	{
+		vkDeviceWaitIdle(device);
+		const uint32_t count = particleCount();
+		Counters counters{};
+
+		if (backend == GPU) {
+			// All particles start dead and are emitted in the first frame
+			counters.deadCount = count;
+			std::vector<uint32_t> deadList(count);
+			for (uint32_t i = 0; i < count; i++) {
+				deadList[i] = i;
+			}
+			vks::Buffer stagingBuffer;
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, count * sizeof(uint32_t), deadList.data()));
+			VkCommandBuffer commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			vkCmdFillBuffer(commandBuffer, buffers.particles.buffer, 0, VK_WHOLE_SIZE, 0);
+			VkBufferCopy copyRegion = { 0, 0, stagingBuffer.size };
+			vkCmdCopyBuffer(commandBuffer, stagingBuffer.buffer, buffers.deadList.buffer, 1, &copyRegion);
+			vkCmdUpdateBuffer(commandBuffer, buffers.counters.buffer, 0, sizeof(Counters), &counters);
+			vulkanDevice->flushCommandBuffer(commandBuffer, queue, true);
+			stagingBuffer.destroy();
+		} else {
+			cpuParticles.resize(count);
+			for (uint32_t i = 0; i < count; i++) {
+				Random rnd(i, simulationFrame);
+				initParticle(i, rnd);
+				cpuParticles.alpha[i] = 1.0f - (abs(cpuParticles.positionY[i]) / (FLAME_RADIUS * 2.0f));
+			}
+			uploadParticles();
+			VkCommandBuffer commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			vkCmdUpdateBuffer(commandBuffer, buffers.counters.buffer, 0, sizeof(Counters), &counters);
+			vulkanDevice->flushCommandBuffer(commandBuffer, queue, true);
+		}
 
-		// Map the memory and store the pointer for reuse
-		VK_CHECK_RESULT(vkMapMemory(device, particles.memory, 0, particles.size, 0, &particles.mappedMemory));
+		// Keep the amount of blended coverage roughly the same for all particle counts
+		uniformDataParticles.pointSize = 8.0f * std::min(sqrt(512.0f / (float)count), 1.0f);
 	}
 
-	// Update the state of all particles
+	// Update the state of all particles on the host
 	void updateParticles()
 	{
-		float particleTimer = frameTimer * 0.45f;
-		for (auto& particle : particleBuffer)
-		{
-			switch (particle.type)
-			{
-			case PARTICLE_TYPE_FLAME:
-				particle.pos.y -= particle.vel.y * particleTimer * 3.5f;
-				particle.alpha += particleTimer * 2.5f;
-				particle.size -= particleTimer * 0.5f;
-				break;
-			case PARTICLE_TYPE_SMOKE:
-				particle.pos -= particle.vel * frameTimer * 1.0f;
-				particle.alpha += particleTimer * 1.25f;
-				particle.size += particleTimer * 0.125f;
-				particle.color -= particleTimer * 0.05f;
-				break;
-			}
-			particle.rotation += particleTimer * particle.rotationSpeed;
-			// If a particle has faded out, turn it into the other type (e.g. flame to smoke and vice versa)
-			if (particle.alpha > 2.0f)
-			{
-				transitionParticle(&particle);
+		ParticleArrays& p = cpuParticles;
+		const uint32_t count = particleCount();
+		const float particleTimer = frameTimer * 0.45f;
+		// Flames only move up, smoke moves along its velocity
+		const float flameMoveY = particleTimer * 3.5f;
+		const float flameAlpha = particleTimer * 2.5f;
+		const float flameSize = -particleTimer * 0.5f;
+		const float smokeAlpha = particleTimer * 1.25f;
+		const float smokeSize = particleTimer * 0.125f;
+		const float smokeColor = particleTimer * 0.05f;
+
+		uint32_t i = 0;
+#if !defined(VKS_SIMD_NONE)
+		// The type only selects the rates, so all particles take the same path
+		const simd::vint smokeType = simd::seti(PARTICLE_TYPE_SMOKE);
+		const simd::vfloat zero = simd::set(0.0f);
+		for (; i + simd::width <= count; i += simd::width) {
+			const simd::vint smoke = simd::equal(simd::loadi(&p.type[i]), smokeType);
+			const simd::vfloat moveXZ = simd::select(smoke, simd::set(frameTimer), zero);
+			const simd::vfloat moveY = simd::select(smoke, simd::set(frameTimer), simd::set(flameMoveY));
+			simd::store(&p.positionX[i], simd::sub(simd::load(&p.positionX[i]), simd::mul(simd::load(&p.velocityX[i]), moveXZ)));
+			simd::store(&p.positionY[i], simd::sub(simd::load(&p.positionY[i]), simd::mul(simd::load(&p.velocityY[i]), moveY)));
+			simd::store(&p.positionZ[i], simd::sub(simd::load(&p.positionZ[i]), simd::mul(simd::load(&p.velocityZ[i]), moveXZ)));
+			simd::store(&p.alpha[i], simd::add(simd::load(&p.alpha[i]), simd::select(smoke, simd::set(smokeAlpha), simd::set(flameAlpha))));
+			simd::store(&p.size[i], simd::add(simd::load(&p.size[i]), simd::select(smoke, simd::set(smokeSize), simd::set(flameSize))));
+			simd::store(&p.color[i], simd::sub(simd::load(&p.color[i]), simd::select(smoke, simd::set(smokeColor), zero)));
+			simd::store(&p.rotation[i], simd::add(simd::load(&p.rotation[i]), simd::mul(simd::load(&p.rotationSpeed[i]), simd::set(particleTimer))));
+		}
+#endif
+		// Remaining particles (or all of them if no SIMD instruction set is available)
+		for (; i < count; i++) {
+			const bool smoke = (p.type[i] == PARTICLE_TYPE_SMOKE);
+			p.positionX[i] -= p.velocityX[i] * (smoke ? frameTimer : 0.0f);
+			p.positionY[i] -= p.velocityY[i] * (smoke ? frameTimer : flameMoveY);
+			p.positionZ[i] -= p.velocityZ[i] * (smoke ? frameTimer : 0.0f);
+			p.alpha[i] += smoke ? smokeAlpha : flameAlpha;
+			p.size[i] += smoke ? smokeSize : flameSize;
+			p.color[i] -= smoke ? smokeColor : 0.0f;
+			p.rotation[i] += p.rotationSpeed[i] * particleTimer;
+		}
+
+		// If a particle has faded out, turn it into the other type (e.g. flame to smoke and vice versa)
+		for (i = 0; i < count; i++) {
+			if (p.alpha[i] > 2.0f) {
+				transitionParticle(i);
 			}
 		}
-		
-		// Copy the updated particles to the vertex buffer
-		size_t size = particleBuffer.size() * sizeof(Particle);
-		memcpy(particles.mappedMemory, particleBuffer.data(), size);
+	}
+
+	// Write the host particles to the upload buffer in the layout used by the shaders
+	void uploadParticles()
+	{
+		const ParticleArrays& p = cpuParticles;
+		Particle* dst = static_cast<Particle*>(buffers.upload.mapped);
+		for (uint32_t i = 0; i < particleCount(); i++) {
+			dst[i].position = glm::vec4(p.positionX[i], p.positionY[i], p.positionZ[i], p.size[i]);
+			dst[i].velocity = glm::vec4(p.velocityX[i], p.velocityY[i], p.velocityZ[i], p.rotationSpeed[i]);
+			dst[i].color = p.color[i];
+			dst[i].alpha = p.alpha[i];
+			dst[i].rotation = p.rotation[i];
+			dst[i].type = p.type[i];
+			dst[i].alive = 1;
+		}
 	}
 
 	void loadAssets()
@@ -355,14 +653,23 @@ public:
 		environment.loadFromFile(getAssetPath() + "models/fireplace.gltf", vulkanDevice, queue, glTFLoadingFlags);
 	}
 
+	void prepareTimestamps()
+	{
+		timestampsSupported = (vulkanDevice->properties.limits.timestampComputeAndGraphics == VK_TRUE) && (vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].timestampValidBits > 0);
+		if (timestampsSupported) {
+			timestamps.create(vulkanDevice, queue, VK_QUERY_TYPE_TIMESTAMP, static_cast<uint32_t>(drawCmdBuffers.size()), 5);
+		}
+	}
+
 	void setupDescriptors()
 	{
 		// Pool
 		std::vector<VkDescriptorPoolSize> poolSizes = {
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6)
 		};
-		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 2);
+		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 3);
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 
 		// Layout
@@ -372,11 +679,31 @@ public:
 			// Binding 1 : Fragment shader image sampler
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),
 			// Binding 1 : Fragment shader image sampler
-			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT,2)
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT,2),
+			// Binding 3 : Particles
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 3),
+			// Binding 4 : Sorted list of alive particles
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 4)
 		};
 		VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &descriptorSetLayout));
-		
+
+		// Compute layout
+		setLayoutBindings = {
+			// Binding 0 : Particles
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			// Binding 1 : Dead list
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+			// Binding 2 : Sort list
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+			// Binding 3 : Counters and indirect arguments
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+			// Binding 4 : Simulation parameters
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4)
+		};
+		descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &computeDescriptorSetLayout));
+
 		// Sets
 		std::vector<VkWriteDescriptorSet> writeDescriptorSets;
 
@@ -394,7 +721,11 @@ public:
 			// Binding 1: Smoke texture
 			vks::initializers::writeDescriptorSet(descriptorSets.particles, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &texDescriptorSmoke),
 			// Binding 1: Fire texture array
-			vks::initializers::writeDescriptorSet(descriptorSets.particles, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &texDescriptorFire)
+			vks::initializers::writeDescriptorSet(descriptorSets.particles, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &texDescriptorFire),
+			// Binding 3: Particles
+			vks::initializers::writeDescriptorSet(descriptorSets.particles, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &buffers.particles.descriptor),
+			// Binding 4: Sorted list of alive particles
+			vks::initializers::writeDescriptorSet(descriptorSets.particles, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &buffers.sortList.descriptor)
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 
@@ -409,6 +740,18 @@ public:
 			vks::initializers::writeDescriptorSet(descriptorSets.environment, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &textures.floor.normalMap.descriptor),
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+		// Compute
+		allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &computeDescriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets.compute));
+		writeDescriptorSets = {
+			vks::initializers::writeDescriptorSet(descriptorSets.compute, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &buffers.particles.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSets.compute, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &buffers.deadList.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSets.compute, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &buffers.sortList.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSets.compute, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &buffers.counters.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSets.compute, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4, &uniformBuffers.simulation.descriptor),
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 	}
 
 	void preparePipelines()
@@ -442,25 +785,8 @@ public:
 
 		// Particle rendering pipeline
 		{
-			// Vertex input state
-			VkVertexInputBindingDescription vertexInputBinding =
-				vks::initializers::vertexInputBindingDescription(0, sizeof(Particle), VK_VERTEX_INPUT_RATE_VERTEX);
-
-			std::vector<VkVertexInputAttributeDescription> vertexInputAttributes = {
-				vks::initializers::vertexInputAttributeDescription(0, 0, VK_FORMAT_R32G32B32A32_SFLOAT,	offsetof(Particle, pos)),	// Location 0: Position
-				vks::initializers::vertexInputAttributeDescription(0, 1, VK_FORMAT_R32G32B32A32_SFLOAT,	offsetof(Particle, color)),	// Location 1: Color
-				vks::initializers::vertexInputAttributeDescription(0, 2, VK_FORMAT_R32_SFLOAT, offsetof(Particle, alpha)),			// Location 2: Alpha
-				vks::initializers::vertexInputAttributeDescription(0, 3, VK_FORMAT_R32_SFLOAT, offsetof(Particle, size)),			// Location 3: Size
-				vks::initializers::vertexInputAttributeDescription(0, 4, VK_FORMAT_R32_SFLOAT, offsetof(Particle, rotation)),		// Location 4: Rotation
-				vks::initializers::vertexInputAttributeDescription(0, 5, VK_FORMAT_R32_SINT, offsetof(Particle, type)),				// Location 5: Particle type
-			};
-
+			// Empty vertex input state, particles are fetched from the storage buffers
 			VkPipelineVertexInputStateCreateInfo vertexInputState = vks::initializers::pipelineVertexInputStateCreateInfo();
-			vertexInputState.vertexBindingDescriptionCount = 1;
-			vertexInputState.pVertexBindingDescriptions = &vertexInputBinding;
-			vertexInputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexInputAttributes.size());
-			vertexInputState.pVertexAttributeDescriptions = vertexInputAttributes.data();
-
 			pipelineCI.pVertexInputState = &vertexInputState;
 
 			// Don t' write to depth buffer
@@ -494,6 +820,27 @@ public:
 			shaderStages[1] = loadShader(getShadersPath() + "particlesystem/normalmap.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
 			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.environment));
 		}
+
+		// Compute pipelines for the simulation and sorting, they share a layout and select their variant with a push constant
+		{
+			VkPipelineLayoutCreateInfo computePipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(&computeDescriptorSetLayout, 1);
+			VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(ComputePushConstants), 0);
+			computePipelineLayoutCI.pushConstantRangeCount = 1;
+			computePipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device, &computePipelineLayoutCI, nullptr, &computePipelineLayout));
+
+			VkComputePipelineCreateInfo computePipelineCI = vks::initializers::computePipelineCreateInfo(computePipelineLayout, 0);
+			const std::vector<std::pair<std::string, VkPipeline*>> computeShaders = {
+				{ "indirect", &pipelines.indirect },
+				{ "emit", &pipelines.emit },
+				{ "simulate", &pipelines.simulate },
+				{ "bitonicsort", &pipelines.sort },
+			};
+			for (auto& computeShader : computeShaders) {
+				computePipelineCI.stage = loadShader(getShadersPath() + "particlesystem/" + computeShader.first + ".comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+				VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCI, nullptr, computeShader.second));
+			}
+		}
 	}
 
 	// Prepare and initialize uniform buffer containing shader uniforms
@@ -503,9 +850,12 @@ public:
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffers.particles, sizeof(UniformDataParticles)));
 		// Vertex shader uniform buffer block
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffers.environment, sizeof(UniformDataEnvironment)));
+		// Compute shader uniform buffer block
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffers.simulation, sizeof(UniformDataSimulation)));
 		// Map persistent
 		VK_CHECK_RESULT(uniformBuffers.particles.map());
 		VK_CHECK_RESULT(uniformBuffers.environment.map());
+		VK_CHECK_RESULT(uniformBuffers.simulation.map());
 	}
 
 	void updateUniformBuffers()
@@ -516,6 +866,16 @@ public:
 		uniformDataParticles.viewportDim = glm::vec2((float)width, (float)height);
 		memcpy(uniformBuffers.particles.mapped, &uniformDataParticles, sizeof(UniformDataParticles));
 
+		// Simulation, a paused simulation only sorts the particles
+		uniformDataSimulation.modelView = camera.matrices.view;
+		uniformDataSimulation.emitter = glm::vec4(emitterPos, FLAME_RADIUS);
+		uniformDataSimulation.minVel = glm::vec4(minVel, 0.0f);
+		uniformDataSimulation.maxVel = glm::vec4(maxVel, 0.0f);
+		uniformDataSimulation.frameTimer = paused ? 0.0f : frameTimer;
+		uniformDataSimulation.frame = simulationFrame;
+		uniformDataSimulation.particleCount = particleCount();
+		memcpy(uniformBuffers.simulation.mapped, &uniformDataSimulation, sizeof(UniformDataSimulation));
+
 		// Environment
 		uniformDataEnvironment.projection = camera.matrices.perspective;
 		uniformDataEnvironment.modelView = camera.matrices.view;
@@ -535,6 +895,7 @@ public:
 		loadAssets();
 		prepareParticles();
 		prepareUniformBuffers();
+		prepareTimestamps();
 		setupDescriptors();
 		preparePipelines();
 		buildCommandBuffers();
@@ -544,6 +905,14 @@ public:
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
+		// The previous submission of this command buffer has finished, so its timestamps can be read without waiting
+		if (timestampsSupported) {
+			const float period = vulkanDevice->properties.limits.timestampPeriod / 1000000.0f;
+			passTimes.emit = (timestamps.getResult(currentBuffer, 1) - timestamps.getResult(currentBuffer, 0)) * period;
+			passTimes.simulate = (timestamps.getResult(currentBuffer, 2) - timestamps.getResult(currentBuffer, 1)) * period;
+			passTimes.sort = (timestamps.getResult(currentBuffer, 3) - timestamps.getResult(currentBuffer, 2)) * period;
+			passTimes.render = (timestamps.getResult(currentBuffer, 4) - timestamps.getResult(currentBuffer, 3)) * period;
+		}
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
@@ -554,12 +923,59 @@ public:
 	{
 		if (!prepared)
 			return;
-		updateUniformBuffers();
 		if (!paused) {
+			simulationFrame++;
+		}
+		updateUniformBuffers();
+		// The previous frame has finished, so the upload buffer can be overwritten
+		if ((backend == CPU) && !paused) {
+			auto tStart = std::chrono::high_resolution_clock::now();
 			updateParticles();
+			auto tUpdated = std::chrono::high_resolution_clock::now();
+			uploadParticles();
+			auto tEnd = std::chrono::high_resolution_clock::now();
+			cpuTimes.simulate = std::chrono::duration<float, std::milli>(tUpdated - tStart).count();
+			cpuTimes.upload = std::chrono::duration<float, std::milli>(tEnd - tUpdated).count();
 		}
 		draw();
 	}
+
+	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
+	{
+		if (overlay->header("Settings")) {
+			if (overlay->comboBox("Simulation", &backend, { "CPU (" VKS_SIMD_NAME ")", "GPU (compute)" })) {
+				// The host simulation uploads all particles every frame, so it supports fewer of them
+				while ((backend == CPU) && (particleCount() > MAX_CPU_PARTICLE_COUNT)) {
+					particleCountIndex--;
+				}
+				resetParticles();
+			}
+			std::vector<std::string> countNames;
+			for (auto count : particleCounts) {
+				countNames.push_back(std::to_string(count));
+			}
+			int32_t index = particleCountIndex;
+			if (overlay->comboBox("Particles", &index, countNames)) {
+				if ((backend == GPU) || (particleCounts[index] <= MAX_CPU_PARTICLE_COUNT)) {
+					particleCountIndex = index;
+					resetParticles();
+				}
+			}
+			overlay->checkBox("Depth sorting", &depthSorting);
+		}
+		if (overlay->header("Timings")) {
+			if (backend == CPU) {
+				overlay->text("CPU simulation: %.2f ms", cpuTimes.simulate);
+				overlay->text("CPU upload: %.2f ms", cpuTimes.upload);
+			}
+			if (timestampsSupported) {
+				overlay->text("%s: %.2f ms", (backend == GPU) ? "Emission" : "Copy", passTimes.emit);
+				overlay->text("%s: %.2f ms", (backend == GPU) ? "Simulation" : "Compaction", passTimes.simulate);
+				overlay->text("Sorting: %.2f ms", passTimes.sort);
+				overlay->text("Rendering: %.2f ms", passTimes.render);
+			}
+		}
+	}
 };
 
 VULKAN_EXAMPLE_MAIN()
@@ -35,6 +35,7 @@
 #endif
 #include <vulkan/vulkan.h>
 #include "VulkanTools.h"
+#include "VulkanFrameCapture.h"
 #include "CommandLineParser.hpp"
 
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
@@ -857,33 +858,8 @@ public:
 #else
 			const char* filename = "headless.ppm";
 #endif
-			std::ofstream file(filename, std::ios::out | std::ios::binary);
-
-			// ppm header
-			file << "P6\n" << width << "\n" << height << "\n" << 255 << "\n";
-
-			// If source is BGR (destination is always RGB) and we can't use blit (which does automatic conversion), we'll have to manually swizzle color components
-			// Check if source is BGR and needs swizzle
-			std::vector<VkFormat> formatsBGR = { VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_B8G8R8A8_UNORM, VK_FORMAT_B8G8R8A8_SNORM };
-			const bool colorSwizzle = (std::find(formatsBGR.begin(), formatsBGR.end(), VK_FORMAT_R8G8B8A8_UNORM) != formatsBGR.end());
-
-			// ppm binary pixel data
-			for (int32_t y = 0; y < height; y++) {
-				unsigned int *row = (unsigned int*)imagedata;
-				for (int32_t x = 0; x < width; x++) {
-					if (colorSwizzle) {
-						file.write((char*)row + 2, 1);
-						file.write((char*)row + 1, 1);
-						file.write((char*)row, 1);
-					}
-					else {
-						file.write((char*)row, 3);
-					}
-					row++;
-				}
-				imagedata += subResourceLayout.rowPitch;
-			}
-			file.close();
+			// The framebuffer uses VK_FORMAT_R8G8B8A8_UNORM, so the color components don't need to be swizzled
+			vks::FrameCapture::writeImage(filename, reinterpret_cast<const uint8_t*>(imagedata), width, height, subResourceLayout.rowPitch, false);
 
 			LOG("Framebuffer image saved to %s\n", filename);
 
@@ -11,12 +11,19 @@
 	This results in a better shadow map resolution distribution that can be tweaked even further by increasing
 	the number of frustum splits.
 
-	A further optimization could be done using a geometry shader to do a single-pass render for the depth map
-	cascades instead of multiple passes (geometry shaders are not supported on all target devices).
+	All cascades are rendered in a single layered render pass with a geometry shader (see vks::LayeredShadowMap), casters are
+	culled against the cascade frustums on the CPU so the geometry shader only outputs them to cascades they can be seen in.
+	Devices without geometry shader support render one pass per cascade instead. The depth of the static casters (terrain and trees)
+	is cached and only re-rendered when the cascades change (i.e. when the camera or the light moves), while the dynamic caster
+	(a tree moving around the scene) is rendered on top of the cached depth every frame.
 */
 
+#include <bitset>
+
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "VulkanLayeredShadowMap.h"
+#include "VulkanQueryManager.h"
 
 #if defined(__ANDROID__)
 #define SHADOWMAP_DIM 2048
@@ -33,6 +40,10 @@ public:
 	int32_t displayDepthMapCascadeIndex = 0;
 	bool colorCascades = false;
 	bool filterPCF = false;
+	bool animateLight = true;
+	bool animateCaster = true;
+	// Cull shadow casters against the frustums of the cascades
+	bool perCascadeCulling = true;
 
 	float cascadeSplitLambda = 0.95f;
 
@@ -80,47 +91,76 @@ public:
 	struct PushConstBlock {
 		glm::vec4 position;
 		uint32_t cascadeIndex;
+		// Cascades the caster is visible in, only used by the depth pass geometry shader
+		uint32_t cascadeMask;
 	};
 
 	// Resources of the depth map generation pass
 	struct DepthPass {
-		VkRenderPass renderPass;
 		VkPipelineLayout pipelineLayout;
+		// Renders to a single cascade, selected by push constant
 		VkPipeline pipeline;
+		// Renders to all cascades at once with a geometry shader
+		VkPipeline pipelineLayered{ VK_NULL_HANDLE };
 	} depthPass;
 
 	// Layered depth image containing the shadow cascade depths
-	struct DepthImage {
-		VkImage image;
-		VkDeviceMemory mem;
-		VkImageView view;
-		VkSampler sampler;
-		void destroy(VkDevice device) {
-			vkDestroyImageView(device, view, nullptr);
-			vkDestroyImage(device, image, nullptr);
-			vkFreeMemory(device, mem, nullptr);
-			vkDestroySampler(device, sampler, nullptr);
-		}
-	} depth;
+	vks::LayeredShadowMap shadowMap;
 
-	// Contains all resources required for a single shadow map cascade
+	// Split depth and matrix of a single shadow map cascade
 	struct Cascade {
-		VkFramebuffer frameBuffer;
-		VkImageView view;
 		float splitDepth;
 		glm::mat4 viewProjMatrix;
-		void destroy(VkDevice device) {
-			vkDestroyImageView(device, view, nullptr);
-			vkDestroyFramebuffer(device, frameBuffer, nullptr);
-		}
 	};
 	std::array<Cascade, SHADOW_MAP_CASCADE_COUNT> cascades;
+
+	// Static casters are the terrain and the trees, the bounds of the models are used for culling against the cascades
+	struct ModelBounds {
+		glm::vec3 center;
+		float radius;
+	};
+	struct {
+		ModelBounds terrain;
+		ModelBounds tree;
+	} modelBounds;
+	const std::vector<glm::vec3> treePositions = {
+		glm::vec3(0.0f, 0.0f, 0.0f),
+		glm::vec3(1.25f, 0.25f, 1.25f),
+		glm::vec3(-1.25f, -0.2f, 1.25f),
+		glm::vec3(1.25f, 0.1f, -1.25f),
+		glm::vec3(-1.25f, -0.25f, -1.25f),
+	};
+	// Cascades each static caster (terrain, then the trees) is visible in
+	std::vector<uint32_t> staticCasterMasks;
+
+	// Tree moving around the scene, rendered to the shadow map every frame
+	struct DynamicCaster {
+		float angle{ 0.0f };
+		glm::vec3 position{ 0.0f };
+		uint32_t cascadeMask{ 0 };
+	} dynamicCaster;
+
+	// GPU time of the depth pass, measured with timestamps before and after it
+	vks::QueryManager timestamps;
+	bool timestampsSupported = false;
+	float shadowPassTime = 0.0f;
+
+	// Draws recorded for the last shadow map update
+	struct ShadowStatistics {
+		uint32_t draws;
+		// Sum of the cascades of all draws, compared to the number of cascades all casters would be rendered to without culling
+		uint32_t cascadeDraws;
+		uint32_t unculledCascadeDraws;
+	} shadowStatistics{};
+
 	// Per-cascade matrices will be passed to the shaders as a linear array
 	vks::Buffer cascadeViewProjMatricesBuffer;
 
 	VulkanExample() : VulkanExampleBase()
 	{
 		title = "Cascaded shadow mapping";
+		// The single pass layered shadow rendering only has GLSL shaders
+		requireGlslShaders();
 		timerSpeed *= 0.025f;
 		camera.type = Camera::CameraType::firstperson;
 		camera.movementSpeed = 2.5f;
@@ -132,15 +172,11 @@ public:
 
 	~VulkanExample()
 	{
-		for (auto cascade : cascades) {
-			cascade.destroy(device);
-		}
-		depth.destroy(device);
-
-		vkDestroyRenderPass(device, depthPass.renderPass, nullptr);
+		shadowMap.destroy();
 
 		vkDestroyPipeline(device, pipelines.debugShadowMap, nullptr);
 		vkDestroyPipeline(device, depthPass.pipeline, nullptr);
+		vkDestroyPipeline(device, depthPass.pipelineLayered, nullptr);
 		vkDestroyPipeline(device, pipelines.sceneShadow, nullptr);
 		vkDestroyPipeline(device, pipelines.sceneShadowPCF, nullptr);
 
@@ -152,6 +188,10 @@ public:
 		cascadeViewProjMatricesBuffer.destroy();
 		uniformBuffers.VS.destroy();
 		uniformBuffers.FS.destroy();
+
+		if (timestampsSupported) {
+			timestamps.destroy();
+		}
 	}
 
 	virtual void getEnabledFeatures()
@@ -159,6 +199,15 @@ public:
 		enabledFeatures.samplerAnisotropy = deviceFeatures.samplerAnisotropy;
 		// Depth clamp to avoid near plane clipping
 		enabledFeatures.depthClamp = deviceFeatures.depthClamp;
+		// Geometry shaders are used to render all cascades in one pass, without them each cascade is rendered in a separate pass
+		if (deviceFeatures.geometryShader) {
+			enabledFeatures.geometryShader = VK_TRUE;
+		}
+	}
+
+	VkShaderStageFlags depthPassStages()
+	{
+		return VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | (enabledFeatures.geometryShader ? VK_SHADER_STAGE_GEOMETRY_BIT : 0);
 	}
 
 	/*
@@ -176,14 +225,9 @@ public:
 		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
 		models.terrain.draw(commandBuffer, vkglTF::RenderFlags::BindImages, pipelineLayout);
 
-		// Trees
-		const std::vector<glm::vec3> positions = {
-			glm::vec3(0.0f, 0.0f, 0.0f),
-			glm::vec3(1.25f, 0.25f, 1.25f),
-			glm::vec3(-1.25f, -0.2f, 1.25f),
-			glm::vec3(1.25f, 0.1f, -1.25f),
-			glm::vec3(-1.25f, -0.25f, -1.25f),
-		};
+		// Trees, the last one is the dynamic caster
+		std::vector<glm::vec3> positions = treePositions;
+		positions.push_back(dynamicCaster.position);
 
 		for (auto& position : positions) {
 			pushConstBlock.position = glm::vec4(position, 0.0f);
@@ -194,245 +238,182 @@ public:
 	}
 
 	/*
-		Setup resources used by the depth pass
-		The depth image is layered with each layer storing one shadow map cascade
+		Setup the layered depth map used by the depth pass
+		Each layer stores one shadow map cascade
 	*/
-	void prepareDepthPass()
+	void prepareShadowMap()
 	{
 		VkFormat depthFormat = vulkanDevice->getSupportedDepthFormat(true);
+		// Depth clamping lets casters between the light and a cascade's near plane cast shadows, so they must not be culled
+		shadowMap.settings.cullNearPlane = !enabledFeatures.depthClamp;
+		shadowMap.create(vulkanDevice, SHADOWMAP_DIM, SHADOWMAP_DIM, SHADOW_MAP_CASCADE_COUNT, VK_FORMAT_UNDEFINED, depthFormat, false);
+	}
 
-		/*
-			Depth map renderpass
-		*/
-
-		VkAttachmentDescription attachmentDescription{};
-		attachmentDescription.format = depthFormat;
-		attachmentDescription.samples = VK_SAMPLE_COUNT_1_BIT;
-		attachmentDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		attachmentDescription.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-		attachmentDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-		attachmentDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		attachmentDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		attachmentDescription.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
-
-		VkAttachmentReference depthReference = {};
-		depthReference.attachment = 0;
-		depthReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-		VkSubpassDescription subpass = {};
-		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-		subpass.colorAttachmentCount = 0;
-		subpass.pDepthStencilAttachment = &depthReference;
-
-		// Use subpass dependencies for layout transitions
-		std::array<VkSubpassDependency, 2> dependencies;
-
-		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-		dependencies[0].dstSubpass = 0;
-		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-		dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-		dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-		dependencies[1].srcSubpass = 0;
-		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-		dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-		dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-		VkRenderPassCreateInfo renderPassCreateInfo = vks::initializers::renderPassCreateInfo();
-		renderPassCreateInfo.attachmentCount = 1;
-		renderPassCreateInfo.pAttachments = &attachmentDescription;
-		renderPassCreateInfo.subpassCount = 1;
-		renderPassCreateInfo.pSubpasses = &subpass;
-		renderPassCreateInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
-		renderPassCreateInfo.pDependencies = dependencies.data();
-
-		VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassCreateInfo, nullptr, &depthPass.renderPass));
+	void prepareTimestamps()
+	{
+		timestampsSupported = (vulkanDevice->properties.limits.timestampComputeAndGraphics == VK_TRUE) && (vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].timestampValidBits > 0);
+		if (timestampsSupported) {
+			timestamps.create(vulkanDevice, queue, VK_QUERY_TYPE_TIMESTAMP, static_cast<uint32_t>(drawCmdBuffers.size()), 2);
+		}
+	}
 
-		/*
-			Layered depth image and views
-		*/
+	// Bounding sphere of the pre-transformed vertices of a model, which are only kept for this
+	ModelBounds getModelBounds(vkglTF::Model& model)
+	{
+		glm::vec3 min(FLT_MAX);
+		glm::vec3 max(-FLT_MAX);
+		for (auto& vertex : model.vertexData) {
+			min = glm::min(min, vertex.pos);
+			max = glm::max(max, vertex.pos);
+		}
+		model.vertexData.clear();
+		model.indexData.clear();
+		return { (min + max) * 0.5f, glm::distance(min, max) * 0.5f };
+	}
 
-		VkImageCreateInfo imageInfo = vks::initializers::imageCreateInfo();
-		imageInfo.imageType = VK_IMAGE_TYPE_2D;
-		imageInfo.extent.width = SHADOWMAP_DIM;
-		imageInfo.extent.height = SHADOWMAP_DIM;
-		imageInfo.extent.depth = 1;
-		imageInfo.mipLevels = 1;
-		imageInfo.arrayLayers = SHADOW_MAP_CASCADE_COUNT;
-		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageInfo.format = depthFormat;
-		imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-		VK_CHECK_RESULT(vkCreateImage(device, &imageInfo, nullptr, &depth.image));
-		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
-		VkMemoryRequirements memReqs;
-		vkGetImageMemoryRequirements(device, depth.image, &memReqs);
-		memAlloc.allocationSize = memReqs.size;
-		memAlloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &depth.mem));
-		VK_CHECK_RESULT(vkBindImageMemory(device, depth.image, depth.mem, 0));
-		// Full depth map view (all layers)
-		VkImageViewCreateInfo viewInfo = vks::initializers::imageViewCreateInfo();
-		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
-		viewInfo.format = depthFormat;
-		viewInfo.subresourceRange = {};
-		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-		viewInfo.subresourceRange.baseMipLevel = 0;
-		viewInfo.subresourceRange.levelCount = 1;
-		viewInfo.subresourceRange.baseArrayLayer = 0;
-		viewInfo.subresourceRange.layerCount = SHADOW_MAP_CASCADE_COUNT;
-		viewInfo.image = depth.image;
-		VK_CHECK_RESULT(vkCreateImageView(device, &viewInfo, nullptr, &depth.view));
-
-		// One image view and framebuffer per cascade
+	// Update the cascade matrices of the shadow map and the cascades each caster is visible in
+	void updateShadowCasters()
+	{
+		std::vector<glm::mat4> cascadeMatrices(SHADOW_MAP_CASCADE_COUNT);
 		for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
-			// Image view for this cascade's layer (inside the depth map)
-			// This view is used to render to that specific depth image layer
-			VkImageViewCreateInfo viewInfo = vks::initializers::imageViewCreateInfo();
-			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
-			viewInfo.format = depthFormat;
-			viewInfo.subresourceRange = {};
-			viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-			viewInfo.subresourceRange.baseMipLevel = 0;
-			viewInfo.subresourceRange.levelCount = 1;
-			viewInfo.subresourceRange.baseArrayLayer = i;
-			viewInfo.subresourceRange.layerCount = 1;
-			viewInfo.image = depth.image;
-			VK_CHECK_RESULT(vkCreateImageView(device, &viewInfo, nullptr, &cascades[i].view));
-			// Framebuffer
-			VkFramebufferCreateInfo framebufferInfo = vks::initializers::framebufferCreateInfo();
-			framebufferInfo.renderPass = depthPass.renderPass;
-			framebufferInfo.attachmentCount = 1;
-			framebufferInfo.pAttachments = &cascades[i].view;
-			framebufferInfo.width = SHADOWMAP_DIM;
-			framebufferInfo.height = SHADOWMAP_DIM;
-			framebufferInfo.layers = 1;
-			VK_CHECK_RESULT(vkCreateFramebuffer(device, &framebufferInfo, nullptr, &cascades[i].frameBuffer));
+			cascadeMatrices[i] = cascades[i].viewProjMatrix;
+		}
+		// Invalidates the cached static casters if the cascades have changed
+		shadowMap.setLayerMatrices(cascadeMatrices);
+
+		const uint32_t allCascades = (1u << SHADOW_MAP_CASCADE_COUNT) - 1;
+		staticCasterMasks.clear();
+		staticCasterMasks.push_back(perCascadeCulling ? shadowMap.getLayerMask(modelBounds.terrain.center, modelBounds.terrain.radius) : allCascades);
+		for (auto& position : treePositions) {
+			staticCasterMasks.push_back(perCascadeCulling ? shadowMap.getLayerMask(modelBounds.tree.center + position, modelBounds.tree.radius) : allCascades);
 		}
+		dynamicCaster.cascadeMask = perCascadeCulling ? shadowMap.getLayerMask(modelBounds.tree.center + dynamicCaster.position, modelBounds.tree.radius) : allCascades;
+	}
+
+	// Record the draws of the static or dynamic casters for one or all cascades, called by the shadow map for each of its passes
+	void drawShadowCasters(VkCommandBuffer commandBuffer, uint32_t casterFlags, uint32_t cascadeIndex)
+	{
+		const bool allCascades = (cascadeIndex == vks::LayeredShadowMap::allLayers);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, allCascades ? depthPass.pipelineLayered : depthPass.pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, depthPass.pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+
+		auto drawCaster = [&](vkglTF::Model& model, const glm::vec3& position, uint32_t cascadeMask) {
+			const uint32_t passMask = allCascades ? cascadeMask : (cascadeMask & (1u << cascadeIndex));
+			shadowStatistics.unculledCascadeDraws += allCascades ? SHADOW_MAP_CASCADE_COUNT : 1;
+			if (passMask == 0) {
+				return;
+			}
+			PushConstBlock pushConstBlock = { glm::vec4(position, 0.0f), allCascades ? 0 : cascadeIndex, passMask };
+			vkCmdPushConstants(commandBuffer, depthPass.pipelineLayout, depthPassStages(), 0, sizeof(PushConstBlock), &pushConstBlock);
+			// This will also bind the texture images to set 1 for alpha masking
+			model.draw(commandBuffer, vkglTF::RenderFlags::BindImages, depthPass.pipelineLayout);
+			shadowStatistics.draws++;
+			shadowStatistics.cascadeDraws += static_cast<uint32_t>(std::bitset<32>(passMask).count());
+		};
 
-		// Shared sampler for cascade depth reads
-		VkSamplerCreateInfo sampler = vks::initializers::samplerCreateInfo();
-		sampler.magFilter = VK_FILTER_LINEAR;
-		sampler.minFilter = VK_FILTER_LINEAR;
-		sampler.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-		sampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-		sampler.addressModeV = sampler.addressModeU;
-		sampler.addressModeW = sampler.addressModeU;
-		sampler.mipLodBias = 0.0f;
-		sampler.maxAnisotropy = 1.0f;
-		sampler.minLod = 0.0f;
-		sampler.maxLod = 1.0f;
-		sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-		VK_CHECK_RESULT(vkCreateSampler(device, &sampler, nullptr, &depth.sampler));
+		if (casterFlags & vks::LayeredShadowMap::StaticCasters) {
+			drawCaster(models.terrain, glm::vec3(0.0f), staticCasterMasks[0]);
+			for (size_t i = 0; i < treePositions.size(); i++) {
+				drawCaster(models.tree, treePositions[i], staticCasterMasks[i + 1]);
+			}
+		}
+		if (casterFlags & vks::LayeredShadowMap::DynamicCasters) {
+			drawCaster(models.tree, dynamicCaster.position, dynamicCaster.cascadeMask);
+		}
 	}
 
-	void buildCommandBuffers()
+	// The shadow map update depends on the cache state and the culling results, so the command buffer is rebuilt every frame
+	void buildCommandBuffer(uint32_t i)
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
-		for (int32_t i = 0; i < drawCmdBuffers.size(); i++) {
-
-			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
-
-			/*
-				Generate depth map cascades
-
-				Uses multiple passes with each pass rendering the scene to the cascade's depth image layer
-				Could be optimized using a geometry shader (and layered frame buffer) on devices that support geometry shaders
-			*/
-			{
-				VkClearValue clearValues[1];
-				clearValues[0].depthStencil = { 1.0f, 0 };
-
-				VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-				renderPassBeginInfo.renderPass = depthPass.renderPass;
-				renderPassBeginInfo.renderArea.offset.x = 0;
-				renderPassBeginInfo.renderArea.offset.y = 0;
-				renderPassBeginInfo.renderArea.extent.width = SHADOWMAP_DIM;
-				renderPassBeginInfo.renderArea.extent.height = SHADOWMAP_DIM;
-				renderPassBeginInfo.clearValueCount = 1;
-				renderPassBeginInfo.pClearValues = clearValues;
-
-				VkViewport viewport = vks::initializers::viewport((float)SHADOWMAP_DIM, (float)SHADOWMAP_DIM, 0.0f, 1.0f);
-				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-
-				VkRect2D scissor = vks::initializers::rect2D(SHADOWMAP_DIM, SHADOWMAP_DIM, 0, 0);
-				vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
-
-				// One pass per cascade
-				for (uint32_t j = 0; j < SHADOW_MAP_CASCADE_COUNT; j++) {
-					renderPassBeginInfo.framebuffer = cascades[j].frameBuffer;
-					vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-					vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, depthPass.pipeline);
-					renderScene(drawCmdBuffers[i], depthPass.pipelineLayout, j);
-					vkCmdEndRenderPass(drawCmdBuffers[i]);
-				}
-			}
+		VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
-			/*
-				Note: Explicit synchronization is not required between the render pass, as this is done implicit via sub pass dependencies
-			*/
-
-			/*
-				Scene rendering using depth cascades for shadow mapping
-			*/
-
-			{
-				VkClearValue clearValues[2];
-				clearValues[0].color = { { 0.0f, 0.0f, 0.2f, 1.0f } };
-				clearValues[1].depthStencil = { 1.0f, 0 };
-
-				VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-				renderPassBeginInfo.renderPass = renderPass;
-				renderPassBeginInfo.framebuffer = frameBuffers[i];
-				renderPassBeginInfo.renderArea.offset.x = 0;
-				renderPassBeginInfo.renderArea.offset.y = 0;
-				renderPassBeginInfo.renderArea.extent.width = width;
-				renderPassBeginInfo.renderArea.extent.height = height;
-				renderPassBeginInfo.clearValueCount = 2;
-				renderPassBeginInfo.pClearValues = clearValues;
-
-				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-				VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
-				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-
-				VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
-				vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
-
-				// Visualize shadow map cascade
-				if (displayDepthMap) {
-					vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
-					vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.debugShadowMap);
-					PushConstBlock pushConstBlock = {};
-					pushConstBlock.cascadeIndex = displayDepthMapCascadeIndex;
-					vkCmdPushConstants(drawCmdBuffers[i], pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
-					vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
-				}
-
-				// Render shadowed scene
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, (filterPCF) ? pipelines.sceneShadowPCF : pipelines.sceneShadow);
-				renderScene(drawCmdBuffers[i], pipelineLayout);
-
-				drawUI(drawCmdBuffers[i]);
-
-				vkCmdEndRenderPass(drawCmdBuffers[i]);
+		if (timestampsSupported) {
+			timestamps.cmdBeginFrame(drawCmdBuffers[i], i);
+			timestamps.cmdWriteTimestamp(drawCmdBuffers[i], i, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+		}
+
+		/*
+			Generate depth map cascades
+
+			Static casters are only rendered if the cache has been invalidated, dynamic casters are rendered on top of the cached depth
+		*/
+		shadowStatistics = {};
+		shadowMap.cmdUpdate(drawCmdBuffers[i], [this](VkCommandBuffer commandBuffer, uint32_t casterFlags, uint32_t cascadeIndex) {
+			drawShadowCasters(commandBuffer, casterFlags, cascadeIndex);
+		});
+
+		if (timestampsSupported) {
+			timestamps.cmdWriteTimestamp(drawCmdBuffers[i], i, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+		}
+
+		/*
+			Note: Explicit synchronization is not required between the render pass, as this is done implicit via sub pass dependencies
+		*/
+
+		/*
+			Scene rendering using depth cascades for shadow mapping
+		*/
+
+		{
+			VkClearValue clearValues[2];
+			clearValues[0].color = { { 0.0f, 0.0f, 0.2f, 1.0f } };
+			clearValues[1].depthStencil = { 1.0f, 0 };
+
+			VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+			renderPassBeginInfo.renderPass = renderPass;
+			renderPassBeginInfo.framebuffer = frameBuffers[i];
+			renderPassBeginInfo.renderArea.offset.x = 0;
+			renderPassBeginInfo.renderArea.offset.y = 0;
+			renderPassBeginInfo.renderArea.extent.width = width;
+			renderPassBeginInfo.renderArea.extent.height = height;
+			renderPassBeginInfo.clearValueCount = 2;
+			renderPassBeginInfo.pClearValues = clearValues;
+
+			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+
+			VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+
+			// Visualize shadow map cascade
+			if (displayDepthMap) {
+				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
+				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.debugShadowMap);
+				PushConstBlock pushConstBlock = {};
+				pushConstBlock.cascadeIndex = displayDepthMapCascadeIndex;
+				vkCmdPushConstants(drawCmdBuffers[i], pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
+				vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
 			}
 
-			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+			// Render shadowed scene
+			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, (filterPCF) ? pipelines.sceneShadowPCF : pipelines.sceneShadow);
+			renderScene(drawCmdBuffers[i], pipelineLayout);
+
+			drawUI(drawCmdBuffers[i]);
+
+			vkCmdEndRenderPass(drawCmdBuffers[i]);
 		}
+
+		if (timestampsSupported) {
+			timestamps.cmdResolve(drawCmdBuffers[i], i);
+		}
+
+		VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 	}
 
 	void loadAssets()
 	{
 		uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::FlipY;
+		// The vertices are kept to calculate the bounds of the shadow casters
+		glTFLoadingFlags |= vkglTF::FileLoadingFlags::KeepHostData;
 		models.terrain.loadFromFile(getAssetPath() + "models/terrain_gridlines.gltf", vulkanDevice, queue, glTFLoadingFlags);
 		models.tree.loadFromFile(getAssetPath() + "models/oaktree.gltf", vulkanDevice, queue, glTFLoadingFlags);
+		modelBounds.terrain = getModelBounds(models.terrain);
+		modelBounds.tree = getModelBounds(models.tree);
 	}
 
 	void setupLayoutsAndDescriptors()
@@ -457,7 +438,7 @@ public:
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0),
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 2),
-			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 3),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, depthPassStages(), 3),
 		};
 		VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &descriptorSetLayout));
@@ -466,9 +447,6 @@ public:
 			Descriptor sets
 		*/
 
-		VkDescriptorImageInfo depthMapDescriptor =
-			vks::initializers::descriptorImageInfo(depth.sampler, depth.view, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
-
 		VkDescriptorSetAllocateInfo allocInfo =
 			vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
 
@@ -476,7 +454,7 @@ public:
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
 		const std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
 			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.VS.descriptor),
-			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &depthMapDescriptor),
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &shadowMap.descriptor),
 			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &uniformBuffers.FS.descriptor),
 			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3, &cascadeViewProjMatricesBuffer.descriptor),
 		};
@@ -498,7 +476,7 @@ public:
 
 		// Depth pass pipeline layout
 		{
-			VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(PushConstBlock), 0);
+			VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(depthPassStages(), sizeof(PushConstBlock), 0);
 			std::array<VkDescriptorSetLayout, 2> setLayouts = { descriptorSetLayout, vkglTF::descriptorSetLayoutImage };
 			VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(setLayouts.data(), static_cast<uint32_t>(setLayouts.size()));
 			pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
@@ -567,8 +545,19 @@ public:
 		// Enable depth clamp (if available)
 		rasterizationState.depthClampEnable = deviceFeatures.depthClamp;
 		pipelineCI.layout = depthPass.pipelineLayout;
-		pipelineCI.renderPass = depthPass.renderPass;
+		pipelineCI.renderPass = shadowMap.renderPass;
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &depthPass.pipeline));
+		// The layered pipeline uses geometry shader instancing (invocations layout modifier) to output each triangle to all cascades
+		if (enabledFeatures.geometryShader) {
+			std::array<VkPipelineShaderStageCreateInfo, 3> layeredShaderStages = {
+				shaderStages[0],
+				loadShader(getShadersPath() + "shadowmappingcascade/depthpass.geom.spv", VK_SHADER_STAGE_GEOMETRY_BIT),
+				shaderStages[1]
+			};
+			pipelineCI.stageCount = static_cast<uint32_t>(layeredShaderStages.size());
+			pipelineCI.pStages = layeredShaderStages.data();
+			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &depthPass.pipelineLayered));
+		}
 	}
 
 	void prepareUniformBuffers()
@@ -689,6 +678,9 @@ public:
 
 	void updateLight()
 	{
+		if (!animateLight) {
+			return;
+		}
 		float angle = glm::radians(timer * 360.0f);
 		float radius = 20.0f;
 		lightPos = glm::vec3(cos(angle) * radius, -radius, sin(angle) * radius);
@@ -722,9 +714,25 @@ public:
 		memcpy(uniformBuffers.FS.mapped, &uboFS, sizeof(uboFS));
 	}
 
+	void updateDynamicCaster()
+	{
+		if (animateCaster && !paused) {
+			dynamicCaster.angle += frameTimer * 20.0f;
+		}
+		float angle = glm::radians(dynamicCaster.angle);
+		dynamicCaster.position = glm::vec3(cos(angle) * 2.0f, 0.0f, sin(angle) * 2.0f);
+	}
+
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
+		// The previous submission of this command buffer has finished, so its timestamps can be read without waiting
+		if (timestampsSupported) {
+			const float period = vulkanDevice->properties.limits.timestampPeriod / 1000000.0f;
+			shadowPassTime = (timestamps.getResult(currentBuffer, 1) - timestamps.getResult(currentBuffer, 0)) * period;
+		}
+		updateShadowCasters();
+		buildCommandBuffer(currentBuffer);
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
@@ -737,11 +745,12 @@ public:
 		loadAssets();
 		updateLight();
 		updateCascades();
-		prepareDepthPass();
+		updateDynamicCaster();
+		prepareShadowMap();
+		prepareTimestamps();
 		prepareUniformBuffers();
 		setupLayoutsAndDescriptors();
 		preparePipelines();
-		buildCommandBuffers();
 		prepared = true;
 	}
 
@@ -749,6 +758,7 @@ public:
 	{
 		if (!prepared)
 			return;
+		updateDynamicCaster();
 		draw();
 		if (!paused || camera.updated) {
 			updateLight();
@@ -767,17 +777,27 @@ public:
 			if (overlay->checkBox("Color cascades", &colorCascades)) {
 				updateUniformBuffers();
 			}
-			if (overlay->checkBox("Display depth map", &displayDepthMap)) {
-				buildCommandBuffers();
-			}
+			overlay->checkBox("Display depth map", &displayDepthMap);
 			if (displayDepthMap) {
-				if (overlay->sliderInt("Cascade", &displayDepthMapCascadeIndex, 0, SHADOW_MAP_CASCADE_COUNT - 1)) {
-					buildCommandBuffers();
-				}
+				overlay->sliderInt("Cascade", &displayDepthMapCascadeIndex, 0, SHADOW_MAP_CASCADE_COUNT - 1);
 			}
-			if (overlay->checkBox("PCF filtering", &filterPCF)) {
-				buildCommandBuffers();
+			overlay->checkBox("PCF filtering", &filterPCF);
+			overlay->checkBox("Animate light", &animateLight);
+			overlay->checkBox("Animate dynamic caster", &animateCaster);
+			overlay->checkBox("Cache static casters", &shadowMap.settings.cacheStaticCasters);
+			overlay->checkBox("Per-cascade culling", &perCascadeCulling);
+			if (enabledFeatures.geometryShader) {
+				overlay->checkBox("Single pass (geometry shader)", &shadowMap.settings.layered);
+			}
+		}
+		if (overlay->header("Shadow pass")) {
+			if (timestampsSupported) {
+				overlay->text("GPU time: %.3f ms", shadowPassTime);
 			}
+			overlay->text("Render passes: %d", shadowMap.statistics.renderPasses);
+			overlay->text("Draws: %d", shadowStatistics.draws);
+			overlay->text("Cascade draws: %d of %d", shadowStatistics.cascadeDraws, shadowStatistics.unculledCascadeDraws);
+			overlay->text("Static casters: %s", shadowMap.statistics.staticPassRendered ? "rendered" : "cached");
 		}
 	}
 };
@@ -1,18 +1,31 @@
 /*
 * Vulkan Example - Omni directional shadows using a dynamic cube map
 *
+* All six faces of the shadow cube map are rendered in a single layered render pass (see vks::LayeredShadowMap), with a
+* geometry shader writing each triangle to the faces it's visible in. Shadow casters are culled against the face frustums
+* on the CPU, so the geometry shader only runs for faces a caster can be seen from. The distance of the static scene is
+* cached and only re-rendered when the light moves, while the dynamic caster (a cube orbiting the light) is rendered every frame
+*
 * Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#include <bitset>
+
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "VulkanLayeredShadowMap.h"
+#include "VulkanQueryManager.h"
 
 class VulkanExample : public VulkanExampleBase
 {
 public:
 	bool displayCubeMap{ false };
+	bool animateLight{ true };
+	bool animateCaster{ true };
+	// Cull shadow casters against the frustums of the cube map faces
+	bool perFaceCulling{ true };
 
 	// Defines the depth range used for the shadow maps
 	// This should be kept as small as possible for precision
@@ -31,8 +44,13 @@ public:
 		glm::mat4 view;
 		glm::mat4 model;
 		glm::vec4 lightPos;
-	};
-	UniformData uniformDataScene, uniformDataOffscreen;
+	} uniformDataScene;
+
+	struct UniformDataOffscreen {
+		// Projection and view matrices of the cube map faces, including the translation to the light's position
+		glm::mat4 faceViewProjections[6];
+		glm::vec4 lightPos;
+	} uniformDataOffscreen;
 
 	struct {
 		vks::Buffer scene;
@@ -41,7 +59,10 @@ public:
 
 	struct {
 		VkPipeline scene{ VK_NULL_HANDLE };
+		// Renders to a single face, selected by push constant
 		VkPipeline offscreen{ VK_NULL_HANDLE };
+		// Renders to all faces at once with a geometry shader
+		VkPipeline offscreenLayered{ VK_NULL_HANDLE };
 		VkPipeline cubemapDisplay{ VK_NULL_HANDLE };
 	} pipelines;
 
@@ -57,24 +78,6 @@ public:
 
 	VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
 
-	vks::Texture shadowCubeMap;
-	std::array<VkImageView, 6> shadowCubeMapFaceImageViews{};
-
-	// Framebuffer for offscreen rendering
-	struct FrameBufferAttachment {
-		VkImage image;
-		VkDeviceMemory mem;
-		VkImageView view;
-	};
-	struct OffscreenPass {
-		int32_t width, height;
-		std::array<VkFramebuffer, 6> frameBuffers;
-		FrameBufferAttachment depth;
-		VkRenderPass renderPass;
-		VkSampler sampler;
-		VkDescriptorImageInfo descriptor;
-	} offscreenPass;
-
 	// Size of the shadow map texture (per face)
 	const uint32_t offscreenImageSize{ 1024 };
 	// We use a 32 bit float format for max. precision. Depending on the use case, lower precision may be fine and can save bandwidth
@@ -82,9 +85,52 @@ public:
 	// The depth format is selected at runtime
 	VkFormat offscreenDepthFormat{ VK_FORMAT_UNDEFINED };
 
+	vks::LayeredShadowMap shadowMap;
+
+	struct ShadowPushConstants {
+		glm::mat4 model;
+		// Face rendered by passes without the geometry shader
+		uint32_t face;
+		// Faces the caster is visible in, the geometry shader skips all others
+		uint32_t faceMask;
+	};
+
+	// The primitives of the scene are static casters, each with a bounding sphere for culling against the cube map faces
+	struct ShadowCaster {
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		glm::vec3 center;
+		float radius;
+		uint32_t faceMask;
+	};
+	std::vector<ShadowCaster> staticCasters;
+
+	// Cube orbiting the light, rendered to the shadow map every frame
+	struct DynamicCaster {
+		float angle{ 0.0f };
+		float scale{ 0.2f };
+		glm::mat4 matrix{ 1.0f };
+		uint32_t faceMask{ 0x3f };
+	} dynamicCaster;
+
+	// GPU time of the shadow pass, measured with timestamps before and after it
+	vks::QueryManager timestamps;
+	bool timestampsSupported{ false };
+	float shadowPassTime{ 0.0f };
+
+	// Draws recorded for the last shadow map update
+	struct ShadowStatistics {
+		uint32_t draws;
+		// Sum of the faces of all draws, compared to the number of faces all casters would be rendered to without culling
+		uint32_t faceDraws;
+		uint32_t unculledFaceDraws;
+	} shadowStatistics{};
+
 	VulkanExample() : VulkanExampleBase()
 	{
 		title = "Point light shadows (cubemap)";
+		// The single pass layered shadow rendering only has GLSL shaders
+		requireGlslShaders();
 		camera.type = Camera::CameraType::lookat;
 		camera.setPerspective(45.0f, (float)width / (float)height, zNear, zFar);
 		camera.setRotation(glm::vec3(-20.5f, -673.0f, 0.0f));
@@ -95,31 +141,12 @@ public:
 	~VulkanExample()
 	{
 		if (device) {
-			// Cube map
-			for (uint32_t i = 0; i < 6; i++) {
-				vkDestroyImageView(device, shadowCubeMapFaceImageViews[i], nullptr);
-			}
-
-			vkDestroyImageView(device, shadowCubeMap.view, nullptr);
-			vkDestroyImage(device, shadowCubeMap.image, nullptr);
-			vkDestroySampler(device, shadowCubeMap.sampler, nullptr);
-			vkFreeMemory(device, shadowCubeMap.deviceMemory, nullptr);
-
-			// Depth attachment
-			vkDestroyImageView(device, offscreenPass.depth.view, nullptr);
-			vkDestroyImage(device, offscreenPass.depth.image, nullptr);
-			vkFreeMemory(device, offscreenPass.depth.mem, nullptr);
-
-			for (uint32_t i = 0; i < 6; i++)
-			{
-				vkDestroyFramebuffer(device, offscreenPass.frameBuffers[i], nullptr);
-			}
-
-			vkDestroyRenderPass(device, offscreenPass.renderPass, nullptr);
+			shadowMap.destroy();
 
 			// Pipelines
 			vkDestroyPipeline(device, pipelines.scene, nullptr);
 			vkDestroyPipeline(device, pipelines.offscreen, nullptr);
+			vkDestroyPipeline(device, pipelines.offscreenLayered, nullptr);
 			vkDestroyPipeline(device, pipelines.cubemapDisplay, nullptr);
 
 			vkDestroyPipelineLayout(device, pipelineLayouts.scene, nullptr);
@@ -130,391 +157,211 @@ public:
 			// Uniform buffers
 			uniformBuffers.offscreen.destroy();
 			uniformBuffers.scene.destroy();
+
+			if (timestampsSupported) {
+				timestamps.destroy();
+			}
 		}
 	}
 
-	void prepareCubeMap()
+	virtual void getEnabledFeatures()
 	{
-		shadowCubeMap.width = offscreenImageSize;
-		shadowCubeMap.height = offscreenImageSize;
-
-		// Cube map image description
-		VkImageCreateInfo imageCreateInfo = vks::initializers::imageCreateInfo();
-		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-		imageCreateInfo.format = offscreenImageFormat;
-		imageCreateInfo.extent = { shadowCubeMap.width, shadowCubeMap.height, 1 };
-		imageCreateInfo.mipLevels = 1;
-		imageCreateInfo.arrayLayers = 6;
-		imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageCreateInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		imageCreateInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
-
-		VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
-		VkMemoryRequirements memReqs;
-
-		VkCommandBuffer layoutCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-		// Create cube map image
-		VK_CHECK_RESULT(vkCreateImage(device, &imageCreateInfo, nullptr, &shadowCubeMap.image));
-
-		vkGetImageMemoryRequirements(device, shadowCubeMap.image, &memReqs);
-
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device, &memAllocInfo, nullptr, &shadowCubeMap.deviceMemory));
-		VK_CHECK_RESULT(vkBindImageMemory(device, shadowCubeMap.image, shadowCubeMap.deviceMemory, 0));
-
-		// Image barrier for optimal image (target)
-		VkImageSubresourceRange subresourceRange = {};
-		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		subresourceRange.baseMipLevel = 0;
-		subresourceRange.levelCount = 1;
-		subresourceRange.layerCount = 6;
-		vks::tools::setImageLayout(
-			layoutCmd,
-			shadowCubeMap.image,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-			subresourceRange);
-
-		vulkanDevice->flushCommandBuffer(layoutCmd, queue, true);
-
-		// Create sampler
-		VkSamplerCreateInfo sampler = vks::initializers::samplerCreateInfo();
-		sampler.magFilter = VK_FILTER_LINEAR;
-		sampler.minFilter = VK_FILTER_LINEAR;
-		sampler.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-		sampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
-		sampler.addressModeV = sampler.addressModeU;
-		sampler.addressModeW = sampler.addressModeU;
-		sampler.mipLodBias = 0.0f;
-		sampler.maxAnisotropy = 1.0f;
-		sampler.compareOp = VK_COMPARE_OP_NEVER;
-		sampler.minLod = 0.0f;
-		sampler.maxLod = 1.0f;
-		sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-		VK_CHECK_RESULT(vkCreateSampler(device, &sampler, nullptr, &shadowCubeMap.sampler));
-
-		// Create image view
-		VkImageViewCreateInfo view = vks::initializers::imageViewCreateInfo();
-		view.image = VK_NULL_HANDLE;
-		view.viewType = VK_IMAGE_VIEW_TYPE_CUBE;
-		view.format = offscreenImageFormat;
-		view.components = { VK_COMPONENT_SWIZZLE_R };
-		view.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-		view.subresourceRange.layerCount = 6;
-		view.image = shadowCubeMap.image;
-		VK_CHECK_RESULT(vkCreateImageView(device, &view, nullptr, &shadowCubeMap.view));
-
-		view.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		view.subresourceRange.layerCount = 1;
-		view.image = shadowCubeMap.image;
-
-		for (uint32_t i = 0; i < 6; i++)
-		{
-			view.subresourceRange.baseArrayLayer = i;
-			VK_CHECK_RESULT(vkCreateImageView(device, &view, nullptr, &shadowCubeMapFaceImageViews[i]));
+		// Geometry shaders are used to render all cube map faces in one pass, without them each face is rendered in a separate pass
+		if (deviceFeatures.geometryShader) {
+			enabledFeatures.geometryShader = VK_TRUE;
 		}
 	}
 
-	// Set up a separate render pass for the offscreen frame buffer
-	// This is necessary as the offscreen frame buffer attachments
-	// use formats different to the ones from the visible frame buffer
-	// and at least the depth one may not be compatible
-	void prepareOffscreenRenderpass()
+	// The shadow cube map has a color attachment storing the distance to the light and a depth attachment for depth testing
+	void prepareShadowMap()
 	{
-		VkAttachmentDescription osAttachments[2] = {};
-
-		// Find a suitable depth format for
 		VkBool32 validDepthFormat = vks::tools::getSupportedDepthFormat(physicalDevice, &offscreenDepthFormat);
 		assert(validDepthFormat);
-
-		osAttachments[0].format = offscreenImageFormat;
-		osAttachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
-		osAttachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		osAttachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-		osAttachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-		osAttachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		osAttachments[0].initialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		osAttachments[0].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-		// Depth attachment
-		osAttachments[1].format = offscreenDepthFormat;
-		osAttachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
-		osAttachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		osAttachments[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-		osAttachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-		osAttachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		osAttachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-		osAttachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-		VkAttachmentReference colorReference = {};
-		colorReference.attachment = 0;
-		colorReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-		VkAttachmentReference depthReference = {};
-		depthReference.attachment = 1;
-		depthReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-		VkSubpassDescription subpass = {};
-		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-		subpass.colorAttachmentCount = 1;
-		subpass.pColorAttachments = &colorReference;
-		subpass.pDepthStencilAttachment = &depthReference;
-
-		VkRenderPassCreateInfo renderPassCreateInfo = vks::initializers::renderPassCreateInfo();
-		renderPassCreateInfo.attachmentCount = 2;
-		renderPassCreateInfo.pAttachments = osAttachments;
-		renderPassCreateInfo.subpassCount = 1;
-		renderPassCreateInfo.pSubpasses = &subpass;
-
-		VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassCreateInfo, nullptr, &offscreenPass.renderPass));
+		shadowMap.create(vulkanDevice, offscreenImageSize, offscreenImageSize, 6, offscreenImageFormat, offscreenDepthFormat, true);
 	}
 
-	// Prepare a new framebuffer for offscreen rendering
-	// The contents of this framebuffer are then
-	// copied to the different cube map faces
-	void prepareOffscreenFramebuffer()
+	void prepareTimestamps()
 	{
-		offscreenPass.width = offscreenImageSize;
-		offscreenPass.height = offscreenImageSize;
-
-		// Color attachment
-		VkImageCreateInfo imageCreateInfo = vks::initializers::imageCreateInfo();
-		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-		imageCreateInfo.format = offscreenImageFormat;
-		imageCreateInfo.extent.width = offscreenPass.width;
-		imageCreateInfo.extent.height = offscreenPass.height;
-		imageCreateInfo.extent.depth = 1;
-		imageCreateInfo.mipLevels = 1;
-		imageCreateInfo.arrayLayers = 1;
-		imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-		// Image of the framebuffer is blit source
-		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		imageCreateInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-		VkImageViewCreateInfo colorImageView = vks::initializers::imageViewCreateInfo();
-		colorImageView.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		colorImageView.format = offscreenImageFormat;
-		colorImageView.flags = 0;
-		colorImageView.subresourceRange = {};
-		colorImageView.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		colorImageView.subresourceRange.baseMipLevel = 0;
-		colorImageView.subresourceRange.levelCount = 1;
-		colorImageView.subresourceRange.baseArrayLayer = 0;
-		colorImageView.subresourceRange.layerCount = 1;
-
-		VkCommandBuffer layoutCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-		// Depth stencil attachment
-		imageCreateInfo.format = offscreenDepthFormat;
-		imageCreateInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-
-		VkImageViewCreateInfo depthStencilView = vks::initializers::imageViewCreateInfo();
-		depthStencilView.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		depthStencilView.format = offscreenDepthFormat;
-		depthStencilView.flags = 0;
-		depthStencilView.subresourceRange = {};
-		depthStencilView.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-		if (offscreenDepthFormat >= VK_FORMAT_D16_UNORM_S8_UINT) {
-			depthStencilView.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-		}
-		depthStencilView.subresourceRange.baseMipLevel = 0;
-		depthStencilView.subresourceRange.levelCount = 1;
-		depthStencilView.subresourceRange.baseArrayLayer = 0;
-		depthStencilView.subresourceRange.layerCount = 1;
-
-		VK_CHECK_RESULT(vkCreateImage(device, &imageCreateInfo, nullptr, &offscreenPass.depth.image));
-
-		VkMemoryRequirements memReqs;
-		vkGetImageMemoryRequirements(device, offscreenPass.depth.image, &memReqs);
-		
-		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
-		memAlloc.allocationSize = memReqs.size;
-		memAlloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &offscreenPass.depth.mem));
-		VK_CHECK_RESULT(vkBindImageMemory(device, offscreenPass.depth.image, offscreenPass.depth.mem, 0));
-
-		vks::tools::setImageLayout(
-			layoutCmd,
-			offscreenPass.depth.image,
-			VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
-
-		vulkanDevice->flushCommandBuffer(layoutCmd, queue, true);
-
-		depthStencilView.image = offscreenPass.depth.image;
-		VK_CHECK_RESULT(vkCreateImageView(device, &depthStencilView, nullptr, &offscreenPass.depth.view));
-
-		VkImageView attachments[2];
-		attachments[1] = offscreenPass.depth.view;
-
-		VkFramebufferCreateInfo fbufCreateInfo = vks::initializers::framebufferCreateInfo();
-		fbufCreateInfo.renderPass = offscreenPass.renderPass;
-		fbufCreateInfo.attachmentCount = 2;
-		fbufCreateInfo.pAttachments = attachments;
-		fbufCreateInfo.width = offscreenPass.width;
-		fbufCreateInfo.height = offscreenPass.height;
-		fbufCreateInfo.layers = 1;
-
-		for (uint32_t i = 0; i < 6; i++)
-		{
-			attachments[0] = shadowCubeMapFaceImageViews[i];
-			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &offscreenPass.frameBuffers[i]));
+		timestampsSupported = (vulkanDevice->properties.limits.timestampComputeAndGraphics == VK_TRUE) && (vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].timestampValidBits > 0);
+		if (timestampsSupported) {
+			timestamps.create(vulkanDevice, queue, VK_QUERY_TYPE_TIMESTAMP, static_cast<uint32_t>(drawCmdBuffers.size()), 2);
 		}
 	}
 
-	// Updates a single cube map face
-	// Renders the scene with face's view directly to the cubemap layer `faceIndex`
-	// Uses push constants for quick update of view matrix for the current cube map face
-	void updateCubeFace(uint32_t faceIndex, VkCommandBuffer commandBuffer)
+	// Split the scene into one shadow caster per primitive, with bounds calculated from the pre-transformed vertices
+	void prepareShadowCasters()
 	{
-		VkClearValue clearValues[2];
-		clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
-		clearValues[1].depthStencil = { 1.0f, 0 };
-
-		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-		// Reuse render pass from example pass
-		renderPassBeginInfo.renderPass = offscreenPass.renderPass;
-		renderPassBeginInfo.framebuffer = offscreenPass.frameBuffers[faceIndex];
-		renderPassBeginInfo.renderArea.extent.width = offscreenPass.width;
-		renderPassBeginInfo.renderArea.extent.height = offscreenPass.height;
-		renderPassBeginInfo.clearValueCount = 2;
-		renderPassBeginInfo.pClearValues = clearValues;
-
-		// Update view matrix via push constant
-
-		glm::mat4 viewMatrix = glm::mat4(1.0f);
-		switch (faceIndex)
-		{
-		case 0: // POSITIVE_X
-			viewMatrix = glm::rotate(viewMatrix, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-			viewMatrix = glm::rotate(viewMatrix, glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-			break;
-		case 1:	// NEGATIVE_X
-			viewMatrix = glm::rotate(viewMatrix, glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-			viewMatrix = glm::rotate(viewMatrix, glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-			break;
-		case 2:	// POSITIVE_Y
-			viewMatrix = glm::rotate(viewMatrix, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-			break;
-		case 3:	// NEGATIVE_Y
-			viewMatrix = glm::rotate(viewMatrix, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-			break;
-		case 4:	// POSITIVE_Z
-			viewMatrix = glm::rotate(viewMatrix, glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-			break;
-		case 5:	// NEGATIVE_Z
-			viewMatrix = glm::rotate(viewMatrix, glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-			break;
+		for (auto node : models.scene.linearNodes) {
+			if (!node->mesh) {
+				continue;
+			}
+			for (auto primitive : node->mesh->primitives) {
+				glm::vec3 min(FLT_MAX);
+				glm::vec3 max(-FLT_MAX);
+				for (uint32_t i = 0; i < primitive->vertexCount; i++) {
+					const glm::vec3& pos = models.scene.vertexData[primitive->firstVertex + i].pos;
+					min = glm::min(min, pos);
+					max = glm::max(max, pos);
+				}
+				ShadowCaster caster{};
+				caster.firstIndex = primitive->firstIndex;
+				caster.indexCount = primitive->indexCount;
+				caster.center = (min + max) * 0.5f;
+				caster.radius = glm::distance(min, max) * 0.5f;
+				staticCasters.push_back(caster);
+			}
 		}
+		// The vertices are only needed for the bounds
+		models.scene.vertexData.clear();
+		models.scene.indexData.clear();
+	}
 
-		// Render scene from cube face's point of view
-		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	// Update the matrices of the cube map faces and the faces each caster is visible in
+	void updateShadowCasters()
+	{
+		std::vector<glm::mat4> faceMatrices(std::begin(uniformDataOffscreen.faceViewProjections), std::end(uniformDataOffscreen.faceViewProjections));
+		// Invalidates the cached static casters if the light has moved
+		shadowMap.setLayerMatrices(faceMatrices);
+		for (auto& caster : staticCasters) {
+			caster.faceMask = perFaceCulling ? shadowMap.getLayerMask(caster.center, caster.radius) : 0x3f;
+		}
+		const glm::vec3 dynamicCenter = glm::vec3(dynamicCaster.matrix * glm::vec4(models.debugcube.dimensions.center, 1.0f));
+		dynamicCaster.faceMask = perFaceCulling ? shadowMap.getLayerMask(dynamicCenter, models.debugcube.dimensions.radius * dynamicCaster.scale) : 0x3f;
+	}
 
-		// Update shader push constant block
-		// Contains current face view matrix
-		vkCmdPushConstants(
-			commandBuffer,
-			pipelineLayouts.offscreen,
-			VK_SHADER_STAGE_VERTEX_BIT,
-			0,
-			sizeof(glm::mat4),
-			&viewMatrix);
+	// Record the draws of the static or dynamic casters for one or all cube map faces, called by the shadow map for each of its passes
+	void drawShadowCasters(VkCommandBuffer commandBuffer, uint32_t casterFlags, uint32_t face)
+	{
+		const bool allFaces = (face == vks::LayeredShadowMap::allLayers);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, allFaces ? pipelines.offscreenLayered : pipelines.offscreen);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.offscreen, 0, 1, &descriptorSets.offscreen, 0, nullptr);
+
+		// Returns false if the caster has been culled for all faces rendered by this pass
+		auto pushCaster = [&](const glm::mat4& model, uint32_t faceMask) {
+			const uint32_t passMask = allFaces ? faceMask : (faceMask & (1u << face));
+			shadowStatistics.unculledFaceDraws += allFaces ? 6 : 1;
+			if (passMask == 0) {
+				return false;
+			}
+			ShadowPushConstants pushConstants{ model, allFaces ? 0 : face, passMask };
+			vkCmdPushConstants(commandBuffer, pipelineLayouts.offscreen, pushConstantStages(), 0, sizeof(ShadowPushConstants), &pushConstants);
+			shadowStatistics.draws++;
+			shadowStatistics.faceDraws += static_cast<uint32_t>(std::bitset<32>(passMask).count());
+			return true;
+		};
 
-		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.offscreen);
-		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.offscreen, 0, 1, &descriptorSets.offscreen, 0, NULL);
-		models.scene.draw(commandBuffer);
+		if (casterFlags & vks::LayeredShadowMap::StaticCasters) {
+			const VkDeviceSize offsets[1] = { 0 };
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &models.scene.vertices.buffer, offsets);
+			vkCmdBindIndexBuffer(commandBuffer, models.scene.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+			for (auto& caster : staticCasters) {
+				if (pushCaster(glm::mat4(1.0f), caster.faceMask)) {
+					vkCmdDrawIndexed(commandBuffer, caster.indexCount, 1, caster.firstIndex, 0, 0);
+				}
+			}
+		}
+		if (casterFlags & vks::LayeredShadowMap::DynamicCasters) {
+			if (pushCaster(dynamicCaster.matrix, dynamicCaster.faceMask)) {
+				models.debugcube.draw(commandBuffer);
+			}
+		}
+	}
 
-		vkCmdEndRenderPass(commandBuffer);
+	VkShaderStageFlags pushConstantStages()
+	{
+		return VK_SHADER_STAGE_VERTEX_BIT | (enabledFeatures.geometryShader ? VK_SHADER_STAGE_GEOMETRY_BIT : 0);
 	}
 
-	void buildCommandBuffers()
+	// The shadow map update depends on the cache state and the culling results, so the command buffer is rebuilt every frame
+	void buildCommandBuffer(uint32_t i)
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
-		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
+		VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
+
+		if (timestampsSupported) {
+			timestamps.cmdBeginFrame(drawCmdBuffers[i], i);
+			timestamps.cmdWriteTimestamp(drawCmdBuffers[i], i, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+		}
+
+		/*
+			Generate the shadow cube map
+			Static casters are only rendered if the cache has been invalidated, dynamic casters are rendered on top of the cached distances
+		*/
+		shadowStatistics = {};
+		shadowMap.cmdUpdate(drawCmdBuffers[i], [this](VkCommandBuffer commandBuffer, uint32_t casterFlags, uint32_t face) {
+			drawShadowCasters(commandBuffer, casterFlags, face);
+		});
+
+		if (timestampsSupported) {
+			timestamps.cmdWriteTimestamp(drawCmdBuffers[i], i, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+		}
+
+		/*
+			Note: Explicit synchronization is not required between the render pass, as this is done implicit via sub pass dependencies
+		*/
+
+		/*
+			Scene rendering with applied shadow map
+		*/
 		{
-			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
+			VkClearValue clearValues[2];
+			clearValues[0].color = defaultClearColor;
+			clearValues[1].depthStencil = { 1.0f, 0 };
 
-			/*
-				Generate shadow cube maps using one render pass per face
-			*/
-			{
-				VkViewport viewport = vks::initializers::viewport((float)offscreenPass.width, (float)offscreenPass.height, 0.0f, 1.0f);
-				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+			VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+			renderPassBeginInfo.renderPass = renderPass;
+			renderPassBeginInfo.framebuffer = frameBuffers[i];
+			renderPassBeginInfo.renderArea.extent.width = width;
+			renderPassBeginInfo.renderArea.extent.height = height;
+			renderPassBeginInfo.clearValueCount = 2;
+			renderPassBeginInfo.pClearValues = clearValues;
 
-				VkRect2D scissor = vks::initializers::rect2D(offscreenPass.width, offscreenPass.height, 0, 0);
-				vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-				for (uint32_t face = 0; face < 6; face++) {
-					updateCubeFace(face, drawCmdBuffers[i]);
-				}
-			}
+			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
 
-			/*
-				Note: Explicit synchronization is not required between the render pass, as this is done implicit via sub pass dependencies
-			*/
+			VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
-			/*
-				Scene rendering with applied shadow map
-			*/
+			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.scene, 0, 1, &descriptorSets.scene, 0, NULL);
+
+			if (displayCubeMap)
 			{
-				VkClearValue clearValues[2];
-				clearValues[0].color = defaultClearColor;
-				clearValues[1].depthStencil = { 1.0f, 0 };
-
-				VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-				renderPassBeginInfo.renderPass = renderPass;
-				renderPassBeginInfo.framebuffer = frameBuffers[i];
-				renderPassBeginInfo.renderArea.extent.width = width;
-				renderPassBeginInfo.renderArea.extent.height = height;
-				renderPassBeginInfo.clearValueCount = 2;
-				renderPassBeginInfo.pClearValues = clearValues;
-
-				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-				VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
-				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-
-				VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
-				vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
-
-				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.scene, 0, 1, &descriptorSets.scene, 0, NULL);
-
-				if (displayCubeMap)
-				{
-					// Display all six sides of the shadow cube map
-					// Note: Visualization of the different faces is done in the fragment shader, see cubemapdisplay.frag
-					vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.cubemapDisplay);
-					models.debugcube.draw(drawCmdBuffers[i]);
-				}
-				else
-				{
-					vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.scene);
-					models.scene.draw(drawCmdBuffers[i]);
-				}
+				// Display all six sides of the shadow cube map
+				// Note: Visualization of the different faces is done in the fragment shader, see cubemapdisplay.frag
+				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.cubemapDisplay);
+				models.debugcube.draw(drawCmdBuffers[i]);
+			}
+			else
+			{
+				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.scene);
+				glm::mat4 model = glm::mat4(1.0f);
+				vkCmdPushConstants(drawCmdBuffers[i], pipelineLayouts.scene, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &model);
+				models.scene.draw(drawCmdBuffers[i]);
+				vkCmdPushConstants(drawCmdBuffers[i], pipelineLayouts.scene, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &dynamicCaster.matrix);
+				models.debugcube.draw(drawCmdBuffers[i]);
+			}
 
-				drawUI(drawCmdBuffers[i]);
+			drawUI(drawCmdBuffers[i]);
 
-				vkCmdEndRenderPass(drawCmdBuffers[i]);
-			}
+			vkCmdEndRenderPass(drawCmdBuffers[i]);
+		}
 
-			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+		if (timestampsSupported) {
+			timestamps.cmdResolve(drawCmdBuffers[i], i);
 		}
+
+		VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 	}
 
 	void loadAssets()
 	{
 		const uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::PreMultiplyVertexColors | vkglTF::FileLoadingFlags::FlipY;
 		models.debugcube.loadFromFile(getAssetPath() + "models/cube.gltf", vulkanDevice, queue, glTFLoadingFlags);
-		models.scene.loadFromFile(getAssetPath() + "models/shadowscene_fire.gltf", vulkanDevice, queue, glTFLoadingFlags);
+		// The vertices are kept to calculate the bounds of the shadow casters
+		models.scene.loadFromFile(getAssetPath() + "models/shadowscene_fire.gltf", vulkanDevice, queue, glTFLoadingFlags | vkglTF::FileLoadingFlags::KeepHostData);
 	}
 
 	void setupDescriptors()
@@ -529,8 +376,8 @@ public:
 
 		// Layout
 		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
-			// Binding 0 : Vertex shader uniform buffer
-			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0),
+			// Binding 0 : Vertex (and geometry) shader uniform buffer
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, pushConstantStages(), 0),
 			// Binding 1 : Fragment shader image sampler (cube map)
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1)
 		};
@@ -539,21 +386,14 @@ public:
 
 		// Sets
 		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
-		
+
 		// 3D scene
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets.scene));
-		// Image descriptor for the cube map
-		VkDescriptorImageInfo texDescriptor =
-			vks::initializers::descriptorImageInfo(
-				shadowCubeMap.sampler,
-				shadowCubeMap.view,
-				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
 		std::vector<VkWriteDescriptorSet> sceneDescriptorSets = {
 			// Binding 0 : Vertex shader uniform buffer
 			vks::initializers::writeDescriptorSet(descriptorSets.scene, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.scene.descriptor),
 			// Binding 1 : Fragment shader shadow sampler
-			vks::initializers::writeDescriptorSet(descriptorSets.scene, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &texDescriptor)
+			vks::initializers::writeDescriptorSet(descriptorSets.scene, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &shadowMap.descriptor)
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(sceneDescriptorSets.size()), sceneDescriptorSets.data(), 0, nullptr);
 
@@ -570,15 +410,16 @@ public:
 	{
 		// Layouts
 		// 3D scene pipeline layout
+		// Push constants for the model matrix of the dynamic caster
+		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_VERTEX_BIT, sizeof(glm::mat4), 0);
 		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.scene));
 
 		// Offscreen pipeline layout
-		// Push constants for cube map face view matrices
-		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_VERTEX_BIT, sizeof(glm::mat4), 0);
-		// Push constant ranges are part of the pipeline layout
-		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
-		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+		// Push constants for the caster's model matrix and the cube map faces it's rendered to
+		pushConstantRange = vks::initializers::pushConstantRange(pushConstantStages(), sizeof(ShadowPushConstants), 0);
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.offscreen));
 
 
@@ -595,7 +436,7 @@ public:
 
 		// 3D scene pipeline
 		// Load shaders
-		std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
+		std::array<VkPipelineShaderStageCreateInfo, 3> shaderStages;
 
 		shaderStages[0] = loadShader(getShadersPath() + "shadowmappingomni/scene.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
 		shaderStages[1] = loadShader(getShadersPath() + "shadowmappingomni/scene.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
@@ -608,17 +449,24 @@ public:
 		pipelineCI.pViewportState = &viewportState;
 		pipelineCI.pDepthStencilState = &depthStencilState;
 		pipelineCI.pDynamicState = &dynamicState;
-		pipelineCI.stageCount = static_cast<uint32_t>(shaderStages.size());
+		pipelineCI.stageCount = 2;
 		pipelineCI.pStages = shaderStages.data();
 		pipelineCI.pVertexInputState = vkglTF::Vertex::getPipelineVertexInputState({vkglTF::VertexComponent::Position, vkglTF::VertexComponent::Color, vkglTF::VertexComponent::Normal});
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.scene));
 
-		// Offscreen pipeline
+		// Offscreen pipelines
 		shaderStages[0] = loadShader(getShadersPath() + "shadowmappingomni/offscreen.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
 		shaderStages[1] = loadShader(getShadersPath() + "shadowmappingomni/offscreen.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
 		pipelineCI.layout = pipelineLayouts.offscreen;
-		pipelineCI.renderPass = offscreenPass.renderPass;
+		pipelineCI.renderPass = shadowMap.renderPass;
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.offscreen));
+		// The layered pipeline uses geometry shader instancing (invocations layout modifier) to output each triangle to all cube map faces
+		if (enabledFeatures.geometryShader) {
+			shaderStages[2] = loadShader(getShadersPath() + "shadowmappingomni/offscreen.geom.spv", VK_SHADER_STAGE_GEOMETRY_BIT);
+			pipelineCI.stageCount = 3;
+			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.offscreenLayered));
+			pipelineCI.stageCount = 2;
+		}
 
 		// Cube map display pipeline
 		shaderStages[0] = loadShader(getShadersPath() + "shadowmappingomni/cubemapdisplay.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
@@ -635,7 +483,7 @@ public:
 	void prepareUniformBuffers()
 	{
 		// Offscreen vertex shader uniform buffer
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffers.offscreen, sizeof(UniformData)));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffers.offscreen, sizeof(UniformDataOffscreen)));
 		// Scene vertex shader uniform buffer
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffers.scene, sizeof(UniformData)));
 		// Map persistent
@@ -654,18 +502,60 @@ public:
 
 	void updateUniformBufferOffscreen()
 	{
-		lightPos.x = sin(glm::radians(timer * 360.0f)) * 0.15f;
-		lightPos.z = cos(glm::radians(timer * 360.0f)) * 0.15f;
-		uniformDataOffscreen.projection = glm::perspective((float)(M_PI / 2.0), 1.0f, zNear, zFar);
-		uniformDataOffscreen.view = glm::mat4(1.0f);
-		uniformDataOffscreen.model = glm::translate(glm::mat4(1.0f), glm::vec3(-lightPos.x, -lightPos.y, -lightPos.z));
+		if (animateLight) {
+			lightPos.x = sin(glm::radians(timer * 360.0f)) * 0.15f;
+			lightPos.z = cos(glm::radians(timer * 360.0f)) * 0.15f;
+		}
+		if (animateCaster && !paused) {
+			dynamicCaster.angle += frameTimer * 45.0f;
+		}
+		dynamicCaster.matrix = glm::translate(glm::mat4(1.0f), glm::vec3(lightPos) + glm::vec3(cos(glm::radians(dynamicCaster.angle)) * 1.25f, 1.0f, sin(glm::radians(dynamicCaster.angle)) * 1.25f));
+		dynamicCaster.matrix = glm::rotate(dynamicCaster.matrix, glm::radians(dynamicCaster.angle * 2.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		dynamicCaster.matrix = glm::scale(dynamicCaster.matrix, glm::vec3(dynamicCaster.scale));
+
+		const glm::mat4 projection = glm::perspective((float)(M_PI / 2.0), 1.0f, zNear, zFar);
+		const glm::mat4 lightTranslation = glm::translate(glm::mat4(1.0f), glm::vec3(-lightPos.x, -lightPos.y, -lightPos.z));
+		for (uint32_t face = 0; face < 6; face++) {
+			glm::mat4 viewMatrix = glm::mat4(1.0f);
+			switch (face)
+			{
+			case 0: // POSITIVE_X
+				viewMatrix = glm::rotate(viewMatrix, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+				viewMatrix = glm::rotate(viewMatrix, glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+				break;
+			case 1:	// NEGATIVE_X
+				viewMatrix = glm::rotate(viewMatrix, glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+				viewMatrix = glm::rotate(viewMatrix, glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+				break;
+			case 2:	// POSITIVE_Y
+				viewMatrix = glm::rotate(viewMatrix, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+				break;
+			case 3:	// NEGATIVE_Y
+				viewMatrix = glm::rotate(viewMatrix, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+				break;
+			case 4:	// POSITIVE_Z
+				viewMatrix = glm::rotate(viewMatrix, glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+				break;
+			case 5:	// NEGATIVE_Z
+				viewMatrix = glm::rotate(viewMatrix, glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+				break;
+			}
+			uniformDataOffscreen.faceViewProjections[face] = projection * viewMatrix * lightTranslation;
+		}
 		uniformDataOffscreen.lightPos = lightPos;
-		memcpy(uniformBuffers.offscreen.mapped, &uniformDataOffscreen, sizeof(UniformData));
+		memcpy(uniformBuffers.offscreen.mapped, &uniformDataOffscreen, sizeof(UniformDataOffscreen));
 	}
 
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
+		// The previous submission of this command buffer has finished, so its timestamps can be read without waiting
+		if (timestampsSupported) {
+			const float period = vulkanDevice->properties.limits.timestampPeriod / 1000000.0f;
+			shadowPassTime = (timestamps.getResult(currentBuffer, 1) - timestamps.getResult(currentBuffer, 0)) * period;
+		}
+		updateShadowCasters();
+		buildCommandBuffer(currentBuffer);
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
@@ -676,13 +566,12 @@ public:
 	{
 		VulkanExampleBase::prepare();
 		loadAssets();
+		prepareShadowCasters();
 		prepareUniformBuffers();
-		prepareCubeMap();
+		prepareShadowMap();
+		prepareTimestamps();
 		setupDescriptors();
-		prepareOffscreenRenderpass();
 		preparePipelines();
-		prepareOffscreenFramebuffer();
-		buildCommandBuffers();
 		prepared = true;
 	}
 
@@ -698,9 +587,23 @@ public:
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
 		if (overlay->header("Settings")) {
-			if (overlay->checkBox("Display shadow cube render target", &displayCubeMap)) {
-				buildCommandBuffers();
+			overlay->checkBox("Display shadow cube render target", &displayCubeMap);
+			overlay->checkBox("Animate light", &animateLight);
+			overlay->checkBox("Animate dynamic caster", &animateCaster);
+			overlay->checkBox("Cache static casters", &shadowMap.settings.cacheStaticCasters);
+			overlay->checkBox("Per-face culling", &perFaceCulling);
+			if (enabledFeatures.geometryShader) {
+				overlay->checkBox("Single pass (geometry shader)", &shadowMap.settings.layered);
+			}
+		}
+		if (overlay->header("Shadow pass")) {
+			if (timestampsSupported) {
+				overlay->text("GPU time: %.3f ms", shadowPassTime);
 			}
+			overlay->text("Render passes: %d", shadowMap.statistics.renderPasses);
+			overlay->text("Draws: %d", shadowStatistics.draws);
+			overlay->text("Face draws: %d of %d", shadowStatistics.faceDraws, shadowStatistics.unculledFaceDraws);
+			overlay->text("Static casters: %s", shadowMap.statistics.staticPassRendered ? "rendered" : "cached");
 		}
 	}
 };
@@ -1,6 +1,10 @@
 /*
 * Vulkan Example - Screen space ambient occlusion example
 *
+* Compares the sample kernel based SSAO fragment shader with a compute path that calculates ground truth based ambient
+* occlusion (GTAO) at a reduced resolution from depth and normals, with interleaved sampling, temporal accumulation
+* and depth aware upsampling
+*
 * Copyright (C) by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
@@ -8,6 +12,8 @@
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "VulkanRenderGraph.h"
+#include "VulkanQueryManager.h"
 
 #define SSAO_KERNEL_SIZE 64
 #define SSAO_RADIUS 0.3f
@@ -19,6 +25,8 @@
 #define SSAO_NOISE_DIM 8
 #endif
 
+#define GTAO_RADIUS 0.5f
+
 class VulkanExample : public VulkanExampleBase
 {
 public:
@@ -40,11 +48,57 @@ public:
 		int32_t ssaoBlur = true;
 	} uboSSAOParams;
 
+	enum AOMethod { FragmentSSAO = 0, ComputeGTAO = 1 };
+	int32_t aoMethod = ComputeGTAO;
+
+	struct UBOGTAOParams {
+		glm::mat4 projection;
+		glm::mat4 inverseView;
+		glm::mat4 previousView;
+		float radius = GTAO_RADIUS;
+		int32_t sliceCount;
+		int32_t stepCount;
+		// Shifts the interleaved sampling pattern every frame, zero without temporal accumulation
+		int32_t frameIndex = 0;
+		// Ratio of the full to the ambient occlusion resolution
+		int32_t scale;
+		float maxHistoryLength = 16.0f;
+	} uboGTAOParams;
+
+	// Settings of the compute path, the resolution and quality trade image quality for GPU time
+	struct GTAOQuality {
+		std::string name;
+		int32_t sliceCount;
+		int32_t stepCount;
+	};
+	const std::vector<GTAOQuality> gtaoQualityLevels = { { "Low", 2, 4 }, { "Medium", 3, 6 }, { "High", 4, 10 } };
+	const std::vector<std::string> gtaoResolutionNames = { "Full", "Half", "Quarter" };
+	struct {
+		// Index into gtaoResolutionNames, the ambient occlusion is calculated at 1 / (2 ^ resolution) of the window size
+		int32_t resolution = 1;
+		int32_t quality = 1;
+		bool temporal = true;
+	} gtaoSettings;
+	uint32_t frameIndex{ 0 };
+
+	// Accumulated ambient occlusion of the previous frame (occlusion, depth, history length), persists across frames so it's owned by the example
+	struct {
+		VkImage image{ VK_NULL_HANDLE };
+		VkDeviceMemory memory{ VK_NULL_HANDLE };
+		VkImageView view{ VK_NULL_HANDLE };
+		uint32_t width{ 0 };
+		uint32_t height{ 0 };
+	} gtaoHistory;
+
 	struct {
 		VkPipeline offscreen{ VK_NULL_HANDLE };
 		VkPipeline composition{ VK_NULL_HANDLE };
 		VkPipeline ssao{ VK_NULL_HANDLE };
 		VkPipeline ssaoBlur{ VK_NULL_HANDLE };
+		VkPipeline gtaoDepth{ VK_NULL_HANDLE };
+		VkPipeline gtao{ VK_NULL_HANDLE };
+		VkPipeline gtaoTemporal{ VK_NULL_HANDLE };
+		VkPipeline gtaoUpsample{ VK_NULL_HANDLE };
 	} pipelines;
 
 	struct {
@@ -52,6 +106,8 @@ public:
 		VkPipelineLayout ssao{ VK_NULL_HANDLE };
 		VkPipelineLayout ssaoBlur{ VK_NULL_HANDLE };
 		VkPipelineLayout composition{ VK_NULL_HANDLE };
+		// Shared by all GTAO compute passes
+		VkPipelineLayout gtao{ VK_NULL_HANDLE };
 	} pipelineLayouts;
 
 	struct {
@@ -59,7 +115,11 @@ public:
 		VkDescriptorSet ssao{ VK_NULL_HANDLE };
 		VkDescriptorSet ssaoBlur{ VK_NULL_HANDLE };
 		VkDescriptorSet composition{ VK_NULL_HANDLE };
-		const uint32_t count = 4;
+		VkDescriptorSet gtaoDepth{ VK_NULL_HANDLE };
+		VkDescriptorSet gtao{ VK_NULL_HANDLE };
+		VkDescriptorSet gtaoTemporal{ VK_NULL_HANDLE };
+		VkDescriptorSet gtaoUpsample{ VK_NULL_HANDLE };
+		const uint32_t count = 8;
 	} descriptorSets;
 
 	struct {
@@ -67,58 +127,85 @@ public:
 		VkDescriptorSetLayout ssao{ VK_NULL_HANDLE };
 		VkDescriptorSetLayout ssaoBlur{ VK_NULL_HANDLE };
 		VkDescriptorSetLayout composition{ VK_NULL_HANDLE };
+		VkDescriptorSetLayout gtao{ VK_NULL_HANDLE };
 	} descriptorSetLayouts;
 
 	struct {
 		vks::Buffer sceneParams;
 		vks::Buffer ssaoKernel;
 		vks::Buffer ssaoParams;
+		vks::Buffer gtaoParams;
 	} uniformBuffers;
 
-	// Framebuffer for offscreen rendering
-	struct FrameBufferAttachment {
-		VkImage image;
-		VkDeviceMemory mem;
-		VkImageView view;
-		VkFormat format;
-		void destroy(VkDevice device)
-		{
-			vkDestroyImage(device, image, nullptr);
-			vkDestroyImageView(device, view, nullptr);
-			vkFreeMemory(device, mem, nullptr);
-		}
-	};
-	struct FrameBuffer {
-		int32_t width, height;
-		VkFramebuffer frameBuffer;
-		VkRenderPass renderPass;
-		void setSize(int32_t w, int32_t h)
-		{
-			this->width = w;
-			this->height = h;
-		}
-		void destroy(VkDevice device)
-		{
-			vkDestroyFramebuffer(device, frameBuffer, nullptr);
-			vkDestroyRenderPass(device, renderPass, nullptr);
-		}
-	};
-
+	// The G-buffer and SSAO targets are transient images of the render graph, the SSAO passes are culled if their result isn't displayed
+	vks::RenderGraph renderGraph;
+	struct {
+		vks::RenderGraph::ResourceHandle position;
+		vks::RenderGraph::ResourceHandle normal;
+		vks::RenderGraph::ResourceHandle albedo;
+		vks::RenderGraph::ResourceHandle depth;
+		vks::RenderGraph::ResourceHandle ssao;
+		vks::RenderGraph::ResourceHandle ssaoBlur;
+		vks::RenderGraph::ResourceHandle gtaoDepth;
+		vks::RenderGraph::ResourceHandle gtaoRaw;
+		vks::RenderGraph::ResourceHandle gtaoAccumulated;
+		vks::RenderGraph::ResourceHandle gtaoHistory;
+		vks::RenderGraph::ResourceHandle gtao;
+		vks::RenderGraph::ResourceHandle swapChainImage;
+		vks::RenderGraph::ResourceHandle depthStencil;
+	} graphResources{};
 	struct {
-		struct Offscreen : public FrameBuffer {
-			FrameBufferAttachment position, normal, albedo, depth;
-		} offscreen;
-		struct SSAO : public FrameBuffer {
-			FrameBufferAttachment color;
-		} ssao, ssaoBlur;
-	} frameBuffers{};
+		vks::RenderGraph::PassHandle gBuffer;
+		vks::RenderGraph::PassHandle ssao;
+		vks::RenderGraph::PassHandle ssaoBlur;
+		vks::RenderGraph::PassHandle gtaoDepth;
+		vks::RenderGraph::PassHandle gtao;
+		vks::RenderGraph::PassHandle gtaoTemporal;
+		vks::RenderGraph::PassHandle gtaoUpsample;
+		vks::RenderGraph::PassHandle composition;
+	} graphPasses{};
 
 	// One sampler for the frame buffer color attachments
 	VkSampler colorSampler;
 
+	// GPU times of the passes are measured with timestamps written before, between and after them
+	vks::QueryManager timestamps;
+	bool timestampsSupported{ false };
+	// Command buffer currently recorded, used by the pass callbacks to write the timestamps
+	uint32_t recordingFrame{ 0 };
+	struct {
+		float gBuffer{ 0.0f };
+		float ambientOcclusion{ 0.0f };
+		float composition{ 0.0f };
+	} passTimes;
+
+	// Measures the GPU time of the ambient occlusion passes for every method, resolution and quality
+	struct AOSetting {
+		int32_t method;
+		int32_t resolution;
+		int32_t quality;
+	};
+	struct AOTimingResult {
+		std::string name;
+		float ambientOcclusion;
+	};
+	struct {
+		std::vector<AOSetting> settings;
+		// Frames rendered with a new setting before measuring, the timestamps lag behind by the number of command buffers
+		const uint32_t warmupFrames = 16;
+		const uint32_t measuredFrames = 64;
+		bool active{ false };
+		uint32_t step{ 0 };
+		uint32_t frame{ 0 };
+		AOSetting previousSetting{};
+		std::vector<AOTimingResult> results;
+	} aoTimings;
+
 	VulkanExample() : VulkanExampleBase()
 	{
 		title = "Screen space ambient occlusion";
+		// The compute GTAO path only has GLSL shaders
+		requireGlslShaders();
 		camera.type = Camera::CameraType::firstperson;
 #ifndef __ANDROID__
 		camera.rotationSpeed = 0.25f;
@@ -133,38 +220,39 @@ public:
 		if (device) {
 			vkDestroySampler(device, colorSampler, nullptr);
 
-			// Attachments
-			frameBuffers.offscreen.position.destroy(device);
-			frameBuffers.offscreen.normal.destroy(device);
-			frameBuffers.offscreen.albedo.destroy(device);
-			frameBuffers.offscreen.depth.destroy(device);
-			frameBuffers.ssao.color.destroy(device);
-			frameBuffers.ssaoBlur.color.destroy(device);
+			renderGraph.destroy();
+			destroyHistory();
 
-			// Framebuffers
-			frameBuffers.offscreen.destroy(device);
-			frameBuffers.ssao.destroy(device);
-			frameBuffers.ssaoBlur.destroy(device);
+			if (timestampsSupported) {
+				timestamps.destroy();
+			}
 
 			vkDestroyPipeline(device, pipelines.offscreen, nullptr);
 			vkDestroyPipeline(device, pipelines.composition, nullptr);
 			vkDestroyPipeline(device, pipelines.ssao, nullptr);
 			vkDestroyPipeline(device, pipelines.ssaoBlur, nullptr);
+			vkDestroyPipeline(device, pipelines.gtaoDepth, nullptr);
+			vkDestroyPipeline(device, pipelines.gtao, nullptr);
+			vkDestroyPipeline(device, pipelines.gtaoTemporal, nullptr);
+			vkDestroyPipeline(device, pipelines.gtaoUpsample, nullptr);
 
 			vkDestroyPipelineLayout(device, pipelineLayouts.gBuffer, nullptr);
 			vkDestroyPipelineLayout(device, pipelineLayouts.ssao, nullptr);
 			vkDestroyPipelineLayout(device, pipelineLayouts.ssaoBlur, nullptr);
 			vkDestroyPipelineLayout(device, pipelineLayouts.composition, nullptr);
+			vkDestroyPipelineLayout(device, pipelineLayouts.gtao, nullptr);
 
 			vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.gBuffer, nullptr);
 			vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.ssao, nullptr);
 			vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.ssaoBlur, nullptr);
 			vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.composition, nullptr);
+			vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.gtao, nullptr);
 
 			// Uniform buffers
 			uniformBuffers.sceneParams.destroy();
 			uniformBuffers.ssaoKernel.destroy();
 			uniformBuffers.ssaoParams.destroy();
+			uniformBuffers.gtaoParams.destroy();
 
 			ssaoNoise.destroy();
 		}
@@ -175,69 +263,61 @@ public:
 		enabledFeatures.samplerAnisotropy = deviceFeatures.samplerAnisotropy;
 	}
 
-	// Create a frame buffer attachment
-	void createAttachment(
-		VkFormat format,
-		VkImageUsageFlagBits usage,
-		FrameBufferAttachment *attachment,
-		uint32_t width,
-		uint32_t height)
+	// The history matches the resolution of the ambient occlusion, it's recreated (and cleared) whenever the graph changes
+	// as it may be outdated or have a different size
+	void prepareHistory(uint32_t historyWidth, uint32_t historyHeight)
 	{
-		VkImageAspectFlags aspectMask = 0;
-
-		attachment->format = format;
-
-		if (usage & VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT)
-		{
-			aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		}
-		if (usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)
-		{
-			aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-			if (format >= VK_FORMAT_D16_UNORM_S8_UINT)
-				aspectMask |=VK_IMAGE_ASPECT_STENCIL_BIT;
-		}
-
-		assert(aspectMask > 0);
-
-		VkImageCreateInfo image = vks::initializers::imageCreateInfo();
-		image.imageType = VK_IMAGE_TYPE_2D;
-		image.format = format;
-		image.extent.width = width;
-		image.extent.height = height;
-		image.extent.depth = 1;
-		image.mipLevels = 1;
-		image.arrayLayers = 1;
-		image.samples = VK_SAMPLE_COUNT_1_BIT;
-		image.tiling = VK_IMAGE_TILING_OPTIMAL;
-		image.usage = usage | VK_IMAGE_USAGE_SAMPLED_BIT;
-
-		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+		destroyHistory();
+		gtaoHistory.width = historyWidth;
+		gtaoHistory.height = historyHeight;
+
+		VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+		imageCI.imageType = VK_IMAGE_TYPE_2D;
+		imageCI.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+		imageCI.extent = { historyWidth, historyHeight, 1 };
+		imageCI.mipLevels = 1;
+		imageCI.arrayLayers = 1;
+		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &gtaoHistory.image));
 		VkMemoryRequirements memReqs;
-
-		VK_CHECK_RESULT(vkCreateImage(device, &image, nullptr, &attachment->image));
-		vkGetImageMemoryRequirements(device, attachment->image, &memReqs);
+		vkGetImageMemoryRequirements(device, gtaoHistory.image, &memReqs);
+		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
 		memAlloc.allocationSize = memReqs.size;
 		memAlloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &attachment->mem));
-		VK_CHECK_RESULT(vkBindImageMemory(device, attachment->image, attachment->mem, 0));
-
-		VkImageViewCreateInfo imageView = vks::initializers::imageViewCreateInfo();
-		imageView.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		imageView.format = format;
-		imageView.subresourceRange = {};
-		imageView.subresourceRange.aspectMask = aspectMask;
-		imageView.subresourceRange.baseMipLevel = 0;
-		imageView.subresourceRange.levelCount = 1;
-		imageView.subresourceRange.baseArrayLayer = 0;
-		imageView.subresourceRange.layerCount = 1;
-		imageView.image = attachment->image;
-		VK_CHECK_RESULT(vkCreateImageView(device, &imageView, nullptr, &attachment->view));
+		VK_CHECK_RESULT(vkAllocateMemory(device, &memAlloc, nullptr, &gtaoHistory.memory));
+		VK_CHECK_RESULT(vkBindImageMemory(device, gtaoHistory.image, gtaoHistory.memory, 0));
+
+		VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+		viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewCI.format = imageCI.format;
+		viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		viewCI.image = gtaoHistory.image;
+		VK_CHECK_RESULT(vkCreateImageView(device, &viewCI, nullptr, &gtaoHistory.view));
+
+		// A history length of zero makes the first frame ignore the history, it's kept in the general layout between frames
+		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		vks::tools::insertImageMemoryBarrier(copyCmd, gtaoHistory.image, 0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, subresourceRange);
+		VkClearColorValue clearValue = { { 1.0f, 0.0f, 0.0f, 0.0f } };
+		vkCmdClearColorImage(copyCmd, gtaoHistory.image, VK_IMAGE_LAYOUT_GENERAL, &clearValue, 1, &subresourceRange);
+		vks::tools::insertImageMemoryBarrier(copyCmd, gtaoHistory.image, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, subresourceRange);
+		vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
+	}
+
+	void destroyHistory()
+	{
+		vkDestroyImageView(device, gtaoHistory.view, nullptr);
+		vkDestroyImage(device, gtaoHistory.image, nullptr);
+		vkFreeMemory(device, gtaoHistory.memory, nullptr);
+		gtaoHistory = {};
 	}
 
-	void prepareOffscreenFramebuffers()
+	// Declare the passes and the images they access, the render graph derives the render passes, barriers and memory layout from this
+	// This is also called when the settings change, as they decide which passes contribute to the final image
+	void prepareRenderGraph()
 	{
-		// Attachments
 #if defined(__ANDROID__)
 		const uint32_t ssaoWidth = width / 2;
 		const uint32_t ssaoHeight = height / 2;
@@ -245,225 +325,185 @@ public:
 		const uint32_t ssaoWidth = width;
 		const uint32_t ssaoHeight = height;
 #endif
+		const uint32_t gtaoScale = 1 << gtaoSettings.resolution;
+		const uint32_t gtaoWidth = (width + gtaoScale - 1) / gtaoScale;
+		const uint32_t gtaoHeight = (height + gtaoScale - 1) / gtaoScale;
+		uboGTAOParams.scale = static_cast<int32_t>(gtaoScale);
+		prepareHistory(gtaoWidth, gtaoHeight);
 
-		frameBuffers.offscreen.setSize(width, height);
-		frameBuffers.ssao.setSize(ssaoWidth, ssaoHeight);
-		frameBuffers.ssaoBlur.setSize(width, height);
-
-		// Find a suitable depth format
-		VkFormat attDepthFormat;
-		VkBool32 validDepthFormat = vks::tools::getSupportedDepthFormat(physicalDevice, &attDepthFormat);
-		assert(validDepthFormat);
+		renderGraph.clear();
 
 		// G-Buffer
-		createAttachment(VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &frameBuffers.offscreen.position, width, height);	// Position + Depth
-		createAttachment(VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &frameBuffers.offscreen.normal, width, height);			// Normals
-		createAttachment(VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &frameBuffers.offscreen.albedo, width, height);			// Albedo (color)
-		createAttachment(attDepthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, &frameBuffers.offscreen.depth, width, height);			// Depth
+		vks::RenderGraph::ImageDesc imageDesc{};
+		imageDesc.width = width;
+		imageDesc.height = height;
+		imageDesc.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+		graphResources.position = renderGraph.createImage("Position", imageDesc);		// Position + Depth
+		imageDesc.format = VK_FORMAT_R8G8B8A8_UNORM;
+		graphResources.normal = renderGraph.createImage("Normal", imageDesc);			// Normals
+		graphResources.albedo = renderGraph.createImage("Albedo", imageDesc);			// Albedo (color)
+		VkBool32 validDepthFormat = vks::tools::getSupportedDepthFormat(physicalDevice, &imageDesc.format);
+		assert(validDepthFormat);
+		graphResources.depth = renderGraph.createImage("G-Buffer depth", imageDesc);	// Depth
 
 		// SSAO
-		createAttachment(VK_FORMAT_R8_UNORM, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &frameBuffers.ssao.color, ssaoWidth, ssaoHeight);				// Color
+		imageDesc.format = VK_FORMAT_R8_UNORM;
+		imageDesc.width = ssaoWidth;
+		imageDesc.height = ssaoHeight;
+		graphResources.ssao = renderGraph.createImage("SSAO", imageDesc);
 
 		// SSAO blur
-		createAttachment(VK_FORMAT_R8_UNORM, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &frameBuffers.ssaoBlur.color, width, height);					// Color
-
-		// Render passes
-
-		// G-Buffer creation
-		{
-			std::array<VkAttachmentDescription, 4> attachmentDescs = {};
-
-			// Init attachment properties
-			for (uint32_t i = 0; i < static_cast<uint32_t>(attachmentDescs.size()); i++)
-			{
-				attachmentDescs[i].samples = VK_SAMPLE_COUNT_1_BIT;
-				attachmentDescs[i].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-				attachmentDescs[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-				attachmentDescs[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-				attachmentDescs[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-				attachmentDescs[i].finalLayout = (i == 3) ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageDesc.width = width;
+		imageDesc.height = height;
+		graphResources.ssaoBlur = renderGraph.createImage("SSAO blur", imageDesc);
+
+		// GTAO, all targets but the upsampled result are at the reduced resolution
+		imageDesc.format = VK_FORMAT_R32_SFLOAT;
+		graphResources.gtao = renderGraph.createImage("GTAO", imageDesc);
+		imageDesc.width = gtaoWidth;
+		imageDesc.height = gtaoHeight;
+		graphResources.gtaoDepth = renderGraph.createImage("GTAO depth", imageDesc);
+		graphResources.gtaoRaw = renderGraph.createImage("GTAO raw", imageDesc);
+		imageDesc.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+		graphResources.gtaoAccumulated = renderGraph.createImage("GTAO accumulated", imageDesc);
+		vks::RenderGraph::ImportedImage historyImage{};
+		historyImage.image = gtaoHistory.image;
+		historyImage.view = gtaoHistory.view;
+		historyImage.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+		historyImage.width = gtaoHistory.width;
+		historyImage.height = gtaoHistory.height;
+		// Last written by the upsampling of the previous frame
+		historyImage.initialLayout = VK_IMAGE_LAYOUT_GENERAL;
+		historyImage.initialStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		historyImage.initialAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		historyImage.finalLayout = VK_IMAGE_LAYOUT_GENERAL;
+		graphResources.gtaoHistory = renderGraph.importImage("GTAO history", historyImage);
+
+		// The images of the default frame buffers are imported, the swap chain image is set for each command buffer
+		vks::RenderGraph::ImportedImage swapChainImage{};
+		swapChainImage.format = swapChain.colorFormat;
+		// Rendering waits for the image to be acquired at the color attachment output stage
+		swapChainImage.initialStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		swapChainImage.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		graphResources.swapChainImage = renderGraph.importImage("Swap chain image", swapChainImage);
+		vks::RenderGraph::ImportedImage depthStencilImage{};
+		depthStencilImage.format = depthFormat;
+		depthStencilImage.initialStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		depthStencilImage.initialAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		graphResources.depthStencil = renderGraph.importImage("Depth stencil", depthStencilImage);
+
+		// First pass: Fill G-Buffer components (positions+depth, normals, albedo) using MRT
+		graphPasses.gBuffer = renderGraph.addGraphicsPass("G-Buffer", [this](VkCommandBuffer commandBuffer) {
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.offscreen);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.gBuffer, 0, 1, &descriptorSets.gBuffer, 0, nullptr);
+			scene.draw(commandBuffer, vkglTF::RenderFlags::BindImages, pipelineLayouts.gBuffer);
+			if (timestampsSupported) {
+				timestamps.cmdWriteTimestamp(commandBuffer, recordingFrame, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
 			}
-
-			// Formats
-			attachmentDescs[0].format = frameBuffers.offscreen.position.format;
-			attachmentDescs[1].format = frameBuffers.offscreen.normal.format;
-			attachmentDescs[2].format = frameBuffers.offscreen.albedo.format;
-			attachmentDescs[3].format = frameBuffers.offscreen.depth.format;
-
-			std::vector<VkAttachmentReference> colorReferences;
-			colorReferences.push_back({ 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
-			colorReferences.push_back({ 1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
-			colorReferences.push_back({ 2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
-
-			VkAttachmentReference depthReference = {};
-			depthReference.attachment = 3;
-			depthReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-			VkSubpassDescription subpass = {};
-			subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-			subpass.pColorAttachments = colorReferences.data();
-			subpass.colorAttachmentCount = static_cast<uint32_t>(colorReferences.size());
-			subpass.pDepthStencilAttachment = &depthReference;
-
-			// Use subpass dependencies for attachment layout transitions
-			std::array<VkSubpassDependency, 2> dependencies;
-
-			dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-			dependencies[0].dstSubpass = 0;
-			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-			dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-			dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-			dependencies[1].srcSubpass = 0;
-			dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-			dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-			dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-			VkRenderPassCreateInfo renderPassInfo = {};
-			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-			renderPassInfo.pAttachments = attachmentDescs.data();
-			renderPassInfo.attachmentCount = static_cast<uint32_t>(attachmentDescs.size());
-			renderPassInfo.subpassCount = 1;
-			renderPassInfo.pSubpasses = &subpass;
-			renderPassInfo.dependencyCount = 2;
-			renderPassInfo.pDependencies = dependencies.data();
-			VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &frameBuffers.offscreen.renderPass));
-
-			std::array<VkImageView, 4> attachments;
-			attachments[0] = frameBuffers.offscreen.position.view;
-			attachments[1] = frameBuffers.offscreen.normal.view;
-			attachments[2] = frameBuffers.offscreen.albedo.view;
-			attachments[3] = frameBuffers.offscreen.depth.view;
-
-			VkFramebufferCreateInfo fbufCreateInfo = vks::initializers::framebufferCreateInfo();
-			fbufCreateInfo.renderPass = frameBuffers.offscreen.renderPass;
-			fbufCreateInfo.pAttachments = attachments.data();
-			fbufCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-			fbufCreateInfo.width = frameBuffers.offscreen.width;
-			fbufCreateInfo.height = frameBuffers.offscreen.height;
-			fbufCreateInfo.layers = 1;
-			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &frameBuffers.offscreen.frameBuffer));
+		});
+		renderGraph.addColorAttachment(graphPasses.gBuffer, graphResources.position);
+		renderGraph.addColorAttachment(graphPasses.gBuffer, graphResources.normal);
+		renderGraph.addColorAttachment(graphPasses.gBuffer, graphResources.albedo);
+		renderGraph.setDepthStencilAttachment(graphPasses.gBuffer, graphResources.depth);
+
+		// Second pass: SSAO generation
+		graphPasses.ssao = renderGraph.addGraphicsPass("SSAO", [this](VkCommandBuffer commandBuffer) {
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.ssao, 0, 1, &descriptorSets.ssao, 0, nullptr);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.ssao);
+			vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+		});
+		renderGraph.addColorAttachment(graphPasses.ssao, graphResources.ssao);
+		renderGraph.addSampledImage(graphPasses.ssao, graphResources.position);
+		renderGraph.addSampledImage(graphPasses.ssao, graphResources.normal);
+
+		// Third pass: SSAO blur
+		graphPasses.ssaoBlur = renderGraph.addGraphicsPass("SSAO blur", [this](VkCommandBuffer commandBuffer) {
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.ssaoBlur, 0, 1, &descriptorSets.ssaoBlur, 0, nullptr);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.ssaoBlur);
+			vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+		});
+		renderGraph.addColorAttachment(graphPasses.ssaoBlur, graphResources.ssaoBlur);
+		renderGraph.addSampledImage(graphPasses.ssaoBlur, graphResources.ssao);
+
+		// Alternative to the second and third pass: GTAO with compute shaders
+		// The low resolution depth is the only depth the occlusion and temporal passes read
+		graphPasses.gtaoDepth = renderGraph.addComputePass("GTAO depth", [this, gtaoWidth, gtaoHeight](VkCommandBuffer commandBuffer) {
+			dispatchGTAO(commandBuffer, pipelines.gtaoDepth, descriptorSets.gtaoDepth, gtaoWidth, gtaoHeight);
+		});
+		renderGraph.addSampledImage(graphPasses.gtaoDepth, graphResources.position, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		renderGraph.addStorageImage(graphPasses.gtaoDepth, graphResources.gtaoDepth, true);
+
+		graphPasses.gtao = renderGraph.addComputePass("GTAO", [this, gtaoWidth, gtaoHeight](VkCommandBuffer commandBuffer) {
+			dispatchGTAO(commandBuffer, pipelines.gtao, descriptorSets.gtao, gtaoWidth, gtaoHeight);
+		});
+		renderGraph.addSampledImage(graphPasses.gtao, graphResources.gtaoDepth, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		renderGraph.addSampledImage(graphPasses.gtao, graphResources.normal, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		renderGraph.addStorageImage(graphPasses.gtao, graphResources.gtaoRaw, true);
+
+		graphPasses.gtaoTemporal = renderGraph.addComputePass("GTAO temporal", [this, gtaoWidth, gtaoHeight](VkCommandBuffer commandBuffer) {
+			dispatchGTAO(commandBuffer, pipelines.gtaoTemporal, descriptorSets.gtaoTemporal, gtaoWidth, gtaoHeight);
+		});
+		renderGraph.addSampledImage(graphPasses.gtaoTemporal, graphResources.gtaoRaw, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		renderGraph.addSampledImage(graphPasses.gtaoTemporal, graphResources.gtaoDepth, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		renderGraph.addSampledImage(graphPasses.gtaoTemporal, graphResources.gtaoHistory, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		renderGraph.addStorageImage(graphPasses.gtaoTemporal, graphResources.gtaoAccumulated, true);
+
+		// Covers all low resolution texels, which may extend beyond the full resolution
+		graphPasses.gtaoUpsample = renderGraph.addComputePass("GTAO upsample", [this, gtaoWidth, gtaoHeight, gtaoScale](VkCommandBuffer commandBuffer) {
+			dispatchGTAO(commandBuffer, pipelines.gtaoUpsample, descriptorSets.gtaoUpsample, gtaoWidth * gtaoScale, gtaoHeight * gtaoScale);
+		});
+		renderGraph.addSampledImage(graphPasses.gtaoUpsample, gtaoSettings.temporal ? graphResources.gtaoAccumulated : graphResources.gtaoRaw, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		renderGraph.addSampledImage(graphPasses.gtaoUpsample, graphResources.gtaoDepth, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		renderGraph.addSampledImage(graphPasses.gtaoUpsample, graphResources.position, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		renderGraph.addStorageImage(graphPasses.gtaoUpsample, graphResources.gtao, true);
+
+		const bool aoDisplayed = uboSSAOParams.ssao || uboSSAOParams.ssaoOnly;
+		// Writing the history is an output of the graph, so it's only declared if the upsampling isn't culled anyway
+		if (aoDisplayed && (aoMethod == ComputeGTAO)) {
+			renderGraph.addStorageImage(graphPasses.gtaoUpsample, graphResources.gtaoHistory, true);
 		}
 
-		// SSAO
-		{
-			VkAttachmentDescription attachmentDescription{};
-			attachmentDescription.format = frameBuffers.ssao.color.format;
-			attachmentDescription.samples = VK_SAMPLE_COUNT_1_BIT;
-			attachmentDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-			attachmentDescription.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-			attachmentDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-			attachmentDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-			attachmentDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			attachmentDescription.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-			VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
-
-			VkSubpassDescription subpass = {};
-			subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-			subpass.pColorAttachments = &colorReference;
-			subpass.colorAttachmentCount = 1;
-
-			std::array<VkSubpassDependency, 2> dependencies;
-
-			dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-			dependencies[0].dstSubpass = 0;
-			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-			dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-			dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-			dependencies[1].srcSubpass = 0;
-			dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-			dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-			dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-			VkRenderPassCreateInfo renderPassInfo = {};
-			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-			renderPassInfo.pAttachments = &attachmentDescription;
-			renderPassInfo.attachmentCount = 1;
-			renderPassInfo.subpassCount = 1;
-			renderPassInfo.pSubpasses = &subpass;
-			renderPassInfo.dependencyCount = 2;
-			renderPassInfo.pDependencies = dependencies.data();
-			VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &frameBuffers.ssao.renderPass));
-
-			VkFramebufferCreateInfo fbufCreateInfo = vks::initializers::framebufferCreateInfo();
-			fbufCreateInfo.renderPass = frameBuffers.ssao.renderPass;
-			fbufCreateInfo.pAttachments = &frameBuffers.ssao.color.view;
-			fbufCreateInfo.attachmentCount = 1;
-			fbufCreateInfo.width = frameBuffers.ssao.width;
-			fbufCreateInfo.height = frameBuffers.ssao.height;
-			fbufCreateInfo.layers = 1;
-			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &frameBuffers.ssao.frameBuffer));
+		// Final pass: Composition of the G-Buffer and the (blurred) ambient occlusion
+		graphPasses.composition = renderGraph.addGraphicsPass("Composition", [this](VkCommandBuffer commandBuffer) {
+			// Written once the ambient occlusion passes have finished
+			if (timestampsSupported) {
+				timestamps.cmdWriteTimestamp(commandBuffer, recordingFrame, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+			}
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.composition, 0, 1, &descriptorSets.composition, 0, NULL);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.composition);
+			vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+			if (timestampsSupported) {
+				timestamps.cmdWriteTimestamp(commandBuffer, recordingFrame, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+			}
+			drawUI(commandBuffer);
+		});
+		renderGraph.addColorAttachment(graphPasses.composition, graphResources.swapChainImage, VK_ATTACHMENT_LOAD_OP_CLEAR, defaultClearColor);
+		renderGraph.setDepthStencilAttachment(graphPasses.composition, graphResources.depthStencil);
+		renderGraph.addSampledImage(graphPasses.composition, graphResources.position);
+		renderGraph.addSampledImage(graphPasses.composition, graphResources.normal);
+		renderGraph.addSampledImage(graphPasses.composition, graphResources.albedo);
+		// The composition shader only samples the ambient occlusion if it's displayed, and only one of the targets,
+		// so the passes of the other method (and the SSAO passes altogether) are culled otherwise
+		if (aoDisplayed) {
+			if (aoMethod == ComputeGTAO) {
+				renderGraph.addSampledImage(graphPasses.composition, graphResources.gtao);
+			} else {
+				renderGraph.addSampledImage(graphPasses.composition, uboSSAOParams.ssaoBlur ? graphResources.ssaoBlur : graphResources.ssao);
+			}
 		}
 
-		// SSAO Blur
-		{
-			VkAttachmentDescription attachmentDescription{};
-			attachmentDescription.format = frameBuffers.ssaoBlur.color.format;
-			attachmentDescription.samples = VK_SAMPLE_COUNT_1_BIT;
-			attachmentDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-			attachmentDescription.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-			attachmentDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-			attachmentDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-			attachmentDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			attachmentDescription.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-			VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
-
-			VkSubpassDescription subpass = {};
-			subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-			subpass.pColorAttachments = &colorReference;
-			subpass.colorAttachmentCount = 1;
-
-			std::array<VkSubpassDependency, 2> dependencies;
-
-			dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-			dependencies[0].dstSubpass = 0;
-			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-			dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-			dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-			dependencies[1].srcSubpass = 0;
-			dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-			dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-			dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-			dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-			VkRenderPassCreateInfo renderPassInfo = {};
-			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-			renderPassInfo.pAttachments = &attachmentDescription;
-			renderPassInfo.attachmentCount = 1;
-			renderPassInfo.subpassCount = 1;
-			renderPassInfo.pSubpasses = &subpass;
-			renderPassInfo.dependencyCount = 2;
-			renderPassInfo.pDependencies = dependencies.data();
-			VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &frameBuffers.ssaoBlur.renderPass));
-
-			VkFramebufferCreateInfo fbufCreateInfo = vks::initializers::framebufferCreateInfo();
-			fbufCreateInfo.renderPass = frameBuffers.ssaoBlur.renderPass;
-			fbufCreateInfo.pAttachments = &frameBuffers.ssaoBlur.color.view;
-			fbufCreateInfo.attachmentCount = 1;
-			fbufCreateInfo.width = frameBuffers.ssaoBlur.width;
-			fbufCreateInfo.height = frameBuffers.ssaoBlur.height;
-			fbufCreateInfo.layers = 1;
-			VK_CHECK_RESULT(vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &frameBuffers.ssaoBlur.frameBuffer));
-		}
+		renderGraph.compile();
+	}
 
+	void dispatchGTAO(VkCommandBuffer commandBuffer, VkPipeline pipeline, VkDescriptorSet descriptorSet, uint32_t dispatchWidth, uint32_t dispatchHeight)
+	{
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts.gtao, 0, 1, &descriptorSet, 0, nullptr);
+		vkCmdDispatch(commandBuffer, (dispatchWidth + 7) / 8, (dispatchHeight + 7) / 8, 1);
+	}
+
+	void prepareSampler()
+	{
 		// Shared sampler used for all color attachments
 		VkSamplerCreateInfo sampler = vks::initializers::samplerCreateInfo();
 		sampler.magFilter = VK_FILTER_NEAREST;
@@ -480,6 +520,14 @@ public:
 		VK_CHECK_RESULT(vkCreateSampler(device, &sampler, nullptr, &colorSampler));
 	}
 
+	void prepareTimestamps()
+	{
+		timestampsSupported = (vulkanDevice->properties.limits.timestampComputeAndGraphics == VK_TRUE) && (vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].timestampValidBits > 0);
+		if (timestampsSupported) {
+			timestamps.create(vulkanDevice, queue, VK_QUERY_TYPE_TIMESTAMP, static_cast<uint32_t>(drawCmdBuffers.size()), 4);
+		}
+	}
+
 	void loadAssets()
 	{
 		vkglTF::descriptorBindingFlags  = vkglTF::DescriptorBindingFlags::ImageBaseColor;
@@ -493,145 +541,42 @@ public:
 
 		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
 		{
-			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
-
-			/*
-				Offscreen SSAO generation
-			*/
-			{
-				// Clear values for all attachments written in the fragment shader
-				std::vector<VkClearValue> clearValues(4);
-				clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
-				clearValues[1].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
-				clearValues[2].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
-				clearValues[3].depthStencil = { 1.0f, 0 };
-
-				VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-				renderPassBeginInfo.renderPass = frameBuffers.offscreen.renderPass;
-				renderPassBeginInfo.framebuffer = frameBuffers.offscreen.frameBuffer;
-				renderPassBeginInfo.renderArea.extent.width = frameBuffers.offscreen.width;
-				renderPassBeginInfo.renderArea.extent.height = frameBuffers.offscreen.height;
-				renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-				renderPassBeginInfo.pClearValues = clearValues.data();
-
-				/*
-					First pass: Fill G-Buffer components (positions+depth, normals, albedo) using MRT
-				*/
-
-				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+			renderGraph.updateImportedImage(graphResources.swapChainImage, swapChain.images[i], swapChain.imageViews[i], width, height);
+			renderGraph.updateImportedImage(graphResources.depthStencil, depthStencil.image, depthStencil.view, width, height);
 
-				VkViewport viewport = vks::initializers::viewport((float)frameBuffers.offscreen.width, (float)frameBuffers.offscreen.height, 0.0f, 1.0f);
-				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-
-				VkRect2D scissor = vks::initializers::rect2D(frameBuffers.offscreen.width, frameBuffers.offscreen.height, 0, 0);
-				vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
-
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.offscreen);
-
-				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.gBuffer, 0, 1, &descriptorSets.gBuffer, 0, nullptr);
-				scene.draw(drawCmdBuffers[i], vkglTF::RenderFlags::BindImages, pipelineLayouts.gBuffer);
-
-				vkCmdEndRenderPass(drawCmdBuffers[i]);
-
-				/*
-					Second pass: SSAO generation
-				*/
-
-				clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
-				clearValues[1].depthStencil = { 1.0f, 0 };
-
-				renderPassBeginInfo.framebuffer = frameBuffers.ssao.frameBuffer;
-				renderPassBeginInfo.renderPass = frameBuffers.ssao.renderPass;
-				renderPassBeginInfo.renderArea.extent.width = frameBuffers.ssao.width;
-				renderPassBeginInfo.renderArea.extent.height = frameBuffers.ssao.height;
-				renderPassBeginInfo.clearValueCount = 2;
-				renderPassBeginInfo.pClearValues = clearValues.data();
-
-				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-				viewport = vks::initializers::viewport((float)frameBuffers.ssao.width, (float)frameBuffers.ssao.height, 0.0f, 1.0f);
-				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-				scissor = vks::initializers::rect2D(frameBuffers.ssao.width, frameBuffers.ssao.height, 0, 0);
-				vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
-
-				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.ssao, 0, 1, &descriptorSets.ssao, 0, nullptr);
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.ssao);
-				vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
-
-				vkCmdEndRenderPass(drawCmdBuffers[i]);
-
-				/*
-					Third pass: SSAO blur
-				*/
-
-				renderPassBeginInfo.framebuffer = frameBuffers.ssaoBlur.frameBuffer;
-				renderPassBeginInfo.renderPass = frameBuffers.ssaoBlur.renderPass;
-				renderPassBeginInfo.renderArea.extent.width = frameBuffers.ssaoBlur.width;
-				renderPassBeginInfo.renderArea.extent.height = frameBuffers.ssaoBlur.height;
-
-				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-				viewport = vks::initializers::viewport((float)frameBuffers.ssaoBlur.width, (float)frameBuffers.ssaoBlur.height, 0.0f, 1.0f);
-				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-				scissor = vks::initializers::rect2D(frameBuffers.ssaoBlur.width, frameBuffers.ssaoBlur.height, 0, 0);
-				vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
-
-				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.ssaoBlur, 0, 1, &descriptorSets.ssaoBlur, 0, nullptr);
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.ssaoBlur);
-				vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
+			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
-				vkCmdEndRenderPass(drawCmdBuffers[i]);
+			recordingFrame = i;
+			if (timestampsSupported) {
+				timestamps.cmdBeginFrame(drawCmdBuffers[i], i);
+				timestamps.cmdWriteTimestamp(drawCmdBuffers[i], i, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
 			}
 
-			/*
-				Note: Explicit synchronization is not required between the render pass, as this is done implicit via sub pass dependencies
-			*/
-
-			/*
-				Final render pass: Scene rendering with applied radial blur
-			*/
-			{
-				std::vector<VkClearValue> clearValues(2);
-				clearValues[0].color = defaultClearColor;
-				clearValues[1].depthStencil = { 1.0f, 0 };
-
-				VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-				renderPassBeginInfo.renderPass = renderPass;
-				renderPassBeginInfo.framebuffer = VulkanExampleBase::frameBuffers[i];
-				renderPassBeginInfo.renderArea.extent.width = width;
-				renderPassBeginInfo.renderArea.extent.height = height;
-				renderPassBeginInfo.clearValueCount = 2;
-				renderPassBeginInfo.pClearValues = clearValues.data();
-
-				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-				VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
-				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-
-				VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
-				vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+			// All passes that haven't been culled, with the barriers between them inserted by the render graph
+			renderGraph.execute(drawCmdBuffers[i]);
 
-				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.composition, 0, 1, &descriptorSets.composition, 0, NULL);
-
-				// Final composition pass
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.composition);
-				vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
-
-				drawUI(drawCmdBuffers[i]);
-
-				vkCmdEndRenderPass(drawCmdBuffers[i]);
+			if (timestampsSupported) {
+				timestamps.cmdResolve(drawCmdBuffers[i], i);
 			}
 
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 		}
 	}
 
+	// The frame buffers of the graph reference the swap chain and depth stencil images, which are recreated on resize
+	void setupFrameBuffer()
+	{
+		VulkanExampleBase::setupFrameBuffer();
+		renderGraph.resetFramebuffers();
+	}
+
 	void setupDescriptors()
 	{
 		// Pool
 		std::vector<VkDescriptorPoolSize> poolSizes = {
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 10),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 12)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 14),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 21),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 5)
 		};
 		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes,  descriptorSets.count);
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
@@ -640,7 +585,6 @@ public:
 		VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo;
 		VkDescriptorSetAllocateInfo descriptorAllocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, nullptr, 1);
 		std::vector<VkWriteDescriptorSet> writeDescriptorSets;
-		std::vector<VkDescriptorImageInfo> imageDescriptors;
 
 		// Layouts and Sets
 
@@ -671,13 +615,7 @@ public:
 
 		descriptorAllocInfo.pSetLayouts = &descriptorSetLayouts.ssao;
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorAllocInfo, &descriptorSets.ssao));
-		imageDescriptors = {
-			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.position.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
-			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.normal.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
-		};
 		writeDescriptorSets = {
-			vks::initializers::writeDescriptorSet(descriptorSets.ssao, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[0]),					// FS Position+Depth
-			vks::initializers::writeDescriptorSet(descriptorSets.ssao, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[1]),					// FS Normals
 			vks::initializers::writeDescriptorSet(descriptorSets.ssao, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &ssaoNoise.descriptor),		// FS SSAO Noise
 			vks::initializers::writeDescriptorSet(descriptorSets.ssao, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3, &uniformBuffers.ssaoKernel.descriptor),		// FS SSAO Kernel UBO
 			vks::initializers::writeDescriptorSet(descriptorSets.ssao, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4, &uniformBuffers.ssaoParams.descriptor),		// FS SSAO Params UBO
@@ -692,13 +630,6 @@ public:
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &setLayoutCreateInfo, nullptr, &descriptorSetLayouts.ssaoBlur));
 		descriptorAllocInfo.pSetLayouts = &descriptorSetLayouts.ssaoBlur;
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorAllocInfo, &descriptorSets.ssaoBlur));
-		imageDescriptors = {
-			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.ssao.color.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
-		};
-		writeDescriptorSets = {
-			vks::initializers::writeDescriptorSet(descriptorSets.ssaoBlur, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[0]),
-		};
-		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 
 		// Composition
 		setLayoutBindings = {
@@ -713,22 +644,109 @@ public:
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &setLayoutCreateInfo, nullptr, &descriptorSetLayouts.composition));
 		descriptorAllocInfo.pSetLayouts = &descriptorSetLayouts.composition;
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorAllocInfo, &descriptorSets.composition));
-		imageDescriptors = {
-			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.position.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
-			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.normal.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
-			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.offscreen.albedo.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
-			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.ssao.color.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
-			vks::initializers::descriptorImageInfo(colorSampler, frameBuffers.ssaoBlur.color.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
-		};
 		writeDescriptorSets = {
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 5, &uniformBuffers.ssaoParams.descriptor),	// FS SSAO Params UBO
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+		// GTAO
+		// One layout for all compute passes, each pass only uses some of the images
+		setLayoutBindings = {
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),								// CS Params UBO
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 1),						// CS Input images
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 5),								// CS Output images
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 6),
+		};
+		setLayoutCreateInfo = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &setLayoutCreateInfo, nullptr, &descriptorSetLayouts.gtao));
+		descriptorAllocInfo.pSetLayouts = &descriptorSetLayouts.gtao;
+		for (VkDescriptorSet* descriptorSet : { &descriptorSets.gtaoDepth, &descriptorSets.gtao, &descriptorSets.gtaoTemporal, &descriptorSets.gtaoUpsample }) {
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorAllocInfo, descriptorSet));
+			VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(*descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.gtaoParams.descriptor);
+			vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+		}
+
+		updateImageDescriptors();
+	}
+
+	// Point the descriptors to the images of the render graph, which change whenever the graph is compiled
+	void updateImageDescriptors()
+	{
+		// Targets of culled passes aren't allocated, their descriptors are pointed at the noise texture instead as they're not sampled
+		auto imageDescriptor = [this](vks::RenderGraph::ResourceHandle resource) {
+			VkImageView view = renderGraph.getImageView(resource);
+			return vks::initializers::descriptorImageInfo(colorSampler, (view != VK_NULL_HANDLE) ? view : ssaoNoise.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		};
+		std::vector<VkDescriptorImageInfo> imageDescriptors = {
+			imageDescriptor(graphResources.position),
+			imageDescriptor(graphResources.normal),
+			imageDescriptor(graphResources.albedo),
+			imageDescriptor(graphResources.ssao),
+			imageDescriptor(graphResources.ssaoBlur),
+		};
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			// SSAO Generation
+			vks::initializers::writeDescriptorSet(descriptorSets.ssao, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[0]),					// FS Position+Depth
+			vks::initializers::writeDescriptorSet(descriptorSets.ssao, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[1]),					// FS Normals
+			// SSAO Blur
+			vks::initializers::writeDescriptorSet(descriptorSets.ssaoBlur, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[3]),				// FS Sampler SSAO
+			// Composition
 			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[0]),			// FS Sampler Position+Depth
 			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[1]),			// FS Sampler Normals
 			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &imageDescriptors[2]),			// FS Sampler Albedo
 			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &imageDescriptors[3]),			// FS Sampler SSAO
 			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4, &imageDescriptors[4]),			// FS Sampler SSAO blurred
-			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 5, &uniformBuffers.ssaoParams.descriptor),	// FS SSAO Params UBO
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+		// The GTAO images are only allocated if its passes aren't culled, and storage descriptors can't fall back to the noise texture
+		if (renderGraph.isCulled(graphPasses.gtaoUpsample)) {
+			return;
+		}
+		auto storageDescriptor = [this](vks::RenderGraph::ResourceHandle resource) {
+			return vks::initializers::descriptorImageInfo(VK_NULL_HANDLE, renderGraph.getImageView(resource), VK_IMAGE_LAYOUT_GENERAL);
+		};
+		const vks::RenderGraph::ResourceHandle upsampleInput = gtaoSettings.temporal ? graphResources.gtaoAccumulated : graphResources.gtaoRaw;
+		std::vector<VkDescriptorImageInfo> gtaoDescriptors = {
+			imageDescriptor(graphResources.gtaoDepth),
+			storageDescriptor(graphResources.gtaoDepth),
+			storageDescriptor(graphResources.gtaoRaw),
+			imageDescriptor(graphResources.gtaoRaw),
+			imageDescriptor(graphResources.gtaoHistory),
+			storageDescriptor(graphResources.gtaoAccumulated),
+			imageDescriptor(upsampleInput),
+			storageDescriptor(graphResources.gtao),
+			storageDescriptor(graphResources.gtaoHistory),
+			imageDescriptor(graphResources.gtao),
+		};
+		writeDescriptorSets = {
+			// Depth downsampling
+			vks::initializers::writeDescriptorSet(descriptorSets.gtaoDepth, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[0]),			// CS Sampler Position+Depth
+			vks::initializers::writeDescriptorSet(descriptorSets.gtaoDepth, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 5, &gtaoDescriptors[1]),						// CS Depth
+			// Occlusion
+			vks::initializers::writeDescriptorSet(descriptorSets.gtao, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &gtaoDescriptors[0]),					// CS Sampler Depth
+			vks::initializers::writeDescriptorSet(descriptorSets.gtao, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &imageDescriptors[1]),				// CS Sampler Normals
+			vks::initializers::writeDescriptorSet(descriptorSets.gtao, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 5, &gtaoDescriptors[2]),							// CS Occlusion
+			// Upsampling
+			vks::initializers::writeDescriptorSet(descriptorSets.gtaoUpsample, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &gtaoDescriptors[6]),			// CS Sampler Occlusion
+			vks::initializers::writeDescriptorSet(descriptorSets.gtaoUpsample, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &gtaoDescriptors[0]),			// CS Sampler Depth
+			vks::initializers::writeDescriptorSet(descriptorSets.gtaoUpsample, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &imageDescriptors[0]),		// CS Sampler Position+Depth
+			vks::initializers::writeDescriptorSet(descriptorSets.gtaoUpsample, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 5, &gtaoDescriptors[7]),					// CS Upsampled occlusion
+			vks::initializers::writeDescriptorSet(descriptorSets.gtaoUpsample, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 6, &gtaoDescriptors[8]),					// CS History
+			// The composition reads the upsampled occlusion for both of its ambient occlusion inputs
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &gtaoDescriptors[9]),			// FS Sampler SSAO
+			vks::initializers::writeDescriptorSet(descriptorSets.composition, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4, &gtaoDescriptors[9]),			// FS Sampler SSAO blurred
+		};
+		// Temporal accumulation
+		if (gtaoSettings.temporal) {
+			writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(descriptorSets.gtaoTemporal, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &gtaoDescriptors[3]));	// CS Sampler Occlusion
+			writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(descriptorSets.gtaoTemporal, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &gtaoDescriptors[0]));	// CS Sampler Depth
+			writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(descriptorSets.gtaoTemporal, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &gtaoDescriptors[4]));	// CS Sampler History
+			writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(descriptorSets.gtaoTemporal, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 5, &gtaoDescriptors[5]));				// CS Accumulated occlusion
+		}
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 	}
 
 	void preparePipelines()
@@ -753,6 +771,10 @@ public:
 		pipelineLayoutCreateInfo.setLayoutCount = 1;
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.composition));
 
+		pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayouts.gtao;
+		pipelineLayoutCreateInfo.setLayoutCount = 1;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.gtao));
+
 		// Pipelines
 		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
 		VkPipelineRasterizationStateCreateInfo rasterizationState = vks::initializers::pipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE, 0);
@@ -765,7 +787,7 @@ public:
 		VkPipelineDynamicStateCreateInfo dynamicState = vks::initializers::pipelineDynamicStateCreateInfo(dynamicStateEnables);
 		std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
 
-		VkGraphicsPipelineCreateInfo pipelineCreateInfo = vks::initializers::pipelineCreateInfo( pipelineLayouts.composition, renderPass, 0);
+		VkGraphicsPipelineCreateInfo pipelineCreateInfo = vks::initializers::pipelineCreateInfo( pipelineLayouts.composition, renderGraph.getRenderPass(graphPasses.composition), 0);
 		pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
 		pipelineCreateInfo.pRasterizationState = &rasterizationState;
 		pipelineCreateInfo.pColorBlendState = &colorBlendState;
@@ -787,7 +809,7 @@ public:
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.composition));
 
 		// SSAO generation pipeline
-		pipelineCreateInfo.renderPass = frameBuffers.ssao.renderPass;
+		pipelineCreateInfo.renderPass = renderGraph.getRenderPass(graphPasses.ssao);
 		pipelineCreateInfo.layout = pipelineLayouts.ssao;
 		// SSAO Kernel size and radius are constant for this pipeline, so we set them using specialization constants
 		struct SpecializationData {
@@ -804,7 +826,7 @@ public:
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.ssao));
 
 		// SSAO blur pipeline
-		pipelineCreateInfo.renderPass = frameBuffers.ssaoBlur.renderPass;
+		pipelineCreateInfo.renderPass = renderGraph.getRenderPass(graphPasses.ssaoBlur);
 		pipelineCreateInfo.layout = pipelineLayouts.ssaoBlur;
 		shaderStages[1] = loadShader(getShadersPath() + "ssao/blur.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.ssaoBlur));
@@ -812,7 +834,7 @@ public:
 		// Fill G-Buffer pipeline
 		// Vertex input state from glTF model loader
 		pipelineCreateInfo.pVertexInputState = vkglTF::Vertex::getPipelineVertexInputState({ vkglTF::VertexComponent::Position, vkglTF::VertexComponent::UV, vkglTF::VertexComponent::Color, vkglTF::VertexComponent::Normal });
-		pipelineCreateInfo.renderPass = frameBuffers.offscreen.renderPass;
+		pipelineCreateInfo.renderPass = renderGraph.getRenderPass(graphPasses.gBuffer);
 		pipelineCreateInfo.layout = pipelineLayouts.gBuffer;
 		// Blend attachment states required for all color attachments
 		// This is important, as color write mask will otherwise be 0x0 and you
@@ -828,6 +850,17 @@ public:
 		shaderStages[0] = loadShader(getShadersPath() + "ssao/gbuffer.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
 		shaderStages[1] = loadShader(getShadersPath() + "ssao/gbuffer.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.offscreen));
+
+		// GTAO compute pipelines
+		VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(pipelineLayouts.gtao, 0);
+		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "ssao/gtaodepth.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &pipelines.gtaoDepth));
+		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "ssao/gtao.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &pipelines.gtao));
+		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "ssao/gtaotemporal.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &pipelines.gtaoTemporal));
+		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "ssao/gtaoupsample.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &pipelines.gtaoUpsample));
 	}
 
 	float lerp(float a, float b, float f)
@@ -852,9 +885,18 @@ public:
 			&uniformBuffers.ssaoParams,
 			sizeof(uboSSAOParams));
 
+		// GTAO parameters
+		vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&uniformBuffers.gtaoParams,
+			sizeof(uboGTAOParams));
+
 		// Update
 		updateUniformBufferMatrices();
 		updateUniformBufferSSAOParams();
+		uboGTAOParams.previousView = camera.matrices.view;
+		updateUniformBufferGTAOParams();
 
 		// SSAO
 		std::default_random_engine rndEngine(benchmark.active ? 0 : (unsigned)time(nullptr));
@@ -909,11 +951,32 @@ public:
 		uniformBuffers.ssaoParams.unmap();
 	}
 
+	// The previous view matrix is the one of the last uploaded frame, as the history was written by that frame
+	void updateUniformBufferGTAOParams()
+	{
+		const GTAOQuality& quality = gtaoQualityLevels[gtaoSettings.quality];
+		uboGTAOParams.projection = camera.matrices.perspective;
+		uboGTAOParams.inverseView = glm::inverse(camera.matrices.view);
+		uboGTAOParams.sliceCount = quality.sliceCount;
+		uboGTAOParams.stepCount = quality.stepCount;
+		uboGTAOParams.frameIndex = gtaoSettings.temporal ? static_cast<int32_t>(frameIndex) : 0;
+
+		VK_CHECK_RESULT(uniformBuffers.gtaoParams.map());
+		uniformBuffers.gtaoParams.copyTo(&uboGTAOParams, sizeof(uboGTAOParams));
+		uniformBuffers.gtaoParams.unmap();
+
+		uboGTAOParams.previousView = camera.matrices.view;
+		frameIndex++;
+	}
+
 	void prepare()
 	{
 		VulkanExampleBase::prepare();
 		loadAssets();
-		prepareOffscreenFramebuffers();
+		renderGraph.create(vulkanDevice);
+		prepareRenderGraph();
+		prepareSampler();
+		prepareTimestamps();
 		prepareUniformBuffers();
 		setupDescriptors();
 		preparePipelines();
@@ -924,6 +987,16 @@ public:
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
+		// The previous submission of this command buffer has finished, so its timestamps can be read without waiting
+		if (timestampsSupported) {
+			const float period = vulkanDevice->properties.limits.timestampPeriod / 1000000.0f;
+			passTimes.gBuffer = (timestamps.getResult(currentBuffer, 1) - timestamps.getResult(currentBuffer, 0)) * period;
+			passTimes.ambientOcclusion = (timestamps.getResult(currentBuffer, 2) - timestamps.getResult(currentBuffer, 1)) * period;
+			passTimes.composition = (timestamps.getResult(currentBuffer, 3) - timestamps.getResult(currentBuffer, 2)) * period;
+			if (aoTimings.active) {
+				updateAOTimings();
+			}
+		}
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
@@ -937,15 +1010,132 @@ public:
 		}
 		updateUniformBufferMatrices();
 		updateUniformBufferSSAOParams();
+		updateUniformBufferGTAOParams();
 		draw();
 	}
 
+	std::string getAOSettingName(const AOSetting& setting)
+	{
+		if (setting.method == FragmentSSAO) {
+			return "SSAO (fragment)";
+		}
+		return "GTAO " + gtaoResolutionNames[setting.resolution] + " resolution, " + gtaoQualityLevels[setting.quality].name + " quality";
+	}
+
+	void applyAOSetting(const AOSetting& setting)
+	{
+		aoMethod = setting.method;
+		gtaoSettings.resolution = setting.resolution;
+		gtaoSettings.quality = setting.quality;
+		updateRenderGraph();
+		buildCommandBuffers();
+	}
+
+	void startAOTimings()
+	{
+		aoTimings.active = true;
+		aoTimings.step = 0;
+		aoTimings.frame = 0;
+		aoTimings.previousSetting = { aoMethod, gtaoSettings.resolution, gtaoSettings.quality };
+		aoTimings.settings = { { FragmentSSAO, 0, 0 } };
+		for (int32_t resolution = 0; resolution < static_cast<int32_t>(gtaoResolutionNames.size()); resolution++) {
+			for (int32_t quality = 0; quality < static_cast<int32_t>(gtaoQualityLevels.size()); quality++) {
+				aoTimings.settings.push_back({ ComputeGTAO, resolution, quality });
+			}
+		}
+		aoTimings.results.clear();
+		for (auto& setting : aoTimings.settings) {
+			aoTimings.results.push_back({ getAOSettingName(setting), 0.0f });
+		}
+		applyAOSetting(aoTimings.settings[0]);
+	}
+
+	// Accumulate the ambient occlusion time of the current step and advance to the next setting once enough frames have been measured
+	void updateAOTimings()
+	{
+		aoTimings.frame++;
+		if (aoTimings.frame <= aoTimings.warmupFrames) {
+			return;
+		}
+		aoTimings.results[aoTimings.step].ambientOcclusion += passTimes.ambientOcclusion / (float)aoTimings.measuredFrames;
+		if (aoTimings.frame < aoTimings.warmupFrames + aoTimings.measuredFrames) {
+			return;
+		}
+		aoTimings.frame = 0;
+		aoTimings.step++;
+		if (aoTimings.step < aoTimings.settings.size()) {
+			applyAOSetting(aoTimings.settings[aoTimings.step]);
+			return;
+		}
+		aoTimings.active = false;
+		applyAOSetting(aoTimings.previousSetting);
+		std::cout << "Ambient occlusion timings at " << width << "x" << height << " (average GPU times over " << aoTimings.measuredFrames << " frames):\n";
+		for (auto& result : aoTimings.results) {
+			std::cout << result.name << ": " << result.ambientOcclusion << " ms\n";
+		}
+	}
+
+	// Recompile the graph for changed settings, the command buffers are rebuilt by the base class after the UI has been updated
+	void updateRenderGraph()
+	{
+		vkDeviceWaitIdle(device);
+		prepareRenderGraph();
+		updateImageDescriptors();
+	}
+
+	// The G-buffer and SSAO targets match the window size
+	virtual void windowResized()
+	{
+		updateRenderGraph();
+		buildCommandBuffers();
+	}
+
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
 		if (overlay->header("Settings")) {
-			overlay->checkBox("Enable SSAO", &uboSSAOParams.ssao);
-			overlay->checkBox("SSAO blur", &uboSSAOParams.ssaoBlur);
-			overlay->checkBox("SSAO pass only", &uboSSAOParams.ssaoOnly);
+			bool graphChanged = false;
+			graphChanged |= overlay->checkBox("Enable SSAO", &uboSSAOParams.ssao);
+			graphChanged |= overlay->checkBox("SSAO pass only", &uboSSAOParams.ssaoOnly);
+			if (!aoTimings.active) {
+				graphChanged |= overlay->comboBox("Method", &aoMethod, { "SSAO (fragment)", "GTAO (compute)" });
+				if (aoMethod == FragmentSSAO) {
+					graphChanged |= overlay->checkBox("SSAO blur", &uboSSAOParams.ssaoBlur);
+				} else {
+					graphChanged |= overlay->comboBox("Resolution", &gtaoSettings.resolution, gtaoResolutionNames);
+					std::vector<std::string> qualityNames;
+					for (auto& quality : gtaoQualityLevels) {
+						qualityNames.push_back(quality.name);
+					}
+					overlay->comboBox("Quality", &gtaoSettings.quality, qualityNames);
+					graphChanged |= overlay->checkBox("Temporal accumulation", &gtaoSettings.temporal);
+				}
+			}
+			if (graphChanged) {
+				updateRenderGraph();
+			}
+		}
+		if (timestampsSupported && overlay->header("Timings")) {
+			overlay->text("G-Buffer pass: %.2f ms", passTimes.gBuffer);
+			overlay->text("Ambient occlusion: %.2f ms", passTimes.ambientOcclusion);
+			overlay->text("Composition pass: %.2f ms", passTimes.composition);
+			if (aoTimings.active) {
+				overlay->text("Measuring %s...", aoTimings.results[aoTimings.step].name.c_str());
+			} else if (overlay->button("Measure all settings")) {
+				startAOTimings();
+			}
+			for (uint32_t i = 0; i < aoTimings.results.size() && (!aoTimings.active || i < aoTimings.step); i++) {
+				overlay->text("%s: %.2f ms", aoTimings.results[i].name.c_str(), aoTimings.results[i].ambientOcclusion);
+			}
+		}
+		if (overlay->header("Render graph")) {
+			if (overlay->checkBox("Alias transient memory", &renderGraph.settings.aliasing)) {
+				updateRenderGraph();
+			}
+			const vks::RenderGraph::Statistics& stats = renderGraph.statistics;
+			overlay->text("Passes: %d (%d culled)", stats.passCount, stats.culledPassCount);
+			overlay->text("Image barriers: %d in %d batches (%d elided)", stats.imageBarrierCount, stats.pipelineBarrierCount, stats.elidedBarrierCount);
+			overlay->text("Transient memory: %.1f MB", (float)stats.transientMemory / (1024.0f * 1024.0f));
+			overlay->text("Without aliasing: %.1f MB", (float)stats.transientMemoryUnaliased / (1024.0f * 1024.0f));
 		}
 	}
 };
@@ -4,6 +4,10 @@
 * This samples draw a terrain from a heightmap texture and uses tessellation to add in details based on camera distance
 * The height level is generated in the vertex shader by reading from the heightmap image
 *
+* Alternatively the terrain can be drawn from a quadtree of chunks that are built on the CPU and streamed into a fixed size vertex pool
+* (see base/VulkanTerrainQuadtree.h), which also works for heightmaps that are too large to be uploaded as a single patch grid or texture
+* A raw square 16 bit heightmap file can be passed with "--heightmap <file>" for this mode
+*
 * Copyright (C) 2016-2023 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
@@ -12,6 +16,7 @@
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
 #include "frustum.hpp"
+#include "VulkanTerrainQuadtree.h"
 #include <ktx.h>
 #include <ktxvulkan.h>
 
@@ -20,6 +25,19 @@ class VulkanExample : public VulkanExampleBase
 public:
 	bool wireframe = false;
 	bool tessellation = true;
+	bool quadtree = false;
+
+	// Quadtree of streamed terrain chunks, used instead of the tessellated patch grid if enabled
+	vks::TerrainQuadtree terrainQuadtree;
+	// Optional raw heightmap file used for the quadtree instead of the heightmap texture
+	std::string heightmapFile;
+
+	// Per chunk values for the quadtree terrain vertex shader
+	struct PushConstantsChunk {
+		glm::vec4 cameraPos;
+		float morphStart;
+		float morphEnd;
+	};
 
 	// Holds the buffers for rendering the tessellated terrain
 	struct {
@@ -71,6 +89,8 @@ public:
 		VkPipeline terrain{ VK_NULL_HANDLE };
 		VkPipeline wireframe{ VK_NULL_HANDLE };
 		VkPipeline skysphere{ VK_NULL_HANDLE };
+		VkPipeline chunks{ VK_NULL_HANDLE };
+		VkPipeline chunksWireframe{ VK_NULL_HANDLE };
 	} pipelines;
 
 	struct {
@@ -81,6 +101,7 @@ public:
 	struct {
 		VkPipelineLayout terrain{ VK_NULL_HANDLE };
 		VkPipelineLayout skysphere{ VK_NULL_HANDLE };
+		VkPipelineLayout chunks{ VK_NULL_HANDLE };
 	} pipelineLayouts;
 
 	struct {
@@ -102,11 +123,20 @@ public:
 	VulkanExample() : VulkanExampleBase()
 	{
 		title = "Dynamic terrain tessellation";
+		// The chunked terrain only has GLSL shaders
+		requireGlslShaders();
 		camera.type = Camera::CameraType::firstperson;
 		camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 512.0f);
 		camera.setRotation(glm::vec3(-12.0f, 159.0f, 0.0f));
 		camera.setTranslation(glm::vec3(18.0f, 22.5f, 57.5f));
 		camera.movementSpeed = 10.0f;
+		// A raw heightmap file can be passed for the quadtree terrain
+		for (size_t i = 0; i + 1 < args.size(); i++) {
+			if (std::string(args[i]) == "--heightmap") {
+				heightmapFile = args[i + 1];
+				quadtree = true;
+			}
+		}
 	}
 
 	~VulkanExample()
@@ -117,9 +147,14 @@ public:
 				vkDestroyPipeline(device, pipelines.wireframe, nullptr);
 			}
 			vkDestroyPipeline(device, pipelines.skysphere, nullptr);
+			vkDestroyPipeline(device, pipelines.chunks, nullptr);
+			if (pipelines.chunksWireframe != VK_NULL_HANDLE) {
+				vkDestroyPipeline(device, pipelines.chunksWireframe, nullptr);
+			}
 
 			vkDestroyPipelineLayout(device, pipelineLayouts.skysphere, nullptr);
 			vkDestroyPipelineLayout(device, pipelineLayouts.terrain, nullptr);
+			vkDestroyPipelineLayout(device, pipelineLayouts.chunks, nullptr);
 
 			vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.terrain, nullptr);
 			vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.skysphere, nullptr);
@@ -136,6 +171,8 @@ public:
 			vkDestroyBuffer(device, terrain.indices.buffer, nullptr);
 			vkFreeMemory(device, terrain.indices.memory, nullptr);
 
+			terrainQuadtree.destroy();
+
 			if (queryPool != VK_NULL_HANDLE) {
 				vkDestroyQueryPool(device, queryPool, nullptr);
 				vkDestroyBuffer(device, queryResult.buffer, nullptr);
@@ -265,7 +302,7 @@ public:
 		textures.terrainArray.descriptor.sampler = textures.terrainArray.sampler;
 	}
 
-	void buildCommandBuffers()
+	void buildCommandBuffer(int32_t i)
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
@@ -281,55 +318,74 @@ public:
 		renderPassBeginInfo.renderArea.extent.height = height;
 		renderPassBeginInfo.clearValueCount = 2;
 		renderPassBeginInfo.pClearValues = clearValues;
+		renderPassBeginInfo.framebuffer = frameBuffers[i];
 
-		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
-		{
-			renderPassBeginInfo.framebuffer = frameBuffers[i];
+		VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
-			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
-
-			if (deviceFeatures.pipelineStatisticsQuery) {
-				vkCmdResetQueryPool(drawCmdBuffers[i], queryPool, 0, 2);
-			}
+		if (deviceFeatures.pipelineStatisticsQuery) {
+			vkCmdResetQueryPool(drawCmdBuffers[i], queryPool, 0, 2);
+		}
 
-			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
-			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+		VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+		vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
 
-			VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
-			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+		VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+		vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
-			vkCmdSetLineWidth(drawCmdBuffers[i], 1.0f);
+		vkCmdSetLineWidth(drawCmdBuffers[i], 1.0f);
 
-			VkDeviceSize offsets[1] = { 0 };
+		VkDeviceSize offsets[1] = { 0 };
 
-			// Skysphere
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.skysphere);
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.skysphere, 0, 1, &descriptorSets.skysphere, 0, nullptr);
-			models.skysphere.draw(drawCmdBuffers[i]);
+		// Skysphere
+		vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.skysphere);
+		vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.skysphere, 0, 1, &descriptorSets.skysphere, 0, nullptr);
+		models.skysphere.draw(drawCmdBuffers[i]);
 
-			// Tessellated terrain
-			if (deviceFeatures.pipelineStatisticsQuery) {
-				// Begin pipeline statistics query
-				vkCmdBeginQuery(drawCmdBuffers[i], queryPool, 0, 0);
+		if (deviceFeatures.pipelineStatisticsQuery) {
+			// Begin pipeline statistics query
+			vkCmdBeginQuery(drawCmdBuffers[i], queryPool, 0, 0);
+		}
+		if (quadtree) {
+			// Quadtree terrain chunks selected by the last update, all chunks are stored in one vertex pool and share one index buffer
+			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, wireframe ? pipelines.chunksWireframe : pipelines.chunks);
+			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.chunks, 0, 1, &descriptorSets.terrain, 0, nullptr);
+			vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1, &terrainQuadtree.vertexBuffer.buffer, offsets);
+			vkCmdBindIndexBuffer(drawCmdBuffers[i], terrainQuadtree.indexBuffer.buffer, 0, vks::TerrainQuadtree::indexType);
+			PushConstantsChunk pushConstants{};
+			pushConstants.cameraPos = glm::inverse(camera.matrices.view)[3];
+			for (auto& drawCommand : terrainQuadtree.drawCommands) {
+				pushConstants.morphStart = drawCommand.morphStart;
+				pushConstants.morphEnd = drawCommand.morphEnd;
+				vkCmdPushConstants(drawCmdBuffers[i], pipelineLayouts.chunks, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstantsChunk), &pushConstants);
+				vkCmdDrawIndexed(drawCmdBuffers[i], drawCommand.indexCount, 1, drawCommand.firstIndex, drawCommand.vertexOffset, 0);
 			}
-			// Render
+		} else {
+			// Tessellated terrain
 			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, wireframe ? pipelines.wireframe : pipelines.terrain);
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.terrain, 0, 1, &descriptorSets.terrain, 0, nullptr);
 			vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1, &terrain.vertices.buffer, offsets);
 			vkCmdBindIndexBuffer(drawCmdBuffers[i], terrain.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
 			vkCmdDrawIndexed(drawCmdBuffers[i], terrain.indices.count, 1, 0, 0, 0);
-			if (deviceFeatures.pipelineStatisticsQuery) {
-				// End pipeline statistics query
-				vkCmdEndQuery(drawCmdBuffers[i], queryPool, 0);
-			}
+		}
+		if (deviceFeatures.pipelineStatisticsQuery) {
+			// End pipeline statistics query
+			vkCmdEndQuery(drawCmdBuffers[i], queryPool, 0);
+		}
 
-			drawUI(drawCmdBuffers[i]);
+		drawUI(drawCmdBuffers[i]);
 
-			vkCmdEndRenderPass(drawCmdBuffers[i]);
+		vkCmdEndRenderPass(drawCmdBuffers[i]);
+
+		VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+	}
 
-			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+	void buildCommandBuffers()
+	{
+		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
+		{
+			buildCommandBuffer(i);
 		}
 	}
 
@@ -418,6 +474,22 @@ public:
 			}
 		}
 
+		// The quadtree terrain is built from the same heightmap (or a heightmap file) and covers the same area as the patch grid
+		if (heightmapFile.empty()) {
+			std::vector<uint16_t> heights(heightdata, heightdata + dim * dim);
+			terrainQuadtree.settings.sampleSpacing = (float)(patchSize - 1) * wx / (float)(dim - 1);
+			terrainQuadtree.create(vulkanDevice, queue, std::make_unique<vks::MemoryHeightSource>(std::move(heights), dim));
+		} else {
+			auto source = std::make_unique<vks::FileHeightSource>(heightmapFile);
+			if (!source->valid()) {
+				vks::tools::exitFatal("Could not load heightmap \"" + heightmapFile + "\", a raw square 16 bit heightmap is required", -1);
+			}
+			// Large heightmaps cover a larger area, so the far plane is moved out too
+			terrainQuadtree.settings.sampleSpacing = 0.25f;
+			terrainQuadtree.create(vulkanDevice, queue, std::move(source));
+			camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, std::max(512.0f, terrainQuadtree.worldSize()));
+		}
+
 		delete[] heightdata;
 
 		// Generate indices
@@ -527,8 +599,8 @@ public:
 
 		// Terrain
 		setLayoutBindings = {
-			// Binding 0 : Shared Tessellation shader ubo
-			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, 0),
+			// Binding 0 : Shared Tessellation shader ubo (also used by the vertex shader of the quadtree chunks)
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, 0),
 			// Binding 1 : Height map
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 1),
 			// Binding 2 : Terrain texture array layers
@@ -588,6 +660,13 @@ public:
 		pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayouts.skysphere, 1);
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.skysphere));
 
+		// Quadtree chunks pass their morph range via push constants
+		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_VERTEX_BIT, sizeof(PushConstantsChunk), 0);
+		pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayouts.terrain, 1);
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.chunks));
+
 		// Pipelines
 		VkPipelineRasterizationStateCreateInfo rasterizationState = vks::initializers::pipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE, 0);
 		VkPipelineColorBlendAttachmentState blendAttachmentState = vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE);
@@ -628,13 +707,41 @@ public:
 			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.wireframe));
 		};
 
-		// Skysphere pipeline
-		rasterizationState.cullMode = VK_CULL_MODE_FRONT_BIT;
-		rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
 		// Revert to triangle list topology
 		inputAssemblyState.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 		// Reset tessellation state
 		pipelineCI.pTessellationState = nullptr;
+
+		// Quadtree terrain chunk pipelines
+		// Skirts are not consistently wound, so culling is disabled
+		rasterizationState.cullMode = VK_CULL_MODE_NONE;
+		rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
+		VkVertexInputBindingDescription vertexInputBinding = vks::initializers::vertexInputBindingDescription(0, sizeof(vks::TerrainQuadtree::Vertex), VK_VERTEX_INPUT_RATE_VERTEX);
+		std::vector<VkVertexInputAttributeDescription> vertexInputAttributes = {
+			vks::initializers::vertexInputAttributeDescription(0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(vks::TerrainQuadtree::Vertex, pos)),
+			vks::initializers::vertexInputAttributeDescription(0, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(vks::TerrainQuadtree::Vertex, normal)),
+			vks::initializers::vertexInputAttributeDescription(0, 2, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(vks::TerrainQuadtree::Vertex, morph)),
+		};
+		VkPipelineVertexInputStateCreateInfo vertexInputState = vks::initializers::pipelineVertexInputStateCreateInfo();
+		vertexInputState.vertexBindingDescriptionCount = 1;
+		vertexInputState.pVertexBindingDescriptions = &vertexInputBinding;
+		vertexInputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexInputAttributes.size());
+		vertexInputState.pVertexAttributeDescriptions = vertexInputAttributes.data();
+		pipelineCI.pVertexInputState = &vertexInputState;
+		pipelineCI.stageCount = 2;
+		pipelineCI.layout = pipelineLayouts.chunks;
+		shaderStages[0] = loadShader(getShadersPath() + "terraintessellation/terrainchunk.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+		shaderStages[1] = loadShader(getShadersPath() + "terraintessellation/terrainchunk.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.chunks));
+		if (deviceFeatures.fillModeNonSolid) {
+			rasterizationState.polygonMode = VK_POLYGON_MODE_LINE;
+			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipelines.chunksWireframe));
+		};
+
+		// Skysphere pipeline
+		rasterizationState.cullMode = VK_CULL_MODE_FRONT_BIT;
+		rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
+		pipelineCI.pVertexInputState = vkglTF::Vertex::getPipelineVertexInputState({ vkglTF::VertexComponent::Position, vkglTF::VertexComponent::Normal, vkglTF::VertexComponent::UV });
 		// Don't write to depth buffer
 		depthStencilState.depthWriteEnable = VK_FALSE;
 		pipelineCI.stageCount = 2;
@@ -683,6 +790,11 @@ public:
 			uniformDataTessellation.tessellationFactor = savedFactor;
 		}
 
+		// Select the quadtree chunks for the current view, chunks missing for the selection are requested from the workers
+		if (quadtree) {
+			terrainQuadtree.update(glm::inverse(camera.matrices.view)[3], frustum, uniformDataTessellation.displacementFactor);
+		}
+
 		// Vertex shader
 		uniformDataVertex.mvp = camera.matrices.perspective * glm::mat4(glm::mat3(camera.matrices.view));
 		memcpy(uniformBuffers.skysphereVertex.mapped, &uniformDataVertex, sizeof(UniformDataVertex));
@@ -706,6 +818,10 @@ public:
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
+		// The chunks drawn by the quadtree terrain change with the view, so the command buffer is rebuilt every frame
+		if (quadtree) {
+			buildCommandBuffer(currentBuffer);
+		}
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
@@ -728,6 +844,9 @@ public:
 	{
 		if (overlay->header("Settings")) {
 
+			if (overlay->checkBox("Quadtree chunks", &quadtree)) {
+				updateUniformBuffers();
+			}
 			if (overlay->checkBox("Tessellation", &tessellation)) {
 				updateUniformBuffers();
 			}
@@ -746,6 +865,21 @@ public:
 				overlay->text("TE invocations: %d", pipelineStats[1]);
 			}
 		}
+		if (quadtree) {
+			if (overlay->header("Quadtree")) {
+				const vks::TerrainQuadtree::Statistics& statistics = terrainQuadtree.statistics;
+				overlay->text("Levels: %d", statistics.levels);
+				overlay->text("Chunks drawn: %d", statistics.drawnChunks);
+				overlay->text("Nodes culled: %d", statistics.culledNodes);
+				overlay->text("Chunks resident: %d / %d", statistics.residentChunks, terrainQuadtree.settings.maxResidentChunks);
+				overlay->text("Chunks pending: %d", statistics.pendingChunks);
+				overlay->text("Chunks evicted: %d", statistics.evictedChunks);
+				const uint32_t builtChunks = statistics.builtChunks;
+				overlay->text("Chunks built: %d (%.3f ms avg)", builtChunks, (builtChunks > 0) ? (double)statistics.buildTimeMicroseconds / builtChunks / 1000.0 : 0.0);
+				overlay->text("Bounds: %.2f ms", statistics.boundsTime);
+				overlay->sliderFloat("LOD distance", &terrainQuadtree.settings.lodDistance, 2.0f, 8.0f);
+			}
+		}
 	}
 };
 
@@ -13,15 +13,18 @@
 #include <iomanip>
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "VulkanTextRenderer.h"
 #include "../external/stb/stb_font_consolas_24_latin1.inl"
 
-// Max. number of chars the text overlay buffer can hold
+// Initial number of glyphs the text overlay's instance buffer can hold, grows if the texts need more
 #define TEXTOVERLAY_MAX_CHAR_COUNT 2048
 
 /*
 	Mostly self-contained text overlay class
 	This class contains all Vulkan resources for drawing the text overlay
 	It can be plugged into an existing renderpass/command buffer
+	The glyphs of all texts are drawn as instances with a single draw call (see vks::TextRenderer), texts are laid out once and
+	only written to the instance buffer again if they change
 */
 class TextOverlay
 {
@@ -32,9 +35,6 @@ private:
 	VkImage image;
 	VkImageView view;
 	VkDeviceMemory imageMemory;
-	// Character vertex buffer
-	VkBuffer buffer;
-	VkDeviceMemory memory;
 	VkDescriptorPool descriptorPool;
 	VkDescriptorSetLayout descriptorSetLayout;
 	VkDescriptorSet descriptorSet;
@@ -51,14 +51,10 @@ private:
 	std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
 	float scale;
 
-	// Pointer to mapped vertex buffer
-	glm::vec4 *mapped = nullptr;
-
-	stb_fontchar stbFontData[STB_FONT_consolas_24_latin1_NUM_CHARS];
+	// Glyph metrics of the baked stb font
+	vks::Font font;
 public:
-	enum TextAlign { alignLeft, alignCenter, alignRight };
-
-	uint32_t numLetters;
+	vks::TextRenderer text;
 	bool visible = true;
 
 	TextOverlay(
@@ -85,11 +81,10 @@ public:
 	~TextOverlay()
 	{
 		// Free up all Vulkan resources requested by the text overlay
+		text.destroy();
 		vkDestroySampler(vulkanDevice->logicalDevice, sampler, nullptr);
 		vkDestroyImage(vulkanDevice->logicalDevice, image, nullptr);
 		vkDestroyImageView(vulkanDevice->logicalDevice, view, nullptr);
-		vkDestroyBuffer(vulkanDevice->logicalDevice, buffer, nullptr);
-		vkFreeMemory(vulkanDevice->logicalDevice, memory, nullptr);
 		vkFreeMemory(vulkanDevice->logicalDevice, imageMemory, nullptr);
 		vkDestroyDescriptorSetLayout(vulkanDevice->logicalDevice, descriptorSetLayout, nullptr);
 		vkDestroyDescriptorPool(vulkanDevice->logicalDevice, descriptorPool, nullptr);
@@ -106,24 +101,30 @@ public:
 		const uint32_t fontHeight = STB_FONT_consolas_24_latin1_BITMAP_HEIGHT;
 
 		static unsigned char font24pixels[fontHeight][fontWidth];
+		static stb_fontchar stbFontData[STB_FONT_consolas_24_latin1_NUM_CHARS];
 		stb_font_consolas_24_latin1(stbFontData, font24pixels, fontHeight);
 
-		// Vertex buffer
-		VkDeviceSize bufferSize = TEXTOVERLAY_MAX_CHAR_COUNT * sizeof(glm::vec4);
+		// Glyph metrics
+		font.size = 24.0f;
+		font.lineHeight = 24.0f;
+		font.atlasWidth = fontWidth;
+		font.atlasHeight = fontHeight;
+		for (uint32_t i = 0; i < STB_FONT_consolas_24_latin1_NUM_CHARS; i++) {
+			const stb_fontchar& charData = stbFontData[i];
+			vks::Font::Glyph glyph;
+			glyph.offset = glm::vec2((float)charData.x0, (float)charData.y0);
+			glyph.size = glm::vec2((float)(charData.x1 - charData.x0), (float)(charData.y1 - charData.y0));
+			glyph.uvRect = glm::vec4(charData.s0, charData.t0, charData.s1, charData.t1);
+			glyph.advance = charData.advance;
+			font.addGlyph(STB_FONT_consolas_24_latin1_FIRST_CHAR + i, glyph);
+		}
 
-		VkBufferCreateInfo bufferInfo = vks::initializers::bufferCreateInfo(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, bufferSize);
-		VK_CHECK_RESULT(vkCreateBuffer(vulkanDevice->logicalDevice, &bufferInfo, nullptr, &buffer));
+		// Glyph instance buffer
+		text.create(vulkanDevice, &font, TEXTOVERLAY_MAX_CHAR_COUNT);
 
 		VkMemoryRequirements memReqs;
 		VkMemoryAllocateInfo allocInfo = vks::initializers::memoryAllocateInfo();
 
-		vkGetBufferMemoryRequirements(vulkanDevice->logicalDevice, buffer, &memReqs);
-		allocInfo.allocationSize = memReqs.size;
-		allocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-		VK_CHECK_RESULT(vkAllocateMemory(vulkanDevice->logicalDevice, &allocInfo, nullptr, &memory));
-		VK_CHECK_RESULT(vkBindBufferMemory(vulkanDevice->logicalDevice, buffer, memory, 0));
-
 		// Font texture
 		VkImageCreateInfo imageInfo = vks::initializers::imageCreateInfo();
 		imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -283,7 +284,11 @@ public:
 		VK_CHECK_RESULT(vkCreatePipelineCache(vulkanDevice->logicalDevice, &pipelineCacheCreateInfo, nullptr, &pipelineCache));
 
 		// Layout
+		// Push constant with the transformation from framebuffer pixels to normalized device coordinates
+		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_VERTEX_BIT, sizeof(glm::mat4), 0);
 		VkPipelineLayoutCreateInfo pipelineLayoutInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 		VK_CHECK_RESULT(vkCreatePipelineLayout(vulkanDevice->logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayout));
 
 		// Enable blending, using alpha from red channel of the font texture (see text.frag)
@@ -298,7 +303,7 @@ public:
 		blendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
 
 		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP, 0, VK_FALSE);
-		VkPipelineRasterizationStateCreateInfo rasterizationState = vks::initializers::pipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_CLOCKWISE, 0);
+		VkPipelineRasterizationStateCreateInfo rasterizationState = vks::initializers::pipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE, 0);
 		VkPipelineColorBlendStateCreateInfo colorBlendState = vks::initializers::pipelineColorBlendStateCreateInfo(1, &blendAttachmentState);
 		VkPipelineDepthStencilStateCreateInfo depthStencilState = vks::initializers::pipelineDepthStencilStateCreateInfo(VK_FALSE, VK_FALSE, VK_COMPARE_OP_LESS_OR_EQUAL);
 		VkPipelineViewportStateCreateInfo viewportState = vks::initializers::pipelineViewportStateCreateInfo(1, 1, 0);
@@ -306,23 +311,9 @@ public:
 		std::vector<VkDynamicState> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
 		VkPipelineDynamicStateCreateInfo dynamicState = vks::initializers::pipelineDynamicStateCreateInfo(dynamicStateEnables);
 
-		std::array<VkVertexInputBindingDescription, 2> vertexInputBindings = {
-			vks::initializers::vertexInputBindingDescription(0, sizeof(glm::vec4), VK_VERTEX_INPUT_RATE_VERTEX),
-			vks::initializers::vertexInputBindingDescription(1, sizeof(glm::vec4), VK_VERTEX_INPUT_RATE_VERTEX),
-		};
-		std::array<VkVertexInputAttributeDescription, 2> vertexInputAttributes = {
-			vks::initializers::vertexInputAttributeDescription(0, 0, VK_FORMAT_R32G32_SFLOAT, 0),					// Location 0: Position
-			vks::initializers::vertexInputAttributeDescription(1, 1, VK_FORMAT_R32G32_SFLOAT, sizeof(glm::vec2)),	// Location 1: UV
-		};
-
-		VkPipelineVertexInputStateCreateInfo vertexInputState = vks::initializers::pipelineVertexInputStateCreateInfo();
-		vertexInputState.vertexBindingDescriptionCount = static_cast<uint32_t>(vertexInputBindings.size());
-		vertexInputState.pVertexBindingDescriptions = vertexInputBindings.data();
-		vertexInputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexInputAttributes.size());
-		vertexInputState.pVertexAttributeDescriptions = vertexInputAttributes.data();
-
 		VkGraphicsPipelineCreateInfo pipelineCreateInfo = vks::initializers::pipelineCreateInfo(pipelineLayout, renderPass, 0);
-		pipelineCreateInfo.pVertexInputState = &vertexInputState;
+		// Glyphs are per instance vertex data, the quad corners are generated from the vertex index
+		pipelineCreateInfo.pVertexInputState = text.getPipelineVertexInputState();
 		pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
 		pipelineCreateInfo.pRasterizationState = &rasterizationState;
 		pipelineCreateInfo.pColorBlendState = &colorBlendState;
@@ -336,105 +327,24 @@ public:
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(vulkanDevice->logicalDevice, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline));
 	}
 
-	// Map buffer
-	void beginTextUpdate()
-	{
-		VK_CHECK_RESULT(vkMapMemory(vulkanDevice->logicalDevice, memory, 0, VK_WHOLE_SIZE, 0, (void **)&mapped));
-		numLetters = 0;
-	}
-
-	// Add text to the current buffer
-	void addText(std::string text, float x, float y, TextAlign align)
-	{
-		const uint32_t firstChar = STB_FONT_consolas_24_latin1_FIRST_CHAR;
-
-		assert(mapped != nullptr);
-
-		const float charW = 1.5f * scale / *frameBufferWidth;
-		const float charH = 1.5f * scale / *frameBufferHeight;
-
-		float fbW = (float)*frameBufferWidth;
-		float fbH = (float)*frameBufferHeight;
-		x = (x / fbW * 2.0f) - 1.0f;
-		y = (y / fbH * 2.0f) - 1.0f;
-
-		// Calculate text width
-		float textWidth = 0;
-		for (auto letter : text)
-		{
-			stb_fontchar *charData = &stbFontData[(uint32_t)letter - firstChar];
-			textWidth += charData->advance * charW;
-		}
-
-		switch (align)
-		{
-			case alignRight:
-				x -= textWidth;
-				break;
-			case alignCenter:
-				x -= textWidth / 2.0f;
-				break;
-			case alignLeft:
-				break;
-		}
-
-		// Generate a uv mapped quad per char in the new text
-		for (auto letter : text)
-		{
-			stb_fontchar *charData = &stbFontData[(uint32_t)letter - firstChar];
-
-			mapped->x = (x + (float)charData->x0 * charW);
-			mapped->y = (y + (float)charData->y0 * charH);
-			mapped->z = charData->s0;
-			mapped->w = charData->t0;
-			mapped++;
-
-			mapped->x = (x + (float)charData->x1 * charW);
-			mapped->y = (y + (float)charData->y0 * charH);
-			mapped->z = charData->s1;
-			mapped->w = charData->t0;
-			mapped++;
-
-			mapped->x = (x + (float)charData->x0 * charW);
-			mapped->y = (y + (float)charData->y1 * charH);
-			mapped->z = charData->s0;
-			mapped->w = charData->t1;
-			mapped++;
-
-			mapped->x = (x + (float)charData->x1 * charW);
-			mapped->y = (y + (float)charData->y1 * charH);
-			mapped->z = charData->s1;
-			mapped->w = charData->t1;
-			mapped++;
-
-			x += charData->advance * charW;
-
-			numLetters++;
-		}
-	}
-
-	// Unmap buffer and update command buffers
-	void endTextUpdate()
+	// Set one of the overlay's texts, the position is in framebuffer pixels
+	void setText(uint32_t handle, const std::string& string, float x, float y, vks::TextRenderer::TextAlign align = vks::TextRenderer::alignLeft)
 	{
-		vkUnmapMemory(vulkanDevice->logicalDevice, memory);
-		mapped = nullptr;
-		//updateCommandBuffers();
+		text.setText(handle, string, glm::vec2(x, y), align, glm::vec4(1.0f), 0.75f * scale);
 	}
 
-	// Issue the draw commands for the characters of the overlay
+	// Issue the draw command for the characters of the overlay
 	void draw(VkCommandBuffer cmdBuffer)
 	{
 		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 		vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
 
-		VkDeviceSize offsets = 0;
-		vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &buffer, &offsets);
-		vkCmdBindVertexBuffers(cmdBuffer, 1, 1, &buffer, &offsets);
-		// One draw command for every character. This is okay for a debug overlay, but not optimal
-		// In a real-world application one would try to batch draw commands
-		for (uint32_t j = 0; j < numLetters; j++) {
-			vkCmdDraw(cmdBuffer, 4, 1, j * 4, 0);
-		}
+		glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(-1.0f, -1.0f, 0.0f));
+		transform = glm::scale(transform, glm::vec3(2.0f / (float)*frameBufferWidth, 2.0f / (float)*frameBufferHeight, 1.0f));
+		vkCmdPushConstants(cmdBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &transform);
+
+		// All glyphs are drawn as instances with a single draw command
+		text.cmdDraw(cmdBuffer);
 	}
 };
 
@@ -445,6 +355,16 @@ class VulkanExample : public VulkanExampleBase
 {
 public:
 	TextOverlay* textOverlay{ nullptr };
+	// Handles of the overlay's texts
+	struct Texts {
+		uint32_t title;
+		uint32_t frameTime;
+		uint32_t deviceName;
+		uint32_t matrixHeader;
+		std::array<uint32_t, 4> matrixRows;
+		uint32_t label;
+		std::array<uint32_t, 2> help;
+	} texts{};
 
 	vkglTF::Model model;
 
@@ -463,6 +383,8 @@ public:
 	VulkanExample() : VulkanExampleBase()
 	{
 		title = "Text overlay";
+		// The instanced glyph rendering only has GLSL shaders
+		requireGlslShaders();
 		camera.type = Camera::CameraType::lookat;
 		camera.setPosition(glm::vec3(0.0f, 0.0f, -2.5f));
 		camera.setRotation(glm::vec3(-25.0f, -0.0f, 0.0f));
@@ -528,45 +450,40 @@ public:
 		vkQueueWaitIdle(queue);
 	}
 
-	// Update the text buffer displayed by the text overlay
+	// Update the texts displayed by the text overlay
+	// Texts are only laid out again if their string changed, and only written to the instance buffer if anything changed
 	void updateTextOverlay(void)
 	{
-		uint32_t lastNumLetters = textOverlay->numLetters;
-
-		textOverlay->beginTextUpdate();
-
-		textOverlay->addText(title, 5.0f * ui.scale, 5.0f * ui.scale, TextOverlay::alignLeft);
+		textOverlay->setText(texts.title, title, 5.0f * ui.scale, 5.0f * ui.scale);
 
 		std::stringstream ss;
 		ss << std::fixed << std::setprecision(2) << (frameTimer * 1000.0f) << "ms (" << lastFPS << " fps)";
-		textOverlay->addText(ss.str(), 5.0f * ui.scale, 25.0f * ui.scale, TextOverlay::alignLeft);
+		textOverlay->setText(texts.frameTime, ss.str(), 5.0f * ui.scale, 25.0f * ui.scale);
 
-		textOverlay->addText(deviceProperties.deviceName, 5.0f * ui.scale, 45.0f * ui.scale, TextOverlay::alignLeft);
+		textOverlay->setText(texts.deviceName, deviceProperties.deviceName, 5.0f * ui.scale, 45.0f * ui.scale);
 
 		// Display current model view matrix
-		textOverlay->addText("model view matrix", (float)width - 5.0f * ui.scale, 5.0f * ui.scale, TextOverlay::alignRight);
+		textOverlay->setText(texts.matrixHeader, "model view matrix", (float)width - 5.0f * ui.scale, 5.0f * ui.scale, vks::TextRenderer::alignRight);
 
 		for (uint32_t i = 0; i < 4; i++)
 		{
 			ss.str("");
 			ss << std::fixed << std::setprecision(2) << std::showpos;
 			ss << uniformData.modelView[0][i] << " " << uniformData.modelView[1][i] << " " << uniformData.modelView[2][i] << " " << uniformData.modelView[3][i];
-			textOverlay->addText(ss.str(), (float)width - 5.0f * ui.scale, (25.0f + (float)i * 20.0f) * ui.scale, TextOverlay::alignRight);
+			textOverlay->setText(texts.matrixRows[i], ss.str(), (float)width - 5.0f * ui.scale, (25.0f + (float)i * 20.0f) * ui.scale, vks::TextRenderer::alignRight);
 		}
 
 		glm::vec3 projected = glm::project(glm::vec3(0.0f), uniformData.modelView, uniformData.projection, glm::vec4(0, 0, (float)width, (float)height));
-		textOverlay->addText("A torus knot", projected.x, projected.y, TextOverlay::alignCenter);
+		textOverlay->setText(texts.label, "A torus knot", projected.x, projected.y, vks::TextRenderer::alignCenter);
 
 #if defined(__ANDROID__)
 #else
-		textOverlay->addText("Press \"space\" to toggle text overlay", 5.0f * ui.scale, 65.0f * ui.scale, TextOverlay::alignLeft);
-		textOverlay->addText("Hold middle mouse button and drag to move", 5.0f * ui.scale, 85.0f * ui.scale, TextOverlay::alignLeft);
+		textOverlay->setText(texts.help[0], "Press \"space\" to toggle text overlay", 5.0f * ui.scale, 65.0f * ui.scale);
+		textOverlay->setText(texts.help[1], "Hold middle mouse button and drag to move", 5.0f * ui.scale, 85.0f * ui.scale);
 #endif
-		textOverlay->endTextUpdate();
 
-		// If the no. of letters changed, the no. of draw commands also changes which requires a rebuild of the command buffers
-		if (lastNumLetters != textOverlay->numLetters) {
-			std::cout << "rebuild cb\n";
+		// If the no. of glyph instances or the instance buffer changed, the draw command changes which requires a rebuild of the command buffers
+		if (textOverlay->text.update()) {
 			buildCommandBuffers();
 		}
 	}
@@ -669,6 +586,18 @@ public:
 			ui.scale,
 			shaderStages
 			);
+
+		texts.title = textOverlay->text.addText();
+		texts.frameTime = textOverlay->text.addText();
+		texts.deviceName = textOverlay->text.addText();
+		texts.matrixHeader = textOverlay->text.addText();
+		for (auto& row : texts.matrixRows) {
+			row = textOverlay->text.addText();
+		}
+		texts.label = textOverlay->text.addText();
+		for (auto& help : texts.help) {
+			help = textOverlay->text.addText();
+		}
 		updateTextOverlay();
 	}
 
@@ -7,6 +7,8 @@
 */
 
 #include "vulkanexamplebase.h"
+#include "threadpool.hpp"
+#include "simd.hpp"
 
 // Vertex layout for this example
 struct Vertex {
@@ -82,8 +84,95 @@ public:
 			lerp(v, lerp(u, grad(permutations[AA + 1], x, y, z - 1), grad(permutations[BA + 1], x - 1, y, z - 1)), lerp(u, grad(permutations[AB + 1], x, y - 1, z - 1), grad(permutations[BB + 1], x - 1, y - 1, z - 1))));
 		return res;
 	}
+	/**
+	* Evaluate the noise for a row of points that only share y and z, which is how the volume is generated
+	* The float specialization below evaluates multiple points at once using SIMD instructions
+	*/
+	void noiseRow(const T* x, T y, T z, T* result, uint32_t count)
+	{
+		for (uint32_t i = 0; i < count; i++) {
+			result[i] = noise(x[i], y, z);
+		}
+	}
+	const uint32_t* permutationTable() const
+	{
+		return permutations;
+	}
 };
 
+#if !defined(VKS_SIMD_NONE)
+namespace simd
+{
+	// Vectorized version of PerlinNoise::grad
+	inline vfloat grad(vint hash, vfloat x, vfloat y, vfloat z)
+	{
+		const vint h = andi(hash, seti(15));
+		const vfloat u = select(lessThan(h, seti(8)), x, y);
+		// h == 12 || h == 14 is the same as (h & 13) == 12
+		const vfloat v = select(lessThan(h, seti(4)), y, select(equal(andi(h, seti(13)), seti(12)), x, z));
+		// Bits 0 and 1 of the hash flip the signs of u and v
+		return add(negate(equal(andi(h, seti(1)), seti(1)), u), negate(equal(andi(h, seti(2)), seti(2)), v));
+	}
+
+	inline vfloat lerp(vfloat t, vfloat a, vfloat b)
+	{
+		return add(a, mul(t, sub(b, a)));
+	}
+
+	inline vfloat fade(vfloat t)
+	{
+		return mul(mul(mul(t, t), t), add(mul(t, sub(mul(t, set(6.0f)), set(15.0f))), set(10.0f)));
+	}
+}
+
+template <>
+inline void PerlinNoise<float>::noiseRow(const float* x, float y, float z, float* result, uint32_t count)
+{
+	// Everything that only depends on y and z is the same for all points of the row
+	const float yFloor = std::floor(y);
+	const float zFloor = std::floor(z);
+	const simd::vint Y = simd::seti((int32_t)yFloor & 255);
+	const simd::vint Z = simd::seti((int32_t)zFloor & 255);
+	const float yFrac = y - yFloor;
+	const float zFrac = z - zFloor;
+	const simd::vfloat v = simd::set(fade(yFrac));
+	const simd::vfloat w = simd::set(fade(zFrac));
+	const simd::vfloat y0 = simd::set(yFrac);
+	const simd::vfloat y1 = simd::set(yFrac - 1.0f);
+	const simd::vfloat z0 = simd::set(zFrac);
+	const simd::vfloat z1 = simd::set(zFrac - 1.0f);
+	const simd::vfloat one = simd::set(1.0f);
+	const simd::vint onei = simd::seti(1);
+
+	uint32_t i = 0;
+	for (; i + simd::width <= count; i += simd::width) {
+		// Same steps as the scalar noise function, with all permutation lookups done as gathers
+		simd::vfloat x0 = simd::load(x + i);
+		const simd::vfloat xFloor = simd::floor(x0);
+		const simd::vint X = simd::andi(simd::toInt(xFloor), simd::seti(255));
+		x0 = simd::sub(x0, xFloor);
+		const simd::vfloat x1 = simd::sub(x0, one);
+		const simd::vfloat u = simd::fade(x0);
+
+		const simd::vint A = simd::addi(simd::gather(permutations, X), Y);
+		const simd::vint AA = simd::addi(simd::gather(permutations, A), Z);
+		const simd::vint AB = simd::addi(simd::gather(permutations, simd::addi(A, onei)), Z);
+		const simd::vint B = simd::addi(simd::gather(permutations, simd::addi(X, onei)), Y);
+		const simd::vint BA = simd::addi(simd::gather(permutations, B), Z);
+		const simd::vint BB = simd::addi(simd::gather(permutations, simd::addi(B, onei)), Z);
+
+		const simd::vfloat res = simd::lerp(w, simd::lerp(v,
+			simd::lerp(u, simd::grad(simd::gather(permutations, AA), x0, y0, z0), simd::grad(simd::gather(permutations, BA), x1, y0, z0)), simd::lerp(u, simd::grad(simd::gather(permutations, AB), x0, y1, z0), simd::grad(simd::gather(permutations, BB), x1, y1, z0))),
+			simd::lerp(v, simd::lerp(u, simd::grad(simd::gather(permutations, simd::addi(AA, onei)), x0, y0, z1), simd::grad(simd::gather(permutations, simd::addi(BA, onei)), x1, y0, z1)), simd::lerp(u, simd::grad(simd::gather(permutations, simd::addi(AB, onei)), x0, y1, z1), simd::grad(simd::gather(permutations, simd::addi(BB, onei)), x1, y1, z1))));
+		simd::store(result + i, res);
+	}
+	// Remaining points that don't fill a whole vector
+	for (; i < count; i++) {
+		result[i] = noise(x[i], y, z);
+	}
+}
+#endif
+
 // Fractal noise generator based on perlin noise above
 template <typename T>
 class FractalNoise
@@ -119,6 +208,39 @@ public:
 		sum = sum / max;
 		return (sum + (T)1.0) / (T)2.0;
 	}
+
+	// Evaluate the noise for a row of points that only share y and z, see PerlinNoise::noiseRow
+	void noiseRow(const T* x, T y, T z, T* result, uint32_t count)
+	{
+		// The row is processed in blocks, so the intermediate results fit on the stack
+		const uint32_t blockSize = 64;
+		T scaled[blockSize];
+		T octave[blockSize];
+		T sum[blockSize];
+		for (uint32_t first = 0; first < count; first += blockSize) {
+			const uint32_t n = std::min(blockSize, count - first);
+			std::fill(sum, sum + n, (T)0);
+			T frequency = (T)1;
+			T amplitude = (T)1;
+			T max = (T)0;
+			for (uint32_t i = 0; i < octaves; i++)
+			{
+				for (uint32_t j = 0; j < n; j++) {
+					scaled[j] = x[first + j] * frequency;
+				}
+				perlinNoise.noiseRow(scaled, y * frequency, z * frequency, octave, n);
+				for (uint32_t j = 0; j < n; j++) {
+					sum[j] += octave[j] * amplitude;
+				}
+				max += amplitude;
+				amplitude *= persistence;
+				frequency *= (T)2;
+			}
+			for (uint32_t j = 0; j < n; j++) {
+				result[first + j] = (sum[j] / max + (T)1.0) / (T)2.0;
+			}
+		}
+	}
 };
 
 class VulkanExample : public VulkanExampleBase
@@ -158,20 +280,70 @@ public:
 	VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
 	VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
 
+	// The noise can either be generated on the CPU (scalar or SIMD, both spread across all cores) or directly on the GPU with a compute shader
+	enum NoiseBackend { backendScalar = 0, backendSIMD = 1, backendCompute = 2 };
+	int32_t noiseBackend{ backendSIMD };
+	const std::vector<std::string> backendNames = { "CPU (scalar)", "CPU (" VKS_SIMD_NAME ")", "GPU (compute)" };
+	// Generation (and upload) times of the last run with each backend
+	struct BenchmarkResult {
+		double milliseconds{ 0.0 };
+		double voxelsPerSecond{ 0.0 };
+	};
+	std::array<BenchmarkResult, 3> benchmarkResults{};
+
+	// Volume sizes that can be selected in the UI
+	const std::vector<uint32_t> volumeSizes = { 64, 128, 256, 512 };
+	int32_t volumeSizeIndex{ 1 };
+
+	// Parameters of the current noise, kept so every backend generates the same volume
+	PerlinNoise<float> perlinNoise{ false };
+	float noiseScale{ 4.0f };
+
+	// Slices are generated by the worker threads into a ring of staging buffers, each filled chunk is uploaded while the next one is generated
+	struct StagingSlot {
+		vks::Buffer buffer;
+		VkCommandBuffer commandBuffer{ VK_NULL_HANDLE };
+		VkFence fence{ VK_NULL_HANDLE };
+	};
+	std::array<StagingSlot, 3> stagingRing{};
+	uint32_t slicesPerChunk{ 0 };
+	vks::ThreadPool threadPool;
+	uint32_t numThreads{ 0 };
+
+	// Resources for generating the noise with a compute shader
+	struct Compute {
+		bool supported{ false };
+		VkPipeline pipeline{ VK_NULL_HANDLE };
+		VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
+		VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
+		VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
+		// Permutation table of the current noise
+		vks::Buffer permutationBuffer;
+	} compute;
+
 	VulkanExample() : VulkanExampleBase()
 	{
 		title = "3D textures";
+		// The compute noise generation only has a GLSL shader
+		requireGlslShaders();
 		camera.type = Camera::CameraType::lookat;
 		camera.setPosition(glm::vec3(0.0f, 0.0f, -2.5f));
 		camera.setRotation(glm::vec3(0.0f, 15.0f, 0.0f));
 		camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 256.0f);
 		srand(benchmark.active ? 0 : (unsigned int)time(NULL));
+		numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+		threadPool.setThreadCount(numThreads);
 	}
 
 	~VulkanExample()
 	{
 		if (device) {
 			destroyTextureImage(texture);
+			destroyStagingRing();
+			vkDestroyPipeline(device, compute.pipeline, nullptr);
+			vkDestroyPipelineLayout(device, compute.pipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(device, compute.descriptorSetLayout, nullptr);
+			compute.permutationBuffer.destroy();
 			vkDestroyPipeline(device, pipeline, nullptr);
 			vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 			vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
@@ -181,6 +353,14 @@ public:
 		}
 	}
 
+	virtual void getEnabledFeatures()
+	{
+		// Writing to an R8 storage image with the compute shader requires the extended storage image formats
+		if (deviceFeatures.shaderStorageImageExtendedFormats) {
+			enabledFeatures.shaderStorageImageExtendedFormats = VK_TRUE;
+		}
+	}
+
 	// Prepare all Vulkan resources for the 3D texture (including descriptors)
 	// Does not fill the texture with data
 	void prepareNoiseTexture(uint32_t width, uint32_t height, uint32_t depth)
@@ -202,6 +382,8 @@ public:
 			std::cout << "Error: Device does not support flag TRANSFER_DST for selected texture format!" << std::endl;
 			return;
 		}
+		// Check if the compute shader can write to the texture
+		compute.supported = enabledFeatures.shaderStorageImageExtendedFormats && (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT);
 		// Check if GPU supports requested 3D texture dimensions
 		uint32_t maxImageDimension3D(vulkanDevice->properties.limits.maxImageDimension3D);
 		if (width > maxImageDimension3D || height > maxImageDimension3D || depth > maxImageDimension3D)
@@ -225,6 +407,9 @@ public:
 		// Set initial layout of the image to undefined
 		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 		imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		if (compute.supported) {
+			imageCreateInfo.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+		}
 		VK_CHECK_RESULT(vkCreateImage(device, &imageCreateInfo, nullptr, &texture.image));
 
 		// Device local memory to back up image
@@ -270,128 +455,242 @@ public:
 		texture.descriptor.imageView = texture.view;
 		texture.descriptor.sampler = texture.sampler;
 
-		updateNoiseTexture();
+		prepareStagingRing();
 	}
 
-	// Generate randomized noise and upload it to the 3D texture using staging
-	void updateNoiseTexture()
+	// Create the staging buffers that the slices are generated into, each one holds a chunk of slices
+	void prepareStagingRing()
 	{
-		const uint32_t texMemSize = texture.width * texture.height * texture.depth;
+		destroyStagingRing();
+		// Chunks of about 4 MB with at least as many slices as there are threads, so all threads have work
+		const uint32_t sliceSize = texture.width * texture.height;
+		slicesPerChunk = std::min(std::max((4u * 1024u * 1024u) / sliceSize, numThreads), texture.depth);
+		for (auto& slot : stagingRing) {
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &slot.buffer, (VkDeviceSize)slicesPerChunk * sliceSize));
+			VK_CHECK_RESULT(slot.buffer.map());
+			slot.commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, cmdPool, false);
+			// Signaled, so the first use of a slot doesn't wait
+			VkFenceCreateInfo fenceCreateInfo = vks::initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
+			VK_CHECK_RESULT(vkCreateFence(device, &fenceCreateInfo, nullptr, &slot.fence));
+		}
+	}
 
-		uint8_t *data = new uint8_t[texMemSize];
-		memset(data, 0, texMemSize);
+	void destroyStagingRing()
+	{
+		for (auto& slot : stagingRing) {
+			if (slot.fence != VK_NULL_HANDLE) {
+				vkWaitForFences(device, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+				vkDestroyFence(device, slot.fence, nullptr);
+				vkFreeCommandBuffers(device, cmdPool, 1, &slot.commandBuffer);
+				slot.buffer.destroy();
+			}
+			slot = StagingSlot();
+		}
+	}
 
-		// Generate perlin based noise
-		std::cout << "Generating " << texture.width << " x " << texture.height << " x " << texture.depth << " noise texture..." << std::endl;
+	// Select a new random noise
+	void randomizeNoise()
+	{
+		perlinNoise = PerlinNoise<float>(!benchmark.active);
+		noiseScale = static_cast<float>(rand() % 10) + 4.0f;
+	}
 
-		auto tStart = std::chrono::high_resolution_clock::now();
+	// Generate one slice of the noise on the CPU
+	void generateSlice(FractalNoise<float>& fractalNoise, const std::vector<float>& xCoords, uint32_t z, uint8_t* dst, bool useSIMD)
+	{
+		std::vector<float> row(texture.width);
+		const float nz = (float)z / (float)texture.depth;
+		for (uint32_t y = 0; y < texture.height; y++)
+		{
+			const float ny = (float)y / (float)texture.height;
+			if (useSIMD) {
+				fractalNoise.noiseRow(xCoords.data(), ny * noiseScale, nz * noiseScale, row.data(), texture.width);
+			} else {
+				for (uint32_t x = 0; x < texture.width; x++) {
+					row[x] = fractalNoise.noise(xCoords[x], ny * noiseScale, nz * noiseScale);
+				}
+			}
+			uint8_t* rowData = dst + y * texture.width;
+			for (uint32_t x = 0; x < texture.width; x++) {
+				float n = row[x];
+				n = n - floor(n);
+				rowData[x] = static_cast<uint8_t>(floor(n * 255));
+			}
+		}
+	}
 
-		PerlinNoise<float> perlinNoise(!benchmark.active);
+	// Generate the noise on the CPU and upload it to the 3D texture using the staging ring
+	void generateNoiseCPU(bool useSIMD)
+	{
 		FractalNoise<float> fractalNoise(perlinNoise);
 
-		const float noiseScale = static_cast<float>(rand() % 10) + 4.0f;
+		// The x coordinates of the noise are the same for all rows
+		std::vector<float> xCoords(texture.width);
+		for (uint32_t x = 0; x < texture.width; x++) {
+			float nx = (float)x / (float)texture.width;
+			xCoords[x] = nx * noiseScale;
+		}
 
-#pragma omp parallel for
-		for (int32_t z = 0; z < static_cast<int32_t>(texture.depth); z++)
+		// The sub resource range describes the regions of the image we will be transitioned
+		VkImageSubresourceRange subresourceRange = {};
+		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		subresourceRange.baseMipLevel = 0;
+		subresourceRange.levelCount = 1;
+		subresourceRange.layerCount = 1;
+
+		const uint32_t sliceSize = texture.width * texture.height;
+		const uint32_t chunkCount = (texture.depth + slicesPerChunk - 1) / slicesPerChunk;
+		for (uint32_t chunk = 0; chunk < chunkCount; chunk++)
 		{
-			for (int32_t y = 0; y < static_cast<int32_t>(texture.height); y++)
-			{
-				for (int32_t x = 0; x < static_cast<int32_t>(texture.width); x++)
-				{
-					float nx = (float)x / (float)texture.width;
-					float ny = (float)y / (float)texture.height;
-					float nz = (float)z / (float)texture.depth;
-					float n = fractalNoise.noise(nx * noiseScale, ny * noiseScale, nz * noiseScale);
-					n = n - floor(n);
-					data[x + y * texture.width + z * texture.width * texture.height] = static_cast<uint8_t>(floor(n * 255));
-				}
+			StagingSlot& slot = stagingRing[chunk % stagingRing.size()];
+			const uint32_t firstSlice = chunk * slicesPerChunk;
+			const uint32_t sliceCount = std::min(slicesPerChunk, texture.depth - firstSlice);
+
+			// Wait until the upload of the chunk that used this slot before has finished
+			VK_CHECK_RESULT(vkWaitForFences(device, 1, &slot.fence, VK_TRUE, UINT64_MAX));
+			VK_CHECK_RESULT(vkResetFences(device, 1, &slot.fence));
+
+			// Distribute the slices of the chunk across the worker threads
+			uint8_t* data = static_cast<uint8_t*>(slot.buffer.mapped);
+			for (uint32_t i = 0; i < sliceCount; i++) {
+				uint8_t* dst = data + (size_t)i * sliceSize;
+				const uint32_t z = firstSlice + i;
+				threadPool.threads[i % numThreads]->addJob([this, &fractalNoise, &xCoords, z, dst, useSIMD] { generateSlice(fractalNoise, xCoords, z, dst, useSIMD); });
+			}
+			threadPool.wait();
+
+			VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+			cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			VK_CHECK_RESULT(vkBeginCommandBuffer(slot.commandBuffer, &cmdBufInfo));
+
+			// Optimal image will be used as destination for the copies, so we must transfer from our
+			// initial undefined image layout to the transfer destination layout before the first chunk
+			if (chunk == 0) {
+				vks::tools::setImageLayout(
+					slot.commandBuffer,
+					texture.image,
+					VK_IMAGE_LAYOUT_UNDEFINED,
+					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					subresourceRange);
 			}
-		}
 
-		auto tEnd = std::chrono::high_resolution_clock::now();
-		auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+			// Copy the slices of this chunk to the texture
+			VkBufferImageCopy bufferCopyRegion{};
+			bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			bufferCopyRegion.imageSubresource.mipLevel = 0;
+			bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
+			bufferCopyRegion.imageSubresource.layerCount = 1;
+			bufferCopyRegion.imageOffset.z = firstSlice;
+			bufferCopyRegion.imageExtent.width = texture.width;
+			bufferCopyRegion.imageExtent.height = texture.height;
+			bufferCopyRegion.imageExtent.depth = sliceCount;
+			vkCmdCopyBufferToImage(slot.commandBuffer, slot.buffer.buffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
+
+			// Change texture image layout to shader read after the last chunk has been copied
+			if (chunk == chunkCount - 1) {
+				texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				vks::tools::setImageLayout(
+					slot.commandBuffer,
+					texture.image,
+					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					texture.imageLayout,
+					subresourceRange);
+			}
 
-		std::cout << "Done in " << tDiff << "ms" << std::endl;
+			VK_CHECK_RESULT(vkEndCommandBuffer(slot.commandBuffer));
 
-		// Create a host-visible staging buffer that contains the raw image data
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingMemory;
+			// Submit without waiting, the copy runs on the GPU while the workers generate the next chunk
+			VkSubmitInfo copySubmitInfo = vks::initializers::submitInfo();
+			copySubmitInfo.commandBufferCount = 1;
+			copySubmitInfo.pCommandBuffers = &slot.commandBuffer;
+			VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &copySubmitInfo, slot.fence));
+		}
 
-		// Buffer object
-		VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo();
-		bufferCreateInfo.size = texMemSize;
-		bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		VK_CHECK_RESULT(vkCreateBuffer(device, &bufferCreateInfo, nullptr, &stagingBuffer));
+		// Wait for the remaining uploads
+		for (auto& slot : stagingRing) {
+			VK_CHECK_RESULT(vkWaitForFences(device, 1, &slot.fence, VK_TRUE, UINT64_MAX));
+		}
+	}
 
-		// Allocate host visible memory for data upload
-		VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
-		VkMemoryRequirements memReqs = {};
-		vkGetBufferMemoryRequirements(device, stagingBuffer, &memReqs);
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device, &memAllocInfo, nullptr, &stagingMemory));
-		VK_CHECK_RESULT(vkBindBufferMemory(device, stagingBuffer, stagingMemory, 0));
+	// Generate the noise directly into the 3D texture with a compute shader, which avoids the upload and scales to large volumes
+	void generateNoiseCompute()
+	{
+		// The compute shader uses the same permutation table as the CPU
+		memcpy(compute.permutationBuffer.mapped, perlinNoise.permutationTable(), 512 * sizeof(uint32_t));
 
-		// Copy texture data into staging buffer
-		uint8_t *mapped;
-		VK_CHECK_RESULT(vkMapMemory(device, stagingMemory, 0, memReqs.size, 0, (void **)&mapped));
-		memcpy(mapped, data, texMemSize);
-		vkUnmapMemory(device, stagingMemory);
+		VkCommandBuffer commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 
-		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		vks::tools::setImageLayout(commandBuffer, texture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresourceRange);
 
-		// The sub resource range describes the regions of the image we will be transitioned
-		VkImageSubresourceRange subresourceRange = {};
-		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		subresourceRange.baseMipLevel = 0;
-		subresourceRange.levelCount = 1;
-		subresourceRange.layerCount = 1;
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(float), &noiseScale);
+		// One invocation per voxel, with 8x8 invocations per work group covering a part of a slice
+		vkCmdDispatch(commandBuffer, (texture.width + 7) / 8, (texture.height + 7) / 8, texture.depth);
 
-		// Optimal image will be used as destination for the copy, so we must transfer from our
-		// initial undefined image layout to the transfer destination layout
-		vks::tools::setImageLayout(
-			copyCmd,
-			texture.image,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			subresourceRange);
-
-		// Copy 3D noise data to texture
-
-		// Setup buffer copy regions
-		VkBufferImageCopy bufferCopyRegion{};
-		bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		bufferCopyRegion.imageSubresource.mipLevel = 0;
-		bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
-		bufferCopyRegion.imageSubresource.layerCount = 1;
-		bufferCopyRegion.imageExtent.width = texture.width;
-		bufferCopyRegion.imageExtent.height = texture.height;
-		bufferCopyRegion.imageExtent.depth = texture.depth;
-
-		vkCmdCopyBufferToImage(
-			copyCmd,
-			stagingBuffer,
-			texture.image,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			1,
-			&bufferCopyRegion);
-
-		// Change texture image layout to shader read after all mip levels have been copied
 		texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		vks::tools::setImageLayout(
-			copyCmd,
-			texture.image,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			texture.imageLayout,
-			subresourceRange);
+		vks::tools::setImageLayout(commandBuffer, texture.image, VK_IMAGE_LAYOUT_GENERAL, texture.imageLayout, subresourceRange);
+
+		vulkanDevice->flushCommandBuffer(commandBuffer, queue, true);
+	}
 
-		vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
+	// Generate the noise with the selected backend and fill the 3D texture
+	void updateNoiseTexture()
+	{
+		if ((noiseBackend == backendCompute) && !compute.supported) {
+			std::cout << "Compute shader generation is not supported on this device, using the CPU instead" << std::endl;
+			noiseBackend = backendSIMD;
+		}
 
-		// Clean up staging resources
-		delete[] data;
-		vkFreeMemory(device, stagingMemory, nullptr);
-		vkDestroyBuffer(device, stagingBuffer, nullptr);
+		std::cout << "Generating " << texture.width << " x " << texture.height << " x " << texture.depth << " noise texture using " << backendNames[noiseBackend] << "..." << std::endl;
+
+		auto tStart = std::chrono::high_resolution_clock::now();
+
+		if (noiseBackend == backendCompute) {
+			generateNoiseCompute();
+		} else {
+			generateNoiseCPU(noiseBackend == backendSIMD);
+		}
+
+		auto tEnd = std::chrono::high_resolution_clock::now();
+		auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+
+		// Times include the upload, as that's when the texture can be used
+		const double voxelCount = (double)texture.width * (double)texture.height * (double)texture.depth;
+		BenchmarkResult& result = benchmarkResults[noiseBackend];
+		result.milliseconds = tDiff;
+		result.voxelsPerSecond = voxelCount / (tDiff / 1000.0);
+
+		std::cout << "Done in " << tDiff << "ms (" << result.voxelsPerSecond / 1.0e6 << " million voxels/s)" << std::endl;
+	}
+
+	// Generate the current noise with all available backends to compare their speed
+	void runBenchmark()
+	{
+		const int32_t selectedBackend = noiseBackend;
+		for (int32_t backend = backendScalar; backend <= backendCompute; backend++) {
+			if ((backend == backendCompute) && !compute.supported) {
+				continue;
+			}
+			noiseBackend = backend;
+			updateNoiseTexture();
+		}
+		noiseBackend = selectedBackend;
+		updateNoiseTexture();
+	}
+
+	// Recreate the texture with a different size
+	void resizeNoiseTexture()
+	{
+		vkQueueWaitIdle(queue);
+		destroyTextureImage(texture);
+		texture = Texture();
+		const uint32_t size = volumeSizes[volumeSizeIndex];
+		prepareNoiseTexture(size, size, size);
+		updateDescriptors();
+		benchmarkResults.fill(BenchmarkResult());
+		updateNoiseTexture();
 	}
 
 	// Free all Vulkan resources used a texture object
@@ -500,7 +799,9 @@ public:
 		// Pool
 		std::vector<VkDescriptorPoolSize> poolSizes = {
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1)
 		};
 		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 2);
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
@@ -519,12 +820,34 @@ public:
 		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
 
+		// Compute shader noise generation
+		if (compute.supported) {
+			setLayoutBindings = {
+				// Binding 0 : Noise output image
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+				// Binding 1 : Permutation table
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1)
+			};
+			descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &compute.descriptorSetLayout));
+			allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &compute.descriptorSetLayout, 1);
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &compute.descriptorSet));
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &compute.permutationBuffer, 512 * sizeof(uint32_t)));
+			VK_CHECK_RESULT(compute.permutationBuffer.map());
+		}
+
+		updateDescriptors();
+	}
+
+	// Write the descriptors that refer to the texture, which changes when the volume is resized
+	void updateDescriptors()
+	{
 		// Image descriptor for the 3D texture
 		VkDescriptorImageInfo textureDescriptor =
 			vks::initializers::descriptorImageInfo(
 				texture.sampler,
 				texture.view,
-				texture.imageLayout);
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
 		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
 			// Binding 0 : Vertex shader uniform buffer
@@ -532,6 +855,14 @@ public:
 			// Binding 1 : Fragment shader texture sampler
 			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &textureDescriptor)
 		};
+
+		VkDescriptorImageInfo storageImageDescriptor = vks::initializers::descriptorImageInfo(VK_NULL_HANDLE, texture.view, VK_IMAGE_LAYOUT_GENERAL);
+		if (compute.supported) {
+			// Binding 0 : Noise output image
+			writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0, &storageImageDescriptor));
+			// Binding 1 : Permutation table
+			writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &compute.permutationBuffer.descriptor));
+		}
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 	}
 
@@ -584,6 +915,18 @@ public:
 		pipelineCreateInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
 		pipelineCreateInfo.pStages = shaderStages.data();
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline));
+
+		// Compute pipeline for generating the noise on the GPU
+		if (compute.supported) {
+			VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(float), 0);
+			pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&compute.descriptorSetLayout, 1);
+			pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+			pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &compute.pipelineLayout));
+			VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(compute.pipelineLayout, 0);
+			computePipelineCreateInfo.stage = loadShader(getShadersPath() + "texture3d/noise.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+			VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipeline));
+		}
 	}
 
 	// Prepare and initialize uniform buffer containing shader uniforms
@@ -614,9 +957,11 @@ public:
 		VulkanExampleBase::prepare();
 		generateQuad();
 		prepareUniformBuffers();
-		prepareNoiseTexture(128, 128, 128);
+		prepareNoiseTexture(volumeSizes[volumeSizeIndex], volumeSizes[volumeSizeIndex], volumeSizes[volumeSizeIndex]);
 		setupDescriptors();
 		preparePipelines();
+		randomizeNoise();
+		updateNoiseTexture();
 		buildCommandBuffers();
 		prepared = true;
 	}
@@ -642,8 +987,31 @@ public:
 	{
 		if (overlay->header("Settings")) {
 			if (overlay->button("Generate new texture")) {
+				randomizeNoise();
 				updateNoiseTexture();
 			}
+			// Switching the backend regenerates the same noise
+			if (overlay->comboBox("Generator", &noiseBackend, backendNames)) {
+				updateNoiseTexture();
+			}
+			std::vector<std::string> sizeNames;
+			for (auto size : volumeSizes) {
+				sizeNames.push_back(std::to_string(size) + "^3");
+			}
+			if (overlay->comboBox("Volume size", &volumeSizeIndex, sizeNames)) {
+				resizeNoiseTexture();
+			}
+			if (overlay->button("Run benchmark")) {
+				runBenchmark();
+			}
+		}
+		if (overlay->header("Benchmark")) {
+			for (size_t i = 0; i < benchmarkResults.size(); i++) {
+				if (benchmarkResults[i].milliseconds > 0.0) {
+					overlay->text("%s: %.1f ms, %.1f M voxels/s", backendNames[i].c_str(), benchmarkResults[i].milliseconds, benchmarkResults[i].voxelsPerSecond / 1.0e6);
+				}
+			}
+			overlay->text("%d threads", numThreads);
 		}
 	}
 };
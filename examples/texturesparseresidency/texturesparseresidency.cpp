@@ -41,18 +41,26 @@ bool VirtualTexturePage::allocate(VkDevice device, uint32_t memoryTypeIndex)
 	VkMemoryAllocateInfo allocInfo = vks::initializers::memoryAllocateInfo();
 	allocInfo.allocationSize = size;
 	allocInfo.memoryTypeIndex = memoryTypeIndex;
-	VK_CHECK_RESULT(vkAllocateMemory(device, &allocInfo, nullptr, &imageMemoryBind.memory));
+	VkDeviceMemory memory;
+	VK_CHECK_RESULT(vkAllocateMemory(device, &allocInfo, nullptr, &memory));
+	assign(memory);
+	return true;
+}
 
+// Back the virtual page with an existing page sized memory allocation
+void VirtualTexturePage::assign(VkDeviceMemory memory)
+{
 	VkImageSubresource subResource{};
 	subResource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	subResource.mipLevel = mipLevel;
 	subResource.arrayLayer = layer;
 
 	// Sparse image memory binding
+	imageMemoryBind = {};
+	imageMemoryBind.memory = memory;
 	imageMemoryBind.subresource = subResource;
 	imageMemoryBind.extent = extent;
 	imageMemoryBind.offset = offset;
-	return true;
 }
 
 // Release Vulkan memory allocated for this page
@@ -94,16 +102,22 @@ VirtualTexturePage* VirtualTexture::addPage(VkOffset3D offset, VkExtent3D extent
 void VirtualTexture::updateSparseBindInfo(std::vector<VirtualTexturePage> &bindingChangedPages, bool del)
 {
 	// Update list of memory-backed sparse image memory binds
-	//sparseImageMemoryBinds.resize(pages.size());
-	sparseImageMemoryBinds.clear();
+	std::vector<VkSparseImageMemoryBind> binds;
 	for (auto page : bindingChangedPages)
 	{
-		sparseImageMemoryBinds.push_back(page.imageMemoryBind);
+		binds.push_back(page.imageMemoryBind);
 		if (del)
 		{
-			sparseImageMemoryBinds[sparseImageMemoryBinds.size() - 1].memory = VK_NULL_HANDLE;
+			binds[binds.size() - 1].memory = VK_NULL_HANDLE;
 		}
 	}
+	updateSparseBindInfo(binds);
+}
+
+// Same as above, but with a list of binds that may mix binding and unbinding (memory = VK_NULL_HANDLE) of pages
+void VirtualTexture::updateSparseBindInfo(const std::vector<VkSparseImageMemoryBind> &binds)
+{
+	sparseImageMemoryBinds = binds;
 	// Update sparse bind info
 	bindSparseInfo = vks::initializers::bindSparseInfo();
 	// todo: Semaphore for queue submission
@@ -126,6 +140,23 @@ void VirtualTexture::updateSparseBindInfo(std::vector<VirtualTexturePage> &bindi
 	bindSparseInfo.pImageOpaqueBinds = &opaqueMemoryBindInfo;
 }
 
+// Returns a page sized memory allocation, evicted pages are recycled before allocating new memory
+VkDeviceMemory VirtualTexture::acquireMemory(VkDeviceSize size)
+{
+	if (!freeMemory.empty())
+	{
+		VkDeviceMemory memory = freeMemory.back();
+		freeMemory.pop_back();
+		return memory;
+	}
+	VkMemoryAllocateInfo allocInfo = vks::initializers::memoryAllocateInfo();
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memoryTypeIndex;
+	VkDeviceMemory memory;
+	VK_CHECK_RESULT(vkAllocateMemory(device, &allocInfo, nullptr, &memory));
+	return memory;
+}
+
 // Release all Vulkan resources
 void VirtualTexture::destroy()
 {
@@ -133,6 +164,10 @@ void VirtualTexture::destroy()
 	{
 		page.release(device);
 	}
+	for (auto memory : freeMemory)
+	{
+		vkFreeMemory(device, memory, nullptr);
+	}
 	for (auto bind : opaqueMemoryBinds)
 	{
 		vkFreeMemory(device, bind.memory, nullptr);
@@ -143,12 +178,138 @@ void VirtualTexture::destroy()
 	}
 }
 
+/*
+	Tile file
+	Stores the content of all virtual pages so they can be streamed from disk
+ */
+
+bool TileFile::open(const std::string& filename, uint32_t width, uint32_t height, uint32_t pageCount)
+{
+	file.open(filename, std::ios::binary | std::ios::in);
+	if (!file.is_open())
+	{
+		return false;
+	}
+	Header fileHeader;
+	file.read(reinterpret_cast<char*>(&fileHeader), sizeof(Header));
+	// Discard files written for a different texture layout
+	if (!file || (memcmp(fileHeader.magic, header.magic, 4) != 0) || (fileHeader.version != header.version) || (fileHeader.width != width) || (fileHeader.height != height) || (fileHeader.pageCount != pageCount))
+	{
+		file.close();
+		return false;
+	}
+	header = fileHeader;
+	offsets.resize(pageCount + 1);
+	file.read(reinterpret_cast<char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+	return true;
+}
+
+void TileFile::close()
+{
+	if (file.is_open())
+	{
+		file.close();
+	}
+}
+
+void TileFile::readTile(uint32_t index, std::vector<uint8_t>& data)
+{
+	data.resize(static_cast<size_t>(offsets[index + 1] - offsets[index]));
+	std::lock_guard<std::mutex> lock(fileMutex);
+	file.seekg(offsets[index]);
+	file.read(reinterpret_cast<char*>(data.data()), data.size());
+}
+
+void TileFile::write(const std::string& filename, uint32_t width, uint32_t height, const std::vector<VirtualTexturePage>& pages, std::function<void(const VirtualTexturePage&, uint8_t*)> generator)
+{
+	Header header;
+	header.width = width;
+	header.height = height;
+	header.pageCount = static_cast<uint32_t>(pages.size());
+	// One additional offset marks the end of the last tile, so tile sizes can be derived from the offsets
+	std::vector<uint64_t> offsets(pages.size() + 1);
+	offsets[0] = sizeof(Header) + offsets.size() * sizeof(uint64_t);
+	for (size_t i = 0; i < pages.size(); i++)
+	{
+		offsets[i + 1] = offsets[i] + static_cast<uint64_t>(header.bytesPerTexel) * pages[i].extent.width * pages[i].extent.height;
+	}
+	std::ofstream file(filename, std::ios::binary | std::ios::out);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+	file.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+	std::vector<uint8_t> tile;
+	for (size_t i = 0; i < pages.size(); i++)
+	{
+		tile.resize(static_cast<size_t>(offsets[i + 1] - offsets[i]));
+		generator(pages[i], tile.data());
+		file.write(reinterpret_cast<const char*>(tile.data()), tile.size());
+	}
+}
+
+/*
+	Residency manager
+	Tracks resident pages in least recently used order
+ */
+
+void ResidencyManager::init(size_t pageCount)
+{
+	lruPositions.resize(pageCount);
+	lastRequestedFrame.resize(pageCount);
+	pending.resize(pageCount);
+	reset();
+}
+
+void ResidencyManager::reset()
+{
+	lruList.clear();
+	std::fill(lruPositions.begin(), lruPositions.end(), lruList.end());
+	std::fill(lastRequestedFrame.begin(), lastRequestedFrame.end(), UINT32_MAX);
+	std::fill(pending.begin(), pending.end(), false);
+}
+
+bool ResidencyManager::resident(uint32_t page) const
+{
+	return lruPositions[page] != lruList.end();
+}
+
+void ResidencyManager::touch(uint32_t page, uint32_t frame)
+{
+	lastRequestedFrame[page] = frame;
+	if (resident(page))
+	{
+		lruList.splice(lruList.begin(), lruList, lruPositions[page]);
+	}
+}
+
+void ResidencyManager::makeResident(uint32_t page, uint32_t frame)
+{
+	lruList.push_front(page);
+	lruPositions[page] = lruList.begin();
+	lastRequestedFrame[page] = frame;
+}
+
+uint32_t ResidencyManager::evictionCandidate(uint32_t frame) const
+{
+	if (lruList.empty() || (lastRequestedFrame[lruList.back()] == frame))
+	{
+		return UINT32_MAX;
+	}
+	return lruList.back();
+}
+
+void ResidencyManager::evict(uint32_t page)
+{
+	lruList.erase(lruPositions[page]);
+	lruPositions[page] = lruList.end();
+}
+
 /*
 	Vulkan Example class
 */
 VulkanExample::VulkanExample() : VulkanExampleBase()
 {
 	title = "Sparse texture residency";
+	// Only the GLSL fragment shader writes the page requests to the feedback buffer
+	requireGlslShaders();
 	std::cout.imbue(std::locale(""));
 	camera.type = Camera::CameraType::lookat;
 	camera.setPosition(glm::vec3(0.0f, 0.0f, -12.0f));
@@ -160,6 +321,13 @@ VulkanExample::~VulkanExample()
 {
 	// Clean up used Vulkan resources
 	// Note : Inherited destructor cleans up resources stored in base class
+	// Worker threads need to be finished before the objects they access are destroyed
+	streaming.threadPool.wait();
+	streaming.threadPool.threads.clear();
+	streaming.tileFile.close();
+	streaming.feedbackBuffer.destroy();
+	streaming.stagingBuffer.destroy();
+	pageTableBuffer.destroy();
 	destroyTextureImage(texture);
 	vkDestroySemaphore(device, bindSparseSemaphore, nullptr);
 	vkDestroyPipeline(device, pipeline, nullptr);
@@ -504,6 +672,20 @@ void VulkanExample::buildCommandBuffers()
 
 		VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
+		// Clear this command buffer's region of the page request buffer before the fragment shader writes new requests
+		const VkDeviceSize feedbackOffset = i * streaming.feedbackStride;
+		const uint32_t dynamicOffset = static_cast<uint32_t>(feedbackOffset);
+		vkCmdFillBuffer(drawCmdBuffers[i], streaming.feedbackBuffer.buffer, feedbackOffset, streaming.feedbackStride, 0);
+		VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
+		bufferBarrier.buffer = streaming.feedbackBuffer.buffer;
+		bufferBarrier.offset = feedbackOffset;
+		bufferBarrier.size = streaming.feedbackStride;
+		bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+
 		vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 		VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
@@ -512,7 +694,7 @@ void VulkanExample::buildCommandBuffers()
 		VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
 		vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
-		vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
+		vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 1, &dynamicOffset);
 		vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 		plane.draw(drawCmdBuffers[i]);
 
@@ -520,6 +702,11 @@ void VulkanExample::buildCommandBuffers()
 
 		vkCmdEndRenderPass(drawCmdBuffers[i]);
 
+		// Make the page requests visible to the host
+		bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(drawCmdBuffers[i], VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+
 		VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 	}
 }
@@ -534,8 +721,9 @@ void VulkanExample::setupDescriptors()
 {
 	// Pool
 	std::vector<VkDescriptorPoolSize> poolSizes = {
-		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
-		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1)
+		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2),
+		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1),
+		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1)
 	};
 	VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 2);
 	VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
@@ -551,7 +739,17 @@ void VulkanExample::setupDescriptors()
 		vks::initializers::descriptorSetLayoutBinding(
 			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
 			VK_SHADER_STAGE_FRAGMENT_BIT,
-			1)
+			1),
+		// Binding 2 : Fragment shader page table uniform buffer
+		vks::initializers::descriptorSetLayoutBinding(
+			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+			VK_SHADER_STAGE_FRAGMENT_BIT,
+			2),
+		// Binding 3 : Fragment shader page request storage buffer (offset selects the region of the current command buffer)
+		vks::initializers::descriptorSetLayoutBinding(
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+			VK_SHADER_STAGE_FRAGMENT_BIT,
+			3)
 	};
 	VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
 	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &descriptorSetLayout));
@@ -564,7 +762,11 @@ void VulkanExample::setupDescriptors()
 		// Binding 0 : Vertex shader uniform buffer
 		vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffer.descriptor),
 		// Binding 1 : Fragment shader texture sampler
-		vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &texture.descriptor)
+		vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &texture.descriptor),
+		// Binding 2 : Fragment shader page table
+		vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &pageTableBuffer.descriptor),
+		// Binding 3 : Fragment shader page requests
+		vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 3, &streaming.feedbackBuffer.descriptor)
 	};
 	vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 }
@@ -634,6 +836,7 @@ void VulkanExample::prepare()
 	prepareUniformBuffers();
 	// Create a virtual texture with max. possible dimension (does not take up any VRAM yet)
 	prepareSparseTexture(4096, 4096, 1, VK_FORMAT_R8G8B8A8_UNORM);
+	prepareStreaming();
 	setupDescriptors();
 	preparePipelines();
 	buildCommandBuffers();
@@ -643,10 +846,15 @@ void VulkanExample::prepare()
 void VulkanExample::draw()
 {
 	VulkanExampleBase::prepareFrame();
+	// The command buffer for this image has finished execution, so its page requests can be processed before it's submitted again
+	if (streaming.enabled) {
+		updateResidency();
+	}
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
 	VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
 	VulkanExampleBase::submitFrame();
+	streaming.frameIndex++;
 }
 
 void VulkanExample::render()
@@ -843,20 +1051,281 @@ void VulkanExample::flushRandomPages()
 	}
 }
 
+// Deterministic content for a page, colored by mip level with a checker pattern and a dark page border to visualize streaming
+void VulkanExample::generatePageContent(const VirtualTexturePage& page, uint8_t* buffer)
+{
+	const std::array<glm::u8vec4, 8> mipColors = {
+		glm::u8vec4(230, 80, 80, 255), glm::u8vec4(80, 230, 80, 255), glm::u8vec4(80, 80, 230, 255), glm::u8vec4(230, 230, 80, 255),
+		glm::u8vec4(230, 80, 230, 255), glm::u8vec4(80, 230, 230, 255), glm::u8vec4(230, 150, 80, 255), glm::u8vec4(150, 80, 230, 255),
+	};
+	const glm::u8vec4 color = mipColors[page.mipLevel % mipColors.size()];
+	for (uint32_t y = 0; y < page.extent.height; y++) {
+		for (uint32_t x = 0; x < page.extent.width; x++) {
+			const uint32_t tx = page.offset.x + x;
+			const uint32_t ty = page.offset.y + y;
+			const bool border = (x < 2) || (y < 2) || (x >= page.extent.width - 2) || (y >= page.extent.height - 2);
+			const bool checker = ((tx / 16) + (ty / 16)) % 2 == 0;
+			const float shade = border ? 0.25f : (checker ? 1.0f : 0.75f);
+			buffer[0] = static_cast<uint8_t>(color.r * shade);
+			buffer[1] = static_cast<uint8_t>(color.g * shade);
+			buffer[2] = static_cast<uint8_t>(color.b * shade);
+			buffer[3] = 255;
+			buffer += 4;
+		}
+	}
+}
+
+void VulkanExample::prepareStreaming()
+{
+	const size_t pageCount = texture.pages.size();
+
+	// Page table for mapping texture coordinates to page indices in the fragment shader
+	pageTable.mipTailStart = texture.mipTailStart;
+	pageTable.pageCount = static_cast<uint32_t>(pageCount);
+	const VkExtent3D granularity = texture.sparseImageMemoryRequirements.formatProperties.imageGranularity;
+	for (uint32_t mipLevel = 0; mipLevel < std::min(texture.mipTailStart, 16u); mipLevel++) {
+		const VkExtent3D extent = { std::max(texture.width >> mipLevel, 1u), std::max(texture.height >> mipLevel, 1u), 1 };
+		const glm::uvec3 pageCounts = alignedDivision(extent, granularity);
+		auto firstPage = std::find_if(texture.pages.begin(), texture.pages.end(), [mipLevel](const VirtualTexturePage& page) { return (page.layer == 0) && (page.mipLevel == mipLevel); });
+		pageTable.mips[mipLevel] = glm::uvec4(static_cast<uint32_t>(std::distance(texture.pages.begin(), firstPage)), pageCounts.x, granularity.width, granularity.height);
+	}
+	VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &pageTableBuffer, sizeof(PageTable), &pageTable));
+
+	// Page request buffer, one aligned region for each command buffer
+	const VkDeviceSize alignment = vulkanDevice->properties.limits.minStorageBufferOffsetAlignment;
+	streaming.feedbackStride = vks::tools::alignedVkSize(std::max(pageCount, (size_t)1) * sizeof(uint32_t), alignment);
+	VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &streaming.feedbackBuffer, streaming.feedbackStride * drawCmdBuffers.size()));
+	VK_CHECK_RESULT(streaming.feedbackBuffer.map());
+	memset(streaming.feedbackBuffer.mapped, 0, streaming.feedbackStride * drawCmdBuffers.size());
+	streaming.feedbackBuffer.descriptor.range = streaming.feedbackStride;
+
+	// Staging buffer large enough for the max. number of page uploads per frame
+	VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &streaming.stagingBuffer, streaming.uploadLimit * granularity.width * granularity.height * 4));
+	VK_CHECK_RESULT(streaming.stagingBuffer.map());
+	VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(cmdPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+	VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &streaming.uploadCmdBuffer));
+
+	// Page content is streamed from a tiled file, which is baked on first run
+	const std::string tileFileName = "texturesparseresidency.tiles";
+	if (!streaming.tileFile.open(tileFileName, texture.width, texture.height, static_cast<uint32_t>(pageCount))) {
+		std::cout << "Baking page content to " << tileFileName << "\n";
+		TileFile::write(tileFileName, texture.width, texture.height, texture.pages, [this](const VirtualTexturePage& page, uint8_t* data) { generatePageContent(page, data); });
+		if (!streaming.tileFile.open(tileFileName, texture.width, texture.height, static_cast<uint32_t>(pageCount))) {
+			vks::tools::exitFatal("Could not open the tile file " + tileFileName, -1);
+		}
+	}
+
+	streaming.residency.init(pageCount);
+	streaming.residency.budgetPages = static_cast<uint32_t>((streaming.budgetMB * 1024ull * 1024ull) / texture.pages[0].size);
+	streaming.threadPool.setThreadCount(std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u));
+
+	// The mip tail is always resident and used as a fallback for pages that haven't been streamed in yet
+	fillMipTail();
+}
+
+// Queue an asynchronous load of a page's tile on one of the worker threads
+void VulkanExample::requestPage(uint32_t pageIndex)
+{
+	streaming.residency.pending[pageIndex] = true;
+	vks::Thread* thread = streaming.threadPool.threads[streaming.nextThread].get();
+	streaming.nextThread = (streaming.nextThread + 1) % static_cast<uint32_t>(streaming.threadPool.threads.size());
+	thread->addJob([this, pageIndex] {
+		Streaming::LoadedTile tile{ pageIndex };
+		streaming.tileFile.readTile(pageIndex, tile.data);
+		std::lock_guard<std::mutex> lock(streaming.loadedMutex);
+		streaming.loadedTiles.push_back(std::move(tile));
+	});
+}
+
+// Reads back the page requests written by the fragment shader the last time the current command buffer was executed
+void VulkanExample::processFeedback()
+{
+	const uint32_t* requests = reinterpret_cast<const uint32_t*>(static_cast<uint8_t*>(streaming.feedbackBuffer.mapped) + currentBuffer * streaming.feedbackStride);
+	std::vector<uint32_t> misses;
+	streaming.stats.requestedPages = 0;
+	for (uint32_t i = 0; i < static_cast<uint32_t>(texture.pages.size()); i++) {
+		if (requests[i] == 0) {
+			continue;
+		}
+		streaming.stats.requestedPages++;
+		streaming.residency.touch(i, streaming.frameIndex);
+		if (!streaming.residency.resident(i)) {
+			misses.push_back(i);
+		}
+	}
+	streaming.stats.misses = static_cast<uint32_t>(misses.size());
+
+	// Load coarse mip levels first, as they cover larger areas and replace the mip tail fallback quicker
+	std::stable_sort(misses.begin(), misses.end(), [this](uint32_t a, uint32_t b) { return texture.pages[a].mipLevel > texture.pages[b].mipLevel; });
+	const uint32_t maxPendingLoads = 4 * streaming.maxUploadsPerFrame;
+	for (uint32_t page : misses) {
+		if (streaming.stats.pendingLoads >= maxPendingLoads) {
+			break;
+		}
+		if (!streaming.residency.pending[page]) {
+			requestPage(page);
+			streaming.stats.pendingLoads++;
+		}
+	}
+}
+
+// Binds memory for loaded tiles (evicting least recently used pages if the budget is exhausted) and uploads their content
+// All binding changes of a frame are done with a single sparse bind and all uploads with a single submission
+void VulkanExample::updateResidency()
+{
+	processFeedback();
+
+	std::vector<Streaming::LoadedTile> tiles;
+	{
+		std::lock_guard<std::mutex> lock(streaming.loadedMutex);
+		const size_t count = std::min(streaming.loadedTiles.size(), static_cast<size_t>(streaming.maxUploadsPerFrame));
+		tiles.insert(tiles.end(), std::make_move_iterator(streaming.loadedTiles.begin()), std::make_move_iterator(streaming.loadedTiles.begin() + count));
+		streaming.loadedTiles.erase(streaming.loadedTiles.begin(), streaming.loadedTiles.begin() + count);
+	}
+
+	// Update bandwidth statistics once per second
+	streaming.stats.bandwidthTimer += frameTimer;
+	if (streaming.stats.bandwidthTimer > 1.0f) {
+		streaming.stats.uploadBandwidth = static_cast<float>(streaming.stats.uploadedBytes) / (1024.0f * 1024.0f) / streaming.stats.bandwidthTimer;
+		streaming.stats.uploadedBytes = 0;
+		streaming.stats.bandwidthTimer = 0.0f;
+	}
+
+	if (tiles.empty()) {
+		return;
+	}
+
+	std::vector<VkSparseImageMemoryBind> binds;
+	std::vector<VkBufferImageCopy> copyRegions;
+	VkDeviceSize stagingOffset = 0;
+	for (auto& tile : tiles) {
+		streaming.residency.pending[tile.page] = false;
+		streaming.stats.pendingLoads--;
+		// Make room within the memory budget
+		// The queue is idle at this point (see submitFrame), so memory of evicted pages can be reused within the same sparse bind
+		bool pageAvailable = true;
+		while (streaming.residency.residentCount() >= streaming.residency.budgetPages) {
+			const uint32_t victim = streaming.residency.evictionCandidate(streaming.frameIndex);
+			if (victim == UINT32_MAX) {
+				pageAvailable = false;
+				break;
+			}
+			VirtualTexturePage& victimPage = texture.pages[victim];
+			VkSparseImageMemoryBind unbind = victimPage.imageMemoryBind;
+			unbind.memory = VK_NULL_HANDLE;
+			binds.push_back(unbind);
+			texture.freeMemory.push_back(victimPage.imageMemoryBind.memory);
+			victimPage.imageMemoryBind.memory = VK_NULL_HANDLE;
+			streaming.residency.evict(victim);
+			streaming.stats.totalEvictions++;
+		}
+		// All resident pages are visible in this frame, the tile will be requested again later on
+		if (!pageAvailable) {
+			continue;
+		}
+		VirtualTexturePage& page = texture.pages[tile.page];
+		page.assign(texture.acquireMemory(page.size));
+		binds.push_back(page.imageMemoryBind);
+		streaming.residency.makeResident(tile.page, streaming.frameIndex);
+
+		memcpy(static_cast<uint8_t*>(streaming.stagingBuffer.mapped) + stagingOffset, tile.data.data(), tile.data.size());
+		VkBufferImageCopy region{};
+		region.bufferOffset = stagingOffset;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.layerCount = 1;
+		region.imageSubresource.mipLevel = page.mipLevel;
+		region.imageSubresource.baseArrayLayer = page.layer;
+		region.imageOffset = page.offset;
+		region.imageExtent = page.extent;
+		copyRegions.push_back(region);
+		stagingOffset += tile.data.size();
+		streaming.stats.uploadedBytes += tile.data.size();
+		streaming.stats.totalUploads++;
+	}
+
+	if (binds.empty()) {
+		return;
+	}
+
+	// Batched sparse binding, signals a semaphore the page uploads wait on
+	texture.updateSparseBindInfo(binds);
+	texture.bindSparseInfo.signalSemaphoreCount = 1;
+	texture.bindSparseInfo.pSignalSemaphores = &bindSparseSemaphore;
+	VK_CHECK_RESULT(vkQueueBindSparse(queue, 1, &texture.bindSparseInfo, VK_NULL_HANDLE));
+
+	// Batched upload of all newly bound pages
+	VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+	VK_CHECK_RESULT(vkBeginCommandBuffer(streaming.uploadCmdBuffer, &cmdBufInfo));
+	if (!copyRegions.empty()) {
+		vks::tools::setImageLayout(streaming.uploadCmdBuffer, texture.image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, texture.subRange, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+		vkCmdCopyBufferToImage(streaming.uploadCmdBuffer, streaming.stagingBuffer.buffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+		vks::tools::setImageLayout(streaming.uploadCmdBuffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, texture.subRange, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+	}
+	VK_CHECK_RESULT(vkEndCommandBuffer(streaming.uploadCmdBuffer));
+	const VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	VkSubmitInfo uploadSubmitInfo = vks::initializers::submitInfo();
+	uploadSubmitInfo.waitSemaphoreCount = 1;
+	uploadSubmitInfo.pWaitSemaphores = &bindSparseSemaphore;
+	uploadSubmitInfo.pWaitDstStageMask = &waitStageMask;
+	uploadSubmitInfo.commandBufferCount = 1;
+	uploadSubmitInfo.pCommandBuffers = &streaming.uploadCmdBuffer;
+	VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &uploadSubmitInfo, VK_NULL_HANDLE));
+}
+
+// Unbinds all pages and discards pending loads, used when switching between streaming and manual page management
+void VulkanExample::resetResidency()
+{
+	vkDeviceWaitIdle(device);
+	streaming.threadPool.wait();
+	streaming.loadedTiles.clear();
+	streaming.stats.pendingLoads = 0;
+
+	std::vector<VkSparseImageMemoryBind> unbinds;
+	for (auto& page : texture.pages) {
+		if (page.resident()) {
+			VkSparseImageMemoryBind unbind = page.imageMemoryBind;
+			unbind.memory = VK_NULL_HANDLE;
+			unbinds.push_back(unbind);
+			texture.freeMemory.push_back(page.imageMemoryBind.memory);
+			page.imageMemoryBind.memory = VK_NULL_HANDLE;
+		}
+	}
+	if (!unbinds.empty()) {
+		texture.updateSparseBindInfo(unbinds);
+		VkFenceCreateInfo fenceInfo = vks::initializers::fenceCreateInfo(VK_FLAGS_NONE);
+		VkFence fence;
+		VK_CHECK_RESULT(vkCreateFence(device, &fenceInfo, nullptr, &fence));
+		vkQueueBindSparse(queue, 1, &texture.bindSparseInfo, fence);
+		vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+		vkDestroyFence(device, fence, nullptr);
+	}
+	streaming.residency.reset();
+}
+
 void VulkanExample::OnUpdateUIOverlay(vks::UIOverlay* overlay)
 {
 	if (overlay->header("Settings")) {
 		if (overlay->sliderFloat("LOD bias", &uniformData.lodBias, -(float)texture.mipLevels, (float)texture.mipLevels)) {
 			updateUniformBuffers();
 		}
-		if (overlay->button("Fill random pages")) {
-			fillRandomPages();
+		if (overlay->checkBox("Feedback streaming", &streaming.enabled)) {
+			resetResidency();
 		}
-		if (overlay->button("Flush random pages")) {
-			flushRandomPages();
-		}
-		if (overlay->button("Fill mip tail")) {
-			fillMipTail();
+		if (streaming.enabled) {
+			if (overlay->sliderInt("Budget (MB)", &streaming.budgetMB, 4, 256)) {
+				streaming.residency.budgetPages = static_cast<uint32_t>((streaming.budgetMB * 1024ull * 1024ull) / texture.pages[0].size);
+			}
+			overlay->sliderInt("Uploads/frame", &streaming.maxUploadsPerFrame, 1, streaming.uploadLimit);
+		} else {
+			if (overlay->button("Fill random pages")) {
+				fillRandomPages();
+			}
+			if (overlay->button("Flush random pages")) {
+				flushRandomPages();
+			}
+			if (overlay->button("Fill mip tail")) {
+				fillMipTail();
+			}
 		}
 	}
 	if (overlay->header("Statistics")) {
@@ -864,6 +1333,14 @@ void VulkanExample::OnUpdateUIOverlay(vks::UIOverlay* overlay)
 		std::for_each(texture.pages.begin(), texture.pages.end(), [&respages](VirtualTexturePage page) { respages += (page.resident()) ? 1 : 0; });
 		overlay->text("Resident pages: %d of %d", respages, static_cast<uint32_t>(texture.pages.size()));
 		overlay->text("Mip tail starts at: %d", texture.mipTailStart);
+		if (streaming.enabled) {
+			overlay->text("Requested pages: %d", streaming.stats.requestedPages);
+			overlay->text("Misses: %d", streaming.stats.misses);
+			overlay->text("Pending loads: %d", streaming.stats.pendingLoads);
+			overlay->text("Uploads: %llu", streaming.stats.totalUploads);
+			overlay->text("Evictions: %llu", streaming.stats.totalEvictions);
+			overlay->text("Upload bandwidth: %.2f MB/s", streaming.stats.uploadBandwidth);
+		}
 	}
 
 }
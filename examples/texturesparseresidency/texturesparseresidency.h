@@ -12,6 +12,9 @@
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "threadpool.hpp"
+#include <list>
+#include <mutex>
 
 // Virtual texture page as a part of the partially resident texture
 // Contains memory bindings, offsets and status information
@@ -29,6 +32,7 @@ struct VirtualTexturePage
 	VirtualTexturePage();
 	bool resident();
 	bool allocate(VkDevice device, uint32_t memoryTypeIndex);
+	void assign(VkDeviceMemory memory);
 	bool release(VkDevice device);
 };
 
@@ -55,12 +59,65 @@ struct VirtualTexture
 		bool alingedMipSize;
 	} mipTailInfo;
 
+	std::vector<VkDeviceMemory> freeMemory;								// Page sized allocations of evicted pages that can be reused without a new allocation
+
 	VirtualTexturePage *addPage(VkOffset3D offset, VkExtent3D extent, const VkDeviceSize size, const uint32_t mipLevel, uint32_t layer);
 	void updateSparseBindInfo(std::vector<VirtualTexturePage> &bindingChangedPages, bool del = false);
+	void updateSparseBindInfo(const std::vector<VkSparseImageMemoryBind> &binds);
+	VkDeviceMemory acquireMemory(VkDeviceSize size);
 	// @todo: replace with dtor?
 	void destroy();
 };
 
+// Simple tiled on-disk format storing the content of each virtual page (outside of the mip tail) as a separate tile
+// Layout: header, one 64-bit file offset per page, tightly packed tile data
+class TileFile
+{
+private:
+	std::mutex fileMutex;
+	std::ifstream file;
+	std::vector<uint64_t> offsets;
+public:
+	struct Header {
+		char magic[4] = { 'V', 'T', 'I', 'L' };
+		uint32_t version = 1;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t pageCount = 0;
+		uint32_t bytesPerTexel = 4;
+	} header;
+
+	bool open(const std::string& filename, uint32_t width, uint32_t height, uint32_t pageCount);
+	void close();
+	// Thread safe, called from the streaming worker threads
+	void readTile(uint32_t index, std::vector<uint8_t>& data);
+	// Bakes the content of all pages into a new tile file
+	static void write(const std::string& filename, uint32_t width, uint32_t height, const std::vector<VirtualTexturePage>& pages, std::function<void(const VirtualTexturePage&, uint8_t*)> generator);
+};
+
+// Decides which pages of the virtual texture are resident, based on the pages requested by the fragment shader
+// Least recently used pages are evicted once the memory budget is exhausted
+class ResidencyManager
+{
+private:
+	std::list<uint32_t> lruList;										// Resident pages, most recently used first
+	std::vector<std::list<uint32_t>::iterator> lruPositions;
+	std::vector<uint32_t> lastRequestedFrame;
+public:
+	uint32_t budgetPages{ 0 };
+	std::vector<bool> pending;											// Pages currently being loaded by a worker thread
+
+	void init(size_t pageCount);
+	void reset();
+	bool resident(uint32_t page) const;
+	void touch(uint32_t page, uint32_t frame);
+	void makeResident(uint32_t page, uint32_t frame);
+	// Returns the least recently used page that was not requested in the current frame (or UINT32_MAX)
+	uint32_t evictionCandidate(uint32_t frame) const;
+	void evict(uint32_t page);
+	size_t residentCount() const { return lruList.size(); }
+};
+
 class VulkanExample : public VulkanExampleBase
 {
 public:
@@ -95,6 +152,51 @@ public:
 	//todo: comment
 	VkSemaphore bindSparseSemaphore{ VK_NULL_HANDLE };
 
+	// Per-mip page layout used by the fragment shader to map texture coordinates to page indices
+	struct PageTable {
+		// x = index of the first page, y = pages in x direction, z = page width, w = page height
+		glm::uvec4 mips[16];
+		uint32_t mipTailStart;
+		uint32_t pageCount;
+	} pageTable{};
+	vks::Buffer pageTableBuffer;
+
+	// Feedback driven streaming of virtual texture pages
+	struct Streaming {
+		bool enabled = true;
+		// Page request buffer with one region per command buffer, a region is read back by the cpu once its command buffer is reused
+		vks::Buffer feedbackBuffer;
+		VkDeviceSize feedbackStride = 0;
+		// Persistently mapped staging buffer and command buffer for batched page uploads
+		vks::Buffer stagingBuffer;
+		VkCommandBuffer uploadCmdBuffer{ VK_NULL_HANDLE };
+		TileFile tileFile;
+		ResidencyManager residency;
+		vks::ThreadPool threadPool;
+		uint32_t nextThread = 0;
+		// Tiles loaded by the worker threads, waiting to be bound and uploaded
+		struct LoadedTile {
+			uint32_t page;
+			std::vector<uint8_t> data;
+		};
+		std::mutex loadedMutex;
+		std::vector<LoadedTile> loadedTiles;
+		int32_t budgetMB = 64;
+		int32_t maxUploadsPerFrame = 32;
+		static const int32_t uploadLimit = 128;
+		uint32_t frameIndex = 0;
+		struct Stats {
+			uint32_t requestedPages = 0;
+			uint32_t misses = 0;
+			uint32_t pendingLoads = 0;
+			uint64_t totalUploads = 0;
+			uint64_t totalEvictions = 0;
+			uint64_t uploadedBytes = 0;
+			float uploadBandwidth = 0.0f;
+			float bandwidthTimer = 0.0f;
+		} stats;
+	} streaming;
+
 	VulkanExample();
 	~VulkanExample();
 	virtual void getEnabledFeatures();
@@ -116,5 +218,11 @@ public:
 	void fillRandomPages();
 	void fillMipTail();
 	void flushRandomPages();
+	void generatePageContent(const VirtualTexturePage& page, uint8_t* buffer);
+	void prepareStreaming();
+	void processFeedback();
+	void requestPage(uint32_t pageIndex);
+	void updateResidency();
+	void resetResidency();
 	virtual void OnUpdateUIOverlay(vks::UIOverlay* overlay);
 };
@@ -0,0 +1,42 @@
+/* Copyright (c) 2023, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// G-buffer layouts shared by the deferred shading examples, matches vks::GBufferLayout
+
+#define GBUFFER_LAYOUT_REFERENCE 0
+#define GBUFFER_LAYOUT_COMPACT 1
+
+// Reference: position (rgba16f), normal (rgba16f), albedo and specular (rgba8)
+// Compact: octahedral normal (rg16 snorm), albedo and specular (rgba8), position is reconstructed from depth
+layout (constant_id = 1) const int GBUFFER_LAYOUT = GBUFFER_LAYOUT_REFERENCE;
+
+vec2 signNotZero(vec2 v)
+{
+	return vec2((v.x >= 0.0) ? 1.0 : -1.0, (v.y >= 0.0) ? 1.0 : -1.0);
+}
+
+// Project the normal onto an octahedron and unfold the lower half, this keeps the error uniform over the sphere
+vec2 encodeNormal(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	return (n.z >= 0.0) ? n.xy : (1.0 - abs(n.yx)) * signNotZero(n.xy);
+}
+
+vec3 decodeNormal(vec2 e)
+{
+	vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0) {
+		n.xy = (1.0 - abs(n.yx)) * signNotZero(n.xy);
+	}
+	return normalize(n);
+}
+
+// The depth buffer stores the normalized device z coordinate (default depth range), so this is exact for both clip space conventions
+vec3 reconstructPosition(vec2 uv, float depth, mat4 inverseViewProjection)
+{
+	vec4 position = inverseViewProjection * vec4(uv * 2.0 - 1.0, depth, 1.0);
+	return position.xyz / position.w;
+}
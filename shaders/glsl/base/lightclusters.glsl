@@ -0,0 +1,73 @@
+/* Copyright (c) 2023, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Clustered lights, matches vks::LightClusters
+// LIGHT_CLUSTERS_BINDING has to be defined to the first of the four consecutive bindings used for the light data:
+// +0 : Lights
+// +1 : Offset and light count of every cluster
+// +2 : Light indices of all clusters
+// +3 : Cluster grid parameters
+
+#ifndef LIGHT_CLUSTERS_BINDING
+#error "LIGHT_CLUSTERS_BINDING needs to be defined before including lightclusters.glsl"
+#endif
+
+// Only the culling shader writes the cluster data
+#ifdef LIGHT_CLUSTERS_WRITE
+#define LIGHT_CLUSTERS_ACCESS
+#else
+#define LIGHT_CLUSTERS_ACCESS readonly
+#endif
+
+struct Light {
+	vec3 position;
+	float range;
+	vec3 color;
+	float intensity;
+};
+
+layout (std430, binding = LIGHT_CLUSTERS_BINDING) readonly buffer Lights
+{
+	Light lights[];
+};
+
+layout (std430, binding = LIGHT_CLUSTERS_BINDING + 1) LIGHT_CLUSTERS_ACCESS buffer Clusters
+{
+	// Offset into the light index list and light count
+	uvec2 clusters[];
+};
+
+layout (std430, binding = LIGHT_CLUSTERS_BINDING + 2) LIGHT_CLUSTERS_ACCESS buffer LightIndices
+{
+	uint lightIndices[];
+};
+
+layout (binding = LIGHT_CLUSTERS_BINDING + 3) uniform LightClusterUBO
+{
+	mat4 view;
+	mat4 inverseProjection;
+	// Grid size in xyz, light count in w
+	uvec4 gridSize;
+	// Near plane, far plane, scale and bias of the logarithmic depth slicing
+	vec4 depthSlicing;
+	uint maxLightsPerCluster;
+} lightClusters;
+
+// Cluster of a fragment, uv is the normalized screen position (e.g. gl_FragCoord.xy / screen size)
+uint getClusterIndex(vec2 uv, vec3 worldPos)
+{
+	float viewDepth = -(lightClusters.view * vec4(worldPos, 1.0)).z;
+	uint slice = uint(clamp(log(max(viewDepth, lightClusters.depthSlicing.x)) * lightClusters.depthSlicing.z - lightClusters.depthSlicing.w, 0.0, float(lightClusters.gridSize.z - 1u)));
+	uvec2 tile = min(uvec2(uv * vec2(lightClusters.gridSize.xy)), lightClusters.gridSize.xy - 1u);
+	return (slice * lightClusters.gridSize.y + tile.y) * lightClusters.gridSize.x + tile.x;
+}
+
+// Inverse square falloff that is smoothly windowed to reach zero at the light's range
+float getLightAttenuation(Light light, float dist)
+{
+	float window = clamp(1.0 - pow(dist / light.range, 4.0), 0.0, 1.0);
+	return light.intensity / (dist * dist + 1.0) * window * window;
+}
@@ -0,0 +1,20 @@
+#version 450
+
+// Adds the first level of the bloom mip chain built by the compute bloom (vks::Bloom)
+
+layout (binding = 1) uniform sampler2D samplerBloom;
+
+layout (binding = 0) uniform UBO 
+{
+	float blurScale;
+	float blurStrength;
+} ubo;
+
+layout (location = 0) in vec2 inUV;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main() 
+{
+	outFragColor = vec4(texture(samplerBloom, inUV).rgb * ubo.blurStrength, 1.0);
+}
@@ -1,5 +1,14 @@
 #version 450
 
+#extension GL_GOOGLE_include_directive : require
+
+#include "../base/gbuffer.glsl"
+
+// Lights and their clusters are at bindings 5 to 8
+#define LIGHT_CLUSTERS_BINDING 5
+#include "../base/lightclusters.glsl"
+
+// Depth instead of positions for the compact layout
 layout (binding = 1) uniform sampler2D samplerposition;
 layout (binding = 2) uniform sampler2D samplerNormal;
 layout (binding = 3) uniform sampler2D samplerAlbedo;
@@ -8,25 +17,29 @@ layout (location = 0) in vec2 inUV;
 
 layout (location = 0) out vec4 outFragcolor;
 
-struct Light {
-	vec4 position;
-	vec3 color;
-	float radius;
-};
-
 layout (binding = 4) uniform UBO 
 {
-	Light lights[6];
 	vec4 viewPos;
+	mat4 inverseViewProjection;
 	int displayDebugTarget;
 } ubo;
 
 void main() 
 {
 	// Get G-Buffer values
-	vec3 fragPos = texture(samplerposition, inUV).rgb;
-	vec3 normal = texture(samplerNormal, inUV).rgb;
+	vec3 fragPos;
+	vec3 normal;
+	if (GBUFFER_LAYOUT == GBUFFER_LAYOUT_COMPACT) {
+		fragPos = reconstructPosition(inUV, texture(samplerposition, inUV).r, ubo.inverseViewProjection);
+		normal = decodeNormal(texture(samplerNormal, inUV).rg);
+	} else {
+		fragPos = texture(samplerposition, inUV).rgb;
+		normal = texture(samplerNormal, inUV).rgb;
+	}
 	vec4 albedo = texture(samplerAlbedo, inUV);
+
+	// Only the lights binned into the fragment's cluster are evaluated
+	uvec2 cluster = clusters[getClusterIndex(inUV, fragPos)];
 	
 	// Debug display
 	if (ubo.displayDebugTarget > 0) {
@@ -43,6 +56,12 @@ void main()
 			case 4: 
 				outFragcolor.rgb = albedo.aaa;
 				break;
+			case 5: {
+				// Number of lights per cluster, from blue (none) over green to red (16 or more)
+				float heat = clamp(float(cluster.y) / 16.0, 0.0, 1.0);
+				outFragcolor.rgb = (heat < 0.5) ? mix(vec3(0.0, 0.0, 1.0), vec3(0.0, 1.0, 0.0), heat * 2.0) : mix(vec3(0.0, 1.0, 0.0), vec3(1.0, 0.0, 0.0), heat * 2.0 - 1.0);
+				break;
+			}
 		}		
 		outFragcolor.a = 1.0;
 		return;
@@ -50,44 +69,41 @@ void main()
 
 	// Render-target composition
 
-	#define lightCount 6
 	#define ambient 0.0
 	
 	// Ambient part
 	vec3 fragcolor  = albedo.rgb * ambient;
+
+	// Viewer to fragment
+	vec3 V = normalize(ubo.viewPos.xyz - fragPos);
+	vec3 N = normalize(normal);
 	
-	for(int i = 0; i < lightCount; ++i)
+	for(uint i = 0; i < cluster.y; ++i)
 	{
+		Light light = lights[lightIndices[cluster.x + i]];
+
 		// Vector to light
-		vec3 L = ubo.lights[i].position.xyz - fragPos;
+		vec3 L = light.position - fragPos;
 		// Distance from light to fragment position
 		float dist = length(L);
 
-		// Viewer to fragment
-		vec3 V = ubo.viewPos.xyz - fragPos;
-		V = normalize(V);
-		
-		//if(dist < ubo.lights[i].radius)
-		{
-			// Light to fragment
-			L = normalize(L);
-
-			// Attenuation
-			float atten = ubo.lights[i].radius / (pow(dist, 2.0) + 1.0);
-
-			// Diffuse part
-			vec3 N = normalize(normal);
-			float NdotL = max(0.0, dot(N, L));
-			vec3 diff = ubo.lights[i].color * albedo.rgb * NdotL * atten;
-
-			// Specular part
-			// Specular map values are stored in alpha of albedo mrt
-			vec3 R = reflect(-L, N);
-			float NdotR = max(0.0, dot(R, V));
-			vec3 spec = ubo.lights[i].color * albedo.a * pow(NdotR, 16.0) * atten;
-
-			fragcolor += diff + spec;	
-		}	
+		// Light to fragment
+		L = normalize(L);
+
+		// Attenuation
+		float atten = getLightAttenuation(light, dist);
+
+		// Diffuse part
+		float NdotL = max(0.0, dot(N, L));
+		vec3 diff = light.color * albedo.rgb * NdotL * atten;
+
+		// Specular part
+		// Specular map values are stored in alpha of albedo mrt
+		vec3 R = reflect(-L, N);
+		float NdotR = max(0.0, dot(R, V));
+		vec3 spec = light.color * albedo.a * pow(NdotR, 16.0) * atten;
+
+		fragcolor += diff + spec;	
 	}    	
    
   outFragcolor = vec4(fragcolor, 1.0);	
@@ -1,5 +1,9 @@
 #version 450
 
+#extension GL_GOOGLE_include_directive : require
+
+#include "../base/gbuffer.glsl"
+
 layout (binding = 1) uniform sampler2D samplerColor;
 layout (binding = 2) uniform sampler2D samplerNormalMap;
 
@@ -9,21 +13,28 @@ layout (location = 2) in vec3 inColor;
 layout (location = 3) in vec3 inWorldPos;
 layout (location = 4) in vec3 inTangent;
 
-layout (location = 0) out vec4 outPosition;
-layout (location = 1) out vec4 outNormal;
-layout (location = 2) out vec4 outAlbedo;
+// The compact layout has no position target, so its targets move up by one and the last output isn't bound to an attachment
+layout (location = 0) out vec4 outTarget0;
+layout (location = 1) out vec4 outTarget1;
+layout (location = 2) out vec4 outTarget2;
 
 void main() 
 {
-	outPosition = vec4(inWorldPos, 1.0);
-
 	// Calculate normal in tangent space
 	vec3 N = normalize(inNormal);
 	vec3 T = normalize(inTangent);
 	vec3 B = cross(N, T);
 	mat3 TBN = mat3(T, B, N);
 	vec3 tnorm = TBN * normalize(texture(samplerNormalMap, inUV).xyz * 2.0 - vec3(1.0));
-	outNormal = vec4(tnorm, 1.0);
 
-	outAlbedo = texture(samplerColor, inUV);
-}
\ No newline at end of file
+	vec4 albedo = texture(samplerColor, inUV);
+
+	if (GBUFFER_LAYOUT == GBUFFER_LAYOUT_COMPACT) {
+		outTarget0 = vec4(encodeNormal(normalize(tnorm)), 0.0, 0.0);
+		outTarget1 = albedo;
+	} else {
+		outTarget0 = vec4(inWorldPos, 1.0);
+		outTarget1 = vec4(tnorm, 1.0);
+		outTarget2 = albedo;
+	}
+}
@@ -1,5 +1,10 @@
 #version 450
 
+#extension GL_GOOGLE_include_directive : require
+
+#include "../base/gbuffer.glsl"
+
+// Depth instead of positions for the compact layout
 layout (binding = 1) uniform sampler2DMS samplerPosition;
 layout (binding = 2) uniform sampler2DMS samplerNormal;
 layout (binding = 3) uniform sampler2DMS samplerAlbedo;
@@ -18,6 +23,7 @@ layout (binding = 4) uniform UBO
 {
 	Light lights[6];
 	vec4 viewPos;
+	mat4 inverseViewProjection;
 	int debugDisplayTarget;
 } ubo;
 
@@ -38,6 +44,24 @@ vec4 resolve(sampler2DMS tex, ivec2 uv)
 	return result / float(NUM_SAMPLES);
 }
 
+vec3 fetchPosition(ivec2 coord, int sampleIndex)
+{
+	if (GBUFFER_LAYOUT == GBUFFER_LAYOUT_COMPACT) {
+		// All samples are reconstructed at the pixel center, the error is within the pixel's footprint
+		vec2 uv = (vec2(coord) + 0.5) / vec2(textureSize(samplerPosition));
+		return reconstructPosition(uv, texelFetch(samplerPosition, coord, sampleIndex).r, ubo.inverseViewProjection);
+	}
+	return texelFetch(samplerPosition, coord, sampleIndex).rgb;
+}
+
+vec3 fetchNormal(ivec2 coord, int sampleIndex)
+{
+	if (GBUFFER_LAYOUT == GBUFFER_LAYOUT_COMPACT) {
+		return decodeNormal(texelFetch(samplerNormal, coord, sampleIndex).rg);
+	}
+	return texelFetch(samplerNormal, coord, sampleIndex).rgb;
+}
+
 vec3 calculateLighting(vec3 pos, vec3 normal, vec4 albedo)
 {
 	vec3 result = vec3(0.0);
@@ -83,10 +107,10 @@ void main()
 	if (ubo.debugDisplayTarget > 0) {
 		switch (ubo.debugDisplayTarget) {
 			case 1: 
-				outFragcolor.rgb = texelFetch(samplerPosition, UV, 0).rgb;
+				outFragcolor.rgb = fetchPosition(UV, 0);
 				break;
 			case 2: 
-				outFragcolor.rgb = texelFetch(samplerNormal, UV, 0).rgb;
+				outFragcolor.rgb = fetchNormal(UV, 0);
 				break;
 			case 3: 
 				outFragcolor.rgb = texelFetch(samplerAlbedo, UV, 0).rgb;
@@ -108,8 +132,8 @@ void main()
 	// Calualte lighting for every MSAA sample
 	for (int i = 0; i < NUM_SAMPLES; i++)
 	{ 
-		vec3 pos = texelFetch(samplerPosition, UV, i).rgb;
-		vec3 normal = texelFetch(samplerNormal, UV, i).rgb;
+		vec3 pos = fetchPosition(UV, i);
+		vec3 normal = fetchNormal(UV, i);
 		vec4 albedo = texelFetch(samplerAlbedo, UV, i);
 		fragColor += calculateLighting(pos, normal, albedo);
 	}
@@ -1,5 +1,10 @@
 #version 450
 
+#extension GL_GOOGLE_include_directive : require
+
+#include "../base/gbuffer.glsl"
+
+// Depth instead of positions for the compact layout
 layout (binding = 1) uniform sampler2D samplerposition;
 layout (binding = 2) uniform sampler2D samplerNormal;
 layout (binding = 3) uniform sampler2D samplerAlbedo;
@@ -26,6 +31,7 @@ layout (binding = 4) uniform UBO
 {
 	vec4 viewPos;
 	Light lights[LIGHT_COUNT];
+	mat4 inverseViewProjection;
 	int useShadows;
 	int debugDisplayTarget;
 } ubo;
@@ -90,8 +96,15 @@ vec3 shadow(vec3 fragcolor, vec3 fragpos) {
 void main() 
 {
 	// Get G-Buffer values
-	vec3 fragPos = texture(samplerposition, inUV).rgb;
-	vec3 normal = texture(samplerNormal, inUV).rgb;
+	vec3 fragPos;
+	vec3 normal;
+	if (GBUFFER_LAYOUT == GBUFFER_LAYOUT_COMPACT) {
+		fragPos = reconstructPosition(inUV, texture(samplerposition, inUV).r, ubo.inverseViewProjection);
+		normal = decodeNormal(texture(samplerNormal, inUV).rg);
+	} else {
+		fragPos = texture(samplerposition, inUV).rgb;
+		normal = texture(samplerNormal, inUV).rgb;
+	}
 	vec4 albedo = texture(samplerAlbedo, inUV);
 
 	// Debug display
@@ -3,10 +3,11 @@
 layout (binding = 1) uniform sampler2D samplerColor;
 
 layout (location = 0) in vec2 inUV;
+layout (location = 1) in vec4 inColor;
 
 layout (location = 0) out vec4 outFragColor;
 
 void main() 
 {
-	outFragColor = vec4(texture(samplerColor, inUV).a);
+	outFragColor = vec4(texture(samplerColor, inUV).a) * inColor;
 }
\ No newline at end of file
@@ -1,7 +1,10 @@
 #version 450
 
-layout (location = 0) in vec3 inPos;
-layout (location = 1) in vec2 inUV;
+// One instance per glyph (vks::TextRenderer), expanded to a quad from the vertex index of a four vertex triangle strip
+layout (location = 0) in vec2 inPos;
+layout (location = 1) in vec2 inSize;
+layout (location = 2) in vec4 inUVRect;
+layout (location = 3) in vec4 inColor;
 
 layout (binding = 0) uniform UBO 
 {
@@ -9,10 +12,18 @@ layout (binding = 0) uniform UBO
 	mat4 model;
 } ubo;
 
+layout (push_constant) uniform PushConsts {
+	// Transforms from font pixels to world space
+	mat4 transform;
+} pushConsts;
+
 layout (location = 0) out vec2 outUV;
+layout (location = 1) out vec4 outColor;
 
 void main() 
 {
-	outUV = inUV;
-	gl_Position = ubo.projection * ubo.model * vec4(inPos.xyz, 1.0);
+	vec2 corner = vec2(gl_VertexIndex & 1, gl_VertexIndex >> 1);
+	outUV = mix(inUVRect.xy, inUVRect.zw, corner);
+	outColor = inColor;
+	gl_Position = ubo.projection * ubo.model * pushConsts.transform * vec4(inPos + inSize * corner, 0.0, 1.0);
 }
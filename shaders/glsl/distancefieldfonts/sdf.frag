@@ -12,6 +12,7 @@ layout (binding = 0) uniform UBO
 } ubo;
 
 layout (location = 0) in vec2 inUV;
+layout (location = 1) in vec4 inColor;
 
 layout (location = 0) out vec4 outFragColor;
 
@@ -29,6 +30,6 @@ void main()
         rgb += mix(vec3(alpha), ubo.outlineColor.rgb, alpha);
     }									 
 									 
-    outFragColor = vec4(rgb, alpha);	
+    outFragColor = vec4(rgb, alpha) * inColor;	
 	
 }
\ No newline at end of file
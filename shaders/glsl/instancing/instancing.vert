@@ -6,10 +6,11 @@ layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec2 inUV;
 layout (location = 3) in vec3 inColor;
 
-// Instanced attributes
-layout (location = 4) in vec3 instancePos;
-layout (location = 5) in vec3 instanceRot;
-layout (location = 6) in float instanceScale;
+// Instanced attributes, taken from the compacted list of visible instances written by cull.comp
+// Rows of the 3x4 model matrix, which includes the animated rotation and the scale of the instance
+layout (location = 4) in vec4 instanceRow0;
+layout (location = 5) in vec4 instanceRow1;
+layout (location = 6) in vec4 instanceRow2;
 layout (location = 7) in int instanceTexIndex;
 
 layout (binding = 0) uniform UBO 
@@ -32,49 +33,14 @@ void main()
 	outColor = inColor;
 	outUV = vec3(inUV, instanceTexIndex);
 
-	mat3 mx, my, mz;
-	
-	// rotate around x
-	float s = sin(instanceRot.x + ubo.locSpeed);
-	float c = cos(instanceRot.x + ubo.locSpeed);
+	mat4x3 model = transpose(mat3x4(instanceRow0, instanceRow1, instanceRow2));
+	vec4 pos = vec4(model * vec4(inPos.xyz, 1.0), 1.0);
 
-	mx[0] = vec3(c, s, 0.0);
-	mx[1] = vec3(-s, c, 0.0);
-	mx[2] = vec3(0.0, 0.0, 1.0);
-	
-	// rotate around y
-	s = sin(instanceRot.y + ubo.locSpeed);
-	c = cos(instanceRot.y + ubo.locSpeed);
+	gl_Position = ubo.projection * ubo.modelview * pos;
+	// The scale is uniform, so the rotation part of the model matrix can be used for the normal
+	outNormal = mat3(ubo.modelview) * mat3(model) * inNormal;
 
-	my[0] = vec3(c, 0.0, s);
-	my[1] = vec3(0.0, 1.0, 0.0);
-	my[2] = vec3(-s, 0.0, c);
-	
-	// rot around z
-	s = sin(instanceRot.z + ubo.locSpeed);
-	c = cos(instanceRot.z + ubo.locSpeed);	
-	
-	mz[0] = vec3(1.0, 0.0, 0.0);
-	mz[1] = vec3(0.0, c, s);
-	mz[2] = vec3(0.0, -s, c);
-	
-	mat3 rotMat = mz * my * mx;
-
-	mat4 gRotMat;
-	s = sin(instanceRot.y + ubo.globSpeed);
-	c = cos(instanceRot.y + ubo.globSpeed);
-	gRotMat[0] = vec4(c, 0.0, s, 0.0);
-	gRotMat[1] = vec4(0.0, 1.0, 0.0, 0.0);
-	gRotMat[2] = vec4(-s, 0.0, c, 0.0);
-	gRotMat[3] = vec4(0.0, 0.0, 0.0, 1.0);	
-	
-	vec4 locPos = vec4(inPos.xyz * rotMat, 1.0);
-	vec4 pos = vec4((locPos.xyz * instanceScale) + instancePos, 1.0);
-
-	gl_Position = ubo.projection * ubo.modelview * gRotMat * pos;
-	outNormal = mat3(ubo.modelview * gRotMat) * inverse(rotMat) * inNormal;
-
-	pos = ubo.modelview * vec4(inPos.xyz + instancePos, 1.0);
+	pos = ubo.modelview * pos;
 	vec3 lPos = mat3(ubo.modelview) * ubo.lightPos.xyz;
 	outLightVec = lPos - pos.xyz;
 	outViewVec = -pos.xyz;		
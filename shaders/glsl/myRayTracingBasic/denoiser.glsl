@@ -0,0 +1,19 @@
+/* Copyright (c) 2023, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Images shared by the ray tracing and denoising passes, matches MyTemporalDenoiser::Image
+#define IMAGE_NOISY 0
+#define IMAGE_GBUFFER0 1
+#define IMAGE_MOTION 3
+#define IMAGE_COUNT 10
+
+layout(binding = 0, set = DENOISER_SET, rgba16f) uniform image2D denoiserImages[IMAGE_COUNT];
+layout(binding = 1, set = DENOISER_SET, rgba8) uniform image2D albedoImage;
+
+float luminance(vec3 color)
+{
+	return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
@@ -17,20 +17,13 @@ struct Triangle {
 	vec2 uv;
 };
 
-// Todo change to specialization
-#ifdef USE_SKINNING
-#define NUM_VEC4_FROM_VERTEX_SIZE 6
-#else
-#define NUM_VEC4_FROM_VERTEX_SIZE 4
-#endif
-
-
 // This function will unpack our vertex buffer data into a single triangle and calculates uv coordinates
 Triangle unpackTriangle(uint index, int vertexSize) {
 	Triangle tri;
 	const uint triIndex = index * 3;
 
-	GeometryNode geometryNode = geometryNodes.nodes[gl_GeometryIndexEXT];
+	// Each BLAS instance stores the index of its first geometry node as its custom index
+	GeometryNode geometryNode = geometryNodes.nodes[gl_InstanceCustomIndexEXT + gl_GeometryIndexEXT];
 
 	Indices indices   = Indices(geometryNode.indexBufferDeviceAddress);
 	Vertices vertices = Vertices(geometryNode.vertexBufferDeviceAddress);
@@ -43,7 +36,7 @@ Triangle unpackTriangle(uint index, int vertexSize) {
 	// glm::vec2 uv;
 	// ...
 	for (uint i = 0; i < 3; i++) {
-		const uint offset = indices.i[triIndex + i] * NUM_VEC4_FROM_VERTEX_SIZE; // vertex stride
+		const uint offset = indices.i[triIndex + i] * geometryNode.vertexStride;
 		vec4 d0 = vertices.v[offset + 0]; // pos.xyz, n.x
 		vec4 d1 = vertices.v[offset + 1]; // n.yz, uv.xy
 		tri.vertices[i].pos = d0.xyz;
@@ -0,0 +1,17 @@
+/* Copyright (c) 2023, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Lighting is kept separate from the albedo, so the denoiser only has to filter the noisy lighting
+struct HitPayload
+{
+	vec3 albedo;
+	// Hit distance, 0 if the ray missed
+	float distance;
+	vec3 normal;
+	// Random number generator state, also used by the any hit shader for stochastic transparency
+	uint seed;
+	vec3 lighting;
+};
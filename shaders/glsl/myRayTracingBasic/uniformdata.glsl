@@ -0,0 +1,20 @@
+/* Copyright (c) 2023, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+layout(binding = 2, set = 0) uniform CameraProperties
+{
+	mat4 viewInverse;
+	mat4 projInverse;
+	mat4 viewProjPrevious;
+	vec4 cameraPositionPrevious;
+	// Direction towards the sun
+	vec4 lightDirection;
+	uint frame;
+	uint samplesPerPixel;
+	uint aoRays;
+	uint gbufferIndex;
+	float aoRadius;
+} cam;
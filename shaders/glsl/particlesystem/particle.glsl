@@ -0,0 +1,53 @@
+/* Copyright (c) 2023, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Particle data shared by the simulation and rendering shaders, matches the host side structs
+
+#define PARTICLE_TYPE_FLAME 0
+#define PARTICLE_TYPE_SMOKE 1
+
+struct Particle {
+	// xyz = position, w = size
+	vec4 position;
+	// xyz = velocity, w = rotation speed
+	vec4 velocity;
+	float color;
+	float alpha;
+	float rotation;
+	uint type;
+	uint alive;
+	uint pad0;
+	uint pad1;
+	uint pad2;
+};
+
+// View depth of an alive particle, sorted back to front for blending
+struct SortEntry {
+	float depth;
+	uint index;
+};
+
+// Counter based random numbers (PCG hash), every particle and frame gets its own independent sequence without any stored state
+uint pcgHash(uint value)
+{
+	uint state = value * 747796405u + 2891336453u;
+	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+uint rngState;
+
+void initRandom(uint index, uint frame)
+{
+	rngState = pcgHash(index ^ pcgHash(frame));
+}
+
+// Uniformly distributed in [0, range)
+float rnd(float range)
+{
+	rngState = pcgHash(rngState);
+	return float(rngState >> 8u) * (1.0 / 16777216.0) * range;
+}
@@ -1,11 +1,8 @@
 #version 450
 
-layout (location = 0) in vec4 inPos;
-layout (location = 1) in vec4 inColor;
-layout (location = 2) in float inAlpha;
-layout (location = 3) in float inSize;
-layout (location = 4) in float inRotation;
-layout (location = 5) in int inType;
+#extension GL_GOOGLE_include_directive : require
+
+#include "particle.glsl"
 
 layout (location = 0) out vec4 outColor;
 layout (location = 1) out float outAlpha;
@@ -20,20 +17,33 @@ layout (binding = 0) uniform UBO
 	float pointSize;
 } ubo;
 
+layout (std430, binding = 3) readonly buffer Particles
+{
+	Particle particles[];
+};
+
+// Alive particles sorted back to front
+layout (std430, binding = 4) readonly buffer SortList
+{
+	SortEntry sortList[];
+};
+
 void main () 
 {
-	outColor = inColor;
-	outAlpha = inAlpha;
-	outType = inType;
-	outRotation = inRotation;
+	Particle particle = particles[sortList[gl_VertexIndex].index];
+
+	outColor = vec4(vec3(particle.color), 1.0);
+	outAlpha = particle.alpha;
+	outType = int(particle.type);
+	outRotation = particle.rotation;
 	  
-	gl_Position = ubo.projection * ubo.modelview * vec4(inPos.xyz, 1.0);	
+	gl_Position = ubo.projection * ubo.modelview * vec4(particle.position.xyz, 1.0);	
 	
-	// Base size of the point sprites
-	float spriteSize = 8.0 * inSize;
+	// Base size of the point sprites, scaled down for higher particle counts
+	float spriteSize = ubo.pointSize * particle.position.w;
 
 	// Scale particle size depending on camera projection
-	vec4 eyePos = ubo.modelview * vec4(inPos.xyz, 1.0);
+	vec4 eyePos = ubo.modelview * vec4(particle.position.xyz, 1.0);
 	vec4 projectedCorner = ubo.projection * vec4(0.5 * spriteSize, 0.5 * spriteSize, eyePos.z, eyePos.w);
 	gl_PointSize = ubo.viewportDim.x * projectedCorner.x / projectedCorner.w;	
-}
\ No newline at end of file
+}
@@ -0,0 +1,82 @@
+/* Copyright (c) 2023, Sascha Willems
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ */
+
+// Resources of the particle compute passes
+
+#include "particle.glsl"
+
+#ifndef LOCAL_SIZE
+#define LOCAL_SIZE 256
+#endif
+layout (local_size_x = LOCAL_SIZE) in;
+
+layout (std430, binding = 0) buffer Particles
+{
+	Particle particles[];
+};
+
+// Indices of dead particles that can be emitted again
+layout (std430, binding = 1) buffer DeadList
+{
+	uint deadList[];
+};
+
+layout (std430, binding = 2) buffer SortList
+{
+	SortEntry sortList[];
+};
+
+layout (std430, binding = 3) buffer Counters
+{
+	uint deadCount;
+	uint emitCount;
+	// Number of alive particles written to the sort list
+	uint aliveCount;
+	uint pad;
+	// Indirect dispatch of the emission
+	uvec4 emitDispatch;
+	// Indirect draw of the sorted particles
+	uvec4 drawArgs;
+};
+
+layout (binding = 4) uniform UBO
+{
+	mat4 modelView;
+	// xyz = position, w = radius
+	vec4 emitter;
+	vec4 minVel;
+	vec4 maxVel;
+	float frameTimer;
+	uint frame;
+	uint particleCount;
+} ubo;
+
+layout (push_constant) uniform PushConsts
+{
+	uint mode;
+	uint n;
+	uint k;
+	uint j;
+} pushConsts;
+
+// Same behaviour as VulkanExample::initParticle
+void initParticle(inout Particle particle)
+{
+	const float PI = 3.14159265359;
+	particle.velocity = vec4(0.0, ubo.minVel.y + rnd(ubo.maxVel.y - ubo.minVel.y), 0.0, 0.0);
+	particle.alpha = rnd(0.75);
+	particle.position.w = 1.0 + rnd(0.5);
+	particle.color = 1.0;
+	particle.type = PARTICLE_TYPE_FLAME;
+	particle.rotation = rnd(2.0 * PI);
+	particle.velocity.w = rnd(2.0) - rnd(2.0);
+
+	// Get random sphere point
+	float theta = rnd(2.0 * PI);
+	float phi = rnd(PI) - PI / 2.0;
+	float r = rnd(ubo.emitter.w);
+	particle.position.xyz = ubo.emitter.xyz + vec3(r * cos(theta) * cos(phi), r * sin(phi), r * sin(theta) * cos(phi));
+}
@@ -9,6 +9,7 @@ layout (location = 1) in vec2 inUV;
 layout(push_constant) uniform PushConsts {
 	vec4 position;
 	uint cascadeIndex;
+	uint cascadeMask;
 } pushConsts;
 
 layout (set = 0, binding = 3) uniform UBO {
@@ -16,10 +17,13 @@ layout (set = 0, binding = 3) uniform UBO {
 } ubo;
 
 layout (location = 0) out vec2 outUV;
+layout (location = 1) out vec4 outPos;
 
 void main()
 {
 	outUV = inUV;
 	vec3 pos = inPos + pushConsts.position.xyz;
-	gl_Position =  ubo.cascadeViewProjMat[pushConsts.cascadeIndex] * vec4(pos, 1.0);
-}
\ No newline at end of file
+	// When rendering all cascades at once, the geometry shader replaces the position with the one for each cascade
+	outPos = vec4(pos, 1.0);
+	gl_Position =  ubo.cascadeViewProjMat[pushConsts.cascadeIndex] * outPos;
+}
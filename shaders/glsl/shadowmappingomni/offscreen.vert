@@ -7,15 +7,15 @@ layout (location = 1) out vec3 outLightPos;
 
 layout (binding = 0) uniform UBO 
 {
-	mat4 projection;
-	mat4 view; 
-	mat4 model;
+	mat4 faceViewProjections[6];
 	vec4 lightPos;
 } ubo;
 
 layout(push_constant) uniform PushConsts 
 {
-	mat4 view;
+	mat4 model;
+	uint face;
+	uint faceMask;
 } pushConsts;
  
 out gl_PerVertex 
@@ -25,8 +25,8 @@ out gl_PerVertex
  
 void main()
 {
-	gl_Position = ubo.projection * pushConsts.view * ubo.model * vec4(inPos, 1.0);
-
-	outPos = vec4(inPos, 1.0);	
+	// When rendering all faces at once, the geometry shader replaces the position with the one for each face
+	outPos = pushConsts.model * vec4(inPos, 1.0);
+	gl_Position = ubo.faceViewProjections[pushConsts.face] * outPos;
 	outLightPos = ubo.lightPos.xyz; 
-}
\ No newline at end of file
+}
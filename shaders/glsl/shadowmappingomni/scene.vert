@@ -12,6 +12,11 @@ layout (binding = 0) uniform UBO
 	vec4 lightPos;
 } ubo;
 
+layout(push_constant) uniform PushConsts 
+{
+	mat4 model;
+} pushConsts;
+
 layout (location = 0) out vec3 outNormal;
 layout (location = 1) out vec3 outColor;
 layout (location = 2) out vec3 outEyePos;
@@ -27,12 +32,14 @@ out gl_PerVertex
 void main() 
 {
 	outColor = inColor;
-	outNormal = inNormal;
-	
-	gl_Position = ubo.projection * ubo.view * ubo.model * vec4(inPos.xyz, 1.0);
-	outEyePos = vec3(ubo.model * vec4(inPos, 1.0f));
-	outLightVec = normalize(ubo.lightPos.xyz - inPos.xyz);	
-	outWorldPos = inPos;
+	outNormal = mat3(pushConsts.model) * inNormal;
+
+	// The push constant model matrix places the dynamic caster, it's the identity for the static scene
+	vec4 worldPos = pushConsts.model * vec4(inPos, 1.0);
+	gl_Position = ubo.projection * ubo.view * ubo.model * worldPos;
+	outEyePos = vec3(ubo.model * worldPos);
+	outLightVec = normalize(ubo.lightPos.xyz - worldPos.xyz);	
+	outWorldPos = worldPos.xyz;
 	
 	outLightPos = ubo.lightPos.xyz;
 }
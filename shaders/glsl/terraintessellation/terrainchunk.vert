@@ -0,0 +1,48 @@
+#version 450
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec3 inNormal;
+layout (location = 2) in vec4 inMorph;
+
+layout (set = 0, binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 modelview;
+	vec4 lightPos;
+	vec4 frustumPlanes[6];
+	float displacementFactor;
+	float tessellationFactor;
+	vec2 viewportDim;
+	float tessellatedEdgeSize;
+} ubo; 
+
+layout (push_constant) uniform PushConsts {
+	vec4 cameraPos;
+	float morphStart;
+	float morphEnd;
+} pushConsts;
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out float outHeight;
+layout (location = 2) out vec3 outViewVec;
+layout (location = 3) out vec3 outLightVec;
+layout (location = 4) out vec3 outEyePos;
+layout (location = 5) out vec3 outWorldPos;
+
+void main()
+{
+	// Morph height and normal towards the next coarser level based on the distance to the camera, so chunks match their coarser neighbours and parents
+	vec3 pos = vec3(inPos.x, -inPos.y * ubo.displacementFactor, inPos.z);
+	float morph = clamp((distance(pos, pushConsts.cameraPos.xyz) - pushConsts.morphStart) / (pushConsts.morphEnd - pushConsts.morphStart), 0.0, 1.0);
+	outHeight = mix(inPos.y, inMorph.w, morph);
+	outNormal = normalize(mix(inNormal, inMorph.xyz, morph));
+	pos.y = -outHeight * ubo.displacementFactor;
+
+	gl_Position = ubo.projection * ubo.modelview * vec4(pos, 1.0);
+
+	// Calculate vectors for lighting as done for the tessellated terrain
+	outViewVec = -pos;
+	outLightVec = normalize(ubo.lightPos.xyz + outViewVec);
+	outWorldPos = pos;
+	outEyePos = vec3(ubo.modelview * vec4(pos, 1.0));
+}
@@ -1,6 +1,7 @@
 #version 450 core
 
 layout (location = 0) in vec2 inUV;
+layout (location = 1) in vec4 inColor;
 
 layout (binding = 0) uniform sampler2D samplerFont;
 
@@ -9,5 +10,5 @@ layout (location = 0) out vec4 outFragColor;
 void main(void)
 {
 	float color = texture(samplerFont, inUV).r;
-	outFragColor = vec4(color);
+	outFragColor = vec4(color) * inColor;
 }
@@ -1,9 +1,18 @@
 #version 450 core
 
+// One instance per glyph (vks::TextRenderer), expanded to a quad from the vertex index of a four vertex triangle strip
 layout (location = 0) in vec2 inPos;
-layout (location = 1) in vec2 inUV;
+layout (location = 1) in vec2 inSize;
+layout (location = 2) in vec4 inUVRect;
+layout (location = 3) in vec4 inColor;
+
+layout (push_constant) uniform PushConsts {
+	// Transforms from framebuffer pixels to normalized device coordinates
+	mat4 transform;
+} pushConsts;
 
 layout (location = 0) out vec2 outUV;
+layout (location = 1) out vec4 outColor;
 
 out gl_PerVertex 
 {
@@ -12,6 +21,8 @@ out gl_PerVertex
 
 void main(void)
 {
-	gl_Position = vec4(inPos, 0.0, 1.0);
-	outUV = inUV;
+	vec2 corner = vec2(gl_VertexIndex & 1, gl_VertexIndex >> 1);
+	gl_Position = pushConsts.transform * vec4(inPos + inSize * corner, 0.0, 1.0);
+	outUV = mix(inUVRect.xy, inUVRect.zw, corner);
+	outColor = inColor;
 }
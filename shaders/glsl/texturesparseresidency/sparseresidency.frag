@@ -5,6 +5,20 @@
 
 layout (binding = 1) uniform sampler2D samplerColor;
 
+// x = index of the first page, y = pages in x direction, z = page width, w = page height
+layout (binding = 2) uniform PageTable
+{
+	uvec4 mips[16];
+	uint mipTailStart;
+	uint pageCount;
+} pageTable;
+
+// Pages requested by this frame, read back on the host to drive streaming
+layout (binding = 3) buffer Feedback
+{
+	uint requests[];
+} feedback;
+
 layout (location = 0) in vec2 inUV;
 layout (location = 1) in float inLodBias;
 
@@ -14,18 +28,30 @@ void main()
 {
 	vec4 color = vec4(0.0);
 
+	// Request the page covering the texel at the mip level the hardware would select
+	float lod = textureQueryLod(samplerColor, inUV).y + inLodBias;
+	uint mipLevel = uint(max(floor(lod + 0.5), 0.0));
+	if (mipLevel < pageTable.mipTailStart) {
+		uvec4 mip = pageTable.mips[mipLevel];
+		ivec2 mipSize = textureSize(samplerColor, int(mipLevel));
+		uvec2 texel = uvec2(clamp(fract(inUV) * vec2(mipSize), vec2(0.0), vec2(mipSize - 1)));
+		uvec2 page = texel / mip.zw;
+		uint pageIndex = mip.x + page.y * mip.y + page.x;
+		if (pageIndex < pageTable.pageCount) {
+			feedback.requests[pageIndex] = 1;
+		}
+	}
+
 	// Get residency code for current texel
 	int residencyCode = sparseTextureARB(samplerColor, inUV, color, inLodBias);
 
-	// Fetch sparse until we get a valid texel
-	/*
+	// Fall back to coarser mip levels until we get a valid texel (the mip tail is always resident)
 	float minLod = 1.0;
-	while (!sparseTexelsResidentARB(residencyCode)) 
+	while (!sparseTexelsResidentARB(residencyCode) && minLod <= float(pageTable.mipTailStart))
 	{
-		residencyCode = sparseTextureClampARB(samplerColor, inUV, minLod, color);
-		minLod += 1.0f;
+		residencyCode = sparseTextureClampARB(samplerColor, inUV, minLod, color, inLodBias);
+		minLod += 1.0;
 	}
-	*/
 
 	// Check if texel is resident
 	bool texelResident = sparseTexelsResidentARB(residencyCode);
@@ -36,4 +62,4 @@ void main()
 	}
 
 	outFragColor = color;
-}
\ No newline at end of file
+}
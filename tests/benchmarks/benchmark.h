@@ -0,0 +1,56 @@
+/*
+* Shared helpers for the benchmarks of the base classes
+*
+* Benchmarks run every measurement several times and report the median, the number of runs can be set with --runs
+*
+* Copyright (C) 2026 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace vks
+{
+	namespace benchmark
+	{
+		/** @brief Number of runs per measurement, from the --runs argument */
+		inline uint32_t runCount(int argc, char* argv[], uint32_t defaultRuns = 5)
+		{
+			for (int i = 1; i + 1 < argc; i++) {
+				if (strcmp(argv[i], "--runs") == 0) {
+					return std::max(atoi(argv[i + 1]), 1);
+				}
+			}
+			return defaultRuns;
+		}
+
+		/** @brief Median of a set of timings */
+		inline double median(std::vector<double> values)
+		{
+			std::sort(values.begin(), values.end());
+			const size_t middle = values.size() / 2;
+			return (values.size() % 2 == 1) ? values[middle] : (values[middle - 1] + values[middle]) * 0.5;
+		}
+
+		/** @brief Call func runs times and return the median duration in milliseconds */
+		template<typename Func>
+		double medianTime(uint32_t runs, Func&& func)
+		{
+			std::vector<double> times(runs);
+			for (uint32_t i = 0; i < runs; i++) {
+				const auto tStart = std::chrono::high_resolution_clock::now();
+				func();
+				times[i] = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+			}
+			return median(times);
+		}
+	}
+}
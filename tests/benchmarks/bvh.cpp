@@ -0,0 +1,101 @@
+/*
+* Build time benchmark for the compute shader ray tracing BVH (vks::BVH)
+*
+* Builds hierarchies for scattered triangles and for a tessellated surface of increasing size, with and without parallel subtree
+* builds, and reports the median binned SAH build and collapse times, the build throughput and the resulting tree
+*
+* Usage: benchmark_bvh [--runs n]
+*
+* Copyright (C) 2026 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+#include "VulkanBVH.h"
+
+struct Mesh {
+	std::string name;
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> indices;
+};
+
+// Small triangles with random orientations scattered in a cube, like foliage or debris
+static Mesh scatteredMesh(uint32_t triangleCount)
+{
+	std::mt19937 random(triangleCount);
+	std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+	Mesh mesh;
+	mesh.name = "scattered";
+	mesh.positions.reserve(size_t(triangleCount) * 3);
+	mesh.indices.reserve(size_t(triangleCount) * 3);
+	for (uint32_t i = 0; i < triangleCount; i++) {
+		const glm::vec3 center = glm::vec3(uniform(random), uniform(random), uniform(random)) * 100.0f;
+		for (uint32_t v = 0; v < 3; v++) {
+			mesh.positions.push_back(center + glm::vec3(uniform(random), uniform(random), uniform(random)));
+			mesh.indices.push_back(i * 3 + v);
+		}
+	}
+	return mesh;
+}
+
+// Indexed grid displaced by a few sine waves, like a terrain or a scanned surface, with triangles of similar size sharing vertices
+static Mesh surfaceMesh(uint32_t triangleCount)
+{
+	const uint32_t quads = static_cast<uint32_t>(std::sqrt(triangleCount / 2.0f));
+	Mesh mesh;
+	mesh.name = "surface";
+	mesh.positions.reserve(size_t(quads + 1) * (quads + 1));
+	mesh.indices.reserve(size_t(quads) * quads * 6);
+	for (uint32_t y = 0; y <= quads; y++) {
+		for (uint32_t x = 0; x <= quads; x++) {
+			const float u = static_cast<float>(x) / quads;
+			const float v = static_cast<float>(y) / quads;
+			const float height = std::sin(u * 17.0f) * std::cos(v * 11.0f) * 5.0f + std::sin((u + v) * 53.0f) * 0.5f;
+			mesh.positions.push_back(glm::vec3(u * 200.0f - 100.0f, height, v * 200.0f - 100.0f));
+		}
+	}
+	for (uint32_t y = 0; y < quads; y++) {
+		for (uint32_t x = 0; x < quads; x++) {
+			const uint32_t i0 = y * (quads + 1) + x;
+			const uint32_t i1 = i0 + quads + 1;
+			mesh.indices.insert(mesh.indices.end(), { i0, i1, i0 + 1, i0 + 1, i1, i1 + 1 });
+		}
+	}
+	return mesh;
+}
+
+int main(int argc, char* argv[])
+{
+	const uint32_t runs = vks::benchmark::runCount(argc, argv);
+	const uint32_t triangleCounts[] = { 10000, 100000, 1000000 };
+
+	printf("BVH build, median of %u runs\n", runs);
+	printf("%-10s %10s %-9s %11s %12s %14s %9s %10s %6s %8s\n", "mesh", "triangles", "build", "total [ms]", "binned [ms]", "collapse [ms]", "Mtris/s", "nodes", "depth", "SAH");
+	for (uint32_t triangleCount : triangleCounts) {
+		for (uint32_t meshType = 0; meshType < 2; meshType++) {
+			const Mesh mesh = (meshType == 0) ? scatteredMesh(triangleCount) : surfaceMesh(triangleCount);
+			const uint32_t meshTriangles = static_cast<uint32_t>(mesh.indices.size() / 3);
+			for (uint32_t parallel = 0; parallel < 2; parallel++) {
+				vks::BVH bvh;
+				bvh.settings.parallelThreshold = parallel ? vks::BVH::BuildSettings().parallelThreshold : 0;
+				std::vector<double> buildTimes, collapseTimes;
+				const double total = vks::benchmark::medianTime(runs, [&]() {
+					bvh.build(mesh.positions, mesh.indices);
+					buildTimes.push_back(bvh.statistics.buildTime);
+					collapseTimes.push_back(bvh.statistics.collapseTime);
+				});
+				printf("%-10s %10u %-9s %11.2f %12.2f %14.2f %9.2f %10u %6u %8.2f\n", mesh.name.c_str(), meshTriangles, parallel ? "parallel" : "serial",
+					total, vks::benchmark::median(buildTimes), vks::benchmark::median(collapseTimes), meshTriangles / (total * 1000.0),
+					bvh.statistics.nodes, bvh.statistics.maxDepth, bvh.statistics.sahCost);
+			}
+		}
+	}
+	return 0;
+}
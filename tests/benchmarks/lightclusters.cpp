@@ -0,0 +1,91 @@
+/*
+* Light count scaling benchmark for the clustered light culling (vks::LightClusters)
+*
+* Culls increasing numbers of small lights scattered in front of the camera, like the moving lights of the deferred example,
+* and reports the median GPU time of the culling pass (from timestamps, or the submission time if the device has none)
+* together with the number of light indices written and the clusters that hit the light limit
+*
+* Usage: benchmark_lightclusters [--runs n]
+*
+* Copyright (C) 2026 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "benchmark.h"
+#include "testing.h"
+#include "VulkanLightClusters.h"
+#include "VulkanQueryManager.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+int main(int argc, char* argv[])
+{
+	const uint32_t runs = vks::benchmark::runCount(argc, argv);
+	const uint32_t lightCounts[] = { 64, 256, 1024, 4096, 16384 };
+	const uint32_t maxLights = lightCounts[sizeof(lightCounts) / sizeof(lightCounts[0]) - 1];
+
+	vks::test::HeadlessDevice headless;
+	if (!headless.create()) {
+		return vks::test::skip("benchmark_lightclusters", "no Vulkan device");
+	}
+	vks::VulkanDevice* device = headless.device;
+	const bool timestampsSupported = (device->properties.limits.timestampComputeAndGraphics == VK_TRUE) && (device->queueFamilyProperties[device->queueFamilyIndices.graphics].timestampValidBits > 0);
+	vks::QueryManager timestamps;
+	if (timestampsSupported) {
+		timestamps.create(device, headless.queue, VK_QUERY_TYPE_TIMESTAMP, 1, 2);
+	}
+
+	vks::LightClusters lightClusters;
+	lightClusters.create(device, headless.queue, headless.shaderCache, headless.shadersPath, maxLights);
+	const float zNear = 0.1f;
+	const float zFar = 256.0f;
+	lightClusters.updateView(glm::lookAt(glm::vec3(0.0f, 2.0f, 10.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)), glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, zNear, zFar), zNear, zFar);
+
+	std::mt19937 random(0);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	std::vector<vks::LightClusters::Light> lights(maxLights);
+	for (vks::LightClusters::Light& light : lights) {
+		light.position = glm::vec3(uniform(random) * 16.0f - 8.0f, uniform(random) * 2.5f, uniform(random) * 16.0f - 8.0f);
+		light.range = 0.3f + uniform(random) * 0.5f;
+		light.color = glm::vec3(1.0f);
+		light.intensity = 0.5f;
+	}
+
+	printf("Light culling, %u x %u x %u clusters, median of %u runs, %s\n", lightClusters.settings.gridSize[0], lightClusters.settings.gridSize[1], lightClusters.settings.gridSize[2],
+		runs, timestampsSupported ? "GPU time" : "submission time (no timestamp support)");
+	printf("%8s %12s %14s %19s\n", "lights", "culling [ms]", "light indices", "saturated clusters");
+	for (uint32_t lightCount : lightCounts) {
+		lightClusters.updateLights(lights.data(), lightCount);
+		std::vector<double> gpuTimes;
+		const double submissionTime = vks::benchmark::medianTime(runs, [&]() {
+			VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			if (timestampsSupported) {
+				timestamps.cmdBeginFrame(commandBuffer, 0);
+				timestamps.cmdWriteTimestamp(commandBuffer, 0, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+			}
+			lightClusters.cmdBuild(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+			if (timestampsSupported) {
+				timestamps.cmdWriteTimestamp(commandBuffer, 0, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+				timestamps.cmdResolve(commandBuffer, 0);
+			}
+			device->flushCommandBuffer(commandBuffer, headless.queue, true);
+			if (timestampsSupported) {
+				gpuTimes.push_back((timestamps.getResult(0, 1) - timestamps.getResult(0, 0)) * device->properties.limits.timestampPeriod / 1000000.0);
+			}
+		});
+		lightClusters.updateStatistics();
+		printf("%8u %12.3f %14u %19u\n", lightCount, timestampsSupported ? vks::benchmark::median(gpuTimes) : submissionTime,
+			lightClusters.statistics.lightIndexCount, lightClusters.statistics.saturatedClusterCount);
+	}
+
+	lightClusters.destroy();
+	if (timestampsSupported) {
+		timestamps.destroy();
+	}
+	return 0;
+}
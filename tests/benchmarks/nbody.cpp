@@ -0,0 +1,270 @@
+/*
+* Throughput benchmark for the n-body simulation of the computenbody example
+*
+* Runs the force calculation compute shader for increasing particle counts with all shared memory tile sizes the device supports,
+* and reports the median GPU time (from timestamps, or the submission time if the device has none) and the interaction throughput
+* Each configuration is checked against one step of the CPU simulation (vks::NBodySimulation) first, particle counts aren't multiples
+* of the tile size, so partially filled tiles and invocations past the last particle are covered as well
+* Afterwards the CPU simulation backends are measured, this part also runs without a Vulkan device
+*
+* Usage: benchmark_nbody [--runs n]
+*
+* Copyright (C) 2026 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "benchmark.h"
+#include "testing.h"
+#include "VulkanBuffer.h"
+#include "VulkanCpuSimulation.h"
+#include "VulkanQueryManager.h"
+#include "VulkanTools.h"
+
+using Particle = vks::NBodySimulation::Particle;
+
+// Same layout as the uniform block of the compute shaders
+struct UniformData {
+	float deltaT{ 0.05f / 60.0f };
+	int32_t particleCount{ 0 };
+	float gravity{ 0.002f };
+	float power{ 0.75f };
+	float soften{ 0.05f };
+};
+
+static const uint32_t particleCounts[] = { 4000, 16000, 64000 };
+// Same as the validation of the example
+static const float validationTolerance = 1e-3f;
+
+// Normally distributed cloud of particles with a heavy body every thousand particles, similar to the attractors of the example
+static std::vector<Particle> generateParticles(uint32_t count)
+{
+	std::mt19937 random(count);
+	std::normal_distribution<float> normal(0.0f, 1.0f);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	std::vector<Particle> particles(count);
+	for (uint32_t i = 0; i < count; i++) {
+		const glm::vec3 position = glm::vec3(normal(random), normal(random), normal(random)) * 2.0f;
+		const float mass = (i % 1000 == 0) ? 1000.0f : 1.0f + uniform(random);
+		particles[i].pos = glm::vec4(position, mass);
+		particles[i].vel = glm::vec4(glm::vec3(0.0f), uniform(random));
+	}
+	return particles;
+}
+
+static void updateSimulationParameters(vks::NBodySimulation& simulation, const UniformData& uniformData)
+{
+	simulation.parameters.deltaT = uniformData.deltaT;
+	simulation.parameters.gravity = uniformData.gravity;
+	simulation.parameters.power = uniformData.power;
+	simulation.parameters.soften = uniformData.soften;
+}
+
+static void runGpuBenchmark(uint32_t runs)
+{
+	vks::test::HeadlessDevice headless;
+	if (!headless.create()) {
+		printf("Skipping the compute shader: no Vulkan device\n\n");
+		return;
+	}
+	vks::VulkanDevice* device = headless.device;
+	VkDevice logicalDevice = device->logicalDevice;
+	const bool timestampsSupported = (device->properties.limits.timestampComputeAndGraphics == VK_TRUE) && (device->queueFamilyProperties[device->queueFamilyIndices.graphics].timestampValidBits > 0);
+	vks::QueryManager timestamps;
+	if (timestampsSupported) {
+		timestamps.create(device, headless.queue, VK_QUERY_TYPE_TIMESTAMP, 1, 2);
+	}
+
+	const uint32_t maxParticles = particleCounts[sizeof(particleCounts) / sizeof(particleCounts[0]) - 1];
+	const VkDeviceSize maxBufferSize = maxParticles * sizeof(Particle);
+	vks::Buffer storageBuffer, stagingBuffer, uniformBuffer;
+	VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &storageBuffer, maxBufferSize));
+	VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, maxBufferSize));
+	VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffer, sizeof(UniformData)));
+	VK_CHECK_RESULT(stagingBuffer.map());
+	VK_CHECK_RESULT(uniformBuffer.map());
+
+	// Same bindings as the compute pipelines of the example
+	VkDescriptorPool descriptorPool;
+	std::vector<VkDescriptorPoolSize> poolSizes = {
+		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1),
+		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1)
+	};
+	VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 1);
+	VK_CHECK_RESULT(vkCreateDescriptorPool(logicalDevice, &descriptorPoolInfo, nullptr, &descriptorPool));
+	std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+	};
+	VkDescriptorSetLayout descriptorSetLayout;
+	VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(logicalDevice, &descriptorLayout, nullptr, &descriptorSetLayout));
+	VkDescriptorSet descriptorSet;
+	VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
+	VK_CHECK_RESULT(vkAllocateDescriptorSets(logicalDevice, &allocInfo, &descriptorSet));
+	std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+		vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &storageBuffer.descriptor),
+		vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, &uniformBuffer.descriptor)
+	};
+	vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+	VkPipelineLayout pipelineLayout;
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+	VK_CHECK_RESULT(vkCreatePipelineLayout(logicalDevice, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout));
+	auto createPipeline = [&](const char* fileName, const VkSpecializationInfo* specializationInfo) {
+		VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
+		computePipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		computePipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		computePipelineCreateInfo.stage.module = vks::tools::loadShader((headless.shadersPath + "computenbody/" + fileName).c_str(), logicalDevice);
+		computePipelineCreateInfo.stage.pName = "main";
+		computePipelineCreateInfo.stage.pSpecializationInfo = specializationInfo;
+		VkPipeline pipeline;
+		VK_CHECK_RESULT(vkCreateComputePipelines(logicalDevice, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &pipeline));
+		vkDestroyShaderModule(logicalDevice, computePipelineCreateInfo.stage.module, nullptr);
+		return pipeline;
+	};
+	VkPipeline pipelineIntegrate = createPipeline("particle_integrate.comp.spv", nullptr);
+
+	// The example uses the largest tile that fits into shared memory (up to 1024 particles), smaller tiles are measured for comparison
+	const uint32_t maxTileSize = std::min((uint32_t)1024, (uint32_t)(device->properties.limits.maxComputeSharedMemorySize / sizeof(glm::vec4)));
+
+	auto computeBarrier = [](VkCommandBuffer commandBuffer) {
+		VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	};
+
+	printf("Compute shader force calculation, median of %u runs, %s\n", runs, timestampsSupported ? "GPU time" : "submission time (no timestamp support)");
+	printf("%10s %6s %16s %20s %18s %18s %11s\n", "particles", "tile", "calculate [ms]", "G interactions/s", "M particles/s", "max. error", "validation");
+	for (uint32_t particleCount : particleCounts) {
+		const std::vector<Particle> particles = generateParticles(particleCount);
+		const VkDeviceSize bufferSize = particleCount * sizeof(Particle);
+		UniformData uniformData;
+		uniformData.particleCount = static_cast<int32_t>(particleCount);
+		memcpy(uniformBuffer.mapped, &uniformData, sizeof(UniformData));
+		const uint32_t groupCount = (particleCount + 255) / 256;
+
+		// Reference for the validation of a single step
+		vks::NBodySimulation reference;
+		updateSimulationParameters(reference, uniformData);
+		reference.setParticles(particles.data(), particleCount);
+		reference.step();
+
+		for (uint32_t tileSize = 256; tileSize <= maxTileSize; tileSize *= 2) {
+			VkSpecializationMapEntry specializationMapEntry = vks::initializers::specializationMapEntry(0, 0, sizeof(uint32_t));
+			VkSpecializationInfo specializationInfo = vks::initializers::specializationInfo(1, &specializationMapEntry, sizeof(uint32_t), &tileSize);
+			VkPipeline pipelineCalculate = createPipeline("particle_calculate.comp.spv", &specializationInfo);
+
+			// Validate one step (calculate and integrate) against the CPU simulation
+			VkBufferCopy copyRegion = { 0, 0, bufferSize };
+			memcpy(stagingBuffer.mapped, particles.data(), bufferSize);
+			device->copyBuffer(&stagingBuffer, &storageBuffer, headless.queue, &copyRegion);
+			VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineCalculate);
+			vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+			computeBarrier(commandBuffer);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineIntegrate);
+			vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+			device->flushCommandBuffer(commandBuffer, headless.queue, true);
+			device->copyBuffer(&storageBuffer, &stagingBuffer, headless.queue, &copyRegion);
+			const vks::SimulationComparison comparison = reference.compare(static_cast<const Particle*>(stagingBuffer.mapped), validationTolerance);
+
+			// The calculation doesn't depend on the velocities it updates, so the runs don't need to restore the particles
+			std::vector<double> gpuTimes;
+			const double submissionTime = vks::benchmark::medianTime(runs, [&]() {
+				VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineCalculate);
+				if (timestampsSupported) {
+					timestamps.cmdBeginFrame(commandBuffer, 0);
+					timestamps.cmdWriteTimestamp(commandBuffer, 0, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+				}
+				vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+				if (timestampsSupported) {
+					timestamps.cmdWriteTimestamp(commandBuffer, 0, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+					timestamps.cmdResolve(commandBuffer, 0);
+				}
+				device->flushCommandBuffer(commandBuffer, headless.queue, true);
+				if (timestampsSupported) {
+					gpuTimes.push_back((timestamps.getResult(0, 1) - timestamps.getResult(0, 0)) * device->properties.limits.timestampPeriod / 1000000.0);
+				}
+			});
+			const double time = timestampsSupported ? vks::benchmark::median(gpuTimes) : submissionTime;
+			printf("%10u %6u %16.3f %20.2f %18.2f %18.2e %11s\n", particleCount, tileSize, time, (double)particleCount * particleCount / (time * 1000000.0),
+				particleCount / (time * 1000.0), std::max(comparison.maxPositionError, comparison.maxVelocityError), comparison.passed ? "passed" : "FAILED");
+
+			vkDestroyPipeline(logicalDevice, pipelineCalculate, nullptr);
+		}
+	}
+	printf("\n");
+
+	vkDestroyPipeline(logicalDevice, pipelineIntegrate, nullptr);
+	vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
+	vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+	storageBuffer.destroy();
+	stagingBuffer.destroy();
+	uniformBuffer.destroy();
+	if (timestampsSupported) {
+		timestamps.destroy();
+	}
+}
+
+static void runCpuBenchmark(uint32_t runs)
+{
+	struct Configuration {
+		const char* name;
+		vks::NBodySimulation::Method method;
+		bool simd;
+		uint32_t threadCount;
+		// Single threaded direct sums take too long for the larger particle counts
+		uint32_t maxParticles;
+	};
+	const Configuration configurations[] = {
+		{ "direct, scalar, 1 thread", vks::NBodySimulation::Direct, false, 1, 16000 },
+		{ "direct, SIMD, 1 thread", vks::NBodySimulation::Direct, true, 1, 16000 },
+		{ "direct, SIMD, all threads", vks::NBodySimulation::Direct, true, 0, 64000 },
+		{ "Barnes-Hut, all threads", vks::NBodySimulation::BarnesHut, true, 0, 64000 },
+	};
+
+	printf("CPU simulation step, median of %u runs\n", runs);
+	printf("%10s %-26s %11s %18s\n", "particles", "configuration", "step [ms]", "M particles/s");
+	for (uint32_t particleCount : particleCounts) {
+		const std::vector<Particle> particles = generateParticles(particleCount);
+		UniformData uniformData;
+		for (const Configuration& configuration : configurations) {
+			if (particleCount > configuration.maxParticles) {
+				continue;
+			}
+			vks::NBodySimulation simulation;
+			updateSimulationParameters(simulation, uniformData);
+			simulation.settings.method = configuration.method;
+			simulation.settings.simd = configuration.simd;
+			simulation.settings.threadCount = configuration.threadCount;
+			simulation.setParticles(particles.data(), particleCount);
+			std::vector<double> stepTimes;
+			for (uint32_t run = 0; run < runs; run++) {
+				simulation.step();
+				stepTimes.push_back(simulation.statistics.stepTime);
+			}
+			const double time = vks::benchmark::median(stepTimes);
+			printf("%10u %-26s %11.2f %18.2f\n", particleCount, configuration.name, time, particleCount / (time * 1000.0));
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const uint32_t runs = vks::benchmark::runCount(argc, argv);
+	runGpuBenchmark(runs);
+	runCpuBenchmark(runs);
+	return 0;
+}
@@ -0,0 +1,390 @@
+/*
+* Test for the compute shader ray tracing BVH (vks::BVH)
+*
+* Checks the structure of the collapsed four wide hierarchy against the input triangles (every triangle referenced once, leaves within
+* the size limit, depth first node order and quantized child bounds containing their subtrees) and compares closest hits found by
+* traversing it the same way the shader does against a brute force search over all triangles
+*
+* Copyright (C) 2026 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "testing.h"
+#include "VulkanBVH.h"
+
+struct Mesh {
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> indices;
+	std::vector<uint32_t> colors;
+};
+
+// Small triangles scattered in a cube, with some of them sharing vertices and some duplicated
+static Mesh randomMesh(uint32_t triangleCount, uint32_t seed, float extent = 10.0f, glm::vec3 offset = glm::vec3(0.0f))
+{
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+	Mesh mesh;
+	for (uint32_t i = 0; i < triangleCount; i++) {
+		if ((i % 16 == 15) && (i > 0)) {
+			// Duplicate of the previous triangle
+			mesh.indices.insert(mesh.indices.end(), mesh.indices.end() - 3, mesh.indices.end());
+		} else {
+			const glm::vec3 center = offset + glm::vec3(uniform(random), uniform(random), uniform(random)) * extent;
+			const uint32_t first = static_cast<uint32_t>(mesh.positions.size());
+			for (uint32_t v = 0; v < 3; v++) {
+				mesh.positions.push_back(center + glm::vec3(uniform(random), uniform(random), uniform(random)) * (extent * 0.01f));
+			}
+			mesh.indices.insert(mesh.indices.end(), { first, first + 1, first + 2 });
+		}
+		mesh.colors.push_back(random());
+	}
+	return mesh;
+}
+
+struct AABB {
+	glm::vec3 min{ FLT_MAX };
+	glm::vec3 max{ -FLT_MAX };
+	void grow(const glm::vec3& point)
+	{
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+	void grow(const AABB& other)
+	{
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+};
+
+// Walks the hierarchy from the root and checks it against the input, returns the bounds of the visited subtree
+static AABB checkNode(const vks::BVH& bvh, const Mesh& mesh, uint32_t index, uint32_t depth, std::vector<uint32_t>& nodeVisits, std::vector<uint32_t>& triangleSlots, std::vector<uint32_t>& triangleIds, uint32_t& leaves, uint32_t& maxDepth)
+{
+	nodeVisits[index]++;
+	maxDepth = std::max(maxDepth, depth);
+	const vks::BVH::Node& node = bvh.nodes[index];
+	AABB nodeBounds;
+	for (uint32_t i = 0; i < 4; i++) {
+		const uint32_t child = node.children[i];
+		if (child == vks::BVH::emptyChild) {
+			continue;
+		}
+		AABB bounds;
+		if (child & vks::BVH::leafFlag) {
+			leaves++;
+			const uint32_t first = child & (vks::BVH::maxTriangles - 1);
+			const uint32_t count = (child >> 24) & vks::BVH::maxLeafTriangles;
+			TEST_CHECK((count > 0) && (count <= bvh.settings.maxLeafSize));
+			if (!TEST_CHECK(first + count <= bvh.triangles.size())) {
+				continue;
+			}
+			for (uint32_t t = first; t < first + count; t++) {
+				triangleSlots[t]++;
+				const vks::BVH::Triangle& triangle = bvh.triangles[t];
+				if (!TEST_CHECK(triangle.id < triangleIds.size())) {
+					continue;
+				}
+				triangleIds[triangle.id]++;
+				// Exact bounds from the input data, not from the stored edges
+				const glm::vec3& v0 = mesh.positions[mesh.indices[triangle.id * 3 + 0]];
+				const glm::vec3& v1 = mesh.positions[mesh.indices[triangle.id * 3 + 1]];
+				const glm::vec3& v2 = mesh.positions[mesh.indices[triangle.id * 3 + 2]];
+				bounds.grow(v0);
+				bounds.grow(v1);
+				bounds.grow(v2);
+				TEST_CHECK(memcmp(&triangle.v0, &v0, sizeof(glm::vec3)) == 0);
+				const glm::vec3 e1 = v1 - v0;
+				const glm::vec3 e2 = v2 - v0;
+				TEST_CHECK(memcmp(&triangle.e1, &e1, sizeof(glm::vec3)) == 0);
+				TEST_CHECK(memcmp(&triangle.e2, &e2, sizeof(glm::vec3)) == 0);
+				TEST_CHECK(triangle.color == (mesh.colors.empty() ? 0xffffffff : mesh.colors[triangle.id]));
+			}
+		} else {
+			// Depth first order, children are always stored after their parent
+			if (!TEST_CHECK((child > index) && (child < bvh.nodes.size()))) {
+				continue;
+			}
+			bounds = checkNode(bvh, mesh, child, depth + 1, nodeVisits, triangleSlots, triangleIds, leaves, maxDepth);
+		}
+		// The quantized bounds need to be conservative, or rays would miss triangles
+		glm::vec3 min, max;
+		vks::BVH::childBounds(node, i, min, max);
+		TEST_CHECK((min.x <= bounds.min.x) && (min.y <= bounds.min.y) && (min.z <= bounds.min.z));
+		TEST_CHECK((max.x >= bounds.max.x) && (max.y >= bounds.max.y) && (max.z >= bounds.max.z));
+		nodeBounds.grow(bounds);
+	}
+	return nodeBounds;
+}
+
+static void checkStructure(const vks::BVH& bvh, const Mesh& mesh)
+{
+	const uint32_t triangleCount = static_cast<uint32_t>(mesh.indices.size() / 3);
+	TEST_CHECK(bvh.statistics.triangles == triangleCount);
+	TEST_CHECK(bvh.triangles.size() == triangleCount);
+	TEST_CHECK(bvh.statistics.nodes == bvh.nodes.size());
+	if (!TEST_CHECK(!bvh.nodes.empty())) {
+		return;
+	}
+	std::vector<uint32_t> nodeVisits(bvh.nodes.size(), 0);
+	std::vector<uint32_t> triangleSlots(bvh.triangles.size(), 0);
+	std::vector<uint32_t> triangleIds(triangleCount, 0);
+	uint32_t leaves = 0;
+	uint32_t maxDepth = 0;
+	checkNode(bvh, mesh, 0, 0, nodeVisits, triangleSlots, triangleIds, leaves, maxDepth);
+	// Every node is reached exactly once, and every triangle is stored and referenced exactly once
+	TEST_CHECK(std::all_of(nodeVisits.begin(), nodeVisits.end(), [](uint32_t count) { return count == 1; }));
+	TEST_CHECK(std::all_of(triangleSlots.begin(), triangleSlots.end(), [](uint32_t count) { return count == 1; }));
+	TEST_CHECK(std::all_of(triangleIds.begin(), triangleIds.end(), [](uint32_t count) { return count == 1; }));
+	TEST_CHECK(bvh.statistics.leaves == leaves);
+	TEST_CHECK(bvh.statistics.maxDepth == maxDepth);
+	TEST_CHECK(bvh.statistics.sahCost > 0.0f);
+	TEST_CHECK(bvh.validate());
+}
+
+// Moeller-Trumbore with the precomputed edges, as done by the shader
+static bool intersectTriangle(const glm::vec3& v0, const glm::vec3& e1, const glm::vec3& e2, const glm::vec3& origin, const glm::vec3& direction, float& closest)
+{
+	const glm::vec3 p = glm::cross(direction, e2);
+	const float det = glm::dot(e1, p);
+	if (std::abs(det) < 1e-12f) {
+		return false;
+	}
+	const float invDet = 1.0f / det;
+	const glm::vec3 s = origin - v0;
+	const float u = glm::dot(s, p) * invDet;
+	if ((u < 0.0f) || (u > 1.0f)) {
+		return false;
+	}
+	const glm::vec3 q = glm::cross(s, e1);
+	const float v = glm::dot(direction, q) * invDet;
+	if ((v < 0.0f) || (u + v > 1.0f)) {
+		return false;
+	}
+	const float t = glm::dot(e2, q) * invDet;
+	if ((t > 1e-4f) && (t < closest)) {
+		closest = t;
+		return true;
+	}
+	return false;
+}
+
+static float traverse(const vks::BVH& bvh, const glm::vec3& origin, const glm::vec3& direction)
+{
+	float closest = FLT_MAX;
+	const glm::vec3 invDirection = glm::vec3(1.0f) / direction;
+	std::vector<uint32_t> stack = { 0 };
+	while (!stack.empty()) {
+		const vks::BVH::Node& node = bvh.nodes[stack.back()];
+		stack.pop_back();
+		for (uint32_t i = 0; i < 4; i++) {
+			if (node.children[i] == vks::BVH::emptyChild) {
+				continue;
+			}
+			glm::vec3 min, max;
+			vks::BVH::childBounds(node, i, min, max);
+			const glm::vec3 t0 = (min - origin) * invDirection;
+			const glm::vec3 t1 = (max - origin) * invDirection;
+			const glm::vec3 tNear = glm::min(t0, t1);
+			const glm::vec3 tFar = glm::max(t0, t1);
+			const float entry = std::max(std::max(tNear.x, tNear.y), tNear.z);
+			const float exit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+			if ((entry > exit) || (exit < 0.0f) || (entry > closest)) {
+				continue;
+			}
+			if (node.children[i] & vks::BVH::leafFlag) {
+				const uint32_t first = node.children[i] & (vks::BVH::maxTriangles - 1);
+				const uint32_t count = (node.children[i] >> 24) & vks::BVH::maxLeafTriangles;
+				for (uint32_t t = first; t < first + count; t++) {
+					intersectTriangle(bvh.triangles[t].v0, bvh.triangles[t].e1, bvh.triangles[t].e2, origin, direction, closest);
+				}
+			} else {
+				stack.push_back(node.children[i]);
+			}
+		}
+	}
+	return closest;
+}
+
+static void checkRayQueries(const vks::BVH& bvh, const Mesh& mesh, uint32_t rayCount, uint32_t seed)
+{
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+	AABB sceneBounds;
+	for (const glm::vec3& position : mesh.positions) {
+		sceneBounds.grow(position);
+	}
+	const glm::vec3 center = (sceneBounds.min + sceneBounds.max) * 0.5f;
+	// Origins are spread over a cube around the scene, so flat scenes aren't only hit by rays parallel to them
+	const glm::vec3 size = sceneBounds.max - sceneBounds.min;
+	const float extent = std::max(std::max(size.x, size.y), size.z) * 0.6f;
+	uint32_t mismatches = 0;
+	uint32_t hits = 0;
+	for (uint32_t r = 0; r < rayCount; r++) {
+		// Every other ray is aimed at a random triangle, so sparse scenes are hit too
+		const glm::vec3 origin = center + glm::vec3(uniform(random), uniform(random), uniform(random)) * extent;
+		glm::vec3 direction = glm::vec3(uniform(random), uniform(random), uniform(random));
+		if (r % 2 == 0) {
+			const size_t triangle = (random() % (mesh.indices.size() / 3)) * 3;
+			const glm::vec3 target = (mesh.positions[mesh.indices[triangle]] + mesh.positions[mesh.indices[triangle + 1]] + mesh.positions[mesh.indices[triangle + 2]]) / 3.0f;
+			direction = target - origin;
+		}
+		direction = glm::normalize(direction);
+		float expected = FLT_MAX;
+		for (size_t t = 0; t < mesh.indices.size(); t += 3) {
+			const glm::vec3& v0 = mesh.positions[mesh.indices[t]];
+			intersectTriangle(v0, mesh.positions[mesh.indices[t + 1]] - v0, mesh.positions[mesh.indices[t + 2]] - v0, origin, direction, expected);
+		}
+		const float closest = traverse(bvh, origin, direction);
+		if (closest != expected) {
+			if (mismatches == 0) {
+				std::cerr << "Ray " << r << " closest hit at " << closest << ", expected " << expected << "\n";
+			}
+			mismatches++;
+		}
+		hits += (expected != FLT_MAX) ? 1 : 0;
+	}
+	TEST_CHECK(mismatches == 0);
+	// Make sure the rays actually test something
+	TEST_CHECK(hits > 0);
+}
+
+static void testEmpty()
+{
+	vks::BVH bvh;
+	bvh.build({}, {});
+	TEST_CHECK(bvh.nodes.empty());
+	TEST_CHECK(bvh.triangles.empty());
+	TEST_CHECK(bvh.statistics.triangles == 0);
+	TEST_CHECK(bvh.validate());
+}
+
+static void testSingleTriangle()
+{
+	Mesh mesh;
+	mesh.positions = { glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f) };
+	mesh.indices = { 0, 1, 2 };
+	vks::BVH bvh;
+	bvh.build(mesh.positions, mesh.indices);
+	// A single node with one leaf child
+	TEST_CHECK(bvh.nodes.size() == 1);
+	TEST_CHECK(bvh.nodes[0].children[0] == (vks::BVH::leafFlag | (1 << 24) | 0));
+	TEST_CHECK((bvh.nodes[0].children[1] == vks::BVH::emptyChild) && (bvh.nodes[0].children[2] == vks::BVH::emptyChild) && (bvh.nodes[0].children[3] == vks::BVH::emptyChild));
+	checkStructure(bvh, mesh);
+}
+
+static void testRandomMeshes()
+{
+	// Bin counts and leaf sizes at and between their limits
+	const uint32_t binCounts[] = { 2, 16, vks::BVH::maxBinCount };
+	const uint32_t leafSizes[] = { 1, 4, vks::BVH::maxLeafTriangles };
+	for (uint32_t binCount : binCounts) {
+		for (uint32_t leafSize : leafSizes) {
+			const Mesh mesh = randomMesh(5000, binCount * 131 + leafSize);
+			vks::BVH bvh;
+			bvh.settings.binCount = binCount;
+			bvh.settings.maxLeafSize = leafSize;
+			bvh.build(mesh.positions, mesh.indices, mesh.colors);
+			checkStructure(bvh, mesh);
+			checkRayQueries(bvh, mesh, 200, binCount + leafSize);
+		}
+	}
+}
+
+static void testParallelBuild()
+{
+	// Large enough to build several subtrees on their own threads, which has to give the same result as a serial build
+	const Mesh mesh = randomMesh(100000, 7);
+	vks::BVH parallel;
+	parallel.settings.parallelThreshold = 1024;
+	parallel.build(mesh.positions, mesh.indices, mesh.colors);
+	checkStructure(parallel, mesh);
+	checkRayQueries(parallel, mesh, 100, 11);
+
+	vks::BVH serial;
+	serial.settings.parallelThreshold = 0;
+	serial.build(mesh.positions, mesh.indices, mesh.colors);
+	TEST_CHECK(serial.nodes.size() == parallel.nodes.size());
+	TEST_CHECK(serial.triangles.size() == parallel.triangles.size());
+	if ((serial.nodes.size() == parallel.nodes.size()) && (serial.triangles.size() == parallel.triangles.size())) {
+		TEST_CHECK(memcmp(serial.nodes.data(), parallel.nodes.data(), serial.nodes.size() * sizeof(vks::BVH::Node)) == 0);
+		TEST_CHECK(memcmp(serial.triangles.data(), parallel.triangles.data(), serial.triangles.size() * sizeof(vks::BVH::Triangle)) == 0);
+	}
+}
+
+static void testCoincidentCentroids()
+{
+	// Rotated copies of a triangle around the same center, so no split plane can separate them and the build falls back to halving the range
+	Mesh mesh;
+	for (uint32_t i = 0; i < 300; i++) {
+		const float angle = i * 0.0209f;
+		const glm::vec3 a(std::cos(angle), std::sin(angle), 0.0f);
+		const glm::vec3 b(-std::sin(angle), std::cos(angle), 0.5f);
+		const uint32_t first = static_cast<uint32_t>(mesh.positions.size());
+		mesh.positions.insert(mesh.positions.end(), { a, b, (a + b) * -1.0f });
+		mesh.indices.insert(mesh.indices.end(), { first, first + 1, first + 2 });
+	}
+	vks::BVH bvh;
+	bvh.settings.maxLeafSize = 4;
+	bvh.build(mesh.positions, mesh.indices);
+	checkStructure(bvh, mesh);
+}
+
+static void testQuantization()
+{
+	// Tiny triangles far away from the origin and a scene spanning a huge range, where the 8 bit child bounds are coarsest
+	const Mesh farMesh = randomMesh(2000, 3, 1.0f, glm::vec3(10000.0f, -5000.0f, 20000.0f));
+	vks::BVH farBvh;
+	farBvh.build(farMesh.positions, farMesh.indices, farMesh.colors);
+	checkStructure(farBvh, farMesh);
+	checkRayQueries(farBvh, farMesh, 200, 5);
+
+	const Mesh wideMesh = randomMesh(2000, 4, 100000.0f);
+	vks::BVH wideBvh;
+	wideBvh.build(wideMesh.positions, wideMesh.indices, wideMesh.colors);
+	checkStructure(wideBvh, wideMesh);
+
+	// Axis aligned triangles have zero extent along one axis
+	Mesh flatMesh;
+	for (uint32_t y = 0; y < 32; y++) {
+		for (uint32_t x = 0; x < 32; x++) {
+			const uint32_t first = static_cast<uint32_t>(flatMesh.positions.size());
+			flatMesh.positions.insert(flatMesh.positions.end(), { glm::vec3(float(x), float(y), 1.0f), glm::vec3(x + 1.0f, float(y), 1.0f), glm::vec3(float(x), y + 1.0f, 1.0f) });
+			flatMesh.indices.insert(flatMesh.indices.end(), { first, first + 1, first + 2 });
+		}
+	}
+	vks::BVH flatBvh;
+	flatBvh.build(flatMesh.positions, flatMesh.indices);
+	checkStructure(flatBvh, flatMesh);
+	checkRayQueries(flatBvh, flatMesh, 200, 6);
+}
+
+static void testRebuild()
+{
+	// Building again replaces the previous contents
+	vks::BVH bvh;
+	const Mesh large = randomMesh(3000, 8);
+	bvh.build(large.positions, large.indices, large.colors);
+	const Mesh small = randomMesh(40, 9);
+	bvh.build(small.positions, small.indices, small.colors);
+	checkStructure(bvh, small);
+}
+
+int main()
+{
+	testEmpty();
+	testSingleTriangle();
+	testRandomMeshes();
+	testParallelBuild();
+	testCoincidentCentroids();
+	testQuantization();
+	testRebuild();
+	return vks::test::result("bvh");
+}
@@ -0,0 +1,209 @@
+/*
+* Test for the cloth compute shader of the computecloth example against the CPU simulation (vks::ClothSimulation)
+*
+* Runs one iteration of the shader on the device and compares the particles with one iteration of the CPU simulation, with and
+* without the normal calculation. The particles are displaced and moving, so all springs exert forces, and the cloth intersects
+* the sphere, so collisions are covered as well. Square and non-square grids check the neighbor indexing
+*
+* Copyright (C) 2026 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "testing.h"
+#include "VulkanBuffer.h"
+#include "VulkanCpuSimulation.h"
+#include "VulkanTools.h"
+
+using Particle = vks::ClothSimulation::Particle;
+
+// Same layout as the uniform block of the compute shader
+struct UniformData {
+	// Larger than in the example, so errors in the forces change the velocities by more than the tolerance
+	float deltaT{ 0.001f };
+	float particleMass{ 0.1f };
+	float springStiffness{ 2000.0f };
+	float damping{ 0.25f };
+	float restDistH{ 0.0f };
+	float restDistV{ 0.0f };
+	float restDistD{ 0.0f };
+	float sphereRadius{ 1.0f };
+	glm::vec4 spherePos{ 0.0f, -1.6f, 0.0f, 0.0f };
+	glm::vec4 gravity{ 2.0f, 9.8f, -3.0f, 0.0f };
+	glm::ivec2 particleCount{ 0 };
+};
+
+// Largest relative error that passes, tighter than the validation of the example as a single step from a known state is compared
+static const float tolerance = 1e-4f;
+
+// Cloth of the example's size centered above the sphere, with randomly displaced particles and velocities
+static std::vector<Particle> generateParticles(uint32_t gridWidth, uint32_t gridHeight, UniformData& uniformData)
+{
+	const glm::vec2 size(5.0f, 5.0f);
+	const float dx = size.x / (gridWidth - 1);
+	const float dy = size.y / (gridHeight - 1);
+	uniformData.restDistH = dx;
+	uniformData.restDistV = dy;
+	uniformData.restDistD = sqrtf(dx * dx + dy * dy);
+	uniformData.particleCount = glm::ivec2(gridWidth, gridHeight);
+
+	std::mt19937 random(gridWidth * gridHeight);
+	std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+	std::vector<Particle> particles(gridWidth * gridHeight);
+	for (uint32_t y = 0; y < gridHeight; y++) {
+		for (uint32_t x = 0; x < gridWidth; x++) {
+			Particle& particle = particles[y * gridWidth + x];
+			const glm::vec3 offset = glm::vec3(uniform(random) * dx, uniform(random) * 0.1f, uniform(random) * dy) * 0.25f;
+			particle.pos = glm::vec4(glm::vec3(dx * x - size.x / 2.0f, -2.0f, dy * y - size.y / 2.0f) + offset, 1.0f);
+			particle.vel = glm::vec4(uniform(random), uniform(random), uniform(random), 0.0f);
+			particle.uv = glm::vec4(1.0f - (float)y / (gridHeight - 1), (float)x / (gridWidth - 1), 0.0f, 0.0f);
+			particle.normal = glm::vec4(0.0f);
+		}
+	}
+	return particles;
+}
+
+static void testGrid(vks::test::HeadlessDevice& headless, uint32_t gridWidth, uint32_t gridHeight, bool calculateNormals)
+{
+	vks::VulkanDevice* device = headless.device;
+	VkDevice logicalDevice = device->logicalDevice;
+	const std::string name = std::to_string(gridWidth) + "x" + std::to_string(gridHeight) + (calculateNormals ? " with normals" : "");
+	UniformData uniformData;
+	const std::vector<Particle> particles = generateParticles(gridWidth, gridHeight, uniformData);
+	const VkDeviceSize bufferSize = particles.size() * sizeof(Particle);
+
+	vks::Buffer inputBuffer, outputBuffer, stagingBuffer, uniformBuffer;
+	VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &inputBuffer, bufferSize));
+	VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &outputBuffer, bufferSize));
+	VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, bufferSize, (void*)particles.data()));
+	VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffer, sizeof(UniformData), &uniformData));
+	VK_CHECK_RESULT(stagingBuffer.map());
+
+	// Same bindings and push constant as the compute pipeline of the example
+	VkDescriptorPool descriptorPool;
+	std::vector<VkDescriptorPoolSize> poolSizes = {
+		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2),
+		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1)
+	};
+	VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 1);
+	VK_CHECK_RESULT(vkCreateDescriptorPool(logicalDevice, &descriptorPoolInfo, nullptr, &descriptorPool));
+	std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+	};
+	VkDescriptorSetLayout descriptorSetLayout;
+	VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(logicalDevice, &descriptorLayout, nullptr, &descriptorSetLayout));
+	VkDescriptorSet descriptorSet;
+	VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
+	VK_CHECK_RESULT(vkAllocateDescriptorSets(logicalDevice, &allocInfo, &descriptorSet));
+	std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+		vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &inputBuffer.descriptor),
+		vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &outputBuffer.descriptor),
+		vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &uniformBuffer.descriptor)
+	};
+	vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+	VkPipelineLayout pipelineLayout;
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+	VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(uint32_t), 0);
+	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+	pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+	VK_CHECK_RESULT(vkCreatePipelineLayout(logicalDevice, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout));
+	VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
+	computePipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	computePipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	computePipelineCreateInfo.stage.module = headless.shaderCache.get(headless.shadersPath + "computecloth/cloth.comp.spv");
+	computePipelineCreateInfo.stage.pName = "main";
+	VkPipeline pipeline;
+	VK_CHECK_RESULT(vkCreateComputePipelines(logicalDevice, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &pipeline));
+
+	// One iteration, the shader's work groups cover 10x10 particles
+	VkBufferCopy copyRegion = { 0, 0, bufferSize };
+	const uint32_t pushConstant = calculateNormals ? 1 : 0;
+	VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+	vkCmdCopyBuffer(commandBuffer, stagingBuffer.buffer, inputBuffer.buffer, 1, &copyRegion);
+	VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+	memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &pushConstant);
+	vkCmdDispatch(commandBuffer, gridWidth / 10, gridHeight / 10, 1);
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	vkCmdCopyBuffer(commandBuffer, outputBuffer.buffer, stagingBuffer.buffer, 1, &copyRegion);
+	device->flushCommandBuffer(commandBuffer, headless.queue, true);
+	const Particle* result = static_cast<const Particle*>(stagingBuffer.mapped);
+
+	vks::ClothSimulation reference;
+	reference.parameters.deltaT = uniformData.deltaT;
+	reference.parameters.particleMass = uniformData.particleMass;
+	reference.parameters.springStiffness = uniformData.springStiffness;
+	reference.parameters.damping = uniformData.damping;
+	reference.parameters.restDistH = uniformData.restDistH;
+	reference.parameters.restDistV = uniformData.restDistV;
+	reference.parameters.restDistD = uniformData.restDistD;
+	reference.parameters.sphereRadius = uniformData.sphereRadius;
+	reference.parameters.spherePos = uniformData.spherePos;
+	reference.parameters.gravity = uniformData.gravity;
+	reference.setParticles(particles.data(), gridWidth, gridHeight);
+	reference.step(1, calculateNormals);
+	const vks::SimulationComparison comparison = reference.compare(result, tolerance);
+	if (!TEST_CHECK(comparison.passed)) {
+		std::cerr << name << ": max. position error " << comparison.maxPositionError << ", max. velocity error " << comparison.maxVelocityError
+			<< " (particle " << comparison.worstParticle << ")\n";
+	}
+
+	// Colliding particles lose their velocity, some of them have to be pushed out of the sphere for the collision to be covered
+	std::vector<Particle> expected(particles.size());
+	reference.getParticles(expected.data());
+	uint32_t collisions = 0;
+	float maxNormalError = 0.0f;
+	for (size_t i = 0; i < expected.size(); i++) {
+		if (expected[i].vel == glm::vec4(0.0f)) {
+			collisions++;
+		}
+		maxNormalError = std::max(maxNormalError, glm::length(glm::vec3(result[i].normal) - glm::vec3(expected[i].normal)));
+	}
+	TEST_CHECK(collisions > 0);
+	// Normals are only written if requested
+	if (calculateNormals) {
+		TEST_CHECK_NEAR(maxNormalError, 0.0f, tolerance);
+	}
+
+	vkDestroyPipeline(logicalDevice, pipeline, nullptr);
+	vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
+	vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+	inputBuffer.destroy();
+	outputBuffer.destroy();
+	stagingBuffer.destroy();
+	uniformBuffer.destroy();
+}
+
+int main()
+{
+	vks::test::HeadlessDevice headless;
+	if (!headless.create()) {
+		return vks::test::skip("cloth", "no Vulkan device");
+	}
+
+	// The example's grid and a non-square one, grid sizes have to be multiples of the work group size
+	for (bool calculateNormals : { false, true }) {
+		testGrid(headless, 60, 60, calculateNormals);
+		testGrid(headless, 30, 70, calculateNormals);
+	}
+
+	return vks::test::result("cloth");
+}
@@ -0,0 +1,257 @@
+/*
+* Test for the hierarchical depth pyramid (vks::DepthPyramid)
+*
+* Uploads known depth values to depth attachments of different sizes, builds the pyramid on the device and compares every level
+* against a CPU reference that reduces the depth pixels covered by each texel directly (instead of level by level like the shader)
+* Each attachment is built twice with different contents, so the second build also checks that the work group counter was reset
+* A 16 bit unorm attachment checks that the pyramid stores the depth values as they are sampled
+*
+* Copyright (C) 2026 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "testing.h"
+#include "VulkanBuffer.h"
+#include "VulkanDepthPyramid.h"
+#include "VulkanTools.h"
+
+struct DepthAttachment {
+	VkImage image{ VK_NULL_HANDLE };
+	VkDeviceMemory memory{ VK_NULL_HANDLE };
+	VkFormat format{ VK_FORMAT_UNDEFINED };
+	uint32_t width{ 0 };
+	uint32_t height{ 0 };
+};
+
+static DepthAttachment createDepthAttachment(vks::VulkanDevice* device, VkFormat depthFormat, uint32_t width, uint32_t height)
+{
+	DepthAttachment attachment;
+	attachment.format = depthFormat;
+	attachment.width = width;
+	attachment.height = height;
+	VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+	imageCI.imageType = VK_IMAGE_TYPE_2D;
+	imageCI.format = depthFormat;
+	imageCI.extent = { width, height, 1 };
+	imageCI.mipLevels = 1;
+	imageCI.arrayLayers = 1;
+	imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCI.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCI, nullptr, &attachment.image));
+	VkMemoryRequirements memReqs;
+	vkGetImageMemoryRequirements(device->logicalDevice, attachment.image, &memReqs);
+	VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+	memAlloc.allocationSize = memReqs.size;
+	memAlloc.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAlloc, nullptr, &attachment.memory));
+	VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, attachment.image, attachment.memory, 0));
+	return attachment;
+}
+
+// Random depth values, with a few boxes of nearer depth in the second pass so levels contain texels with a wide min/max range
+static std::vector<float> generateDepth(uint32_t width, uint32_t height, uint32_t pass)
+{
+	uint32_t state = 0x9e3779b9u * (pass + 1) + width * 31 + height;
+	auto random = [&state]() {
+		state = state * 1664525u + 1013904223u;
+		return static_cast<float>(state >> 8) / static_cast<float>(1 << 24);
+	};
+	std::vector<float> depth(size_t(width) * height);
+	for (float& value : depth) {
+		value = (pass == 0) ? random() : 0.9f + random() * 0.1f;
+	}
+	if (pass > 0) {
+		for (uint32_t box = 0; box < 8; box++) {
+			const uint32_t x0 = static_cast<uint32_t>(random() * width);
+			const uint32_t y0 = static_cast<uint32_t>(random() * height);
+			const uint32_t x1 = std::min(width, x0 + 1 + static_cast<uint32_t>(random() * width / 4));
+			const uint32_t y1 = std::min(height, y0 + 1 + static_cast<uint32_t>(random() * height / 4));
+			const float boxDepth = random() * 0.5f;
+			for (uint32_t y = y0; y < y1; y++) {
+				for (uint32_t x = x0; x < x1; x++) {
+					depth[size_t(y) * width + x] = boxDepth;
+				}
+			}
+		}
+	}
+	return depth;
+}
+
+// A texel (x, y) of level n covers the depth pixels [x, x + 1) * 2^(n + 1), pixels outside of the attachment are clamped to its border
+static void referenceTexel(const std::vector<float>& depth, uint32_t width, uint32_t height, uint32_t level, uint32_t x, uint32_t y, float& minDepth, float& maxDepth)
+{
+	const uint32_t footprint = 2u << level;
+	const uint32_t x0 = std::min(x * footprint, width - 1);
+	const uint32_t y0 = std::min(y * footprint, height - 1);
+	const uint32_t x1 = std::max(std::min((x + 1) * footprint, width), x0 + 1);
+	const uint32_t y1 = std::max(std::min((y + 1) * footprint, height), y0 + 1);
+	minDepth = 1.0f;
+	maxDepth = 0.0f;
+	for (uint32_t sy = y0; sy < y1; sy++) {
+		for (uint32_t sx = x0; sx < x1; sx++) {
+			minDepth = std::min(minDepth, depth[size_t(sy) * width + sx]);
+			maxDepth = std::max(maxDepth, depth[size_t(sy) * width + sx]);
+		}
+	}
+}
+
+// Quantize the depth values to what a 16 bit unorm attachment stores, the pyramid has to contain the values sampling them returns
+static std::vector<uint16_t> quantizeDepth(std::vector<float>& depth)
+{
+	std::vector<uint16_t> values(depth.size());
+	for (size_t i = 0; i < depth.size(); i++) {
+		values[i] = static_cast<uint16_t>(depth[i] * 65535.0f + 0.5f);
+		depth[i] = values[i] / 65535.0f;
+	}
+	return values;
+}
+
+static void testAttachment(vks::test::HeadlessDevice& headless, VkFormat depthFormat, uint32_t width, uint32_t height)
+{
+	vks::VulkanDevice* device = headless.device;
+	DepthAttachment attachment = createDepthAttachment(device, depthFormat, width, height);
+	vks::DepthPyramid depthPyramid;
+	TEST_CHECK(depthPyramid.create(device, headless.queue, headless.shaderCache, headless.shadersPath, attachment.image, depthFormat, width, height));
+
+	// Expected pyramid size: half the attachment size rounded up to a power of two, down to 1x1
+	uint32_t expectedWidth = 1;
+	uint32_t expectedHeight = 1;
+	while (expectedWidth < (width + 1) / 2) {
+		expectedWidth <<= 1;
+	}
+	while (expectedHeight < (height + 1) / 2) {
+		expectedHeight <<= 1;
+	}
+	TEST_CHECK(depthPyramid.width == expectedWidth);
+	TEST_CHECK(depthPyramid.height == expectedHeight);
+	uint32_t expectedLevels = 1;
+	while ((std::max(expectedWidth, expectedHeight) >> expectedLevels) > 0) {
+		expectedLevels++;
+	}
+	TEST_CHECK(depthPyramid.mipLevels == expectedLevels);
+
+	std::vector<VkDeviceSize> levelOffsets(depthPyramid.mipLevels);
+	VkDeviceSize pyramidSize = 0;
+	for (uint32_t i = 0; i < depthPyramid.mipLevels; i++) {
+		levelOffsets[i] = pyramidSize;
+		pyramidSize += VkDeviceSize(std::max(depthPyramid.width >> i, 1u)) * std::max(depthPyramid.height >> i, 1u) * 2 * sizeof(float);
+	}
+	const bool unorm = (depthFormat == VK_FORMAT_D16_UNORM);
+	const VkDeviceSize depthSize = VkDeviceSize(width) * height * (unorm ? sizeof(uint16_t) : sizeof(float));
+	vks::Buffer uploadBuffer;
+	vks::Buffer readbackBuffer;
+	VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uploadBuffer, depthSize));
+	VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &readbackBuffer, pyramidSize));
+	VK_CHECK_RESULT(uploadBuffer.map());
+	VK_CHECK_RESULT(readbackBuffer.map());
+
+	const VkImageSubresourceRange depthRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+	const VkImageSubresourceRange pyramidRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, depthPyramid.mipLevels, 0, 1 };
+	for (uint32_t pass = 0; pass < 2; pass++) {
+		std::vector<float> depth = generateDepth(width, height, pass);
+		if (unorm) {
+			memcpy(uploadBuffer.mapped, quantizeDepth(depth).data(), depthSize);
+		} else {
+			memcpy(uploadBuffer.mapped, depth.data(), depthSize);
+		}
+
+		VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		// Upload the depth values and leave the attachment as a render pass writing depth would
+		vks::tools::insertImageMemoryBarrier(commandBuffer, attachment.image,
+			0, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			depthRange);
+		VkBufferImageCopy depthRegion{};
+		depthRegion.imageSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, 1 };
+		depthRegion.imageExtent = { width, height, 1 };
+		vkCmdCopyBufferToImage(commandBuffer, uploadBuffer.buffer, attachment.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &depthRegion);
+		vks::tools::insertImageMemoryBarrier(commandBuffer, attachment.image,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			depthRange);
+
+		depthPyramid.cmdBuild(commandBuffer);
+
+		vks::tools::insertImageMemoryBarrier(commandBuffer, depthPyramid.image,
+			VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+			VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			pyramidRange);
+		std::vector<VkBufferImageCopy> pyramidRegions(depthPyramid.mipLevels);
+		for (uint32_t i = 0; i < depthPyramid.mipLevels; i++) {
+			pyramidRegions[i].bufferOffset = levelOffsets[i];
+			pyramidRegions[i].imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 };
+			pyramidRegions[i].imageExtent = { std::max(depthPyramid.width >> i, 1u), std::max(depthPyramid.height >> i, 1u), 1 };
+		}
+		vkCmdCopyImageToBuffer(commandBuffer, depthPyramid.image, VK_IMAGE_LAYOUT_GENERAL, readbackBuffer.buffer, depthPyramid.mipLevels, pyramidRegions.data());
+		device->flushCommandBuffer(commandBuffer, headless.queue, true);
+
+		// Depth values are stored as 32 bit floats and only compared, so the results have to match exactly (unorm to float conversion may round differently on the device)
+		const float tolerance = unorm ? 1.0e-6f : 0.0f;
+		for (uint32_t level = 0; level < depthPyramid.mipLevels; level++) {
+			const uint32_t levelWidth = std::max(depthPyramid.width >> level, 1u);
+			const uint32_t levelHeight = std::max(depthPyramid.height >> level, 1u);
+			const float* texels = reinterpret_cast<const float*>(static_cast<const uint8_t*>(readbackBuffer.mapped) + levelOffsets[level]);
+			uint32_t mismatches = 0;
+			for (uint32_t y = 0; y < levelHeight; y++) {
+				for (uint32_t x = 0; x < levelWidth; x++) {
+					float minDepth, maxDepth;
+					referenceTexel(depth, width, height, level, x, y, minDepth, maxDepth);
+					const float* texel = texels + (size_t(y) * levelWidth + x) * 2;
+					if (std::abs(texel[0] - minDepth) > tolerance || std::abs(texel[1] - maxDepth) > tolerance) {
+						if (mismatches == 0) {
+							std::cerr << (unorm ? "D16 " : "D32 ") << width << "x" << height << " pass " << pass << ", level " << level << " texel (" << x << ", " << y << "): min/max "
+								<< texel[0] << "/" << texel[1] << ", expected " << minDepth << "/" << maxDepth << "\n";
+						}
+						mismatches++;
+					}
+				}
+			}
+			TEST_CHECK(mismatches == 0);
+		}
+	}
+
+	uploadBuffer.destroy();
+	readbackBuffer.destroy();
+	depthPyramid.destroy();
+	vkDestroyImage(device->logicalDevice, attachment.image, nullptr);
+	vkFreeMemory(device->logicalDevice, attachment.memory, nullptr);
+}
+
+int main()
+{
+	vks::test::HeadlessDevice headless;
+	VkPhysicalDeviceFeatures enabledFeatures{};
+	enabledFeatures.shaderStorageImageExtendedFormats = VK_TRUE;
+	if (!headless.create(enabledFeatures)) {
+		return vks::test::skip("depthpyramid", "no Vulkan device with rg32f storage image support");
+	}
+	// Sizes cover a single work group, several work groups with partial tiles at the borders, non power of two and very
+	// unequal dimensions (where one side of the pyramid reaches a single texel long before the other) and the smallest attachment
+	const uint32_t sizes[][2] = { { 1, 1 }, { 7, 5 }, { 128, 128 }, { 333, 197 }, { 1920, 1080 }, { 2560, 1440 }, { 4096, 6 }, { 3, 2049 } };
+	for (VkFormat depthFormat : { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM }) {
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(headless.device->physicalDevice, depthFormat, &formatProperties);
+		if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+			if (depthFormat == VK_FORMAT_D32_SFLOAT) {
+				return vks::test::skip("depthpyramid", "depth format can't be sampled");
+			}
+			continue;
+		}
+		for (auto& size : sizes) {
+			testAttachment(headless, depthFormat, size[0], size[1]);
+		}
+	}
+
+	return vks::test::result("depthpyramid");
+}
@@ -0,0 +1,219 @@
+/*
+* Test for the clustered light culling (vks::LightClusters)
+*
+* Builds the clusters on the device for several light sets, cameras and grid sizes and compares every cluster's light list against
+* a CPU reference that tests each light against the cluster's view space bounds. The sets include no lights, light counts that
+* aren't a multiple of the culling work group size, lights that cover every cluster and clusters with more lights than the limit.
+* All sets of a grid are built with the same object, so later builds also check that the counters are reset
+*
+* Copyright (C) 2026 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "testing.h"
+#include "VulkanBuffer.h"
+#include "VulkanLightClusters.h"
+#include "VulkanTools.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+struct View {
+	glm::mat4 view;
+	glm::mat4 projection;
+	float zNear;
+	float zFar;
+};
+
+// View space bounds of a cluster, same calculation as the culling shader
+static void getClusterBounds(const vks::LightClusters& lightClusters, const View& view, uint32_t x, uint32_t y, uint32_t z, glm::vec3& boundsMin, glm::vec3& boundsMax)
+{
+	const uint32_t* gridSize = lightClusters.settings.gridSize;
+	const glm::mat4 inverseProjection = glm::inverse(view.projection);
+	const float sliceNear = view.zNear * pow(view.zFar / view.zNear, float(z) / float(gridSize[2]));
+	const float sliceFar = view.zNear * pow(view.zFar / view.zNear, float(z + 1) / float(gridSize[2]));
+	// Rays through the corners of the tile, scaled to both ends of the slice
+	boundsMin = glm::vec3(FLT_MAX);
+	boundsMax = glm::vec3(-FLT_MAX);
+	for (uint32_t i = 0; i < 4; i++) {
+		const glm::vec2 ndc = glm::vec2(float(x + (i & 1)) / float(gridSize[0]), float(y + (i >> 1)) / float(gridSize[1])) * 2.0f - 1.0f;
+		glm::vec4 ray = inverseProjection * glm::vec4(ndc, 1.0f, 1.0f);
+		const glm::vec3 direction = glm::vec3(ray) / ray.w;
+		for (float depth : { sliceNear, sliceFar }) {
+			const glm::vec3 corner = direction * (depth / -direction.z);
+			boundsMin = glm::min(boundsMin, corner);
+			boundsMax = glm::max(boundsMax, corner);
+		}
+	}
+}
+
+// Lights scattered in a box in front of the camera, with ranges from a fraction of a cluster to several clusters
+static std::vector<vks::LightClusters::Light> randomLights(uint32_t count, float minRange, float maxRange, uint32_t seed)
+{
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	std::vector<vks::LightClusters::Light> lights(count);
+	for (vks::LightClusters::Light& light : lights) {
+		light.position = glm::vec3(uniform(random) * 80.0f - 40.0f, uniform(random) * 40.0f - 20.0f, uniform(random) * 120.0f - 100.0f);
+		light.range = minRange + uniform(random) * (maxRange - minRange);
+		light.color = glm::vec3(1.0f);
+		light.intensity = 1.0f;
+	}
+	return lights;
+}
+
+// Build the clusters for a set of lights and compare the light lists against the CPU reference
+static void testLights(vks::test::HeadlessDevice& headless, vks::LightClusters& lightClusters, const std::vector<vks::LightClusters::Light>& lights, const View& view, const std::string& name)
+{
+	vks::VulkanDevice* device = headless.device;
+	lightClusters.updateLights(lights.data(), static_cast<uint32_t>(lights.size()));
+	lightClusters.updateView(view.view, view.projection, view.zNear, view.zFar);
+
+	const VkDeviceSize clusterSize = lightClusters.clusterBuffer.size;
+	vks::Buffer readbackBuffer;
+	VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &readbackBuffer, clusterSize + lightClusters.lightIndexBuffer.size));
+	VK_CHECK_RESULT(readbackBuffer.map());
+
+	VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+	lightClusters.cmdBuild(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT);
+	VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	VkBufferCopy copyRegion = { 0, 0, clusterSize };
+	vkCmdCopyBuffer(commandBuffer, lightClusters.clusterBuffer.buffer, readbackBuffer.buffer, 1, &copyRegion);
+	copyRegion = { 0, clusterSize, lightClusters.lightIndexBuffer.size };
+	vkCmdCopyBuffer(commandBuffer, lightClusters.lightIndexBuffer.buffer, readbackBuffer.buffer, 1, &copyRegion);
+	device->flushCommandBuffer(commandBuffer, headless.queue, true);
+	lightClusters.updateStatistics();
+
+	const uint32_t* clusters = static_cast<const uint32_t*>(readbackBuffer.mapped);
+	const uint32_t* lightIndices = reinterpret_cast<const uint32_t*>(static_cast<const uint8_t*>(readbackBuffer.mapped) + clusterSize);
+	const uint32_t* gridSize = lightClusters.settings.gridSize;
+	const uint32_t maxLightsPerCluster = lightClusters.settings.maxLightsPerCluster;
+
+	std::vector<glm::vec3> viewPositions(lights.size());
+	for (size_t i = 0; i < lights.size(); i++) {
+		viewPositions[i] = glm::vec3(view.view * glm::vec4(lights[i].position, 1.0f));
+	}
+
+	// Lights are classified as certainly inside or outside of a cluster with a small tolerance, as CPU and GPU round differently
+	uint32_t mismatches = 0;
+	uint32_t indexCount = 0;
+	uint32_t saturatedClusters = 0;
+	uint32_t fullClusters = 0;
+	std::vector<bool> listed(lights.size());
+	for (uint32_t z = 0; z < gridSize[2]; z++) {
+		for (uint32_t y = 0; y < gridSize[1]; y++) {
+			for (uint32_t x = 0; x < gridSize[0]; x++) {
+				const uint32_t clusterIndex = (z * gridSize[1] + y) * gridSize[0] + x;
+				const uint32_t offset = clusters[clusterIndex * 2 + 0];
+				const uint32_t count = clusters[clusterIndex * 2 + 1];
+				indexCount += count;
+				fullClusters += (count == maxLightsPerCluster) ? 1 : 0;
+				std::string error;
+				if (count > maxLightsPerCluster || offset + count > lightClusters.statistics.lightIndexCount) {
+					error = "invalid light list";
+				}
+				// Lights have to be listed in ascending order, which also rules out duplicates
+				std::fill(listed.begin(), listed.end(), false);
+				for (uint32_t i = 0; i < count && error.empty(); i++) {
+					const uint32_t lightIndex = lightIndices[offset + i];
+					if (lightIndex >= lights.size() || (i > 0 && lightIndex <= lightIndices[offset + i - 1])) {
+						error = "invalid light index " + std::to_string(lightIndex);
+					} else {
+						listed[lightIndex] = true;
+					}
+				}
+				glm::vec3 boundsMin, boundsMax;
+				getClusterBounds(lightClusters, view, x, y, z, boundsMin, boundsMax);
+				uint32_t referenceCount = 0;
+				for (size_t i = 0; i < lights.size() && error.empty(); i++) {
+					const float distance = glm::length(glm::clamp(viewPositions[i], boundsMin, boundsMax) - viewPositions[i]);
+					const float tolerance = 1.0e-3f * std::max(lights[i].range, 1.0f);
+					if (distance < lights[i].range - tolerance) {
+						referenceCount++;
+						// Lights beyond the limit are dropped
+						if (!listed[i] && count < maxLightsPerCluster) {
+							error = "light " + std::to_string(i) + " is missing";
+						}
+					}
+					if (distance > lights[i].range + tolerance && listed[i]) {
+						error = "light " + std::to_string(i) + " is out of range";
+					}
+				}
+				if (error.empty() && count < std::min(referenceCount, maxLightsPerCluster)) {
+					error = "light count " + std::to_string(count) + ", expected " + std::to_string(referenceCount);
+				}
+				saturatedClusters += (referenceCount > maxLightsPerCluster) ? 1 : 0;
+				if (!error.empty()) {
+					if (mismatches == 0) {
+						std::cerr << name << ", cluster (" << x << ", " << y << ", " << z << "): " << error << "\n";
+					}
+					mismatches++;
+				}
+			}
+		}
+	}
+	TEST_CHECK(mismatches == 0);
+	TEST_CHECK(lightClusters.statistics.lightIndexCount == indexCount);
+	// Only clusters with lights that certainly intersect have to be reported as saturated, clusters at the limit may be
+	TEST_CHECK(lightClusters.statistics.saturatedClusterCount >= saturatedClusters);
+	TEST_CHECK(lightClusters.statistics.saturatedClusterCount <= fullClusters);
+
+	readbackBuffer.destroy();
+}
+
+static void testGrid(vks::test::HeadlessDevice& headless, uint32_t gridX, uint32_t gridY, uint32_t gridZ, uint32_t maxLightsPerCluster)
+{
+	const std::string grid = std::to_string(gridX) + "x" + std::to_string(gridY) + "x" + std::to_string(gridZ);
+	vks::LightClusters lightClusters;
+	lightClusters.settings.gridSize[0] = gridX;
+	lightClusters.settings.gridSize[1] = gridY;
+	lightClusters.settings.gridSize[2] = gridZ;
+	lightClusters.settings.maxLightsPerCluster = maxLightsPerCluster;
+	lightClusters.create(headless.device, headless.queue, headless.shaderCache, headless.shadersPath, 5000);
+	TEST_CHECK(lightClusters.clusterCount() == gridX * gridY * gridZ);
+
+	const View views[] = {
+		{ glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f)), glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 256.0f), 0.1f, 256.0f },
+		{ glm::lookAt(glm::vec3(10.0f, 5.0f, 10.0f), glm::vec3(-5.0f, -2.0f, -40.0f), glm::vec3(0.0f, 1.0f, 0.0f)), glm::perspective(glm::radians(90.0f), 1.0f, 0.5f, 100.0f), 0.5f, 100.0f },
+	};
+	for (uint32_t v = 0; v < 2; v++) {
+		const std::string name = grid + ", view " + std::to_string(v);
+		testLights(headless, lightClusters, {}, views[v], name + ", no lights");
+		TEST_CHECK(lightClusters.statistics.lightIndexCount == 0);
+		testLights(headless, lightClusters, randomLights(1, 5.0f, 5.0f, 1), views[v], name + ", one light");
+		testLights(headless, lightClusters, randomLights(1000, 0.3f, 10.0f, 2), views[v], name + ", 1000 lights");
+		// One light covers everything, the others only a few clusters
+		std::vector<vks::LightClusters::Light> lights = randomLights(5000, 0.1f, 2.0f, 3);
+		lights[2500].range = 1000.0f;
+		testLights(headless, lightClusters, lights, views[v], name + ", 5000 lights");
+	}
+
+	lightClusters.destroy();
+}
+
+int main()
+{
+	vks::test::HeadlessDevice headless;
+	if (!headless.create()) {
+		return vks::test::skip("lightclusters", "no Vulkan device");
+	}
+
+	// The example's grid, a grid whose cluster count isn't a multiple of the work group size and one with a low light limit
+	// that saturates most clusters
+	testGrid(headless, 16, 9, 24, 256);
+	testGrid(headless, 5, 3, 7, 256);
+	testGrid(headless, 8, 4, 6, 16);
+
+	return vks::test::result("lightclusters");
+}
@@ -0,0 +1,198 @@
+/*
+* Test for the n-body compute shaders of the computenbody example against the CPU simulation (vks::NBodySimulation)
+*
+* Runs one simulation step (force calculation and integration) on the device and compares the particles with one step of the
+* CPU simulation. Particle counts aren't multiples of the work group or shared memory tile size, so partially filled tiles and
+* invocations past the last particle are covered. The smallest tile is checked along with the largest one the device supports
+*
+* Copyright (C) 2026 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "testing.h"
+#include "VulkanBuffer.h"
+#include "VulkanCpuSimulation.h"
+#include "VulkanTools.h"
+
+using Particle = vks::NBodySimulation::Particle;
+
+// Same layout as the uniform block of the compute shaders
+struct UniformData {
+	// Larger than in the example, so errors in the forces change the velocities by more than the tolerance
+	float deltaT{ 0.05f };
+	int32_t particleCount{ 0 };
+	float gravity{ 0.002f };
+	float power{ 0.75f };
+	float soften{ 0.05f };
+};
+
+// Largest relative error that passes, tighter than the validation of the example as a single step from a known state is compared
+static const float tolerance = 1e-4f;
+
+// Normally distributed cloud of particles with a heavy body every thousand particles, similar to the attractors of the example
+static std::vector<Particle> generateParticles(uint32_t count)
+{
+	std::mt19937 random(count);
+	std::normal_distribution<float> normal(0.0f, 1.0f);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	std::vector<Particle> particles(count);
+	for (uint32_t i = 0; i < count; i++) {
+		const glm::vec3 position = glm::vec3(normal(random), normal(random), normal(random)) * 2.0f;
+		const float mass = (i % 1000 == 0) ? 1000.0f : 1.0f + uniform(random);
+		particles[i].pos = glm::vec4(position, mass);
+		particles[i].vel = glm::vec4(glm::vec3(normal(random), normal(random), normal(random)) * 0.1f, uniform(random));
+	}
+	return particles;
+}
+
+class NBodyPipelines
+{
+public:
+	vks::test::HeadlessDevice& headless;
+	VkDescriptorPool descriptorPool{ VK_NULL_HANDLE };
+	VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
+	VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
+	VkPipeline pipelineIntegrate{ VK_NULL_HANDLE };
+
+	NBodyPipelines(vks::test::HeadlessDevice& headless) : headless(headless)
+	{
+		VkDevice logicalDevice = headless.device->logicalDevice;
+		// Same bindings as the compute pipelines of the example
+		std::vector<VkDescriptorPoolSize> poolSizes = {
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1)
+		};
+		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 1);
+		descriptorPoolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+		VK_CHECK_RESULT(vkCreateDescriptorPool(logicalDevice, &descriptorPoolInfo, nullptr, &descriptorPool));
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+		};
+		VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(logicalDevice, &descriptorLayout, nullptr, &descriptorSetLayout));
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkCreatePipelineLayout(logicalDevice, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout));
+		pipelineIntegrate = createPipeline("particle_integrate.comp.spv", nullptr);
+	}
+
+	~NBodyPipelines()
+	{
+		VkDevice logicalDevice = headless.device->logicalDevice;
+		vkDestroyPipeline(logicalDevice, pipelineIntegrate, nullptr);
+		vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
+		vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+	}
+
+	VkPipeline createPipeline(const char* fileName, const VkSpecializationInfo* specializationInfo)
+	{
+		VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
+		computePipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		computePipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		computePipelineCreateInfo.stage.module = headless.shaderCache.get(headless.shadersPath + "computenbody/" + fileName);
+		computePipelineCreateInfo.stage.pName = "main";
+		computePipelineCreateInfo.stage.pSpecializationInfo = specializationInfo;
+		VkPipeline pipeline;
+		VK_CHECK_RESULT(vkCreateComputePipelines(headless.device->logicalDevice, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &pipeline));
+		return pipeline;
+	}
+};
+
+static void testStep(NBodyPipelines& pipelines, uint32_t particleCount, uint32_t tileSize)
+{
+	vks::test::HeadlessDevice& headless = pipelines.headless;
+	vks::VulkanDevice* device = headless.device;
+	VkDevice logicalDevice = device->logicalDevice;
+	const std::vector<Particle> particles = generateParticles(particleCount);
+	const VkDeviceSize bufferSize = particleCount * sizeof(Particle);
+	UniformData uniformData;
+	uniformData.particleCount = static_cast<int32_t>(particleCount);
+
+	vks::Buffer storageBuffer, stagingBuffer, uniformBuffer;
+	VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &storageBuffer, bufferSize));
+	VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, bufferSize, (void*)particles.data()));
+	VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffer, sizeof(UniformData), &uniformData));
+	VK_CHECK_RESULT(stagingBuffer.map());
+
+	VkDescriptorSet descriptorSet;
+	VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(pipelines.descriptorPool, &pipelines.descriptorSetLayout, 1);
+	VK_CHECK_RESULT(vkAllocateDescriptorSets(logicalDevice, &allocInfo, &descriptorSet));
+	std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+		vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &storageBuffer.descriptor),
+		vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, &uniformBuffer.descriptor)
+	};
+	vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+	VkSpecializationMapEntry specializationMapEntry = vks::initializers::specializationMapEntry(0, 0, sizeof(uint32_t));
+	VkSpecializationInfo specializationInfo = vks::initializers::specializationInfo(1, &specializationMapEntry, sizeof(uint32_t), &tileSize);
+	VkPipeline pipelineCalculate = pipelines.createPipeline("particle_calculate.comp.spv", &specializationInfo);
+
+	// One step, recorded the same way as in the example
+	VkBufferCopy copyRegion = { 0, 0, bufferSize };
+	const uint32_t groupCount = (particleCount + 255) / 256;
+	VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+	vkCmdCopyBuffer(commandBuffer, stagingBuffer.buffer, storageBuffer.buffer, 1, &copyRegion);
+	VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+	memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineCalculate);
+	vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.pipelineIntegrate);
+	vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+	memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	vkCmdCopyBuffer(commandBuffer, storageBuffer.buffer, stagingBuffer.buffer, 1, &copyRegion);
+	device->flushCommandBuffer(commandBuffer, headless.queue, true);
+
+	vks::NBodySimulation reference;
+	reference.parameters.deltaT = uniformData.deltaT;
+	reference.parameters.gravity = uniformData.gravity;
+	reference.parameters.power = uniformData.power;
+	reference.parameters.soften = uniformData.soften;
+	reference.setParticles(particles.data(), particleCount);
+	reference.step();
+	const vks::SimulationComparison comparison = reference.compare(static_cast<const Particle*>(stagingBuffer.mapped), tolerance);
+	if (!TEST_CHECK(comparison.passed)) {
+		std::cerr << particleCount << " particles, tile size " << tileSize << ": max. position error " << comparison.maxPositionError
+			<< ", max. velocity error " << comparison.maxVelocityError << " (particle " << comparison.worstParticle << ")\n";
+	}
+
+	vkDestroyPipeline(logicalDevice, pipelineCalculate, nullptr);
+	vkFreeDescriptorSets(logicalDevice, pipelines.descriptorPool, 1, &descriptorSet);
+	storageBuffer.destroy();
+	stagingBuffer.destroy();
+	uniformBuffer.destroy();
+}
+
+int main()
+{
+	vks::test::HeadlessDevice headless;
+	if (!headless.create()) {
+		return vks::test::skip("nbody", "no Vulkan device");
+	}
+
+	{
+		NBodyPipelines pipelines(headless);
+		// The example uses the largest tile that fits into shared memory (up to 1024 particles)
+		const uint32_t maxTileSize = std::min((uint32_t)1024, (uint32_t)(headless.device->properties.limits.maxComputeSharedMemorySize / sizeof(glm::vec4)));
+		// Fewer particles than a work group, a single heavy body and a count with partially filled work groups and tiles
+		for (uint32_t particleCount : { 100u, 1u, 3001u }) {
+			testStep(pipelines, particleCount, 256);
+			testStep(pipelines, particleCount, maxTileSize);
+		}
+	}
+
+	return vks::test::result("nbody");
+}
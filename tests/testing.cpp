@@ -0,0 +1,132 @@
+/*
+* Shared helpers for the tests of the base classes
+*
+* Copyright (C) 2026 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "testing.h"
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include "VulkanTools.h"
+
+namespace vks
+{
+	namespace test
+	{
+		static uint32_t failedChecks = 0;
+
+		bool check(bool condition, const char* expression, const char* file, int line)
+		{
+			if (!condition) {
+				std::cerr << file << ":" << line << ": check failed: " << expression << "\n";
+				failedChecks++;
+			}
+			return condition;
+		}
+
+		bool checkNear(double value, double expected, double tolerance, const char* expression, const char* file, int line)
+		{
+			const bool condition = std::abs(value - expected) <= tolerance;
+			if (!condition) {
+				std::cerr << file << ":" << line << ": check failed: " << expression << " is " << value << ", expected " << expected << " (tolerance " << tolerance << ")\n";
+				failedChecks++;
+			}
+			return condition;
+		}
+
+		int result(const std::string& testName)
+		{
+			if (failedChecks > 0) {
+				std::cout << testName << ": " << failedChecks << " check(s) failed\n";
+				return 1;
+			}
+			std::cout << testName << ": passed\n";
+			return 0;
+		}
+
+		int skip(const std::string& testName, const std::string& reason)
+		{
+			std::cout << testName << ": skipped (" << reason << ")\n";
+			return TEST_SKIP_RETURN_CODE;
+		}
+
+		HeadlessDevice::~HeadlessDevice()
+		{
+			if (device) {
+				vkDeviceWaitIdle(device->logicalDevice);
+				shaderCache.destroy();
+				delete device;
+			}
+			if (instance) {
+				vkDestroyInstance(instance, nullptr);
+			}
+		}
+
+		bool HeadlessDevice::create(VkPhysicalDeviceFeatures enabledFeatures, const std::vector<const char*>& enabledExtensions, void* pNextChain)
+		{
+			shadersPath = getShaderBasePath() + "glsl/";
+
+			VkApplicationInfo appInfo{};
+			appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+			appInfo.pApplicationName = "Vulkan base class tests";
+			appInfo.pEngineName = "VulkanExample";
+			appInfo.apiVersion = VK_API_VERSION_1_2;
+
+			// Instance without surface extensions
+			VkInstanceCreateInfo instanceCreateInfo{};
+			instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+			instanceCreateInfo.pApplicationInfo = &appInfo;
+			std::vector<const char*> instanceExtensions;
+#if (defined(VK_USE_PLATFORM_MACOS_MVK) || defined(VK_USE_PLATFORM_METAL_EXT)) && defined(VK_KHR_portability_enumeration)
+			// SRS - MoltenVK devices are only enumerated with the portability enumeration extension
+			instanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+			instanceExtensions.push_back(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME);
+			instanceCreateInfo.flags = VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR;
+#endif
+			instanceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(instanceExtensions.size());
+			instanceCreateInfo.ppEnabledExtensionNames = instanceExtensions.data();
+			if (vkCreateInstance(&instanceCreateInfo, nullptr, &instance) != VK_SUCCESS) {
+				instance = VK_NULL_HANDLE;
+				return false;
+			}
+
+			uint32_t deviceCount = 0;
+			vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+			std::vector<VkPhysicalDevice> physicalDevices(deviceCount);
+			vkEnumeratePhysicalDevices(instance, &deviceCount, physicalDevices.data());
+
+			// Features are compared member by member, VkPhysicalDeviceFeatures only consists of VkBool32s
+			const size_t featureCount = sizeof(VkPhysicalDeviceFeatures) / sizeof(VkBool32);
+			for (VkPhysicalDevice physicalDevice : physicalDevices) {
+				vks::VulkanDevice* candidate = new vks::VulkanDevice(physicalDevice);
+				// Not initialized by the constructor, but destroyed by the destructor if set
+				candidate->logicalDevice = VK_NULL_HANDLE;
+				bool suitable = true;
+				for (const char* extension : enabledExtensions) {
+					suitable &= candidate->extensionSupported(extension);
+				}
+				VkBool32 requested[featureCount];
+				VkBool32 supported[featureCount];
+				memcpy(requested, &enabledFeatures, sizeof(requested));
+				memcpy(supported, &candidate->features, sizeof(supported));
+				for (size_t i = 0; i < featureCount; i++) {
+					suitable &= !requested[i] || supported[i];
+				}
+				if (suitable && candidate->createLogicalDevice(enabledFeatures, enabledExtensions, pNextChain, false) == VK_SUCCESS) {
+					device = candidate;
+					vkGetDeviceQueue(device->logicalDevice, device->queueFamilyIndices.graphics, 0, &queue);
+					shaderCache.create(device->logicalDevice, "tests");
+					std::cout << "Running on " << device->properties.deviceName << "\n";
+					return true;
+				}
+				delete candidate;
+			}
+			return false;
+		}
+	}
+}
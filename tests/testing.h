@@ -0,0 +1,63 @@
+/*
+* Shared helpers for the tests of the base classes
+*
+* Failed checks are reported with their location and counted, a test returns result() from main
+* Tests that need a Vulkan device create a headless one and return skip() if that fails
+*
+* Copyright (C) 2026 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+#include "VulkanShaderCache.h"
+
+// Report and count a failed check, evaluates to the condition so a test can bail out of dependent checks
+#define TEST_CHECK(condition) vks::test::check((condition), #condition, __FILE__, __LINE__)
+// Same as TEST_CHECK, but also prints both values if the comparison fails
+#define TEST_CHECK_NEAR(value, expected, tolerance) vks::test::checkNear((value), (expected), (tolerance), #value, __FILE__, __LINE__)
+
+namespace vks
+{
+	namespace test
+	{
+		bool check(bool condition, const char* expression, const char* file, int line);
+		bool checkNear(double value, double expected, double tolerance, const char* expression, const char* file, int line);
+		/** @brief Exit code of the test, prints a summary of the failed checks */
+		int result(const std::string& testName);
+		/** @brief Exit code that marks a test as skipped (e.g. if there is no Vulkan device) */
+		int skip(const std::string& testName, const std::string& reason);
+
+		// Vulkan device without a surface, created with all features the base classes under test may need
+		class HeadlessDevice
+		{
+		public:
+			VkInstance instance{ VK_NULL_HANDLE };
+			vks::VulkanDevice* device{ nullptr };
+			// Queue of the graphics family, also used for compute and transfers
+			VkQueue queue{ VK_NULL_HANDLE };
+			std::string shadersPath;
+			// Shader modules of the base classes under test are loaded through this cache, like they are in the examples
+			vks::ShaderModuleCache shaderCache;
+
+			~HeadlessDevice();
+			/**
+			* Create the instance and a logical device on the first physical device that supports the requested extensions
+			*
+			* @param enabledFeatures Device features to enable, unsupported features make creation fail
+			* @param enabledExtensions Device extensions to enable
+			* @param pNextChain (Optional) Feature structures chained to the device creation
+			*
+			* @return False if there is no (suitable) device
+			*/
+			bool create(VkPhysicalDeviceFeatures enabledFeatures = {}, const std::vector<const char*>& enabledExtensions = {}, void* pNextChain = nullptr);
+		};
+	}
+}